@@ -23,13 +23,30 @@
 #include <stdlib.h>
 #include <stdexcept>
 #include "ParameterReader.h"
+#include "DefinitionSerializer.h"
+#include "MPITransport.h"
+#include "QueueTransport.h"
+#include "MessageQueue.h"
 #include <iostream>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <exception>
+#include <cstdint>
 #include "AnalysisRingItems.h"
 
 static const unsigned MINIMUM_SIZE(4);
 
+// The transport of the role running in this thread (see setTransport).
+
+static thread_local frib::analysis::CTransport* pThreadTransport(nullptr);
+
 namespace frib {
     namespace analysis {
+        // getTriggerCount value meaning 'to the end of the data':
+        
+        const std::uint64_t AbstractApplication::ALL_TRIGGERS(UINT64_MAX);
+        
         /**
          * constructor
          *   @param argc -number of command line arguments.
@@ -52,7 +69,6 @@ namespace frib {
             int reslen;
             char msg[MPI_MAX_ERROR_STRING];
                 
-            reader.read();
             int status = MPI_Init(&m_argc, &m_argv);
             if (status != MPI_SUCCESS) {
                 
@@ -68,7 +84,6 @@ namespace frib {
                     MPI_Error_string(status, msg, &reslen);
                     throw std::runtime_error(msg);
                 }
-                m_rank = rank;
                 status = MPI_Comm_size(MPI_COMM_WORLD, &size);
                 if (status != MPI_SUCCESS) {
                     MPI_Error_string(status, msg, &reslen);
@@ -88,34 +103,98 @@ namespace frib {
 
                 }
                 m_nWorkers = size - 3;
-                // Run in the appropriate role:
+                readDefinitions(reader, rank);
                 
-                 switch (rank) {
-                    case 0:
-                        dealer(m_argc, m_argv, this);
-                        break;
-                    case 1:
-                        farmer(m_argc, m_argv, this);
-                        break;
-                    case 2:
-                        outputter(m_argc, m_argv, this);
-                        break;
-                    default:
-                        worker(m_argc, m_argv, this);
-                        break;
+                // Run in the appropriate role.  The transport must be
+                // destroyed before MPI_Finalize.
+                {
+                    CMPITransport transport(*this);
+                    setTransport(&transport);
+                    runRole(rank);
+                    setTransport(nullptr);
                 }
+                
                 // Finalize the application:
                 
                 MPI_Finalize();
                 
             }
             catch (...) {
+                setTransport(nullptr);
                 MPI_Finalize();    // So MPI App does not hang.
                 throw;
             }
             // Caller is expected to exit.
             
         }
+        /**
+         * runThreaded
+         *    Entry point to run the application in this process.  MPI is
+         *    not used.  Each role runs in its own thread with its own rank
+         *    (same assignment as for MPI: 0 dealer, 1 farmer, 2 outputter,
+         *    and the rest workers).  The roles communicate via
+         *    CQueueTransports.
+         *
+         *    If a role throws, the mailboxes are aborted so that the other
+         *    roles don't wait forever; they'll throw too.  Once all threads
+         *    have exited, the first exception is rethrown.
+         *
+         * @param paramReader - object that knows how to read the parameter file.
+         * @param nWorkers    - number of worker threads.
+         * @throw std::invalid_argument - nWorkers is zero.
+         */
+        void
+        AbstractApplication::runThreaded(CParameterReader& reader, unsigned nWorkers) {
+            if (nWorkers == 0) {
+                throw std::invalid_argument("runThreaded needs at least one worker");
+            }
+            reader.read();
+            m_nWorkers = nWorkers;
+            
+            unsigned nRanks = nWorkers + FIRST_WORKER_RANK;
+            std::vector<CMessageQueue*> mailboxes;
+            std::vector<CQueueTransport*> transports;
+            for (int i = 0; i < int(nRanks); i++) {
+                mailboxes.push_back(new CMessageQueue);
+            }
+            for (int i = 0; i < int(nRanks); i++) {
+                transports.push_back(new CQueueTransport(mailboxes, i));
+            }
+            
+            std::mutex         errorLock;
+            std::exception_ptr firstError;
+            std::vector<std::thread> threads;
+            for (int i = 0; i < int(nRanks); i++) {
+                CQueueTransport* pTransport = transports[i];
+                threads.emplace_back([this, i, pTransport, &errorLock, &firstError]() {
+                    try {
+                        setTransport(pTransport);
+                        runRole(i);
+                    }
+                    catch (...) {
+                        {
+                            std::lock_guard<std::mutex> l(errorLock);
+                            if (!firstError) {
+                                firstError = std::current_exception();
+                            }
+                        }
+                        pTransport->abort();
+                    }
+                    setTransport(nullptr);
+                });
+            }
+            for (auto& t : threads) {
+                t.join();
+            }
+            
+            for (int i = 0; i < int(nRanks); i++) {
+                delete transports[i];
+                delete mailboxes[i];
+            }
+            if (firstError) {
+                std::rethrow_exception(firstError);
+            }
+        }
         ////////////////////////////////  Getters //////////////////////////////
         
         /**
@@ -175,6 +254,41 @@ namespace frib {
         unsigned AbstractApplication::numWorkers() {
             return m_nWorkers;    
         }
+        /**
+         * transport
+         *    @return CTransport& - the transport of the role that's running
+         *                   in the calling thread.
+         *    @throw std::logic_error - no role is running in this thread.
+         */
+        CTransport&
+        AbstractApplication::transport() {
+            if (!pThreadTransport) {
+                throw std::logic_error("No transport - a role is not running in this thread");
+            }
+            return *pThreadTransport;
+        }
+        /**
+         * getFirstTrigger
+         *    @param argc, argv - the command line parameters.
+         *    @return std::uint64_t - the first trigger to process.
+         *    @note all roles must agree on this so it's the application's.
+         *          The default is to start at the beginning of the data.
+         */
+        std::uint64_t
+        AbstractApplication::getFirstTrigger(int argc, char** argv) {
+            return 0;
+        }
+        /**
+         * getTriggerCount
+         *    @param argc, argv - the command line parameters.
+         *    @return std::uint64_t - the number of triggers to process,
+         *            ALL_TRIGGERS (the default) processes them to the end of
+         *            the data.
+         */
+        std::uint64_t
+        AbstractApplication::getTriggerCount(int argc, char** argv) {
+            return ALL_TRIGGERS;
+        }
         /**
          * forwardPassThrough
          *    Send bytes without any real interpretation to the output
@@ -189,19 +303,16 @@ namespace frib {
             header.s_triggerNumber = 0;       // ignored.
             header.s_numParameters = nBytes;  // Actualy block size...
             header.s_end           = false;   // not an end.
-            int status = MPI_Send(
-                &header, 1, parameterHeaderDataType(),
-                2, MPI_PASSTHROUGH_TAG, MPI_COMM_WORLD
+            transport().send(
+                &header, 1, CTransport::PARAMETER_HEADER, OUTPUTTER_RANK,
+                MPI_PASSTHROUGH_TAG
             );
-            throwMPIError(status, "Failed to send passthrough header: ");
             
             // Now the data block itself:
             
-            status = MPI_Send(
-                pData, nBytes, MPI_UINT8_T,
-                2, MPI_DATA_TAG, MPI_COMM_WORLD
+            transport().send(
+                pData, nBytes, CTransport::BYTES, OUTPUTTER_RANK, MPI_DATA_TAG
             );
-            throwMPIError(status, "Failed to send passthrough data block: ");
         }
         
         /**
@@ -225,6 +336,110 @@ namespace frib {
         AbstractApplication::getArgv()  {
             return m_argv;
         }
+        /**
+         * setTransport
+         *    Set the transport returned by transport() in the calling thread.
+         *    operator() and runThreaded do this before running a role;
+         *    derived classes that override them must do so too.
+         * @param pTransport - the transport (nullptr to clear it).
+         */
+        void
+        AbstractApplication::setTransport(CTransport* pTransport) {
+            pThreadTransport = pTransport;
+        }
+        /**
+         * readDefinitions
+         *    Only rank 0 runs the parameter reader.  It packs the
+         *    resulting tree parameter and variable definitions
+         *    (CDefinitionSerializer) and broadcasts them to the other ranks
+         *    which unpack them.  This is much faster than running the
+         *    reader everywhere when there are many ranks.
+         *
+         *    If the reader fails on rank 0, an empty blob is sent so the
+         *    other ranks fail too rather than waiting forever.  Similarly,
+         *    if any rank fails to unpack the blob, all ranks fail.
+         * @param reader - object that knows how to read the parameter file.
+         * @param rank   - our rank in MPI_COMM_WORLD.
+         * @throw std::runtime_error - rank 0 could not read the definitions
+         *                 (on rank 0 it's whatever the reader threw) or some
+         *                 rank could not unpack them (on that rank it's
+         *                 whatever CDefinitionSerializer threw).
+         */
+        void
+        AbstractApplication::readDefinitions(CParameterReader& reader, int rank) {
+            std::vector<std::uint8_t> blob;
+            std::exception_ptr readError;
+            if (rank == DEALER_RANK) {
+                try {
+                    reader.read();
+                    blob = CDefinitionSerializer::serialize();
+                }
+                catch (...) {
+                    readError = std::current_exception();
+                    blob.clear();
+                }
+            }
+            std::uint64_t nBytes = blob.size();
+            int status = MPI_Bcast(&nBytes, 1, MPI_UINT64_T, DEALER_RANK, MPI_COMM_WORLD);
+            throwMPIError(status, "Unable to broadcast definition size: ");
+            if (readError) {
+                std::rethrow_exception(readError);
+            }
+            if (nBytes == 0) {
+                throw std::runtime_error("Rank 0 could not read the parameter definitions");
+            }
+            
+            blob.resize(nBytes);
+            status = MPI_Bcast(
+                blob.data(), nBytes, MPI_UINT8_T, DEALER_RANK, MPI_COMM_WORLD
+            );
+            throwMPIError(status, "Unable to broadcast definitions: ");
+            
+            // Everyone needs to know if any rank failed to unpack the
+            // definitions or the others would wait for it forever.
+            
+            std::exception_ptr unpackError;
+            if (rank != DEALER_RANK) {
+                try {
+                    CDefinitionSerializer::deserialize(blob.data(), nBytes);
+                }
+                catch (...) {
+                    unpackError = std::current_exception();
+                }
+            }
+            int ok = unpackError ? 0 : 1;
+            int allOk;
+            status = MPI_Allreduce(&ok, &allOk, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+            throwMPIError(status, "Unable to check definitions were unpacked: ");
+            if (unpackError) {
+                std::rethrow_exception(unpackError);
+            }
+            if (!allOk) {
+                throw std::runtime_error("Some ranks could not unpack the parameter definitions");
+            }
+        }
+        /**
+         * runRole
+         *    Run the role method for a rank.
+         * @param rank - the rank.
+         */
+        void
+        AbstractApplication::runRole(int rank) {
+            switch (rank) {
+                case DEALER_RANK:
+                    dealer(m_argc, m_argv, this);
+                    break;
+                case FARMER_RANK:
+                    farmer(m_argc, m_argv, this);
+                    break;
+                case OUTPUTTER_RANK:
+                    outputter(m_argc, m_argv, this);
+                    break;
+                default:
+                    worker(m_argc, m_argv, this);
+                    break;
+            }
+        }
         /**
          *  makeDataTypes
          *    Creates any MPI custom data types we need.
@@ -240,7 +455,7 @@ namespace frib {
                 1,1, 1
             };
             MPI_Datatype types[3] = {
-                MPI_INT, MPI_INT, MPI_CXX_BOOL
+                MPI_INT, MPI_UINT64_T, MPI_CXX_BOOL
             };
             MPI_Aint offsets[3] = {
                 offsetof(FRIB_MPI_Message_Header, s_nBytes),
@@ -261,12 +476,14 @@ namespace frib {
             }
             // Data Request:
             
+            types[1]    = MPI_INT;
+            types[2]    = MPI_INT;
             offsets[0]  = offsetof(FRIB_MPI_Request_Data, s_requestor);
             offsets[1]  = offsetof(FRIB_MPI_Request_Data, s_maxdata);
-            
+            offsets[2]  = offsetof(FRIB_MPI_Request_Data, s_credits);
             
             status = MPI_Type_create_struct(
-                2, lengths, offsets, types, &m_requestDataType
+                3, lengths, offsets, types, &m_requestDataType
             );
             if (status != MPI_SUCCESS) {
                 throw std::runtime_error("Unable to create data request  MPI type");
@@ -364,19 +581,60 @@ namespace frib {
         /**
          * requestData
          *    Send a request for data to the dealer
-         *  @param maxBytes - maxium payload we want to accept.
+         *  @param maxBytes - maxium payload we want to accept.  This is only
+         *                    enforced for workers that prefetch.
+         *  @param credits  - number of requests the worker keeps outstanding
+         *                    (0 if it waits for each request to be satisfied
+         *                    before making the next).
          */
         void
-        AbstractApplication::requestData(size_t maxBytes) {
+        AbstractApplication::requestData(size_t maxBytes, unsigned credits) {
             FRIB_MPI_Request_Data req;
-            req.s_requestor = m_rank;
-            req.s_maxdata   = maxBytes;   // currently gets ignored anyway.
+            req.s_requestor = transport().rank();
+            req.s_maxdata   = maxBytes;
+            req.s_credits   = credits;
             
-            int status = MPI_Send(
-                &req, 1, requestDataType(),
-                0, MPI_REQUEST_TAG, MPI_COMM_WORLD
+            transport().send(
+                &req, 1, CTransport::REQUEST_DATA, DEALER_RANK, MPI_REQUEST_TAG
             );
-            throwMPIError(status, "Unable to send work request: ");
+        }
+        /**
+         * workItemSize
+         *    Figure out how much of a block of ring items can be sent to
+         *    satisfy a request.  Workers that prefetch have posted receives
+         *    for at most s_maxdata bytes, so they get as many whole ring items
+         *    as fit in that.  Other workers get everything.
+         * @param request - the request being satisfied.
+         * @param pData   - the block of ring items.
+         * @param nBytes  - bytes in the block.
+         * @return size_t - number of bytes to send.
+         * @throw std::runtime_error - the first ring item doesn't fit.
+         */
+        size_t
+        AbstractApplication::workItemSize(
+            const FRIB_MPI_Request_Data& request,
+            const void* pData, size_t nBytes
+        ) {
+            size_t maxBytes = request.s_maxdata;
+            if ((request.s_credits <= 0) || (nBytes <= maxBytes)) {
+                return nBytes;
+            }
+            const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(pData);
+            size_t result = 0;
+            while (result < nBytes) {
+                const RingItemHeader* pHeader =
+                    reinterpret_cast<const RingItemHeader*>(p + result);
+                if ((result + pHeader->s_size) > maxBytes) {
+                    break;
+                }
+                result += pHeader->s_size;
+            }
+            if (result == 0) {
+                throw std::runtime_error(
+                    "A ring item is larger than a worker's prefetch buffer"
+                );
+            }
+            return result;
         }
         /**
          * throwMPIError
@@ -400,46 +658,85 @@ namespace frib {
         /**
          *  getRequest
          *     Receive a request from a worker and return the rank of the sender.
+         *  @param pRequest - if not null, the request is copied here so the
+         *                    caller can see e.g. how much data the worker
+         *                    can accept.
          *  @return int - requesting worker.
          */
         int
-        AbstractApplication:: getRequest() {
+        AbstractApplication:: getRequest(FRIB_MPI_Request_Data* pRequest) {
             
 
             FRIB_MPI_Request_Data req;
-            MPI_Status info;
-            int status = MPI_Recv(
-                &req, 1, requestDataType(), MPI_ANY_SOURCE,
-                MPI_ANY_TAG, MPI_COMM_WORLD, &info
+            CTransport::Status info = transport().recv(
+                &req, 1, CTransport::REQUEST_DATA,
+                CTransport::ANY_SOURCE, CTransport::ANY_TAG
             );
-            throwMPIError(status, "Failed to receive a data request: ");
             
             // Consistency check the rank in the request must be the same as
             // the one that sent us the request - note in the future,
             // this could be lifted if there's an agent that determines who
             // gets the next data item:
             
-            if (req.s_requestor != info.MPI_SOURCE) {
+            if (req.s_requestor != info.s_source) {
                 throw std::logic_error("Mismatch between requestor in data and actual sender");
             }
-            if (info.MPI_TAG != MPI_REQUEST_TAG) {
+            if (info.s_tag != MPI_REQUEST_TAG) {
                 throw std::logic_error("Request data but not a request tag");
             }
             
+            if (pRequest) {
+                *pRequest = req;
+            }
             // Returning this allows later support for an agent to request
             // data on behalf of another rank.
             
             return req.s_requestor;
 
         }
+        /**
+         * sendWorkItem
+         *    Grant a worker's request for data by sending it a work item:
+         *    a FRIB_MPI_Message_Header followed by the data.
+         * @param dest     - rank of the worker (from getRequest).
+         * @param blockNum - work item number put in the header.
+         * @param pData    - the data.
+         * @param nBytes   - number of bytes of data (see workItemSize).
+         */
+        void
+        AbstractApplication::sendWorkItem(
+            int dest, std::uint64_t blockNum, const void* pData, size_t nBytes
+        ) {
+            FRIB_MPI_Message_Header header;
+            header.s_nBytes    = nBytes;
+            header.s_nBlockNum = blockNum;
+            header.s_end       = false;
+            
+            transport().send(
+                &header, 1, CTransport::MESSAGE_HEADER, dest, MPI_HEADER_TAG
+            );
+            transport().send(pData, nBytes, CTransport::BYTES, dest, MPI_DATA_TAG);
+        }
         /**
          * sendEofs
-         *    Send all the EOFS to workers.
+         *    Send all the EOFS to workers.  Every outstanding request must
+         *    be answered, so workers that prefetch get an EOF for each of
+         *    their credits; we're done when every worker has had all of
+         *    the EOFs it's owed.
          */
         void
         AbstractApplication::sendEofs() {
-            for (int i =0; i < m_nWorkers; i++) {
-                sendEof();
+            std::vector<int> eofsSent(m_nWorkers + FIRST_WORKER_RANK, 0);
+            unsigned nDone = 0;
+            while (nDone < m_nWorkers) {
+                FRIB_MPI_Request_Data req;
+                int dest = getRequest(&req);
+                sendEof(dest);
+                
+                int owed = req.s_credits > 0 ? req.s_credits : 1;
+                if (++eofsSent.at(dest) == owed) {
+                    nDone++;
+                }
             }
         }
         /**
@@ -447,21 +744,23 @@ namespace frib {
          */
         void
         AbstractApplication::sendEof() {
+            sendEof(getRequest());
+        }
+        /**
+         * sendEof
+         *    Send an EOF to a worker whose request we already have.
+         * @param dest - rank of the worker.
+         */
+        void
+        AbstractApplication::sendEof(int dest) {
             FRIB_MPI_Message_Header header;
             header.s_nBytes = 0;
             header.s_nBlockNum = 0;
             header.s_end = true;
             
-            char errorWhy[MPI_MAX_ERROR_STRING];
-            int len;
-            
-            int dest = getRequest();
-            
-            int status = MPI_Send(
-                &header, 1, messageHeaderType(),
-                dest, MPI_HEADER_TAG, MPI_COMM_WORLD
+            transport().send(
+                &header, 1, CTransport::MESSAGE_HEADER, dest, MPI_HEADER_TAG
             );
-            throwMPIError(status, "Failed to send end of data message to worker: ");
         }
         
     }
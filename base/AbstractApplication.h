@@ -21,9 +21,11 @@
 #ifndef ABSTRACTAPPLICATION_H
 #define ABSTRACTAPPLICATION_H
 #include <mpi.h>
+#include "AnalysisRingItems.h"
 namespace frib {
     namespace analysis {
         class CParameterReader;
+        class CTransport;
         /**
          * @class AbstractApplication
          *    This class is a strategy pattern for the dealer/worker/farmer/outputter
@@ -68,7 +70,9 @@ namespace frib {
          *    Each process type is implemented as a pure virtual method.
          *    The function call operator():
          *     -   Calls MPI_INIT
-         *     -   Uses the ParameterReader it was passed to read in the parameter configuration.
+         *     -   Uses the ParameterReader it was passed to read in the parameter
+         *         configuration in rank 0 and broadcasts the resulting
+         *         definitions to the other ranks.
          *     -   If rank 0 figures out the extent of the program and if it is
          *         sufficient to run at least one worker.
          *     -   Depending on the rank, invokes the appropriate strategy
@@ -79,6 +83,20 @@ namespace frib {
          *  @note the operator() is also virtual to allow that logic to be
          *  overridden.
          *
+         *  The roles talk to each other through a CTransport which they get
+         *  from transport().  Under operator() that's a CMPITransport.
+         *  runThreaded is an alternative entry point that runs the whole
+         *  application in one process without MPI:  each role is a thread
+         *  with its own rank and the ranks talk through in-memory message
+         *  queues (CQueueTransport).  The role methods are unchanged; each
+         *  thread's transport() is its own.
+         *  @note in a threaded application, the roles share whatever static
+         *  data the user code has.  Worker code must be safe to run in
+         *  several threads at once.  The framework's workers give each
+         *  worker its own tree parameter context, so tree parameters are
+         *  safe as long as they are all defined before the workers start
+         *  (e.g. by the parameter reader).
+         *
          *  A typical use of this class woud be to:
          *  \verbatim
          *
@@ -97,9 +115,18 @@ namespace frib {
          *  }
          *  
          *  \endverbatim
+         *  or, to run with 8 worker threads and no mpirun, replace
+         *  app(configReader) with app.runThreaded(configReader, 8).
+         *
+         *  An application can process a range of triggers rather than all
+         *  of them by overriding getFirstTrigger and getTriggerCount.  The
+         *  dealers start at the first trigger (seeking to it if the input
+         *  has a CTriggerIndex) and the farmer expects it first.
          *   
          */
         class AbstractApplication {
+        public:
+            static const std::uint64_t ALL_TRIGGERS;
         private:
             // Keep the program arguments so that we can access them from the
             // methods.
@@ -107,7 +134,6 @@ namespace frib {
             int m_argc;
             char** m_argv;
             unsigned m_nWorkers;
-            int    m_rank;
         private:
             MPI_Datatype  m_messageHeaderType;
             MPI_Datatype  m_requestDataType;
@@ -128,6 +154,7 @@ namespace frib {
             // Application entry point.
             
             virtual void operator()(CParameterReader& paramReader);
+            virtual void runThreaded(CParameterReader& paramReader, unsigned nWorkers);
             
             // Roles in the program (Strategy methods).
             
@@ -146,14 +173,28 @@ namespace frib {
             MPI_Datatype& variableDefType();
             
             unsigned numWorkers();
+            CTransport& transport();
+            
+            // Range of triggers to process:
+            
+            virtual std::uint64_t getFirstTrigger(int argc, char** argv);
+            virtual std::uint64_t getTriggerCount(int argc, char** argv);
             
             // Code factored out of other bits of the system:
             
             void forwardPassThrough(const void* pData, size_t nBytes);
-            int  getRequest();
+            int  getRequest(FRIB_MPI_Request_Data* pRequest = nullptr);
             void sendEofs();
             void sendEof();
-            void requestData(size_t maxBytes);
+            void sendEof(int dest);
+            void requestData(size_t maxBytes, unsigned credits = 0);
+            size_t workItemSize(
+                const FRIB_MPI_Request_Data& request,
+                const void* pData, size_t nBytes
+            );
+            void sendWorkItem(
+                int dest, std::uint64_t blockNum, const void* pData, size_t nBytes
+            );
             void throwMPIError(int status, const char* reason);
             
 
@@ -162,7 +203,10 @@ namespace frib {
             int getArgc() const;
             char** getArgv();            
             void makeDataTypes();
-            
+            void setTransport(CTransport* pTransport);
+            void readDefinitions(CParameterReader& reader, int rank);
+        private:
+            void runRole(int rank);
         };
         
          
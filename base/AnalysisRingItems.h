@@ -91,6 +91,150 @@ namespace frib {
             
         } VariableItem, *pVariableItem;
         
+        /**
+         * Columnar parameter data.  A PARAMETER_CHUNK item holds a run of
+         * events stored by parameter rather than by event.  The fixed
+         * part below is followed by:
+         *  - std::uint64_t triggers[s_eventCount] - trigger number of each event.
+         *  - ChunkColumn columns[s_columnCount] - one per parameter that has a
+         *    value in some event of the chunk, sorted by parameter number.
+         *  - The column bodies.  Each body is a presence bitmap of
+         *    (s_eventCount+7)/8 bytes (bit i%8 of byte i/8 set if event i has
+         *    a value) followed by s_valueCount doubles - the values of the
+         *    events that have one, in event order.
+         *  sizeof is not useful for the item as a whole.
+         */
+        typedef struct _ChunkColumn {
+            std::uint32_t s_parameterNumber;
+            std::uint32_t s_valueCount;
+            std::uint64_t s_offset;          // Of the body from item start.
+        } ChunkColumn, *pChunkColumn;
+        
+        typedef struct _ParameterChunk {
+            RingItemHeader s_header;
+            std::uint32_t  s_eventCount;
+            std::uint32_t  s_columnCount;
+        } ParameterChunk, *pParameterChunk;
+        
+        /**
+         *  The chunk directory is written after the last chunk so that
+         *  readers can go straight to the chunks they want.
+         *  It's followed by a fixed size CHUNK_DIRECTORY_POINTER item which
+         *  ends the file and locates the directory.
+         */
+        typedef struct _ChunkDirectoryEntry {
+            std::uint64_t s_offset;          // File offset of the chunk item.
+            std::uint64_t s_firstTrigger;
+            std::uint32_t s_eventCount;
+            std::uint32_t s_columnCount;
+        } ChunkDirectoryEntry, *pChunkDirectoryEntry;
+        
+        typedef struct _ChunkDirectory {
+            RingItemHeader      s_header;
+            std::uint32_t       s_chunkCount;
+            ChunkDirectoryEntry s_chunks[0];
+        } ChunkDirectory, *pChunkDirectory;
+        
+        typedef struct _ChunkDirectoryPointer {
+            RingItemHeader s_header;
+            std::uint64_t  s_directoryOffset;   // File offset of the directory.
+        } ChunkDirectoryPointer, *pChunkDirectoryPointer;
+        
+        /**
+         * Compressed parameter data.  s_data is a zlib stream that inflates
+         * to s_uncompressedSize bytes of PARAMETER_DATA (or
+         * PACKED_PARAMETER_DATA) items whose triggers are
+         * s_firstTrigger .. s_firstTrigger + s_eventCount - 1 in order.
+         * The fixed part lines up with that of a ParameterItem
+         * (s_firstTrigger with s_triggerCount) so frames can be sorted
+         * by trigger alongside uncompressed items.
+         * sizeof is not useful.
+         */
+        typedef struct _CompressedParameters {
+            RingItemHeader s_header;
+            std::uint64_t  s_firstTrigger;
+            std::uint32_t  s_eventCount;
+            std::uint32_t  s_uncompressedSize;
+            std::uint8_t   s_data[0];
+        } CompressedParameters, *pCompressedParameters;
+        
+        /**
+         * Parameter data with values stored in reduced precision.  The
+         * fixed part is that of a ParameterItem.  s_data holds
+         * s_parameterCount entries, each a std::uint32_t whose top bits
+         * (PACKED_TYPE_SHIFT on) are the VALUE_* type of the value that
+         * follows it and whose low bits (PACKED_NUMBER_MASK) are the
+         * parameter number.  The value is a double, float, std::uint16_t or
+         * std::uint32_t as the type says, so entries are self describing.
+         * sizeof is not useful.
+         */
+        typedef struct _PackedParameterItem {
+            RingItemHeader s_header;
+            std::uint64_t  s_triggerCount;
+            std::uint32_t  s_parameterCount;
+            std::uint8_t   s_data[0];
+        } PackedParameterItem, *pPackedParameterItem;
+        
+        static const std::uint32_t VALUE_DOUBLE  = 0;
+        static const std::uint32_t VALUE_FLOAT32 = 1;
+        static const std::uint32_t VALUE_UINT16  = 2;
+        static const std::uint32_t VALUE_UINT32  = 3;
+        static const unsigned      PACKED_TYPE_SHIFT  = 28;
+        static const std::uint32_t PACKED_NUMBER_MASK = 0x0fffffff;
+        
+        /**
+         * Pattern encoded parameter data.  A pattern is the sorted list of
+         * parameter numbers an event sets.  A PARAMETER_PATTERNS item
+         * defines s_patternCount patterns numbered from s_firstPattern
+         * (patterns are numbered from 0 in the order they are defined and
+         * each is defined before its first use).  s_data holds, for each
+         * pattern, a std::uint32_t count followed by that many parameter
+         * numbers.  sizeof is not useful.
+         */
+        typedef struct _ParameterPatterns {
+            RingItemHeader s_header;
+            std::uint32_t  s_firstPattern;
+            std::uint32_t  s_patternCount;
+            std::uint32_t  s_data[0];
+        } ParameterPatterns, *pParameterPatterns;
+        
+        /**
+         * A PATTERN_PARAMETER_DATA item holds the values of an event whose
+         * parameter numbers are those of pattern s_pattern, one value per
+         * number, in pattern order.  The fixed part lines up with that of a
+         * ParameterItem so these sort by trigger alongside them.
+         */
+        typedef struct _PatternParameterItem {
+            RingItemHeader s_header;
+            std::uint64_t  s_triggerCount;
+            std::uint32_t  s_pattern;
+            double         s_values[0];
+        } PatternParameterItem, *pPatternParameterItem;
+        
+        /**
+         * Trigger index.  An index of a file (see CTriggerIndex) is kept in
+         * a sidecar file of TRIGGER_INDEX items.  Each entry gives the
+         * offset of an item that has a trigger number, that number and the
+         * number of items that precede it in the file.  Entries are made
+         * every s_interval items and are in file order.  The size and
+         * modification time (ns since the epoch) of the indexed file
+         * identify it so a stale index can be detected.  sizeof is not useful.
+         */
+        typedef struct _TriggerIndexEntry {
+            std::uint64_t s_trigger;
+            std::uint64_t s_itemCount;
+            std::uint64_t s_offset;
+        } TriggerIndexEntry, *pTriggerIndexEntry;
+        
+        typedef struct _TriggerIndex {
+            RingItemHeader    s_header;
+            std::uint32_t     s_interval;
+            std::uint32_t     s_entryCount;
+            std::uint64_t     s_fileSize;
+            std::uint64_t     s_fileTime;
+            TriggerIndexEntry s_entries[0];
+        } TriggerIndex, *pTriggerIndex;
+        
         /* Ring Item types - these begin at 32768 (0x8000). - the first user type
          * documented in the NSCLDAQ ring item world:
          *
@@ -103,6 +247,14 @@ namespace frib {
         static const std::uint32_t VARIABLE_VALUES       = 32769;
         static const std::uint32_t PARAMETER_DATA        = 32770;
         static const std::uint32_t TEST_DATA             = 32771;
+        static const std::uint32_t PARAMETER_CHUNK       = 32772;
+        static const std::uint32_t CHUNK_DIRECTORY       = 32773;
+        static const std::uint32_t CHUNK_DIRECTORY_POINTER = 32774;
+        static const std::uint32_t COMPRESSED_PARAMETERS = 32775;
+        static const std::uint32_t PACKED_PARAMETER_DATA = 32776;
+        static const std::uint32_t PARAMETER_PATTERNS    = 32777;
+        static const std::uint32_t PATTERN_PARAMETER_DATA = 32778;
+        static const std::uint32_t TRIGGER_INDEX         = 32779;
         
         // MPI Message tags
         
@@ -114,6 +266,15 @@ namespace frib {
         static const int  MPI_PASSTHROUGH_TAG = 5;    // Header for passthrough
         static const int  MPI_PARAMDEF_TAG = 6;
         static const int  MPI_VARIABLES_TAG = 7;
+        static const int  MPI_PARAMETER_BATCH_TAG = 8; // Packed ParameterItems.
+        static const int  MPI_PROJECTION_TAG = 9;   // Ids a worker consumes.
+        
+        // Ranks of the roles.  Ranks from FIRST_WORKER_RANK on are workers.
+        
+        static const int  DEALER_RANK = 0;
+        static const int  FARMER_RANK = 1;
+        static const int  OUTPUTTER_RANK = 2;
+        static const int  FIRST_WORKER_RANK = 3;
         
         
         
@@ -124,10 +285,14 @@ namespace frib {
         
 
         // Request for data message:
+        // A worker that prefetches keeps s_credits requests outstanding
+        // and must be answered with at most s_maxdata bytes.  Workers
+        // that don't, set s_credits to 0 and s_maxdata is advisory.
         
         typedef struct _FRIB_MPI_Request_Data {
             int s_requestor;                  // Rank of requestor.
             int s_maxdata;                    // Max data I can get.
+            int s_credits;                    // # requests kept outstanding.
         } FRIB_MPI_Request_Data, *pFRIB_MPI_Request_Data;
     
         // Data are sent with this header followed by a block of char data
@@ -135,7 +300,7 @@ namespace frib {
         
         typedef struct _FRIB_MPI_Message_Header {
             unsigned s_nBytes;                       // Size of subsequent msg.
-            unsigned s_nBlockNum;                    // Work Item number.
+            std::uint64_t s_nBlockNum;               // Work Item/first trigger number.
             bool s_end;                         // End data marker.
             
         } FRIB_MPI_Message_Header, *pFRIB_MPI_MessageHeader;
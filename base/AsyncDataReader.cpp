@@ -0,0 +1,419 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  AsyncDataReader.cpp
+ *  @brief: Implement the CAsyncDataReader class.
+ */
+#include "AsyncDataReader.h"
+#include <unistd.h>
+#include <stdexcept>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <string>
+#include <sstream>
+#include <cstdlib>
+#include <new>
+#include <chrono>
+
+namespace frib {
+    namespace analysis {
+        // Triple buffering: one being sent, one ready to go, one being read.
+        
+        const unsigned CAsyncDataReader::DEFAULT_BUFFER_COUNT(3);
+        
+        /**
+         * constructor
+         *    @param pFilename  - the name of a file that's opened readonly.
+         *    @param bufferSize - number of bytes in each buffer.
+         *    @param nBuffers   - number of buffers (at least 2).
+         * The file is opened, the buffers allocated and the read thread
+         * started.
+         */
+        CAsyncDataReader::CAsyncDataReader(
+            const char* pFilename, std::size_t bufferSize, unsigned nBuffers
+        ) :
+            m_nFd(-1), m_nBufferSize(bufferSize), m_nFull(0), m_stop(false),
+            m_nReadIndex(0), m_haveBuffer(false), m_nCursor(0),
+            m_fReleased(true), m_nUserBytes(0), m_nUserItems(0),
+            m_waitTime(0.0), m_readTime(0.0)
+        {
+            m_nFd = open(pFilename, O_RDONLY);
+            if (m_nFd < 0) {
+                std::string failureReason = strerror(errno);
+                std::stringstream errorStream;
+                errorStream << "Failed to open: " << pFilename << " for read: "
+                    << failureReason;
+                std::string errormsg = errorStream.str();
+                throw std::runtime_error(errormsg);
+            }
+            try {
+                start(nBuffers);
+            }
+            catch (...) {
+                close(m_nFd);
+                throw;
+            }
+        }
+        /**
+         * constructor
+         *    Already have a file descriptor open:
+         *  @param fd -  a file descriptor open on the data source.
+         *  @param bufferSize - number of bytes in each buffer.
+         *  @param nBuffers   - number of buffers (at least 2).
+         *  @note fd will be closed on destruction.
+         */
+        CAsyncDataReader::CAsyncDataReader(
+            int fd, std::size_t bufferSize, unsigned nBuffers
+        ) :
+            m_nFd(fd), m_nBufferSize(bufferSize), m_nFull(0), m_stop(false),
+            m_nReadIndex(0), m_haveBuffer(false), m_nCursor(0),
+            m_fReleased(true), m_nUserBytes(0), m_nUserItems(0),
+            m_waitTime(0.0), m_readTime(0.0)
+        {
+            start(nBuffers);
+        }
+        /**
+         * destructor
+         *    Stop the read thread, close the file and free the buffers.
+         * @note if the read thread is blocked in a read (e.g. on a pipe),
+         *       this waits for that read to complete.
+         */
+        CAsyncDataReader::~CAsyncDataReader() {
+            stop();
+            close(m_nFd);
+            for (auto& b : m_buffers) {
+                std::free(b.s_pData);
+            }
+        }
+        /**
+         * getBlock
+         *   - Ensure this is legal (m_fReleased is true).
+         *   - Wait for a buffer with data if we don't have one.
+         *   - probeData to figure out how much data to give the caller.
+         *  @param maxbytes - maximum number of bytes the caller can accept.
+         *  @return CDataReader::Result - describes the data.  At end of file,
+         *          s_nbytes and s_nItems are zero and s_pData is null.
+         *  @throw whatever the read thread threw if it failed.
+         */
+        CDataReader::Result
+        CAsyncDataReader::getBlock(std::size_t maxbytes)
+        {
+            if (!m_fReleased) {
+                throw std::logic_error("Attemped read without releasing prior data");
+            }
+            Result res = {0, 0, nullptr};
+            while (1) {
+                waitForBuffer();
+                Buffer& b = m_buffers[m_nReadIndex];
+                if (m_nCursor < b.s_nBytes) break;
+                if (b.s_eof) {
+                    m_nUserBytes = 0;
+                    m_nUserItems = 0;
+                    m_fReleased  = false;
+                    return res;
+                }
+                releaseBuffer();
+            }
+            probeData(maxbytes);
+            res.s_nbytes = m_nUserBytes;
+            res.s_nItems = m_nUserItems;
+            res.s_pData  = m_buffers[m_nReadIndex].s_pData + m_nCursor;
+            m_fReleased = false;
+            return res;
+        }
+        /**
+         * done
+         *    Indicate the client is done with the last chunk of data.  If
+         *    that exhausted the current buffer, it's given back to the read
+         *    thread to fill.
+         */
+        void
+        CAsyncDataReader::done()
+        {
+            if (m_fReleased) {
+                throw std::logic_error("Releasing but already released");
+            }
+            m_fReleased = true;
+            m_nCursor += m_nUserBytes;
+            Buffer& b = m_buffers[m_nReadIndex];
+            if (m_haveBuffer && (m_nCursor >= b.s_nBytes) && !b.s_eof) {
+                releaseBuffer();
+            }
+        }
+        /**
+         * getWaitTime
+         *   @return double - seconds the client has spent waiting for the
+         *                    read thread to supply data.
+         */
+        double
+        CAsyncDataReader::getWaitTime() const
+        {
+            return m_waitTime;
+        }
+        /**
+         * getReadTime
+         *   @return double - seconds the read thread has spent filling buffers.
+         */
+        double
+        CAsyncDataReader::getReadTime() const
+        {
+            std::lock_guard<std::mutex> l(m_lock);
+            return m_readTime;
+        }
+        //////////////////////////////////////////////////////////////////////////
+        // Private utilities - client side:
+        
+        /**
+         * start
+         *    Allocate the buffers and start the read thread.
+         *  @param nBuffers - number of buffers to allocate.
+         */
+        void
+        CAsyncDataReader::start(unsigned nBuffers)
+        {
+            if (nBuffers < 2) {
+                throw std::invalid_argument(
+                    "CAsyncDataReader needs at least two buffers"
+                );
+            }
+            for (unsigned i = 0; i < nBuffers; i++) {
+                Buffer b = {
+                    reinterpret_cast<std::uint8_t*>(malloc(m_nBufferSize)), 0, false
+                };
+                if (!b.s_pData) {
+                    for (auto& p : m_buffers) {
+                        std::free(p.s_pData);
+                    }
+                    m_buffers.clear();
+                    throw std::bad_alloc();
+                }
+                m_buffers.push_back(b);
+            }
+            m_thread = std::thread(&CAsyncDataReader::readThread, this);
+        }
+        /**
+         * stop
+         *    Ask the read thread to exit and wait for it to do so.
+         */
+        void
+        CAsyncDataReader::stop()
+        {
+            {
+                std::lock_guard<std::mutex> l(m_lock);
+                m_stop = true;
+            }
+            m_emptied.notify_all();
+            if (m_thread.joinable()) {
+                m_thread.join();
+            }
+        }
+        /**
+         * waitForBuffer
+         *    If the client does not have a buffer, wait for the read thread
+         *    to fill the next one.  The time spent waiting is added to
+         *    m_waitTime.
+         * @throw the read thread's exception if it failed and there are no
+         *        more good buffers.
+         */
+        void
+        CAsyncDataReader::waitForBuffer()
+        {
+            if (!m_haveBuffer) {
+                auto start = std::chrono::steady_clock::now();
+                {
+                    std::unique_lock<std::mutex> l(m_lock);
+                    m_filled.wait(l, [this]() { return m_nFull || m_error; });
+                    if (!m_nFull) {
+                        std::rethrow_exception(m_error);
+                    }
+                }
+                std::chrono::duration<double> waited =
+                    std::chrono::steady_clock::now() - start;
+                m_waitTime  += waited.count();
+                m_haveBuffer = true;
+                m_nCursor    = 0;
+            }
+        }
+        /**
+         * releaseBuffer
+         *    Give the client's buffer back to the read thread and advance
+         *    to the next one.
+         */
+        void
+        CAsyncDataReader::releaseBuffer()
+        {
+            {
+                std::lock_guard<std::mutex> l(m_lock);
+                m_nFull--;
+            }
+            m_emptied.notify_one();
+            m_haveBuffer = false;
+            m_nReadIndex = (m_nReadIndex + 1) % m_buffers.size();
+        }
+        /**
+         * probeData
+         *   Set up m_nUserBytes, m_nUserItems so that from the cursor
+         *   there's at least one item and no more than maxbytes or what's
+         *   left in the buffer.
+         * @param maxBytes - maximum number of byes the caller can deal with.
+         */
+        void
+        CAsyncDataReader::probeData(std::size_t maxBytes)
+        {
+            m_nUserBytes = 0;
+            m_nUserItems = 0;
+            
+            const Buffer& b = m_buffers[m_nReadIndex];
+            std::size_t remaining = b.s_nBytes - m_nCursor;
+            if (maxBytes > remaining) maxBytes = remaining;
+            
+            const std::uint8_t* p = b.s_pData + m_nCursor;
+            while (m_nUserBytes < maxBytes) {
+                std::uint32_t size = *reinterpret_cast<const std::uint32_t*>(p);
+                if (size > maxBytes && m_nUserItems == 0) {
+                    throw std::logic_error("User request overflowed by a single ring item");
+                }
+                if ((size + m_nUserBytes) > maxBytes) return;
+                m_nUserBytes += size;
+                m_nUserItems++;
+                p += size;
+            }
+        }
+        ///////////////////////////////////////////////////////////////////////
+        // Private utilities - read thread:
+        
+        /**
+         * readThread
+         *    Entry point of the read thread.  Fill buffers as they become
+         *    free until end of file or we're asked to stop.  Any exception
+         *    is saved for the client to rethrow.
+         */
+        void
+        CAsyncDataReader::readThread()
+        {
+            std::size_t fillIndex = 0;
+            try {
+                while (1) {
+                    {
+                        std::unique_lock<std::mutex> l(m_lock);
+                        m_emptied.wait(l, [this]() {
+                            return m_stop || (m_nFull < m_buffers.size());
+                        });
+                        if (m_stop) return;
+                    }
+                    Buffer& b = m_buffers[fillIndex];
+                    auto start = std::chrono::steady_clock::now();
+                    fill(b);
+                    std::chrono::duration<double> took =
+                        std::chrono::steady_clock::now() - start;
+                    {
+                        std::lock_guard<std::mutex> l(m_lock);
+                        m_readTime += took.count();
+                        m_nFull++;
+                    }
+                    m_filled.notify_one();
+                    if (b.s_eof) return;
+                    fillIndex = (fillIndex + 1) % m_buffers.size();
+                }
+            }
+            catch (...) {
+                {
+                    std::lock_guard<std::mutex> l(m_lock);
+                    m_error = std::current_exception();
+                }
+                m_filled.notify_one();
+            }
+        }
+        /**
+         * fill
+         *    Fill a buffer.  Any partial item left over from the previous
+         *    buffer goes first, then we read until the buffer is full or
+         *    end of file.  A trailing partial item is saved for the next
+         *    buffer.
+         * @param buffer - the buffer to fill.
+         * @throw std::runtime_error - read failed.
+         * @throw std::logic_error   - a ring item is bigger than a buffer or
+         *                             the file ends in a partial item.
+         */
+        void
+        CAsyncDataReader::fill(Buffer& buffer)
+        {
+            std::size_t n = m_carry.size();
+            if (n) {
+                memcpy(buffer.s_pData, m_carry.data(), n);
+                m_carry.clear();
+            }
+            bool eof = false;
+            while (n < m_nBufferSize) {
+                ssize_t nRead = read(m_nFd, buffer.s_pData + n, m_nBufferSize - n);
+                if (nRead < 0) {
+                    if (errno == EINTR) continue;
+                    std::string msg = "Read failed in CAsyncDataReader: ";
+                    msg += strerror(errno);
+                    throw std::runtime_error(msg);
+                }
+                if (nRead == 0) {
+                    eof = true;
+                    break;
+                }
+                n += nRead;
+            }
+            std::size_t complete = completeBytes(buffer.s_pData, n);
+            if (complete < n) {
+                if (complete == 0) {
+                    throw std::logic_error(
+                        eof ? "Data source ends with a partial ring item" :
+                              "Ring item is larger than the read-ahead buffer"
+                    );
+                }
+                // Carry the partial item to the next buffer.  If we're at the
+                // end of file, that fill will report the error after the
+                // client has gotten the good data in this buffer.
+                
+                m_carry.assign(buffer.s_pData + complete, buffer.s_pData + n);
+                eof = false;
+            }
+            buffer.s_nBytes = complete;
+            buffer.s_eof    = eof;
+        }
+        /**
+         * completeBytes
+         *    Figure out how many bytes of a block of data are complete ring
+         *    items.
+         * @param p - pointer to the data.
+         * @param nBytes - number of bytes of data.
+         * @return std::size_t - bytes in the complete items.
+         */
+        std::size_t
+        CAsyncDataReader::completeBytes(const std::uint8_t* p, std::size_t nBytes)
+        {
+            std::size_t result = 0;
+            while ((result + sizeof(std::uint32_t)) <= nBytes) {
+                std::uint32_t size = *reinterpret_cast<const std::uint32_t*>(p + result);
+                if (size < sizeof(std::uint32_t)) {
+                    throw std::logic_error("Invalid ring item size in data source");
+                }
+                if ((result + size) > nBytes) break;
+                result += size;
+            }
+            return result;
+        }
+    }
+}
@@ -0,0 +1,129 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  AsyncDataReader.h
+ *  @brief: A CDataReader that reads ahead on a background thread.
+ */
+#ifndef ASYNCDATAREADER_H
+#define ASYNCDATAREADER_H
+#include "DataReader.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+namespace frib {
+    namespace analysis {
+        /**
+         * @class CAsyncDataReader
+         *    This reader has the same getBlock/done contract as CDataReader
+         *    but reads ahead into a ring of buffers (by default three) on a
+         *    background thread.  While the client is processing/sending the
+         *    data from one buffer, the next ones are being filled so, unless
+         *    the client consumes data faster than the data source can supply
+         *    them, getBlock does not have to wait for I/O.
+         *
+         *    Each buffer only contains complete ring items.  Partial items
+         *    at the end of a read are carried over into the front of the next
+         *    buffer.  Thus, as with CDataReader, no ring item can be larger
+         *    than a buffer.
+         *
+         *    Errors detected by the read thread are rethrown to the client
+         *    by getBlock.
+         *
+         *    Statistics are kept about how long the client has had to wait
+         *    for data (getWaitTime) and how long the read thread has spent
+         *    reading (getReadTime).
+         */
+        class CAsyncDataReader : public CDataReader {
+        private:
+            typedef struct _Buffer {
+                std::uint8_t* s_pData;
+                std::size_t   s_nBytes;       // Bytes of complete items.
+                bool          s_eof;          // Last buffer.
+            } Buffer, *pBuffer;
+            
+            int                     m_nFd;
+            std::size_t             m_nBufferSize;
+            std::vector<Buffer>     m_buffers;
+            
+            // Shared between the client and the read thread - protected by
+            // m_lock:
+            
+            mutable std::mutex      m_lock;
+            std::condition_variable m_filled;     // A buffer was filled.
+            std::condition_variable m_emptied;    // A buffer was released.
+            std::size_t             m_nFull;      // # buffers waiting for client.
+            bool                    m_stop;       // Read thread must exit.
+            std::exception_ptr      m_error;      // Read thread failure.
+            
+            // Client state:
+            
+            std::size_t             m_nReadIndex;  // Buffer the client is in.
+            bool                    m_haveBuffer;  // Client holds m_nReadIndex.
+            std::size_t             m_nCursor;     // Next byte in that buffer.
+            bool                    m_fReleased;
+            std::size_t             m_nUserBytes;
+            std::size_t             m_nUserItems;
+            double                  m_waitTime;
+            
+            // Read thread state:
+            
+            std::vector<std::uint8_t> m_carry;      // Partial item for next buffer.
+            double                  m_readTime;
+            std::thread             m_thread;
+        public:
+            static const unsigned DEFAULT_BUFFER_COUNT;
+        public:
+            CAsyncDataReader(
+                const char* pFilename, std::size_t bufferSize,
+                unsigned nBuffers = DEFAULT_BUFFER_COUNT
+            );
+            CAsyncDataReader(
+                int fd, std::size_t bufferSize,
+                unsigned nBuffers = DEFAULT_BUFFER_COUNT
+            );
+            virtual ~CAsyncDataReader();
+        private:
+            CAsyncDataReader(const CAsyncDataReader& rhs);
+            CAsyncDataReader& operator=(const CAsyncDataReader& rhs);
+            int operator==(const CAsyncDataReader& rhs);
+            int operator!=(const CAsyncDataReader& rhs);
+        public:
+            virtual Result getBlock(std::size_t maxbytes);
+            virtual void done();
+            
+            double getWaitTime() const;
+            double getReadTime() const;
+        private:
+            void start(unsigned nBuffers);
+            void stop();
+            void waitForBuffer();
+            void releaseBuffer();
+            void probeData(std::size_t maxBytes);
+            
+            void readThread();
+            void fill(Buffer& buffer);
+            std::size_t completeBytes(const std::uint8_t* p, std::size_t nBytes);
+        };
+    }
+}
+
+#endif
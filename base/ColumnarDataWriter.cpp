@@ -0,0 +1,328 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+
+/** @file:  ColumnarDataWriter.cpp
+ *  @brief: Implement the columnar data writer.
+ */
+#include "ColumnarDataWriter.h"
+#include "ParameterPacker.h"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <string.h>
+
+namespace frib {
+    namespace analysis {
+        // A few thousand triggers makes the per chunk overhead (triggers,
+        // column directory, bitmaps) small compared with the values while
+        // keeping the chunk being built a modest amount of memory.
+        
+        const std::uint32_t CColumnarDataWriter::DEFAULT_CHUNK_SIZE(4096);
+        
+        /**
+         * constructor
+         *   @param pFilename - path to the output file.
+         *   @param chunkSize - Number of triggers in each chunk.
+         *   @param bufferSize - Number of bytes of output buffering,
+         *                      0 means writes are not buffered.
+         *   @throw std::invalid_argument - chunkSize is 0.
+         */
+        CColumnarDataWriter::CColumnarDataWriter(
+            const char* pFilename, std::uint32_t chunkSize,
+            std::size_t bufferSize
+        ) :
+            CDataWriter(pFilename, bufferSize), m_nChunkSize(chunkSize)
+        {
+            checkChunkSize();
+        }
+        /**
+         * constructor from fd
+         *   @param fd - file descriptor already open on the output file.
+         *   @param chunkSize - Number of triggers in each chunk.
+         *   @param bufferSize - Number of bytes of output buffering,
+         *                      0 means writes are not buffered.
+         *   @throw std::invalid_argument - chunkSize is 0.
+         */
+        CColumnarDataWriter::CColumnarDataWriter(
+            int fd, std::uint32_t chunkSize, std::size_t bufferSize
+        ) :
+            CDataWriter(fd, bufferSize), m_nChunkSize(chunkSize)
+        {
+            checkChunkSize();
+        }
+        /**
+         * destructor
+         *    Finish the file if the client didn't.  As with CDataWriter,
+         *    failures here can't be reported.
+         */
+        CColumnarDataWriter::~CColumnarDataWriter() {
+            try {
+                finish();
+            }
+            catch (...) {}
+        }
+        //////////////////////////////////////////////////////////////////////
+        // Public methods.
+        
+        /**
+         * writeEvent
+         *    Add an event to the chunk being built, writing the chunk if
+         *    that fills it.
+         * @param event - the parameter number/value pairs of the event.
+         * @param trigger - the trigger number of the event.
+         */
+        void
+        CColumnarDataWriter::writeEvent(
+            const std::vector<std::pair<unsigned, double>>& event,
+            std::uint64_t trigger
+        ) {
+            m_triggers.push_back(trigger);
+            for (auto& p : event) {
+                addValue(p.first, p.second);
+            }
+            endEvent();
+        }
+        /**
+         * writeItem
+         *    A PARAMETER_DATA item is treated like writeEvent, as is each
+         *    event of a COMPRESSED_PARAMETERS frame and each
+         *    PACKED_PARAMETER_DATA item once widened.  Anything else is a
+         *    passthrough item which is written after ending the current
+         *    chunk.
+         * @param pItem - pointer to the ring item.
+         */
+        void
+        CColumnarDataWriter::writeItem(const void* pItem) {
+            const ParameterItem* p = reinterpret_cast<const ParameterItem*>(pItem);
+            if (p->s_header.s_type == PARAMETER_DATA) {
+                m_triggers.push_back(p->s_triggerCount);
+                for (std::uint32_t i = 0; i < p->s_parameterCount; i++) {
+                    addValue(p->s_parameters[i].s_number, p->s_parameters[i].s_value);
+                }
+                endEvent();
+            } else if (p->s_header.s_type == COMPRESSED_PARAMETERS) {
+                m_inflated.clear();
+                m_inflater.decompress(
+                    reinterpret_cast<const CompressedParameters*>(pItem), m_inflated
+                );
+                writeBlock(m_inflated.data(), m_inflated.size());
+            } else if (p->s_header.s_type == PACKED_PARAMETER_DATA) {
+                m_widened.clear();
+                CParameterPacker::widen(
+                    reinterpret_cast<const PackedParameterItem*>(pItem), m_widened
+                );
+                writeItem(m_widened.data());
+            } else {
+                writeChunk();
+                CDataWriter::writeItem(pItem);
+            }
+        }
+        /**
+         * writeBlock
+         *    Write a block of complete ring items.  Each is handled as by
+         *    writeItem.
+         * @param pData  - pointer to the first item of the block.
+         * @param nBytes - number of bytes in the block.
+         */
+        void
+        CColumnarDataWriter::writeBlock(const void* pData, std::size_t nBytes) {
+            const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(pData);
+            const std::uint8_t* pEnd = p + nBytes;
+            while (p < pEnd) {
+                const RingItemHeader* pHeader =
+                    reinterpret_cast<const RingItemHeader*>(p);
+                writeItem(p);
+                p += pHeader->s_size;
+            }
+        }
+        /**
+         * flush
+         *    End the current chunk (if it has any events) and write
+         *    all buffered data.
+         *  @throw std::runtime_error - if the write fails.
+         */
+        void
+        CColumnarDataWriter::flush() {
+            writeChunk();
+            CDataWriter::flush();
+        }
+        /**
+         * finish
+         *    Write the last partial chunk and the chunk directory, then
+         *    flush and close the file.
+         * @throw std::runtime_error - any of that fails.
+         */
+        void
+        CColumnarDataWriter::finish() {
+            if (finished()) {
+                return;
+            }
+            try {
+                writeChunk();
+                writeDirectory();
+            }
+            catch (...) {
+                try {
+                    CDataWriter::finish();    // Close the file anyway.
+                }
+                catch (...) {}
+                throw;
+            }
+            CDataWriter::finish();
+        }
+        ///////////////////////////////////////////////////////////////////////
+        // Private utilities:
+        
+        /**
+         * checkChunkSize
+         *    @throw std::invalid_argument - if the chunk size is zero.
+         */
+        void
+        CColumnarDataWriter::checkChunkSize() {
+            if (m_nChunkSize == 0) {
+                throw std::invalid_argument(
+                    "CColumnarDataWriter - chunk size must be at least 1"
+                );
+            }
+            m_triggers.reserve(m_nChunkSize);
+        }
+        /**
+         * addValue
+         *    Add a parameter value to the most recent event of the chunk.
+         *    The column's bitmap is allocated for a full chunk the first
+         *    time the parameter is seen and then reused for all chunks.
+         * @param number - parameter number.
+         * @param value  - its value.
+         */
+        void
+        CColumnarDataWriter::addValue(unsigned number, double value) {
+            if (number >= m_columns.size()) {
+                m_columns.resize(number + 1);
+            }
+            Column& column(m_columns[number]);
+            if (column.s_present.empty()) {
+                column.s_present.resize((m_nChunkSize + 7)/8, 0);
+            }
+            if (column.s_values.empty()) {
+                m_used.push_back(number);           // First value in chunk.
+            }
+            std::size_t  event = m_triggers.size() - 1;
+            std::uint8_t bit   = 1 << (event % 8);
+            std::uint8_t& bits(column.s_present[event/8]);
+            if (bits & bit) {
+                column.s_values.back() = value;     // Duplicate: last wins.
+            } else {
+                bits |= bit;
+                column.s_values.push_back(value);
+            }
+        }
+        /**
+         * endEvent
+         *    Called when an event has been added; writes the chunk if
+         *    it's full.
+         */
+        void
+        CColumnarDataWriter::endEvent() {
+            if (m_triggers.size() >= m_nChunkSize) {
+                writeChunk();
+            }
+        }
+        /**
+         * writeChunk
+         *    Write the chunk being built as a PARAMETER_CHUNK item, record
+         *    it in the directory and empty it.  Does nothing if the chunk has
+         *    no events.
+         *  @throw std::runtime_error - the chunk won't fit in a ring item.
+         */
+        void
+        CColumnarDataWriter::writeChunk() {
+            if (m_triggers.empty()) {
+                return;
+            }
+            std::sort(m_used.begin(), m_used.end());
+            std::uint32_t nEvents = m_triggers.size();
+            std::size_t   bitmapBytes = (nEvents + 7)/8;
+            
+            std::uint64_t nBytes = sizeof(ParameterChunk)
+                + nEvents * sizeof(std::uint64_t)
+                + m_used.size() * sizeof(ChunkColumn);
+            for (auto n : m_used) {
+                nBytes += bitmapBytes + m_columns[n].s_values.size() * sizeof(double);
+            }
+            if (nBytes > std::numeric_limits<std::uint32_t>::max()) {
+                throw std::runtime_error(
+                    "CColumnarDataWriter - chunk is too big for a ring item, use a smaller chunk size"
+                );
+            }
+            ChunkDirectoryEntry entry;
+            entry.s_offset       = position();
+            entry.s_firstTrigger = m_triggers.front();
+            entry.s_eventCount   = nEvents;
+            entry.s_columnCount  = m_used.size();
+            
+            writeHeader(nBytes, PARAMETER_CHUNK);
+            put(&entry.s_eventCount, sizeof(std::uint32_t));
+            put(&entry.s_columnCount, sizeof(std::uint32_t));
+            put(m_triggers.data(), nEvents * sizeof(std::uint64_t));
+            
+            std::uint64_t offset = sizeof(ParameterChunk)
+                + nEvents * sizeof(std::uint64_t)
+                + m_used.size() * sizeof(ChunkColumn);
+            for (auto n : m_used) {
+                ChunkColumn column;
+                column.s_parameterNumber = n;
+                column.s_valueCount      = m_columns[n].s_values.size();
+                column.s_offset          = offset;
+                put(&column, sizeof(column));
+                offset += bitmapBytes + column.s_valueCount * sizeof(double);
+            }
+            for (auto n : m_used) {
+                Column& column(m_columns[n]);
+                put(column.s_present.data(), bitmapBytes);
+                put(column.s_values.data(), column.s_values.size() * sizeof(double));
+                
+                memset(column.s_present.data(), 0, bitmapBytes);
+                column.s_values.clear();
+            }
+            m_used.clear();
+            m_triggers.clear();
+            m_directory.push_back(entry);
+        }
+        /**
+         * writeDirectory
+         *    Write the CHUNK_DIRECTORY item followed by the
+         *    CHUNK_DIRECTORY_POINTER that locates it.
+         */
+        void
+        CColumnarDataWriter::writeDirectory() {
+            std::uint64_t offset = position();
+            std::uint32_t nChunks = m_directory.size();
+            writeHeader(
+                sizeof(ChunkDirectory) + nChunks * sizeof(ChunkDirectoryEntry),
+                CHUNK_DIRECTORY
+            );
+            put(&nChunks, sizeof(nChunks));
+            if (nChunks) {
+                put(m_directory.data(), nChunks * sizeof(ChunkDirectoryEntry));
+            }
+            
+            writeHeader(sizeof(ChunkDirectoryPointer), CHUNK_DIRECTORY_POINTER);
+            put(&offset, sizeof(offset));
+        }
+    }
+}
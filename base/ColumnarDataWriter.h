@@ -0,0 +1,107 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+
+/** @file:  ColumnarDataWriter.h
+ *  @brief: Write parameter data in column order.
+ */
+#ifndef COLUMNARDATAWRITER_H
+#define COLUMNARDATAWRITER_H
+#include "DataWriter.h"
+#include "AnalysisRingItems.h"
+#include "ParameterCompressor.h"
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace frib {
+    namespace analysis {
+        /**
+         * @class CColumnarDataWriter
+         *    A CDataWriter that, rather than writing each event as a
+         *    PARAMETER_DATA item, groups events into chunks of a fixed
+         *    number of triggers and writes each chunk as a PARAMETER_CHUNK
+         *    item.  Within a chunk, each parameter's values are contiguous
+         *    and accompanied by a presence bitmap.  When the file is
+         *    finished (see CDataWriter::finish), the last chunk, a
+         *    CHUNK_DIRECTORY item locating each chunk and a
+         *    CHUNK_DIRECTORY_POINTER item locating the directory end the file.
+         *    A consumer that wants a few parameters out of thousands can then
+         *    read just those columns (see CColumnarReader).
+         *
+         *    The front matter is the same as for CDataWriter.  Passthrough
+         *    items are written between chunks: the chunk being built is
+         *    ended first so that the file order is preserved.
+         *
+         *    If a parameter appears more than once in an event, the last
+         *    value wins.  COMPRESSED_PARAMETERS frames (from compressing
+         *    workers) are inflated and their events added to the chunks.
+         *    PACKED_PARAMETER_DATA items are widened back to doubles.
+         */
+        class CColumnarDataWriter : public CDataWriter {
+        public:
+            static const std::uint32_t DEFAULT_CHUNK_SIZE;
+        private:
+            struct Column {
+                std::vector<std::uint8_t> s_present;
+                std::vector<double>       s_values;
+            };
+            std::uint32_t                    m_nChunkSize;
+            std::vector<std::uint64_t>       m_triggers;   // of chunk events.
+            std::vector<Column>              m_columns;    // Indexed by number.
+            std::vector<unsigned>            m_used;       // Numbers in chunk.
+            std::vector<ChunkDirectoryEntry> m_directory;
+            CParameterCompressor             m_inflater;
+            std::vector<std::uint8_t>        m_inflated;   // Frame contents.
+            std::vector<std::uint8_t>        m_widened;    // A packed item.
+        public:
+            CColumnarDataWriter(
+                const char* pFilename,
+                std::uint32_t chunkSize = DEFAULT_CHUNK_SIZE,
+                std::size_t bufferSize = DEFAULT_BUFFER_SIZE
+            );
+            CColumnarDataWriter(
+                int fd,
+                std::uint32_t chunkSize = DEFAULT_CHUNK_SIZE,
+                std::size_t bufferSize = DEFAULT_BUFFER_SIZE
+            );
+            virtual ~CColumnarDataWriter();
+        private:
+            CColumnarDataWriter(const CColumnarDataWriter& rhs);
+            CColumnarDataWriter& operator=(const CColumnarDataWriter& rhs);
+            int operator==(const CColumnarDataWriter& rhs) const;
+            int operator!=(const CColumnarDataWriter& rhs) const;
+        public:
+            virtual void writeEvent(
+                const std::vector<std::pair<unsigned, double>>& event,
+                std::uint64_t eventNum
+            );
+            virtual void writeItem(const void* pItem);
+            virtual void writeBlock(const void* pData, std::size_t nBytes);
+            virtual void flush();
+            virtual void finish();
+        private:
+            void checkChunkSize();
+            void addValue(unsigned number, double value);
+            void endEvent();
+            void writeChunk();
+            void writeDirectory();
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,335 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+
+/** @file:  ColumnarReader.cpp
+ *  @brief: Implement the columnar parameter file reader.
+ */
+#include "ColumnarReader.h"
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+#include <sstream>
+
+namespace frib {
+    namespace analysis {
+        /**
+         * constructor
+         *    Open the file and read the parameter definitions and the chunk
+         *    directory.
+         * @param pFilename - path to the file.
+         * @throw std::runtime_error - the file can't be opened or is not a
+         *        (complete) columnar parameter file.
+         */
+        CColumnarReader::CColumnarReader(const char* pFilename) :
+            m_fd(-1), m_nBytesRead(0)
+        {
+            m_fd = open(pFilename, O_RDONLY);
+            if (m_fd < 0) {
+                const char* pReason = strerror(errno);
+                std::stringstream s;
+                s << "Failed to open : " << pFilename << " : " << pReason;
+                std::string msg = s.str();
+                throw std::runtime_error(msg);
+            }
+            try {
+                readDefinitions();
+                readDirectory();
+            }
+            catch (...) {
+                close(m_fd);
+                throw;
+            }
+        }
+        /**
+         * destructor
+         */
+        CColumnarReader::~CColumnarReader() {
+            close(m_fd);
+        }
+        //////////////////////////////////////////////////////////////////////
+        // Public methods.
+        
+        /**
+         * parameterNumber
+         *    @param name - name of a parameter in the file.
+         *    @return unsigned - the number used for it in the file.
+         *    @throw std::invalid_argument - no such parameter.
+         */
+        unsigned
+        CColumnarReader::parameterNumber(const std::string& name) const {
+            auto p = m_parameters.find(name);
+            if (p == m_parameters.end()) {
+                std::string msg = "CColumnarReader - no such parameter: ";
+                msg += name;
+                throw std::invalid_argument(msg);
+            }
+            return p->second;
+        }
+        /**
+         * chunks
+         *    @return std::size_t - number of chunks in the file.
+         */
+        std::size_t
+        CColumnarReader::chunks() const {
+            return m_directory.size();
+        }
+        /**
+         * chunkInfo
+         *    @param n - chunk number.
+         *    @return const ChunkDirectoryEntry& - the directory entry for it.
+         *    @throw std::out_of_range - n is not a chunk number.
+         */
+        const ChunkDirectoryEntry&
+        CColumnarReader::chunkInfo(std::size_t n) const {
+            return m_directory.at(n);
+        }
+        /**
+         * readChunk
+         *    Read some columns of a chunk.  The head of the chunk (triggers
+         *    and column directory) is read in one go then one read is done
+         *    for each requested column that's in the chunk.  A parameter that
+         *    has no values in the chunk gets an all zero bitmap and no values.
+         * @param n - chunk number.
+         * @param numbers - numbers of the parameters to read.
+         * @param[out] chunk - the triggers and the requested columns in the
+         *              order requested.  Storage is reused from call to call.
+         * @throw std::out_of_range - n is not a chunk number.
+         * @throw std::runtime_error - read failures or a corrupt chunk.
+         */
+        void
+        CColumnarReader::readChunk(
+            std::size_t n, const std::vector<unsigned>& numbers, Chunk& chunk
+        ) {
+            const ChunkDirectoryEntry& entry(m_directory.at(n));
+            std::size_t nEvents = entry.s_eventCount;
+            std::size_t headBytes = sizeof(ParameterChunk)
+                + nEvents * sizeof(std::uint64_t)
+                + entry.s_columnCount * sizeof(ChunkColumn);
+            m_head.resize(headBytes);
+            readAt(m_head.data(), headBytes, entry.s_offset);
+            
+            const ParameterChunk* pHead =
+                reinterpret_cast<const ParameterChunk*>(m_head.data());
+            if (pHead->s_header.s_type != PARAMETER_CHUNK ||
+                pHead->s_eventCount != entry.s_eventCount ||
+                pHead->s_columnCount != entry.s_columnCount ||
+                pHead->s_header.s_size < headBytes) {
+                throw std::runtime_error(
+                    "CColumnarReader - chunk does not match the chunk directory"
+                );
+            }
+            chunk.s_triggers.resize(nEvents);
+            memcpy(
+                chunk.s_triggers.data(), pHead + 1,
+                nEvents * sizeof(std::uint64_t)
+            );
+            const ChunkColumn* pColumns = reinterpret_cast<const ChunkColumn*>(
+                m_head.data() + sizeof(ParameterChunk) + nEvents * sizeof(std::uint64_t)
+            );
+            const ChunkColumn* pEnd = pColumns + entry.s_columnCount;
+            
+            std::size_t bitmapBytes = (nEvents + 7)/8;
+            chunk.s_columns.resize(numbers.size());
+            for (std::size_t i = 0; i < numbers.size(); i++) {
+                Column& column(chunk.s_columns[i]);
+                column.s_parameterNumber = numbers[i];
+                column.s_present.assign(bitmapBytes, 0);
+                
+                const ChunkColumn* p = std::lower_bound(
+                    pColumns, pEnd, numbers[i],
+                    [](const ChunkColumn& c, unsigned number) {
+                        return c.s_parameterNumber < number;
+                    }
+                );
+                if (p == pEnd || p->s_parameterNumber != numbers[i]) {
+                    column.s_values.clear();
+                    continue;
+                }
+                std::uint64_t valueBytes = std::uint64_t(p->s_valueCount) * sizeof(double);
+                if (p->s_offset + bitmapBytes + valueBytes > pHead->s_header.s_size) {
+                    throw std::runtime_error(
+                        "CColumnarReader - column extends past the end of its chunk"
+                    );
+                }
+                column.s_values.resize(p->s_valueCount);
+                iovec parts[2];
+                parts[0].iov_base = column.s_present.data();
+                parts[0].iov_len  = bitmapBytes;
+                parts[1].iov_base = column.s_values.data();
+                parts[1].iov_len  = valueBytes;
+                readAt(parts, 2, entry.s_offset + p->s_offset);
+            }
+        }
+        /**
+         * bytesRead
+         *    @return std::uint64_t - number of bytes read from the file so far,
+         *          including the definitions and directory.
+         */
+        std::uint64_t
+        CColumnarReader::bytesRead() const {
+            return m_nBytesRead;
+        }
+        ///////////////////////////////////////////////////////////////////////
+        // Private utilities:
+        
+        /**
+         * readDefinitions
+         *    Read the PARAMETER_DEFINITIONS item that starts the file and
+         *    build the name to number map.
+         * @throw std::runtime_error - the first item isn't parameter definitions.
+         */
+        void
+        CColumnarReader::readDefinitions() {
+            RingItemHeader header;
+            readAt(&header, sizeof(header), 0);
+            if (header.s_type != PARAMETER_DEFINITIONS ||
+                header.s_size < sizeof(ParameterDefinitions)) {
+                throw std::runtime_error(
+                    "CColumnarReader - file does not start with parameter definitions"
+                );
+            }
+            std::vector<std::uint8_t> item(header.s_size + 1, 0); // 0 guards strings
+            readAt(item.data(), header.s_size, 0);
+            const ParameterDefinitions* pDefs =
+                reinterpret_cast<const ParameterDefinitions*>(item.data());
+            const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(pDefs->s_parameters);
+            const std::uint8_t* pEnd = item.data() + header.s_size;
+            for (std::uint32_t i = 0; i < pDefs->s_numParameters; i++) {
+                if (p + sizeof(ParameterDefinition) >= pEnd) {
+                    throw std::runtime_error(
+                        "CColumnarReader - truncated parameter definitions"
+                    );
+                }
+                const ParameterDefinition* pDef =
+                    reinterpret_cast<const ParameterDefinition*>(p);
+                m_parameters[pDef->s_parameterName] = pDef->s_parameterNumber;
+                p += sizeof(ParameterDefinition) + strlen(pDef->s_parameterName) + 1;
+            }
+        }
+        /**
+         * readDirectory
+         *    Use the CHUNK_DIRECTORY_POINTER at the end of the file to read
+         *    the chunk directory.
+         * @throw std::runtime_error - the file does not end with a chunk
+         *        directory pointer (e.g. it was written by CDataWriter or
+         *        the writer was never destroyed).
+         */
+        void
+        CColumnarReader::readDirectory() {
+            struct stat info;
+            if (fstat(m_fd, &info) < 0) {
+                std::string msg = "CColumnarReader - can't stat file: ";
+                msg += strerror(errno);
+                throw std::runtime_error(msg);
+            }
+            ChunkDirectoryPointer pointer;
+            if (std::uint64_t(info.st_size) < sizeof(pointer)) {
+                throw std::runtime_error(
+                    "CColumnarReader - file has no chunk directory"
+                );
+            }
+            readAt(&pointer, sizeof(pointer), info.st_size - sizeof(pointer));
+            if (pointer.s_header.s_type != CHUNK_DIRECTORY_POINTER ||
+                pointer.s_header.s_size != sizeof(pointer)) {
+                throw std::runtime_error(
+                    "CColumnarReader - file has no chunk directory"
+                );
+            }
+            ChunkDirectory directory;
+            readAt(&directory, sizeof(directory), pointer.s_directoryOffset);
+            if (directory.s_header.s_type != CHUNK_DIRECTORY ||
+                directory.s_header.s_size !=
+                    sizeof(directory) + directory.s_chunkCount * sizeof(ChunkDirectoryEntry)) {
+                throw std::runtime_error(
+                    "CColumnarReader - chunk directory pointer does not point to a directory"
+                );
+            }
+            m_directory.resize(directory.s_chunkCount);
+            readAt(
+                m_directory.data(),
+                directory.s_chunkCount * sizeof(ChunkDirectoryEntry),
+                pointer.s_directoryOffset + sizeof(directory)
+            );
+        }
+        /**
+         * readAt
+         *    Read a block of data at an offset, dealing with partial reads
+         *    and interrupted system calls.
+         * @param pData - where to put the data.
+         * @param nBytes - number of bytes to read.
+         * @param offset - file offset of the data.
+         * @throw std::runtime_error - read failure or end of file.
+         */
+        void
+        CColumnarReader::readAt(void* pData, std::size_t nBytes, std::uint64_t offset) {
+            iovec part;
+            part.iov_base = pData;
+            part.iov_len  = nBytes;
+            readAt(&part, 1, offset);
+        }
+        /**
+         * readAt
+         *    Scatter read of contiguous file data at an offset.  On return
+         *    the iovecs have been modified.
+         * @param pParts - describes where the data go.
+         * @param nParts - number of parts.
+         * @param offset - file offset of the data.
+         * @throw std::runtime_error - read failure or end of file.
+         */
+        void
+        CColumnarReader::readAt(iovec* pParts, int nParts, std::uint64_t offset) {
+            while (nParts) {
+                if (pParts->iov_len == 0) {
+                    pParts++;
+                    nParts--;
+                    continue;
+                }
+                ssize_t n = preadv(m_fd, pParts, nParts, offset);
+                if (n < 0) {
+                    if (errno == EINTR) continue;
+                    std::string msg = "CColumnarReader failed to read data: ";
+                    msg += strerror(errno);
+                    throw std::runtime_error(msg);
+                }
+                if (n == 0) {
+                    throw std::runtime_error(
+                        "CColumnarReader - unexpected end of file"
+                    );
+                }
+                offset       += n;
+                m_nBytesRead += n;
+                while (n && nParts) {
+                    size_t used = (size_t(n) < pParts->iov_len) ? n : pParts->iov_len;
+                    pParts->iov_base = reinterpret_cast<std::uint8_t*>(pParts->iov_base) + used;
+                    pParts->iov_len -= used;
+                    n               -= used;
+                    if (pParts->iov_len == 0) {
+                        pParts++;
+                        nParts--;
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,119 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+
+/** @file:  ColumnarReader.h
+ *  @brief: Selectively read parameters from a columnar parameter file.
+ */
+#ifndef COLUMNARREADER_H
+#define COLUMNARREADER_H
+#include "AnalysisRingItems.h"
+#include <vector>
+#include <string>
+#include <map>
+#include <cstdint>
+#include <cstddef>
+
+struct iovec;
+
+namespace frib {
+    namespace analysis {
+        /**
+         * @class CColumnarReader
+         *    Reads files written by CColumnarDataWriter.  The chunk directory
+         *    at the end of the file is read when the reader is constructed.
+         *    After that, readChunk reads the triggers and column directory of
+         *    a chunk and then only the columns the caller asks for.  For
+         *    a consumer that wants a few parameters of many, that's a small
+         *    fraction of the file.
+         *
+         *    Typical use:
+         *
+         *  \verbatim
+         *     CColumnarReader reader("run.par");
+         *     std::vector<unsigned> want = {
+         *        reader.parameterNumber("x"), reader.parameterNumber("y")
+         *     };
+         *     CColumnarReader::Chunk chunk;
+         *     for (size_t c = 0; c < reader.chunks(); c++) {
+         *         reader.readChunk(c, want, chunk);
+         *         auto& x(chunk.s_columns[0]);
+         *         size_t nx = 0;
+         *         for (size_t e = 0; e < chunk.s_triggers.size(); e++) {
+         *             if (x.present(e)) {
+         *                 double value = x.s_values[nx++];
+         *                 ...
+         *             }
+         *         }
+         *     }
+         *  \endverbatim
+         */
+        class CColumnarReader {
+        public:
+            /**
+             *  The values of one parameter in a chunk.  s_values
+             *  has one value for each event whose bit is set in s_present.
+             */
+            struct Column {
+                unsigned                  s_parameterNumber;
+                std::vector<std::uint8_t> s_present;
+                std::vector<double>       s_values;
+                
+                bool present(std::size_t event) const {
+                    return (s_present[event/8] >> (event % 8)) & 1;
+                }
+            };
+            /**
+             * A chunk as read - s_columns are in the order requested.
+             */
+            struct Chunk {
+                std::vector<std::uint64_t> s_triggers;
+                std::vector<Column>        s_columns;
+            };
+        private:
+            int                                m_fd;
+            std::map<std::string, unsigned>    m_parameters;
+            std::vector<ChunkDirectoryEntry>   m_directory;
+            std::vector<std::uint8_t>          m_head;   // Of chunk being read.
+            std::uint64_t                      m_nBytesRead;
+        public:
+            CColumnarReader(const char* pFilename);
+            virtual ~CColumnarReader();
+        private:
+            CColumnarReader(const CColumnarReader& rhs);
+            CColumnarReader& operator=(const CColumnarReader& rhs);
+            int operator==(const CColumnarReader& rhs) const;
+            int operator!=(const CColumnarReader& rhs) const;
+        public:
+            unsigned parameterNumber(const std::string& name) const;
+            std::size_t chunks() const;
+            const ChunkDirectoryEntry& chunkInfo(std::size_t n) const;
+            void readChunk(
+                std::size_t n, const std::vector<unsigned>& numbers,
+                Chunk& chunk
+            );
+            std::uint64_t bytesRead() const;
+        private:
+            void readDefinitions();
+            void readDirectory();
+            void readAt(void* pData, std::size_t nBytes, std::uint64_t offset);
+            void readAt(iovec* pParts, int nParts, std::uint64_t offset);
+        };
+    }
+}
+
+#endif
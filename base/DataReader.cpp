@@ -73,11 +73,23 @@ namespace frib {
             allocateBuffer();
             fillBuffer();
         }
+        /**
+         * constructor
+         *    For use by derived classes that manage their own data.
+         *    No file is open and there's no buffer.
+         */
+        CDataReader::CDataReader() :
+            m_nBytes(0), m_pBuffer(nullptr), m_nBufferSize(0),
+            m_eof(true), m_nFd(-1), m_fReleased(true),
+            m_nUserBytes(0), m_nUserItems(0)
+        {}
         /**
          * destructor
          */
         CDataReader::~CDataReader() {
-            close(m_nFd);
+            if (m_nFd >= 0) {
+                close(m_nFd);
+            }
             std::free(m_pBuffer);
         }
         /**
@@ -118,11 +130,58 @@ namespace frib {
                 throw std::logic_error("Releasing but already released");
             }
             std::uint8_t* pfront = static_cast<std::uint8_t*>(m_pBuffer);
-            memmove(pfront, pfront + m_nUserBytes, m_nUserBytes);
+            memmove(pfront, pfront + m_nUserBytes, m_nBytes - m_nUserBytes);
             m_nBytes -= m_nUserBytes;
             m_fReleased = true;
             fillBuffer();                  // Read ahead more.
         }
+        /**
+         * blocksPersist
+         *    @return bool - false; done() recycles the buffer the data
+         *                   were returned in.
+         */
+        bool
+        CDataReader::blocksPersist() const
+        {
+            return false;
+        }
+        /**
+         * seek
+         *    Continue reading from an offset in the file.  Any buffered
+         *    data are discarded.
+         * @param offset - file offset of the item to read next.
+         * @throw std::logic_error - the last block has not been released or
+         *        the reader does not have a file to seek in.
+         * @throw std::runtime_error - the file can't seek (e.g. a pipe).
+         */
+        void
+        CDataReader::seek(std::uint64_t offset)
+        {
+            if (!m_fReleased) {
+                throw std::logic_error("Attempted seek without releasing prior data");
+            }
+            if (m_nFd < 0) {
+                throw std::logic_error("This data reader can't seek");
+            }
+            if (lseek(m_nFd, offset, SEEK_SET) == (off_t)-1) {
+                std::string msg = "CDataReader seek failed: ";
+                msg += strerror(errno);
+                throw std::runtime_error(msg);
+            }
+            m_nBytes = 0;
+            m_eof    = false;
+            fillBuffer();
+        }
+        /**
+         * addContext
+         *    Accept items needed to interpret what follows a seek.  We
+         *    don't interpret items so we don't need them.
+         * @param pItems - pointer to the first of the items.
+         * @param nBytes - number of bytes of items.
+         */
+        void
+        CDataReader::addContext(const void* pItems, std::size_t nBytes)
+        {}
         //////////////////////////////////////////////////////////////////////////
         // Private utilities:
         
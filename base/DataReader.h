@@ -22,6 +22,7 @@
 #define DATAREADER_H
 
 #include <cstddef>
+#include <cstdint>
 
 namespace frib {
     namespace analysis {
@@ -56,6 +57,17 @@ namespace frib {
          * @note this works best (in terms of minmal data movement), if the
          *       size of the reader's buffer is closely matched to the maxsize's
          *       that are passed to getBlock().
+         * @note getBlock and done are virtual so that other ways of getting
+         *       at the data (e.g. CMappedDataReader) can be dropped in
+         *       wherever a CDataReader is used.
+         * @note blocksPersist tells clients whether the data returned by
+         *       getBlock remain valid after done() is called.  For us they
+         *       don't - done() slides the unconsumed data down over them.
+         * @note seek repositions readers on seekable sources to an item
+         *       boundary (e.g. one from a CTriggerIndex).  Readers that
+         *       interpret items (CInflatingDataReader) may need the items
+         *       a seek skipped over, the index context, given to them via
+         *       addContext.
          */
         class CDataReader {
         private:
@@ -85,15 +97,19 @@ namespace frib {
             CDataReader(const char* pFilename, std::size_t bufferSize);
             CDataReader(int fd,  std::size_t bufferSize);
             virtual ~CDataReader();
-            
+        protected:
+            CDataReader();            // For readers that don't use our buffer.
         private:
             CDataReader(const CDataReader& rhs);
             CDataReader& operator=(const CDataReader& rhs);
             int operator==(const CDataReader& rhs);
             int operator!=(const CDataReader& rhs);
         public:
-            Result getBlock(std::size_t maxbytes);
-            void done();
+            virtual Result getBlock(std::size_t maxbytes);
+            virtual void done();
+            virtual bool blocksPersist() const;
+            virtual void seek(std::uint64_t offset);
+            virtual void addContext(const void* pItems, std::size_t nBytes);
         private:
             void allocateBuffer();
             void fillBuffer();
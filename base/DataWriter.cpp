@@ -24,6 +24,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <sys/uio.h>
 
 #include <stdexcept>
 #include <string>
@@ -31,15 +32,29 @@
 #include <sstream>
 #include <iostream>
 #include "AnalysisRingItems.h"
+#include "TriggerIndex.h"
 
 namespace frib {
     namespace analysis {
+        // 1MB is enough to amortize the system call overhead many times over
+        // without being a significant memory cost.
+        
+        const std::size_t CDataWriter::DEFAULT_BUFFER_SIZE(1024*1024);
+        
         /**
          * constructor
          *   @param pFilename - path to the output file.
+         *   @param bufferSize - Number of bytes of output buffering,
+         *                      0 means writes are not buffered.
+         *   @param indexInterval - If nonzero, the file is indexed with an
+         *                      entry every indexInterval items.
          */
-        CDataWriter::CDataWriter(const char* pFilename) :
-            m_fd(-1) {
+        CDataWriter::CDataWriter(
+            const char* pFilename, std::size_t bufferSize,
+            std::uint32_t indexInterval
+        ) :
+            m_fd(-1), m_pBuffer(nullptr), m_nBufferSize(0), m_nBuffered(0),
+            m_nWritten(0), m_pIndex(nullptr) {
                 m_fd = creat(pFilename, S_IRUSR | S_IWUSR | S_IRGRP);
                 if(m_fd < 0) {
                     const char* pReason = strerror(errno);
@@ -49,23 +64,45 @@ namespace frib {
                     std::string msg = s.str();
                     throw std::runtime_error(msg);
                 }
+                allocateBuffer(bufferSize);
+                if (indexInterval) {
+                    m_pIndex = new CTriggerIndex(indexInterval);
+                    m_indexFile = CTriggerIndex::sidecarName(pFilename);
+                    m_dataFile  = pFilename;
+                }
                 writeFrontMatter();
         }
         /**
          * constructor from fd
          *   @param fd - file descriptor already open on the output file:
+         *   @param bufferSize - Number of bytes of output buffering,
+         *                      0 means writes are not buffered.
          */
-        CDataWriter::CDataWriter(int fd) :
-            m_fd(fd)
+        CDataWriter::CDataWriter(int fd, std::size_t bufferSize) :
+            m_fd(fd), m_pBuffer(nullptr), m_nBufferSize(0), m_nBuffered(0),
+            m_nWritten(0), m_pIndex(nullptr)
         {
+            off_t here = lseek(m_fd, 0, SEEK_CUR);  // Fails for pipes etc.
+            if (here > 0) {
+                m_nWritten = here;
+            }
+            allocateBuffer(bufferSize);
             writeFrontMatter();
         }
         
         /**
          * destructor
+         *    If the file has not been finished, finish it.  Since we can't
+         *    throw from here, failures are ignored; clients that want to know
+         *    about them should call finish() before destruction.
          */
         CDataWriter::~CDataWriter() {
-            close(m_fd);
+            try {
+                CDataWriter::finish();
+            }
+            catch (...) {}
+            delete []m_pBuffer;
+            delete m_pIndex;
         }
         //////////////////////////////////////////////////////////////////////
         // Public methods.
@@ -73,35 +110,33 @@ namespace frib {
         /**
          * writeEvent
          *   Write an event that's been marshalled into a parameter #/value set of pairs.
+         *   The event is marshalled as a ParameterItem directly into the output
+         *   buffer.  If it won't fit in the buffer at all (or we're unbuffered),
+         *   it's marshalled into a temporary and written in one go.
          * @param event -the event to write.
+         * @param trigger - the trigger number of the event.
          */
         void CDataWriter::writeEvent(
             const std::vector<std::pair<unsigned, double>>& event,
             std::uint64_t trigger
         ) {
             size_t nBytes = sizeEvent(event);
-            writeHeader(nBytes, PARAMETER_DATA);
-            write(m_fd, &trigger, sizeof(trigger));
-            std::uint32_t nParams = event.size();
-            write(m_fd, &nParams, sizeof(nParams));
-            
-            // You might think you could just point to the data using
-            // event.data and write event.size()*sizeof(std::pari<unsigned, double)
-            // and that would write the data _but:
-            // - unsigned may not be std::uint32_t.
-            // - There's no assurance the pair is packed as required by the
-            //   spec.
-            
-            for (auto& item : event) {
-                ParameterValue v;
-                v.s_number = item.first;
-                v.s_value  = item.second;
-                write(m_fd, &v, sizeof(v));
+            indexItem(true, trigger);
+            void* pDest = reserve(nBytes);
+            if (pDest) {
+                marshallEvent(pDest, nBytes, event, trigger);
+            } else {
+                std::vector<std::uint8_t> item(nBytes);
+                marshallEvent(item.data(), nBytes, event, trigger);
+                put(item.data(), nBytes);
             }
         }
         /**
          * writeItem
          *   Write a non-event item -- this is just a passthrough item.
+         *   Small items are just buffered.  If the item won't fit in the
+         *   remaining buffer space, the buffered data and the item are written
+         *   in a single gathered write so the item is never copied.
          * @param pItem - pointer to the item to write.
          */
         void
@@ -109,11 +144,182 @@ namespace frib {
             // Item is a ring item so:
             
             const RingItemHeader* p = reinterpret_cast<const RingItemHeader*>(pItem);
-            write(m_fd, p, p->s_size);
+            indexItems(p, p->s_size);
+            if ((m_nBuffered + p->s_size) <= m_nBufferSize) {
+                put(p, p->s_size);
+            } else {
+                gather(p, p->s_size);
+            }
+        }
+        /**
+         * writeBlock
+         *    Write a block of complete ring items, e.g. a run of
+         *    PARAMETER_DATA items that were marshalled elsewhere.  Like
+         *    writeItem, the block is buffered if it fits, otherwise it's
+         *    written along with the buffered data without being copied.
+         * @param pData  - pointer to the first item of the block.
+         * @param nBytes - number of bytes in the block.
+         */
+        void
+        CDataWriter::writeBlock(const void* pData, std::size_t nBytes) {
+            indexItems(pData, nBytes);
+            if ((m_nBuffered + nBytes) <= m_nBufferSize) {
+                put(pData, nBytes);
+            } else {
+                gather(pData, nBytes);
+            }
+        }
+        /**
+         * flush
+         *    Write any buffered data to the file.
+         *  @throw std::runtime_error - if the write fails.
+         */
+        void
+        CDataWriter::flush() {
+            flushBuffer();
+        }
+        /**
+         * finish
+         *    Flush any buffered data, close the file and write the index
+         *    sidecar if we're indexing.  Once finished, nothing more can be
+         *    written; finishing again does nothing.
+         *  @throw std::runtime_error - if the data, the close or the
+         *         sidecar can't be written.  The file is closed anyway.
+         */
+        void
+        CDataWriter::finish() {
+            if (finished()) {
+                return;
+            }
+            try {
+                flushBuffer();
+            }
+            catch (...) {
+                close(m_fd);
+                m_fd = -1;
+                throw;
+            }
+            int status = close(m_fd);
+            m_fd = -1;
+            if (status < 0) {
+                std::stringstream s;
+                s << "CDataWriter - failed to close the output file : "
+                  << strerror(errno);
+                throw std::runtime_error(s.str());
+            }
+            if (m_pIndex) {
+                m_pIndex->describeFile(m_dataFile.c_str());
+                m_pIndex->write(m_indexFile.c_str());
+            }
+        }
+        ///////////////////////////////////////////////////////////////////////
+        // Protected methods for derived writers.
+        
+        /**
+         * finished
+         *    @return bool - true if finish() has been called.
+         */
+        bool
+        CDataWriter::finished() const {
+            return m_fd < 0;
+        }
+        /**
+         * position
+         *    @return std::uint64_t - the file offset at which the next byte
+         *               put will land.  This includes data that are still
+         *               buffered.  If the writer was constructed on an fd
+         *               that can't seek (e.g. a pipe), offsets are relative
+         *               to where the writer started.
+         */
+        std::uint64_t
+        CDataWriter::position() const {
+            return m_nWritten + m_nBuffered;
+        }
+        /**
+         * indexItem
+         *    Tell the index (if there is one) about the item that's about
+         *    to be put at position().  Derived writers must call this
+         *    for each item they write other than through writeItem/writeBlock.
+         * @param hasTrigger - true if the item has a trigger number.
+         * @param trigger    - that trigger number.
+         */
+        void
+        CDataWriter::indexItem(bool hasTrigger, std::uint64_t trigger) {
+            if (m_pIndex) {
+                m_pIndex->addItem(position(), hasTrigger, trigger);
+            }
+        }
+        /**
+         * addIndexContext
+         *    Keep a copy of an item in the index context (if there's an
+         *    index), see CTriggerIndex::addContext.
+         * @param pItem - the ring item.
+         */
+        void
+        CDataWriter::addIndexContext(const void* pItem) {
+            if (m_pIndex) {
+                m_pIndex->addContext(pItem);
+            }
         }
         ///////////////////////////////////////////////////////////////////////
         // Private utilities:
         
+        /**
+         * indexItems
+         *    Index a block of complete ring items that's about to be put
+         *    at position().
+         * @param pData  - pointer to the first item.
+         * @param nBytes - number of bytes in the block.
+         */
+        void
+        CDataWriter::indexItems(const void* pData, size_t nBytes) {
+            if (m_pIndex) {
+                std::uint64_t offset = position();
+                const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(pData);
+                const std::uint8_t* pEnd = p + nBytes;
+                while (p < pEnd) {
+                    const RingItemHeader* pHeader =
+                        reinterpret_cast<const RingItemHeader*>(p);
+                    std::uint64_t trigger(0);
+                    bool hasTrigger = CTriggerIndex::triggerOf(p, trigger);
+                    m_pIndex->addItem(offset, hasTrigger, trigger);
+                    if (pHeader->s_type == PARAMETER_PATTERNS) {
+                        m_pIndex->addContext(p);
+                    }
+                    offset += pHeader->s_size;
+                    p      += pHeader->s_size;
+                }
+            }
+        }
+        /**
+         * flushBuffer
+         *    Write the output buffer to the file.  Internally we use this
+         *    rather than flush() as derived classes can override flush()
+         *    to do more than empty the buffer.
+         *  @throw std::runtime_error - if the write fails.
+         */
+        void
+        CDataWriter::flushBuffer() {
+            if (m_nBuffered) {
+                size_t n = m_nBuffered;
+                m_nBuffered = 0;             // Don't retry a failed write.
+                writeAll(m_pBuffer, n);
+            }
+        }
+        /**
+         * allocateBuffer
+         *    Allocate the output buffer.
+         *  @param bufferSize - size of the buffer, if 0 no buffer is allocated
+         *                   and all output is unbuffered.
+         */
+        void
+        CDataWriter::allocateBuffer(std::size_t bufferSize) {
+            if (bufferSize) {
+                m_pBuffer = new std::uint8_t[bufferSize];
+            }
+            m_nBufferSize = bufferSize;
+            m_nBuffered   = 0;
+        }
         /**
          * writeFrontMatter
          *     Write the stuff at the front of every file.
@@ -134,13 +340,14 @@ namespace frib {
         {
             auto defs = CTreeParameter::getDefinitions();
             size_t nBytes = sizeParameterDefItem(defs);
+            indexItem(false);
             writeHeader(nBytes, PARAMETER_DEFINITIONS);
             std::uint32_t n = defs.size();
-            write(m_fd, &n, sizeof(n));
+            put(&n, sizeof(n));
             for (auto& d : defs) {
                 std::uint32_t number = d.second.s_parameterNumber;
-                write(m_fd, &number, sizeof(number));
-                write(m_fd, d.first.c_str(), d.first.size()+1);   // +1 is the null terminator.
+                put(&number, sizeof(number));
+                put(d.first.c_str(), d.first.size()+1);   // +1 is the null terminator.
             }
         }
         /**
@@ -151,17 +358,18 @@ namespace frib {
         CDataWriter::writeVariableDefs() {
             auto defs = CTreeVariable::getDefinitions();
             size_t nBytes = sizeVariableDefItem(defs);
+            indexItem(false);
             writeHeader(nBytes, VARIABLE_VALUES);
             std::uint32_t n = defs.size();
-            write(m_fd, &n, sizeof(n));
+            put(&n, sizeof(n));
             
             for (auto& d : defs) {
-                write(m_fd, &d.second->s_value, sizeof(double));
+                put(&d.second->s_value, sizeof(double));
                 char units[MAX_UNITS_LENGTH];
                 memset(units, 0, sizeof(units));
                 strncpy(units, d.second->s_units.c_str(), MAX_UNITS_LENGTH);
-                write(m_fd, units, MAX_UNITS_LENGTH);
-                write(m_fd, d.first.c_str(), d.first.size() + 1);
+                put(units, MAX_UNITS_LENGTH);
+                put(d.first.c_str(), d.first.size() + 1);
             }
         }
         /**
@@ -231,7 +439,149 @@ namespace frib {
             RingItemHeader header = {
                 std::uint32_t(nBytes), std::uint32_t(type), sizeof(std::uint32_t)
             };
-            write(m_fd, &header, sizeof(header));
+            put(&header, sizeof(header));
+        }
+        /**
+         * marshallEvent
+         *    Marshall an event as a PARAMETER_DATA ring item.
+         *  @param pDest - where to put the item, must have at least nBytes of
+         *                storage.
+         *  @param nBytes - Size of the item (from sizeEvent).
+         *  @param event  - The parameter number/value pairs.
+         *  @param trigger - The trigger number of the event.
+         *  @note we can't just point to event.data() since:
+         *    - unsigned may not be std::uint32_t.
+         *    - There's no assurance the pair is packed as required by the
+         *      spec.
+         */
+        void
+        CDataWriter::marshallEvent(
+            void* pDest, size_t nBytes,
+            const std::vector<std::pair<unsigned, double>>& event,
+            std::uint64_t trigger
+        ) {
+            pParameterItem pItem = reinterpret_cast<pParameterItem>(pDest);
+            pItem->s_header.s_size = nBytes;
+            pItem->s_header.s_type = PARAMETER_DATA;
+            pItem->s_header.s_unused = sizeof(std::uint32_t);
+            pItem->s_triggerCount = trigger;
+            pItem->s_parameterCount = event.size();
+            
+            pParameterValue p = pItem->s_parameters;
+            for (auto& item : event) {
+                p->s_number = item.first;
+                p->s_value  = item.second;
+                p++;
+            }
+        }
+        /**
+         * reserve
+         *    Reserve space in the output buffer, flushing it if needed.
+         *  @param nBytes - number of bytes needed.
+         *  @return void* - Pointer to the reserved space.  This is nullptr if the
+         *                request can never fit in the buffer.
+         */
+        void*
+        CDataWriter::reserve(size_t nBytes) {
+            if (nBytes > m_nBufferSize) {
+                return nullptr;
+            }
+            if ((m_nBuffered + nBytes) > m_nBufferSize) {
+                flushBuffer();
+            }
+            void* result = m_pBuffer + m_nBuffered;
+            m_nBuffered += nBytes;
+            return result;
+        }
+        /**
+         * put
+         *    Put data into the output stream.  If the data fit in the buffer
+         *    they are copied into it.  Otherwise the buffer is flushed and
+         *    the data are written directly.
+         * @param pData - the data to write.
+         * @param nBytes - number of bytes of data.
+         */
+        void
+        CDataWriter::put(const void* pData, size_t nBytes) {
+            void* pDest = reserve(nBytes);
+            if (pDest) {
+                memcpy(pDest, pData, nBytes);
+            } else {
+                flushBuffer();
+                writeAll(pData, nBytes);
+            }
+        }
+        /**
+         * writeAll
+         *    Write a block of data to file dealing with partial writes
+         *    and interrupted system calls.
+         * @param pData - the data to write.
+         * @param nBytes - number of bytes to write.
+         * @throw std::runtime_error - on write failures.
+         */
+        void
+        CDataWriter::writeAll(const void* pData, size_t nBytes) {
+            const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(pData);
+            while (nBytes) {
+                ssize_t n = write(m_fd, p, nBytes);
+                if (n < 0) {
+                    if (errno == EINTR) continue;
+                    std::string msg = "CDataWriter failed to write data: ";
+                    msg += strerror(errno);
+                    throw std::runtime_error(msg);
+                }
+                p      += n;
+                nBytes -= n;
+                m_nWritten += n;
+            }
+        }
+        /**
+         * gather
+         *    Write the contents of the buffer followed by a block of
+         *    user data with one writev(2) call (well more if there are
+         *    partial writes).  On exit, the output buffer is empty.
+         * @param pData - the user data to write after the buffer.
+         * @param nBytes - number of bytes of user data.
+         * @throw std::runtime_error on write failures.
+         */
+        void
+        CDataWriter::gather(const void* pData, size_t nBytes) {
+            iovec parts[2];
+            parts[0].iov_base = m_pBuffer;
+            parts[0].iov_len  = m_nBuffered;
+            parts[1].iov_base = const_cast<void*>(pData);
+            parts[1].iov_len  = nBytes;
+            m_nBuffered = 0;
+            
+            iovec* pPart = parts;
+            int    nParts = 2;
+            while (nParts) {
+                if (pPart->iov_len == 0) {          // Done with this part.
+                    pPart++;
+                    nParts--;
+                    continue;
+                }
+                ssize_t n = writev(m_fd, pPart, nParts);
+                if (n < 0) {
+                    if (errno == EINTR) continue;
+                    std::string msg = "CDataWriter failed to write data: ";
+                    msg += strerror(errno);
+                    throw std::runtime_error(msg);
+                }
+                // Account for what got written - could be partial.
+                
+                m_nWritten += n;
+                while (n && nParts) {
+                    size_t used = (size_t(n) < pPart->iov_len) ? n : pPart->iov_len;
+                    pPart->iov_base = reinterpret_cast<std::uint8_t*>(pPart->iov_base) + used;
+                    pPart->iov_len -= used;
+                    n              -= used;
+                    if (pPart->iov_len == 0) {
+                        pPart++;
+                        nParts--;
+                    }
+                }
+            }
         }
     }
 }
\ No newline at end of file
@@ -22,12 +22,15 @@
 #define DATAWRITER_H
 #include <vector>
 #include <cstdint>
+#include <cstddef>
+#include <string>
 
 #include "TreeVariable.h"
 #include "TreeParameter.h"
 
 namespace frib {
     namespace analysis {
+        class CTriggerIndex;
         /**
          * @class CDataWriter
          *    Writes data to some sink.  We assume that the
@@ -36,13 +39,49 @@ namespace frib {
          *    the parameter and variable definitions to the output sink.
          *    Once that's done, we just accept data from the client and
          *    write it to our sink.  We closee the sink on destruction.
+         *
+         *    By default output is accumulated in a user space buffer and
+         *    written in large chunks when the buffer fills, when flush()
+         *    is called and when the writer is destroyed.  Events are
+         *    marshalled as complete ParameterItems directly into that
+         *    buffer.  Passing a buffer size of 0 makes the writer unbuffered,
+         *    though each item is still written with a single system call.
+         *
+         *    The output methods are virtual so that derived writers
+         *    (e.g. CColumnarDataWriter) can lay the events out differently
+         *    while still sharing the front matter and buffering.
+         *
+         *    If constructed with a nonzero index interval, the writer also
+         *    builds a CTriggerIndex of the file as it writes it and, when the
+         *    file is finished, writes it to the file's index sidecar (see
+         *    CTriggerIndex::sidecarName).  Derived writers that make
+         *    their own items tell the index about them with indexItem.
+         *
+         *    finish() completes the file (derived writers may have more to
+         *    write), flushes and closes it and writes the sidecar, throwing
+         *    if any of that fails.  Clients that need to know the file is
+         *    good should call it; the destructor only finishes the file on
+         *    a best effort basis since it can't report failures.
          */
         class CDataWriter {
+        public:
+            static const std::size_t DEFAULT_BUFFER_SIZE;
         private:
-            int m_fd;
+            int           m_fd;
+            std::uint8_t* m_pBuffer;
+            std::size_t   m_nBufferSize;
+            std::size_t   m_nBuffered;
+            std::uint64_t m_nWritten;
+            CTriggerIndex* m_pIndex;
+            std::string    m_indexFile;
+            std::string    m_dataFile;
         public:
-            CDataWriter(const char* pFilename);
-            CDataWriter(int fd);
+            CDataWriter(
+                const char* pFilename,
+                std::size_t bufferSize = DEFAULT_BUFFER_SIZE,
+                std::uint32_t indexInterval = 0
+            );
+            CDataWriter(int fd, std::size_t bufferSize = DEFAULT_BUFFER_SIZE);
             virtual ~CDataWriter();
         private:
             CDataWriter(const CDataWriter& rhs);
@@ -50,19 +89,39 @@ namespace frib {
             int operator==(const CDataWriter& rhs) const;
             int operator!=(const CDataWriter& rhs) const;
         public:
-            void writeEvent(
+            virtual void writeEvent(
                 const std::vector<std::pair<unsigned, double>>& event,
                 std::uint64_t eventNum
             );
-            void writeItem(const void* pItem);
+            virtual void writeItem(const void* pItem);
+            virtual void writeBlock(const void* pData, std::size_t nBytes);
+            virtual void flush();
+            virtual void finish();
+        protected:
+            bool finished() const;
+            std::uint64_t position() const;
+            void writeHeader(size_t nBytes, unsigned type);
+            void put(const void* pData, size_t nBytes);
+            void indexItem(bool hasTrigger, std::uint64_t trigger = 0);
+            void addIndexContext(const void* pItem);
         private:
+            void indexItems(const void* pData, size_t nBytes);
+            void flushBuffer();
+            void allocateBuffer(std::size_t bufferSize);
             void writeFrontMatter();
             void writeParameterDefs();
             void writeVariableDefs();
             size_t sizeParameterDefItem(const std::vector<std::pair<std::string, CTreeParameter::SharedData>>& defs);
             size_t sizeVariableDefItem(const std::vector<std::pair<std::string, const CTreeVariable::Definition*>>& defs);
             size_t sizeEvent(const std::vector<std::pair<unsigned, double>>& event);
-            void writeHeader(size_t nBytes, unsigned type);
+            void marshallEvent(
+                void* pDest, size_t nBytes,
+                const std::vector<std::pair<unsigned, double>>& event,
+                std::uint64_t trigger
+            );
+            void* reserve(size_t nBytes);
+            void writeAll(const void* pData, size_t nBytes);
+            void gather(const void* pData, size_t nBytes);
         };
     }
 }
@@ -0,0 +1,181 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+
+/** @file:  DefinitionSerializer.cpp
+ *  @brief: Implement CDefinitionSerializer.
+ */
+#include "DefinitionSerializer.h"
+#include "TreeParameter.h"
+#include "TreeVariable.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <string.h>
+
+namespace frib {
+    namespace analysis {
+        
+        /**
+         * put
+         *    Append a plain old data item to a blob.
+         */
+        template<class T> static void
+        put(std::vector<std::uint8_t>& blob, const T& item) {
+            const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(&item);
+            blob.insert(blob.end(), p, p + sizeof(T));
+        }
+        /**
+         * putString
+         *    Append a string and its null terminator to a blob.
+         */
+        static void
+        putString(std::vector<std::uint8_t>& blob, const std::string& s) {
+            const std::uint8_t* p =
+                reinterpret_cast<const std::uint8_t*>(s.c_str());
+            blob.insert(blob.end(), p, p + s.size() + 1);
+        }
+        /**
+         * get
+         *    Pull a plain old data item from a blob.
+         * @throw std::invalid_argument - the blob is too short.
+         */
+        template<class T> static T
+        get(const std::uint8_t*& p, const std::uint8_t* pEnd) {
+            if (std::size_t(pEnd - p) < sizeof(T)) {
+                throw std::invalid_argument("Truncated definition blob");
+            }
+            T result;
+            memcpy(&result, p, sizeof(T));
+            p += sizeof(T);
+            return result;
+        }
+        /**
+         * getString
+         *    Pull a null terminated string from a blob.
+         * @throw std::invalid_argument - the blob is too short.
+         */
+        static std::string
+        getString(const std::uint8_t*& p, const std::uint8_t* pEnd) {
+            const std::uint8_t* pNull = std::find(p, pEnd, 0);
+            if (pNull == pEnd) {
+                throw std::invalid_argument("Truncated definition blob");
+            }
+            std::string result(reinterpret_cast<const char*>(p), pNull - p);
+            p = pNull + 1;
+            return result;
+        }
+        
+        /**
+         * serialize
+         *    Pack the current tree parameter and tree variable definitions.
+         * @return std::vector<std::uint8_t> - the blob.
+         */
+        std::vector<std::uint8_t>
+        CDefinitionSerializer::serialize() {
+            std::vector<std::uint8_t> result;
+            
+            auto params = CTreeParameter::getDefinitions();
+            std::sort(
+                params.begin(), params.end(),
+                [](const std::pair<std::string, CTreeParameter::SharedData>& a,
+                   const std::pair<std::string, CTreeParameter::SharedData>& b) {
+                    return a.second.s_parameterNumber < b.second.s_parameterNumber;
+                }
+            );
+            put(result, std::uint32_t(params.size()));
+            for (const auto& p : params) {
+                put(result, std::uint32_t(p.second.s_parameterNumber));
+                put(result, std::uint32_t(p.second.s_chans));
+                put(result, p.second.s_storage);
+                put(result, p.second.s_low);
+                put(result, p.second.s_high);
+                putString(result, p.first);
+                putString(result, p.second.s_units);
+            }
+            
+            put(result, std::uint32_t(CTreeVariable::size()));
+            for (auto p = CTreeVariable::begin(); p != CTreeVariable::end(); ++p) {
+                put(result, p->second.s_value);
+                putString(result, p->first);
+                putString(result, p->second.s_units);
+            }
+            return result;
+        }
+        /**
+         * deserialize
+         *    Make the definitions described by a blob from serialize.
+         * @param pData  - the blob.
+         * @param nBytes - its size.
+         * @throw std::invalid_argument - the blob is malformed.
+         * @throw std::logic_error - a parameter would get a different id
+         *              than it has in the blob.
+         */
+        void
+        CDefinitionSerializer::deserialize(const void* pData, std::size_t nBytes) {
+            const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(pData);
+            const std::uint8_t* pEnd = p + nBytes;
+            
+            std::uint32_t nParams = get<std::uint32_t>(p, pEnd);
+            CTreeParameter::reserveDefinitions(nParams);
+            for (std::uint32_t i = 0; i < nParams; i++) {
+                std::uint32_t id    = get<std::uint32_t>(p, pEnd);
+                std::uint32_t chans = get<std::uint32_t>(p, pEnd);
+                std::uint32_t storage = get<std::uint32_t>(p, pEnd);
+                double        low   = get<double>(p, pEnd);
+                double        high  = get<double>(p, pEnd);
+                std::string   name  = getString(p, pEnd);
+                std::string   units = getString(p, pEnd);
+                
+                // Ids are not always consecutive (e.g. array templates use
+                // them up) so a new parameter gets exactly its id.
+                
+                if (!CTreeParameter::lookupParameter(name)) {
+                    if (id < CTreeParameter::m_nextId) {
+                        std::string msg("Parameter ");
+                        msg += name;
+                        msg += "'s id is already in use";
+                        throw std::logic_error(msg);
+                    }
+                    CTreeParameter::m_nextId = id;
+                }
+                CTreeParameter param(name, chans, low, high, units);
+                if (param.getId() != id) {
+                    std::string msg("Parameter ");
+                    msg += name;
+                    msg += " has a different id than on rank 0";
+                    throw std::logic_error(msg);
+                }
+                if (param.getStorage() != storage) {
+                    param.setStorage(storage);
+                }
+            }
+            
+            std::uint32_t nVars = get<std::uint32_t>(p, pEnd);
+            for (std::uint32_t i = 0; i < nVars; i++) {
+                double      value = get<double>(p, pEnd);
+                std::string name  = getString(p, pEnd);
+                std::string units = getString(p, pEnd);
+                CTreeVariable var(name, value, units);
+            }
+            if (p != pEnd) {
+                throw std::invalid_argument("Definition blob has trailing data");
+            }
+        }
+    }
+}
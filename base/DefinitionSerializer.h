@@ -0,0 +1,60 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+
+/** @file:  DefinitionSerializer.h
+ *  @brief: Packs the tree parameter/variable definitions into a binary blob.
+ */
+#ifndef DEFINITIONSERIALIZER_H
+#define DEFINITIONSERIALIZER_H
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace frib {
+    namespace analysis {
+        /**
+         * @class CDefinitionSerializer
+         *    Running the parameter reader (e.g. a Tcl interpreter) on every
+         *    rank of a large application makes startup slow.  Instead, rank 0
+         *    reads the definitions and this class packs the tree parameter
+         *    and tree variable definitions into a compact binary blob that's
+         *    broadcast to the other ranks, which unpack it to make the
+         *    same definitions.
+         *
+         *    The blob is in native byte order:
+         *    -  uint32 number of parameters followed by that many
+         *       parameters in id order:  uint32 id, uint32 channels,
+         *       uint32 storage type (VALUE_*), double low, double high,
+         *       name (cz string), units (cz string).
+         *    -  uint32 number of variables followed by that many variables:
+         *       double value, name (cz string), units (cz string).
+         *
+         *    Parameters that are not yet defined are given the id they
+         *    have in the blob.  Ones that are (e.g. static tree parameters)
+         *    must already have that id; that's the case as long as they're
+         *    defined the same way on all ranks.  This is checked.
+         */
+        class CDefinitionSerializer {
+        public:
+            static std::vector<std::uint8_t> serialize();
+            static void deserialize(const void* pData, std::size_t nBytes);
+        };
+    }
+}
+
+#endif
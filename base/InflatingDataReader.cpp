@@ -0,0 +1,268 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  InflatingDataReader.cpp
+ *  @brief: Implement the CInflatingDataReader class.
+ */
+#include "InflatingDataReader.h"
+#include "AnalysisRingItems.h"
+#include "ParameterPacker.h"
+#include <stdexcept>
+
+namespace frib {
+    namespace analysis {
+        /**
+         * constructor
+         *   @param pReader - the reader we get data from.  It must have been
+         *                    dynamically created and now belongs to us.
+         */
+        CInflatingDataReader::CInflatingDataReader(CDataReader* pReader) :
+            m_pReader(pReader), m_nOffset(0), m_fReleased(true),
+            m_fFromInflated(false), m_nUserBytes(0)
+        {}
+        /**
+         * destructor
+         */
+        CInflatingDataReader::~CInflatingDataReader() {
+            delete m_pReader;
+        }
+        /**
+         * getBlock
+         *    - Ensure this is legal (m_fReleased is true).
+         *    - If we still have expanded data, hand out the next piece of it.
+         *    - Otherwise get a block from the wrapped reader.  If it has no
+         *      frames, packed or pattern items it's returned as is, otherwise
+         *      it's expanded and the first piece of the expansion is returned.
+         * @param maxbytes - maximum number of bytes the caller will accept.
+         * @return CDataReader::Result
+         * @throw std::runtime_error - a frame could not be inflated, a
+         *        packed item could not be widened or a pattern item
+         *        could not be expanded.
+         */
+        CDataReader::Result
+        CInflatingDataReader::getBlock(std::size_t maxbytes) {
+            if (!m_fReleased) {
+                throw std::logic_error("Attemped read without releasing prior data");
+            }
+            if (m_nOffset < m_inflated.size()) {
+                return nextInflated(maxbytes);
+            }
+            // A block of only pattern definitions expands to nothing so
+            // we go on to the next one:
+            
+            do {
+                Result block = m_pReader->getBlock(maxbytes);
+                if (!needsExpansion(block)) {
+                    m_fReleased     = false;
+                    m_fFromInflated = false;
+                    return block;
+                }
+                try {
+                    inflate(block);
+                }
+                catch (...) {
+                    m_inflated.clear();
+                    m_pReader->done();
+                    throw;
+                }
+                m_pReader->done();
+            } while (m_inflated.empty());
+            return nextInflated(maxbytes);
+        }
+        /**
+         * done
+         *    Release the data from the last getBlock - back to the wrapped
+         *    reader if they came from it.
+         */
+        void
+        CInflatingDataReader::done() {
+            if (m_fReleased) {
+                throw std::logic_error("Releasing but already released");
+            }
+            if (m_fFromInflated) {
+                m_nOffset += m_nUserBytes;
+            } else {
+                m_pReader->done();
+            }
+            m_fReleased = true;
+        }
+        /**
+         * blocksPersist
+         *    @return bool - false; expanded data are overwritten when the
+         *                   next block that needs expanding is read.
+         */
+        bool
+        CInflatingDataReader::blocksPersist() const {
+            return false;
+        }
+        /**
+         * seek
+         *    Discard any expanded data and have the wrapped reader seek.
+         * @param offset - file offset of the item to read next.
+         * @throw std::logic_error - the last block has not been released.
+         */
+        void
+        CInflatingDataReader::seek(std::uint64_t offset) {
+            if (!m_fReleased) {
+                throw std::logic_error("Attempted seek without releasing prior data");
+            }
+            m_inflated.clear();
+            m_nOffset = 0;
+            m_pReader->seek(offset);
+        }
+        /**
+         * addContext
+         *    Define the patterns of any PARAMETER_PATTERNS items in the
+         *    context.  Other items are ignored.
+         * @param pItems - pointer to the first of the items.
+         * @param nBytes - number of bytes of items.
+         * @throw std::runtime_error - a pattern item is bad or conflicts with
+         *        the patterns we already have.
+         */
+        void
+        CInflatingDataReader::addContext(const void* pItems, std::size_t nBytes) {
+            const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(pItems);
+            const std::uint8_t* pEnd = p + nBytes;
+            while (p < pEnd) {
+                const RingItemHeader* pHeader =
+                    reinterpret_cast<const RingItemHeader*>(p);
+                if (pHeader->s_type == PARAMETER_PATTERNS) {
+                    m_patterns.define(reinterpret_cast<const ParameterPatterns*>(p));
+                }
+                p += pHeader->s_size;
+            }
+        }
+        ///////////////////////////////////////////////////////////////////////
+        // Private utilities.
+        
+        /**
+         * nextInflated
+         *    Hand out the next whole items of the expanded data - as many as
+         *    fit in maxbytes but always at least one.
+         * @param maxbytes - maximum number of bytes the caller will accept.
+         * @return CDataReader::Result
+         */
+        CDataReader::Result
+        CInflatingDataReader::nextInflated(std::size_t maxbytes) {
+            const std::uint8_t* pStart = m_inflated.data() + m_nOffset;
+            std::size_t remaining = m_inflated.size() - m_nOffset;
+            std::size_t nBytes = 0;
+            std::size_t nItems = 0;
+            while (nBytes < remaining) {
+                const RingItemHeader* pHeader =
+                    reinterpret_cast<const RingItemHeader*>(pStart + nBytes);
+                if (nItems && (nBytes + pHeader->s_size > maxbytes)) {
+                    break;
+                }
+                nBytes += pHeader->s_size;
+                nItems++;
+            }
+            m_nUserBytes    = nBytes;
+            m_fReleased     = false;
+            m_fFromInflated = true;
+            
+            Result result;
+            result.s_nbytes = nBytes;
+            result.s_nItems = nItems;
+            result.s_pData  = pStart;
+            return result;
+        }
+        /**
+         * inflate
+         *    Expand a block into m_inflated: frames are inflated and the
+         *    items in them and all other items are appended as append
+         *    does.
+         * @param block - the block from the wrapped reader.
+         */
+        void
+        CInflatingDataReader::inflate(const Result& block) {
+            m_inflated.clear();
+            m_nOffset = 0;
+            const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(block.s_pData);
+            for (std::size_t i = 0; i < block.s_nItems; i++) {
+                const RingItemHeader* pHeader =
+                    reinterpret_cast<const RingItemHeader*>(p);
+                if (pHeader->s_type == COMPRESSED_PARAMETERS) {
+                    m_frame.clear();
+                    m_inflater.decompress(
+                        reinterpret_cast<const CompressedParameters*>(p), m_frame
+                    );
+                    // decompress checked the items so we can walk them:
+                    
+                    const std::uint8_t* pItem = m_frame.data();
+                    const std::uint8_t* pEnd  = pItem + m_frame.size();
+                    while (pItem < pEnd) {
+                        append(pItem);
+                        pItem += reinterpret_cast<const RingItemHeader*>(pItem)->s_size;
+                    }
+                } else {
+                    append(p);
+                }
+                p += pHeader->s_size;
+            }
+        }
+        /**
+         * append
+         *    Append an item to m_inflated, widening it if it's packed and
+         *    expanding it if it's a pattern item.  Pattern definitions are
+         *    added to m_patterns rather than appended.
+         * @param pItem - the item.
+         */
+        void
+        CInflatingDataReader::append(const std::uint8_t* pItem) {
+            const RingItemHeader* pHeader =
+                reinterpret_cast<const RingItemHeader*>(pItem);
+            if (pHeader->s_type == PACKED_PARAMETER_DATA) {
+                CParameterPacker::widen(
+                    reinterpret_cast<const PackedParameterItem*>(pItem), m_inflated
+                );
+            } else if (pHeader->s_type == PATTERN_PARAMETER_DATA) {
+                m_patterns.expand(
+                    reinterpret_cast<const PatternParameterItem*>(pItem), m_inflated
+                );
+            } else if (pHeader->s_type == PARAMETER_PATTERNS) {
+                m_patterns.define(reinterpret_cast<const ParameterPatterns*>(pItem));
+            } else {
+                m_inflated.insert(m_inflated.end(), pItem, pItem + pHeader->s_size);
+            }
+        }
+        /**
+         * needsExpansion
+         *    @param block - a block from the wrapped reader.
+         *    @return bool - true if there are compressed frames, packed
+         *                   or pattern items in it.
+         */
+        bool
+        CInflatingDataReader::needsExpansion(const Result& block) {
+            const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(block.s_pData);
+            for (std::size_t i = 0; i < block.s_nItems; i++) {
+                const RingItemHeader* pHeader =
+                    reinterpret_cast<const RingItemHeader*>(p);
+                if (
+                    (pHeader->s_type == COMPRESSED_PARAMETERS) ||
+                    (pHeader->s_type == PACKED_PARAMETER_DATA) ||
+                    (pHeader->s_type == PATTERN_PARAMETER_DATA) ||
+                    (pHeader->s_type == PARAMETER_PATTERNS)
+                ) {
+                    return true;
+                }
+                p += pHeader->s_size;
+            }
+            return false;
+        }
+    }
+}
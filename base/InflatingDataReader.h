@@ -0,0 +1,100 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  InflatingDataReader.h
+ *  @brief: A CDataReader that inflates compressed and packed parameters.
+ */
+#ifndef INFLATINGDATAREADER_H
+#define INFLATINGDATAREADER_H
+#include "DataReader.h"
+#include "ParameterCompressor.h"
+#include "ParameterPatterns.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace frib {
+    namespace analysis {
+        /**
+         * @class CInflatingDataReader
+         *    Wraps another CDataReader and replaces any
+         *    COMPRESSED_PARAMETERS frames it returns with the PARAMETER_DATA
+         *    items they hold and any PACKED_PARAMETER_DATA items (in frames
+         *    or not) with their widened PARAMETER_DATA equivalents (see
+         *    CParameterPacker).  PARAMETER_PATTERNS items are absorbed into
+         *    a pattern dictionary and PATTERN_PARAMETER_DATA items expanded
+         *    with it (see CPatternDataWriter).  Clients (e.g.
+         *    CMPIParameterDealer) therefore see a parameter file written by
+         *    compressing or packing workers or a pattern writer just as if it
+         *    had been written with plain PARAMETER_DATA items.
+         *
+         *    Blocks with nothing to expand in them are handed out as the
+         *    wrapped reader returned them.  Other blocks are expanded into a
+         *    buffer of our own (and released back to the wrapped reader)
+         *    and that buffer is then handed out in pieces of at most maxbytes
+         *    bytes, split at item boundaries, by this and subsequent
+         *    getBlock calls.  As with any item, a frame has to fit in
+         *    maxbytes; the items it expands to are handed out even if
+         *    they don't.
+         *
+         *    After a seek, the patterns of a pattern encoded file are
+         *    given to us as index context (addContext) since their
+         *    definitions may be behind the new position.
+         *
+         * @note the data handed out from our buffer are overwritten by the
+         *       next block that has to be expanded, so blocks don't persist.
+         * @note widened items are bigger than packed ones so, like frames,
+         *       they are handed out even if they exceed maxbytes.
+         */
+        class CInflatingDataReader : public CDataReader {
+        private:
+            CDataReader*              m_pReader;
+            CParameterCompressor      m_inflater;
+            CParameterPatterns        m_patterns;
+            std::vector<std::uint8_t> m_inflated;
+            std::vector<std::uint8_t> m_frame;        // Contents of one frame.
+            std::size_t               m_nOffset;      // Next data in m_inflated.
+            
+            // State of the last getBlock:
+            
+            bool                      m_fReleased;
+            bool                      m_fFromInflated;
+            std::size_t               m_nUserBytes;
+        public:
+            CInflatingDataReader(CDataReader* pReader);
+            virtual ~CInflatingDataReader();
+        private:
+            CInflatingDataReader(const CInflatingDataReader& rhs);
+            CInflatingDataReader& operator=(const CInflatingDataReader& rhs);
+            int operator==(const CInflatingDataReader& rhs);
+            int operator!=(const CInflatingDataReader& rhs);
+        public:
+            virtual Result getBlock(std::size_t maxbytes);
+            virtual void done();
+            virtual bool blocksPersist() const;
+            virtual void seek(std::uint64_t offset);
+            virtual void addContext(const void* pItems, std::size_t nBytes);
+        private:
+            Result nextInflated(std::size_t maxbytes);
+            void   inflate(const Result& block);
+            void   append(const std::uint8_t* pItem);
+            static bool needsExpansion(const Result& block);
+        };
+    }
+}
+
+#endif
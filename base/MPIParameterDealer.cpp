@@ -23,14 +23,38 @@
 #include "AbstractApplication.h"
 #include "AnalysisRingItems.h"
 #include "DataReader.h"
+#include "MappedDataReader.h"
+#include "InflatingDataReader.h"
+#include "AsyncDataReader.h"
+#include "TriggerIndex.h"
 #include <stdexcept>
 #include <cstdint>
 #include <vector>
 #include <string.h>
 #include <iostream>
+#include <chrono>
+#include <unistd.h>
 
 static unsigned DEFAULT_BLOCKSIZE=16*1024*1024;
 
+// Where an item is relative to the range of triggers (placeItem):
+
+static const int BEFORE_RANGE(-1);
+static const int IN_RANGE(0);
+static const int AFTER_RANGE(1);
+
+/**
+ * secondsSince
+ *   @param start - a time point.
+ *   @return double - seconds since start.
+ */
+static double
+secondsSince(std::chrono::steady_clock::time_point start)
+{
+    std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+    return d.count();
+}
+
 namespace frib {
     namespace analysis {
         /**
@@ -43,7 +67,10 @@ namespace frib {
         CMPIParameterDealer::CMPIParameterDealer(
             int argc, char** argv, AbstractApplication* pApp
         )  : m_argc(argc), m_argv(argv), m_pApp(pApp),
-        m_pReader(nullptr), m_nBlockSize(0), m_nEndsLeft(0)
+        m_pReader(nullptr), m_nBlockSize(0), m_nEndsLeft(0),
+        m_ioWaitTime(0.0), m_requestWaitTime(0.0), m_nDefinitions(0),
+        m_project(false), m_ranged(false), m_inRange(true),
+        m_nFirstTrigger(0), m_nEndTrigger(AbstractApplication::ALL_TRIGGERS)
         {}
         /**
          * destructor
@@ -61,10 +88,18 @@ namespace frib {
         CMPIParameterDealer::operator()() {
             m_nBlockSize = getBlockSize(m_argc, m_argv);
             auto name = getInputFile(m_argc, m_argv);
-            m_pReader = new CDataReader(name, m_nBlockSize);
+            m_pReader = createReader(name, m_nBlockSize);
             m_nEndsLeft = m_pApp->numWorkers();
             
-            auto info = m_pReader->getBlock(m_nBlockSize);
+            m_nFirstTrigger = m_pApp->getFirstTrigger(m_argc, m_argv);
+            std::uint64_t count = m_pApp->getTriggerCount(m_argc, m_argv);
+            m_nEndTrigger = (count > AbstractApplication::ALL_TRIGGERS - m_nFirstTrigger) ?
+                AbstractApplication::ALL_TRIGGERS : m_nFirstTrigger + count;
+            m_ranged  = (m_nFirstTrigger > 0) ||
+                (m_nEndTrigger != AbstractApplication::ALL_TRIGGERS);
+            m_inRange = (m_nFirstTrigger == 0);
+            
+            auto info = getBlock();
             if (info.s_nbytes == 0) {
                 
                 m_pApp->sendEofs();
@@ -83,11 +118,44 @@ namespace frib {
             
             p += sendDefinitions(p);
             nItems -= 2;
+            receiveProjections();
+            
+            // If we can, skip to the first trigger.  The rest of the first
+            // block is then not needed:
+            
+            CTriggerIndex index;
+            const TriggerIndexEntry* pStart = findStart(index);
+            if (pStart) {
+                done();
+                m_pReader->seek(pStart->s_offset);
+                m_pReader->addContext(index.context().data(), index.context().size());
+                info   = getBlock();
+                p      = reinterpret_cast<const std::uint8_t*>(info.s_pData);
+                nItems = info.s_nItems;
+            }
             
             // Send the remainder of the data and then EOFS to everyone.
     
             sendData(nItems, p);
-            sendEofs();
+            m_pApp->sendEofs();
+            reportStatistics(m_ioWaitTime, m_requestWaitTime);
+        }
+        /**
+         * getIoWaitTime
+         *   @return double - seconds spent waiting for the reader to supply
+         *                   or take back data.
+         */
+        double
+        CMPIParameterDealer::getIoWaitTime() const {
+            return m_ioWaitTime;
+        }
+        /**
+         * getRequestWaitTime
+         *   @return double - seconds spent waiting for data requests from workers.
+         */
+        double
+        CMPIParameterDealer::getRequestWaitTime() const {
+            return m_requestWaitTime;
         }
         ////////////////////////////////////////////////////////////////////
         // Private methods
@@ -122,6 +190,54 @@ namespace frib {
         CMPIParameterDealer::getBlockSize(int argc, char** argv) const {
             return DEFAULT_BLOCKSIZE;
         }
+        /**
+         * createReader
+         *    Create the reader that will supply data from the input file.
+         *    This is virtual so users can choose a different reader.  By default,
+         *    regular files are memory mapped so that data are sent straight
+         *    from the page cache; anything else (e.g. a pipe) is read ahead
+         *    on a background thread by a CAsyncDataReader.  Either way the
+         *    reader is wrapped in a CInflatingDataReader so files written by
+         *    compressing workers are read transparently.
+         * @param pFilename - name of the input file.
+         * @param blockSize - size of the blocks we'll be sending.
+         * @return CDataReader* - pointer to a dynamically created reader.
+         */
+        CDataReader*
+        CMPIParameterDealer::createReader(const char* pFilename, unsigned blockSize) const {
+            if (CMappedDataReader::isMappable(pFilename)) {
+                return new CInflatingDataReader(new CMappedDataReader(pFilename));
+            }
+            return new CInflatingDataReader(new CAsyncDataReader(pFilename, blockSize));
+        }
+        /**
+         * getIndexFile
+         *    Get the name of the trigger index of the input file.  It's
+         *    only used if the application starts after the first trigger
+         *    and it exists.
+         * @param argc, argv - command words.
+         * @return std::string - by default the index sidecar of the input
+         *                       file (see CTriggerIndex::sidecarName).
+         */
+        std::string
+        CMPIParameterDealer::getIndexFile(int argc, char** argv) const {
+            return CTriggerIndex::sidecarName(getInputFile(argc, argv));
+        }
+        /**
+         * reportStatistics
+         *    Report how long we spent waiting for I/O and waiting for worker
+         *    requests.  This is virtual so it can be overridden (e.g. to
+         *    suppress the report).  By default a line is written to stderr.
+         * @param ioSeconds - seconds spent in the reader's getBlock/done.
+         * @param requestSeconds - seconds spent waiting for worker requests.
+         */
+        void
+        CMPIParameterDealer::reportStatistics(
+            double ioSeconds, double requestSeconds
+        ) const {
+            std::cerr << "CMPIParameterDealer: blocked on I/O " << ioSeconds
+                << " s, blocked on worker requests " << requestSeconds << " s\n";
+        }
         /**
          * sendDefinitions
          *    Send the parameter and variable definitions to the workers.
@@ -145,8 +261,7 @@ namespace frib {
         /**
          * sendParameterDefs
          *    Send parameter definitions to the workers as a push.
-         *    These are sent individually rather than in a multicast
-         *    because it's simpler and only needs to be done once.
+         *    They're broadcast to all workers since each needs them.
          * @param pData - pointer to the parameter definition ring item.
          * @return size_t - Number of bytes in the ring item.
          * @throw std::logic_error if pData does not point at a PARAMETER_DEFINITIONS
@@ -162,7 +277,10 @@ namespace frib {
             
             // Send the number of defs:
             
-            sendAll(&(pDefs->s_numParameters), MPI_UINT32_T, 1, MPI_PARAMDEF_TAG);
+            m_nDefinitions = pDefs->s_numParameters;
+            sendAll(
+                &(pDefs->s_numParameters), CTransport::UINT32, 1, MPI_PARAMDEF_TAG
+            );
             
             // only marshall/send the defs if there are any:
             
@@ -184,7 +302,7 @@ namespace frib {
                 }
                 
                 sendAll(
-                    defs.data(), m_pApp->parameterDefType(),
+                    defs.data(), CTransport::PARAMETER_DEF,
                     pDefs->s_numParameters, MPI_PARAMDEF_TAG
                 );
             }
@@ -212,7 +330,9 @@ namespace frib {
             
             // Send the number of variables to expect:
             
-            sendAll(&(pItem->s_numVars), MPI_UINT32_T, 1, MPI_VARIABLES_TAG);
+            sendAll(
+                &(pItem->s_numVars), CTransport::UINT32, 1, MPI_VARIABLES_TAG
+            );
 
             // Only actuallys end variables if there are some:
             
@@ -238,106 +358,205 @@ namespace frib {
                 }
                 
                 sendAll(
-                    defs.data(), m_pApp->variableDefType(),
+                    defs.data(), CTransport::VARIABLE_DEF,
                     pItem->s_numVars, MPI_VARIABLES_TAG
                 );
             }
             
             return pItem->s_header.s_size;
         }
+        /**
+         * receiveProjections
+         *    Each worker replies to the definitions with the number of
+         *    parameter ids it consumes followed (if there are any) by the
+         *    ids.  The union of those is stored in m_consumed.  If that's
+         *    not all of the defined parameters, m_project is set so
+         *    work items are projected onto the consumed parameters.
+         *    The time this takes is accumulated into m_requestWaitTime.
+         */
+        void
+        CMPIParameterDealer::receiveProjections() {
+            auto start = std::chrono::steady_clock::now();
+            CTransport& transport(m_pApp->transport());
+            std::uint32_t nConsumed(0);
+            std::vector<std::uint32_t> ids;
+            
+            m_consumed.clear();
+            int endRank = FIRST_WORKER_RANK + m_pApp->numWorkers();
+            for (int worker = FIRST_WORKER_RANK; worker < endRank; worker++) {
+                std::uint32_t numIds;
+                transport.recv(
+                    &numIds, 1, CTransport::UINT32, worker, MPI_PROJECTION_TAG
+                );
+                if (!numIds) continue;
+                
+                ids.resize(numIds);
+                transport.recv(
+                    ids.data(), numIds, CTransport::UINT32,
+                    worker, MPI_PROJECTION_TAG
+                );
+                for (auto id : ids) {
+                    if (id >= m_consumed.size()) {
+                        m_consumed.resize(id + 1, false);
+                    }
+                    if (!m_consumed[id]) {
+                        m_consumed[id] = true;
+                        nConsumed++;
+                    }
+                }
+            }
+            m_project = nConsumed < m_nDefinitions;
+            m_requestWaitTime += secondsSince(start);
+        }
         /**
          * sendData
-         *    Sends data on request to workers.  In this version one item is
-         *    sent at a time.   Future versions we may want to marshall more
-         *    than one item.  We keep reading, as needed from the input file and
-         *    reuturn when a read indicates there's no more data to read.
+         *    Sends data on request to workers.  Work items are contiguous
+         *    runs of PARAMETER_DATA ring items taken straight from the blocks
+         *    the reader gives us, so they are sent without being marshalled
+         *    and each carries its own trigger number.  A run ends at the end
+         *    of a block or at an item that is not PARAMETER_DATA; those are
+         *    sent, without interpretation, to the outputter.
+         *    We keep reading, as needed from the input file and
+         *    return when a read indicates there's no more data to read.
+         *    If we're sending a range of triggers, items outside it are
+         *    dropped and we return at the end of the range.
          * @param nItems  - Number of items left  in the current block of data.
          * @param pData   - Pointer to the next item.
-         * @note any non PARAMETER_DATA items are sent without interpretation
-         *      to the outputter.
          */
         void
         CMPIParameterDealer::sendData(size_t nItems, const void* pData) {
-            const ParameterItem* pItem =
-                    reinterpret_cast<const ParameterItem*>(pData);
-            while (nItems) {
-                if (pItem->s_header.s_type == PARAMETER_DATA) {
-                    sendWorkItem(pItem);
-                } else {
-                    sendPassthrough(pItem);
-                }
+            bool finished = false;
+            while (1) {
+                const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(pData);
+                const std::uint8_t* pRun = nullptr;   // Start of a work item.
+                size_t runBytes = 0;
                 
-                nItems--;
+                while (nItems) {
+                    const RingItemHeader* pItem =
+                        reinterpret_cast<const RingItemHeader*>(p);
+                    int where = m_ranged ? placeItem(pItem) : IN_RANGE;
+                    if (where != IN_RANGE) {
+                        if (pRun) {
+                            sendWorkItem(pRun, runBytes);
+                            pRun = nullptr;
+                            runBytes = 0;
+                        }
+                        if (where == AFTER_RANGE) {
+                            finished = true;
+                            break;
+                        }
+                    } else if (pItem->s_type == PARAMETER_DATA) {
+                        if (!pRun) pRun = p;
+                        runBytes += pItem->s_size;
+                    } else {
+                        if (pRun) {
+                            sendWorkItem(pRun, runBytes);
+                            pRun = nullptr;
+                            runBytes = 0;
+                        }
+                        sendPassthrough(pItem);
+                    }
+                    p += pItem->s_size;
+                    nItems--;
+                }
+                if (pRun) {
+                    sendWorkItem(pRun, runBytes);
+                }
                 
-                if (nItems == 0) {
-                    m_pReader->done();      // Release storage for re-use.
-                    auto info = m_pReader->getBlock(m_nBlockSize);
-                    nItems = info.s_nItems; // 0 if at EOF.
-                    pData  = info.s_pData;
-                    
-                } else {
-    
-                    const std::uint8_t* p =
-                        reinterpret_cast<const std::uint8_t*>(pItem);
-                    p += pItem->s_header.s_size;
-                    pItem = reinterpret_cast<const ParameterItem*>(p);
+                done();                    // Release storage for re-use.
+                if (finished) {
+                    break;                 // End of the range.
+                }
+                auto info = getBlock();
+                if (info.s_nItems == 0) {
+                    break;                 // EOF.
                 }
+                nItems = info.s_nItems;
+                pData  = info.s_pData;
             }
         }
         /**
          * sendWorkItem
-         *    - Marshall a work item into a message for a worker.
-         *    - Accept to the next work item request from a worker and satisfy
-         *      it with the parameter item we have.
-         *  @param pData - pointer to what is known  to be a PARAMETER_DATA ring item
+         *    - Accept the next work item request from a worker and satisfy
+         *      it with a block of parameter items.
+         *    The block is preceded by a FRIB_MPI_Message_Header just like
+         *    the work items CMPIRawReader sends.  Since each item carries its
+         *    trigger number, the header's block number is just informational
+         *    (the trigger of the first item).
+         *    Workers that prefetch limit how much they'll accept; if the
+         *    block is bigger than that it's split across several requests.
+         *    If the workers don't consume all parameters, the items are
+         *    projected onto the ones they do first.
+         *  @param pData - pointer to the first of a contiguous set of
+         *                 PARAMETER_DATA ring items.
+         *  @param nBytes - number of bytes of ring items.
          */
         void
-        CMPIParameterDealer::sendWorkItem(const void* pData) {
-            const ParameterItem* pItem =
-                reinterpret_cast<const ParameterItem*>(pData);
+        CMPIParameterDealer::sendWorkItem(const void* pData, size_t nBytes) {
+            if (m_project) {
+                nBytes = project(pData, nBytes);
+                pData  = m_projected.data();
+            }
+            const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(pData);
+            while (nBytes) {
                 
-            // Marshall the header:
-            
-            FRIB_MPI_Parameter_MessageHeader header;
-            header.s_triggerNumber = pItem->s_triggerCount;
-            header.s_numParameters = pItem->s_parameterCount;
-            header.s_end           = false;
-            
-            
-            // Marshall the parameters:
-            
-            std::vector<FRIB_MPI_Parameter_Value> body;
-            body.reserve(pItem->s_parameterCount);
-            
-            const ParameterValue*  p = pItem->s_parameters;
-            for (int i =0; i < pItem->s_parameterCount; i++) {
-                FRIB_MPI_Parameter_Value v = {
-                    .s_number = p->s_number,
-                    .s_value  = p->s_value
-                };
+                // Get a request, then we know how much we can send:
+                
+                auto start = std::chrono::steady_clock::now();
+                FRIB_MPI_Request_Data request;
+                int worker = m_pApp->getRequest(&request);    // Send it to this rank.
+                m_requestWaitTime += secondsSince(start);
+                size_t n = m_pApp->workItemSize(request, p, nBytes);
                 
-                body.push_back(v);
-                p += 1;
+                const ParameterItem* pItem =
+                    reinterpret_cast<const ParameterItem*>(p);
+                m_pApp->sendWorkItem(worker, pItem->s_triggerCount, p, n);
+                p      += n;
+                nBytes -= n;
             }
-            
-            // Now we're read to respond to a request:
-            
-            int worker = m_pApp->getRequest();    // Send it to this rank.
-            
-            int status = MPI_Send(
-                &header, 1, m_pApp->parameterHeaderDataType(), worker,
-                MPI_HEADER_TAG,
-            MPI_COMM_WORLD);
-            m_pApp->throwMPIError(status, "Sending parameter header to worker");
-            
-            status = MPI_Send(
-                body.data(),
-                pItem->s_parameterCount, m_pApp->parameterValueDataType(),
-                worker, MPI_DATA_TAG, MPI_COMM_WORLD
-            );
-        
-            m_pApp->throwMPIError(status, "Sending parameter data block to worker");
-        
+        }
+        /**
+         * project
+         *    Copy a run of PARAMETER_DATA items into m_projected, keeping
+         *    only the parameters some worker consumes.  Each item keeps its
+         *    trigger number, even if no parameters are left, since workers
+         *    produce output for every event.
+         * @param pData - pointer to the first of a contiguous set of
+         *                PARAMETER_DATA ring items.
+         * @param nBytes - number of bytes of ring items.
+         * @return size_t - number of bytes of projected items in m_projected.
+         */
+        size_t
+        CMPIParameterDealer::project(const void* pData, size_t nBytes) {
+            if (m_projected.size() < nBytes) {
+                m_projected.resize(nBytes);     // Projecting never grows items.
+            }
+            const std::uint8_t* pIn = reinterpret_cast<const std::uint8_t*>(pData);
+            std::uint8_t* pOut = m_projected.data();
+            while (nBytes) {
+                const ParameterItem* pItem =
+                    reinterpret_cast<const ParameterItem*>(pIn);
+                ParameterItem* pProjected = reinterpret_cast<ParameterItem*>(pOut);
+                memcpy(pProjected, pItem, sizeof(ParameterItem));
+                
+                const ParameterValue* pValue = pItem->s_parameters;
+                ParameterValue* pKept = pProjected->s_parameters;
+                for (std::uint32_t i = 0; i < pItem->s_parameterCount; i++, pValue++) {
+                    std::uint32_t id = pValue->s_number;
+                    if ((id < m_consumed.size()) && m_consumed[id]) {
+                        *pKept++ = *pValue;
+                    }
+                }
+                std::uint32_t nKept = pKept - pProjected->s_parameters;
+                pProjected->s_parameterCount = nKept;
+                pProjected->s_header.s_size =
+                    sizeof(ParameterItem) + nKept*sizeof(ParameterValue);
+                
+                pOut   += pProjected->s_header.s_size;
+                pIn    += pItem->s_header.s_size;
+                nBytes -= pItem->s_header.s_size;
+            }
+            return pOut - m_projected.data();
         }
         /**
          * sendPassthrough
@@ -352,62 +571,96 @@ namespace frib {
             
             m_pApp->forwardPassThrough(pData, pItem->s_size);
         }
+        /**
+         * findStart
+         *    If we start after the first trigger and there's an index for the
+         *    input file, find where to seek to.  An index that doesn't
+         *    describe the input file as it is now is ignored.
+         * @param[out] index - the index is read into this.
+         * @return const TriggerIndexEntry* - the entry to seek to, nullptr if
+         *         we just read from where we are.
+         * @throw std::runtime_error - the index file is not a trigger index.
+         */
+        const TriggerIndexEntry*
+        CMPIParameterDealer::findStart(CTriggerIndex& index) {
+            if (m_nFirstTrigger == 0) {
+                return nullptr;
+            }
+            std::string indexFile = getIndexFile(m_argc, m_argv);
+            if (access(indexFile.c_str(), R_OK)) {
+                return nullptr;
+            }
+            index.read(indexFile.c_str());
+            const char* pInputFile = getInputFile(m_argc, m_argv);
+            if (!index.describes(pInputFile)) {
+                std::cerr << "CMPIParameterDealer: ignoring " << indexFile
+                    << " which does not match " << pInputFile << std::endl;
+                return nullptr;
+            }
+            return index.find(m_nFirstTrigger);
+        }
+        /**
+         * placeItem
+         *    Determine where an item is relative to the range of triggers.
+         *    PARAMETER_DATA items are placed by their trigger numbers.  Other
+         *    items are before the range until the first item in the range
+         *    has been seen (or from the start if the range starts at
+         *    trigger 0) and in it after that.
+         * @param pItem - the item.
+         * @return int - BEFORE_RANGE, IN_RANGE or AFTER_RANGE.
+         */
+        int
+        CMPIParameterDealer::placeItem(const RingItemHeader* pItem) {
+            if (pItem->s_type == PARAMETER_DATA) {
+                std::uint64_t trigger =
+                    reinterpret_cast<const ParameterItem*>(pItem)->s_triggerCount;
+                if (trigger < m_nFirstTrigger) return BEFORE_RANGE;
+                if (trigger >= m_nEndTrigger)  return AFTER_RANGE;
+                m_inRange = true;
+            }
+            return m_inRange ? IN_RANGE : BEFORE_RANGE;
+        }
         /**
          * sendAll
-         *    Rather than play with making additional groups and communicators,
-         *    since we only have a couple of messages to send; and only once,
-         *    we just iterate over the workers to multicast the definition
-         *    items to them:
+         *    Multicast the definition items to all of the workers.  Workers
+         *    receive them with CTransport::receiveBroadcast; under MPI, this
+         *    is an MPI_Bcast.
          *  @param pData - pointer to the data to send.
-         *  @param type  - MPI Data type of the payload
+         *  @param type  - data type of the payload
          *  @param numItesm - Number of items of *type* in pData.
-         *  @param ttag  - MPI Tag to use to send the items.
+         *  @param ttag  - Tag to use to send the items.
          */
         void
         CMPIParameterDealer::sendAll(
-            const void* pData, MPI_Datatype type, size_t numItems, int tag
+            const void* pData, CTransport::DataType type, size_t numItems, int tag
         ) {
-            int nextWorker = 3;    // 0 - dealer 1 - farmer  2- outputter.
-            unsigned nWorkers  = m_pApp->numWorkers();
-            for (int i =0; i < nWorkers; i++ ) {
-                int status = MPI_Send(
-                    pData, numItems, type, nextWorker, tag, MPI_COMM_WORLD
-                );
-                m_pApp->throwMPIError(status, "Failed send in CMPIParameterDealer::sendAll");
-                
-                nextWorker++;
-            }
+            m_pApp->transport().broadcast(
+                pData, numItems, type, FIRST_WORKER_RANK, tag
+            );
         }
         /**
-         * sendEofs
-         *    Send EOFS until all workers got sent one.
-         *    The code assumes any worker only asks once:
-         *
+         * getBlock
+         *    Get the next block of data from the reader, accumulating the
+         *    time it takes into m_ioWaitTime.
+         * @return CDataReader::Result - describes the block.
          */
-        void
-        CMPIParameterDealer::sendEofs() {
-            unsigned nWorkers = m_pApp->numWorkers();
-            for (int i =0; i < nWorkers; i++) {
-                sendEof();
-            }
+        CDataReader::Result
+        CMPIParameterDealer::getBlock() {
+            auto start = std::chrono::steady_clock::now();
+            auto result = m_pReader->getBlock(m_nBlockSize);
+            m_ioWaitTime += secondsSince(start);
+            return result;
         }
         /**
-         * sendEof
-         *   Respond to a client request by sending a single EOF:
+         * done
+         *    Release the current block back to the reader, accumulating the
+         *    time that takes into m_ioWaitTime.
          */
         void
-        CMPIParameterDealer::sendEof() {
-            auto worker = m_pApp->getRequest();
-            FRIB_MPI_Parameter_MessageHeader msg;
-            msg.s_triggerNumber =0;
-            msg.s_numParameters = 0;
-            msg.s_end = true;
-            
-            int stat = MPI_Send(
-                &msg, 1, m_pApp->parameterHeaderDataType(),
-                worker, MPI_HEADER_TAG, MPI_COMM_WORLD
-            );
-            m_pApp->throwMPIError(stat, "Unable to send eof.");
+        CMPIParameterDealer::done() {
+            auto start = std::chrono::steady_clock::now();
+            m_pReader->done();
+            m_ioWaitTime += secondsSince(start);
         }
     }    
 }
\ No newline at end of file
@@ -21,13 +21,17 @@
 #ifndef MPIPARAMETERDEALER_H
 #define MPIPARAMETERDEALER_H
 #include <stddef.h>
+#include <vector>
+#include <cstdint>
+#include <string>
 #include <DataReader.h>
-#include <mpi.h>
+#include "AnalysisRingItems.h"
+#include "Transport.h"
 
 namespace frib {
     namespace analysis {
         class AbstractApplication;
-
+        class CTriggerIndex;
         
         /**
          * @class CMPIParameterDealer
@@ -53,9 +57,16 @@ namespace frib {
          * outputter, howver is going to assume the defintition file is the last
          * word on it as it does not know anything about what the workers are doing.
          *
+         * Each worker then replies with the ids of the parameters it
+         * consumes.  If, between them, the workers don't consume all of the
+         * parameters in the file, work items are projected onto the ones
+         * they do consume before being sent.  Otherwise they are sent as is.
+         *
          * Once the parameter and variable items are sent; send on request begins.
          * Each worker sends a request for data which is satisfied either by
-         * a new block of parameter ring items or an end indicator.
+         * a new block of parameter ring items or an end indicator.  As with
+         * CMPIRawReader, blocks are preceded by a FRIB_MPI_Message_Header
+         * and are sent directly from the reader's storage.
          *
          * Ring items that are not parameter ring items are passed directy to the
          * outputter in a push so that they can be directly written to file.
@@ -63,6 +74,17 @@ namespace frib {
          * Once and end file indication has been gotten on the input file, further
          * requests are answered with an end indication and, when all workers have
          * gotten that we exit.
+         *
+         * As with CMPIRawReader, the time spent waiting on I/O and on worker
+         * requests is accumulated and reported via reportStatistics at the
+         * end of the run.
+         *
+         * If the application asks for a range of triggers (see
+         * AbstractApplication::getFirstTrigger), items before the first
+         * trigger and from the end of the range on are not sent.  If the
+         * file has a trigger index (getIndexFile), we seek to the nearest
+         * indexed trigger at or before the first one after the definitions
+         * have been sent rather than reading the file from its start.
          */
         class CMPIParameterDealer {
         private:
@@ -72,6 +94,16 @@ namespace frib {
             CDataReader* m_pReader;
             unsigned     m_nBlockSize;
             unsigned     m_nEndsLeft;
+            double       m_ioWaitTime;
+            double       m_requestWaitTime;
+            std::uint32_t     m_nDefinitions;
+            std::vector<bool> m_consumed;      // Indexed by parameter id.
+            bool              m_project;
+            std::vector<std::uint8_t> m_projected;
+            bool              m_ranged;        // Only some triggers are sent.
+            bool              m_inRange;       // Got to the first of them.
+            std::uint64_t     m_nFirstTrigger;
+            std::uint64_t     m_nEndTrigger;   // Just after the range.
             
         public:
             CMPIParameterDealer(int argc, char** argv, AbstractApplication* pApp);
@@ -83,22 +115,35 @@ namespace frib {
             int operator!=(const CMPIParameterDealer& rhs);
         public:
             void operator()();
+            double getIoWaitTime() const;
+            double getRequestWaitTime() const;
         private:
             virtual const char* getInputFile(int  argc, char** argv) const;
             virtual unsigned getBlockSize(int argc, char** argv) const;
+            virtual CDataReader* createReader(
+                const char* pFilename, unsigned blockSize
+            ) const;
+            virtual std::string getIndexFile(int argc, char** argv) const;
+            virtual void reportStatistics(
+                double ioSeconds, double requestSeconds
+            ) const;
             
             size_t sendDefinitions(const void* pData);
             size_t sendParameterDefs(const void* pData);
             size_t sendVariableValues(const void* pData);
+            void receiveProjections();
             void sendData(size_t nItems, const void* pData);
-            void sendWorkItem(const void* pData);
+            void sendWorkItem(const void* pData, size_t nBytes);
+            size_t project(const void* pData, size_t nBytes);
             void sendPassthrough(const void* pData);
+            const TriggerIndexEntry* findStart(CTriggerIndex& index);
+            int placeItem(const RingItemHeader* pItem);
             
             void sendAll(
-                const void* pData, MPI_Datatype type, size_t numItems, int tag
+                const void* pData, CTransport::DataType type, size_t numItems, int tag
             );
-            void sendEofs();
-            void sendEof();
+            CDataReader::Result getBlock();
+            void done();
         };
     }
 }
@@ -21,8 +21,15 @@
 #include "MPIParameterFarmer.h"
 #include "AbstractApplication.h"
 #include "MPITriggerSorter.h"
-#include <mpi.h>
 #include <iostream>
+#include <stdexcept>
+
+// The pool holds received batches as well as single items so its chunks
+// need to be large enough for a batch that's a bit over the default byte
+// limit.
+
+static const std::size_t BATCH_SLAB_SIZE(4*1024*1024);
+static const std::size_t BATCH_MAX_CHUNK_SIZE(1024*1024);
 
 namespace frib {
     namespace analysis {
@@ -40,7 +47,8 @@ namespace frib {
         CMPIParameterFarmer::CMPIParameterFarmer(
             int argc, char** argv, AbstractApplication& app
         ) : m_argc(argc), m_argv(argv), m_App(app),
-        m_nMaxParams(100), m_parameterBuffer(new FRIB_MPI_Parameter_Value[100])
+        m_nMaxParams(100), m_parameterBuffer(new FRIB_MPI_Parameter_Value[100]),
+        m_pool(BATCH_SLAB_SIZE, BATCH_MAX_CHUNK_SIZE)
         {}
         
         /**
@@ -53,37 +61,71 @@ namespace frib {
         /**
          * operator()
          *   - Figure out how many workers there are so we can count down m_nEndsLeft.
-         *   - Instantiate a CMPITriggerSorter to re-order the triggers properly.
-         *   - Accept header/data pairs (or just headers in the case of an end) until
-         *   all of the workers have sent ends - then flush the sorter and send an end
-         *   to the outputter.
+         *   - Instantiate a CMPITriggerSorter to re-order the triggers properly,
+         *     starting at the application's first trigger.
+         *   - Accept header/data pairs (or just headers in the case of an end)
+         *   and batches of events until all of the workers have sent ends - then
+         *   flush the sorter and send an end to the outputter.
          */
         void
         CMPIParameterFarmer::operator()() {
             m_nEndsLeft = m_App.numWorkers();
-            CMPITriggerSorter sorter(
-                2, m_App.parameterHeaderDataType(),
-                m_App.parameterValueDataType()
-            );
+            CTransport& transport(m_App.transport());
+            CMPITriggerSorter sorter(transport, OUTPUTTER_RANK, &m_pool);
+            sorter.setFirstTrigger(m_App.getFirstTrigger(m_argc, m_argv));
             while (m_nEndsLeft) {
-                pParameterItem pItem = getItem();
-                if (pItem) {
-                    sorter.addItem(pItem);     // If possible this will send items.
+                CTransport::Status probed = transport.probe(
+                    CTransport::ANY_SOURCE, CTransport::ANY_TAG
+                );
+                
+                if (probed.s_tag == MPI_PARAMETER_BATCH_TAG) {
+                    getBatch(probed, sorter);
                 } else {
-                    m_nEndsLeft--;
-                    
+                    pParameterItem pItem = getItem(probed.s_source);
+                    if (pItem) {
+                        sorter.addItem(pItem);     // If possible this will send items.
+                    } else {
+                        m_nEndsLeft--;
+                        
+                    }
                 }
             }
             sorter.flush();
             sendEnd();
-            
+            reportStatistics(m_pool.getStatistics());
+        }
+        /**
+         * getPoolStatistics
+         *   @return const CParameterItemPool::Statistics& - statistics of
+         *         the pool that holds the items being sorted.
+         */
+        const CParameterItemPool::Statistics&
+        CMPIParameterFarmer::getPoolStatistics() const {
+            return m_pool.getStatistics();
         }
         ///////////////////////////////////////////////////////////////////////
         // Private utilities.
         
+        /**
+         * reportStatistics
+         *    Report how much memory the item pool needed.  This is virtual
+         *    so it can be overridden (e.g. to suppress the report).  By
+         *    default a line is written to stderr.
+         * @param stats - the pool statistics.
+         */
+        void
+        CMPIParameterFarmer::reportStatistics(
+            const CParameterItemPool::Statistics& stats
+        ) const {
+            std::cerr << "CMPIParameterFarmer: item pool high water mark "
+                << stats.s_highWaterMark << " bytes (" << stats.s_maxItemsInUse
+                << " items), " << stats.s_bytesHeld << " bytes held, "
+                << stats.s_slabAllocations << " slab and "
+                << stats.s_oversizeAllocations << " oversize allocations\n";
+        }
         /**
          * sendEnd
-         *    Send an end to the outputter on rank 2.
+         *    Send an end to the outputter.
          */
         void
         CMPIParameterFarmer::sendEnd() {
@@ -91,64 +133,46 @@ namespace frib {
             header.s_triggerNumber = 0;
             header.s_numParameters = 0;
             header.s_end = true;
-            char error[MPI_MAX_ERROR_STRING];
-            int len;
-            int status = MPI_Send(
-                &header, 1, m_App.parameterHeaderDataType(),
-                2, MPI_END_TAG, MPI_COMM_WORLD
+            m_App.transport().send(
+                &header, 1, CTransport::PARAMETER_HEADER, OUTPUTTER_RANK, MPI_END_TAG
             );
-            if (status != MPI_SUCCESS) {
-                MPI_Error_string(status, error, &len);
-                std::string message = "Unable to send end message to outputter: ";
-                message += error;
-                throw std::runtime_error(message);
-            }
         }
         /**
          * getItem
-         *   Get an item from a worke... any worker. Put it in a pParameterItem
-         *   dynamically allocated via new and return it.
+         *   Get an item from the worker whose header we probed. Put it in a
+         *   pParameterItem allocated from the pool and return it.
          *   If the header from the worker has s_end true, a null pointer is returned.
          *   Note that in multiple workers other workers  may well have data in the pipe
          *   after the first end is received from a worker.
          *
-         *   @return pParameterItem - dynamically allocated parameter item.
+         *   @param from - rank of the worker that sent the header.
+         *   @return pParameterItem - parameter item allocated from m_pool.
          */
         pParameterItem
-        CMPIParameterFarmer::getItem()
+        CMPIParameterFarmer::getItem(int from)
         {
             pParameterItem result=nullptr;
-            char error[MPI_MAX_ERROR_STRING];
-            int len;
-            MPI_Status mpistat;
+            CTransport& transport(m_App.transport());
             
             // Get the header first:
             // Note that due to the fact that multiple senders are operating
-            // asynchronously we'll explicitly specify the rand from which to get
-            // the data item:
+            // asynchronously we'll explicitly specify the rank from which to get
+            // the data item - the one whose message we probed.
             
             
             FRIB_MPI_Parameter_MessageHeader header;
-            int status = MPI_Recv(
-                &header, 1, m_App.parameterHeaderDataType(),
-                MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD,
-                &mpistat
+            CTransport::Status status = transport.recv(
+                &header, 1, CTransport::PARAMETER_HEADER,
+                from, CTransport::ANY_TAG
             );
-            if (status != MPI_SUCCESS) {
-                MPI_Error_string(status, error, &len);
-                std::string message = "Unable to receive parameter header ";
-                message += error;
-                throw std::runtime_error(message);
-            }
             // Must be a header tag:
             
             if (
-                (mpistat.MPI_TAG != MPI_HEADER_TAG) &&
-                (mpistat.MPI_TAG != MPI_END_TAG)
+                (status.s_tag != MPI_HEADER_TAG) &&
+                (status.s_tag != MPI_END_TAG)
             ) {
                 throw std::logic_error("Farmer expected header or end tag");
             }
-            int from = mpistat.MPI_SOURCE;
             
             // If this is an end, return null:
             
@@ -163,28 +187,19 @@ namespace frib {
                }
                // Receive the parameter record itself:
                
-               status = MPI_Recv(
-                   m_parameterBuffer, header.s_numParameters, m_App.parameterValueDataType(),
-                   from, MPI_ANY_TAG, MPI_COMM_WORLD,
-                   &mpistat
+               status = transport.recv(
+                   m_parameterBuffer, header.s_numParameters,
+                   CTransport::PARAMETER_VALUE, from, CTransport::ANY_TAG
                );
                
-               // Status must be ok and tag must be MPI_DATA_TAG.
+               // Tag must be MPI_DATA_TAG.
                
-               if (status != MPI_SUCCESS) {
-                   MPI_Error_string(status, error, &len);
-                   std::string message ="Unable to receive parameters from worker: " ;
-                   message += error;
-                   throw std::runtime_error(message);
-               }
-               if (mpistat.MPI_TAG != MPI_DATA_TAG) {
+               if (status.s_tag != MPI_DATA_TAG) {
                    throw std::logic_error("Expected data tag but got something else in farmer");
                }
                // Now we can allocate the ring item and marshall the data into it:
                
-               std::uint32_t totalSize = sizeof(ParameterItem) + header.s_numParameters*sizeof(ParameterValue);
-               std::uint8_t* pDummy = new std::uint8_t[totalSize];
-               result = reinterpret_cast<pParameterItem>(pDummy);
+               result = m_pool.allocateItem(header.s_numParameters);
                
                // Marshall the data:
                // Note/TODO:  This may well become the bottleneck for dataflow.  IF
@@ -193,12 +208,7 @@ namespace frib {
                // data movements.  In that case, we'll be allocating m_parameterBuffer
                // each event.
                
-               result->s_header.s_size = totalSize;
-               result->s_header.s_type = PARAMETER_DATA;
-               result->s_header.s_unused = sizeof(std::uint32_t);
-               
                result->s_triggerCount = header.s_triggerNumber;
-               result->s_parameterCount = header.s_numParameters;
                
                for (int i =0; i < header.s_numParameters; i++) {
                    result->s_parameters[i].s_number = m_parameterBuffer[i].s_number;
@@ -207,6 +217,43 @@ namespace frib {
             }            
             return result;
         }
+        /**
+         * getBatch
+         *   Receive a batch of events whose message we've probed and
+         *   hand it to the sorter.  The batch is a sequence of
+         *   PARAMETER_DATA ring items (see CParameterBatch).  It's received
+         *   into storage from the pool and the sorter takes ownership of it,
+         *   giving it back to the pool once all its events have been sent on.
+         *
+         * @param probed - status from the probe that found the batch.
+         * @param sorter - the sorter that gets the events.
+         */
+        void
+        CMPIParameterFarmer::getBatch(
+            const CTransport::Status& probed, CTriggerSorter& sorter
+        )
+        {
+            std::size_t nBytes = probed.s_nBytes;
+            pParameterItem pBlock = m_pool.allocate(nBytes);
+            
+            try {
+                m_App.transport().recv(
+                    pBlock, nBytes, CTransport::BYTES,
+                    probed.s_source, MPI_PARAMETER_BATCH_TAG
+                );
+            }
+            catch (...) {
+                m_pool.release(pBlock);
+                throw;
+            }
+            try {
+                sorter.addBlock(pBlock, nBytes);
+            }
+            catch (...) {
+                m_pool.release(pBlock);        // Malformed - still ours.
+                throw;
+            }
+        }
         
     }
 }
\ No newline at end of file
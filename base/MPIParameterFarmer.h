@@ -22,9 +22,14 @@
 #define MPIPARAMETERFARMER_H
 
 #include "AnalysisRingItems.h" 
+#include "ParameterItemPool.h"
+#include "Transport.h"
+#include <vector>
+#include <cstdint>
 namespace frib {
     namespace analysis {
         class AbstractApplication;
+        class CTriggerSorter;
         /**
          * @class CMPIParameterFarmer
          *    This can be instantiated in the farmer method of thee CAbstractApplication
@@ -42,6 +47,20 @@ namespace frib {
          *    unflushed items and then send an end to the outputter.
          *    The unflushed items will be in trigger order but will probably have
          *    at least one skip (else they already would have been emitted).
+         *
+         *    Workers can send us events either one at a time (a header
+         *    message followed by a parameter values message) or as batches
+         *    of PARAMETER_DATA ring items tagged MPI_PARAMETER_BATCH_TAG
+         *    (see CParameterBatch).  We probe each message to decide which
+         *    it is.
+         *
+         *    Storage for the items comes from a CParameterItemPool shared
+         *    with the sorter, so steady state runs without heap allocations.
+         *    Batches are received into pool storage and handed to the sorter
+         *    as blocks, so their events are forwarded to the outputter
+         *    without being copied.
+         *    The pool statistics are reported via reportStatistics at the
+         *    end of the run and are available from getPoolStatistics.
          *    
          */
         class CMPIParameterFarmer {
@@ -52,14 +71,20 @@ namespace frib {
             int m_nEndsLeft;
             unsigned m_nMaxParams;
             pFRIB_MPI_Parameter_Value  m_parameterBuffer;
+            CParameterItemPool          m_pool;
         public:
             CMPIParameterFarmer(int argc, char** argv, AbstractApplication& app);
             virtual ~CMPIParameterFarmer();
             
             void operator()();
+            const CParameterItemPool::Statistics& getPoolStatistics() const;
         private:
+            virtual void reportStatistics(
+                const CParameterItemPool::Statistics& stats
+            ) const;
             void sendEnd();
-            pParameterItem getItem();
+            pParameterItem getItem(int from);
+            void getBatch(const CTransport::Status& probed, CTriggerSorter& sorter);
         };
     }
 } 
@@ -22,10 +22,14 @@
 #include "AbstractApplication.h"
 #include "AnalysisRingItems.h"
 #include "DataWriter.h"
-#include <mpi.h>
+#include "ColumnarDataWriter.h"
+#include "PatternDataWriter.h"
+#include "Transport.h"
 #include <string>
 #include <stdexcept>
 #include <memory>
+#include <vector>
+#include <cstdint>
 #include <iostream>
 
 namespace frib {
@@ -49,45 +53,74 @@ namespace frib {
          * operator()
          *     Called to run the process:
          *     - Use the virtual getOutputFile to get the output filename.
-         *     - Create the data writer object.
+         *     - Create the data writer object with the buffering from
+         *       getOutputBufferSize.  If getOutputChunkSize is nonzero
+         *       that's a columnar writer, otherwise if getPatternEncoding
+         *       is true it's a pattern writer.  Those two index the file
+         *       if getIndexInterval is nonzero.
          *     - Until we get an end message from the sender (there is one),
          *       get data and write it to the m_pWriter.
+         *     - Finish the file so that failing to complete it (e.g. a
+         *       full disk) is reported rather than leaving a truncated file.
          * @param argc, argv - command line arguments, used by getOutputFile.
-         * @param app        - The application.  Used to get the synthetic
-         *                     MPI data types.
+         * @param app        - The application.  Used to get the transport.
          */
         void
         CMPIParameterOutput::operator()(
             int argc, char** argv, AbstractApplication* app
         ) {
-            char errorWhy[MPI_MAX_ERROR_STRING];
-            int len;
-            
             // Parameter buffering:
             
             std::unique_ptr<FRIB_MPI_Parameter_Value> pData;
             size_t nParamsAllocated = 0;
             std::vector<std::pair<unsigned, double>> event;
+            std::vector<std::uint8_t> block;
             
             m_pApp  = app;
             auto filename = getOutputFile(argc, argv);
-            m_pWriter = new CDataWriter(filename.c_str());
+            std::uint32_t chunkSize = getOutputChunkSize(argc, argv);
+            if (chunkSize) {
+                m_pWriter = new CColumnarDataWriter(
+                    filename.c_str(), chunkSize, getOutputBufferSize(argc, argv)
+                );
+            } else if (getPatternEncoding(argc, argv)) {
+                m_pWriter = new CPatternDataWriter(
+                    filename.c_str(), getOutputBufferSize(argc, argv),
+                    getIndexInterval(argc, argv)
+                );
+            } else {
+                m_pWriter = new CDataWriter(
+                    filename.c_str(), getOutputBufferSize(argc, argv),
+                    getIndexInterval(argc, argv)
+                );
+            }
+            CTransport& transport(app->transport());
             FRIB_MPI_Parameter_MessageHeader header;
             header.s_end = false;
-            MPI_Status mpistat;
             do {
-                int status = MPI_Recv(
-                    &header, 1, app->parameterHeaderDataType(),
-                    MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &mpistat
+                CTransport::Status probed = transport.probe(
+                    CTransport::ANY_SOURCE, CTransport::ANY_TAG
                 );
-                if (status != MPI_SUCCESS)  {
-                    std::string msg = "Failed MPI_Recv for header in parameter output : ";
-                    MPI_Error_string(status, errorWhy, &len);
-                    msg += errorWhy;
-                    throw std::runtime_error(msg);
+                if (probed.s_tag == MPI_PARAMETER_BATCH_TAG) {
+                    // A block of ring items that can go right to the file:
+                    
+                    std::size_t nBytes = probed.s_nBytes;
+                    if (nBytes > block.size()) {
+                        block.resize(nBytes);
+                    }
+                    transport.recv(
+                        block.data(), nBytes, CTransport::BYTES,
+                        probed.s_source, MPI_PARAMETER_BATCH_TAG
+                    );
+                    m_pWriter->writeBlock(block.data(), nBytes);
+                    continue;
                 }
+                CTransport::Status status = transport.recv(
+                    &header, 1, CTransport::PARAMETER_HEADER,
+                    probed.s_source, probed.s_tag
+                );
                 
-                if (mpistat.MPI_TAG == MPI_HEADER_TAG) {
+                if (status.s_tag == MPI_HEADER_TAG) {
                     // If it's a header we have actual data:
             
                     if (header.s_numParameters > nParamsAllocated) {
@@ -95,17 +128,10 @@ namespace frib {
                         pData.reset(new FRIB_MPI_Parameter_Value[nParamsAllocated]);
                     }
                     
-                    status = MPI_Recv(
-                        pData.get(), header.s_numParameters, app->parameterValueDataType(),
-                        mpistat.MPI_SOURCE, MPI_DATA_TAG, MPI_COMM_WORLD, &mpistat
+                    transport.recv(
+                        pData.get(), header.s_numParameters,
+                        CTransport::PARAMETER_VALUE, status.s_source, MPI_DATA_TAG
                     );
-                    
-                    if (status != MPI_SUCCESS) {
-                        std::string msg = "Failed MPI_Recv for parameter data in parameter output: ";
-                        MPI_Error_string(status, errorWhy, &len);
-                        msg += errorWhy;
-                        throw std::runtime_error(msg);
-                    }
                     // New we have the data, we can send it to the output
                     
                     event.clear();
@@ -118,30 +144,25 @@ namespace frib {
                 
                     }
                     m_pWriter->writeEvent(event, header.s_triggerNumber);
-                } else if (mpistat.MPI_TAG == MPI_PASSTHROUGH_TAG) {
+                } else if (status.s_tag == MPI_PASSTHROUGH_TAG) {
                     // Passthrough item- m_numParameters is the # bytes.
                     // These are rare so we can allocate each time.
                     // Get the data item and pass it to writeItem...as the
                     // payload is assumed to be just a raw ring item.
                     //
                     std::unique_ptr<std::uint8_t> pPassThroughData(new std::uint8_t[header.s_numParameters]);
-                    status = MPI_Recv(pPassThroughData.get(), header.s_numParameters, MPI_UINT8_T,
-                        mpistat.MPI_SOURCE, MPI_DATA_TAG, MPI_COMM_WORLD, &mpistat       
+                    transport.recv(
+                        pPassThroughData.get(), header.s_numParameters,
+                        CTransport::BYTES, status.s_source, MPI_DATA_TAG
                     );
-                    if (status != MPI_SUCCESS) {
-                        std::string msg = "Failed MPI_Recv for passthrough data block output: ";
-                        MPI_Error_string(status, errorWhy, &len);
-                        msg += errorWhy;
-                        throw std::runtime_error(msg);
-                    }
                     m_pWriter->writeItem(pPassThroughData.get());
                     
     
-                } else if (mpistat.MPI_TAG == MPI_DATA_TAG) {
+                } else if (status.s_tag == MPI_DATA_TAG) {
                     throw std::logic_error(
                         "CMPIParameterOutput - expected MPI Header got data"
                     );
-                } else if (mpistat.MPI_TAG == MPI_END_TAG) {
+                } else if (status.s_tag == MPI_END_TAG) {
 
                      // Do nothing - s_end will be true.
                      header.s_end = true;             // Just in case.
@@ -152,7 +173,9 @@ namespace frib {
                 
                 
             } while (!header.s_end);
-            
+            m_pWriter->finish();             // Complete and close the file.
+            delete m_pWriter;
+            m_pWriter = nullptr;
         }
         /**
          * getOutputFile
@@ -172,5 +195,55 @@ namespace frib {
             }
             return argv[2];
         }
+        /**
+         * getOutputBufferSize
+         *    Returns the number of bytes of output buffering the data writer
+         *    should use.  This is virtual so it can be overridden.  The
+         *    default is CDataWriter::DEFAULT_BUFFER_SIZE.
+         * @param argc, argv - the command line parameters.
+         * @return std::size_t - buffer size, 0 means unbuffered.
+         */
+        std::size_t
+        CMPIParameterOutput::getOutputBufferSize(int argc, char** argv) {
+            return CDataWriter::DEFAULT_BUFFER_SIZE;
+        }
+        /**
+         * getOutputChunkSize
+         *    Returns the number of triggers in each chunk of columnar output.
+         *    This is virtual so it can be overridden.  The default, 0,
+         *    selects the PARAMETER_DATA item format.
+         * @param argc, argv - the command line parameters.
+         * @return std::uint32_t - triggers per chunk, 0 for event items.
+         */
+        std::uint32_t
+        CMPIParameterOutput::getOutputChunkSize(int argc, char** argv) {
+            return 0;
+        }
+        /**
+         * getPatternEncoding
+         *    Returns true if events should be written as pattern numbers and
+         *    values (see CPatternDataWriter).  This is virtual so it can be
+         *    overridden.  The default, false, selects PARAMETER_DATA items.
+         *    Columnar output (getOutputChunkSize) takes precedence.
+         * @param argc, argv - the command line parameters.
+         * @return bool
+         */
+        bool
+        CMPIParameterOutput::getPatternEncoding(int argc, char** argv) {
+            return false;
+        }
+        /**
+         * getIndexInterval
+         *    Returns the number of items between the entries of the trigger
+         *    index written alongside the output file (see CTriggerIndex).
+         *    This is virtual so it can be overridden.  The default, 0,
+         *    writes no index.
+         * @param argc, argv - the command line parameters.
+         * @return std::uint32_t - items per index entry, 0 for no index.
+         */
+        std::uint32_t
+        CMPIParameterOutput::getIndexInterval(int argc, char** argv) {
+            return 0;
+        }
     }
-}
\ No newline at end of file
+}
@@ -21,6 +21,8 @@
 #ifndef MPIPARAMETEROUTPUT_H
 #define MPIPARAMETEROUTPUT_H
 #include <string>
+#include <cstddef>
+#include <cstdint>
 
 
 namespace frib {
@@ -34,11 +36,25 @@ namespace frib {
      *
      *      -  FRIB_MPI_Parameter_MessageHeader which describes the following parameters
      *      -  FRIB_MPI_Parameter_Value array which contain the parameters themselves.
+     *  or as blocks of PARAMETER_DATA ring items tagged
+     *  MPI_PARAMETER_BATCH_TAG (what CMPITriggerSorter sends).  Blocks are
+     *  already in the file format so they are handed to the writer as is.
      *  It uses a CDataWriter to output the data it receives.  Pretty
      *  simple beast really.  If run under something derived as an abstract
      *  application class, it will have access to the parameter definitions
      *  and the data writer will write those and the variable definitions to file.
      *  
+     *  By default events are written as PARAMETER_DATA items.  If
+     *  getOutputChunkSize is overridden to return nonzero, a
+     *  CColumnarDataWriter is used instead which writes chunks of that many
+     *  triggers in column order.  Otherwise, if getPatternEncoding is
+     *  overridden to return true, a CPatternDataWriter writes each event as
+     *  its pattern number and values.
+     *
+     *  If getIndexInterval is overridden to return nonzero, the event
+     *  item and pattern writers also write a CTriggerIndex sidecar with an
+     *  entry every that many items.  Columnar files aren't indexed; their
+     *  chunk directory already locates triggers.
      */
     class CMPIParameterOutput {
     private:
@@ -50,6 +66,10 @@ namespace frib {
         virtual void operator()(int argc, char** argv, AbstractApplication* app);
     protected:
         virtual std::string getOutputFile(int argc, char** argv);
+        virtual std::size_t getOutputBufferSize(int argc, char** argv);
+        virtual std::uint32_t getOutputChunkSize(int argc, char** argv);
+        virtual bool getPatternEncoding(int argc, char** argv);
+        virtual std::uint32_t getIndexInterval(int argc, char** argv);
         
     };
     
@@ -24,10 +24,13 @@
 #include "AbstractApplication.h"
 #include "TreeParameter.h"
 #include "TreeVariable.h"
+#include "ParameterBatch.h"
+#include "ParameterCompressor.h"
+#include "ParameterPacker.h"
+#include "MPIWorkItemPrefetcher.h"
 
 #include <stdexcept>
 #include <sstream>
-#include <mpi.h>
 #include <iostream>
 
 namespace frib {
@@ -38,17 +41,22 @@ namespace frib {
          */
         CMPIParametersToParametersWorker::CMPIParametersToParametersWorker(
             int argc, char** argv, AbstractApplication* pApp
-        ) :  m_argc(argc), m_argv(argv), m_pApp(pApp)
+        ) :  m_argc(argc), m_argv(argv), m_pApp(pApp), m_pBatch(nullptr),
+             m_pCompressor(nullptr), m_pPacker(nullptr)
         {}
         /**
          * destructor - The tree parameters in the tree map were dynamically
          *         created by the receipt of the parameter definition record so
-         *         They must be deleted.
+         *         They must be deleted.  So must the batch, compressor and
+         *         packer.
          */
         CMPIParametersToParametersWorker::~CMPIParametersToParametersWorker() {
             for (auto& item : m_parameterMap) {
                 delete item;
             }
+            delete m_pBatch;
+            delete m_pCompressor;
+            delete m_pPacker;
         }
         
         /**
@@ -56,12 +64,23 @@ namespace frib {
          *    Entry  point for the worker.  The top level logic is simple:
          *    Receive the parameter definitions - those are first.
          *    Receive the variable definitions - those must be second.
+         *    Tell the dealer which parameters we consume.
          *    Recieve/process all of the events:
+         *    Events are processed in our own tree parameter context.
          */
         void CMPIParametersToParametersWorker::operator()() {
             receiveParameterDefinitions();
             receiveVariableDefinitions();
-            receiveEvents();
+            sendProjection();
+            CTreeParameter::setContext(&m_context);
+            try {
+                receiveEvents();
+            }
+            catch (...) {
+                CTreeParameter::setContext(nullptr);
+                throw;
+            }
+            CTreeParameter::setContext(nullptr);
         }
         /*---------------------------------------------------------------------
          *  protected utilities available to derived (concrete) class instances.
@@ -124,6 +143,92 @@ namespace frib {
             
             return result;
         }
+        /**
+         * getBatchEvents
+         *    Returns the maximum number of events sent to the farmer in a
+         *    single message.  Override to change the default
+         *    (CParameterBatch::DEFAULT_MAX_EVENTS).
+         * @param argc, argv - the command line parameters.
+         * @return std::size_t
+         */
+        std::size_t
+        CMPIParametersToParametersWorker::getBatchEvents(int argc, char** argv) {
+            return CParameterBatch::DEFAULT_MAX_EVENTS;
+        }
+        /**
+         * getBatchBytes
+         *    Returns the size in bytes at which a batch of events is sent to
+         *    the farmer.  Override to change the default
+         *    (CParameterBatch::DEFAULT_MAX_BYTES).
+         * @param argc, argv - the command line parameters.
+         * @return std::size_t
+         */
+        std::size_t
+        CMPIParametersToParametersWorker::getBatchBytes(int argc, char** argv) {
+            return CParameterBatch::DEFAULT_MAX_BYTES;
+        }
+        /**
+         * getPrefetchCredits
+         *    Returns the number of block requests kept outstanding with the
+         *    dealer.  Override to change the default
+         *    (CMPIWorkItemPrefetcher::DEFAULT_CREDITS).  0 turns prefetching
+         *    off.
+         * @param argc, argv - the command line parameters.
+         * @return unsigned
+         */
+        unsigned
+        CMPIParametersToParametersWorker::getPrefetchCredits(int argc, char** argv) {
+            return CMPIWorkItemPrefetcher::DEFAULT_CREDITS;
+        }
+        /**
+         * getPrefetchBufferSize
+         *    Returns the size of each prefetch buffer which is the largest
+         *    block the dealer will send us.  Override to change the default
+         *    (CMPIWorkItemPrefetcher::DEFAULT_BUFFER_SIZE).
+         * @param argc, argv - the command line parameters.
+         * @return std::size_t
+         */
+        std::size_t
+        CMPIParametersToParametersWorker::getPrefetchBufferSize(
+            int argc, char** argv
+        ) {
+            return CMPIWorkItemPrefetcher::DEFAULT_BUFFER_SIZE;
+        }
+        /**
+         * getCompressionLevel
+         *    Returns the zlib level (1-9) with which batches of events are
+         *    compressed before they're sent to the farmer.  Override to
+         *    change the default, 0, which sends them uncompressed.
+         * @param argc, argv - the command line parameters.
+         * @return int
+         */
+        int
+        CMPIParametersToParametersWorker::getCompressionLevel(
+            int argc, char** argv
+        ) {
+            return 0;
+        }
+        /**
+         * consumesParameter
+         *    Decides if a parameter in the input file is loaded into a tree
+         *    parameter for process.  The dealer only sends the parameters
+         *    consumed by at least one worker so, for passes that only use a
+         *    few of the input parameters, overriding this can greatly
+         *    reduce the data shipped to the workers.  Parameters that
+         *    are not consumed don't make it to the output file either.
+         *
+         *    The default consumes everything.  An override that only
+         *    consumes the raw parameters might be:
+         *    `return name.compare(0, 4, "raw.") == 0;`
+         * @param name - name of the parameter in the input file.
+         * @return bool - true to consume the parameter.
+         */
+        bool
+        CMPIParametersToParametersWorker::consumesParameter(
+            const std::string& name
+        ) {
+            return true;
+        }
         /*---------------------------------------------------------------------
          * Private utilities.
         
@@ -146,25 +251,24 @@ namespace frib {
         CMPIParametersToParametersWorker::receiveParameterDefinitions() {
             // get the number of definition records to expect:
             
-            int stat;
-            MPI_Status status;
+            CTransport& transport(m_pApp->transport());
             std::uint32_t numItems;
             
-            stat = MPI_Recv(
-                &numItems, 1, MPI_UINT32_T,
-                0, MPI_PARAMDEF_TAG, MPI_COMM_WORLD, &status
+            transport.receiveBroadcast(
+                &numItems, 1, CTransport::UINT32, DEALER_RANK, FIRST_WORKER_RANK,
+                MPI_PARAMDEF_TAG
             );
-            m_pApp->throwMPIError(stat, "Unable to receive count of parameter definitions");
             
-            // Get the definitions:
+            // Get the definitions (the dealer only sends them if there are any):
             
             std::vector<FRIB_MPI_ParameterDef> paramDefs;
             paramDefs.resize(numItems);
-            stat = MPI_Recv(
-                paramDefs.data(), numItems, m_pApp->parameterDefType(),
-                0, MPI_PARAMDEF_TAG, MPI_COMM_WORLD, &status
-            );
-            m_pApp->throwMPIError(stat,"Unable to receive parameter definitions from dealer");
+            if (numItems) {
+                transport.receiveBroadcast(
+                    paramDefs.data(), numItems, CTransport::PARAMETER_DEF,
+                    DEALER_RANK, FIRST_WORKER_RANK, MPI_PARAMDEF_TAG
+                );
+            }
                         
             loadTreeParameterMap(paramDefs);
         }
@@ -177,78 +281,191 @@ namespace frib {
         CMPIParametersToParametersWorker::receiveVariableDefinitions() {
             // get the numbver of definitions:
             
-            int stat;
-            MPI_Status status;
+            CTransport& transport(m_pApp->transport());
             std::uint32_t numItems;
             
-            stat = MPI_Recv(
-                &numItems, 1, MPI_UINT32_T,
-                0, MPI_VARIABLES_TAG, MPI_COMM_WORLD, &status
+            transport.receiveBroadcast(
+                &numItems, 1, CTransport::UINT32, DEALER_RANK, FIRST_WORKER_RANK,
+                MPI_VARIABLES_TAG
             );
-            m_pApp->throwMPIError(stat, "Unable to recive count of variable definitions");
             
-            // Now the definitions themselves:
+            // Now the definitions themselves (if there are any):
             
             std::vector<FRIB_MPI_VariableDef> defs;
             defs.resize(numItems);
-            stat = MPI_Recv(
-                defs.data(), numItems, m_pApp->variableDefType(),
-                0, MPI_VARIABLES_TAG, MPI_COMM_WORLD, &status
-            );
-            m_pApp->throwMPIError(stat, "Unable to receive variable definitions");
+            if (numItems) {
+                transport.receiveBroadcast(
+                    defs.data(), numItems, CTransport::VARIABLE_DEF,
+                    DEALER_RANK, FIRST_WORKER_RANK, MPI_VARIABLES_TAG
+                );
+            }
             
             loadVariableMap(defs);
         }
+        /**
+         * sendProjection
+         *    Tell the dealer which parameter ids from the input file we
+         *    consume; these are the ones with a slot in m_parameterMap.
+         *    This is the number of ids followed, if there are any, by the ids.
+         *    This is sent after both definition pushes have been received
+         *    so the dealer is never blocked sending them to us.
+         */
+        void
+        CMPIParametersToParametersWorker::sendProjection() {
+            std::vector<std::uint32_t> ids;
+            for (std::uint32_t i = 0; i < m_parameterMap.size(); i++) {
+                if (m_parameterMap[i]) {
+                    ids.push_back(i);
+                }
+            }
+            CTransport& transport(m_pApp->transport());
+            std::uint32_t numIds = ids.size();
+            transport.send(
+                &numIds, 1, CTransport::UINT32, DEALER_RANK, MPI_PROJECTION_TAG
+            );
+            if (numIds) {
+                transport.send(
+                    ids.data(), numIds, CTransport::UINT32,
+                    DEALER_RANK, MPI_PROJECTION_TAG
+                );
+            }
+        }
         /**
          * receiveEvents
-         *    -   Request an event from the dealer.
-         *    -   Get the parameter encoded event.
-         *    -   Load the event into the tree parameters.
-         *    -   invoke process (user written code).
-         *    -   Marshall the resulting event from the tree parameters.
-         *    -   Push it to the farmer.
+         *    -   Request a block of events from the dealer (prefetched unless
+         *        that's turned off).
+         *    -   Process the events in the block (see processBlock).
+         *    -   Send the batch of output events to the farmer.
          *    -   Keep doing this until the dealer sends us an end item...which
          *        we also push to the farmer so it knows a single worker is done.
          */
         void
         CMPIParametersToParametersWorker::receiveEvents() {
+            delete m_pBatch;
+            m_pBatch = nullptr;
+            m_pBatch = new CParameterBatch(
+                getBatchEvents(m_argc, m_argv), getBatchBytes(m_argc, m_argv)
+            );
+            delete m_pCompressor;
+            m_pCompressor = nullptr;
+            int level = getCompressionLevel(m_argc, m_argv);
+            if (level) {
+                m_pCompressor = new CParameterCompressor(level);
+            }
+            delete m_pPacker;
+            m_pPacker = nullptr;
+            auto types = CTreeParameter::getStorageTypes();
+            if (CParameterPacker::packs(types)) {
+                m_pPacker = new CParameterPacker(types);
+            }
+            unsigned credits = getPrefetchCredits(m_argc, m_argv);
+            if (credits) {
+                CMPIWorkItemPrefetcher prefetcher(
+                    *m_pApp, credits, getPrefetchBufferSize(m_argc, m_argv)
+                );
+                FRIB_MPI_Message_Header hdr;
+                while (const void* pData = prefetcher.next(hdr)) {
+                    processBlock(pData, hdr.s_nBytes);
+                    sendBatchToFarmer();
+                }
+            } else {
+                receiveBlocks();
+            }
+            
+            sendBatchToFarmer();          // Whatever's left.
+            sendEndToFarmer();            // No more events.
+        }
+        /**
+         * receiveBlocks
+         *    Request blocks of events from the dealer one at a time,
+         *    processing each and sending the results to the farmer until the
+         *    dealer sends an end.
+         */
+        void
+        CMPIParametersToParametersWorker::receiveBlocks() {
+            std::vector<std::uint8_t> block;
             while(1) {
                 // Request data and get the header.
                 // If it's an end mark then we can end the loop.
                 m_pApp->requestData(1024*1024);    // Size is actually ignored now.
-                FRIB_MPI_Parameter_MessageHeader hdr;
-                int stat;
-                MPI_Status status;
+                FRIB_MPI_Message_Header hdr;
+                CTransport& transport(m_pApp->transport());
                 
-                stat = MPI_Recv(
-                    &hdr, 1, m_pApp->parameterHeaderDataType(),
-                    0, MPI_HEADER_TAG, MPI_COMM_WORLD, &status
+                transport.recv(
+                    &hdr, 1, CTransport::MESSAGE_HEADER,
+                    DEALER_RANK, MPI_HEADER_TAG
                 );
-                m_pApp->throwMPIError(stat, "Unable to get event header");
                 
                 if (hdr.s_end) {
                     break;
                 }
                 
-                // Get the data into a parameter value vector, load tree params
-                // and call process:?
+                // Get the block of events, process them and ship the results:
                 
-                std::vector<FRIB_MPI_Parameter_Value> data;
-                data.resize(hdr.s_numParameters);
-                stat = MPI_Recv(
-                    data.data(), hdr.s_numParameters, m_pApp->parameterValueDataType(),
-                    0, MPI_DATA_TAG, MPI_COMM_WORLD, &status
+                if (hdr.s_nBytes > block.size()) {
+                    block.resize(hdr.s_nBytes);
+                }
+                transport.recv(
+                    block.data(), hdr.s_nBytes, CTransport::BYTES,
+                    DEALER_RANK, MPI_DATA_TAG
                 );
-                m_pApp->throwMPIError(stat, "Unable to receive parameterized event data");
                 
-                CTreeParameter::nextEvent();
-                loadTreeParameters(data);
-                process();
-                sendEventToFarmer(hdr.s_triggerNumber);
-            
+                processBlock(block.data(), hdr.s_nBytes);
+                sendBatchToFarmer();
+            }
+        }
+        /**
+         * processBlock
+         *    For each PARAMETER_DATA ring item in a block of them:
+         *    -   Load the event into the tree parameters.
+         *    -   invoke process (user written code).
+         *    -   Marshall the resulting event from the tree parameters into
+         *        the batch for the farmer, with the input event's trigger.
+         *    The dealer does not put anything else in a work item but, just
+         *    in case, anything else is passed through to the outputter.
+         *
+         * @param pData - the block of ring items.
+         * @param nBytes - number of bytes in the block.
+         * @throw std::logic_error - an item or event runs past its end.
+         */
+        void
+        CMPIParametersToParametersWorker::processBlock(
+            const void* pData, std::size_t nBytes
+        ) {
+            const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(pData);
+            while (nBytes) {
+                const ParameterItem* pEvent =
+                    reinterpret_cast<const ParameterItem*>(p);
+                if (nBytes < sizeof(RingItemHeader)) {
+                    throw std::logic_error("Malformed parameter block from dealer");
+                }
+                std::uint32_t size = pEvent->s_header.s_size;
+                if ((size < sizeof(RingItemHeader)) || (size > nBytes)) {
+                    throw std::logic_error("Malformed parameter block from dealer");
+                }
+                if (pEvent->s_header.s_type == PARAMETER_DATA) {
+                    if (
+                        (size < sizeof(ParameterItem)) ||
+                        (
+                            size < sizeof(ParameterItem) +
+                            std::uint64_t(pEvent->s_parameterCount) *
+                                sizeof(ParameterValue)
+                        )
+                    ) {
+                        throw std::logic_error(
+                            "Malformed parameter event from dealer"
+                        );
+                    }
+                    CTreeParameter::nextEvent();
+                    loadTreeParameters(pEvent);
+                    process();
+                    sendEventToFarmer(pEvent->s_triggerCount);
+                } else {
+                    m_pApp->forwardPassThrough(pEvent, size);
+                }
+                p      += size;
+                nBytes -= size;
             }
-            
-            sendEndToFarmer();            // No more events.
         }
         /**
          * loadTreeParameterMap
@@ -263,8 +480,8 @@ namespace frib {
          *        std::vector is defined to fill those with default constructed items
          *        which for pointers are nulls.
          *    -  Iterate over the definitions and create a new tree parameter
-         *       for each item, putting its pointer into the appropriate slot of
-         *       the parameter map vector.
+         *       for each item we consume (see consumesParameter), putting its
+         *       pointer into the appropriate slot of the parameter map vector.
          *
          *    @param params - the parameter definitions.
          */
@@ -283,7 +500,10 @@ namespace frib {
                 m_parameterMap.resize(maxId+1);    // Filled with nulls.
                 
                 for (const auto& def : params) {
-                    m_parameterMap[def.s_parameterId] = new CTreeParameter(def.s_name);
+                    if (consumesParameter(def.s_name)) {
+                        m_parameterMap[def.s_parameterId] =
+                            new CTreeParameter(def.s_name);
+                    }
                 }
             }
         }
@@ -311,7 +531,7 @@ namespace frib {
         }
         /**
          * loadTreeParameters
-         *    Given a vector of parameter values from an event, uses
+         *    Given an event from the dealer, uses
          *    the parameter ids to index the m_parameterMap, find the associated
          *    tree parameter and set it with the variable.
          *
@@ -330,65 +550,69 @@ namespace frib {
          *    one can imagine discarding the raw parameters from the data.
          *    This is an option and not required of course.
          *
-         *  @param params - the parameter value vector received from the dealer.
+         *  @param pEvent - the PARAMETER_DATA item received from the dealer.
          */
         void
         CMPIParametersToParametersWorker::loadTreeParameters(
-            const std::vector<FRIB_MPI_Parameter_Value>& params
+            const ParameterItem* pEvent
         ) {
-            for (const auto param : params) {
-                if(param.s_number < m_parameterMap.size() &&
-                   m_parameterMap[param.s_number]
+            const ParameterValue* param = pEvent->s_parameters;
+            for (std::uint32_t i = 0; i < pEvent->s_parameterCount; i++, param++) {
+                std::uint32_t number = param->s_number;
+                if(number < m_parameterMap.size() &&
+                   m_parameterMap[number]
                 ) {
                     
-                    *m_parameterMap[param.s_number] = param.s_value;    
+                    *m_parameterMap[number] = param->s_value;    
                 } 
             }
         }
         /**
          * sendEventToFarmer
-         *    Pulls the event from the tree parameter, marshalls and sends it
-         *    to the farmer.
+         *    Pulls the event from the tree parameter and marshalls it into
+         *    the batch for the farmer.  If that fills the batch, it's sent.
          *
          *    @param trigger the trigger number.
          */
         void
         CMPIParametersToParametersWorker::sendEventToFarmer(std::uint64_t trigger) {
-            auto rawEvent = CTreeParameter::collectEvent();
-            
-            // Build the header from what we know:
-            
-            FRIB_MPI_Parameter_MessageHeader hdr;
-            hdr.s_triggerNumber = trigger;
-            hdr.s_numParameters = rawEvent.size();
-            hdr.s_end = false;
-            
-            // build the array of parameter values:
-            
-            std::vector<FRIB_MPI_Parameter_Value> data;
-            data.reserve(rawEvent.size());            // Allocate only once.
-            for(auto& par : rawEvent) {
-                FRIB_MPI_Parameter_Value v = {
-                    .s_number = par.first,
-                    .s_value  = par.second
-                };
-                data.push_back(v);
-            }
-            // Now we can push the header and value to the farmer which is
-            // rank 1.
-            
-            int status;
-            status = MPI_Send(
-                &hdr, 1, m_pApp->parameterHeaderDataType(),
-                1, MPI_HEADER_TAG, MPI_COMM_WORLD
-            );
-            m_pApp->throwMPIError(status, "Unable to send parameter data header to farmer");
-            
-            status = MPI_Send(
-                data.data(), data.size(), m_pApp->parameterValueDataType(),
-                1, MPI_DATA_TAG, MPI_COMM_WORLD
+            CTreeParameter::collectEvent(
+                m_pBatch->allocateEvent(trigger, CTreeParameter::eventSize())
             );
-            m_pApp->throwMPIError(status, "Unable to send parameter data to farmer");
+            if (m_pBatch->full()) {
+                sendBatchToFarmer();
+            }
+        }
+        /**
+         * sendBatchToFarmer
+         *    Pushes the batch of events to the farmer as a single
+         *    message and empties it.  Empty batches are not sent.
+         *    If we're packing and/or compressing, its packed items/compressed
+         *    frames are sent instead.
+         */
+        void
+        CMPIParametersToParametersWorker::sendBatchToFarmer() {
+            if (!m_pBatch->empty()) {
+                const void* pData  = m_pBatch->data();
+                std::size_t nBytes = m_pBatch->size();
+                if (m_pPacker) {
+                    m_pPacker->clear();
+                    m_pPacker->add(pData, nBytes);
+                    pData  = m_pPacker->data();
+                    nBytes = m_pPacker->size();
+                }
+                if (m_pCompressor) {
+                    m_pCompressor->clear();
+                    m_pCompressor->add(pData, nBytes);
+                    pData  = m_pCompressor->data();
+                    nBytes = m_pCompressor->size();
+                }
+                m_pApp->transport().send(
+                    pData, nBytes, CTransport::BYTES,
+                    FARMER_RANK, MPI_PARAMETER_BATCH_TAG
+                );
+                m_pBatch->clear();
+            }
         }
         /**
          * sendEndToFarmer
@@ -401,13 +625,9 @@ namespace frib {
             hdr.s_numParameters = 0;
             hdr.s_end = true;
             
-            int status;
-            status = MPI_Send(
-                &hdr, 1, m_pApp->parameterHeaderDataType(),
-                1, MPI_END_TAG, MPI_COMM_WORLD
+            m_pApp->transport().send(
+                &hdr, 1, CTransport::PARAMETER_HEADER, FARMER_RANK, MPI_END_TAG
             );
-            m_pApp->throwMPIError(status, "Unable to send end of data message to farmer");
-            
         }
 
     }
@@ -22,12 +22,18 @@
 #define MPIPARAMETERSTOPARAMETERSWORKER_h
 #include <vector>
 #include <map>
+#include <string>
 #include <cstdint>
+#include <cstddef>
+#include "TreeParameterContext.h"
 
 namespace frib {
     namespace analysis {
         class AbstractApplication;
         class CTreeParameter;
+        class CParameterBatch;
+        class CParameterCompressor;
+        class CParameterPacker;
         
         struct _FRIB_MPI_ParameterDef;
         typedef _FRIB_MPI_ParameterDef
@@ -37,9 +43,8 @@ namespace frib {
         typedef _FRIB_MPI_VariableDef
             FRIB_MPI_VariableDef, *pFRIB_MPI_VariableDef;
             
-        struct _FRIB_MPI_Parameter_Value;
-        typedef _FRIB_MPI_Parameter_Value
-            FRIB_MPI_Parameter_Value, *pFRIB_MPI_Parameter_Value;
+        struct _ParameterItem;
+        typedef _ParameterItem ParameterItem, *pParameterItem;
 
                     
         /**
@@ -61,15 +66,32 @@ namespace frib {
          *       Note that utility methods available to derived classes can
          *       provide the data from the message data.  Note, however that it is
          *       the file data that goes into the output file.
-         *    -  The worker than requests and gets parameter data.  Using the
-         *       mappings previously constructed, tree parameters are loaded with
-         *       the data in each event.
+         *    -  The worker tells the dealer which of the file's parameter
+         *       ids it maps (see consumesParameter).  The dealer strips
+         *       parameters no worker consumes from the events it sends.
+         *    -  The worker than requests and gets blocks of parameter data
+         *       (PARAMETER_DATA ring items).  Using the mappings previously
+         *       constructed, tree parameters are loaded with the data in each
+         *       event of the block.
          *    -  process (the user method) is then called and the user must do
          *       the application specific computations that result in output
          *       parameers
          *    -  On return from process, the parameters are marshalled from the
-         *       tree parameters and sent to the farmer.
-         *    -  When data are exhausted an end record is pushed to the farmer.
+         *       tree parameters and added to a batch of events that's sent to
+         *       the farmer when full (see getBatchEvents and getBatchBytes)
+         *       and at the end of each block.  The trigger number of each
+         *       input event is preserved.
+         *    -  When data are exhausted any partial batch and then an end record
+         *       are pushed to the farmer.
+         *    -  Blocks are prefetched from the dealer (see
+         *       CMPIWorkItemPrefetcher, getPrefetchCredits and
+         *       getPrefetchBufferSize) so that the next one is usually
+         *       already here when the current one is processed.
+         *    -  Batches are compressed before they're sent if
+         *       getCompressionLevel says so (see CParameterCompressor).
+         *    -  Batches are packed (see CParameterPacker) before they're
+         *       sent (and compressed) if any tree parameter has a storage
+         *       type other than double.
          *  
          */
         class CMPIParametersToParametersWorker  {
@@ -82,6 +104,10 @@ namespace frib {
             int                   m_argc;
             char**                m_argv;
             AbstractApplication*  m_pApp;
+            CParameterBatch*      m_pBatch;
+            CParameterCompressor* m_pCompressor;   // nullptr if not compressing.
+            CParameterPacker*     m_pPacker;       // nullptr if not packing.
+            CTreeParameterContext m_context;
         public:
             CMPIParametersToParametersWorker(
                 int argc, char** argv, AbstractApplication* pApp
@@ -94,10 +120,20 @@ namespace frib {
             VariableInfo* getVariable(const char* pVarName);
             void loadVariable(const char* pVarName);
             std::vector<std::string> getVariableNames();
+            
+            virtual std::size_t getBatchEvents(int argc, char** argv);
+            virtual std::size_t getBatchBytes(int argc, char** argv);
+            virtual unsigned getPrefetchCredits(int argc, char** argv);
+            virtual std::size_t getPrefetchBufferSize(int argc, char** argv);
+            virtual int getCompressionLevel(int argc, char** argv);
+            virtual bool consumesParameter(const std::string& name);
         private:
             void receiveParameterDefinitions();
             void receiveVariableDefinitions();
+            void sendProjection();
             void receiveEvents();
+            void receiveBlocks();
+            void processBlock(const void* pData, std::size_t nBytes);
             
             void loadTreeParameterMap(
                 const std::vector<FRIB_MPI_ParameterDef>& params
@@ -105,10 +141,9 @@ namespace frib {
             void loadVariableMap(
                 const std::vector<FRIB_MPI_VariableDef>& vars
             );
-            void loadTreeParameters(
-                const std::vector<FRIB_MPI_Parameter_Value>& params
-            );
+            void loadTreeParameters(const ParameterItem* pEvent);
             void sendEventToFarmer(std::uint64_t trigger);
+            void sendBatchToFarmer();
             void sendEndToFarmer();
             
         };
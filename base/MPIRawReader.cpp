@@ -20,15 +20,32 @@
  */
 #include "MPIRawReader.h"
 #include "DataReader.h"
+#include "MappedDataReader.h"
+#include "AsyncDataReader.h"
 #include "AbstractApplication.h"
 #include "AnalysisRingItems.h"
-#include <mpi.h>
+#include "TriggerIndex.h"
 #include <stdexcept>
 #include <iostream>
+#include <chrono>
+#include <unistd.h>
 
 using namespace frib::analysis;
 
 static const unsigned DEFAULT_BLOCKSIZE(16*1024*1024);
+static const unsigned DEFAULT_MAX_OUTSTANDING_SENDS(4);
+
+/**
+ * secondsSince
+ *   @param start - a time point.
+ *   @return double - seconds since start.
+ */
+static double
+secondsSince(std::chrono::steady_clock::time_point start)
+{
+    std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+    return d.count();
+}
 namespace frib {
     namespace analysis {
         /**
@@ -39,7 +56,10 @@ namespace frib {
         CMPIRawReader::CMPIRawReader(int argc, char** argv, AbstractApplication* pApp) :
             m_argc(argc), m_argv(argv),
             m_pApp(pApp), m_pReader(nullptr), m_nBlockSize(DEFAULT_BLOCKSIZE),
-            m_nEndsLeft(pApp->numWorkers())
+            m_nEndsLeft(pApp->numWorkers()),
+            m_ioWaitTime(0.0), m_requestWaitTime(0.0), m_sendWaitTime(0.0),
+            m_copyData(true), m_nSequence(0), m_ranged(false), m_inRange(true),
+            m_nFirstTrigger(0), m_nEndTrigger(AbstractApplication::ALL_TRIGGERS)
         {
                 
             // Note that calling virtual methods from a construtor calls _our_
@@ -49,6 +69,8 @@ namespace frib {
         }
         /**
          * destructor - delete the reader.  The app is owned by the caller.
+         * operator() waits for all sends to complete so, normally, there are
+         * none in flight by now.
          */
         CMPIRawReader::~CMPIRawReader() {
             delete m_pReader;
@@ -58,15 +80,62 @@ namespace frib {
          *    This is the functiuonal entry point:
          *    -  Create the reader and initialize the stuff we could not in the
          *       construtor due to restrictions on when virtual methods are honored
-         *    -  Use sendData to send the data until EOF.
+         *    -  Set up the slots for in-flight sends.
+         *    -  Get the range of triggers to send.
+         *    -  Use sendData to send the data until EOF (or the end of the range).
+         *    -  Wait for the sends still in flight.
          *    -  Use sendEofs to send the end messages until m_nEndsLeft is 0.
+         *    -  Report the I/O and request wait statistics.
          */
         void CMPIRawReader::operator()()  {
             m_nBlockSize = getBlockSize(m_argc, m_argv);
-            m_pReader = new CDataReader(getInputFile(m_argc, m_argv), m_nBlockSize);
+            m_pReader = createReader(getInputFile(m_argc, m_argv), m_nBlockSize);
+            m_copyData = !m_pReader->blocksPersist();
+            
+            unsigned nSlots = getMaxOutstandingSends(m_argc, m_argv);
+            if (nSlots == 0) nSlots = 1;       // 1 is like blocking sends.
+            m_slots.resize(nSlots);
+            m_requests.assign(2*nSlots, CTransport::NULL_REQUEST);
+            
+            m_nFirstTrigger = m_pApp->getFirstTrigger(m_argc, m_argv);
+            uint64_t count  = m_pApp->getTriggerCount(m_argc, m_argv);
+            m_nEndTrigger = (count > AbstractApplication::ALL_TRIGGERS - m_nFirstTrigger) ?
+                AbstractApplication::ALL_TRIGGERS : m_nFirstTrigger + count;
+            m_ranged = (m_nFirstTrigger > 0) ||
+                (m_nEndTrigger != AbstractApplication::ALL_TRIGGERS);
+            m_inRange = (m_nFirstTrigger == 0);
             
             sendData();
+            waitSends();
             m_pApp->sendEofs();
+            reportStatistics(m_ioWaitTime, m_requestWaitTime);
+        }
+        /**
+         * getIoWaitTime
+         *   @return double - seconds spent waiting for the reader to supply
+         *                   or take back data.
+         */
+        double
+        CMPIRawReader::getIoWaitTime() const {
+            return m_ioWaitTime;
+        }
+        /**
+         * getRequestWaitTime
+         *   @return double - seconds spent waiting for data requests from workers.
+         */
+        double
+        CMPIRawReader::getRequestWaitTime() const {
+            return m_requestWaitTime;
+        }
+        /**
+         * getSendWaitTime
+         *   @return double - seconds spent waiting for sends to complete
+         *                    because the cap on in-flight sends was reached
+         *                    (or at the end of the run).
+         */
+        double
+        CMPIRawReader::getSendWaitTime() const {
+            return m_sendWaitTime;
         }
                 /**
          * getInputFile
@@ -99,6 +168,69 @@ namespace frib {
         CMPIRawReader::getBlockSize(int argc, char** argv) const {
             return DEFAULT_BLOCKSIZE;
         }
+        /**
+         * createReader
+         *    Create the reader that will supply data from the input file.
+         *    This is virtual so users can choose a different reader.  By default,
+         *    regular files are memory mapped so that data are sent straight
+         *    from the page cache; anything else (e.g. a pipe) is read ahead
+         *    on a background thread by a CAsyncDataReader.
+         * @param pFilename - name of the input file.
+         * @param blockSize - size of the blocks we'll be sending.
+         * @return CDataReader* - pointer to a dynamically created reader.
+         */
+        CDataReader*
+        CMPIRawReader::createReader(const char* pFilename, unsigned blockSize) const {
+            if (CMappedDataReader::isMappable(pFilename)) {
+                return new CMappedDataReader(pFilename);
+            }
+            return new CAsyncDataReader(pFilename, blockSize);
+        }
+        /**
+         * getMaxOutstandingSends
+         *    Return the maximum number of work items that can be in flight
+         *    at any time.  Virtual so users can override it (e.g. from the
+         *    command line).  Note that if the reader's blocks don't persist,
+         *    each in-flight item holds a copy of up to a block of data.
+         *    A value of 1 behaves much like blocking sends.
+         * @param argc - number of command line parameters.
+         * @param argv - command line parameters.
+         * @return unsigned - DEFAULT_MAX_OUTSTANDING_SENDS.
+         */
+        unsigned
+        CMPIRawReader::getMaxOutstandingSends(int argc, char** argv) const {
+            return DEFAULT_MAX_OUTSTANDING_SENDS;
+        }
+        /**
+         * getIndexFile
+         *    Get the name of the trigger index of the input file.  It's
+         *    only used if the application starts after the first trigger
+         *    and it exists.
+         * @param argc - number of command line parameters.
+         * @param argv - command line parameters.
+         * @return std::string - by default the index sidecar of the input
+         *                       file (see CTriggerIndex::sidecarName).
+         */
+        std::string
+        CMPIRawReader::getIndexFile(int argc, char** argv) const {
+            return CTriggerIndex::sidecarName(getInputFile(argc, argv));
+        }
+        /**
+         * reportStatistics
+         *    Report how long we spent waiting for I/O and waiting for worker
+         *    requests.  This is virtual so it can be overridden (e.g. to
+         *    suppress the report).  By default a line is written to stderr.
+         *    The time spent waiting for sends to complete is also
+         *    reported (see getSendWaitTime).
+         * @param ioSeconds - seconds spent in the reader's getBlock/done.
+         * @param requestSeconds - seconds spent waiting for worker requests.
+         */
+        void
+        CMPIRawReader::reportStatistics(double ioSeconds, double requestSeconds) const {
+            std::cerr << "CMPIRawReader: blocked on I/O " << ioSeconds
+                << " s, blocked on worker requests " << requestSeconds
+                << " s, blocked on sends " << m_sendWaitTime << " s\n";
+        }
         /**
          * sendData
          *    - Pull blocks of data from the Reader until and end file.
@@ -108,19 +240,33 @@ namespace frib {
          *      *    Read a data request.
          *      *    Satisfy it.
          *      *    Update the next trigger count
+         *    - If only a range of triggers is sent, we start at the first
+         *      trigger (seeking to it if we can), trim the blocks to the range
+         *      and stop at its end.
          */
         void
         CMPIRawReader::sendData() {
-            unsigned firstTrigger(0);
+            std::uint64_t firstTrigger = seekFirstTrigger();
             
             while(1) {
+                auto start = std::chrono::steady_clock::now();
                 auto descrip = m_pReader->getBlock(m_nBlockSize);
+                m_ioWaitTime += secondsSince(start);
                 if (descrip.s_pData)  {
                     // not eof
-                    unsigned triggers = countTriggers(descrip.s_pData, descrip.s_nItems);
-                    sendWorkItem(descrip.s_pData, descrip.s_nbytes, firstTrigger);
-                    firstTrigger += triggers;
+                    const std::uint8_t* p =
+                        reinterpret_cast<const std::uint8_t*>(descrip.s_pData);
+                    size_t nBytes = descrip.s_nbytes;
+                    bool   last   = m_ranged && selectTriggers(p, nBytes, firstTrigger);
+                    if (nBytes) {
+                        sendWorkItems(p, nBytes, firstTrigger);
+                    }
+                    start = std::chrono::steady_clock::now();
                     m_pReader->done();
+                    m_ioWaitTime += secondsSince(start);
+                    if (last) {
+                        break;             // End of the range.
+                    }
                 } else {
                     break;                 // EOF so done sending data.
                 }
@@ -131,13 +277,13 @@ namespace frib {
          * countTriggers
          *   Given  a block of ring items, counts the number of physics items.
          * @param pData - pointer to the data.
-         * @param numItems - number of ring items known to be in the block of data.
+         * @param nBytes - number of bytes of ring items in the block of data.
          * @return unsigned - number of physics items.
          * @note we do this without reference to NSCLDAQ's DataFormat.h
          *   to be independent of an NSCLDAQ version.
          */
         unsigned
-        CMPIRawReader::countTriggers(const void* pData, size_t numItems) const {
+        CMPIRawReader::countTriggers(const void* pData, size_t nBytes) const {
             // NSCLDAQ stuff normally in DataFormat.h:
             
             struct ItemHeader {
@@ -153,29 +299,151 @@ namespace frib {
                 const std::uint8_t* s_p8;
             } p;
             p.s_p8 = reinterpret_cast<const std::uint8_t*>(pData);
+            const std::uint8_t* pEnd = p.s_p8 + nBytes;
             
             unsigned result(0);
             
-            while (numItems) {
+            while (p.s_p8 < pEnd) {
                 if (p.s_pHeader->s_type == PHYSICS_EVENT) {
                     result++;              // Count a trigger.
                 }
                 p.s_p8 += p.s_pHeader->s_size;
-                
-                numItems--;
             }
             
             return result;
         }
+        /**
+         * seekFirstTrigger
+         *    If we start after the first trigger and there's an index for the
+         *    input file, seek to the last indexed trigger at or before the
+         *    first one.  An index that doesn't describe the input file as
+         *    it is now (e.g. the file was rewritten) is ignored.
+         * @return std::uint64_t - number of the trigger the reader is now at.
+         * @throw std::runtime_error - the index file is not a trigger index.
+         */
+        std::uint64_t
+        CMPIRawReader::seekFirstTrigger() {
+            if (m_nFirstTrigger == 0) {
+                return 0;
+            }
+            std::string indexFile = getIndexFile(m_argc, m_argv);
+            if (access(indexFile.c_str(), R_OK)) {
+                return 0;
+            }
+            CTriggerIndex index;
+            index.read(indexFile.c_str());
+            const char* pInputFile = getInputFile(m_argc, m_argv);
+            if (!index.describes(pInputFile)) {
+                std::cerr << "CMPIRawReader: ignoring " << indexFile
+                    << " which does not match " << pInputFile << std::endl;
+                return 0;
+            }
+            const TriggerIndexEntry* pStart = index.find(m_nFirstTrigger);
+            if (!pStart) {
+                return 0;
+            }
+            m_pReader->seek(pStart->s_offset);
+            m_pReader->addContext(index.context().data(), index.context().size());
+            return pStart->s_trigger;
+        }
+        /**
+         * selectTriggers
+         *    Trim a block to the items in the range of triggers: until the
+         *    range has started, items before its first physics event are
+         *    dropped; items from the first physics event after the range
+         *    are dropped too.  Everything else, including non physics items
+         *    between the range's events, is sent.
+         * @param[inout] pData - the block; on return the first item to send.
+         * @param[inout] nBytes - bytes in the block; on return bytes to send.
+         * @param[inout] firstTrigger - number of the next physics event in the
+         *              block; on return that of the first one to send.
+         * @return bool - true if the end of the range is in the block.
+         */
+        bool
+        CMPIRawReader::selectTriggers(
+            const std::uint8_t*& pData, size_t& nBytes, std::uint64_t& firstTrigger
+        ) {
+            if (!m_inRange) {
+                size_t skip = skipTriggers(pData, nBytes, firstTrigger, m_nFirstTrigger);
+                m_inRange = skip < nBytes;
+                pData  += skip;
+                nBytes -= skip;
+            }
+            
+            std::uint64_t trigger = firstTrigger;
+            size_t keep = skipTriggers(pData, nBytes, trigger, m_nEndTrigger);
+            bool last = keep < nBytes;
+            nBytes = keep;
+            return last;
+        }
+        /**
+         * skipTriggers
+         *    Find the first physics event of a block whose trigger number is
+         *    at least some value.
+         * @param pData - pointer to the block.
+         * @param nBytes - number of bytes in the block.
+         * @param[inout] trigger - number of the next physics event in the
+         *               block; on return that of the one found.
+         * @param until - trigger number of the physics event to find.
+         * @return size_t - offset of that event in the block (nBytes if it's
+         *               not in the block).
+         */
+        size_t
+        CMPIRawReader::skipTriggers(
+            const void* pData, size_t nBytes, std::uint64_t& trigger,
+            std::uint64_t until
+        ) const {
+            static const std::uint32_t PHYSICS_EVENT=30;
+            
+            const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(pData);
+            const std::uint8_t* pEnd = p + nBytes;
+            while (p < pEnd) {
+                const RingItemHeader* pHeader =
+                    reinterpret_cast<const RingItemHeader*>(p);
+                if (pHeader->s_type == PHYSICS_EVENT) {
+                    if (trigger >= until) break;
+                    trigger++;
+                }
+                p += pHeader->s_size;
+            }
+            return p - reinterpret_cast<const std::uint8_t*>(pData);
+        }
+        /**
+         * sendWorkItems
+         *    Send a block of data from the reader to the workers.  Normally
+         *    this is a single work item.  Workers that prefetch, however,
+         *    limit the size of the work items they'll accept, in which case the
+         *    block is split up into as many work items as needed.
+         * @param pData - pointer to the data to send.
+         * @param nBytes - number of bytes to send.
+         * @param[inout] firstTrigger - the number of the first trigger in the
+         *               block. On return, the number of the trigger after the
+         *               block.
+         */
+        void
+        CMPIRawReader::sendWorkItems(
+            const void* pData, size_t nBytes, std::uint64_t& firstTrigger
+        ) {
+            const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(pData);
+            while (nBytes) {
+                FRIB_MPI_Request_Data request;
+                int dest = getRequest(request);
+                size_t n = m_pApp->workItemSize(request, p, nBytes);
+                sendWorkItem(dest, p, n, firstTrigger);
+                
+                firstTrigger += countTriggers(p, n);
+                p      += n;
+                nBytes -= n;
+            }
+        }
         /**
          * sendWorkItem
+         *    - Get a free send slot (waiting for one if all are in flight).
          *    - Format the header block.
-         *    - Accept the next work request.
-         *    - send the header and the data to the requestor.
-         *  @note - in this version the maxrequest is ignored since we overlapped
-         *      the read from the file bewteen adjacent work requests.  The requstor
-         *      can use the header to ensure it allocates sufficient space to receive
-         *      the actual data block.
+         *    - If needed, copy the data into the slot.
+         *    - Start sending the header and the data to the requestor.
+         *  @note - The requestor can use the header to ensure it allocates
+         *      sufficient space to receive the actual data block.
          * @param pData - pointer to the data to send.
          * @param numBytes - number of bytes to be sent.
          * @param blockNum - really the number of the first trigger in the block.
@@ -183,60 +451,118 @@ namespace frib {
          *  as a starting point.  Note that if the worker deletes data, it should
          *  send an empty parameter event to the farmer with the trigger number
          *  of the deleted event.
+         * @param dest - rank of the worker whose request we're satisfying.
          */
         void
-        CMPIRawReader::sendWorkItem(const void* pData, size_t nBytes, unsigned blockNum)
+        CMPIRawReader::sendWorkItem(
+            int dest, const void* pData, size_t nBytes, std::uint64_t blockNum
+        )
         {
-        
-            // fill in the reply header so its ready for the request:
-            
-            FRIB_MPI_Message_Header header;
-            header.s_nBytes = nBytes;
-            header.s_nBlockNum = blockNum;
-            header.s_end = false;
+            size_t slot = freeSlot();
+            SendSlot& s(m_slots[slot]);
+            s.s_sequence = m_nSequence++;
             
-            char errorWhy[MPI_MAX_ERROR_STRING];
-            int len;
+            s.s_header.s_nBytes = nBytes;
+            s.s_header.s_nBlockNum = blockNum;
+            s.s_header.s_end = false;
             
-            // get the request:
+            // The reader will reuse its buffer once we call done() so, unless
+            // its blocks persist, send from our own copy:
             
-            int dest = getRequest();
-        
-            // Send the header and send the data:
+            if (m_copyData) {
+                const uint8_t* p = reinterpret_cast<const uint8_t*>(pData);
+                s.s_data.assign(p, p + nBytes);
+                pData = s.s_data.data();
+            }
             
-            int status = MPI_Send(
-                &header, 1, m_pApp->messageHeaderType(), dest,
-                MPI_HEADER_TAG, MPI_COMM_WORLD
+            CTransport& transport(m_pApp->transport());
+            m_requests[2*slot] = transport.isend(
+                &s.s_header, 1, CTransport::MESSAGE_HEADER, dest, MPI_HEADER_TAG
             );
-
-            if (status != MPI_SUCCESS) {
-                std::string msg = "Failed to send data header to worker: ";
-                MPI_Error_string(status, errorWhy, &len);
-                msg += errorWhy;
-                throw std::runtime_error(msg);
-            }
-            status = MPI_Send(
-                pData, nBytes, MPI_UINT8_T, dest,
-                MPI_DATA_TAG, MPI_COMM_WORLD
+            m_requests[2*slot + 1] = transport.isend(
+                pData, nBytes, CTransport::BYTES, dest, MPI_DATA_TAG
             );
-    
-            if (status != MPI_SUCCESS) {
-                std::string msg = "Failed to send data block to worker: ";
-                MPI_Error_string(status, errorWhy, &len);
-                msg += errorWhy;
-                throw std::runtime_error(msg);
-            }
         }
         
         /**
          * getRequest
-         *    Read a request message from whatever worker first gets one in:
+         *    Read a request message from whatever worker first gets one in.
+         *    The time we wait is added to m_requestWaitTime.
+         *  @param[out] request - the request.
          *  @return int - rank of worker.
          */
         int
-        CMPIRawReader::getRequest()
+        CMPIRawReader::getRequest(FRIB_MPI_Request_Data& request)
+        {
+            auto start = std::chrono::steady_clock::now();
+            int result = m_pApp->getRequest(&request);
+            m_requestWaitTime += secondsSince(start);
+            return result;
+        }
+        /**
+         * freeSlot
+         *    Return the index of a send slot that has nothing in flight.
+         *    Completed sends are reaped first.  If all slots are still busy,
+         *    we wait for the oldest one's sends to complete.  That time is
+         *    added to m_sendWaitTime.
+         * @return size_t - index of the free slot.
+         */
+        size_t
+        CMPIRawReader::freeSlot()
+        {
+            reapSends();
+            size_t oldest = 0;
+            for (size_t i = 0; i < m_slots.size(); i++) {
+                if (!slotBusy(i)) return i;
+                if (m_slots[i].s_sequence < m_slots[oldest].s_sequence) {
+                    oldest = i;
+                }
+            }
+            CTransport& transport(m_pApp->transport());
+            auto start = std::chrono::steady_clock::now();
+            transport.wait(m_requests[2*oldest]);
+            transport.wait(m_requests[2*oldest + 1]);
+            m_sendWaitTime += secondsSince(start);
+            return oldest;
+        }
+        /**
+         * reapSends
+         *    Test the requests that are in flight.  The transport sets the
+         *    ones that completed to CTransport::NULL_REQUEST.
+         */
+        void
+        CMPIRawReader::reapSends()
+        {
+            CTransport& transport(m_pApp->transport());
+            for (auto& request : m_requests) {
+                transport.test(request);
+            }
+        }
+        /**
+         * waitSends
+         *    Wait for all sends in flight to complete.  The time is added
+         *    to m_sendWaitTime.
+         */
+        void
+        CMPIRawReader::waitSends()
+        {
+            CTransport& transport(m_pApp->transport());
+            auto start = std::chrono::steady_clock::now();
+            for (auto& request : m_requests) {
+                transport.wait(request);
+            }
+            m_sendWaitTime += secondsSince(start);
+        }
+        /**
+         * slotBusy
+         *   @param slot - index of a send slot.
+         *   @return bool - true if either of its sends is still in flight.
+         */
+        bool
+        CMPIRawReader::slotBusy(size_t slot) const
         {
-            return m_pApp->getRequest();
+            return (m_requests[2*slot] != CTransport::NULL_REQUEST) ||
+                (m_requests[2*slot + 1] != CTransport::NULL_REQUEST);
         }
         
     }
@@ -22,6 +22,11 @@
 #define MPIRAWREADER_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include <string>
+#include "AnalysisRingItems.h"
+#include "Transport.h"
 
 
 namespace frib {
@@ -48,15 +53,60 @@ namespace frib {
          *   request - that is we get a block to send, analyze the number
          *   triggers in it to update  m_nTriggersInBLock; and _then_
          *   get the next request
+         *
+         *   The time spent waiting for the reader (I/O) and waiting for
+         *   worker requests is accumulated and, at the end of the run,
+         *   passed to the virtual reportStatistics method.  If the dealer
+         *   mostly waits on I/O the workers are starved for data; if it
+         *   mostly waits for requests, the workers are the bottleneck.
+         *
+         *   Work items are sent with non-blocking sends so that, while a
+         *   block is on its way to one worker, we can read the next block
+         *   and accept the next worker's request.  The number of work items
+         *   in flight is capped by getMaxOutstandingSends; when the cap is
+         *   reached we wait for the oldest send to complete (that time is
+         *   reported as well).  If the reader's blocks don't persist
+         *   after done() (see CDataReader::blocksPersist), each in-flight
+         *   work item is copied into a buffer owned by its send slot, so
+         *   memory use is bounded by the cap times the block size.
+         *
+         *   If the application asks for a range of triggers (see
+         *   AbstractApplication::getFirstTrigger), only the items from the
+         *   first physics event of the range (the start of the file if
+         *   it's trigger 0) up to the first one after it are sent.  If the file has a trigger index (getIndexFile, see
+         *   the indexTriggers program) we seek to the nearest indexed
+         *   trigger at or before the first one rather than counting
+         *   physics events from the start of the file.
          */
         class CMPIRawReader {
         private:
+            // An in-flight work item.  Its header and data sends use
+            // m_requests[2*i] and m_requests[2*i+1] where i is the slot's
+            // index:
+            
+            typedef struct _SendSlot {
+                FRIB_MPI_Message_Header   s_header;
+                std::vector<uint8_t>      s_data;   // Copy if blocks don't persist.
+                uint64_t                  s_sequence; // Order the sends started.
+            } SendSlot, *pSendSlot;
+            
             int m_argc;
             char** m_argv;
             AbstractApplication* m_pApp;
             CDataReader* m_pReader;
             unsigned     m_nBlockSize;
             unsigned     m_nEndsLeft;
+            double       m_ioWaitTime;
+            double       m_requestWaitTime;
+            double       m_sendWaitTime;
+            bool         m_copyData;
+            uint64_t     m_nSequence;
+            bool         m_ranged;            // Only some triggers are sent.
+            bool         m_inRange;           // First trigger sent.
+            uint64_t     m_nFirstTrigger;
+            uint64_t     m_nEndTrigger;       // Just after the range.
+            std::vector<SendSlot>    m_slots;
+            std::vector<CTransport::Request> m_requests;
         public:
             CMPIRawReader(int argc, char** argv, AbstractApplication* pApp);
             virtual ~CMPIRawReader();
@@ -67,18 +117,47 @@ namespace frib {
             int operator!=(const CMPIRawReader& rhs);
         public:
             void operator()();
+            double getIoWaitTime() const;
+            double getRequestWaitTime() const;
+            double getSendWaitTime() const;
         private:
             // These utilities are virtual so that the user can override them
             // to parse argc/argv differently than we do.
             //
             virtual const char* getInputFile(int argc, char** argv) const;
             virtual unsigned getBlockSize(int argc, char** argv) const;
+            virtual CDataReader* createReader(
+                const char* pFilename, unsigned blockSize
+            ) const;
+            virtual unsigned getMaxOutstandingSends(int argc, char** argv) const;
+            virtual std::string getIndexFile(int argc, char** argv) const;
+            virtual void reportStatistics(
+                double ioSeconds, double requestSeconds
+            ) const;
             
             void sendData();
             
-            unsigned countTriggers(const void* pData, size_t numItems) const;
-            void sendWorkItem(const void* pData, size_t nBytes, unsigned blockNum);
-            int getRequest();
+            unsigned countTriggers(const void* pData, size_t nBytes) const;
+            uint64_t seekFirstTrigger();
+            bool selectTriggers(
+                const uint8_t*& pData, size_t& nBytes,
+                uint64_t& firstTrigger
+            );
+            size_t skipTriggers(
+                const void* pData, size_t nBytes, uint64_t& trigger,
+                uint64_t until
+            ) const;
+            void sendWorkItems(
+                const void* pData, size_t nBytes, uint64_t& firstTrigger
+            );
+            void sendWorkItem(
+                int dest, const void* pData, size_t nBytes, uint64_t blockNum
+            );
+            int getRequest(FRIB_MPI_Request_Data& request);
+            size_t freeSlot();
+            void reapSends();
+            void waitSends();
+            bool slotBusy(size_t slot) const;
         };
     }
 }
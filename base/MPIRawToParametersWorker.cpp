@@ -22,7 +22,13 @@
 #include "AnalysisRingItems.h"
 #include "AbstractApplication.h"
 #include "TreeParameter.h"
-#include <mpi.h>
+#include "ParameterBatch.h"
+#include "ParameterCompressor.h"
+#include "ParameterPacker.h"
+#include "MPIWorkItemPrefetcher.h"
+#include "Transport.h"
+#include "ThreadPool.h"
+#include <atomic>
 #include <memory>
 #include <stdexcept>
 #include <string>
@@ -31,38 +37,98 @@
 namespace frib {
     namespace analysis {
         const std::uint32_t PHYSICS_EVENT=30;
+        static const unsigned CHUNKS_PER_THREAD=4;  // Granularity for load balance.
         /**
          * Constructor
          *    @param App - referencees the application
          */
         CMPIRawToParametersWorker::CMPIRawToParametersWorker(
             AbstractApplication& App
-        ) : m_App(App), m_pParameterBuffer(nullptr), m_paramBufferSize(0)
+        ) : m_App(App), m_pBatch(nullptr), m_pCompressor(nullptr),
+            m_pPacker(nullptr), m_pPool(nullptr), m_batchEvents(0), m_batchBytes(0),
+            m_compressionLevel(0)
         {
             
         }
         
         /** Destructor
-         *    Kill off the parameter bufer:
+         *    Kill off the parameter batch, compressor, packer and the thread
+         *    pool if we still have them (e.g. processing threw):
          */
         CMPIRawToParametersWorker::~CMPIRawToParametersWorker() {
-            delete []m_pParameterBuffer;
+            delete m_pBatch;
+            delete m_pCompressor;
+            delete m_pPacker;
+            destroyPool();
         }
         
         /**
          * operator()
          *    The entry point for the application object.
          *    - Initialize the user code.
+         *    - Create the batch that accumulates events for the farmer.
          *    - Until we get an end header, request data/get data
+         *      (via a prefetcher unless that's turned off).
          *    -   Process the data block.
          *    
          * @param argc,argv - the program parameters.
          */
         void
         CMPIRawToParametersWorker::operator()(int argc, char** argv) {
-            int status = MPI_Comm_rank(MPI_COMM_WORLD, &m_rank);
-            throwMPIError(status, "Unable to obtain worker rank: ");
+            CTreeParameter::setContext(&m_context);
+            try {
+                processWorkItems(argc, argv);
+            }
+            catch (...) {
+                CTreeParameter::setContext(nullptr);
+                throw;
+            }
+            CTreeParameter::setContext(nullptr);
+        }
+        /**
+         * processWorkItems
+         *    Does the work of operator() with our tree parameter context set.
+         * @param argc,argv - the program parameters.
+         */
+        void
+        CMPIRawToParametersWorker::processWorkItems(int argc, char** argv) {
+            m_rank = m_App.transport().rank();
             initializeUserCode(argc, argv, m_App);
+            delete m_pBatch;
+            m_pBatch = nullptr;
+            m_batchEvents = getBatchEvents(argc, argv);
+            m_batchBytes  = getBatchBytes(argc, argv);
+            m_pBatch = new CParameterBatch(m_batchEvents, m_batchBytes);
+            delete m_pCompressor;
+            m_pCompressor = nullptr;
+            m_compressionLevel = getCompressionLevel(argc, argv);
+            if (m_compressionLevel) {
+                m_pCompressor = new CParameterCompressor(m_compressionLevel);
+            }
+            delete m_pPacker;
+            m_pPacker = nullptr;
+            m_storageTypes = CTreeParameter::getStorageTypes();
+            if (CParameterPacker::packs(m_storageTypes)) {
+                m_pPacker = new CParameterPacker(m_storageTypes);
+            }
+            destroyPool();
+            unsigned nThreads = getThreadCount(argc, argv);
+            if (nThreads > 1) {
+                createPool(nThreads);
+            }
+            unsigned credits = getPrefetchCredits(argc, argv);
+            if (credits) {
+                CMPIWorkItemPrefetcher prefetcher(
+                    m_App, credits, getPrefetchBufferSize(argc, argv)
+                );
+                FRIB_MPI_Message_Header header;
+                while (const void* pData = prefetcher.next(header)) {
+                    processDataBlock(pData, header.s_nBytes, header.s_nBlockNum);
+                }
+                sendEnd();
+                destroyPool();
+                return;
+            }
             std::unique_ptr<std::uint8_t> pData;
             size_t                         bytesReserved(0);
             while (1) {
@@ -88,10 +154,11 @@ namespace frib {
                     break;
                 }
             }
+            destroyPool();
         }
         /**
          * requestData
-         *    Make a data request from rank 0 (the dealer). Error result in
+         *    Make a data request from the dealer. Error result in
          *    a runtime error.
          */
         void
@@ -100,17 +167,14 @@ namespace frib {
         }
         /**
          * getHeader
-         *    Read the data header from the rank 0 (dealer).
+         *    Read the data header from the dealer.
          * @param header - references where to put the data.
          */
         void
         CMPIRawToParametersWorker::getHeader(FRIB_MPI_Message_Header&  header) {
-            MPI_Status info;
-            int status = MPI_Recv(
-                &header, 1, m_App.messageHeaderType(),
-                0, MPI_HEADER_TAG, MPI_COMM_WORLD, &info
+            m_App.transport().recv(
+                &header, 1, CTransport::MESSAGE_HEADER, DEALER_RANK, MPI_HEADER_TAG
             );
-            throwMPIError(status, "Unable to read data header: ");
         }
         /**
          * getData
@@ -120,11 +184,9 @@ namespace frib {
          */
         void
         CMPIRawToParametersWorker::getData(void* pData, size_t nBytes) {
-            MPI_Status s;
-            int status = MPI_Recv(
-                pData, nBytes, MPI_UINT8_T, 0, MPI_DATA_TAG, MPI_COMM_WORLD, &s
+            m_App.transport().recv(
+                pData, nBytes, CTransport::BYTES, DEALER_RANK, MPI_DATA_TAG
             );
-            throwMPIError(status, "Unable to receive data block from dealer: ");
         }
         /**
          * forwardPassthrough
@@ -142,74 +204,70 @@ namespace frib {
         }
         /**
          * sendParameters
-         *    Sends a parameters data block to the farmer (rank 1).
-         * @param event - the event represented as pairs of parmeter id/values.
+         *    Adds the tree parameters set this event to the batch destined
+         *    for the farmer.  They are marshalled directly into the batch.
+         *    If that fills the batch it's sent.
          * @param trigger - thrigger number to associated with the event.
          */
         void
-        CMPIRawToParametersWorker::sendParameters(
-            const std::vector<std::pair<unsigned, double>>& event,
-            std::uint64_t trigger
-        ) {
-            
-            // See if we need to expand the parameter buffer:
-            
-            if (event.size() > m_paramBufferSize) {
-                delete m_pParameterBuffer;
-                m_pParameterBuffer = new FRIB_MPI_Parameter_Value[event.size()];
-                m_paramBufferSize= event.size();
+        CMPIRawToParametersWorker::sendParameters(std::uint64_t trigger) {
+            CTreeParameter::collectEvent(
+                m_pBatch->allocateEvent(trigger, CTreeParameter::eventSize())
+            );
+            if (m_pBatch->full()) {
+                sendBatch();
             }
-            // Marshall the data into the parameter buffer:
-            
-            auto p = m_pParameterBuffer;
-            for (auto& item: event) {
-                p->s_number = item.first;
-                p->s_value = item.second;
-                p++;
+        }
+        /**
+         * sendBatch
+         *    Sends the events accumulated in the batch to the farmer in a
+         *    single message and empties the batch.  Nothing is sent if
+         *    the batch is empty.  If we're packing and/or compressing, the
+         *    batch's packed items/compressed frames are sent instead.
+         */
+        void
+        CMPIRawToParametersWorker::sendBatch() {
+            if (!m_pBatch->empty()) {
+                const void* pData = m_pBatch->data();
+                size_t      nBytes = m_pBatch->size();
+                if (m_pPacker) {
+                    m_pPacker->clear();
+                    m_pPacker->add(pData, nBytes);
+                    pData  = m_pPacker->data();
+                    nBytes = m_pPacker->size();
+                }
+                if (m_pCompressor) {
+                    m_pCompressor->clear();
+                    m_pCompressor->add(pData, nBytes);
+                    pData  = m_pCompressor->data();
+                    nBytes = m_pCompressor->size();
+                }
+                m_App.transport().send(
+                    pData, nBytes, CTransport::BYTES,
+                    FARMER_RANK, MPI_PARAMETER_BATCH_TAG
+                );
+                m_pBatch->clear();
             }
-            
-            // Format and send the header:
-            
-            FRIB_MPI_Parameter_MessageHeader header;
-            header.s_triggerNumber = trigger;
-            header.s_numParameters = event.size();
-            header.s_end           = false;
-            
-            int status = MPI_Send(
-                &header, 1, m_App.parameterHeaderDataType(),
-                1, MPI_HEADER_TAG, MPI_COMM_WORLD
-            );
-            throwMPIError(status, "Failed to send parameter header: ");
-            
-            // Send the data:
-            
-            status = MPI_Send(
-                m_pParameterBuffer, event.size(), m_App.parameterValueDataType(),
-                1, MPI_DATA_TAG, MPI_COMM_WORLD
-            );
-            
-            throwMPIError(status, "Failed to send parameter data to farmer: ");
         }
         /**
          *  sendEnd
-         *     Send an end of data for us to the farmer (rank1).  Note that
+         *     Send an end of data for us to the farmer.  Note that
          *     the farmer will keep getting data until all worker ranks have
          *     sent ends.
          */
         void
         CMPIRawToParametersWorker::sendEnd()
         {
+            sendBatch();                 // Should be empty but just in case.
+            
             FRIB_MPI_Parameter_MessageHeader header;
             header.s_triggerNumber = 0;
             header.s_numParameters = 0;
             header.s_end           = true;
             
-            int status = MPI_Send(
-                &header, 1, m_App.parameterHeaderDataType(),
-                1, MPI_END_TAG, MPI_COMM_WORLD
+            m_App.transport().send(
+                &header, 1, CTransport::PARAMETER_HEADER, FARMER_RANK, MPI_END_TAG
             );
-            
-            throwMPIError(status, "Failed to send end flag to farme4r: ");
         }
         /**
          * processDataBLock
@@ -219,13 +277,14 @@ namespace frib {
          *    and does a forwardPassthrough on all non PHYSICS_EVENT items.
          *    for PHYSCIS_EVENT items:
          *     - unpackData is called with a pointer to the ring item.
-         *     - the resulting event is marshalled from the tree parameters.
-         *     - the marshalled event is sent to the farmer (rank 1).
+         *     - the resulting event is marshalled from the tree parameters
+         *       straight into the batch for the farmer.
          *     - The tree parameter subsystem is told to re-initialize for the next
          *        event.
-         *  @note - since MPI is process level parallelism, each worker has its own
-         *       independent set of tree parameters and all the nasties of
-         *       threaded SpecTcl are side-stepped.
+         *    Whatever is left in the batch is sent at the end of the block.
+         *  @note - each worker has its own tree parameter context so
+         *       workers can share a process (as threads) as long as the
+         *       tree parameters are defined before they start.
          *  @param pData - pointer to the data block.
          *  @param nBytes - number of bytes in the block.
          *  @param firstTrigger - trigger number to assign to the first physics item.
@@ -234,7 +293,11 @@ namespace frib {
         void
         CMPIRawToParametersWorker::processDataBlock(
             const void* pData, size_t nBytes, std::uint64_t firstTrigger
-        ) {            
+        ) {
+            if (m_pPool) {
+                processDataBlockThreaded(pData, nBytes, firstTrigger);
+                return;
+            }
             union {
                 const RingItemHeader* pH;
                 const std::uint8_t*   p8;
@@ -247,8 +310,7 @@ namespace frib {
                 if (p.pH->s_type == PHYSICS_EVENT) {
                 
                     unpackData(p.pH);
-                    auto event = CTreeParameter::collectEvent();
-                    sendParameters(event, firstTrigger);
+                    sendParameters(firstTrigger);
                     CTreeParameter::nextEvent();
                     firstTrigger++;
                     
@@ -263,6 +325,234 @@ namespace frib {
                 nBytes -= p.pH->s_size;
                 p.p8   += p.pH->s_size;
             }
+            sendBatch();
+        }
+        /**
+         * processDataBlockThreaded
+         *    processDataBlock when we have a thread pool.  The block is
+         *    split into chunks which the pool threads take in turn, each
+         *    unpacking into its own tree parameter context and its chunk's
+         *    batches.  Once all chunks are done, we send, in block order,
+         *    each chunk's passthrough items to the outputter and its batches
+         *    (or, if packing or compressing, its packed items/frames in a
+         *    single message) to the farmer.  Only this thread uses the
+         *    transport.
+         *
+         * @param pData - pointer to the data block.
+         * @param nBytes - number of bytes in the block.
+         * @param firstTrigger - trigger number to assign to the first physics item.
+         */
+        void
+        CMPIRawToParametersWorker::processDataBlockThreaded(
+            const void* pData, size_t nBytes, std::uint64_t firstTrigger
+        ) {
+            splitBlock(pData, nBytes, firstTrigger);
+            
+            std::atomic<size_t> nextChunk(0);
+            m_pPool->run([this, &nextChunk](unsigned thread) {
+                if (thread) {
+                    CTreeParameter::setContext(m_threadContexts[thread]);
+                }
+                try {
+                    size_t i;
+                    while ((i = nextChunk.fetch_add(1)) < m_chunks.size()) {
+                        processChunk(m_chunks[i]);
+                    }
+                }
+                catch (...) {
+                    if (thread) CTreeParameter::setContext(nullptr);
+                    throw;
+                }
+                if (thread) {
+                    CTreeParameter::setContext(nullptr);
+                }
+            });
+            
+            for (auto& chunk : m_chunks) {
+                for (auto pItem : chunk.s_passthroughs) {
+                    forwardPassthrough(
+                        pItem, reinterpret_cast<const RingItemHeader*>(pItem)->s_size
+                    );
+                }
+                if (chunk.s_pCompressor) {
+                    if (!chunk.s_pCompressor->empty()) {
+                        m_App.transport().send(
+                            chunk.s_pCompressor->data(), chunk.s_pCompressor->size(),
+                            CTransport::BYTES, FARMER_RANK, MPI_PARAMETER_BATCH_TAG
+                        );
+                    }
+                    continue;
+                }
+                if (chunk.s_pPacker) {
+                    if (!chunk.s_pPacker->empty()) {
+                        m_App.transport().send(
+                            chunk.s_pPacker->data(), chunk.s_pPacker->size(),
+                            CTransport::BYTES, FARMER_RANK, MPI_PARAMETER_BATCH_TAG
+                        );
+                    }
+                    continue;
+                }
+                for (size_t i = 0; i < chunk.s_nBatches; i++) {
+                    CParameterBatch* pBatch = chunk.s_batches[i];
+                    if (!pBatch->empty()) {
+                        m_App.transport().send(
+                            pBatch->data(), pBatch->size(), CTransport::BYTES,
+                            FARMER_RANK, MPI_PARAMETER_BATCH_TAG
+                        );
+                    }
+                }
+            }
+        }
+        /**
+         * splitBlock
+         *    Divides a data block into about the same number of bytes for each
+         *    chunk, splitting only at ring item boundaries.  The number of
+         *    physics items ahead of each chunk gives its first trigger number.
+         *    Chunks we don't need for a small block are left empty.
+         *
+         * @param pData - pointer to the data block.
+         * @param nBytes - number of bytes in the block.
+         * @param firstTrigger - trigger number of the first physics item.
+         */
+        void
+        CMPIRawToParametersWorker::splitBlock(
+            const void* pData, size_t nBytes, std::uint64_t firstTrigger
+        ) {
+            size_t target = (nBytes + m_chunks.size() - 1)/m_chunks.size();
+            const std::uint8_t* p8 = reinterpret_cast<const std::uint8_t*>(pData);
+            
+            for (auto& chunk : m_chunks) {
+                chunk.s_pData        = p8;
+                chunk.s_nBytes       = 0;
+                chunk.s_firstTrigger = firstTrigger;
+                while (nBytes && (chunk.s_nBytes < target)) {
+                    const RingItemHeader* pH =
+                        reinterpret_cast<const RingItemHeader*>(p8);
+                    if (pH->s_type == PHYSICS_EVENT) {
+                        firstTrigger++;
+                    }
+                    chunk.s_nBytes += pH->s_size;
+                    nBytes         -= pH->s_size;
+                    p8             += pH->s_size;
+                }
+            }
+        }
+        /**
+         * processChunk
+         *    Unpacks the physics items of a chunk into the calling thread's
+         *    tree parameter context, accumulating the events in the chunk's
+         *    batches.  Passthrough items are just remembered so they can be
+         *    sent once the block is done.  If we're packing and/or
+         *    compressing, the batches are packed/compressed here too so
+         *    that's done in parallel as well.
+         *
+         * @param chunk - the chunk to process.
+         */
+        void
+        CMPIRawToParametersWorker::processChunk(Chunk& chunk) {
+            chunk.s_passthroughs.clear();
+            chunk.s_nBatches = 0;
+            
+            std::uint64_t trigger = chunk.s_firstTrigger;
+            const std::uint8_t* p8 = reinterpret_cast<const std::uint8_t*>(chunk.s_pData);
+            size_t nBytes = chunk.s_nBytes;
+            CParameterBatch* pBatch(nullptr);
+            
+            while (nBytes) {
+                const RingItemHeader* pH = reinterpret_cast<const RingItemHeader*>(p8);
+                if (pH->s_type == PHYSICS_EVENT) {
+                    unpackData(pH);
+                    if (!pBatch || pBatch->full()) {
+                        if (chunk.s_nBatches == chunk.s_batches.size()) {
+                            chunk.s_batches.push_back(
+                                new CParameterBatch(m_batchEvents, m_batchBytes)
+                            );
+                        }
+                        pBatch = chunk.s_batches[chunk.s_nBatches++];
+                        pBatch->clear();
+                    }
+                    CTreeParameter::collectEvent(
+                        pBatch->allocateEvent(trigger, CTreeParameter::eventSize())
+                    );
+                    CTreeParameter::nextEvent();
+                    trigger++;
+                } else {
+                    chunk.s_passthroughs.push_back(p8);
+                }
+                nBytes -= pH->s_size;
+                p8     += pH->s_size;
+            }
+            if (chunk.s_pPacker) {
+                chunk.s_pPacker->clear();
+                for (size_t i = 0; i < chunk.s_nBatches; i++) {
+                    chunk.s_pPacker->add(
+                        chunk.s_batches[i]->data(), chunk.s_batches[i]->size()
+                    );
+                }
+            }
+            if (chunk.s_pCompressor) {
+                chunk.s_pCompressor->clear();
+                if (chunk.s_pPacker) {
+                    chunk.s_pCompressor->add(
+                        chunk.s_pPacker->data(), chunk.s_pPacker->size()
+                    );
+                } else {
+                    for (size_t i = 0; i < chunk.s_nBatches; i++) {
+                        chunk.s_pCompressor->add(
+                            chunk.s_batches[i]->data(), chunk.s_batches[i]->size()
+                        );
+                    }
+                }
+            }
+        }
+        /**
+         * createPool
+         *    Creates the thread pool, the tree parameter contexts of its
+         *    threads and the chunks blocks are divided into (with their own
+         *    compressors and packers if we're compressing/packing).
+         *    Thread 0 is the rank's own thread so it uses m_context.
+         *
+         * @param nThreads - number of threads.
+         */
+        void
+        CMPIRawToParametersWorker::createPool(unsigned nThreads) {
+            m_pPool = new CThreadPool(nThreads);
+            m_threadContexts.push_back(&m_context);
+            for (unsigned i = 1; i < nThreads; i++) {
+                m_threadContexts.push_back(new CTreeParameterContext);
+            }
+            m_chunks.resize(nThreads * CHUNKS_PER_THREAD);
+            for (auto& chunk : m_chunks) {
+                chunk.s_pData        = nullptr;
+                chunk.s_nBytes       = 0;
+                chunk.s_firstTrigger = 0;
+                chunk.s_nBatches     = 0;
+                chunk.s_pCompressor  = m_compressionLevel ?
+                    new CParameterCompressor(m_compressionLevel) : nullptr;
+                chunk.s_pPacker      = m_pPacker ?
+                    new CParameterPacker(m_storageTypes) : nullptr;
+            }
+        }
+        /**
+         * destroyPool
+         *    Undoes createPool.  Harmless if there's no pool.
+         */
+        void
+        CMPIRawToParametersWorker::destroyPool() {
+            delete m_pPool;
+            m_pPool = nullptr;
+            for (size_t i = 1; i < m_threadContexts.size(); i++) {
+                delete m_threadContexts[i];
+            }
+            m_threadContexts.clear();
+            for (auto& chunk : m_chunks) {
+                for (auto pBatch : chunk.s_batches) {
+                    delete pBatch;
+                }
+                delete chunk.s_pCompressor;
+                delete chunk.s_pPacker;
+            }
+            m_chunks.clear();
         }
         /**
          * throwMPIError
@@ -277,6 +567,85 @@ namespace frib {
         CMPIRawToParametersWorker::throwMPIError(int status, const char* prefix) {
             m_App.throwMPIError(status, prefix);
         }
+        /**
+         * getBatchEvents
+         *    Returns the maximum number of events sent to the farmer in a
+         *    single message.  This is virtual so it can be overridden.  The
+         *    default is CParameterBatch::DEFAULT_MAX_EVENTS.
+         * @param argc, argv - the command line parameters.
+         * @return size_t
+         */
+        size_t
+        CMPIRawToParametersWorker::getBatchEvents(int argc, char** argv) {
+            return CParameterBatch::DEFAULT_MAX_EVENTS;
+        }
+        /**
+         * getBatchBytes
+         *    Returns the number of bytes at which a batch of events is sent
+         *    to the farmer.  This is virtual so it can be overridden.  The
+         *    default is CParameterBatch::DEFAULT_MAX_BYTES.
+         * @param argc, argv - the command line parameters.
+         * @return size_t
+         */
+        size_t
+        CMPIRawToParametersWorker::getBatchBytes(int argc, char** argv) {
+            return CParameterBatch::DEFAULT_MAX_BYTES;
+        }
+        /**
+         * getPrefetchCredits
+         *    Returns the number of work item requests kept outstanding with
+         *    the dealer.  This is virtual so it can be overridden.  The
+         *    default is CMPIWorkItemPrefetcher::DEFAULT_CREDITS.  Returning 0
+         *    requests each work item only when the previous one is done.
+         * @param argc, argv - the command line parameters.
+         * @return unsigned
+         */
+        unsigned
+        CMPIRawToParametersWorker::getPrefetchCredits(int argc, char** argv) {
+            return CMPIWorkItemPrefetcher::DEFAULT_CREDITS;
+        }
+        /**
+         * getPrefetchBufferSize
+         *    Returns the size of each prefetch buffer - the largest work
+         *    item the dealer will send us.  This is virtual so it can be
+         *    overridden.  The default is
+         *    CMPIWorkItemPrefetcher::DEFAULT_BUFFER_SIZE.
+         * @param argc, argv - the command line parameters.
+         * @return size_t
+         */
+        size_t
+        CMPIRawToParametersWorker::getPrefetchBufferSize(int argc, char** argv) {
+            return CMPIWorkItemPrefetcher::DEFAULT_BUFFER_SIZE;
+        }
+        /**
+         * getThreadCount
+         *    Returns the number of threads that unpack each data block.
+         *    This is virtual so it can be overridden.  The default, 1,
+         *    unpacks in the rank's own thread.  If more than 1 is returned,
+         *    unpackData is called concurrently from that many threads, each
+         *    with its own tree parameter context, so it must not modify
+         *    shared state without synchronization.
+         * @param argc, argv - the command line parameters.
+         * @return unsigned
+         */
+        unsigned
+        CMPIRawToParametersWorker::getThreadCount(int argc, char** argv) {
+            return 1;
+        }
+        /**
+         * getCompressionLevel
+         *    Returns the zlib level (1-9) with which parameter batches are
+         *    compressed before being sent to the farmer.  This is virtual so
+         *    it can be overridden.  The default, 0, sends them uncompressed.
+         *    Compressed frames end up in the output file as is;
+         *    CInflatingDataReader reads them back.
+         * @param argc, argv - the command line parameters.
+         * @return int
+         */
+        int
+        CMPIRawToParametersWorker::getCompressionLevel(int argc, char** argv) {
+            return 0;
+        }
         
         
     }
@@ -23,15 +23,18 @@
 #include <stddef.h>
 #include <vector>
 #include <cstdint>
+#include "TreeParameterContext.h"
 
 
 namespace frib {
     namespace analysis {
         class AbstractApplication;
+        class CParameterBatch;
+        class CParameterCompressor;
+        class CParameterPacker;
+        class CThreadPool;
         struct _FRIB_MPI_Message_Header;
         typedef struct _FRIB_MPI_Message_Header FRIB_MPI_Message_Header;
-        struct _FRIB_MPI_Parameter_Value;
-        typedef struct _FRIB_MPI_Parameter_Value FRIB_MPI_Parameter_Value;
         /**
          * @class CMPIRawToParametersWorker
          *    This is an abstract base class for a worker that maps raw
@@ -60,15 +63,64 @@ namespace frib {
          *    @note unpack data will only get PHYSICS_EVENT ring items.
          *          all other ring item types are treated as passthrough items
          *          and sent directly, as such, to the outputter.
+         *    @note events are not sent to the farmer one by one.  They are
+         *          accumulated in a CParameterBatch that is sent when it is
+         *          full and at the end of each block of data from the dealer.
+         *          Override getBatchEvents and getBatchBytes to tune this.
+         *    @note by default work items are prefetched (see
+         *          CMPIWorkItemPrefetcher) so the next one is usually here by
+         *          the time the current one is processed.  Override
+         *          getPrefetchCredits (0 turns prefetching off) and
+         *          getPrefetchBufferSize to tune this.
+         *    @note a worker rank can unpack each block with several threads.
+         *          Override getThreadCount to return more than 1 to do that.
+         *          The block is split at ring item boundaries into chunks
+         *          that the threads of a CThreadPool take in turn; each
+         *          thread unpacks into its own tree parameter context and
+         *          numbers triggers from its chunk's offset in the block.
+         *          Results are sent in block order by the rank's own thread.
+         *          unpackData must then be safe to call concurrently.
+         *    @note override getCompressionLevel to have batches compressed
+         *          (see CParameterCompressor) before they're sent.  With a
+         *          thread pool each chunk is compressed by the thread that
+         *          unpacked it.
+         *    @note if any tree parameter has a storage type other than
+         *          double (CTreeParameter::setStorage) batches are packed
+         *          (see CParameterPacker) before they're sent (and before
+         *          they're compressed).  This is also done by the pool
+         *          threads.
          *    @note implementers that are porting SpecTcl code should look at
          *       MPISpecTclWorker which tries to allow users to re-use SpecTcl
          *         event processor code as much as possible.
          */
         class CMPIRawToParametersWorker {
+        private:
+            // A piece of a data block unpacked by one of the pool threads.
+            
+            struct Chunk {
+                const void*      s_pData;
+                size_t           s_nBytes;
+                std::uint64_t    s_firstTrigger;
+                std::vector<CParameterBatch*> s_batches;  // Reused block to block.
+                size_t           s_nBatches;              // Number in use.
+                std::vector<const void*> s_passthroughs;
+                CParameterCompressor* s_pCompressor;      // nullptr if not compressing.
+                CParameterPacker*     s_pPacker;          // nullptr if not packing.
+            };
+            
             AbstractApplication& m_App;
             int          m_rank;
-            FRIB_MPI_Parameter_Value* m_pParameterBuffer;
-            size_t       m_paramBufferSize;
+            CParameterBatch* m_pBatch;
+            CParameterCompressor* m_pCompressor;      // nullptr if not compressing.
+            CParameterPacker*    m_pPacker;           // nullptr if not packing.
+            CTreeParameterContext m_context;
+            CThreadPool*         m_pPool;
+            std::vector<CTreeParameterContext*> m_threadContexts; // [0] is m_context.
+            std::vector<Chunk>   m_chunks;
+            size_t               m_batchEvents;
+            size_t               m_batchBytes;
+            int                  m_compressionLevel;
+            std::vector<std::uint32_t> m_storageTypes;
         public:
             CMPIRawToParametersWorker(AbstractApplication& App);
             virtual ~CMPIRawToParametersWorker();
@@ -77,14 +129,28 @@ namespace frib {
                 int argc, char** argv, AbstractApplication& pApp
             ) {}
             virtual void unpackData(const void* pData) = 0;
+        protected:
+            virtual size_t getBatchEvents(int argc, char** argv);
+            virtual size_t getBatchBytes(int argc, char** argv);
+            virtual unsigned getPrefetchCredits(int argc, char** argv);
+            virtual size_t getPrefetchBufferSize(int argc, char** argv);
+            virtual unsigned getThreadCount(int argc, char** argv);
+            virtual int getCompressionLevel(int argc, char** argv);
         private:
+            void processWorkItems(int argc, char** argv);
             void requestData();
             void getHeader(FRIB_MPI_Message_Header& header);
             void getData(void* pData, size_t nBytes);
             void forwardPassthrough(const void* pData, size_t nBytes);
-            void sendParameters(const std::vector<std::pair<unsigned, double>>& event, std::uint64_t trigger);
+            void sendParameters(std::uint64_t trigger);
+            void sendBatch();
             void sendEnd();
             void processDataBlock(const void* pData, size_t nBytes, std::uint64_t firstTrigger);
+            void processDataBlockThreaded(const void* pData, size_t nBytes, std::uint64_t firstTrigger);
+            void splitBlock(const void* pData, size_t nBytes, std::uint64_t firstTrigger);
+            void processChunk(Chunk& chunk);
+            void createPool(unsigned nThreads);
+            void destroyPool();
             void throwMPIError(int status, const char* prefix);
         };
         
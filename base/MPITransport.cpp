@@ -0,0 +1,421 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+
+/** @file:  MPITransport.cpp
+ *  @brief: Implement the CMPITransport class.
+ */
+#include "MPITransport.h"
+#include "AbstractApplication.h"
+#include "AnalysisRingItems.h"
+#include <stdexcept>
+
+namespace frib {
+    namespace analysis {
+        /**
+         * constructor
+         *   Making the dealer/worker communicator is collective so all
+         *   ranks must construct their transports.
+         *   @param app - the application; has the MPI data types and error
+         *                reporting.
+         */
+        CMPITransport::CMPITransport(AbstractApplication& app) :
+            m_App(app), m_rank(0), m_nRanks(0), m_dealWorkers(MPI_COMM_NULL)
+        {
+            int status = MPI_Comm_rank(MPI_COMM_WORLD, &m_rank);
+            m_App.throwMPIError(status, "CMPITransport unable to get rank: ");
+            int size;
+            status = MPI_Comm_size(MPI_COMM_WORLD, &size);
+            m_App.throwMPIError(status, "CMPITransport unable to get size: ");
+            m_nRanks = size;
+            
+            // Rank order is kept so the dealer is rank 0 in m_dealWorkers.
+            
+            bool member = (m_rank == DEALER_RANK) || (m_rank >= FIRST_WORKER_RANK);
+            status = MPI_Comm_split(
+                MPI_COMM_WORLD, member ? 0 : MPI_UNDEFINED, m_rank, &m_dealWorkers
+            );
+            m_App.throwMPIError(
+                status, "CMPITransport unable to make dealer/worker communicator: "
+            );
+        }
+        /**
+         * destructor
+         *    Outstanding requests are just forgotten.  This must run
+         *    before MPI_Finalize.
+         */
+        CMPITransport::~CMPITransport() {
+            if (m_dealWorkers != MPI_COMM_NULL) {
+                MPI_Comm_free(&m_dealWorkers);
+            }
+        }
+        
+        /**
+         * rank
+         *   @return int - our rank in MPI_COMM_WORLD.
+         */
+        int
+        CMPITransport::rank() const {
+            return m_rank;
+        }
+        /**
+         * size
+         *   @return unsigned - number of ranks in MPI_COMM_WORLD.
+         */
+        unsigned
+        CMPITransport::size() const {
+            return m_nRanks;
+        }
+        /**
+         * send
+         *    MPI_Send.
+         * @param pData - the data.
+         * @param count - number of items of type.
+         * @param type  - data type.
+         * @param dest  - destination rank.
+         * @param tag   - message tag.
+         */
+        void
+        CMPITransport::send(
+            const void* pData, std::size_t count, DataType type, int dest, int tag
+        ) {
+            int status = MPI_Send(
+                pData, count, mpiType(type), dest, tag, MPI_COMM_WORLD
+            );
+            m_App.throwMPIError(status, "CMPITransport::send failed: ");
+        }
+        /**
+         * recv
+         *    MPI_Recv.
+         * @param pData - receive buffer.
+         * @param count - maximum number of items of type in pData.
+         * @param type  - data type.
+         * @param source - source rank or ANY_SOURCE.
+         * @param tag    - tag or ANY_TAG.
+         * @return Status - what was received.
+         */
+        CTransport::Status
+        CMPITransport::recv(
+            void* pData, std::size_t count, DataType type, int source, int tag
+        ) {
+            MPI_Status info;
+            int status = MPI_Recv(
+                pData, count, mpiType(type), mpiSource(source), mpiTag(tag),
+                MPI_COMM_WORLD, &info
+            );
+            m_App.throwMPIError(status, "CMPITransport::recv failed: ");
+            return makeStatus(info, type);
+        }
+        /**
+         * probe
+         *    MPI_Probe.
+         * @param source - source rank or ANY_SOURCE.
+         * @param tag    - tag or ANY_TAG.
+         * @return Status - describes the message.
+         */
+        CTransport::Status
+        CMPITransport::probe(int source, int tag) {
+            MPI_Status info;
+            int status = MPI_Probe(
+                mpiSource(source), mpiTag(tag), MPI_COMM_WORLD, &info
+            );
+            m_App.throwMPIError(status, "CMPITransport::probe failed: ");
+            return makeStatus(info, BYTES);
+        }
+        /**
+         * isend
+         *    MPI_Isend.
+         * @param pData, count, type, dest, tag - see send.
+         * @return Request - the request.
+         * @note pData must remain valid until the request completes.
+         */
+        CTransport::Request
+        CMPITransport::isend(
+            const void* pData, std::size_t count, DataType type, int dest, int tag
+        ) {
+            Request result = allocateOperation(type);
+            int status = MPI_Isend(
+                pData, count, mpiType(type), dest, tag, MPI_COMM_WORLD,
+                &operation(result).s_request
+            );
+            if (status != MPI_SUCCESS) {
+                freeOperation(result);
+            }
+            m_App.throwMPIError(status, "CMPITransport::isend failed: ");
+            return result;
+        }
+        /**
+         * irecv
+         *    MPI_Irecv.
+         * @param pData, count, type, source, tag - see recv.
+         * @return Request - the request.
+         * @note pData must remain valid until the request completes.
+         */
+        CTransport::Request
+        CMPITransport::irecv(
+            void* pData, std::size_t count, DataType type, int source, int tag
+        ) {
+            Request result = allocateOperation(type);
+            int status = MPI_Irecv(
+                pData, count, mpiType(type), mpiSource(source), mpiTag(tag),
+                MPI_COMM_WORLD, &operation(result).s_request
+            );
+            if (status != MPI_SUCCESS) {
+                freeOperation(result);
+            }
+            m_App.throwMPIError(status, "CMPITransport::irecv failed: ");
+            return result;
+        }
+        /**
+         * wait
+         *    MPI_Wait.
+         * @param[inout] request - the request; NULL_REQUEST on return.
+         * @return Status - status of the completed operation.
+         */
+        CTransport::Status
+        CMPITransport::wait(Request& request) {
+            Status result = {ANY_SOURCE, ANY_TAG, 0};
+            if (request == NULL_REQUEST) {
+                return result;
+            }
+            Operation& op(operation(request));
+            MPI_Status info;
+            int status = MPI_Wait(&op.s_request, &info);
+            DataType type = op.s_type;
+            freeOperation(request);
+            m_App.throwMPIError(status, "CMPITransport::wait failed: ");
+            return makeStatus(info, type);
+        }
+        /**
+         * test
+         *    MPI_Test.
+         * @param[inout] request - the request; NULL_REQUEST if it completed.
+         * @return bool - true if the request is complete.
+         */
+        bool
+        CMPITransport::test(Request& request) {
+            if (request == NULL_REQUEST) {
+                return true;
+            }
+            int flag;
+            int status = MPI_Test(
+                &operation(request).s_request, &flag, MPI_STATUS_IGNORE
+            );
+            m_App.throwMPIError(status, "CMPITransport::test failed: ");
+            if (flag) {
+                freeOperation(request);
+            }
+            return flag;
+        }
+        /**
+         * cancel
+         *    MPI_Cancel and then MPI_Wait for the cancellation.
+         * @param[inout] request - the request; NULL_REQUEST on return.
+         */
+        void
+        CMPITransport::cancel(Request& request) {
+            if (request == NULL_REQUEST) {
+                return;
+            }
+            Operation& op(operation(request));
+            int status = MPI_Cancel(&op.s_request);
+            if (status == MPI_SUCCESS) {
+                status = MPI_Wait(&op.s_request, MPI_STATUS_IGNORE);
+            }
+            freeOperation(request);
+            m_App.throwMPIError(status, "CMPITransport::cancel failed: ");
+        }
+        ///////////////////////////////////////////////////////////////////////
+        // Private utilities.
+        
+        /**
+         * broadcast
+         *    From the dealer to the workers, this is an MPI_Bcast which
+         *    takes log(workers) steps rather than one send per worker.
+         *    Otherwise, CTransport::broadcast.
+         * @param pData - the data.
+         * @param count - number of items of type in pData.
+         * @param type  - data type.
+         * @param firstRank - first rank to send to.
+         * @param tag   - message tag (only used for point to point).
+         */
+        void
+        CMPITransport::broadcast(
+            const void* pData, std::size_t count, DataType type,
+            int firstRank, int tag
+        ) {
+            if (isCollective(m_rank, firstRank)) {
+                int status = MPI_Bcast(
+                    const_cast<void*>(pData), count, mpiType(type), 0,
+                    m_dealWorkers
+                );
+                m_App.throwMPIError(status, "CMPITransport::broadcast failed: ");
+            } else {
+                CTransport::broadcast(pData, count, type, firstRank, tag);
+            }
+        }
+        /**
+         * receiveBroadcast
+         *    The receiving side of broadcast.
+         * @param pData - where the data go.
+         * @param count - number of items of type broadcast.
+         * @param type  - data type.
+         * @param root  - rank that made the broadcast.
+         * @param firstRank - firstRank of the broadcast.
+         * @param tag   - message tag (only used for point to point).
+         * @return Status - status of the receive.
+         */
+        CTransport::Status
+        CMPITransport::receiveBroadcast(
+            void* pData, std::size_t count, DataType type,
+            int root, int firstRank, int tag
+        ) {
+            if (isCollective(root, firstRank)) {
+                int status = MPI_Bcast(pData, count, mpiType(type), 0, m_dealWorkers);
+                m_App.throwMPIError(
+                    status, "CMPITransport::receiveBroadcast failed: "
+                );
+                Status result = {root, tag, count * typeSize(type)};
+                return result;
+            }
+            return CTransport::receiveBroadcast(
+                pData, count, type, root, firstRank, tag
+            );
+        }
+        /**
+         * isCollective
+         *   @param root - rank making a broadcast.
+         *   @param firstRank - first rank it's sent to.
+         *   @return bool - true if it's from the dealer to all workers so it
+         *                  goes through m_dealWorkers.
+         */
+        bool
+        CMPITransport::isCollective(int root, int firstRank) {
+            return (root == DEALER_RANK) && (firstRank == FIRST_WORKER_RANK);
+        }
+        /**
+         * mpiType
+         *   @param type - a data type.
+         *   @return MPI_Datatype - the corresponding MPI data type.
+         */
+        MPI_Datatype
+        CMPITransport::mpiType(DataType type) {
+            switch (type) {
+            case BYTES:
+                return MPI_UINT8_T;
+            case UINT32:
+                return MPI_UINT32_T;
+            case MESSAGE_HEADER:
+                return m_App.messageHeaderType();
+            case REQUEST_DATA:
+                return m_App.requestDataType();
+            case PARAMETER_HEADER:
+                return m_App.parameterHeaderDataType();
+            case PARAMETER_VALUE:
+                return m_App.parameterValueDataType();
+            case PARAMETER_DEF:
+                return m_App.parameterDefType();
+            case VARIABLE_DEF:
+                return m_App.variableDefType();
+            default:
+                throw std::invalid_argument("CMPITransport - invalid data type");
+            }
+        }
+        /**
+         * mpiSource
+         *   @param source - a source rank or ANY_SOURCE.
+         *   @return int - the MPI equivalent.
+         */
+        int
+        CMPITransport::mpiSource(int source) {
+            return source == ANY_SOURCE ? MPI_ANY_SOURCE : source;
+        }
+        /**
+         * mpiTag
+         *   @param tag - a tag or ANY_TAG.
+         *   @return int - the MPI equivalent.
+         */
+        int
+        CMPITransport::mpiTag(int tag) {
+            return tag == ANY_TAG ? MPI_ANY_TAG : tag;
+        }
+        /**
+         * makeStatus
+         *    Translate an MPI status.
+         * @param status - MPI status of a completed receive or probe.
+         * @param type   - data type received.
+         * @return Status - our status.
+         */
+        CTransport::Status
+        CMPITransport::makeStatus(MPI_Status& status, DataType type) {
+            Status result;
+            result.s_source = status.MPI_SOURCE;
+            result.s_tag    = status.MPI_TAG;
+            int count;
+            int stat = MPI_Get_count(&status, mpiType(type), &count);
+            m_App.throwMPIError(stat, "CMPITransport unable to get message size: ");
+            result.s_nBytes = count == MPI_UNDEFINED ? 0 : count * typeSize(type);
+            return result;
+        }
+        /**
+         * allocateOperation
+         *   @param type - data type of the operation.
+         *   @return Request - index of an unused entry in m_operations.
+         */
+        CTransport::Request
+        CMPITransport::allocateOperation(DataType type) {
+            Request result;
+            for (result = 0; result < Request(m_operations.size()); result++) {
+                if (!m_operations[result].s_inUse) break;
+            }
+            if (result == Request(m_operations.size())) {
+                m_operations.push_back(Operation());
+            }
+            Operation& op(m_operations[result]);
+            op.s_request = MPI_REQUEST_NULL;
+            op.s_type    = type;
+            op.s_inUse   = true;
+            return result;
+        }
+        /**
+         * freeOperation
+         *   @param[inout] request - request whose operation is no longer
+         *                 needed; set to NULL_REQUEST.
+         */
+        void
+        CMPITransport::freeOperation(Request& request) {
+            operation(request).s_inUse = false;
+            request = NULL_REQUEST;
+        }
+        /**
+         * operation
+         *   @param request - a request.
+         *   @return Operation& - its operation.
+         *   @throw std::logic_error - the request is not in use.
+         */
+        CMPITransport::Operation&
+        CMPITransport::operation(Request request) {
+            if (
+                (request < 0) || (request >= Request(m_operations.size())) ||
+                !m_operations[request].s_inUse
+            ) {
+                throw std::logic_error("CMPITransport - invalid request");
+            }
+            return m_operations[request];
+        }
+    }
+}
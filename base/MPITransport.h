@@ -0,0 +1,113 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+
+/** @file:  MPITransport.h
+ *  @brief: Transport between the ranks of an MPI application.
+ */
+#ifndef MPITRANSPORT_H
+#define MPITRANSPORT_H
+#include "Transport.h"
+#include <mpi.h>
+#include <vector>
+
+namespace frib {
+    namespace analysis {
+        class AbstractApplication;
+        /**
+         * @class CMPITransport
+         *    Implements CTransport with MPI point to point messaging in
+         *    MPI_COMM_WORLD.  Data types other than BYTES and UINT32 use the
+         *    MPI data types the application made for our message structs.
+         *    MPI errors are turned into std::runtime_error exceptions.
+         *
+         *    Broadcasts from the dealer to all of the workers use MPI_Bcast
+         *    in a communicator made of just those ranks (the tag is not used).
+         *    Other broadcasts are sets of point to point messages.
+         *
+         *    MPI must be initialized and the application's data types made
+         *    before one of these is constructed.
+         */
+        class CMPITransport : public CTransport {
+        private:
+            typedef struct _Operation {
+                MPI_Request s_request;
+                DataType    s_type;
+                bool        s_inUse;
+            } Operation, *pOperation;
+            
+            AbstractApplication&   m_App;
+            int                    m_rank;
+            unsigned               m_nRanks;
+            std::vector<Operation> m_operations;   // Indexed by Request.
+            MPI_Comm               m_dealWorkers;  // Dealer + workers.
+        public:
+            CMPITransport(AbstractApplication& app);
+            virtual ~CMPITransport();
+        private:
+            CMPITransport(const CMPITransport& rhs);
+            CMPITransport& operator=(const CMPITransport& rhs);
+            int operator==(const CMPITransport& rhs);
+            int operator!=(const CMPITransport& rhs);
+        public:
+            virtual int rank() const;
+            virtual unsigned size() const;
+            
+            virtual void send(
+                const void* pData, std::size_t count, DataType type,
+                int dest, int tag
+            );
+            virtual Status recv(
+                void* pData, std::size_t count, DataType type,
+                int source, int tag
+            );
+            virtual Status probe(int source, int tag);
+            
+            virtual Request isend(
+                const void* pData, std::size_t count, DataType type,
+                int dest, int tag
+            );
+            virtual Request irecv(
+                void* pData, std::size_t count, DataType type,
+                int source, int tag
+            );
+            virtual Status wait(Request& request);
+            virtual bool test(Request& request);
+            virtual void cancel(Request& request);
+            
+            virtual void broadcast(
+                const void* pData, std::size_t count, DataType type,
+                int firstRank, int tag
+            );
+            virtual Status receiveBroadcast(
+                void* pData, std::size_t count, DataType type,
+                int root, int firstRank, int tag
+            );
+        private:
+            static bool isCollective(int root, int firstRank);
+            MPI_Datatype mpiType(DataType type);
+            static int mpiSource(int source);
+            static int mpiTag(int tag);
+            Status makeStatus(MPI_Status& status, DataType type);
+            Request allocateOperation(DataType type);
+            void freeOperation(Request& request);
+            Operation& operation(Request request);
+        };
+    }
+}
+
+#endif
@@ -23,33 +23,44 @@
 #define MPITRIGGERSORTER_H
 
 #include "TriggerSorter.h"
-#include <mpi.h>
-#include <vector>
-#include <memory>
+#include <cstddef>
 
 namespace frib {
     namespace analysis {
+        class CTransport;
         /**
          * @class CMPITRiggerSorter
          *
          * Specializes the CTriggerSorter class so that
          * emitItem method pushes items to an MPIParameterOutpu object.
          * running in the specified rank.
+         *
+         * Items are sent as they are laid out in the output file: raw
+         * PARAMETER_DATA ring items tagged MPI_PARAMETER_BATCH_TAG.  Runs of
+         * items that came in a block (see CTriggerSorter::addBlock) are sent
+         * in a single message straight out of the block, so the
+         * parameters are never copied on their way through the farmer.
+         * Messages go out through the transport of the farmer that
+         * creates us.
          */
         class CMPITriggerSorter : public CTriggerSorter {
         private:
+            CTransport&  m_transport;
             int          m_outputRank;
-            MPI_Datatype& m_headerType;    // MPI Data type for header data.
-            MPI_Datatype& m_parameterType; // MPI Data type for the parameters.
-            unsigned      m_maxItems;      // # items that can fit in m_item.
-            std::unique_ptr<FRIB_MPI_Parameter_Value> m_items; // To avoid allocation each event.
         public:
             CMPITriggerSorter(
-                int outputterRank, MPI_Datatype& headers, MPI_Datatype& param
+                CTransport& transport, int outputterRank,
+                CParameterItemPool* pPool = nullptr
             );
             virtual ~CMPITriggerSorter();
             
             virtual void emitItem(pParameterItem item);
+            virtual void emitItems(
+                const ParameterItem* pFirst, std::size_t nItems,
+                std::size_t nBytes
+            );
+        private:
+            void send(const void* pData, std::size_t nBytes);
         };
     }
 }
@@ -0,0 +1,178 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+/** @file:  MPIWorkItemPrefetcher.cpp
+ *  @brief: Implement the CMPIWorkItemPrefetcher class.
+ */
+#include "MPIWorkItemPrefetcher.h"
+#include "AbstractApplication.h"
+#include <stdexcept>
+#include <chrono>
+
+/**
+ * secondsSince
+ *   @param start - a time point.
+ *   @return double - seconds since start.
+ */
+static double
+secondsSince(std::chrono::steady_clock::time_point start)
+{
+    std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+    return d.count();
+}
+
+namespace frib {
+    namespace analysis {
+        const unsigned    CMPIWorkItemPrefetcher::DEFAULT_CREDITS(2);
+        const std::size_t CMPIWorkItemPrefetcher::DEFAULT_BUFFER_SIZE(4*1024*1024);
+        
+        /**
+         * constructor
+         *    Nothing is requested until the first call to next.
+         *    We communicate through the transport of the role that
+         *    constructs us.
+         * @param app - the application (has the transport and request code).
+         * @param credits - number of work item requests kept outstanding.
+         * @param bufferSize - size of each slot's data buffer.  This is the
+         *                    largest work item we'll accept.
+         * @throw std::invalid_argument - credits or bufferSize are 0.
+         */
+        CMPIWorkItemPrefetcher::CMPIWorkItemPrefetcher(
+            AbstractApplication& app, unsigned credits, std::size_t bufferSize
+        ) :
+            m_App(app), m_transport(app.transport()),
+            m_nBufferSize(bufferSize), m_nNext(0),
+            m_started(false), m_done(false), m_idleTime(0.0)
+        {
+            if (credits == 0) {
+                throw std::invalid_argument("Prefetcher needs at least one credit");
+            }
+            if (bufferSize == 0) {
+                throw std::invalid_argument("Prefetcher buffer size must be non-zero");
+            }
+            m_slots.resize(credits);
+            for (auto& slot : m_slots) {
+                slot.s_data.resize(bufferSize);
+                slot.s_headerRequest = CTransport::NULL_REQUEST;
+                slot.s_dataRequest   = CTransport::NULL_REQUEST;
+            }
+        }
+        /**
+         * destructor
+         *    If we're destroyed before the end of data (e.g. an exception),
+         *    cancel whatever receives are still outstanding so the buffers
+         *    aren't written after they're freed.
+         */
+        CMPIWorkItemPrefetcher::~CMPIWorkItemPrefetcher() {
+            for (auto& slot : m_slots) {
+                try {
+                    m_transport.cancel(slot.s_headerRequest);
+                    m_transport.cancel(slot.s_dataRequest);
+                }
+                catch (...) {}             // Destructors must not throw.
+            }
+        }
+        /**
+         * next
+         *    Return the next work item.  The slot the previous work item
+         *    was in is re-posted first, so the previous work item's data are
+         *    no longer valid.
+         * @param[out] header - the header of the work item.
+         * @return const void* - pointer to header.s_nBytes of data.  nullptr
+         *         if the dealer has no more data (header.s_end is true).
+         */
+        const void*
+        CMPIWorkItemPrefetcher::next(FRIB_MPI_Message_Header& header) {
+            if (m_done) {
+                header.s_nBytes = 0;
+                header.s_end    = true;
+                return nullptr;
+            }
+            if (!m_started) {
+                for (auto& slot : m_slots) {
+                    post(slot);
+                }
+                m_started = true;
+            } else {
+                std::size_t prior = (m_nNext + m_slots.size() - 1) % m_slots.size();
+                post(m_slots[prior]);
+            }
+            
+            Slot& slot = m_slots[m_nNext];
+            auto start = std::chrono::steady_clock::now();
+            m_transport.wait(slot.s_headerRequest);
+            
+            if (slot.s_header.s_end) {
+                m_idleTime += secondsSince(start);
+                header = slot.s_header;
+                m_nNext = (m_nNext + 1) % m_slots.size();
+                drain();
+                return nullptr;
+            }
+            m_transport.wait(slot.s_dataRequest);
+            m_idleTime += secondsSince(start);
+            
+            header = slot.s_header;
+            m_nNext = (m_nNext + 1) % m_slots.size();
+            return slot.s_data.data();
+        }
+        /**
+         * idleTime
+         *   @return double - seconds next spent waiting for work items.
+         */
+        double
+        CMPIWorkItemPrefetcher::idleTime() const {
+            return m_idleTime;
+        }
+        ///////////////////////////////////////////////////////////////////////
+        // Private utilities.
+        
+        /**
+         * post
+         *    Post the receives for a slot and then send the request that
+         *    they'll satisfy.
+         * @param slot - the slot to post.
+         */
+        void
+        CMPIWorkItemPrefetcher::post(Slot& slot) {
+            slot.s_headerRequest = m_transport.irecv(
+                &slot.s_header, 1, CTransport::MESSAGE_HEADER,
+                DEALER_RANK, MPI_HEADER_TAG
+            );
+            slot.s_dataRequest = m_transport.irecv(
+                slot.s_data.data(), m_nBufferSize, CTransport::BYTES,
+                DEALER_RANK, MPI_DATA_TAG
+            );
+            
+            m_App.requestData(m_nBufferSize, m_slots.size());
+        }
+        /**
+         * drain
+         *    Called once the dealer has started sending ends.  The remaining
+         *    outstanding headers are all ends.  None of the posted data
+         *    receives will be satisfied so they're cancelled.
+         *    The slot that got the first end has already been consumed.
+         */
+        void
+        CMPIWorkItemPrefetcher::drain() {
+            m_done = true;
+            for (auto& slot : m_slots) {
+                m_transport.wait(slot.s_headerRequest);
+                m_transport.cancel(slot.s_dataRequest);
+            }
+        }
+    }
+}
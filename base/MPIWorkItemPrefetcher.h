@@ -0,0 +1,103 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+/** @file:  MPIWorkItemPrefetcher.h
+ *  @brief: Keeps several work item requests outstanding for a worker.
+ */
+#ifndef MPIWORKITEMPREFETCHER_H
+#define MPIWORKITEMPREFETCHER_H
+#include "AnalysisRingItems.h"
+#include "Transport.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace frib {
+    namespace analysis {
+        class AbstractApplication;
+        /**
+         * @class CMPIWorkItemPrefetcher
+         *    A worker that requests a work item and then waits for it pays a
+         *    full round trip to the dealer for every work item.  This class
+         *    keeps a number of requests (credits) outstanding, each with a
+         *    non-blocking receive posted for the header and the data.  While
+         *    the worker processes one work item, the next ones are already on
+         *    their way.
+         *
+         *    Each credit is a slot with its own buffer.  Slots are posted,
+         *    and therefore satisfied, in round robin order; the transport's
+         *    (MPI's) non-overtaking rule guarantees that the n'th header and
+         *    data the dealer sends us land in the n'th slot posted.  Since
+         *    the data receive must be posted before we know how big the work
+         *    item is, the requests tell the dealer the slot buffer size and
+         *    it won't send us more than that.
+         *
+         *    The dealer answers every outstanding request with an end once it
+         *    runs out of data (see AbstractApplication::sendEofs).  When we
+         *    see the first end, the remaining slots are drained and the
+         *    unused data receives cancelled.
+         *
+         *    Typical use:
+         * \verbatim
+         *     CMPIWorkItemPrefetcher prefetcher(app, credits, bufferSize);
+         *     FRIB_MPI_Message_Header header;
+         *     while (const void* pData = prefetcher.next(header)) {
+         *         // process header.s_nBytes bytes of pData.
+         *     }
+         * \endverbatim
+         */
+        class CMPIWorkItemPrefetcher {
+        public:
+            static const unsigned    DEFAULT_CREDITS;
+            static const std::size_t DEFAULT_BUFFER_SIZE;
+        private:
+            struct Slot {
+                FRIB_MPI_Message_Header   s_header;
+                std::vector<std::uint8_t> s_data;
+                CTransport::Request       s_headerRequest;
+                CTransport::Request       s_dataRequest;
+            };
+            AbstractApplication& m_App;
+            CTransport&          m_transport;
+            std::vector<Slot>    m_slots;
+            std::size_t          m_nBufferSize;
+            std::size_t          m_nNext;       // Slot to be consumed next.
+            bool                 m_started;
+            bool                 m_done;
+            double               m_idleTime;
+        public:
+            CMPIWorkItemPrefetcher(
+                AbstractApplication& app,
+                unsigned credits = DEFAULT_CREDITS,
+                std::size_t bufferSize = DEFAULT_BUFFER_SIZE
+            );
+            virtual ~CMPIWorkItemPrefetcher();
+        private:
+            CMPIWorkItemPrefetcher(const CMPIWorkItemPrefetcher& rhs);
+            CMPIWorkItemPrefetcher& operator=(const CMPIWorkItemPrefetcher& rhs);
+            int operator==(const CMPIWorkItemPrefetcher& rhs);
+            int operator!=(const CMPIWorkItemPrefetcher& rhs);
+        public:
+            const void* next(FRIB_MPI_Message_Header& header);
+            double idleTime() const;
+        private:
+            void post(Slot& slot);
+            void drain();
+        };
+    }
+}
+
+#endif
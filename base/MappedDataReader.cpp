@@ -0,0 +1,272 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  MappedDataReader.cpp
+ *  @brief: Implement the CMappedDataReader class.
+ */
+#include "MappedDataReader.h"
+#include <unistd.h>
+#include <stdexcept>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <string>
+#include <sstream>
+
+// Pages behind the cursor are released in chunks at least this big so
+// we don't do an madvise for every block.
+
+static const std::size_t RELEASE_CHUNK(8*1024*1024);
+
+namespace frib {
+    namespace analysis {
+        /**
+         * constructor
+         *    @param pFilename  - the name of a file that's opened readonly.
+         * The file is opened and mapped.
+         */
+        CMappedDataReader::CMappedDataReader(const char* pFilename) :
+            m_nFd(-1), m_pMapping(nullptr), m_nFileSize(0), m_nCursor(0),
+            m_nReleased(0), m_fReleased(true), m_nUserBytes(0), m_nUserItems(0)
+        {
+            m_nFd = open(pFilename, O_RDONLY);
+            if (m_nFd < 0) {
+                std::string failureReason = strerror(errno);
+                std::stringstream errorStream;
+                errorStream << "Failed to open: " << pFilename << " for read: "
+                    << failureReason;
+                std::string errormsg = errorStream.str();
+                throw std::runtime_error(errormsg);
+            }
+            try {
+                mapFile();
+            }
+            catch (...) {
+                close(m_nFd);
+                throw;
+            }
+        }
+        /**
+         * constructor
+         *    Already have a file descriptor open.  Data are read from the
+         *    current file position.
+         *  @param fd -  a file descriptor open on the data source.
+         *  @note fd will be closed on destruction.
+         */
+        CMappedDataReader::CMappedDataReader(int fd) :
+            m_nFd(fd), m_pMapping(nullptr), m_nFileSize(0), m_nCursor(0),
+            m_nReleased(0), m_fReleased(true), m_nUserBytes(0), m_nUserItems(0)
+        {
+            mapFile();
+            off_t here = lseek(m_nFd, 0, SEEK_CUR);
+            if (here > 0) {
+                m_nCursor = here;
+                if (m_nCursor > m_nFileSize) m_nCursor = m_nFileSize;
+            }
+        }
+        /**
+         * destructor
+         *    Unmap the file and close it.
+         */
+        CMappedDataReader::~CMappedDataReader() {
+            if (m_pMapping) {
+                munmap(const_cast<std::uint8_t*>(m_pMapping), m_nFileSize);
+            }
+            close(m_nFd);
+        }
+        /**
+         * getBlock
+         *   - Ensure this is legal (m_fReleased is true).
+         *   - probeData to figure out how much data to actually give.
+         *   - Return a description of the data which points into the mapping.
+         *  @param maxbytes - maximum number of bytes the caller will accept.
+         *  @return CDataReader::Result
+         */
+        CDataReader::Result
+        CMappedDataReader::getBlock(std::size_t maxbytes)
+        {
+            if (!m_fReleased) {
+                throw std::logic_error("Attemped read without releasing prior data");
+            }
+            probeData(maxbytes);
+            
+            Result res;
+            res.s_nbytes = m_nUserBytes;
+            res.s_nItems = m_nUserItems;
+            res.s_pData  = m_nUserBytes > 0 ? m_pMapping + m_nCursor : nullptr;
+            m_fReleased = false;
+            return res;
+        }
+        /**
+         * done
+         *    Indicate the client is done with the last chunk of data:
+         *    - Ensure this is a valid call (m_fReleased is false).
+         *    - Advance the cursor past the data given to the client.
+         *    - Release pages behind the cursor if there are enough of them.
+         */
+        void
+        CMappedDataReader::done()
+        {
+            if (m_fReleased) {
+                throw std::logic_error("Releasing but already released");
+            }
+            m_nCursor  += m_nUserBytes;
+            m_fReleased = true;
+            releasePages();
+        }
+        /**
+         * blocksPersist
+         *    @return bool - true. Data are returned from the mapping, which
+         *                   lives as long as we do.  Released pages are just
+         *                   faulted back in from the file if they're
+         *                   touched again.
+         */
+        bool
+        CMappedDataReader::blocksPersist() const
+        {
+            return true;
+        }
+        /**
+         * seek
+         *    Move the cursor to an offset in the file.  Page release starts
+         *    over from there.
+         * @param offset - file offset of the item to read next.
+         * @throw std::logic_error - the last block has not been released.
+         * @throw std::out_of_range - offset is past the end of the file.
+         */
+        void
+        CMappedDataReader::seek(std::uint64_t offset)
+        {
+            if (!m_fReleased) {
+                throw std::logic_error("Attempted seek without releasing prior data");
+            }
+            if (offset > m_nFileSize) {
+                throw std::out_of_range("CMappedDataReader - seek past end of file");
+            }
+            static const std::size_t pageSize = sysconf(_SC_PAGESIZE);
+            m_nCursor   = offset;
+            m_nReleased = (m_nCursor / pageSize) * pageSize;
+        }
+        /**
+         * isMappable
+         *    Determine if a file can be read with this class.  Only
+         *    regular files can.
+         *  @param pFilename - name of the file.
+         *  @return bool - true if the file is a regular file.
+         */
+        bool
+        CMappedDataReader::isMappable(const char* pFilename)
+        {
+            struct stat info;
+            if (stat(pFilename, &info)) {
+                return false;
+            }
+            return S_ISREG(info.st_mode);
+        }
+        //////////////////////////////////////////////////////////////////////////
+        // Private utilities:
+        
+        /**
+         * mapFile
+         *    Map the file open on m_nFd and tell the kernel we're going to
+         *    read it sequentially.  Empty files are not mapped; we're just
+         *    always at end of file.
+         */
+        void
+        CMappedDataReader::mapFile()
+        {
+            struct stat info;
+            if (fstat(m_nFd, &info)) {
+                std::string msg = "CMappedDataReader unable to stat file: ";
+                msg += strerror(errno);
+                throw std::runtime_error(msg);
+            }
+            if (!S_ISREG(info.st_mode)) {
+                throw std::invalid_argument(
+                    "CMappedDataReader can only read regular files"
+                );
+            }
+            m_nFileSize = info.st_size;
+            if (m_nFileSize == 0) {
+                return;
+            }
+            void* p = mmap(nullptr, m_nFileSize, PROT_READ, MAP_PRIVATE, m_nFd, 0);
+            if (p == MAP_FAILED) {
+                std::string msg = "CMappedDataReader unable to map file: ";
+                msg += strerror(errno);
+                throw std::runtime_error(msg);
+            }
+            m_pMapping = reinterpret_cast<const std::uint8_t*>(p);
+            madvise(p, m_nFileSize, MADV_SEQUENTIAL);
+        }
+        /**
+         * probeData
+         *   Set up m_nUserBytes, m_nUserItems so that from the cursor
+         *   there's at least one item, and no more than maxbytes or what's
+         *   left in the file.
+         *
+         *   @param maxBytes - maximum number of byes the caller can deal with.
+         */
+        void
+        CMappedDataReader::probeData(std::size_t maxBytes)
+        {
+            m_nUserBytes = 0;
+            m_nUserItems = 0;
+            
+            std::size_t remaining = m_nFileSize - m_nCursor;
+            if (maxBytes > remaining) maxBytes = remaining;
+            
+            const std::uint8_t* p = m_pMapping + m_nCursor;
+            while ((m_nUserBytes + sizeof(std::uint32_t)) <= maxBytes) {
+                std::uint32_t size = *reinterpret_cast<const std::uint32_t*>(p);
+                if (size == 0 || size > remaining || (size > maxBytes && m_nUserItems == 0)) {
+                    throw std::logic_error("Mapped file or user request overflowed by a single ring item");
+                }
+                if ((size + m_nUserBytes) > maxBytes) return;
+                m_nUserBytes += size;
+                m_nUserItems++;
+                p += size;
+            }
+            if (m_nUserItems == 0 && remaining) {
+                throw std::logic_error("Mapped file ends with a partial ring item");
+            }
+        }
+        /**
+         * releasePages
+         *    Tell the kernel we don't need the pages behind the cursor any
+         *    more.  This is done in chunks of at least RELEASE_CHUNK bytes.
+         *    Note that if the data are touched again (e.g. a client holding on
+         *    to an old block) they are just faulted back in from the file.
+         */
+        void
+        CMappedDataReader::releasePages()
+        {
+            static const std::size_t pageSize = sysconf(_SC_PAGESIZE);
+            std::size_t releaseTo = (m_nCursor / pageSize) * pageSize;
+            if ((releaseTo - m_nReleased) >= RELEASE_CHUNK) {
+                madvise(
+                    const_cast<std::uint8_t*>(m_pMapping) + m_nReleased,
+                    releaseTo - m_nReleased, MADV_DONTNEED
+                );
+                m_nReleased = releaseTo;
+            }
+        }
+    }
+}
@@ -0,0 +1,84 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  MappedDataReader.h
+ *  @brief: A CDataReader that hands out data directly from a mapped file.
+ */
+#ifndef MAPPEDDATAREADER_H
+#define MAPPEDDATAREADER_H
+#include "DataReader.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace frib {
+    namespace analysis {
+        /**
+         * @class CMappedDataReader
+         *    This reader has the same getBlock/done contract as CDataReader
+         *    but, rather than reading data into a buffer and sliding the
+         *    unconsumed part to the front of the buffer, it maps the entire
+         *    file into the process address space and returns pointers
+         *    directly into that mapping.  Data are therefore never copied by
+         *    the reader; they go straight from the page cache to whatever
+         *    the client does with them (e.g. an MPI_Send).
+         *
+         *    The kernel is told we're going to read the file sequentially
+         *    and, as the client releases data, pages behind the cursor are
+         *    released as well so that even very large files don't bloat our
+         *    resident set.
+         *
+         *    Only things that can be mapped (regular files) can be read this
+         *    way - use isMappable to decide between this and CDataReader.
+         */
+        class CMappedDataReader : public CDataReader {
+        private:
+            int                 m_nFd;
+            const std::uint8_t* m_pMapping;
+            std::size_t         m_nFileSize;
+            std::size_t         m_nCursor;         // Offset of next data.
+            std::size_t         m_nReleased;       // Pages below this are released.
+            
+            // State of the last getBlock:
+            
+            bool                m_fReleased;
+            std::size_t         m_nUserBytes;
+            std::size_t         m_nUserItems;
+        public:
+            CMappedDataReader(const char* pFilename);
+            CMappedDataReader(int fd);
+            virtual ~CMappedDataReader();
+        private:
+            CMappedDataReader(const CMappedDataReader& rhs);
+            CMappedDataReader& operator=(const CMappedDataReader& rhs);
+            int operator==(const CMappedDataReader& rhs);
+            int operator!=(const CMappedDataReader& rhs);
+        public:
+            virtual Result getBlock(std::size_t maxbytes);
+            virtual void done();
+            virtual bool blocksPersist() const;
+            virtual void seek(std::uint64_t offset);
+            
+            static bool isMappable(const char* pFilename);
+        private:
+            void mapFile();
+            void probeData(std::size_t maxBytes);
+            void releasePages();
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,308 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+
+/** @file:  MessageQueue.cpp
+ *  @brief: Implement the CMessageQueue class.
+ */
+#include "MessageQueue.h"
+#include <new>
+#include <thread>
+#include <stdexcept>
+
+// Number of times get/put poll before going to sleep.
+
+static const unsigned SPIN_COUNT(1000);
+
+namespace frib {
+    namespace analysis {
+        const std::size_t CMessageQueue::DEFAULT_MAX_BYTES(64*1024*1024);
+        
+        /**
+         * constructor
+         *    The queue starts out holding only the stub node.
+         * @param maxBytes - payload bytes above which put blocks.  0 means
+         *                   there's no limit.
+         */
+        CMessageQueue::CMessageQueue(std::size_t maxBytes) :
+            m_pHead(&m_stub), m_pTail(&m_stub), m_nBytes(0),
+            m_nMaxBytes(maxBytes), m_consumerWaiting(false),
+            m_nProducersWaiting(0), m_aborted(false)
+        {
+            m_stub.s_pNext.store(nullptr);
+        }
+        /**
+         * destructor
+         *    Free any messages that were never received.  Producers must
+         *    be done with us.
+         */
+        CMessageQueue::~CMessageQueue() {
+            while (pMessage p = pop()) {
+                free(p);
+            }
+        }
+        /**
+         * allocate
+         *    Make a message.  The header and payload are a single allocation.
+         * @param nBytes - size of the payload.
+         * @return pMessage - the message, s_nBytes is filled in.
+         */
+        CMessageQueue::pMessage
+        CMessageQueue::allocate(std::size_t nBytes) {
+            void* pStorage = ::operator new(sizeof(Message) + nBytes);
+            pMessage result = new(pStorage) Message;
+            result->s_pNext.store(nullptr, std::memory_order_relaxed);
+            result->s_source = -1;
+            result->s_tag    = -1;
+            result->s_nBytes = nBytes;
+            return result;
+        }
+        /**
+         * free
+         *    Destroy a message made by allocate.
+         * @param pMsg - the message.
+         */
+        void
+        CMessageQueue::free(pMessage pMsg) {
+            pMsg->~Message();
+            ::operator delete(pMsg);
+        }
+        /**
+         * payload
+         *   @param pMsg - a message.
+         *   @return void* - pointer to its payload.
+         */
+        void*
+        CMessageQueue::payload(pMessage pMsg) {
+            return pMsg + 1;
+        }
+        /**
+         * put
+         *    Put a message in the queue, first waiting, if necessary, for
+         *    there to be room for it.  The queue owns the message from now on.
+         * @param pMsg - the message.
+         * @throw std::runtime_error - the queue was aborted.  In that case
+         *        the message still belongs to the caller.
+         */
+        void
+        CMessageQueue::put(pMessage pMsg) {
+            if (m_nMaxBytes) {
+                waitForSpace(pMsg->s_nBytes);
+            } else {
+                throwIfAborted();
+            }
+            m_nBytes.fetch_add(pMsg->s_nBytes);
+            push(pMsg);
+            
+            // The link push made and this load are sequentially consistent
+            // with get's setting of m_consumerWaiting and its pop so either
+            // get sees the message or we see the waiter:
+            
+            if (m_consumerWaiting.load()) {
+                std::lock_guard<std::mutex> l(m_lock);
+                m_notEmpty.notify_one();
+            }
+        }
+        /**
+         * get
+         *    Take the next message from the queue, waiting for one if
+         *    necessary.  Only the consumer may call this.
+         * @return pMessage - the message; the caller must free it.
+         * @throw std::runtime_error - the queue was aborted.
+         */
+        CMessageQueue::pMessage
+        CMessageQueue::get() {
+            for (unsigned i = 0; i < SPIN_COUNT; i++) {
+                if (pMessage p = tryGet()) {
+                    return p;
+                }
+                throwIfAborted();
+                std::this_thread::yield();
+            }
+            
+            std::unique_lock<std::mutex> l(m_lock);
+            m_consumerWaiting.store(true);
+            pMessage result;
+            while (!(result = pop())) {
+                if (m_aborted.load()) {
+                    m_consumerWaiting.store(false);
+                    throwIfAborted();
+                }
+                m_notEmpty.wait(l);
+            }
+            m_consumerWaiting.store(false);
+            l.unlock();
+            
+            taken(result);
+            return result;
+        }
+        /**
+         * tryGet
+         *    Take the next message from the queue if there is one.  Only the
+         *    consumer may call this.
+         * @return pMessage - the message (the caller must free it) or nullptr
+         *              if the queue is empty.
+         */
+        CMessageQueue::pMessage
+        CMessageQueue::tryGet() {
+            pMessage result = pop();
+            if (result) {
+                taken(result);
+            }
+            return result;
+        }
+        /**
+         * bytesQueued
+         *    @return std::size_t - payload bytes in the queue.
+         */
+        std::size_t
+        CMessageQueue::bytesQueued() const {
+            return m_nBytes.load();
+        }
+        /**
+         * abort
+         *    Wake up anyone waiting on the queue and make them (and later
+         *    callers) throw.
+         */
+        void
+        CMessageQueue::abort() {
+            std::lock_guard<std::mutex> l(m_lock);
+            m_aborted.store(true);
+            m_notEmpty.notify_all();
+            m_notFull.notify_all();
+        }
+        /**
+         * aborted
+         *    @return bool - true if abort was called.
+         */
+        bool
+        CMessageQueue::aborted() const {
+            return m_aborted.load();
+        }
+        ///////////////////////////////////////////////////////////////////////
+        // Private utilities.
+        
+        /**
+         * push
+         *    Link a message onto the head of the list.  The message is
+         *    visible to the consumer once the previous head points at it.
+         * @param pMsg - the message.
+         */
+        void
+        CMessageQueue::push(pMessage pMsg) {
+            pMsg->s_pNext.store(nullptr, std::memory_order_relaxed);
+            pMessage pPrior = m_pHead.exchange(pMsg);
+            pPrior->s_pNext.store(pMsg);
+        }
+        /**
+         * pop
+         *    Unlink the message at the tail of the list.  The stub node keeps
+         *    the list from ever being empty; when we'd take the last real
+         *    message, the stub is pushed back behind it first.
+         * @return pMessage - the message or nullptr if there's none (or one
+         *       is in the middle of being pushed).
+         */
+        CMessageQueue::pMessage
+        CMessageQueue::pop() {
+            pMessage pTail = m_pTail;
+            pMessage pNext = pTail->s_pNext.load();
+            if (pTail == &m_stub) {
+                if (!pNext) {
+                    return nullptr;
+                }
+                m_pTail = pNext;
+                pTail   = pNext;
+                pNext   = pNext->s_pNext.load();
+            }
+            if (pNext) {
+                m_pTail = pNext;
+                return pTail;
+            }
+            if (pTail != m_pHead.load()) {
+                return nullptr;                // Push in progress.
+            }
+            push(&m_stub);
+            pNext = pTail->s_pNext.load();
+            if (pNext) {
+                m_pTail = pNext;
+                return pTail;
+            }
+            return nullptr;
+        }
+        /**
+         * taken
+         *    Account for a message leaving the queue and wake any producers
+         *    that might now have room.  As with put/get, the update of
+         *    m_nBytes and the load of m_nProducersWaiting are sequentially
+         *    consistent with the producer's increment and re-check.
+         * @param pMsg - the message that was popped.
+         */
+        void
+        CMessageQueue::taken(pMessage pMsg) {
+            m_nBytes.fetch_sub(pMsg->s_nBytes);
+            if (m_nProducersWaiting.load()) {
+                std::lock_guard<std::mutex> l(m_lock);
+                m_notFull.notify_all();
+            }
+        }
+        /**
+         * fits
+         *   @param nBytes - size of a payload.
+         *   @return bool - true if a message with that payload can be
+         *                  queued now.
+         */
+        bool
+        CMessageQueue::fits(std::size_t nBytes) const {
+            std::size_t queued = m_nBytes.load();
+            return (queued == 0) || ((queued + nBytes) <= m_nMaxBytes);
+        }
+        /**
+         * waitForSpace
+         *    Wait until a message with nBytes of payload fits.  Note that
+         *    producers don't reserve space so several of them can squeeze
+         *    in at once; the limit is soft.
+         * @param nBytes - the payload size.
+         */
+        void
+        CMessageQueue::waitForSpace(std::size_t nBytes) {
+            for (unsigned i = 0; i < SPIN_COUNT; i++) {
+                throwIfAborted();
+                if (fits(nBytes)) {
+                    return;
+                }
+                std::this_thread::yield();
+            }
+            std::unique_lock<std::mutex> l(m_lock);
+            m_nProducersWaiting++;
+            while (!fits(nBytes) && !m_aborted.load()) {
+                m_notFull.wait(l);
+            }
+            m_nProducersWaiting--;
+            throwIfAborted();
+        }
+        /**
+         * throwIfAborted
+         *   @throw std::runtime_error if the queue was aborted.
+         */
+        void
+        CMessageQueue::throwIfAborted() const {
+            if (m_aborted.load()) {
+                throw std::runtime_error("Message queue aborted");
+            }
+        }
+    }
+}
@@ -0,0 +1,110 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+
+/** @file:  MessageQueue.h
+ *  @brief: Lock-free multiple producer, single consumer message queue.
+ */
+#ifndef MESSAGEQUEUE_H
+#define MESSAGEQUEUE_H
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+
+namespace frib {
+    namespace analysis {
+        /**
+         * @class CMessageQueue
+         *    The mailbox of one rank of a CQueueTransport.  Any number of
+         *    threads put messages into it but only the thread of the rank
+         *    that owns it takes them out.  The queue is an intrusive linked
+         *    list (Vyukov's MPSC queue) so put is a single atomic exchange
+         *    and neither put nor get takes a lock.
+         *
+         *    A consumer that finds the queue empty spins for a bit and then
+         *    sleeps on a condition variable.  Producers only touch the mutex
+         *    if the consumer is (or is about to be) asleep.
+         *
+         *    To bound memory the way MPI's rendezvous protocol does, put
+         *    blocks while the queue holds more than its byte limit of
+         *    payload.  An empty queue accepts any message so a message
+         *    bigger than the limit can't block forever.
+         *
+         *    abort wakes everyone.  Waiting and subsequent blocking
+         *    operations throw std::runtime_error.  This is used to tear down
+         *    the rest of an application when one of its roles fails.
+         */
+        class CMessageQueue {
+        public:
+            // A message - the payload immediately follows this struct.
+            // Messages are created by allocate and destroyed by free.
+            
+            typedef struct _Message {
+                std::atomic<_Message*> s_pNext;
+                int                    s_source;
+                int                    s_tag;
+                std::size_t            s_nBytes;
+            } Message, *pMessage;
+            
+            static const std::size_t DEFAULT_MAX_BYTES;
+        private:
+            std::atomic<pMessage>    m_pHead;         // Producers put here.
+            pMessage                 m_pTail;         // Consumer gets here.
+            Message                  m_stub;
+            std::atomic<std::size_t> m_nBytes;        // Payload bytes queued.
+            std::size_t              m_nMaxBytes;
+            
+            std::atomic<bool>        m_consumerWaiting;
+            std::atomic<unsigned>    m_nProducersWaiting;
+            std::atomic<bool>        m_aborted;
+            std::mutex               m_lock;
+            std::condition_variable  m_notEmpty;
+            std::condition_variable  m_notFull;
+        public:
+            CMessageQueue(std::size_t maxBytes = DEFAULT_MAX_BYTES);
+            virtual ~CMessageQueue();
+        private:
+            CMessageQueue(const CMessageQueue& rhs);
+            CMessageQueue& operator=(const CMessageQueue& rhs);
+            int operator==(const CMessageQueue& rhs);
+            int operator!=(const CMessageQueue& rhs);
+        public:
+            static pMessage allocate(std::size_t nBytes);
+            static void free(pMessage pMsg);
+            static void* payload(pMessage pMsg);
+            
+            void put(pMessage pMsg);
+            pMessage get();
+            pMessage tryGet();
+            std::size_t bytesQueued() const;
+            
+            void abort();
+            bool aborted() const;
+        private:
+            void push(pMessage pMsg);
+            pMessage pop();
+            void taken(pMessage pMsg);
+            bool fits(std::size_t nBytes) const;
+            void waitForSpace(std::size_t nBytes);
+            void throwIfAborted() const;
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,219 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+
+/** @file:  NameDictionary.h
+ *  @brief: Hash indexed dictionary of named items with stable addresses.
+ */
+#ifndef NAMEDICTIONARY_H
+#define NAMEDICTIONARY_H
+#include <deque>
+#include <vector>
+#include <string>
+#include <utility>
+#include <tuple>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+namespace frib {
+    namespace analysis {
+        /**
+         * @class CNameDictionary
+         *    Maps names to items.  This is what the tree parameter and tree
+         *    variable dictionaries are kept in.  Those can get big (large
+         *    detector arrays define 100k+ parameters) and are searched
+         *    every time a tree parameter/variable is constructed.
+         *
+         *    -  The items are kept, in the order they were added, in a deque
+         *       so they never move: pointers to them remain valid as the
+         *       dictionary grows (tree parameters/variables hold pointers
+         *       to their definitions).
+         *    -  They are found via a flat, open addressed (linear probe)
+         *       table of slots that hold an item's index and part of its name's
+         *       hash.  A lookup normally touches one slot and one item.
+         *
+         *    The interface is the subset of std::map used by the clients.
+         *    Iteration is in the order the items were added.
+         *    Items can't be individually removed, only all of them (clear).
+         *
+         *    This is a template so it's all in the header.
+         */
+        template <typename T>
+        class CNameDictionary {
+        public:
+            typedef std::pair<const std::string, T>           value_type;
+            typedef typename std::deque<value_type>::iterator iterator;
+            typedef typename std::deque<value_type>::const_iterator const_iterator;
+        private:
+            struct Slot {
+                std::uint32_t s_hash;      // Low bits of the name's hash.
+                std::uint32_t s_index;     // Item index + 1; 0 means empty.
+            };
+            static const std::size_t INITIAL_SLOTS = 16;   // Power of 2.
+            
+            std::deque<value_type> m_items;
+            std::vector<Slot>      m_slots;     // Size is a power of 2.
+        public:
+            CNameDictionary() : m_slots(INITIAL_SLOTS, Slot{0, 0}) {}
+        private:
+            CNameDictionary(const CNameDictionary& rhs);
+            CNameDictionary& operator=(const CNameDictionary& rhs);
+            int operator==(const CNameDictionary& rhs);
+            int operator!=(const CNameDictionary& rhs);
+        public:
+            iterator begin()             { return m_items.begin(); }
+            iterator end()               { return m_items.end(); }
+            const_iterator begin() const { return m_items.begin(); }
+            const_iterator end() const   { return m_items.end(); }
+            std::size_t size() const     { return m_items.size(); }
+            bool empty() const           { return m_items.empty(); }
+            
+            /**
+             * find
+             *  @param name - name to look up.
+             *  @return iterator - the item with that name.
+             *  @retval end() - there isn't one.
+             */
+            iterator find(const std::string& name) {
+                std::size_t slot = findSlot(name, hash(name));
+                if (m_slots[slot].s_index) {
+                    return m_items.begin() + (m_slots[slot].s_index - 1);
+                }
+                return m_items.end();
+            }
+            /**
+             * count
+             *  @param name - name to look up.
+             *  @return std::size_t - 1 if there's an item with that name else 0.
+             */
+            std::size_t count(const std::string& name) const {
+                return m_slots[findSlot(name, hash(name))].s_index ? 1 : 0;
+            }
+            /**
+             * emplace
+             *    Add an item if there's not one with that name.
+             *  @param name - the name.
+             *  @param args - passed to T's constructor.
+             *  @return std::pair<iterator, bool> - the item with that name
+             *          and whether or not it was added.
+             *  @note unlike std::map, T is not constructed if the name exists.
+             */
+            template <typename... Args>
+            std::pair<iterator, bool> emplace(const std::string& name, Args&&... args) {
+                growIfNeeded(m_items.size() + 1);
+                std::size_t h    = hash(name);
+                std::size_t slot = findSlot(name, h);
+                if (m_slots[slot].s_index) {
+                    return {m_items.begin() + (m_slots[slot].s_index - 1), false};
+                }
+                m_items.emplace_back(
+                    std::piecewise_construct, std::forward_as_tuple(name),
+                    std::forward_as_tuple(std::forward<Args>(args)...)
+                );
+                m_slots[slot].s_hash  = h;
+                m_slots[slot].s_index = m_items.size();
+                return {m_items.end() - 1, true};
+            }
+            /**
+             * insert
+             *    std::map compatible insertion.
+             *  @param item - name/value pair.
+             *  @return std::pair<iterator, bool> - as for emplace.
+             */
+            std::pair<iterator, bool> insert(const value_type& item) {
+                return emplace(item.first, item.second);
+            }
+            /**
+             * operator[]
+             *  @param name - name of an item.
+             *  @return T& - the item, default constructed if it did not exist.
+             */
+            T& operator[](const std::string& name) {
+                return emplace(name).first->second;
+            }
+            /**
+             * reserve
+             *    Size the slot table for at least n items so it won't be
+             *    rebuilt until there are more than that.
+             *  @param n - number of items.
+             */
+            void reserve(std::size_t n) {
+                growIfNeeded(n);
+            }
+            /**
+             * clear
+             *    Remove all items.
+             */
+            void clear() {
+                m_items.clear();
+                m_slots.assign(INITIAL_SLOTS, Slot{0, 0});
+            }
+        private:
+            static std::uint32_t hash(const std::string& name) {
+                return std::hash<std::string>()(name);
+            }
+            /**
+             * findSlot
+             *    Linear probe for a name.
+             *  @return std::size_t - the index of the slot that holds it or
+             *             the empty slot where it would go.
+             */
+            std::size_t findSlot(const std::string& name, std::uint32_t h) const {
+                std::size_t mask = m_slots.size() - 1;
+                std::size_t slot = h & mask;
+                while (m_slots[slot].s_index) {
+                    if ((m_slots[slot].s_hash == h) &&
+                        (m_items[m_slots[slot].s_index - 1].first == name)) {
+                        break;
+                    }
+                    slot = (slot + 1) & mask;
+                }
+                return slot;
+            }
+            /**
+             * growIfNeeded
+             *    Keeps the slot table no more than half full by doubling it
+             *    and re-entering the slots.  The saved hashes are used so
+             *    the items themselves aren't touched.
+             *  @param n - number of items it needs to hold.
+             */
+            void growIfNeeded(std::size_t n) {
+                std::size_t nSlots = m_slots.size();
+                while (n*2 > nSlots) {
+                    nSlots *= 2;
+                }
+                if (nSlots != m_slots.size()) {
+                    std::vector<Slot> slots(nSlots, Slot{0, 0});
+                    std::size_t mask = nSlots - 1;
+                    for (auto& old : m_slots) {
+                        if (old.s_index) {
+                            std::size_t slot = old.s_hash & mask;
+                            while (slots[slot].s_index) {
+                                slot = (slot + 1) & mask;
+                            }
+                            slots[slot] = old;
+                        }
+                    }
+                    m_slots.swap(slots);
+                }
+            }
+        };
+    }
+}
+
+#endif
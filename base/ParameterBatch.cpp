@@ -0,0 +1,244 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  ParameterBatch.cpp
+ *  @brief: Implement the CParameterBatch class.
+ */
+#include "ParameterBatch.h"
+#include "ParameterItemPool.h"
+#include <stdexcept>
+#include <string.h>
+
+namespace frib {
+    namespace analysis {
+        const std::size_t CParameterBatch::DEFAULT_MAX_EVENTS(256);
+        const std::size_t CParameterBatch::DEFAULT_MAX_BYTES(256*1024);
+        
+        /**
+         * constructor
+         *    @param maxEvents - Maximum number of events in a batch.
+         *    @param maxBytes  - Size at which the batch is considered full.
+         *    @throw std::invalid_argument - if either limit is zero.
+         *    @note the buffer is reserved up front so that normally no
+         *          reallocation is needed as events are added.
+         */
+        CParameterBatch::CParameterBatch(
+            std::size_t maxEvents, std::size_t maxBytes
+        ) : m_nMaxEvents(maxEvents), m_nMaxBytes(maxBytes), m_nEvents(0)
+        {
+            if ((maxEvents == 0) || (maxBytes == 0)) {
+                throw std::invalid_argument(
+                    "Parameter batch limits must be non-zero"
+                );
+            }
+            m_buffer.reserve(maxBytes);
+        }
+        /**
+         * destructor
+         */
+        CParameterBatch::~CParameterBatch() {}
+        
+        /**
+         * addEvent
+         *    Marshall an event onto the end of the batch as a PARAMETER_DATA
+         *    ring item.
+         *
+         * @param event - the event as parameter number/value pairs.
+         * @param trigger - trigger number of the event.
+         */
+        void
+        CParameterBatch::addEvent(
+            const std::vector<std::pair<unsigned, double>>& event,
+            std::uint64_t trigger
+        ) {
+            pParameterValue p = allocateEvent(trigger, event.size());
+            for (const auto& param : event) {
+                p->s_number = param.first;
+                p->s_value  = param.second;
+                p++;
+            }
+        }
+        /**
+         * allocateEvent
+         *    Adds a PARAMETER_DATA ring item to the end of the batch, leaving
+         *    the parameter values for the caller to fill in.  This lets
+         *    the values be marshalled straight into the batch, e.g.:
+         *  \verbatim
+         *     CTreeParameter::collectEvent(
+         *         batch.allocateEvent(trigger, CTreeParameter::eventSize())
+         *     );
+         *  \endverbatim
+         *
+         * @param trigger - trigger number of the event.
+         * @param nParameters - number of parameter values in the event.
+         * @return ParameterValue* - where the caller puts the nParameters
+         *                    values.  Only valid until the batch is next modified.
+         */
+        ParameterValue*
+        CParameterBatch::allocateEvent(
+            std::uint64_t trigger, std::size_t nParameters
+        ) {
+            std::size_t itemSize =
+                sizeof(ParameterItem) + nParameters*sizeof(ParameterValue);
+            std::size_t offset = m_buffer.size();
+            m_buffer.resize(offset + itemSize);
+            
+            pParameterItem pItem =
+                reinterpret_cast<pParameterItem>(m_buffer.data() + offset);
+            pItem->s_header.s_size   = itemSize;
+            pItem->s_header.s_type   = PARAMETER_DATA;
+            pItem->s_header.s_unused = sizeof(std::uint32_t);
+            pItem->s_triggerCount    = trigger;
+            pItem->s_parameterCount  = nParameters;
+            m_nEvents++;
+            
+            return pItem->s_parameters;
+        }
+        /**
+         * clear
+         *    Empty the batch - normally done after it's been sent.
+         *    The buffer storage is kept for the next batch.
+         */
+        void
+        CParameterBatch::clear() {
+            m_buffer.clear();
+            m_nEvents = 0;
+        }
+        /**
+         * full
+         *   @return bool - true if the batch should be sent now.
+         */
+        bool
+        CParameterBatch::full() const {
+            return (m_nEvents >= m_nMaxEvents) || (m_buffer.size() >= m_nMaxBytes);
+        }
+        /**
+         * empty
+         *   @return bool - true if there are no events in the batch.
+         */
+        bool
+        CParameterBatch::empty() const {
+            return m_nEvents == 0;
+        }
+        /**
+         * data
+         *   @return const void* - pointer to the batch data.
+         */
+        const void*
+        CParameterBatch::data() const {
+            return m_buffer.data();
+        }
+        /**
+         * size
+         *   @return std::size_t - number of bytes in the batch.
+         */
+        std::size_t
+        CParameterBatch::size() const {
+            return m_buffer.size();
+        }
+        /**
+         * events
+         *   @return std::size_t - number of events in the batch.
+         */
+        std::size_t
+        CParameterBatch::events() const {
+            return m_nEvents;
+        }
+        /**
+         * validate
+         *    Check that a received batch is a whole number of PARAMETER_DATA
+         *    ring items.  COMPRESSED_PARAMETERS frames (see
+         *    CParameterCompressor) and PACKED_PARAMETER_DATA items (see
+         *    CParameterPacker) are also accepted since the farmer sorts
+         *    those without looking inside them.
+         * @param pData  - Pointer to the batch.
+         * @param nBytes - Number of bytes in the batch.
+         * @return std::size_t - number of items in the batch.
+         * @throw std::logic_error - the batch is malformed.
+         */
+        std::size_t
+        CParameterBatch::validate(const void* pData, std::size_t nBytes) {
+            const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(pData);
+            std::size_t nItems = 0;
+            while (nBytes) {
+                const RingItemHeader* pHeader =
+                    reinterpret_cast<const RingItemHeader*>(p);
+                if (
+                    (nBytes < sizeof(ParameterItem)) ||
+                    (pHeader->s_size < sizeof(ParameterItem)) ||
+                    (pHeader->s_size > nBytes)
+                ) {
+                    throw std::logic_error("Malformed parameter batch");
+                }
+                if (pHeader->s_type == COMPRESSED_PARAMETERS) {
+                    const CompressedParameters* pFrame =
+                        reinterpret_cast<const CompressedParameters*>(p);
+                    if (
+                        (pHeader->s_size < sizeof(CompressedParameters)) ||
+                        (pFrame->s_eventCount == 0)
+                    ) {
+                        throw std::logic_error("Malformed parameter batch");
+                    }
+                } else if (
+                    (pHeader->s_type != PARAMETER_DATA) &&
+                    (pHeader->s_type != PACKED_PARAMETER_DATA)
+                ) {
+                    throw std::logic_error("Malformed parameter batch");
+                }
+                nItems++;
+                nBytes -= pHeader->s_size;
+                p      += pHeader->s_size;
+            }
+            return nItems;
+        }
+        /**
+         * unpack
+         *    Given a received batch, split it up into individual, dynamically
+         *    allocated parameter items that can be handed off to a
+         *    CTriggerSorter (which takes ownership of them).  The items
+         *    are allocated from pPool if one is given, else with new.
+         *
+         * @param pData  - Pointer to the batch.
+         * @param nBytes - Number of bytes in the batch.
+         * @param items  - Items are appended to this vector.
+         * @param pPool  - Pool to allocate the items from (may be nullptr).
+         * @throw std::logic_error - the batch is not a whole number of
+         *        PARAMETER_DATA items.
+         */
+        void
+        CParameterBatch::unpack(
+            const void* pData, std::size_t nBytes,
+            std::vector<pParameterItem>& items, CParameterItemPool* pPool
+        ) {
+            std::size_t nItems = validate(pData, nBytes);
+            items.reserve(items.size() + nItems);
+            
+            const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(pData);
+            for (std::size_t i = 0; i < nItems; i++) {
+                const RingItemHeader* pHeader =
+                    reinterpret_cast<const RingItemHeader*>(p);
+                pParameterItem pItem = pPool ?
+                    pPool->allocate(pHeader->s_size) :
+                    reinterpret_cast<pParameterItem>(new std::uint8_t[pHeader->s_size]);
+                memcpy(pItem, p, pHeader->s_size);
+                items.push_back(pItem);
+                
+                p += pHeader->s_size;
+            }
+        }
+    }
+}
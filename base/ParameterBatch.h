@@ -0,0 +1,98 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  ParameterBatch.h
+ *  @brief: Packs several parameter events into one contiguous message.
+ */
+#ifndef PARAMETERBATCH_H
+#define PARAMETERBATCH_H
+#include "AnalysisRingItems.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <utility>
+
+namespace frib {
+    namespace analysis {
+        class CParameterItemPool;
+        /**
+         * @class CParameterBatch
+         *    Workers used to send each event to the farmer as a pair of
+         *    messages (a header and the parameter values).  At high event
+         *    rates the farmer spends most of its time in per message latency.
+         *    This class accumulates events in a single contiguous buffer so
+         *    that many of them can be shipped in one MPI_Send with the
+         *    MPI_PARAMETER_BATCH_TAG tag.
+         *
+         *    The wire format is just a sequence of PARAMETER_DATA ring items
+         *    (ParameterItem) - exactly what lands in the output file.
+         *    That means the farmer can walk the batch using the ring item
+         *    headers and needs no other framing.
+         *
+         *    A batch is considered full when it holds the maximum number
+         *    of events or its size reaches the byte limit.  The byte limit
+         *    is a soft limit: an event is always added in its entirety.
+         *    It's up to the client to send the batch when it's full (and at
+         *    natural boundaries, e.g. the end of a work item).
+         */
+        class CParameterBatch {
+        public:
+            static const std::size_t DEFAULT_MAX_EVENTS;
+            static const std::size_t DEFAULT_MAX_BYTES;
+        private:
+            std::size_t               m_nMaxEvents;
+            std::size_t               m_nMaxBytes;
+            std::size_t               m_nEvents;
+            std::vector<std::uint8_t> m_buffer;
+        public:
+            CParameterBatch(
+                std::size_t maxEvents = DEFAULT_MAX_EVENTS,
+                std::size_t maxBytes  = DEFAULT_MAX_BYTES
+            );
+            virtual ~CParameterBatch();
+        private:
+            CParameterBatch(const CParameterBatch& rhs);
+            CParameterBatch& operator=(const CParameterBatch& rhs);
+            int operator==(const CParameterBatch& rhs);
+            int operator!=(const CParameterBatch& rhs);
+        public:
+            void addEvent(
+                const std::vector<std::pair<unsigned, double>>& event,
+                std::uint64_t trigger
+            );
+            ParameterValue* allocateEvent(
+                std::uint64_t trigger, std::size_t nParameters
+            );
+            void clear();
+            
+            bool full() const;
+            bool empty() const;
+            const void* data() const;
+            std::size_t size() const;
+            std::size_t events() const;
+            
+            static std::size_t validate(const void* pData, std::size_t nBytes);
+            static void unpack(
+                const void* pData, std::size_t nBytes,
+                std::vector<pParameterItem>& items,
+                CParameterItemPool* pPool = nullptr
+            );
+        };
+    }
+}
+
+#endif
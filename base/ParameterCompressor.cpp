@@ -0,0 +1,301 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  ParameterCompressor.cpp
+ *  @brief: Implement the CParameterCompressor class.
+ */
+#include "ParameterCompressor.h"
+#include <zlib.h>
+#include <stdexcept>
+#include <string.h>
+
+namespace frib {
+    namespace analysis {
+        const int         CParameterCompressor::DEFAULT_LEVEL(1);
+        const std::size_t CParameterCompressor::MAX_FRAME_BYTES(1024*1024);
+        
+        /**
+         * isParameterItem [static]
+         *   @param type - a ring item type.
+         *   @return bool - true if frames can hold items of that type.
+         *           Packed items share the fixed part of ParameterItem so
+         *           their triggers are found the same way.
+         */
+        static bool
+        isParameterItem(std::uint32_t type) {
+            return (type == PARAMETER_DATA) || (type == PACKED_PARAMETER_DATA);
+        }
+        /**
+         * constructor
+         *    The zlib streams are made when first needed and reused
+         *    (reset) for each frame after that.
+         * @param level - zlib compression level 1 (fastest) - 9 (smallest).
+         * @throw std::invalid_argument - level out of range.
+         */
+        CParameterCompressor::CParameterCompressor(int level) :
+            m_nLevel(level), m_pDeflater(nullptr), m_pInflater(nullptr)
+        {
+            if ((level < Z_BEST_SPEED) || (level > Z_BEST_COMPRESSION)) {
+                throw std::invalid_argument(
+                    "CParameterCompressor - compression level must be in [1, 9]"
+                );
+            }
+        }
+        /**
+         * destructor
+         */
+        CParameterCompressor::~CParameterCompressor() {
+            if (m_pDeflater) {
+                deflateEnd(m_pDeflater);
+                delete m_pDeflater;
+            }
+            if (m_pInflater) {
+                inflateEnd(m_pInflater);
+                delete m_pInflater;
+            }
+        }
+        /**
+         * add
+         *    Compress a block of PARAMETER_DATA or PACKED_PARAMETER_DATA
+         *    items (e.g. a CParameterBatch) and append the resulting frames to the ones
+         *    we already hold.  A new frame is started whenever the trigger
+         *    of an item doesn't follow that of the previous one or the
+         *    frame would exceed MAX_FRAME_BYTES uncompressed.
+         *
+         * @param pItems - the items.
+         * @param nBytes - number of bytes of items.
+         * @throw std::logic_error - the block isn't a whole number of
+         *        parameter items.
+         */
+        void
+        CParameterCompressor::add(const void* pItems, std::size_t nBytes) {
+            const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(pItems);
+            const std::uint8_t* pRun = p;
+            std::size_t   runBytes  = 0;
+            std::uint32_t runEvents = 0;
+            std::uint64_t first     = 0;
+            
+            while (nBytes) {
+                const ParameterItem* pItem =
+                    reinterpret_cast<const ParameterItem*>(p);
+                if (
+                    (nBytes < sizeof(ParameterItem)) ||
+                    (pItem->s_header.s_size < sizeof(ParameterItem)) ||
+                    (pItem->s_header.s_size > nBytes) ||
+                    !isParameterItem(pItem->s_header.s_type)
+                ) {
+                    throw std::logic_error(
+                        "CParameterCompressor::add - malformed parameter items"
+                    );
+                }
+                std::size_t size = pItem->s_header.s_size;
+                if (
+                    runEvents && (
+                        (pItem->s_triggerCount != first + runEvents) ||
+                        (runBytes + size > MAX_FRAME_BYTES)
+                    )
+                ) {
+                    compressRun(pRun, runBytes, first, runEvents);
+                    runEvents = 0;
+                }
+                if (!runEvents) {
+                    pRun     = p;
+                    runBytes = 0;
+                    first    = pItem->s_triggerCount;
+                }
+                runEvents++;
+                runBytes += size;
+                
+                p      += size;
+                nBytes -= size;
+            }
+            if (runEvents) {
+                compressRun(pRun, runBytes, first, runEvents);
+            }
+        }
+        /**
+         * clear
+         *    Discard the frames we hold (e.g. after they've been sent).
+         */
+        void
+        CParameterCompressor::clear() {
+            m_frames.clear();
+        }
+        /**
+         * empty
+         *   @return bool - true if there are no frames.
+         */
+        bool
+        CParameterCompressor::empty() const {
+            return m_frames.empty();
+        }
+        /**
+         * data
+         *   @return const void* - pointer to the frames.
+         */
+        const void*
+        CParameterCompressor::data() const {
+            return m_frames.data();
+        }
+        /**
+         * size
+         *   @return std::size_t - number of bytes of frames.
+         */
+        std::size_t
+        CParameterCompressor::size() const {
+            return m_frames.size();
+        }
+        /**
+         * decompress
+         *    Inflate a frame and append the parameter items it holds
+         *    to a buffer.  Packed items are left packed.
+         *
+         * @param pFrame - the frame; its s_header.s_size must be trustworthy
+         *                (e.g. the item was read by a CDataReader).
+         * @param out    - the items are appended to this.
+         * @throw std::runtime_error - the frame is corrupt or does not hold
+         *                what its header says it does.
+         */
+        void
+        CParameterCompressor::decompress(
+            const CompressedParameters* pFrame, std::vector<std::uint8_t>& out
+        ) {
+            if (
+                (pFrame->s_header.s_type != COMPRESSED_PARAMETERS) ||
+                (pFrame->s_header.s_size < sizeof(CompressedParameters))
+            ) {
+                throw std::runtime_error(
+                    "CParameterCompressor::decompress - not a compressed parameter frame"
+                );
+            }
+            if (!m_pInflater) {
+                m_pInflater = new z_stream;
+                memset(m_pInflater, 0, sizeof(z_stream));
+                if (inflateInit(m_pInflater) != Z_OK) {
+                    delete m_pInflater;
+                    m_pInflater = nullptr;
+                    throw std::runtime_error(
+                        "CParameterCompressor::decompress - inflateInit failed"
+                    );
+                }
+            } else {
+                inflateReset(m_pInflater);
+            }
+            std::size_t start = out.size();
+            std::size_t nBytes = pFrame->s_uncompressedSize;
+            out.resize(start + nBytes);
+            
+            m_pInflater->next_in   = const_cast<Bytef*>(pFrame->s_data);
+            m_pInflater->avail_in  =
+                pFrame->s_header.s_size - sizeof(CompressedParameters);
+            m_pInflater->next_out  = out.data() + start;
+            m_pInflater->avail_out = nBytes;
+            int status = inflate(m_pInflater, Z_FINISH);
+            if ((status != Z_STREAM_END) || (m_pInflater->total_out != nBytes)) {
+                out.resize(start);
+                throw std::runtime_error(
+                    "CParameterCompressor::decompress - corrupt compressed parameter frame"
+                );
+            }
+            // Make sure we got the events the header promised:
+            
+            const std::uint8_t* p = out.data() + start;
+            std::uint32_t nEvents = 0;
+            while (nBytes) {
+                const ParameterItem* pItem =
+                    reinterpret_cast<const ParameterItem*>(p);
+                if (
+                    (nBytes < sizeof(ParameterItem)) ||
+                    (pItem->s_header.s_size < sizeof(ParameterItem)) ||
+                    (pItem->s_header.s_size > nBytes) ||
+                    !isParameterItem(pItem->s_header.s_type) ||
+                    (pItem->s_triggerCount != pFrame->s_firstTrigger + nEvents)
+                ) {
+                    break;
+                }
+                nEvents++;
+                nBytes -= pItem->s_header.s_size;
+                p      += pItem->s_header.s_size;
+            }
+            if (nBytes || (nEvents != pFrame->s_eventCount)) {
+                out.resize(start);
+                throw std::runtime_error(
+                    "CParameterCompressor::decompress - compressed frame contents don't match its header"
+                );
+            }
+        }
+        ///////////////////////////////////////////////////////////////////////
+        // Private utilities.
+        
+        /**
+         * compressRun
+         *    Compress a run of items with consecutive triggers into a
+         *    frame at the end of m_frames.
+         *
+         * @param pItems       - the items.
+         * @param nBytes       - number of bytes in the run.
+         * @param firstTrigger - trigger of the first item.
+         * @param nEvents      - number of items in the run.
+         */
+        void
+        CParameterCompressor::compressRun(
+            const std::uint8_t* pItems, std::size_t nBytes,
+            std::uint64_t firstTrigger, std::uint32_t nEvents
+        ) {
+            if (!m_pDeflater) {
+                m_pDeflater = new z_stream;
+                memset(m_pDeflater, 0, sizeof(z_stream));
+                if (deflateInit(m_pDeflater, m_nLevel) != Z_OK) {
+                    delete m_pDeflater;
+                    m_pDeflater = nullptr;
+                    throw std::runtime_error(
+                        "CParameterCompressor::add - deflateInit failed"
+                    );
+                }
+            } else {
+                deflateReset(m_pDeflater);
+            }
+            std::size_t start = m_frames.size();
+            std::size_t bound = deflateBound(m_pDeflater, nBytes);
+            m_frames.resize(start + sizeof(CompressedParameters) + bound);
+            
+            m_pDeflater->next_in   = const_cast<Bytef*>(pItems);
+            m_pDeflater->avail_in  = nBytes;
+            m_pDeflater->next_out  =
+                m_frames.data() + start + sizeof(CompressedParameters);
+            m_pDeflater->avail_out = bound;
+            if (deflate(m_pDeflater, Z_FINISH) != Z_STREAM_END) {
+                m_frames.resize(start);
+                throw std::runtime_error(
+                    "CParameterCompressor::add - deflate failed"
+                );
+            }
+            std::size_t frameSize =
+                sizeof(CompressedParameters) + m_pDeflater->total_out;
+            m_frames.resize(start + frameSize);
+            
+            pCompressedParameters pFrame =
+                reinterpret_cast<pCompressedParameters>(m_frames.data() + start);
+            pFrame->s_header.s_size          = frameSize;
+            pFrame->s_header.s_type          = COMPRESSED_PARAMETERS;
+            pFrame->s_header.s_unused        = sizeof(std::uint32_t);
+            pFrame->s_firstTrigger           = firstTrigger;
+            pFrame->s_eventCount             = nEvents;
+            pFrame->s_uncompressedSize       = nBytes;
+        }
+    }
+}
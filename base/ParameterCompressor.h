@@ -0,0 +1,87 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  ParameterCompressor.h
+ *  @brief: Compress parameter items into COMPRESSED_PARAMETERS frames.
+ */
+#ifndef PARAMETERCOMPRESSOR_H
+#define PARAMETERCOMPRESSOR_H
+#include "AnalysisRingItems.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct z_stream_s;
+
+namespace frib {
+    namespace analysis {
+        /**
+         * @class CParameterCompressor
+         *    Parameter files are large and mostly small doubles that
+         *    repeat a lot, so they compress well.  Compressing them in the
+         *    outputter would serialize the work on one rank, however.
+         *    Instead, workers compress their batches (in parallel) with
+         *    this class and the farmer and outputter just move the
+         *    resulting frames around.
+         *
+         *    A frame (CompressedParameters) is a zlib stream of
+         *    PARAMETER_DATA (or PACKED_PARAMETER_DATA, see
+         *    CParameterPacker) items with consecutive triggers.  Runs of
+         *    items handed to add are split into frames wherever the trigger
+         *    sequence breaks so the trigger sorter can treat a frame as
+         *    a single item that covers all of its triggers.
+         *
+         *    decompress reverses the process; CInflatingDataReader uses it
+         *    to hand the plain items to readers of the file.
+         */
+        class CParameterCompressor {
+        public:
+            static const int         DEFAULT_LEVEL;
+            static const std::size_t MAX_FRAME_BYTES;
+        private:
+            int                       m_nLevel;
+            z_stream_s*               m_pDeflater;
+            z_stream_s*               m_pInflater;
+            std::vector<std::uint8_t> m_frames;
+        public:
+            CParameterCompressor(int level = DEFAULT_LEVEL);
+            virtual ~CParameterCompressor();
+        private:
+            CParameterCompressor(const CParameterCompressor& rhs);
+            CParameterCompressor& operator=(const CParameterCompressor& rhs);
+            int operator==(const CParameterCompressor& rhs);
+            int operator!=(const CParameterCompressor& rhs);
+        public:
+            void add(const void* pItems, std::size_t nBytes);
+            void clear();
+            bool empty() const;
+            const void* data() const;
+            std::size_t size() const;
+            
+            void decompress(
+                const CompressedParameters* pFrame, std::vector<std::uint8_t>& out
+            );
+        private:
+            void compressRun(
+                const std::uint8_t* pItems, std::size_t nBytes,
+                std::uint64_t firstTrigger, std::uint32_t nEvents
+            );
+        };
+    }
+}
+
+#endif
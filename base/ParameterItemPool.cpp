@@ -0,0 +1,211 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  ParameterItemPool.cpp
+ *  @brief: Implement the CParameterItemPool class.
+ */
+#include "ParameterItemPool.h"
+#include <stdexcept>
+#include <string.h>
+
+static const std::size_t MIN_CHUNK_SIZE(64);   // Including the header.
+
+namespace frib {
+    namespace analysis {
+        const std::size_t CParameterItemPool::DEFAULT_SLAB_SIZE(1024*1024);
+        const std::size_t CParameterItemPool::DEFAULT_MAX_CHUNK_SIZE(256*1024);
+        
+        /**
+         * constructor
+         *    Set up the size classes.  These are powers of two from
+         *    MIN_CHUNK_SIZE until one that holds maxChunkSize bytes of user data.
+         *    No storage is allocated until it's needed.
+         *
+         * @param slabSize - bytes gotten from the heap at a time for a size
+         *                   class (more if a single chunk is bigger than this).
+         * @param maxChunkSize - largest request satisfied from the pool.
+         * @throw std::invalid_argument - if the slab size is zero.
+         */
+        CParameterItemPool::CParameterItemPool(
+            std::size_t slabSize, std::size_t maxChunkSize
+        ) : m_nSlabSize(slabSize)
+        {
+            if (slabSize == 0) {
+                throw std::invalid_argument("Parameter item pool slab size must be non-zero");
+            }
+            memset(&m_statistics, 0, sizeof(m_statistics));
+            std::size_t size = MIN_CHUNK_SIZE;
+            m_classSizes.push_back(size);
+            while ((size - sizeof(Chunk)) < maxChunkSize) {
+                size <<= 1;
+                m_classSizes.push_back(size);
+            }
+            m_freeLists.resize(m_classSizes.size(), nullptr);
+        }
+        /**
+         * destructor
+         *    Return the slabs to the heap.  Any items still in use are
+         *    invalid after this.
+         */
+        CParameterItemPool::~CParameterItemPool() {
+            for (auto p : m_slabs) {
+                delete []p;
+            }
+        }
+        /**
+         * allocate
+         *    Get storage for a parameter item.
+         * @param nBytes - number of bytes needed.
+         * @return pParameterItem - pointer to the storage.  The caller
+         *         fills it in.  Give it back with release.
+         */
+        pParameterItem
+        CParameterItemPool::allocate(std::size_t nBytes) {
+            m_statistics.s_allocations++;
+            
+            Chunk* pChunk;
+            std::size_t chunkSize;
+            unsigned c = sizeClass(nBytes);
+            if (c < m_classSizes.size()) {
+                if (!m_freeLists[c]) {
+                    addSlab(c);
+                }
+                pChunk = m_freeLists[c];
+                m_freeLists[c] = pChunk->s_pNext;
+                pChunk->s_sizeClass = c;
+                chunkSize = m_classSizes[c];
+                pChunk->s_nBytes = chunkSize;
+            } else {
+                chunkSize = nBytes + sizeof(Chunk);
+                pChunk = reinterpret_cast<Chunk*>(new std::uint8_t[chunkSize]);
+                pChunk->s_sizeClass = OVERSIZE;
+                pChunk->s_nBytes    = chunkSize;
+                m_statistics.s_oversizeAllocations++;
+                m_statistics.s_bytesHeld += chunkSize;
+            }
+            m_statistics.s_bytesInUse += chunkSize;
+            m_statistics.s_itemsInUse++;
+            if (m_statistics.s_bytesInUse > m_statistics.s_highWaterMark) {
+                m_statistics.s_highWaterMark = m_statistics.s_bytesInUse;
+            }
+            if (m_statistics.s_itemsInUse > m_statistics.s_maxItemsInUse) {
+                m_statistics.s_maxItemsInUse = m_statistics.s_itemsInUse;
+            }
+            return reinterpret_cast<pParameterItem>(pChunk + 1);
+        }
+        /**
+         * allocateItem
+         *    Get storage for a parameter item with the specified number
+         *    of parameters.  The ring item header, size and parameter count
+         *    are filled in.
+         * @param nParameters - number of parameters the item will hold.
+         * @return pParameterItem
+         */
+        pParameterItem
+        CParameterItemPool::allocateItem(std::uint32_t nParameters) {
+            std::size_t nBytes =
+                sizeof(ParameterItem) + nParameters*sizeof(ParameterValue);
+            pParameterItem pItem = allocate(nBytes);
+            pItem->s_header.s_size   = nBytes;
+            pItem->s_header.s_type   = PARAMETER_DATA;
+            pItem->s_header.s_unused = sizeof(std::uint32_t);
+            pItem->s_parameterCount  = nParameters;
+            return pItem;
+        }
+        /**
+         * release
+         *    Give storage back to the pool.
+         * @param pItem - an item returned from allocate or allocateItem.
+         */
+        void
+        CParameterItemPool::release(pParameterItem pItem) {
+            Chunk* pChunk = reinterpret_cast<Chunk*>(pItem) - 1;
+            std::uint64_t c = pChunk->s_sizeClass;
+            if (c == OVERSIZE) {
+                m_statistics.s_bytesInUse -= pChunk->s_nBytes;
+                m_statistics.s_bytesHeld  -= pChunk->s_nBytes;
+                delete [](reinterpret_cast<std::uint8_t*>(pChunk));
+            } else if (c < m_classSizes.size()) {
+                m_statistics.s_bytesInUse -= pChunk->s_nBytes;
+                pChunk->s_pNext = m_freeLists[c];
+                m_freeLists[c]  = pChunk;
+            } else {
+                throw std::logic_error("Releasing an item not from a CParameterItemPool");
+            }
+            m_statistics.s_itemsInUse--;
+        }
+        /**
+         * getStatistics
+         *   @return const Statistics& - the pool's usage statistics.
+         */
+        const CParameterItemPool::Statistics&
+        CParameterItemPool::getStatistics() const {
+            return m_statistics;
+        }
+        /**
+         * maxChunkSize
+         *    @return std::size_t - largest request that comes from a slab
+         *          rather than directly from the heap.
+         */
+        std::size_t
+        CParameterItemPool::maxChunkSize() const {
+            return m_classSizes.back() - sizeof(Chunk);
+        }
+        ///////////////////////////////////////////////////////////////////////
+        // Private utilities.
+        
+        /**
+         * sizeClass
+         *    @param nBytes - user bytes needed.
+         *    @return unsigned - size class that holds them.  If this is
+         *       m_classSizes.size() the request is too big to pool.
+         */
+        unsigned
+        CParameterItemPool::sizeClass(std::size_t nBytes) const {
+            std::size_t needed = nBytes + sizeof(Chunk);
+            unsigned c = 0;
+            while ((c < m_classSizes.size()) && (m_classSizes[c] < needed)) {
+                c++;
+            }
+            return c;
+        }
+        /**
+         * addSlab
+         *    Allocate a slab for a size class and thread its chunks onto the
+         *    class's free list.  A slab is at least one chunk.
+         * @param sizeClass - the size class that needs more chunks.
+         */
+        void
+        CParameterItemPool::addSlab(unsigned sizeClass) {
+            std::size_t chunkSize = m_classSizes[sizeClass];
+            std::size_t nChunks   = m_nSlabSize/chunkSize;
+            if (nChunks == 0) nChunks = 1;
+            std::size_t slabBytes = nChunks*chunkSize;
+            
+            std::uint8_t* pSlab = new std::uint8_t[slabBytes];
+            m_slabs.push_back(pSlab);
+            m_statistics.s_slabAllocations++;
+            m_statistics.s_bytesHeld += slabBytes;
+            
+            for (std::size_t i = 0; i < nChunks; i++) {
+                Chunk* pChunk = reinterpret_cast<Chunk*>(pSlab + i*chunkSize);
+                pChunk->s_pNext = m_freeLists[sizeClass];
+                m_freeLists[sizeClass] = pChunk;
+            }
+        }
+    }
+}
@@ -0,0 +1,108 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  ParameterItemPool.h
+ *  @brief: Size classed pool of storage for ParameterItems.
+ */
+#ifndef PARAMETERITEMPOOL_H
+#define PARAMETERITEMPOOL_H
+#include "AnalysisRingItems.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace frib {
+    namespace analysis {
+        /**
+         * @class CParameterItemPool
+         *    The farmer used to new a buffer for every event it received and
+         *    the sorter deleted it once the event was sent on.  This pool
+         *    recycles that storage so that, once the pool has grown to hold
+         *    the in-flight events, no heap allocations are done per event.
+         *
+         *    Storage is organized in power of two size classes.  Each class
+         *    is carved out of slabs allocated from the heap and keeps a free
+         *    list threaded through its free chunks.  Each chunk is preceded
+         *    by a small header that records its size class so that release
+         *    need not be told the size.  Requests bigger than the largest
+         *    class are satisfied directly from the heap (and are counted
+         *    in the statistics).  Slabs are only returned to the heap when
+         *    the pool is destroyed, so all items must be released first.
+         *
+         *    The pool is not thread-safe; it's meant to be owned by the
+         *    single threaded farmer and shared with its sorter.
+         */
+        class CParameterItemPool {
+        public:
+            static const std::size_t DEFAULT_SLAB_SIZE;
+            static const std::size_t DEFAULT_MAX_CHUNK_SIZE;
+            
+            /**
+             * Statistics - what the pool's doing, for sizing it to
+             * a memory budget:
+             */
+            typedef struct _Statistics {
+                std::size_t s_bytesHeld;           // From the heap now.
+                std::size_t s_bytesInUse;          // Chunks handed out now.
+                std::size_t s_highWaterMark;       // Max of s_bytesInUse.
+                std::size_t s_itemsInUse;
+                std::size_t s_maxItemsInUse;
+                std::size_t s_allocations;         // Total allocate calls.
+                std::size_t s_slabAllocations;     // Slabs gotten from heap.
+                std::size_t s_oversizeAllocations; // Too big to pool.
+            } Statistics;
+        private:
+            struct Chunk {               // Header preceding the user storage.
+                union {
+                    std::uint64_t s_sizeClass;
+                    Chunk*        s_pNext;   // When on a free list.
+                };
+                std::uint64_t s_nBytes;  // Size of the chunk, header included.
+            };
+            static const std::uint64_t OVERSIZE = ~std::uint64_t(0);
+            
+            std::size_t                m_nSlabSize;
+            std::vector<std::size_t>   m_classSizes;   // Including the header.
+            std::vector<Chunk*>        m_freeLists;
+            std::vector<std::uint8_t*> m_slabs;
+            Statistics                 m_statistics;
+        public:
+            CParameterItemPool(
+                std::size_t slabSize = DEFAULT_SLAB_SIZE,
+                std::size_t maxChunkSize = DEFAULT_MAX_CHUNK_SIZE
+            );
+            virtual ~CParameterItemPool();
+        private:
+            CParameterItemPool(const CParameterItemPool& rhs);
+            CParameterItemPool& operator=(const CParameterItemPool& rhs);
+            int operator==(const CParameterItemPool& rhs);
+            int operator!=(const CParameterItemPool& rhs);
+        public:
+            pParameterItem allocate(std::size_t nBytes);
+            pParameterItem allocateItem(std::uint32_t nParameters);
+            void release(pParameterItem pItem);
+            
+            const Statistics& getStatistics() const;
+            std::size_t maxChunkSize() const;
+        private:
+            unsigned sizeClass(std::size_t nBytes) const;
+            void addSlab(unsigned sizeClass);
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,362 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+/** @file:  ParameterPacker.cpp
+ *  @brief: Implement the CParameterPacker class.
+ */
+#include "ParameterPacker.h"
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string.h>
+
+namespace frib {
+    namespace analysis {
+        /**
+         * valueSize [static]
+         *   @param type - a VALUE_* type.
+         *   @return std::size_t - bytes a value of that type occupies.
+         *   @retval 0 - not a valid type.
+         */
+        static std::size_t
+        valueSize(std::uint32_t type) {
+            switch (type) {
+            case VALUE_DOUBLE:
+                return sizeof(double);
+            case VALUE_FLOAT32:
+                return sizeof(float);
+            case VALUE_UINT16:
+                return sizeof(std::uint16_t);
+            case VALUE_UINT32:
+                return sizeof(std::uint32_t);
+            default:
+                return 0;
+            }
+        }
+        /**
+         * constructor
+         *   @param types - the VALUE_* storage type of each parameter,
+         *                indexed by parameter number (see
+         *                CTreeParameter::getStorageTypes).  Parameters past
+         *                the end are stored as doubles.
+         */
+        CParameterPacker::CParameterPacker(
+            const std::vector<std::uint32_t>& types
+        ) : m_types(types)
+        {}
+        /**
+         * destructor
+         */
+        CParameterPacker::~CParameterPacker() {}
+        
+        /**
+         * packs [static]
+         *   @param types - storage types as for the constructor.
+         *   @return bool - true if packing with these types would store
+         *           anything in less than a double.  If not, there's no
+         *           point in packing.
+         */
+        bool
+        CParameterPacker::packs(const std::vector<std::uint32_t>& types) {
+            for (auto type : types) {
+                if (type != VALUE_DOUBLE) return true;
+            }
+            return false;
+        }
+        /**
+         * add
+         *    Pack a block of PARAMETER_DATA items (e.g. a CParameterBatch)
+         *    and append the resulting PACKED_PARAMETER_DATA items to the
+         *    ones we already hold.  Item order, and therefore trigger
+         *    order, is preserved.
+         *
+         * @param pItems - the items.
+         * @param nBytes - number of bytes of items.
+         * @throw std::logic_error - the block isn't a whole number of
+         *        PARAMETER_DATA items or has a parameter number too big
+         *        to pack.
+         */
+        void
+        CParameterPacker::add(const void* pItems, std::size_t nBytes) {
+            const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(pItems);
+            while (nBytes) {
+                const ParameterItem* pItem =
+                    reinterpret_cast<const ParameterItem*>(p);
+                if (
+                    (nBytes < sizeof(ParameterItem)) ||
+                    (pItem->s_header.s_size < sizeof(ParameterItem)) ||
+                    (pItem->s_header.s_size > nBytes) ||
+                    (pItem->s_header.s_type != PARAMETER_DATA) ||
+                    (
+                        pItem->s_header.s_size !=
+                        sizeof(ParameterItem) +
+                            pItem->s_parameterCount * sizeof(ParameterValue)
+                    )
+                ) {
+                    throw std::logic_error(
+                        "CParameterPacker::add - malformed parameter items"
+                    );
+                }
+                pack(pItem);
+                
+                p      += pItem->s_header.s_size;
+                nBytes -= pItem->s_header.s_size;
+            }
+        }
+        /**
+         * clear
+         *    Discard the items we hold (e.g. after they've been sent).
+         */
+        void
+        CParameterPacker::clear() {
+            m_items.clear();
+        }
+        /**
+         * empty
+         *   @return bool - true if there are no items.
+         */
+        bool
+        CParameterPacker::empty() const {
+            return m_items.empty();
+        }
+        /**
+         * data
+         *   @return const void* - pointer to the packed items.
+         */
+        const void*
+        CParameterPacker::data() const {
+            return m_items.data();
+        }
+        /**
+         * size
+         *   @return std::size_t - number of bytes of packed items.
+         */
+        std::size_t
+        CParameterPacker::size() const {
+            return m_items.size();
+        }
+        /**
+         * widen [static]
+         *    Append the PARAMETER_DATA item equivalent to a packed item
+         *    to a buffer.
+         *
+         * @param pItem - the packed item; its s_header.s_size must be
+         *                trustworthy (e.g. the item was read by a CDataReader).
+         * @param out   - the item is appended to this.
+         * @throw std::runtime_error - the item is not a well formed packed
+         *                item.  out is left as it was.
+         */
+        void
+        CParameterPacker::widen(
+            const PackedParameterItem* pItem, std::vector<std::uint8_t>& out
+        ) {
+            // The smallest entry is a uint16:
+            
+            if (
+                (pItem->s_header.s_type != PACKED_PARAMETER_DATA) ||
+                (pItem->s_header.s_size < sizeof(PackedParameterItem)) ||
+                (
+                    std::uint64_t(pItem->s_parameterCount) *
+                        (sizeof(std::uint32_t) + sizeof(std::uint16_t)) >
+                    pItem->s_header.s_size - sizeof(PackedParameterItem)
+                )
+            ) {
+                throw std::runtime_error(
+                    "CParameterPacker::widen - not a packed parameter item"
+                );
+            }
+            std::uint32_t nParams = pItem->s_parameterCount;
+            std::size_t   start   = out.size();
+            out.resize(
+                start + sizeof(ParameterItem) + nParams * sizeof(ParameterValue)
+            );
+            pParameterItem pWide =
+                reinterpret_cast<pParameterItem>(out.data() + start);
+            pWide->s_header.s_size   = out.size() - start;
+            pWide->s_header.s_type   = PARAMETER_DATA;
+            pWide->s_header.s_unused = sizeof(std::uint32_t);
+            pWide->s_triggerCount    = pItem->s_triggerCount;
+            pWide->s_parameterCount  = nParams;
+            
+            const std::uint8_t* p    = pItem->s_data;
+            const std::uint8_t* pEnd =
+                reinterpret_cast<const std::uint8_t*>(pItem) +
+                pItem->s_header.s_size;
+            for (std::uint32_t i = 0; i < nParams; i++) {
+                std::uint32_t tag;
+                std::size_t   vsize = 0;
+                if (std::size_t(pEnd - p) >= sizeof(tag)) {
+                    memcpy(&tag, p, sizeof(tag));
+                    p += sizeof(tag);
+                    vsize = valueSize(tag >> PACKED_TYPE_SHIFT);
+                }
+                if (!vsize || (std::size_t(pEnd - p) < vsize)) {
+                    out.resize(start);
+                    throw std::runtime_error(
+                        "CParameterPacker::widen - corrupt packed parameter item"
+                    );
+                }
+                double value;
+                switch (tag >> PACKED_TYPE_SHIFT) {
+                case VALUE_DOUBLE:
+                    memcpy(&value, p, sizeof(double));
+                    break;
+                case VALUE_FLOAT32:
+                    {
+                        float f;
+                        memcpy(&f, p, sizeof(float));
+                        value = f;
+                    }
+                    break;
+                case VALUE_UINT16:
+                    {
+                        std::uint16_t u;
+                        memcpy(&u, p, sizeof(u));
+                        value = u;
+                    }
+                    break;
+                case VALUE_UINT32:
+                    {
+                        std::uint32_t u;
+                        memcpy(&u, p, sizeof(u));
+                        value = u;
+                    }
+                    break;
+                }
+                p += vsize;
+                pWide->s_parameters[i].s_number = tag & PACKED_NUMBER_MASK;
+                pWide->s_parameters[i].s_value  = value;
+            }
+            if (p != pEnd) {
+                out.resize(start);
+                throw std::runtime_error(
+                    "CParameterPacker::widen - packed parameter item has trailing data"
+                );
+            }
+        }
+        ///////////////////////////////////////////////////////////////////////
+        // Private utilities.
+        
+        /**
+         * pack
+         *    Append the packed equivalent of a parameter item to m_items.
+         * @param pItem - the item, already validated by add.
+         */
+        void
+        CParameterPacker::pack(const ParameterItem* pItem) {
+            std::size_t start = m_items.size();
+            std::uint32_t nParams = pItem->s_parameterCount;
+            
+            // Reserve the worst case (all doubles) and trim afterwards:
+            
+            m_items.resize(
+                start + sizeof(PackedParameterItem) +
+                nParams * (sizeof(std::uint32_t) + sizeof(double))
+            );
+            std::uint8_t* p = m_items.data() + start + sizeof(PackedParameterItem);
+            for (std::uint32_t i = 0; i < nParams; i++) {
+                std::uint32_t number = pItem->s_parameters[i].s_number;
+                double        value  = pItem->s_parameters[i].s_value;
+                if (number > PACKED_NUMBER_MASK) {
+                    m_items.resize(start);
+                    throw std::logic_error(
+                        "CParameterPacker::add - parameter number too big to pack"
+                    );
+                }
+                std::uint32_t type = typeOf(number, value);
+                std::uint32_t tag  = number | (type << PACKED_TYPE_SHIFT);
+                memcpy(p, &tag, sizeof(tag));
+                p += sizeof(tag);
+                switch (type) {
+                case VALUE_DOUBLE:
+                    memcpy(p, &value, sizeof(double));
+                    break;
+                case VALUE_FLOAT32:
+                    {
+                        float f = value;
+                        memcpy(p, &f, sizeof(float));
+                    }
+                    break;
+                case VALUE_UINT16:
+                    {
+                        std::uint16_t u = value;
+                        memcpy(p, &u, sizeof(u));
+                    }
+                    break;
+                case VALUE_UINT32:
+                    {
+                        std::uint32_t u = value;
+                        memcpy(p, &u, sizeof(u));
+                    }
+                    break;
+                }
+                p += valueSize(type);
+            }
+            m_items.resize(p - m_items.data());
+            
+            pPackedParameterItem pPacked =
+                reinterpret_cast<pPackedParameterItem>(m_items.data() + start);
+            pPacked->s_header.s_size   = m_items.size() - start;
+            pPacked->s_header.s_type   = PACKED_PARAMETER_DATA;
+            pPacked->s_header.s_unused = sizeof(std::uint32_t);
+            pPacked->s_triggerCount    = pItem->s_triggerCount;
+            pPacked->s_parameterCount  = nParams;
+        }
+        /**
+         * typeOf
+         *    Decide how to store a value.
+         *
+         * @param number - the parameter number.
+         * @param value  - its value.
+         * @return std::uint32_t - the VALUE_* type to store it as.  This is
+         *         the parameter's storage type unless that can't represent
+         *         the value, in which case it's VALUE_DOUBLE.
+         */
+        std::uint32_t
+        CParameterPacker::typeOf(std::uint32_t number, double value) const {
+            std::uint32_t type =
+                number < m_types.size() ? m_types[number] : VALUE_DOUBLE;
+            switch (type) {
+            case VALUE_FLOAT32:
+                if (
+                    std::isfinite(value) &&
+                    (std::fabs(value) > std::numeric_limits<float>::max())
+                ) {
+                    type = VALUE_DOUBLE;
+                }
+                break;
+            case VALUE_UINT16:
+            case VALUE_UINT32:
+                {
+                    double max = (type == VALUE_UINT16) ?
+                        std::numeric_limits<std::uint16_t>::max() :
+                        std::numeric_limits<std::uint32_t>::max();
+                    if (
+                        !(value >= 0.0) || (value > max) ||
+                        (std::trunc(value) != value) || std::signbit(value)
+                    ) {
+                        type = VALUE_DOUBLE;
+                    }
+                }
+                break;
+            default:
+                type = VALUE_DOUBLE;
+                break;
+            }
+            return type;
+        }
+    }
+}
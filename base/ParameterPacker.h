@@ -0,0 +1,80 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+/** @file:  ParameterPacker.h
+ *  @brief: Store parameter values in the precision they need.
+ */
+#ifndef PARAMETERPACKER_H
+#define PARAMETERPACKER_H
+#include "AnalysisRingItems.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace frib {
+    namespace analysis {
+        /**
+         * @class CParameterPacker
+         *    Most parameters are ADC channels or calibrated values that
+         *    don't need a double's precision.  Their tree parameters can
+         *    declare a storage type (CTreeParameter::setStorage) and workers
+         *    use this class to turn their PARAMETER_DATA items into
+         *    PACKED_PARAMETER_DATA items that store each value in its
+         *    parameter's type before they send them on.
+         *
+         *    -  VALUE_UINT16 and VALUE_UINT32 values are stored that way only
+         *       if they are integers the type can hold; others stay doubles
+         *       so nothing is lost.
+         *    -  VALUE_FLOAT32 values are rounded to float.  Values too big
+         *       for a float stay doubles.
+         *
+         *    widen turns a packed item back into a PARAMETER_DATA item.
+         *    Packed entries say what type they are so widening doesn't need
+         *    the storage types.  CInflatingDataReader uses it so readers of
+         *    parameter files only ever see doubles.
+         */
+        class CParameterPacker {
+        private:
+            std::vector<std::uint32_t> m_types;     // Indexed by parameter number.
+            std::vector<std::uint8_t>  m_items;
+        public:
+            CParameterPacker(const std::vector<std::uint32_t>& types);
+            virtual ~CParameterPacker();
+        private:
+            CParameterPacker(const CParameterPacker& rhs);
+            CParameterPacker& operator=(const CParameterPacker& rhs);
+            int operator==(const CParameterPacker& rhs);
+            int operator!=(const CParameterPacker& rhs);
+        public:
+            static bool packs(const std::vector<std::uint32_t>& types);
+            
+            void add(const void* pItems, std::size_t nBytes);
+            void clear();
+            bool empty() const;
+            const void* data() const;
+            std::size_t size() const;
+            
+            static void widen(
+                const PackedParameterItem* pItem, std::vector<std::uint8_t>& out
+            );
+        private:
+            void pack(const ParameterItem* pItem);
+            std::uint32_t typeOf(std::uint32_t number, double value) const;
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,259 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+
+/** @file:  ParameterPatterns.cpp
+ *  @brief: Implement the parameter pattern dictionary.
+ */
+#include "ParameterPatterns.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string.h>
+
+namespace frib {
+    namespace analysis {
+        const std::uint32_t CParameterPatterns::NO_PATTERN(0xffffffff);
+        
+        /**
+         * PatternHash::operator()
+         *    FNV-1a over the parameter numbers of a pattern.
+         * @param pattern - the pattern.
+         * @return std::size_t - its hash.
+         */
+        std::size_t
+        CParameterPatterns::PatternHash::operator()(const Pattern& pattern) const {
+            std::uint64_t h = 14695981039346656037ULL;
+            for (auto n : pattern) {
+                h ^= n;
+                h *= 1099511628211ULL;
+            }
+            return h;
+        }
+        /**
+         * constructor
+         *    The dictionary starts out empty.
+         */
+        CParameterPatterns::CParameterPatterns() {}
+        /**
+         * destructor
+         */
+        CParameterPatterns::~CParameterPatterns() {}
+        
+        /**
+         * lookup
+         *    @param numbers - sorted parameter numbers of an event.
+         *    @return std::uint32_t - the number of that pattern or
+         *            NO_PATTERN if it's not been defined.
+         */
+        std::uint32_t
+        CParameterPatterns::lookup(const Pattern& numbers) const {
+            auto p = m_index.find(numbers);
+            return p == m_index.end() ? NO_PATTERN : p->second;
+        }
+        /**
+         * add
+         *    Define a new pattern.
+         * @param numbers - sorted parameter numbers of the pattern.
+         * @return std::uint32_t - the number of the pattern.
+         * @throw std::logic_error - the pattern is already defined.
+         * @throw std::length_error - there's no number left for it.
+         */
+        std::uint32_t
+        CParameterPatterns::add(const Pattern& numbers) {
+            if (m_index.count(numbers)) {
+                throw std::logic_error(
+                    "CParameterPatterns::add - pattern is already defined"
+                );
+            }
+            if (m_patterns.size() >= NO_PATTERN) {
+                throw std::length_error(
+                    "CParameterPatterns::add - too many patterns"
+                );
+            }
+            std::uint32_t index = m_patterns.size();
+            m_patterns.push_back(numbers);
+            m_index[numbers] = index;
+            return index;
+        }
+        /**
+         * pattern
+         *    @param index - a pattern number.
+         *    @return const Pattern& - the parameter numbers of that pattern.
+         *    @throw std::out_of_range - no such pattern.
+         */
+        const CParameterPatterns::Pattern&
+        CParameterPatterns::pattern(std::uint32_t index) const {
+            if (index >= m_patterns.size()) {
+                throw std::out_of_range(
+                    "CParameterPatterns::pattern - no such pattern"
+                );
+            }
+            return m_patterns[index];
+        }
+        /**
+         * size
+         *    @return std::size_t - number of patterns defined.
+         */
+        std::size_t
+        CParameterPatterns::size() const {
+            return m_patterns.size();
+        }
+        /**
+         * clear
+         *    Forget all patterns (e.g. before reading another file).
+         */
+        void
+        CParameterPatterns::clear() {
+            m_patterns.clear();
+            m_index.clear();
+        }
+        /**
+         * define
+         *    Define the patterns in a PARAMETER_PATTERNS item.
+         * @param pItem - the item; its s_header.s_size must be
+         *                trustworthy (e.g. the item was read by a CDataReader).
+         *    Patterns the item defines that are already defined identically
+         *    are skipped; that happens when a reader has seeked and was
+         *    given the file's patterns as context (see CTriggerIndex).
+         * @throw std::runtime_error - the item is not well formed, leaves a
+         *        gap in the pattern numbering, conflicts with an existing
+         *        pattern or redefines a pattern.
+         *        No patterns are defined in that case.
+         */
+        void
+        CParameterPatterns::define(const ParameterPatterns* pItem) {
+            if (
+                (pItem->s_header.s_type != PARAMETER_PATTERNS) ||
+                (pItem->s_header.s_size < sizeof(ParameterPatterns))
+            ) {
+                throw std::runtime_error(
+                    "CParameterPatterns::define - not a parameter patterns item"
+                );
+            }
+            if (pItem->s_firstPattern > m_patterns.size()) {
+                throw std::runtime_error(
+                    "CParameterPatterns::define - patterns are not defined in order"
+                );
+            }
+            std::size_t nWords =
+                (pItem->s_header.s_size - sizeof(ParameterPatterns))/sizeof(std::uint32_t);
+            std::size_t next = 0;
+            std::vector<Pattern> patterns;
+            for (std::uint32_t i = 0; i < pItem->s_patternCount; i++) {
+                std::uint32_t n = 0;
+                if (next < nWords) {
+                    memcpy(&n, pItem->s_data + next, sizeof(n));
+                    next++;
+                }
+                if ((next > nWords) || (n > nWords - next)) {
+                    throw std::runtime_error(
+                        "CParameterPatterns::define - corrupt parameter patterns item"
+                    );
+                }
+                patterns.push_back(Pattern(n));
+                if (n) {
+                    memcpy(patterns.back().data(), pItem->s_data + next, n * sizeof(std::uint32_t));
+                }
+                next += n;
+            }
+            // Patterns we already have must match:
+            
+            std::size_t nKnown = std::min(
+                patterns.size(), m_patterns.size() - pItem->s_firstPattern
+            );
+            for (std::size_t i = 0; i < nKnown; i++) {
+                if (patterns[i] != m_patterns[pItem->s_firstPattern + i]) {
+                    throw std::runtime_error(
+                        "CParameterPatterns::define - pattern conflicts with its definition"
+                    );
+                }
+            }
+            // A redefinition undoes the patterns this item already added:
+            
+            std::size_t nBefore = m_patterns.size();
+            try {
+                for (std::size_t i = nKnown; i < patterns.size(); i++) {
+                    add(patterns[i]);
+                }
+            }
+            catch (std::logic_error&) {
+                while (m_patterns.size() > nBefore) {
+                    m_index.erase(m_patterns.back());
+                    m_patterns.pop_back();
+                }
+                throw std::runtime_error(
+                    "CParameterPatterns::define - pattern is defined twice"
+                );
+            }
+        }
+        /**
+         * expand
+         *    Append the PARAMETER_DATA item equivalent to a pattern item
+         *    to a buffer.
+         * @param pItem - the pattern item; its s_header.s_size must be
+         *                trustworthy.
+         * @param out   - the item is appended to this.
+         * @throw std::runtime_error - the item is not well formed or its
+         *        pattern has not been defined.  out is left as it was.
+         */
+        void
+        CParameterPatterns::expand(
+            const PatternParameterItem* pItem, std::vector<std::uint8_t>& out
+        ) const {
+            if (
+                (pItem->s_header.s_type != PATTERN_PARAMETER_DATA) ||
+                (pItem->s_header.s_size < sizeof(PatternParameterItem))
+            ) {
+                throw std::runtime_error(
+                    "CParameterPatterns::expand - not a pattern parameter item"
+                );
+            }
+            if (pItem->s_pattern >= m_patterns.size()) {
+                throw std::runtime_error(
+                    "CParameterPatterns::expand - item uses an undefined pattern"
+                );
+            }
+            const Pattern& numbers(m_patterns[pItem->s_pattern]);
+            if (
+                pItem->s_header.s_size - sizeof(PatternParameterItem) !=
+                numbers.size() * sizeof(double)
+            ) {
+                throw std::runtime_error(
+                    "CParameterPatterns::expand - values don't match the pattern"
+                );
+            }
+            std::size_t start = out.size();
+            out.resize(
+                start + sizeof(ParameterItem) + numbers.size() * sizeof(ParameterValue)
+            );
+            pParameterItem pWide =
+                reinterpret_cast<pParameterItem>(out.data() + start);
+            pWide->s_header.s_size   = out.size() - start;
+            pWide->s_header.s_type   = PARAMETER_DATA;
+            pWide->s_header.s_unused = sizeof(std::uint32_t);
+            pWide->s_triggerCount    = pItem->s_triggerCount;
+            pWide->s_parameterCount  = numbers.size();
+            for (std::size_t i = 0; i < numbers.size(); i++) {
+                pWide->s_parameters[i].s_number = numbers[i];
+                memcpy(
+                    &pWide->s_parameters[i].s_value, pItem->s_values + i,
+                    sizeof(double)
+                );
+            }
+        }
+    }
+}
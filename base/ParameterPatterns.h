@@ -0,0 +1,79 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+
+/** @file:  ParameterPatterns.h
+ *  @brief: Dictionary of the parameter number sets events use.
+ */
+#ifndef PARAMETERPATTERNS_H
+#define PARAMETERPATTERNS_H
+#include "AnalysisRingItems.h"
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace frib {
+    namespace analysis {
+        /**
+         * @class CParameterPatterns
+         *    Most events set one of a few combinations of parameters.  A
+         *    pattern is the sorted list of the parameter numbers an event
+         *    sets and this class numbers the patterns of a file in the order
+         *    they are first seen.  CPatternDataWriter uses it to write each
+         *    event as its pattern number and values only, defining new
+         *    patterns in PARAMETER_PATTERNS items as they appear.  Readers
+         *    define the patterns from those items and can then
+         *    expand PATTERN_PARAMETER_DATA items back to PARAMETER_DATA or
+         *    go straight to a value: the values of pattern events are in
+         *    pattern order so, once a parameter's slot in a pattern is
+         *    known, it is the same for every event with that pattern.
+         */
+        class CParameterPatterns {
+        public:
+            typedef std::vector<std::uint32_t> Pattern;
+            static const std::uint32_t NO_PATTERN;
+        private:
+            struct PatternHash {
+                std::size_t operator()(const Pattern& pattern) const;
+            };
+            std::vector<Pattern>                                m_patterns;
+            std::unordered_map<Pattern, std::uint32_t, PatternHash> m_index;
+        public:
+            CParameterPatterns();
+            virtual ~CParameterPatterns();
+        private:
+            CParameterPatterns(const CParameterPatterns& rhs);
+            CParameterPatterns& operator=(const CParameterPatterns& rhs);
+            int operator==(const CParameterPatterns& rhs);
+            int operator!=(const CParameterPatterns& rhs);
+        public:
+            std::uint32_t lookup(const Pattern& numbers) const;
+            std::uint32_t add(const Pattern& numbers);
+            const Pattern& pattern(std::uint32_t index) const;
+            std::size_t size() const;
+            void clear();
+            
+            void define(const ParameterPatterns* pItem);
+            void expand(
+                const PatternParameterItem* pItem, std::vector<std::uint8_t>& out
+            ) const;
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,238 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+
+/** @file:  PatternDataWriter.cpp
+ *  @brief: Implement the pattern data writer.
+ */
+#include "PatternDataWriter.h"
+#include "ParameterPacker.h"
+#include <algorithm>
+
+namespace frib {
+    namespace analysis {
+        // Real data have tens to hundreds of patterns.  This is far more
+        // than that but still bounds the dictionary if the data don't
+        // repeat patterns.
+        
+        const std::size_t CPatternDataWriter::MAX_PATTERNS(65536);
+        
+        /**
+         * constructor
+         *   @param pFilename - path to the output file.
+         *   @param bufferSize - Number of bytes of output buffering,
+         *                      0 means writes are not buffered.
+         *   @param indexInterval - If nonzero, the file is indexed with an
+         *                      entry every indexInterval items.
+         */
+        CPatternDataWriter::CPatternDataWriter(
+            const char* pFilename, std::size_t bufferSize,
+            std::uint32_t indexInterval
+        ) :
+            CDataWriter(pFilename, bufferSize, indexInterval)
+        {}
+        /**
+         * constructor from fd
+         *   @param fd - file descriptor already open on the output file.
+         *   @param bufferSize - Number of bytes of output buffering,
+         *                      0 means writes are not buffered.
+         */
+        CPatternDataWriter::CPatternDataWriter(int fd, std::size_t bufferSize) :
+            CDataWriter(fd, bufferSize)
+        {}
+        /**
+         * destructor
+         *    Nothing is held back so the base class does all the work.
+         */
+        CPatternDataWriter::~CPatternDataWriter() {}
+        
+        //////////////////////////////////////////////////////////////////////
+        // Public methods.
+        
+        /**
+         * writeEvent
+         *    Write an event in pattern form.
+         * @param event - the parameter number/value pairs of the event.
+         * @param trigger - the trigger number of the event.
+         */
+        void
+        CPatternDataWriter::writeEvent(
+            const std::vector<std::pair<unsigned, double>>& event,
+            std::uint64_t trigger
+        ) {
+            m_numbers.clear();
+            m_values.clear();
+            for (auto& p : event) {
+                m_numbers.push_back(p.first);
+                m_values.push_back(p.second);
+            }
+            encode(trigger);
+        }
+        /**
+         * writeItem
+         *    A PARAMETER_DATA item is treated like writeEvent, as is each
+         *    event of a COMPRESSED_PARAMETERS frame and each
+         *    PACKED_PARAMETER_DATA item once widened.  Anything else is a
+         *    passthrough item and is written as is.
+         * @param pItem - pointer to the ring item.
+         */
+        void
+        CPatternDataWriter::writeItem(const void* pItem) {
+            const ParameterItem* p = reinterpret_cast<const ParameterItem*>(pItem);
+            if (p->s_header.s_type == PARAMETER_DATA) {
+                std::uint32_t n = p->s_parameterCount;
+                m_numbers.resize(n);
+                m_values.resize(n);
+                for (std::uint32_t i = 0; i < n; i++) {
+                    m_numbers[i] = p->s_parameters[i].s_number;
+                    m_values[i]  = p->s_parameters[i].s_value;
+                }
+                encode(p->s_triggerCount);
+            } else if (p->s_header.s_type == COMPRESSED_PARAMETERS) {
+                m_inflated.clear();
+                m_inflater.decompress(
+                    reinterpret_cast<const CompressedParameters*>(pItem), m_inflated
+                );
+                writeBlock(m_inflated.data(), m_inflated.size());
+            } else if (p->s_header.s_type == PACKED_PARAMETER_DATA) {
+                m_widened.clear();
+                CParameterPacker::widen(
+                    reinterpret_cast<const PackedParameterItem*>(pItem), m_widened
+                );
+                writeItem(m_widened.data());
+            } else {
+                CDataWriter::writeItem(pItem);
+            }
+        }
+        /**
+         * writeBlock
+         *    Write a block of complete ring items.  Each is handled as by
+         *    writeItem.
+         * @param pData  - pointer to the first item of the block.
+         * @param nBytes - number of bytes in the block.
+         */
+        void
+        CPatternDataWriter::writeBlock(const void* pData, std::size_t nBytes) {
+            const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(pData);
+            const std::uint8_t* pEnd = p + nBytes;
+            while (p < pEnd) {
+                const RingItemHeader* pHeader =
+                    reinterpret_cast<const RingItemHeader*>(p);
+                writeItem(p);
+                p += pHeader->s_size;
+            }
+        }
+        /**
+         * patterns
+         *    @return const CParameterPatterns& - the patterns written so far.
+         */
+        const CParameterPatterns&
+        CPatternDataWriter::patterns() const {
+            return m_patterns;
+        }
+        ///////////////////////////////////////////////////////////////////////
+        // Private utilities:
+        
+        /**
+         * encode
+         *    Write the event in m_numbers/m_values as a
+         *    PATTERN_PARAMETER_DATA item, defining its pattern first if
+         *    it's new.  If the dictionary is full and the pattern is new,
+         *    the event is written as PARAMETER_DATA instead.
+         *  @param trigger - the event's trigger number.
+         *  @note the pattern must be sorted.  Events from tree parameters
+         *        already are (CTreeParameter::collectEvent) so normally
+         *        this is just a check.
+         */
+        void
+        CPatternDataWriter::encode(std::uint64_t trigger) {
+            if (!std::is_sorted(m_numbers.begin(), m_numbers.end())) {
+                sortEvent();
+            }
+            std::uint32_t index = m_patterns.lookup(m_numbers);
+            if (index == CParameterPatterns::NO_PATTERN) {
+                if (m_patterns.size() >= MAX_PATTERNS) {
+                    std::vector<std::pair<unsigned, double>> event;
+                    for (std::size_t i = 0; i < m_numbers.size(); i++) {
+                        event.push_back({m_numbers[i], m_values[i]});
+                    }
+                    CDataWriter::writeEvent(event, trigger);
+                    return;
+                }
+                index = m_patterns.add(m_numbers);
+                writePattern(index);
+            }
+            std::size_t nBytes =
+                sizeof(PatternParameterItem) + m_values.size() * sizeof(double);
+            indexItem(true, trigger);
+            writeHeader(nBytes, PATTERN_PARAMETER_DATA);
+            put(&trigger, sizeof(trigger));
+            put(&index, sizeof(index));
+            put(m_values.data(), m_values.size() * sizeof(double));
+        }
+        /**
+         * sortEvent
+         *    Sort m_numbers and m_values by parameter number.  The sort is
+         *    stable so a parameter given more than once keeps the order of its
+         *    values.
+         */
+        void
+        CPatternDataWriter::sortEvent() {
+            std::vector<std::pair<unsigned, double>> event;
+            for (std::size_t i = 0; i < m_numbers.size(); i++) {
+                event.push_back({m_numbers[i], m_values[i]});
+            }
+            std::stable_sort(
+                event.begin(), event.end(),
+                [](
+                    const std::pair<unsigned, double>& a,
+                    const std::pair<unsigned, double>& b
+                ) { return a.first < b.first; }
+            );
+            for (std::size_t i = 0; i < event.size(); i++) {
+                m_numbers[i] = event[i].first;
+                m_values[i]  = event[i].second;
+            }
+        }
+        /**
+         * writePattern
+         *    Write a PARAMETER_PATTERNS item defining one pattern.  The
+         *    item is also index context.
+         *  @param index - number of the pattern.
+         */
+        void
+        CPatternDataWriter::writePattern(std::uint32_t index) {
+            const CParameterPatterns::Pattern& numbers(m_patterns.pattern(index));
+            std::uint32_t nNumbers  = numbers.size();
+            std::vector<std::uint32_t> item(
+                (sizeof(ParameterPatterns) / sizeof(std::uint32_t)) + nNumbers + 1
+            );
+            pParameterPatterns pItem = reinterpret_cast<pParameterPatterns>(item.data());
+            pItem->s_header.s_size   = item.size() * sizeof(std::uint32_t);
+            pItem->s_header.s_type   = PARAMETER_PATTERNS;
+            pItem->s_header.s_unused = sizeof(std::uint32_t);
+            pItem->s_firstPattern    = index;
+            pItem->s_patternCount    = 1;
+            pItem->s_data[0]         = nNumbers;
+            std::copy(numbers.begin(), numbers.end(), pItem->s_data + 1);
+            
+            indexItem(false);
+            addIndexContext(pItem);
+            put(pItem, pItem->s_header.s_size);
+        }
+    }
+}
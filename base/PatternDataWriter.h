@@ -0,0 +1,99 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+
+/** @file:  PatternDataWriter.h
+ *  @brief: Write parameter data as pattern numbers and values.
+ */
+#ifndef PATTERNDATAWRITER_H
+#define PATTERNDATAWRITER_H
+#include "DataWriter.h"
+#include "AnalysisRingItems.h"
+#include "ParameterCompressor.h"
+#include "ParameterPatterns.h"
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace frib {
+    namespace analysis {
+        /**
+         * @class CPatternDataWriter
+         *    A CDataWriter that writes each event as a
+         *    PATTERN_PARAMETER_DATA item: the number of the event's pattern
+         *    (sorted list of parameter numbers, see CParameterPatterns) and
+         *    its values in pattern order.  The first time a pattern is seen
+         *    a PARAMETER_PATTERNS item defining it is written just ahead
+         *    of the event.  Since most events use one of a few patterns,
+         *    this saves the four byte parameter number of each value.
+         *    CInflatingDataReader turns the items back into PARAMETER_DATA.
+         *
+         *    Events with patterns beyond the first MAX_PATTERNS are
+         *    written as PARAMETER_DATA items so data where few events
+         *    share a pattern can't grow the dictionary without limit.
+         *
+         *    The front matter and passthrough items are written as by
+         *    CDataWriter.  COMPRESSED_PARAMETERS frames are inflated and
+         *    PACKED_PARAMETER_DATA items widened before their events are
+         *    encoded.
+         *
+         *    When indexing, the PARAMETER_PATTERNS items are kept as the
+         *    index context so a reader that seeks can still decode events.
+         */
+        class CPatternDataWriter : public CDataWriter {
+        public:
+            static const std::size_t MAX_PATTERNS;
+        private:
+            CParameterPatterns                       m_patterns;
+            CParameterPatterns::Pattern              m_numbers;    // Of the event
+            std::vector<double>                      m_values;     // being written.
+            CParameterCompressor                     m_inflater;
+            std::vector<std::uint8_t>                m_inflated;   // Frame contents.
+            std::vector<std::uint8_t>                m_widened;    // A packed item.
+        public:
+            CPatternDataWriter(
+                const char* pFilename,
+                std::size_t bufferSize = DEFAULT_BUFFER_SIZE,
+                std::uint32_t indexInterval = 0
+            );
+            CPatternDataWriter(
+                int fd, std::size_t bufferSize = DEFAULT_BUFFER_SIZE
+            );
+            virtual ~CPatternDataWriter();
+        private:
+            CPatternDataWriter(const CPatternDataWriter& rhs);
+            CPatternDataWriter& operator=(const CPatternDataWriter& rhs);
+            int operator==(const CPatternDataWriter& rhs) const;
+            int operator!=(const CPatternDataWriter& rhs) const;
+        public:
+            virtual void writeEvent(
+                const std::vector<std::pair<unsigned, double>>& event,
+                std::uint64_t eventNum
+            );
+            virtual void writeItem(const void* pItem);
+            virtual void writeBlock(const void* pData, std::size_t nBytes);
+            
+            const CParameterPatterns& patterns() const;
+        private:
+            void encode(std::uint64_t trigger);
+            void sortEvent();
+            void writePattern(std::uint32_t index);
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,426 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+
+/** @file:  QueueTransport.cpp
+ *  @brief: Implement the CQueueTransport class.
+ */
+#include "QueueTransport.h"
+#include <stdexcept>
+#include <string.h>
+
+namespace frib {
+    namespace analysis {
+        /**
+         * constructor
+         * @param mailboxes - the mailboxes of all of the ranks, indexed by rank.
+         * @param rank      - our rank.
+         * @throw std::invalid_argument - rank is not the index of a mailbox.
+         */
+        CQueueTransport::CQueueTransport(
+            const std::vector<CMessageQueue*>& mailboxes, int rank
+        ) :
+            m_mailboxes(mailboxes), m_rank(rank)
+        {
+            if ((rank < 0) || (rank >= int(mailboxes.size()))) {
+                throw std::invalid_argument("CQueueTransport - rank has no mailbox");
+            }
+        }
+        /**
+         * destructor
+         *    Free messages that arrived but were never received.  Requests
+         *    that were never completed are just forgotten.
+         */
+        CQueueTransport::~CQueueTransport() {
+            for (auto p : m_unexpected) {
+                CMessageQueue::free(p);
+            }
+        }
+        /**
+         * rank
+         *   @return int - our rank.
+         */
+        int
+        CQueueTransport::rank() const {
+            return m_rank;
+        }
+        /**
+         * size
+         *   @return unsigned - number of ranks.
+         */
+        unsigned
+        CQueueTransport::size() const {
+            return m_mailboxes.size();
+        }
+        /**
+         * send
+         *    Copy the data into a message and put it in the destination's
+         *    mailbox.
+         * @param pData - the data.
+         * @param count - number of items of type.
+         * @param type  - the data type.
+         * @param dest  - destination rank.
+         * @param tag   - message tag.
+         * @throw std::runtime_error - the destination mailbox was aborted.
+         */
+        void
+        CQueueTransport::send(
+            const void* pData, std::size_t count, DataType type, int dest, int tag
+        ) {
+            if ((dest < 0) || (dest >= int(m_mailboxes.size()))) {
+                throw std::invalid_argument("CQueueTransport::send - invalid destination rank");
+            }
+            std::size_t nBytes = count * typeSize(type);
+            pMessage pMsg = CMessageQueue::allocate(nBytes);
+            pMsg->s_source = m_rank;
+            pMsg->s_tag    = tag;
+            memcpy(CMessageQueue::payload(pMsg), pData, nBytes);
+            try {
+                m_mailboxes[dest]->put(pMsg);
+            }
+            catch (...) {
+                CMessageQueue::free(pMsg);
+                throw;
+            }
+        }
+        /**
+         * recv
+         *    Receive a message.  A message that's already arrived and
+         *    matches is taken first.  Otherwise messages are taken from
+         *    our mailbox until one matches.  Messages that match a posted
+         *    irecv complete it instead and others are set aside for later.
+         * @param pData - where the data go.
+         * @param count - maximum number of items of type that fit in pData.
+         * @param type  - the data type.
+         * @param source - rank to receive from or ANY_SOURCE.
+         * @param tag    - tag to receive or ANY_TAG.
+         * @return Status - describes what was received.
+         * @throw std::runtime_error - the message is bigger than pData or
+         *           our mailbox was aborted.
+         */
+        CTransport::Status
+        CQueueTransport::recv(
+            void* pData, std::size_t count, DataType type, int source, int tag
+        ) {
+            std::size_t nBytes = count * typeSize(type);
+            pMessage pMsg = findUnexpected(source, tag, true);
+            while (!pMsg) {
+                pMessage p = mailbox().get();
+                if (deliver(p)) {
+                    continue;
+                }
+                if (matches(p, source, tag)) {
+                    pMsg = p;
+                } else {
+                    m_unexpected.push_back(p);
+                }
+            }
+            return take(pMsg, pData, nBytes);
+        }
+        /**
+         * probe
+         *    Wait for a matching message without receiving it.
+         * @param source - rank to receive from or ANY_SOURCE.
+         * @param tag    - tag to receive or ANY_TAG.
+         * @return Status - describes the message.
+         */
+        CTransport::Status
+        CQueueTransport::probe(int source, int tag) {
+            pMessage pMsg = findUnexpected(source, tag, false);
+            while (!pMsg) {
+                pMessage p = mailbox().get();
+                if (deliver(p)) {
+                    continue;
+                }
+                m_unexpected.push_back(p);
+                if (matches(p, source, tag)) {
+                    pMsg = p;
+                }
+            }
+            Status result;
+            result.s_source = pMsg->s_source;
+            result.s_tag    = pMsg->s_tag;
+            result.s_nBytes = pMsg->s_nBytes;
+            return result;
+        }
+        /**
+         * isend
+         *    Since send never waits for the receiver, this is just a send
+         *    and the request is already complete.
+         * @param pData, count, type, dest, tag - see send.
+         * @return Request - the request to be waited on or tested.
+         */
+        CTransport::Request
+        CQueueTransport::isend(
+            const void* pData, std::size_t count, DataType type, int dest, int tag
+        ) {
+            send(pData, count, type, dest, tag);
+            
+            Request result = allocateOperation();
+            Operation& op(operation(result));
+            op.s_complete        = true;
+            op.s_status.s_source = m_rank;
+            op.s_status.s_tag    = tag;
+            op.s_status.s_nBytes = count * typeSize(type);
+            return result;
+        }
+        /**
+         * irecv
+         *    Post a receive.  If a matching message has already arrived it's
+         *    received immediately.  Otherwise the receive is completed by the
+         *    first matching message taken from the mailbox after this.
+         * @param pData, count, type, source, tag - see recv.
+         * @return Request - the request to be waited on, tested or cancelled.
+         * @note pData must remain valid until the request is complete.
+         */
+        CTransport::Request
+        CQueueTransport::irecv(
+            void* pData, std::size_t count, DataType type, int source, int tag
+        ) {
+            Request result = allocateOperation();
+            Operation& op(operation(result));
+            op.s_pData  = pData;
+            op.s_nBytes = count * typeSize(type);
+            op.s_source = source;
+            op.s_tag    = tag;
+            
+            pMessage pMsg = findUnexpected(source, tag, true);
+            if (pMsg) {
+                op.s_status   = take(pMsg, pData, op.s_nBytes);
+                op.s_complete = true;
+            } else {
+                m_posted.push_back(result);
+            }
+            return result;
+        }
+        /**
+         * wait
+         *    Take messages from the mailbox until the request is complete.
+         * @param[inout] request - the request; NULL_REQUEST on return.
+         * @return Status - status of the completed operation.
+         */
+        CTransport::Status
+        CQueueTransport::wait(Request& request) {
+            Status result = {ANY_SOURCE, ANY_TAG, 0};
+            if (request == NULL_REQUEST) {
+                return result;
+            }
+            while (!operation(request).s_complete) {
+                pMessage p = mailbox().get();
+                if (!deliver(p)) {
+                    m_unexpected.push_back(p);
+                }
+            }
+            result = operation(request).s_status;
+            freeOperation(request);
+            return result;
+        }
+        /**
+         * test
+         *    Take whatever messages are in the mailbox and see if that
+         *    completes the request.
+         * @param[inout] request - the request; NULL_REQUEST if it's complete.
+         * @return bool - true if the request is complete.
+         */
+        bool
+        CQueueTransport::test(Request& request) {
+            if (request == NULL_REQUEST) {
+                return true;
+            }
+            while (!operation(request).s_complete) {
+                pMessage p = mailbox().tryGet();
+                if (!p) {
+                    return false;
+                }
+                if (!deliver(p)) {
+                    m_unexpected.push_back(p);
+                }
+            }
+            freeOperation(request);
+            return true;
+        }
+        /**
+         * cancel
+         *    Cancel a request.  If it's a receive that's not been satisfied,
+         *    it won't be.
+         * @param[inout] request - the request; NULL_REQUEST on return.
+         */
+        void
+        CQueueTransport::cancel(Request& request) {
+            if (request == NULL_REQUEST) {
+                return;
+            }
+            m_posted.remove(request);
+            freeOperation(request);
+        }
+        /**
+         * abort
+         *    Abort all of the mailboxes.  Anyone waiting on a send or receive
+         *    (and anyone who does so later) gets an exception.  This is
+         *    done when a role fails so the others don't wait forever.
+         */
+        void
+        CQueueTransport::abort() {
+            for (auto p : m_mailboxes) {
+                p->abort();
+            }
+        }
+        ///////////////////////////////////////////////////////////////////////
+        // Private utilities.
+        
+        /**
+         * mailbox
+         *    @return CMessageQueue& - our mailbox.
+         */
+        CMessageQueue&
+        CQueueTransport::mailbox() {
+            return *m_mailboxes[m_rank];
+        }
+        /**
+         * matches
+         *   @param pMsg   - a message.
+         *   @param source - source rank or ANY_SOURCE.
+         *   @param tag    - tag or ANY_TAG.
+         *   @return bool - true if the message matches source and tag.
+         */
+        bool
+        CQueueTransport::matches(pMessage pMsg, int source, int tag) {
+            return ((source == ANY_SOURCE) || (source == pMsg->s_source)) &&
+                ((tag == ANY_TAG) || (tag == pMsg->s_tag));
+        }
+        /**
+         * take
+         *    Copy a message's payload to the receiver and free it.
+         * @param pMsg - the message.
+         * @param pData - receive buffer.
+         * @param nBytes - size of the receive buffer.
+         * @return Status - describes the message.
+         * @throw std::runtime_error - the payload is bigger than the buffer.
+         *        The message is freed anyway.
+         */
+        CTransport::Status
+        CQueueTransport::take(pMessage pMsg, void* pData, std::size_t nBytes) {
+            Status result;
+            result.s_source = pMsg->s_source;
+            result.s_tag    = pMsg->s_tag;
+            result.s_nBytes = pMsg->s_nBytes;
+            if (pMsg->s_nBytes > nBytes) {
+                CMessageQueue::free(pMsg);
+                throw std::runtime_error(
+                    "CQueueTransport - message truncated by receive"
+                );
+            }
+            memcpy(pData, CMessageQueue::payload(pMsg), pMsg->s_nBytes);
+            CMessageQueue::free(pMsg);
+            return result;
+        }
+        /**
+         * findUnexpected
+         *    Find the earliest message that arrived without matching a
+         *    posted receive that matches source and tag.
+         * @param source, tag - what to match.
+         * @param remove - if true, the message is removed from the list.
+         * @return pMessage - the message or nullptr if there's none.
+         */
+        CQueueTransport::pMessage
+        CQueueTransport::findUnexpected(int source, int tag, bool remove) {
+            for (auto p = m_unexpected.begin(); p != m_unexpected.end(); p++) {
+                if (matches(*p, source, tag)) {
+                    pMessage result = *p;
+                    if (remove) {
+                        m_unexpected.erase(p);
+                    }
+                    return result;
+                }
+            }
+            return nullptr;
+        }
+        /**
+         * deliver
+         *    Offer a message that just came out of the mailbox to the
+         *    posted receives in the order they were posted.  The first one
+         *    that matches is completed.
+         * @param pMsg - the message.
+         * @return bool - true if a posted receive took the message.
+         */
+        bool
+        CQueueTransport::deliver(pMessage pMsg) {
+            for (auto p = m_posted.begin(); p != m_posted.end(); p++) {
+                Operation& op(operation(*p));
+                if (matches(pMsg, op.s_source, op.s_tag)) {
+                    m_posted.erase(p);
+                    op.s_complete = true;
+                    op.s_status   = take(pMsg, op.s_pData, op.s_nBytes);
+                    return true;
+                }
+            }
+            return false;
+        }
+        /**
+         * allocateOperation
+         *    @return Request - index of an unused, reset, entry in
+         *                      m_operations.
+         */
+        CTransport::Request
+        CQueueTransport::allocateOperation() {
+            Request result;
+            for (result = 0; result < Request(m_operations.size()); result++) {
+                if (!m_operations[result].s_inUse) break;
+            }
+            if (result == Request(m_operations.size())) {
+                m_operations.push_back(Operation());
+            }
+            Operation& op(m_operations[result]);
+            op.s_pData    = nullptr;
+            op.s_nBytes   = 0;
+            op.s_source   = ANY_SOURCE;
+            op.s_tag      = ANY_TAG;
+            op.s_inUse    = true;
+            op.s_complete = false;
+            op.s_status.s_source = ANY_SOURCE;
+            op.s_status.s_tag    = ANY_TAG;
+            op.s_status.s_nBytes = 0;
+            return result;
+        }
+        /**
+         * freeOperation
+         *   @param[inout] request - request whose operation is no longer
+         *                 needed; set to NULL_REQUEST.
+         */
+        void
+        CQueueTransport::freeOperation(Request& request) {
+            operation(request).s_inUse = false;
+            request = NULL_REQUEST;
+        }
+        /**
+         * operation
+         *   @param request - a request.
+         *   @return Operation& - its operation.
+         *   @throw std::logic_error - the request is not in use.
+         */
+        CQueueTransport::Operation&
+        CQueueTransport::operation(Request request) {
+            if (
+                (request < 0) || (request >= Request(m_operations.size())) ||
+                !m_operations[request].s_inUse
+            ) {
+                throw std::logic_error("CQueueTransport - invalid request");
+            }
+            return m_operations[request];
+        }
+    }
+}
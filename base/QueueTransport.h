@@ -0,0 +1,122 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+
+/** @file:  QueueTransport.h
+ *  @brief: In-process transport between threads.
+ */
+#ifndef QUEUETRANSPORT_H
+#define QUEUETRANSPORT_H
+#include "Transport.h"
+#include "MessageQueue.h"
+#include <vector>
+#include <list>
+
+namespace frib {
+    namespace analysis {
+        /**
+         * @class CQueueTransport
+         *    A transport for roles that are threads in the same process.
+         *    Each rank has a CMessageQueue as its mailbox; sending a message
+         *    copies the data once into a message which is put in the
+         *    destination's mailbox.  There's no serialization and no
+         *    system call unless a receiver has to go to sleep.
+         *
+         *    Matching follows the MPI rules:
+         *    -  A message goes to the earliest posted irecv it matches.
+         *    -  Messages that don't match anything posted yet are kept, in
+         *       order of arrival, for later receives and probes.
+         *    Since messages from one sender arrive in the order they were
+         *    sent, messages aren't overtaken.
+         *
+         *    Sends never wait for a matching receive; they only wait if the
+         *    destination's mailbox is over its byte limit.  isend therefore
+         *    completes immediately.
+         *
+         *    Each rank's thread uses its own CQueueTransport; all of them
+         *    share the vector of mailboxes (which they don't own).
+         */
+        class CQueueTransport : public CTransport {
+        private:
+            typedef CMessageQueue::pMessage pMessage;
+            
+            // A non-blocking operation:
+            
+            typedef struct _Operation {
+                void*       s_pData;
+                std::size_t s_nBytes;          // Size of s_pData.
+                int         s_source;
+                int         s_tag;
+                bool        s_inUse;
+                bool        s_complete;
+                Status      s_status;
+            } Operation, *pOperation;
+            
+            std::vector<CMessageQueue*> m_mailboxes;
+            int                         m_rank;
+            std::list<pMessage>         m_unexpected;  // Arrived, unmatched.
+            std::vector<Operation>      m_operations;  // Indexed by Request.
+            std::list<Request>          m_posted;      // Incomplete irecvs.
+        public:
+            CQueueTransport(const std::vector<CMessageQueue*>& mailboxes, int rank);
+            virtual ~CQueueTransport();
+        private:
+            CQueueTransport(const CQueueTransport& rhs);
+            CQueueTransport& operator=(const CQueueTransport& rhs);
+            int operator==(const CQueueTransport& rhs);
+            int operator!=(const CQueueTransport& rhs);
+        public:
+            virtual int rank() const;
+            virtual unsigned size() const;
+            
+            virtual void send(
+                const void* pData, std::size_t count, DataType type,
+                int dest, int tag
+            );
+            virtual Status recv(
+                void* pData, std::size_t count, DataType type,
+                int source, int tag
+            );
+            virtual Status probe(int source, int tag);
+            
+            virtual Request isend(
+                const void* pData, std::size_t count, DataType type,
+                int dest, int tag
+            );
+            virtual Request irecv(
+                void* pData, std::size_t count, DataType type,
+                int source, int tag
+            );
+            virtual Status wait(Request& request);
+            virtual bool test(Request& request);
+            virtual void cancel(Request& request);
+            
+            void abort();
+        private:
+            CMessageQueue& mailbox();
+            static bool matches(pMessage pMsg, int source, int tag);
+            static Status take(pMessage pMsg, void* pData, std::size_t nBytes);
+            pMessage findUnexpected(int source, int tag, bool remove);
+            bool deliver(pMessage pMsg);
+            Request allocateOperation();
+            void freeOperation(Request& request);
+            Operation& operation(Request request);
+        };
+    }
+}
+
+#endif
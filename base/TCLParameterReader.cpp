@@ -28,11 +28,32 @@
 #include "TreeParameterArray.h"
 #include "TreeVariable.h"
 #include "TreeVariableArray.h"
+#include "AnalysisRingItems.h"
 #include <stdexcept>
 
 
 namespace frib {
     namespace analysis {
+        /**
+         * storageType [static]
+         *    Translate the optional type word of treeparameter and
+         *    treeparameterarray into a storage type.
+         * @param type - the type name: double, float32, uint16 or uint32.
+         * @return std::uint32_t - the corresponding VALUE_* code.
+         * @throw std::string - the type name is not one of those.
+         */
+        static std::uint32_t
+        storageType(const std::string& type) {
+            if (type == "double")  return VALUE_DOUBLE;
+            if (type == "float32") return VALUE_FLOAT32;
+            if (type == "uint16")  return VALUE_UINT16;
+            if (type == "uint32")  return VALUE_UINT32;
+            
+            std::string msg("Invalid parameter storage type: ");
+            msg += type;
+            msg += " must be one of double, float32, uint16 or uint32";
+            throw msg;
+        }
         //////////////////////////// TreeParameterCommand implementation /////
         
         /**
@@ -51,13 +72,19 @@ namespace frib {
             CTCLInterpreter& interp, std::vector<CTCLObject>& objv
         ) {
             bindAll(interp, objv);
-            requireExactly(objv, 6);
+            requireAtLeast(objv, 6);
+            requireAtMost(objv, 7);
             
             std::string name = objv[1];
             double      low  = objv[2];
             double      high = objv[3];
             int         bins = objv[4];
             std::string units = objv[5];
+            std::uint32_t storage = VALUE_DOUBLE;
+            if (objv.size() == 7) {
+                std::string type = objv[6];
+                storage = storageType(type);
+            }
             
             /**
                This next line may seem a bit odd...creating a tree parameter which
@@ -67,6 +94,7 @@ namespace frib {
                going to be common to all tree parameters with this name.
             **/
             CTreeParameter parameter(name, bins, low, high, units);
+            parameter.setStorage(storage);
             
             return TCL_OK;
         }
@@ -87,7 +115,8 @@ namespace frib {
             CTCLInterpreter& interp, std::vector<CTCLObject>& objv
         ) {
             bindAll(interp, objv);
-            requireExactly(objv, 8);
+            requireAtLeast(objv, 8);
+            requireAtMost(objv, 9);
             
             std::string name = objv[1];
             double low       = objv[2];
@@ -96,6 +125,11 @@ namespace frib {
             std::string units = objv[5];
             int elements     = objv[6];
             int firstindex   = objv[7];
+            std::uint32_t storage = VALUE_DOUBLE;
+            if (objv.size() == 9) {
+                std::string type = objv[8];
+                storage = storageType(type);
+            }
             
             // See the note on TreeParameterCommand::operator() about why this
             // works.   Note in pulling the data out, we'll get elements
@@ -105,6 +139,9 @@ namespace frib {
             CTreeParameterArray array(
                 name, bins, low, high, units, elements, firstindex
             );
+            for (int i = 0; i < elements; i++) {
+                array[firstindex + i].setStorage(storage);
+            }
             
             return TCL_OK;
         }
@@ -34,18 +34,24 @@ namespace frib {
          *    to read the parameter and variable definition.  The
          *    extensions to the interpreter are four new commands:
          *
-         *  -  treeparameter name low high bins units - Defines a treee parameter.
-         *  -  treeparameterarray name low high bins units elements firstindex
+         *  -  treeparameter name low high bins units ?type? - Defines a treee parameter.
+         *  -  treeparameterarray name low high bins units elements firstindex ?type?
          *  -  treevariable name value units
          *  -  treevariablearray name value units elements firstindex
          *
+         *  The optional type is how parameter files store the values:
+         *  double (the default), float32, uint16 or uint32.  See
+         *  CTreeParameter::setStorage.
+         *
          *  @note that these create initial definitions but user code
-         *    can modify those definitions as well.  Therefore it's normally
-         *    needed to have all computational elements not only read the
-         *    configuration file but to define any CTreeParameters/CTreeVariables
-         *    as well...otherwise, since MPI is a multiprocessing, SPMD system,
-         *    there's danger that one or more processes will operate with
-         *    differing parameter/variable definitions.
+         *    can modify those definitions as well.  AbstractApplication only
+         *    reads the configuration file in rank 0 and broadcasts the
+         *    resulting definitions to the other ranks.  Any
+         *    CTreeParameters/CTreeVariables user code defines must still be
+         *    defined in all computational elements...otherwise, since MPI is
+         *    a multiprocessing, SPMD system, there's danger that one or more
+         *    processes will operate with differing parameter/variable
+         *    definitions.
          *    
          */    
         class CTCLParameterReader : public CParameterReader {
@@ -0,0 +1,146 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+
+/** @file:  ThreadPool.cpp
+ *  @brief: Implement CThreadPool.
+ */
+#include "ThreadPool.h"
+#include <stdexcept>
+
+namespace frib {
+    namespace analysis {
+        /**
+         * constructor
+         *    Start the pool threads.
+         * @param nThreads - number of threads including the one that will
+         *                   call run.
+         * @throw std::invalid_argument - nThreads is zero.
+         */
+        CThreadPool::CThreadPool(unsigned nThreads) :
+            m_pJob(nullptr), m_jobNumber(0), m_nRunning(0), m_exiting(false)
+        {
+            if (nThreads == 0) {
+                throw std::invalid_argument("A thread pool needs at least one thread");
+            }
+            for (unsigned i = 1; i < nThreads; i++) {
+                m_threads.emplace_back(&CThreadPool::threadMain, this, i);
+            }
+        }
+        /**
+         * destructor
+         *    Tell the pool threads to exit and wait for them.
+         */
+        CThreadPool::~CThreadPool() {
+            {
+                std::lock_guard<std::mutex> l(m_lock);
+                m_exiting = true;
+            }
+            m_start.notify_all();
+            for (auto& t : m_threads) {
+                t.join();
+            }
+        }
+        /**
+         * size
+         *   @return unsigned - number of threads (including the caller of run).
+         */
+        unsigned
+        CThreadPool::size() const {
+            return m_threads.size() + 1;
+        }
+        /**
+         * run
+         *    Run a job in all threads and wait for it to finish.
+         * @param job - the job.  It's called with each thread index.
+         */
+        void
+        CThreadPool::run(const Job& job) {
+            {
+                std::lock_guard<std::mutex> l(m_lock);
+                m_pJob     = &job;
+                m_nRunning = m_threads.size();
+                m_error    = nullptr;
+                m_jobNumber++;
+            }
+            m_start.notify_all();
+            
+            runJob(job, 0);
+            
+            std::exception_ptr error;
+            {
+                std::unique_lock<std::mutex> l(m_lock);
+                m_finished.wait(l, [this]() { return m_nRunning == 0; });
+                m_pJob = nullptr;
+                error  = m_error;
+                m_error = nullptr;
+            }
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+        /**
+         * threadMain
+         *    Pool threads wait for jobs and run them until told to exit.
+         * @param index - our index.
+         */
+        void
+        CThreadPool::threadMain(unsigned index) {
+            std::uint64_t lastJob = 0;
+            while (1) {
+                const Job* pJob;
+                {
+                    std::unique_lock<std::mutex> l(m_lock);
+                    m_start.wait(l, [this, lastJob]() {
+                        return m_exiting || (m_jobNumber != lastJob);
+                    });
+                    if (m_exiting) {
+                        return;
+                    }
+                    lastJob = m_jobNumber;
+                    pJob    = m_pJob;
+                }
+                runJob(*pJob, index);
+                {
+                    std::lock_guard<std::mutex> l(m_lock);
+                    m_nRunning--;
+                    if (m_nRunning == 0) {
+                        m_finished.notify_one();
+                    }
+                }
+            }
+        }
+        /**
+         * runJob
+         *    Run a job, saving the first exception any call throws.
+         * @param job   - the job.
+         * @param index - index of the calling thread.
+         */
+        void
+        CThreadPool::runJob(const Job& job, unsigned index) {
+            try {
+                job(index);
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> l(m_lock);
+                if (!m_error) {
+                    m_error = std::current_exception();
+                }
+            }
+        }
+    }
+}
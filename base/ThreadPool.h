@@ -0,0 +1,85 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+
+/** @file:  ThreadPool.h
+ *  @brief: Fixed set of threads that run a job together.
+ */
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <cstdint>
+
+namespace frib {
+    namespace analysis {
+        /**
+         * @class CThreadPool
+         *    A pool of n threads (the caller of run is one of them) that
+         *    run a job together: run(job) calls job(i) in each of the threads,
+         *    i = 0 (the caller), 1, ..., n-1, and returns when all calls have
+         *    returned.  i lets each call use its own per-thread state.
+         *
+         *    Jobs normally divide their work into more pieces than there are
+         *    threads and have each call take the next piece until there are
+         *    none left (e.g. with an std::atomic counter).  That balances the
+         *    load the way work stealing would, without the deques, since
+         *    all of a job's work is known when it starts.
+         *
+         *    If calls of a job throw, the first exception is rethrown by run
+         *    once all of the calls are done.
+         *
+         *    The pool threads are created once and wait between jobs, so
+         *    run is cheap enough to call per block of data.  run must not be
+         *    called from more than one thread at a time.
+         */
+        class CThreadPool {
+        public:
+            typedef std::function<void(unsigned)> Job;
+        private:
+            std::vector<std::thread> m_threads;
+            std::mutex               m_lock;
+            std::condition_variable  m_start;      // Pool threads wait here.
+            std::condition_variable  m_finished;   // run waits here.
+            const Job*               m_pJob;
+            std::uint64_t            m_jobNumber;
+            unsigned                 m_nRunning;
+            bool                     m_exiting;
+            std::exception_ptr       m_error;
+        public:
+            CThreadPool(unsigned nThreads);
+            virtual ~CThreadPool();
+        private:
+            CThreadPool(const CThreadPool& rhs);
+            CThreadPool& operator=(const CThreadPool& rhs);
+            int operator==(const CThreadPool& rhs);
+            int operator!=(const CThreadPool& rhs);
+        public:
+            unsigned size() const;
+            void run(const Job& job);
+        private:
+            void threadMain(unsigned index);
+            void runJob(const Job& job, unsigned index);
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,116 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+
+/** @file:  Transport.cpp
+ *  @brief: Implement the non-pure parts of CTransport.
+ */
+#include "Transport.h"
+#include "AnalysisRingItems.h"
+#include <stdexcept>
+#include <cstdint>
+#include <vector>
+
+namespace frib {
+    namespace analysis {
+        const int                 CTransport::ANY_SOURCE(-1);
+        const int                 CTransport::ANY_TAG(-1);
+        const CTransport::Request CTransport::NULL_REQUEST(-1);
+        
+        /**
+         * constructor and destructor are here for the vtable.
+         */
+        CTransport::CTransport() {}
+        CTransport::~CTransport() {}
+        
+        /**
+         * broadcast
+         *    Send the same message to each rank from firstRank on.  The
+         *    sends are all started before any is waited for so that, where
+         *    the transport allows, they proceed concurrently.  Transports
+         *    with something better can override this.
+         * @param pData - the data.
+         * @param count - number of items of type in pData.
+         * @param type  - data type.
+         * @param firstRank - first rank to send to.  All ranks from this
+         *                one through size()-1 get the message.
+         * @param tag   - message tag.
+         */
+        void
+        CTransport::broadcast(
+            const void* pData, std::size_t count, DataType type,
+            int firstRank, int tag
+        ) {
+            std::vector<Request> requests;
+            for (int dest = firstRank; dest < int(size()); dest++) {
+                requests.push_back(isend(pData, count, type, dest, tag));
+            }
+            for (auto& r : requests) {
+                wait(r);
+            }
+        }
+        /**
+         * receiveBroadcast
+         *    Receive a message sent with broadcast.  This default just
+         *    receives it.
+         * @param pData - where the data go.
+         * @param count - number of items of type the broadcast sends.
+         * @param type  - data type.
+         * @param root  - rank that made the broadcast.
+         * @param firstRank - firstRank of the broadcast.
+         * @param tag   - message tag.
+         * @return Status - status of the receive.
+         */
+        CTransport::Status
+        CTransport::receiveBroadcast(
+            void* pData, std::size_t count, DataType type,
+            int root, int firstRank, int tag
+        ) {
+            return recv(pData, count, type, root, tag);
+        }
+        
+        /**
+         * typeSize
+         *    @param type - a data type.
+         *    @return std::size_t - the in-memory size of one item of that type.
+         *    @throw std::invalid_argument - invalid type.
+         */
+        std::size_t
+        CTransport::typeSize(DataType type) {
+            switch (type) {
+            case BYTES:
+                return sizeof(std::uint8_t);
+            case UINT32:
+                return sizeof(std::uint32_t);
+            case MESSAGE_HEADER:
+                return sizeof(FRIB_MPI_Message_Header);
+            case REQUEST_DATA:
+                return sizeof(FRIB_MPI_Request_Data);
+            case PARAMETER_HEADER:
+                return sizeof(FRIB_MPI_Parameter_MessageHeader);
+            case PARAMETER_VALUE:
+                return sizeof(FRIB_MPI_Parameter_Value);
+            case PARAMETER_DEF:
+                return sizeof(FRIB_MPI_ParameterDef);
+            case VARIABLE_DEF:
+                return sizeof(FRIB_MPI_VariableDef);
+            default:
+                throw std::invalid_argument("CTransport - invalid data type");
+            }
+        }
+    }
+}
@@ -0,0 +1,134 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+
+/** @file:  Transport.h
+ *  @brief: Interface through which the roles of an application communicate.
+ */
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+#include <cstddef>
+
+namespace frib {
+    namespace analysis {
+        /**
+         * @class CTransport
+         *    The roles of an application (dealer, farmer, outputter and
+         *    workers) exchange messages.  This class abstracts that messaging
+         *    so that the same role code can run as ranks of an MPI
+         *    application (CMPITransport) or as threads of a single process
+         *    (CQueueTransport).
+         *
+         *    The semantics are the subset of MPI point to point messaging
+         *    the roles use:
+         *    -  Messages are sent to a rank and carry a tag.
+         *    -  Receives and probes can accept ANY_SOURCE and/or ANY_TAG.
+         *    -  Messages between a pair of ranks that match the same receive
+         *       are received in the order they were sent.
+         *    -  Non-blocking sends and receives return a Request that's
+         *       completed by wait or test.  A receive can be cancelled.  Once
+         *       complete (or cancelled) the request is set to NULL_REQUEST.
+         *    -  broadcast sends the same message to a range of ranks (e.g.
+         *       all workers).  Receivers get it with receiveBroadcast so
+         *       that transports can implement the pair as a collective.
+         *       Broadcasts from a root to a range of ranks are received in
+         *       the order they were made.
+         *
+         *    Data are described as a count of items of a DataType so that
+         *    the MPI transport can use the MPI data types the application
+         *    creates for our message structs.
+         *
+         *    An object is the endpoint of a single rank and is not
+         *    thread-safe.
+         */
+        class CTransport {
+        public:
+            typedef enum _DataType {
+                BYTES,                 // std::uint8_t
+                UINT32,                // std::uint32_t
+                MESSAGE_HEADER,        // FRIB_MPI_Message_Header
+                REQUEST_DATA,          // FRIB_MPI_Request_Data
+                PARAMETER_HEADER,      // FRIB_MPI_Parameter_MessageHeader
+                PARAMETER_VALUE,       // FRIB_MPI_Parameter_Value
+                PARAMETER_DEF,         // FRIB_MPI_ParameterDef
+                VARIABLE_DEF           // FRIB_MPI_VariableDef
+            } DataType;
+            
+            // What was received/probed.  For receives, s_nBytes is the
+            // size of the data in memory.  For probes, it's only
+            // meaningful for messages of BYTES.
+            
+            typedef struct _Status {
+                int         s_source;
+                int         s_tag;
+                std::size_t s_nBytes;
+            } Status, *pStatus;
+            
+            typedef int Request;
+            
+            static const int     ANY_SOURCE;
+            static const int     ANY_TAG;
+            static const Request NULL_REQUEST;
+        public:
+            CTransport();
+            virtual ~CTransport();
+        private:
+            CTransport(const CTransport& rhs);
+            CTransport& operator=(const CTransport& rhs);
+            int operator==(const CTransport& rhs);
+            int operator!=(const CTransport& rhs);
+        public:
+            virtual int rank() const = 0;
+            virtual unsigned size() const = 0;
+            
+            virtual void send(
+                const void* pData, std::size_t count, DataType type,
+                int dest, int tag
+            ) = 0;
+            virtual Status recv(
+                void* pData, std::size_t count, DataType type,
+                int source, int tag
+            ) = 0;
+            virtual Status probe(int source, int tag) = 0;
+            
+            virtual Request isend(
+                const void* pData, std::size_t count, DataType type,
+                int dest, int tag
+            ) = 0;
+            virtual Request irecv(
+                void* pData, std::size_t count, DataType type,
+                int source, int tag
+            ) = 0;
+            virtual Status wait(Request& request) = 0;
+            virtual bool test(Request& request) = 0;
+            virtual void cancel(Request& request) = 0;
+            
+            virtual void broadcast(
+                const void* pData, std::size_t count, DataType type,
+                int firstRank, int tag
+            );
+            virtual Status receiveBroadcast(
+                void* pData, std::size_t count, DataType type,
+                int root, int firstRank, int tag
+            );
+            
+            static std::size_t typeSize(DataType type);
+        };
+    }
+}
+
+#endif
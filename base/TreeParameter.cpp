@@ -20,6 +20,7 @@
  */
 
 #include "TreeParameter.h"
+#include "AnalysisRingItems.h"
 #include <stdexcept>
 #include <algorithm>
 namespace frib {
@@ -28,20 +29,16 @@ namespace frib {
          * static class data:
          */
         
-        // m_generation is the per process event number.  It allows an O(1)
-        // setting of all tree parameters to invalid.  Note that initializing it to
-        // 1 solves the initial condition that all parameters are invalid because
-        // their shared data will set s_generation to 0 != 1.
-        
-        std::uint64_t CTreeParameter::m_generation(1);   // Increments for each event.
-        
         // m_parameterDictionary provides a mapping between tree parameter names
         // and the data that's shared between instances of a tree parameter that
         // have the same name.  When a tree parameters is created, it either
         // creates a new map entry or looks up the existing one if there is one
         // to set its m_pDefinition pointer.
+        // It's hashed because large detector arrays define a lot of parameters;
+        // its elements don't move so m_pDefinition pointers remain valid as it
+        // grows.  getDefinitions provides the ordered view.
         //
-        std::map<std::string, CTreeParameter::SharedData> CTreeParameter::m_parameterDictionary;
+        CNameDictionary<CTreeParameter::SharedData> CTreeParameter::m_parameterDictionary;
         
         // Each tree parameter stores its data in an element of m_event, a
         // vector of double values.  As unique tree parameters are created,
@@ -51,24 +48,14 @@ namespace frib {
         
         unsigned CTreeParameter::m_nextId(0);
         
-        // The vector below contains the values that have been stored for
-        // tree paramters for this event.  nextevent wil pre-size it to
-        // hold the required number of elements so that pure stores can be done.
-        //
-    
-        std::vector<double> CTreeParameter::m_event;
-        
-        // As tree paramters are assigned to, if their s_generation
-        // is not the same as m_generation:
-        //  1.   s_generation is set to m_generation.
-        //  2.   The s_parameterNumber of the tree parameters is
-        //       pushed back to m_scoreboard
-        // Note that nexEvent, clears the m_scoreboard vector.
-        // Thus m_scoreboard contains the indices of m_event that have
-        // been given values this event. For large, sparse parameter spaces,
-        // this speeds up collectEvent().
+        // The values of the tree parameters for this event, the scoreboard
+        // of the ones that have been set and the generation number that
+        // makes nextEvent O(1) are in a CTreeParameterContext.
+        // m_processContext is used by threads that have not set their own
+        // context; pThreadContext is the context set by this thread, if any.
         
-        std::vector<unsigned> CTreeParameter::m_scoreboard;
+        CTreeParameterContext CTreeParameter::m_processContext;
+        static thread_local CTreeParameterContext* pThreadContext(nullptr);
         
         // The original tree parameter had a fixed set of default specifications:
         //  low = 0, high = 100, bins = 100 units ''   In this version, the default
@@ -96,8 +83,7 @@ namespace frib {
             double low, double hi, unsigned  chans, const char* units
         ) : s_parameterNumber(CTreeParameter::m_nextId++),
             s_low(low), s_high(hi), s_chans(chans), s_units(units),
-            s_generation(CTreeParameter::m_generation - 1),
-            s_changed(false)
+            s_changed(false), s_storage(VALUE_DOUBLE)
         {}
         // Construction.
         
@@ -105,8 +91,7 @@ namespace frib {
             s_parameterNumber(rhs.s_parameterNumber),
             s_low(rhs.s_low), s_high(rhs.s_high), s_chans(rhs.s_chans),
             s_units(rhs.s_units),
-            s_generation(rhs.s_generation),
-            s_changed(rhs.s_changed) {}
+            s_changed(rhs.s_changed), s_storage(rhs.s_storage) {}
             
         // Default construction:
         
@@ -119,15 +104,12 @@ namespace frib {
         
         /**
          * nextEvent
-         *    -  Increments m_generation.
-         *    -  Clears m_scorecard
-         *  This sufficient to set all tree parameters to invalid and to have
-         *  an empty event for collectEvent().
+         *    Start a new event in this thread's context.  This invalidates
+         *    all tree parameters and empties the event for collectEvent().
          */
         void
         CTreeParameter::nextEvent() {
-            m_generation++;
-            m_scoreboard.clear();
+            context().nextEvent();
         }
         /**
          * collectEvent
@@ -142,12 +124,36 @@ namespace frib {
          */
         std::vector<std::pair<unsigned, double>>
         CTreeParameter::collectEvent() {
-            std::vector<std::pair<unsigned, double>> result;
-            for (auto n : m_scoreboard) {
-                result.push_back({n, m_event.at(n)});
-            }
-            
-            return result;
+            return context().collectEvent();
+        }
+        /**
+         * collectEvent
+         *    Same as above but fills a vector the caller reuses from event
+         *    to event so nothing is allocated once it has grown.
+         * @param event - receives the parameter number/value pairs.
+         */
+        void
+        CTreeParameter::collectEvent(std::vector<std::pair<unsigned, double>>& event) {
+            context().collectEvent(event);
+        }
+        /**
+         * collectEvent
+         *    Writes the event as ParameterValue structs, the way it's laid
+         *    out in a PARAMETER_DATA item (see CParameterBatch::allocateEvent).
+         * @param pValues - where to put the values. Must have room for
+         *                  eventSize() of them.
+         */
+        void
+        CTreeParameter::collectEvent(ParameterValue* pValues) {
+            context().collectEvent(pValues);
+        }
+        /**
+         * eventSize
+         *   @return std::size_t - number of parameters set in this event.
+         */
+        std::size_t
+        CTreeParameter::eventSize() {
+            return context().eventSize();
         }
         /**
          * setDefaultLimits
@@ -204,7 +210,7 @@ namespace frib {
          */
         const std::vector<double>&
         CTreeParameter::getEvent() {
-            return m_event;
+            return context().getEvent();
         }
         /**
          * getScoreboard
@@ -212,23 +218,93 @@ namespace frib {
          */
         const std::vector<unsigned>
         CTreeParameter::getScoreboard() {
-            return m_scoreboard;
+            return context().getScoreboard();
+        }
+        /**
+         * context
+         *   @return CTreeParameterContext& - the context in which this thread
+         *      gets and sets tree parameter values.
+         */
+        CTreeParameterContext&
+        CTreeParameter::context() {
+            return pThreadContext ? *pThreadContext : m_processContext;
+        }
+        /**
+         * setContext
+         *    Set the context this thread uses for tree parameter values.
+         *    The context is sized to hold the parameters defined so far.
+         *    The caller retains ownership of the context and must reset
+         *    the context (setContext(nullptr)) before destroying it.
+         * @param pContext - the context, nullptr to go back to the
+         *                   process wide context.
+         */
+        void
+        CTreeParameter::setContext(CTreeParameterContext* pContext) {
+            if (pContext) {
+                pContext->resize(m_nextId);
+            }
+            pThreadContext = pContext;
         }
         /**
          * getDefinitions
          *   @return std::vector<std::pair<std::string, SharedData>  - the tree
          *             parameter definitions.
          *   @note - tree parameter vectors will appear as several entries in this vector.
+         *   @note - the definitions are sorted by name.
          */
         std::vector<std::pair<std::string, CTreeParameter::SharedData>>
         CTreeParameter::getDefinitions() {
-            std::vector<std::pair<std::string, SharedData>> result;
+            typedef CNameDictionary<SharedData>::value_type Entry;
+            std::vector<const Entry*> sorted;
+            sorted.reserve(m_parameterDictionary.size());
             for(auto& p : m_parameterDictionary) {
-                result.push_back(p);
+                sorted.push_back(&p);
             }
+            std::sort(sorted.begin(), sorted.end(), [](
+                const Entry* p1, const Entry* p2
+            ) { return p1->first < p2->first; });
             
+            std::vector<std::pair<std::string, SharedData>> result;
+            result.reserve(sorted.size());
+            for (auto p : sorted) {
+                result.push_back(*p);
+            }
+            return result;
+        }
+        /**
+         * getStorageTypes
+         *    @return std::vector<std::uint32_t> - the VALUE_* storage type
+         *            of each parameter indexed by parameter number.  Numbers
+         *            with no parameter are VALUE_DOUBLE.
+         */
+        std::vector<std::uint32_t>
+        CTreeParameter::getStorageTypes() {
+            std::vector<std::uint32_t> result(m_nextId, VALUE_DOUBLE);
+            for (auto& p : m_parameterDictionary) {
+                result[p.second.s_parameterNumber] = p.second.s_storage;
+            }
             return result;
         }
+        /**
+         * getDefinitionCount
+         *    @return std::size_t - number of tree parameters defined.  This
+         *                 is much cheaper than getDefinitions().size().
+         */
+        std::size_t
+        CTreeParameter::getDefinitionCount() {
+            return m_parameterDictionary.size();
+        }
+        /**
+         * reserveDefinitions
+         *    Makes room in the dictionary for nMore more definitions so that
+         *    defining them doesn't rehash it over and over.
+         *    CTreeParameterArray does this before creating its elements.
+         * @param nMore - number of definitions about to be made.
+         */
+        void
+        CTreeParameter::reserveDefinitions(std::size_t nMore) {
+            m_parameterDictionary.reserve(m_parameterDictionary.size() + nMore);
+        }
         /**
          * Private static methods
          */
@@ -258,8 +334,7 @@ namespace frib {
          *  @return pSharedData - pointer to the complete shared data item created.
          *  @note - if this parameter already exists an std::logic_error is thrown.
          *  @note - a parameter number is assigned.
-         *  @note - the generation is set  m_generation -1 which ensures the
-         *         CTreeParameter is invalid for the current event.
+         *  @note - the parameter is not valid for the current event.
          *         
          */
          CTreeParameter::pSharedData
@@ -267,10 +342,9 @@ namespace frib {
             const std::string& name,
             double low, double high, unsigned chans, const char* units
         ) {
-            SharedData data(low, high, chans, units);
-            auto result = m_parameterDictionary.insert(std::make_pair(name, data));
+            auto result = m_parameterDictionary.emplace(name, low, high, chans, units);
             if (result.second) {
-                m_event.resize(m_nextId);
+                context().resize(m_nextId);
                 return &(result.first->second);   // pointer to the data.
             } else {
                 throw std::logic_error(
@@ -472,7 +546,6 @@ namespace frib {
             std::string name, unsigned channels, 
             double lowLimit, double highLimit, std::string units
         ) {
-            m_name = name;
             auto pData = lookupParameter(name);
             if (pData) {
                 pData->s_low   = lowLimit;
@@ -482,6 +555,7 @@ namespace frib {
             } else {
                 pData = makeSharedData(name, lowLimit, highLimit, channels, units.c_str());
             }
+            m_name = std::move(name);
             m_pDefinition = pData;
         }
         /**
@@ -656,7 +730,7 @@ namespace frib {
                     "Tree parameter does not have a valid value in getValue"
                 );
             }
-            return m_event.at(m_pDefinition->s_parameterNumber);
+            return context().get(m_pDefinition->s_parameterNumber);
         }
         /**
          * setValue
@@ -673,14 +747,7 @@ namespace frib {
                     "Tree parameter must be bound to call setValue"
                 );
             }
-            m_event.at(m_pDefinition->s_parameterNumber) = newValue;
-            
-            // If we were not valid before we are now:
-            
-            if (m_pDefinition->s_generation != m_generation) {
-                m_pDefinition->s_generation = m_generation;
-                m_scoreboard.push_back(m_pDefinition->s_parameterNumber);
-            }
+            context().set(m_pDefinition->s_parameterNumber, newValue);
         }
         /**
          * getBins
@@ -851,6 +918,44 @@ namespace frib {
             m_pDefinition->s_units = units;
             m_pDefinition->s_changed = true;
         }
+        /**
+         * getStorage
+         *    @return std::uint32_t - the VALUE_* type used to store the
+         *           parameter's values in parameter files.
+         *    @throw std::logic_error - if not bound.
+         */
+        std::uint32_t
+        CTreeParameter::getStorage() const {
+            if (!isBound()) {
+                throw std::logic_error(
+                    "Tree parameter must be bound to call getStorage"
+                );
+            }
+            return m_pDefinition->s_storage;
+        }
+        /**
+         * setStorage
+         *    Change how the parameter's values are stored in parameter files.
+         *    Values a type can't hold exactly (e.g. 3.5 in a VALUE_UINT16)
+         *    are still stored as doubles.
+         *  @param type - VALUE_DOUBLE, VALUE_FLOAT32, VALUE_UINT16 or
+         *             VALUE_UINT32.
+         *  @throw std::logic_error - if not bound.
+         *  @throw std::invalid_argument - type is not one of those.
+         */
+        void
+        CTreeParameter::setStorage(std::uint32_t type) {
+            if (!isBound()) {
+                throw std::logic_error(
+                    "Tree parameter must be bound to call setStorage"
+                );
+            }
+            if (type > VALUE_UINT32) {
+                throw std::invalid_argument("Invalid tree parameter storage type");
+            }
+            m_pDefinition->s_storage = type;
+            m_pDefinition->s_changed = true;
+        }
         /**
          * isValid
          *    @return bool - true if the parameter has been set
@@ -863,25 +968,19 @@ namespace frib {
                     "Tree parameter must be bound to call isValid"
                 );
             }
-            return m_pDefinition->s_generation == m_generation;
+            return context().isSet(m_pDefinition->s_parameterNumber);
         }
         /**
          * setInvalid
          *    -  If the parameter is not bound throw logic_error.,
-         *    -  If the parameter's generation is the same as current:
-         *       #    Remove its index from the set of indices in the scoreboard.
-         *       #    Set the generation to one less than current.
+         *    -  If the parameter is valid, remove it from the scoreboard
+         *       of this thread's context and make it invalid there.
          */
         void
         CTreeParameter::setInvalid() {
             
             if (isValid()) {     // Checks bindings too.
-                auto p = std::find(
-                    m_scoreboard.begin(), m_scoreboard.end(),
-                    m_pDefinition->s_parameterNumber
-                );
-                m_scoreboard.erase(p);
-                m_pDefinition->s_generation--;   // We've established it was current.
+                context().unset(m_pDefinition->s_parameterNumber);
             }
         }
         /**
@@ -22,11 +22,13 @@
 #define TREEPARAMETER_H
 #include <cstdint>
 #include <string>
-#include <map>
+#include "NameDictionary.h"
 #include <vector>
+#include "TreeParameterContext.h"
 namespace frib {
     namespace analysis {
         class CEvent;
+        class CDefinitionSerializer;
         /**
          * @class TreeParameter
          * 
@@ -37,7 +39,13 @@ namespace frib {
          * of a tree paramter will point to the same underlying parameter.
          * in a single process instance.
          *
-         * @note Tree parameters are inherently _not_ threadsafe.
+         * The definitions are process wide.  The values for the current
+         * event are kept in a CTreeParameterContext.  By default all threads
+         * share a process wide context.
+         *
+         * @note Tree parameters are _not_ threadsafe unless each thread that
+         *       uses them sets its own context and all parameters are
+         *       defined before those threads start.
          */
         class CTreeParameter {
         public:
@@ -49,18 +57,16 @@ namespace frib {
                 double   s_high;                  // Spectrum recommendations.
                 unsigned s_chans;
                 std::string s_units;
-                std::uint64_t s_generation;       // Last generation it was set at.
                 bool          s_changed;          // Definition has changed.
+                std::uint32_t s_storage;          // VALUE_* type in files.
                 _SharedData(double low, double hi, unsigned chans, const char* units);
                 _SharedData(const _SharedData& rhs);
                 _SharedData();
             } SharedData, *pSharedData;
         private:
-            static std::uint64_t                     m_generation;          // For O(1) reset.
-            static std::map<std::string, SharedData> m_parameterDictionary; // Registered parameters.
+            static CNameDictionary<SharedData>       m_parameterDictionary; // Registered parameters.
             static unsigned                          m_nextId;     
-            static std::vector<double>               m_event;               // Event data
-            static std::vector<unsigned>             m_scoreboard;          // Parameters set this event.
+            static CTreeParameterContext             m_processContext;      // Default event data.
         public:
             static SharedData                        m_defaultSpecification;
             
@@ -73,6 +79,9 @@ namespace frib {
         public:
             static void nextEvent();               // Called to start a new event.
             static std::vector<std::pair<unsigned, double>> collectEvent();
+            static void collectEvent(std::vector<std::pair<unsigned, double>>& event);
+            static void collectEvent(ParameterValue* pValues);
+            static std::size_t eventSize();
             static void setDefaultLimits(double low, double high);
             static void setDefaultBins(unsigned bins);
             static void setDefaultUnits(const char* units);
@@ -85,7 +94,13 @@ namespace frib {
             
             static const std::vector<double>&   getEvent();
             static const std::vector<unsigned> getScoreboard();
+            
+            static CTreeParameterContext& context();
+            static void setContext(CTreeParameterContext* pContext);
             static std::vector<std::pair<std::string, SharedData>> getDefinitions();
+            static std::size_t getDefinitionCount();
+            static void reserveDefinitions(std::size_t nMore);
+            static std::vector<std::uint32_t> getStorageTypes();
         private:
             static pSharedData lookupParameter(const std::string& name);
             static pSharedData makeSharedData(
@@ -155,6 +170,8 @@ namespace frib {
             void   setInc(double channelWidth);
             std::string getUnit() const;
             void   setUnit(std::string units);
+            std::uint32_t getStorage() const;
+            void   setStorage(std::uint32_t type);
             bool   isValid() const;
             void   setInvalid();
             void   Reset();
@@ -170,6 +187,7 @@ namespace frib {
             // of C++.
             
             friend ::frib::analysis::CEvent;
+            friend ::frib::analysis::CDefinitionSerializer;  // Sets ids.
         };
         
         
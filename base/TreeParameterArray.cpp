@@ -57,7 +57,7 @@ namespace frib {
          *  m_nFirstIndex  = 0.
          */
         CTreeParameterArray::CTreeParameterArray() :
-          m_nFirstIndex(0)
+          m_nFirstIndex(0), m_nFirstId(0), m_contiguousIds(false)
         {
         
         }
@@ -76,7 +76,8 @@ namespace frib {
          */
         CTreeParameterArray::CTreeParameterArray(string baseName, 
                              unsigned resolution, unsigned numElements, 
-                             int baseIndex)
+                             int baseIndex) :
+          m_nFirstIndex(0), m_nFirstId(0), m_contiguousIds(false)
         {
           Initialize(baseName, resolution, numElements, baseIndex);
         }
@@ -100,7 +101,8 @@ namespace frib {
         CTreeParameterArray::CTreeParameterArray(string baseName, unsigned resolution, 
                              double lowLimit, double highOrWidth, 
                              string units, bool widthOrHighGiven,
-                             unsigned elements, int firstIndex)
+                             unsigned elements, int firstIndex) :
+          m_nFirstIndex(0), m_nFirstId(0), m_contiguousIds(false)
         {
           Initialize(baseName, resolution, lowLimit, highOrWidth, units, widthOrHighGiven,
                  elements, firstIndex);
@@ -116,7 +118,8 @@ namespace frib {
          * 
          */
           CTreeParameterArray::CTreeParameterArray(string baseName, unsigned elements, 
-                               int baseIndex)
+                               int baseIndex) :
+          m_nFirstIndex(0), m_nFirstId(0), m_contiguousIds(false)
         {
           Initialize(baseName, elements, baseIndex);
         }
@@ -132,7 +135,8 @@ namespace frib {
          * 
          */
         CTreeParameterArray::CTreeParameterArray(string baseName, string units, 
-                             unsigned elements, int firstIndex)
+                             unsigned elements, int firstIndex) :
+          m_nFirstIndex(0), m_nFirstId(0), m_contiguousIds(false)
         {
           Initialize(baseName, units, elements, firstIndex);
         }
@@ -152,7 +156,8 @@ namespace frib {
         CTreeParameterArray::CTreeParameterArray(string baseName, 
                              double low, double high, 
                              string units, unsigned elements, 
-                             int firstIndex)
+                             int firstIndex) :
+          m_nFirstIndex(0), m_nFirstId(0), m_contiguousIds(false)
         {
           Initialize(baseName, low, high, units, elements, firstIndex);
         }
@@ -175,7 +180,8 @@ namespace frib {
          */
         CTreeParameterArray::CTreeParameterArray(string baseName, unsigned channels, 
                              double low, double high, string units, 
-                             unsigned elements, int firstIndex)
+                             unsigned elements, int firstIndex) :
+          m_nFirstIndex(0), m_nFirstId(0), m_contiguousIds(false)
         {
           Initialize(baseName, channels, low, high, units, elements, firstIndex);
         }
@@ -232,34 +238,51 @@ namespace frib {
           snprintf(format, sizeof(format), "%s.%%%d.%dd", baseName.c_str(), 
                numDigits, numDigits);
           
+          // Reserving up front means m_Elements won't move so
+          // m_Parameters can point into it.
+          
+          m_Elements.reserve(size);
+          m_Parameters.reserve(size);
+          CTreeParameter::reserveDefinitions(size);
+          
           for (int i =0; i < size; i++) {
             int index = i + m_nFirstIndex; // The element number the user will use.
             char name[100];
             snprintf(name, sizeof(name),  format,  index);
           
-            CTreeParameter* pParameter = new CTreeParameter(
+            m_Elements.emplace_back(
                 name,
                 Template.s_chans, Template.s_low, Template.s_high, Template.s_units
             );
-            m_Parameters.push_back(pParameter);
+            m_Parameters.push_back(&m_Elements.back());
+          }
+          
+          // The ids are consecutive unless some of the names were
+          // already defined.
+          
+          m_contiguousIds = !m_Elements.empty();
+          if (m_contiguousIds) {
+            m_nFirstId = m_Elements[0].getId();
+            for (unsigned i = 1; i < size; i++) {
+              if (m_Elements[i].getId() != m_nFirstId + i) {
+                m_contiguousIds = false;
+                break;
+              }
+            }
           }
         }
         
         
         /**
-         * Deletes all the parameters this vector holds.
+         * Destroys all the parameters this vector holds.
          */
         void 
         CTreeParameterArray::DeleteParameters()
         {
         
-          // Keep deleting elements off the back of the array
-          // until there are none left.
-          //
-          while(!m_Parameters.empty()) {
-            delete m_Parameters.back();
-            m_Parameters.pop_back();
-          }
+          m_Parameters.clear();
+          m_Elements.clear();
+          m_contiguousIds = false;
           
           
         
@@ -279,7 +302,53 @@ namespace frib {
         {
         
           nIndex -= m_nFirstIndex;	// Remove first index bias.
-          return *m_Parameters.at(nIndex);  // Let at sort out range checking.
+          return m_Elements.at(nIndex);  // Let at sort out range checking.
+        }
+        /**
+         * Same as operator[] but the index is not checked.  Use this in
+         * inner loops where the index is known to be good.
+         * @param nIndex    
+         *        Index into the array (m_nFirstIndex is the first element).
+         */
+        CTreeParameter&
+        CTreeParameterArray::unchecked(int nIndex)
+        {
+          return m_Elements[nIndex - m_nFirstIndex];
+        }
+        /**
+         * Makes all of the elements valid for this event and returns a pointer
+         * to their values so they can all be filled in one loop:
+         * \verbatim
+         *   double* pValues = array.setAll();
+         *   for (unsigned i = 0; i < array.size(); i++) {
+         *      pValues[i] = pRaw[i] * gain[i];
+         *   }
+         * \endverbatim
+         * pValues[i] is the element at lowIndex() + i.  The pointer is only good
+         * for the current event in this thread.
+         * @return double*
+         * @throw std::logic_error - the elements don't have consecutive
+         *        parameter numbers (see hasContiguousIds).
+         */
+        double*
+        CTreeParameterArray::setAll()
+        {
+          if (!m_contiguousIds) {
+            throw std::logic_error(
+              "CTreeParameterArray::setAll - the array's parameter ids are not consecutive"
+            );
+          }
+          return CTreeParameter::context().referenceRange(m_nFirstId, m_Elements.size());
+        }
+        /**
+         * @return bool - true if the elements have consecutive parameter
+         *  numbers.  That's the case unless some of them were defined before
+         *  the array was created.
+         */
+        bool
+        CTreeParameterArray::hasContiguousIds() const
+        {
+          return m_contiguousIds;
         }
         
         
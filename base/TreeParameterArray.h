@@ -55,6 +55,13 @@ namespace frib {
          * basename.17
          * \endverbatim
          * for an 18 element array.
+         *
+         * The elements are stored contiguously and, as long as the array
+         * defines its parameters (rather than binding to some that were
+         * defined earlier), they get consecutive parameter numbers.  Then
+         * setAll gives unpackers a pointer to the values of the whole array
+         * so they can be filled in a tight loop.  unchecked is operator[]
+         * without the range check.
          * @author Ron Fox
          * @version 1.0
          * @created 30-Mar-2005 11:03:51 AM
@@ -68,7 +75,10 @@ namespace frib {
            * negative BTW).
            */
           int m_nFirstIndex;  
-          std::vector<CTreeParameter*> m_Parameters;
+          std::vector<CTreeParameter>  m_Elements;     // Contiguous elements.
+          std::vector<CTreeParameter*> m_Parameters;   // Point into m_Elements.
+          unsigned m_nFirstId;       // Parameter number of the first element.
+          bool     m_contiguousIds;  // Element ids are m_nFirstId, m_nFirstId+1...
           
         public:
           /**
@@ -94,6 +104,9 @@ namespace frib {
           ~CTreeParameterArray();
         
           CTreeParameter& operator[](int nIndex);
+          CTreeParameter& unchecked(int nIndex);
+          double* setAll();
+          bool hasContiguousIds() const;
           void Reset();
           void Initialize(std::string baseName, unsigned  resolution, 
                   unsigned  elements, int baseIndex = 0);
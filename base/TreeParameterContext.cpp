@@ -0,0 +1,243 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+
+/** @file:  TreeParameterContext.cpp
+ *  @brief: Implement CTreeParameterContext.
+ */
+#include "TreeParameterContext.h"
+#include "AnalysisRingItems.h"
+#include <stdexcept>
+#include <algorithm>
+
+namespace frib {
+    namespace analysis {
+        /**
+         * constructor
+         *    Starting the generation at 1 makes every parameter invalid
+         *    since their generations start at 0.
+         */
+        CTreeParameterContext::CTreeParameterContext() :
+            m_generation(1)
+        {}
+        /**
+         * destructor
+         */
+        CTreeParameterContext::~CTreeParameterContext() {}
+        
+        /**
+         * resize
+         *    Make room for at least nParameters parameters.  New
+         *    parameters are not valid.
+         * @param nParameters - number of parameters.
+         */
+        void
+        CTreeParameterContext::resize(unsigned nParameters) {
+            if (nParameters > m_event.size()) {
+                m_event.resize(nParameters);
+                m_generations.resize(nParameters, m_generation - 1);
+            }
+        }
+        /**
+         * nextEvent
+         *    Start a new event: all parameters become invalid.
+         */
+        void
+        CTreeParameterContext::nextEvent() {
+            m_generation++;
+            m_scoreboard.clear();
+        }
+        /**
+         * clear
+         *    Return to the initial state (no parameters, generation 1).
+         */
+        void
+        CTreeParameterContext::clear() {
+            m_generation = 1;
+            m_event.clear();
+            m_scoreboard.clear();
+            m_generations.clear();
+        }
+        /**
+         * isSet
+         *   @param id - a parameter number.
+         *   @return bool - true if the parameter was set this event.
+         */
+        bool
+        CTreeParameterContext::isSet(unsigned id) const {
+            return (id < m_generations.size()) && (m_generations[id] == m_generation);
+        }
+        /**
+         * get
+         *   @param id - a parameter number.
+         *   @return double - its value.  This is only meaningful if isSet.
+         *   @throw std::out_of_range - id is not in the event.
+         */
+        double
+        CTreeParameterContext::get(unsigned id) const {
+            return m_event.at(id);
+        }
+        /**
+         * set
+         *    Set a parameter's value.  If it was not yet set this event it's
+         *    added to the scoreboard.
+         * @param id    - parameter number.
+         * @param value - new value.
+         */
+        void
+        CTreeParameterContext::set(unsigned id, double value) {
+            reference(id) = value;
+        }
+        /**
+         * reference
+         *    Marks a parameter as set this event (adding it to the
+         *    scoreboard if it was not yet set) and returns a reference
+         *    to its value.  This is O(1) thanks to the generation stamps.
+         * @param id - parameter number.
+         * @return double& - the parameter's value.  It's only valid until
+         *                   the event is resized.
+         */
+        double&
+        CTreeParameterContext::reference(unsigned id) {
+            if (id >= m_event.size()) {
+                resize(id + 1);
+            }
+            if (m_generations[id] != m_generation) {
+                m_generations[id] = m_generation;
+                m_scoreboard.push_back(id);
+            }
+            return m_event[id];
+        }
+        /**
+         * referenceRange
+         *    Marks a range of consecutive parameters as set this event and
+         *    returns a pointer to their values so they can be filled in
+         *    a single loop.
+         * @param firstId - number of the first parameter.
+         * @param n       - number of parameters.
+         * @return double* - value of firstId; the others follow it.  Only
+         *                   valid until the event is resized.
+         */
+        double*
+        CTreeParameterContext::referenceRange(unsigned firstId, unsigned n) {
+            if (firstId + n > m_event.size()) {
+                resize(firstId + n);
+            }
+            std::uint64_t* pGenerations = m_generations.data() + firstId;
+            for (unsigned i = 0; i < n; i++) {
+                if (pGenerations[i] != m_generation) {
+                    pGenerations[i] = m_generation;
+                    m_scoreboard.push_back(firstId + i);
+                }
+            }
+            return m_event.data() + firstId;
+        }
+        /**
+         * unset
+         *    Make a parameter invalid for this event.  This is a no-op if it's
+         *    not set.
+         * @param id - parameter number.
+         */
+        void
+        CTreeParameterContext::unset(unsigned id) {
+            if (isSet(id)) {
+                auto p = std::find(m_scoreboard.begin(), m_scoreboard.end(), id);
+                m_scoreboard.erase(p);
+                m_generations[id] = m_generation - 1;
+            }
+        }
+        /**
+         * collectEvent
+         *    @return std::vector<std::pair<unsigned, double>> - parameter
+         *          number/value pairs for the parameters set this event.
+         *    @note if, somehow the scoreboard has an invalid index,
+         *          std::out_of_range is thrown.
+         */
+        std::vector<std::pair<unsigned, double>>
+        CTreeParameterContext::collectEvent() const {
+            std::vector<std::pair<unsigned, double>> result;
+            collectEvent(result);
+            return result;
+        }
+        /**
+         * collectEvent
+         *    Same as above but the pairs are put in a vector the caller
+         *    can reuse so that, once it's grown, nothing is allocated.
+         * @param event - receives the number/value pairs.  Its previous
+         *                contents are discarded.
+         */
+        void
+        CTreeParameterContext::collectEvent(
+            std::vector<std::pair<unsigned, double>>& event
+        ) const {
+            event.clear();
+            for (auto n : m_scoreboard) {
+                event.push_back({n, m_event.at(n)});
+            }
+        }
+        /**
+         * collectEvent
+         *    Write the parameters set this event as ParameterValue structs -
+         *    the form they take in PARAMETER_DATA items and batches.
+         * @param pValues - where to put them.  There must be room
+         *                  for eventSize() values.
+         * @note set sizes the event for every parameter it puts in the
+         *       scoreboard so the values are not range checked here.
+         */
+        void
+        CTreeParameterContext::collectEvent(ParameterValue* pValues) const {
+            const double* pEvent = m_event.data();
+            for (auto n : m_scoreboard) {
+                pValues->s_number = n;
+                pValues->s_value  = pEvent[n];
+                pValues++;
+            }
+        }
+        /**
+         * eventSize
+         *   @return std::size_t - number of parameters set this event.
+         */
+        std::size_t
+        CTreeParameterContext::eventSize() const {
+            return m_scoreboard.size();
+        }
+        /**
+         * getEvent
+         *   @return const std::vector<double>& - the event values.
+         */
+        const std::vector<double>&
+        CTreeParameterContext::getEvent() const {
+            return m_event;
+        }
+        /**
+         * getScoreboard
+         *   @return const std::vector<unsigned>& - parameters set this event.
+         */
+        const std::vector<unsigned>&
+        CTreeParameterContext::getScoreboard() const {
+            return m_scoreboard;
+        }
+        /**
+         * generation
+         *   @return std::uint64_t - the current generation.
+         */
+        std::uint64_t
+        CTreeParameterContext::generation() const {
+            return m_generation;
+        }
+    }
+}
@@ -0,0 +1,105 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+
+/** @file:  TreeParameterContext.h
+ *  @brief: Per event state of the tree parameters.
+ */
+#ifndef TREEPARAMETERCONTEXT_H
+#define TREEPARAMETERCONTEXT_H
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <utility>
+
+namespace frib {
+    namespace analysis {
+        class CEvent;
+        struct _ParameterValue;
+        typedef struct _ParameterValue ParameterValue;
+        /**
+         * @class CTreeParameterContext
+         *    Tree parameter definitions (the dictionary) are shared by the
+         *    whole process.  The values of the parameters for the event
+         *    being processed live in a context.  A context holds:
+         *    -  The event: a value for each parameter, indexed by
+         *       parameter number.
+         *    -  The scoreboard: the numbers of the parameters set in this
+         *       event, in the order they were first set.
+         *    -  A generation (event) number and, for each parameter, the
+         *       generation in which it was last set.  A parameter is valid
+         *       if that's the current generation so starting a new event
+         *       is O(1).
+         *
+         *    There's a process wide context which is used by default.
+         *    A thread can use its own context (see
+         *    CTreeParameter::setContext) so that several threads can
+         *    process events at the same time using the same tree
+         *    parameter objects.  The definitions must then be made before
+         *    those threads start; the dictionary is not locked.
+         *
+         *    The vectors grow as needed when a parameter that was defined
+         *    after the context was sized is set.
+         *
+         *    collectEvent comes in three flavors.  The one that returns a
+         *    vector is the simplest to use.  Per event code should use one
+         *    that fills a caller's vector (reused from event to event) or,
+         *    better, one that writes ParameterValue wire format directly
+         *    into a buffer of eventSize() elements; those don't allocate.
+         */
+        class CTreeParameterContext {
+        private:
+            std::uint64_t              m_generation;    // Current event.
+            std::vector<double>        m_event;         // Values.
+            std::vector<unsigned>      m_scoreboard;    // Set this event.
+            std::vector<std::uint64_t> m_generations;   // When each was set.
+        public:
+            CTreeParameterContext();
+            virtual ~CTreeParameterContext();
+        private:
+            CTreeParameterContext(const CTreeParameterContext& rhs);
+            CTreeParameterContext& operator=(const CTreeParameterContext& rhs);
+            int operator==(const CTreeParameterContext& rhs);
+            int operator!=(const CTreeParameterContext& rhs);
+        public:
+            void resize(unsigned nParameters);
+            void nextEvent();
+            void clear();
+            
+            bool   isSet(unsigned id) const;
+            double get(unsigned id) const;
+            void   set(unsigned id, double value);
+            double& reference(unsigned id);
+            double* referenceRange(unsigned firstId, unsigned n);
+            void   unset(unsigned id);
+            
+            std::vector<std::pair<unsigned, double>> collectEvent() const;
+            void collectEvent(std::vector<std::pair<unsigned, double>>& event) const;
+            void collectEvent(ParameterValue* pValues) const;
+            std::size_t eventSize() const;
+            const std::vector<double>&   getEvent() const;
+            const std::vector<unsigned>& getScoreboard() const;
+            std::uint64_t generation() const;
+            
+            // SpecTcl's CEvent hands out references into the event.
+            
+            friend ::frib::analysis::CEvent;
+        };
+    }
+}
+
+#endif
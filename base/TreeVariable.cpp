@@ -20,6 +20,7 @@
  */
 #include "TreeVariable.h"
 #include <stdexcept>
+#include <algorithm>
 
 namespace frib {
     namespace analysis {
@@ -58,8 +59,11 @@ namespace frib {
         
         // Static data for CTreeVariable:
         
-        std::map<std::string, CTreeVariable::Definition>
-            CTreeVariable::m_dictionary;
+        // Hashed for fast lookup; elements don't move as it grows so
+        // m_pDefinition pointers stay valid.  Iteration is in creation order;
+        // getNames and getDefinitions sort by name.
+        
+        CNameDictionary<CTreeVariable::Definition> CTreeVariable::m_dictionary;
             
         //   Static methods (public and private).
         
@@ -77,9 +81,7 @@ namespace frib {
             if (m_dictionary.count(name)) {
                 throw std::logic_error("createDefinition - definition already exists");
             } else {
-                auto p = m_dictionary.insert(
-                    std::make_pair(name, Definition(value, pUnits))
-                );
+                auto p = m_dictionary.emplace(name, value, pUnits);
                 return &(p.first->second);
             }
         }
@@ -107,9 +109,11 @@ namespace frib {
         std::vector<std::string>
         CTreeVariable::getNames() {
             std::vector<std::string> result;
+            result.reserve(m_dictionary.size());
             for (auto& p : m_dictionary) {
                 result.push_back(p.first);
             }
+            std::sort(result.begin(), result.end());
             return result;
         }
         /**
@@ -117,21 +121,28 @@ namespace frib {
          *
          * @return std::vector<std::pair<std::string, const pDefinition>>
          *    first is the name of an item, second its definition.
+         *    Sorted by name.
          */
         std::vector<std::pair<std::string, const CTreeVariable::Definition*>>
         CTreeVariable::getDefinitions()
         {
             std::vector<std::pair<std::string, const Definition*>> result;
+            result.reserve(m_dictionary.size());
             for (auto& p : m_dictionary) {
                 std::pair<std::string, const Definition*> def =
                     {p.first, &(p.second)};
                 result.push_back(def);                    
             }
+            std::sort(result.begin(), result.end(), [](
+                const std::pair<std::string, const Definition*>& d1,
+                const std::pair<std::string, const Definition*>& d2
+            ) { return d1.first < d2.first; });
             return result;
         }
         /**
          * begin
          *    Provide standard iteration support for the tree variable dict.
+         *    Iteration is in the order the variables were created.
          * @return CTreeVarialbe::TreeVariableIterator
          */
         CTreeVariable::TreeVariableIterator
@@ -22,7 +22,7 @@
 #define TREEVARIABLE_H
 
 #include <string>
-#include <map>
+#include "NameDictionary.h"
 #include <vector>
 
 namespace frib {
@@ -65,11 +65,11 @@ namespace frib {
                 } Definition, *pDefinition;
             // Static data:
             private:
-                static std::map<std::string, Definition> m_dictionary;
+                static CNameDictionary<Definition> m_dictionary;
             // Static private methods
 
             public:
-                typedef std::map<std::string, Definition>::iterator
+                typedef CNameDictionary<Definition>::iterator
                     TreeVariableIterator;
             
             // Per object data:
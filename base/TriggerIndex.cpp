@@ -0,0 +1,495 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+
+/** @file:  TriggerIndex.cpp
+ *  @brief: Implement the trigger index.
+ */
+#include "TriggerIndex.h"
+#include "DataReader.h"
+#include <algorithm>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <string.h>
+
+// NSCLDAQ stuff normally in DataFormat.h:
+
+static const std::uint32_t PHYSICS_EVENT = 30;
+
+// Entries in each TRIGGER_INDEX item of a sidecar (keeps items ~1.5MB).
+
+static const std::size_t ITEM_ENTRIES = 65536;
+
+// Size of the blocks build reads; items must fit in them.
+
+static const std::size_t BUILD_BLOCK = 16*1024*1024;
+
+// Get the size and modification time (ns since the epoch) of a file.
+// Returns false if the file can't be stat-ed.
+
+static bool
+fileIdentity(const char* pFilename, std::uint64_t& size, std::uint64_t& mtime)
+{
+    struct stat info;
+    if (stat(pFilename, &info) < 0) {
+        return false;
+    }
+    size  = info.st_size;
+    mtime = std::uint64_t(info.st_mtim.tv_sec)*1000000000 + info.st_mtim.tv_nsec;
+    return true;
+}
+
+namespace frib {
+    namespace analysis {
+        // An entry per 1024 items costs about 24 bytes per thousand events
+        // and leaves a reader that seeks a thousand items to skip.
+        
+        const std::uint32_t CTriggerIndex::DEFAULT_INTERVAL(1024);
+        
+        /**
+         * constructor
+         *   @param interval - number of items between index entries.
+         *   @throw std::invalid_argument - interval is 0.
+         */
+        CTriggerIndex::CTriggerIndex(std::uint32_t interval) :
+            m_nInterval(interval), m_nItems(0), m_nNextEntry(0),
+            m_nFileSize(0), m_nFileTime(0)
+        {
+            if (interval == 0) {
+                throw std::invalid_argument(
+                    "CTriggerIndex - the interval must be at least 1"
+                );
+            }
+        }
+        /**
+         * destructor
+         */
+        CTriggerIndex::~CTriggerIndex() {}
+        
+        /**
+         * addItem
+         *    Account for the next item of the file.  If it has a trigger
+         *    and at least interval items have gone by since the last entry
+         *    (or there are no entries yet) an entry is made for it.
+         * @param offset - offset of the item in the file.
+         * @param hasTrigger - true if the item has a trigger number.
+         * @param trigger - the trigger number if it does.
+         */
+        void
+        CTriggerIndex::addItem(
+            std::uint64_t offset, bool hasTrigger, std::uint64_t trigger
+        ) {
+            if (hasTrigger && (m_nItems >= m_nNextEntry)) {
+                TriggerIndexEntry entry = {trigger, m_nItems, offset};
+                m_entries.push_back(entry);
+                m_nNextEntry = m_nItems + m_nInterval;
+            }
+            m_nItems++;
+        }
+        /**
+         * addContext
+         *    Keep a copy of an item readers need wherever they start.
+         * @param pItem - the ring item.
+         */
+        void
+        CTriggerIndex::addContext(const void* pItem) {
+            const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(pItem);
+            const RingItemHeader* pHeader = reinterpret_cast<const RingItemHeader*>(p);
+            m_context.insert(m_context.end(), p, p + pHeader->s_size);
+        }
+        /**
+         * build
+         *    Index a file from its start.  If the first item is a
+         *    PARAMETER_DEFINITIONS item, it's a parameter file and its
+         *    PARAMETER_PATTERNS items are kept as context.  Otherwise it's a
+         *    raw event file and triggers are counted physics events.
+         *    Any existing index is replaced.  Use describeFile to say which
+         *    file was indexed.
+         * @param reader - reader positioned at the start of the file.
+         */
+        void
+        CTriggerIndex::build(CDataReader& reader) {
+            clear();
+            std::uint64_t offset  = 0;
+            std::uint64_t physics = 0;
+            bool          first   = true;
+            bool          raw     = true;
+            while (1) {
+                auto block = reader.getBlock(BUILD_BLOCK);
+                if (!block.s_nbytes) {
+                    reader.done();
+                    break;
+                }
+                const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(block.s_pData);
+                for (std::size_t i = 0; i < block.s_nItems; i++) {
+                    const RingItemHeader* pHeader =
+                        reinterpret_cast<const RingItemHeader*>(p);
+                    if (first) {
+                        raw   = pHeader->s_type != PARAMETER_DEFINITIONS;
+                        first = false;
+                    }
+                    bool          hasTrigger;
+                    std::uint64_t trigger = 0;
+                    if (raw) {
+                        hasTrigger = pHeader->s_type == PHYSICS_EVENT;
+                        trigger    = physics;
+                        if (hasTrigger) physics++;
+                    } else {
+                        hasTrigger = triggerOf(p, trigger);
+                        if (pHeader->s_type == PARAMETER_PATTERNS) {
+                            addContext(p);
+                        }
+                    }
+                    addItem(offset, hasTrigger, trigger);
+                    offset += pHeader->s_size;
+                    p      += pHeader->s_size;
+                }
+                reader.done();
+            }
+        }
+        /**
+         * clear
+         *    Empty the index.
+         */
+        void
+        CTriggerIndex::clear() {
+            m_entries.clear();
+            m_context.clear();
+            m_nItems     = 0;
+            m_nNextEntry = 0;
+            m_nFileSize  = 0;
+            m_nFileTime  = 0;
+        }
+        /**
+         * setFile
+         *    Record the identity of the indexed file.
+         * @param size - its size in bytes.
+         * @param mtime - its modification time in ns since the epoch.
+         */
+        void
+        CTriggerIndex::setFile(std::uint64_t size, std::uint64_t mtime) {
+            m_nFileSize = size;
+            m_nFileTime = mtime;
+        }
+        /**
+         * describeFile
+         *    Record the size and modification time of the indexed file.
+         *    Do this once the file is complete.
+         * @param pFilename - the file.
+         * @throw std::runtime_error - the file can't be stat-ed.
+         */
+        void
+        CTriggerIndex::describeFile(const char* pFilename) {
+            std::uint64_t size, mtime;
+            if (!fileIdentity(pFilename, size, mtime)) {
+                std::string msg = "CTriggerIndex can't stat ";
+                msg += pFilename;
+                msg += ": ";
+                msg += strerror(errno);
+                throw std::runtime_error(msg);
+            }
+            setFile(size, mtime);
+        }
+        /**
+         * describes
+         *    @param pFilename - a data file.
+         *    @return bool - true if the file has the size and modification
+         *           time recorded for the indexed file.
+         */
+        bool
+        CTriggerIndex::describes(const char* pFilename) const {
+            std::uint64_t size, mtime;
+            return fileIdentity(pFilename, size, mtime) &&
+                (size == m_nFileSize) && (mtime == m_nFileTime);
+        }
+        /**
+         * write
+         *    Write the index to a sidecar file: the entries in
+         *    TRIGGER_INDEX items (there's always at least one, each carries
+         *    the indexed file's identity) followed by the context items.
+         * @param pFilename - the file; it's replaced if it exists.
+         * @throw std::runtime_error - the file can't be written.
+         */
+        void
+        CTriggerIndex::write(const char* pFilename) const {
+            std::vector<std::uint8_t> data;
+            std::size_t next = 0;
+            do {
+                std::size_t n = std::min(ITEM_ENTRIES, m_entries.size() - next);
+                std::size_t start = data.size();
+                data.resize(start + sizeof(TriggerIndex) + n * sizeof(TriggerIndexEntry));
+                pTriggerIndex pItem = reinterpret_cast<pTriggerIndex>(data.data() + start);
+                pItem->s_header.s_size   = data.size() - start;
+                pItem->s_header.s_type   = TRIGGER_INDEX;
+                pItem->s_header.s_unused = sizeof(std::uint32_t);
+                pItem->s_interval        = m_nInterval;
+                pItem->s_entryCount      = n;
+                pItem->s_fileSize        = m_nFileSize;
+                pItem->s_fileTime        = m_nFileTime;
+                if (n) {
+                    memcpy(pItem->s_entries, m_entries.data() + next, n * sizeof(TriggerIndexEntry));
+                }
+                next += n;
+            } while (next < m_entries.size());
+            data.insert(data.end(), m_context.begin(), m_context.end());
+            
+            int fd = open(pFilename, O_WRONLY | O_CREAT | O_TRUNC, 0664);
+            if (fd < 0) {
+                std::string msg = "CTriggerIndex failed to open ";
+                msg += pFilename;
+                msg += ": ";
+                msg += strerror(errno);
+                throw std::runtime_error(msg);
+            }
+            const std::uint8_t* p = data.data();
+            std::size_t nBytes = data.size();
+            while (nBytes) {
+                ssize_t n = ::write(fd, p, nBytes);
+                if (n < 0) {
+                    if (errno == EINTR) continue;
+                    std::string msg = "CTriggerIndex failed to write index: ";
+                    msg += strerror(errno);
+                    close(fd);
+                    throw std::runtime_error(msg);
+                }
+                p      += n;
+                nBytes -= n;
+            }
+            if (close(fd) < 0) {
+                std::string msg = "CTriggerIndex failed to close index: ";
+                msg += strerror(errno);
+                throw std::runtime_error(msg);
+            }
+        }
+        /**
+         * read
+         *    Replace the index with one from a sidecar file.  The result
+         *    is for lookups; items added to it are counted from 0.
+         * @param pFilename - the file.
+         * @throw std::runtime_error - the file can't be read or is not a
+         *        trigger index (e.g. its items disagree about the indexed
+         *        file or an entry lies outside it).  The index is left as
+         *        it was.
+         */
+        void
+        CTriggerIndex::read(const char* pFilename) {
+            int fd = open(pFilename, O_RDONLY);
+            if (fd < 0) {
+                std::string msg = "CTriggerIndex failed to open ";
+                msg += pFilename;
+                msg += ": ";
+                msg += strerror(errno);
+                throw std::runtime_error(msg);
+            }
+            struct stat info;
+            std::vector<std::uint8_t> data;
+            if (fstat(fd, &info) == 0) {
+                data.resize(info.st_size);
+            }
+            std::size_t nRead = 0;
+            while (nRead < data.size()) {
+                ssize_t n = ::read(fd, data.data() + nRead, data.size() - nRead);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) break;
+                nRead += n;
+            }
+            close(fd);
+            if (nRead != data.size()) {
+                throw std::runtime_error("CTriggerIndex failed to read the index");
+            }
+            std::uint32_t                  interval = 0;
+            std::uint64_t                  fileSize = 0;
+            std::uint64_t                  fileTime = 0;
+            std::vector<TriggerIndexEntry> entries;
+            std::vector<std::uint8_t>      context;
+            std::size_t offset = 0;
+            while (offset < data.size()) {
+                const RingItemHeader* pHeader =
+                    reinterpret_cast<const RingItemHeader*>(data.data() + offset);
+                if (
+                    (data.size() - offset < sizeof(RingItemHeader)) ||
+                    (pHeader->s_size < sizeof(RingItemHeader)) ||
+                    (pHeader->s_size > data.size() - offset)
+                ) {
+                    throw std::runtime_error("CTriggerIndex - corrupt index file");
+                }
+                if (pHeader->s_type == TRIGGER_INDEX) {
+                    const TriggerIndex* pItem =
+                        reinterpret_cast<const TriggerIndex*>(pHeader);
+                    if (
+                        (pHeader->s_size < sizeof(TriggerIndex)) ||
+                        (pHeader->s_size !=
+                            sizeof(TriggerIndex) +
+                            std::uint64_t(pItem->s_entryCount) * sizeof(TriggerIndexEntry)) ||
+                        (pItem->s_interval == 0)
+                    ) {
+                        throw std::runtime_error("CTriggerIndex - corrupt index item");
+                    }
+                    if (
+                        interval &&
+                        ((pItem->s_fileSize != fileSize) || (pItem->s_fileTime != fileTime))
+                    ) {
+                        throw std::runtime_error(
+                            "CTriggerIndex - index items describe different files"
+                        );
+                    }
+                    for (std::uint32_t i = 0; i < pItem->s_entryCount; i++) {
+                        if (pItem->s_entries[i].s_offset >= pItem->s_fileSize) {
+                            throw std::runtime_error(
+                                "CTriggerIndex - index entry is past the end of its file"
+                            );
+                        }
+                    }
+                    interval = pItem->s_interval;
+                    fileSize = pItem->s_fileSize;
+                    fileTime = pItem->s_fileTime;
+                    entries.insert(
+                        entries.end(), pItem->s_entries,
+                        pItem->s_entries + pItem->s_entryCount
+                    );
+                } else {
+                    const std::uint8_t* p = data.data() + offset;
+                    context.insert(context.end(), p, p + pHeader->s_size);
+                }
+                offset += pHeader->s_size;
+            }
+            if (interval == 0) {
+                throw std::runtime_error("CTriggerIndex - not a trigger index file");
+            }
+            m_nInterval = interval;
+            m_nFileSize = fileSize;
+            m_nFileTime = fileTime;
+            m_entries.swap(entries);
+            m_context.swap(context);
+            m_nItems     = 0;
+            m_nNextEntry = 0;
+        }
+        /**
+         * find
+         *    @param trigger - a trigger number.
+         *    @return const TriggerIndexEntry* - the last entry whose trigger
+         *            is at or before it or nullptr if there's none (start
+         *            at the beginning of the file).
+         */
+        const TriggerIndexEntry*
+        CTriggerIndex::find(std::uint64_t trigger) const {
+            auto p = std::upper_bound(
+                m_entries.begin(), m_entries.end(), trigger,
+                [](std::uint64_t t, const TriggerIndexEntry& e) {
+                    return t < e.s_trigger;
+                }
+            );
+            return p == m_entries.begin() ? nullptr : &(*(p - 1));
+        }
+        /**
+         * size
+         *    @return std::size_t - number of entries.
+         */
+        std::size_t
+        CTriggerIndex::size() const {
+            return m_entries.size();
+        }
+        /**
+         * operator[]
+         *    @param i - entry number.
+         *    @return const TriggerIndexEntry& - that entry.
+         *    @throw std::out_of_range - there's no such entry.
+         */
+        const TriggerIndexEntry&
+        CTriggerIndex::operator[](std::size_t i) const {
+            return m_entries.at(i);
+        }
+        /**
+         * interval
+         *    @return std::uint32_t - number of items between entries.
+         */
+        std::uint32_t
+        CTriggerIndex::interval() const {
+            return m_nInterval;
+        }
+        /**
+         * items
+         *    @return std::uint64_t - number of items added.
+         */
+        std::uint64_t
+        CTriggerIndex::items() const {
+            return m_nItems;
+        }
+        /**
+         * context
+         *    @return const std::vector<std::uint8_t>& - the context items.
+         */
+        const std::vector<std::uint8_t>&
+        CTriggerIndex::context() const {
+            return m_context;
+        }
+        /**
+         * fileSize
+         *    @return std::uint64_t - size of the indexed file.
+         */
+        std::uint64_t
+        CTriggerIndex::fileSize() const {
+            return m_nFileSize;
+        }
+        /**
+         * fileTime
+         *    @return std::uint64_t - modification time of the indexed file
+         *                  in ns since the epoch.
+         */
+        std::uint64_t
+        CTriggerIndex::fileTime() const {
+            return m_nFileTime;
+        }
+        /**
+         * sidecarName [static]
+         *    @param pFilename - name of a data file.
+         *    @return std::string - the name of its index sidecar.
+         */
+        std::string
+        CTriggerIndex::sidecarName(const char* pFilename) {
+            std::string result = pFilename;
+            result += ".idx";
+            return result;
+        }
+        /**
+         * triggerOf [static]
+         *    Get the trigger number of a parameter file item.
+         * @param pItem - the ring item.
+         * @param[out] trigger - its trigger number if it has one.
+         * @return bool - true if it has one.
+         * @note all of the item types with triggers have their trigger
+         *       number just after the header.
+         */
+        bool
+        CTriggerIndex::triggerOf(const void* pItem, std::uint64_t& trigger) {
+            const ParameterItem* p = reinterpret_cast<const ParameterItem*>(pItem);
+            switch (p->s_header.s_type) {
+            case PARAMETER_DATA:
+            case PACKED_PARAMETER_DATA:
+            case PATTERN_PARAMETER_DATA:
+            case COMPRESSED_PARAMETERS:
+                trigger = p->s_triggerCount;
+                return true;
+            default:
+                return false;
+            }
+        }
+    }
+}
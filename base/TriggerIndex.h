@@ -0,0 +1,111 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+
+/** @file:  TriggerIndex.h
+ *  @brief: Index of where triggers are in a raw or parameter file.
+ */
+#ifndef TRIGGERINDEX_H
+#define TRIGGERINDEX_H
+#include "AnalysisRingItems.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace frib {
+    namespace analysis {
+        class CDataReader;
+        /**
+         * @class CTriggerIndex
+         *    Readers can only stream a file from the start.  A trigger index
+         *    lets them start at a trigger instead: every interval items
+         *    it notes the offset, trigger number and item count of the
+         *    next item that has a trigger.  To start at trigger t, seek to
+         *    the last entry at or before t (find) and skip forward from
+         *    there.  Indices are kept in a sidecar file (sidecarName) of
+         *    TRIGGER_INDEX items.
+         *
+         *    -  In a parameter file, the items with triggers are event items
+         *       (PARAMETER_DATA, PACKED_PARAMETER_DATA, PATTERN_PARAMETER_DATA)
+         *       and COMPRESSED_PARAMETERS frames (whose trigger is that of
+         *       their first event).  CDataWriter can build the index as it
+         *       writes the file.
+         *    -  In a raw event file, the items with triggers are the physics
+         *       events and the trigger number is the count of physics events
+         *       before the item, as CMPIRawReader numbers them.
+         *
+         *    build indexes an existing file of either sort.
+         *
+         *    Some items are needed to make sense of what follows them
+         *    wherever a reader starts, e.g. the PARAMETER_PATTERNS items of a
+         *    pattern encoded file.  Copies of those can be kept with the
+         *    index as its context (addContext); they're written to the
+         *    sidecar after the entries.
+         *
+         *    An index is only good for the file it was made from.  The size
+         *    and modification time of that file are recorded with the index
+         *    (describeFile) so that users can check that a sidecar still
+         *    describes its data file (describes) before seeking with it.
+         */
+        class CTriggerIndex {
+        public:
+            static const std::uint32_t DEFAULT_INTERVAL;
+        private:
+            std::uint32_t                  m_nInterval;
+            std::vector<TriggerIndexEntry> m_entries;
+            std::vector<std::uint8_t>      m_context;
+            std::uint64_t                  m_nItems;      // Added so far.
+            std::uint64_t                  m_nNextEntry;  // Item count for it.
+            std::uint64_t                  m_nFileSize;   // Of the indexed file.
+            std::uint64_t                  m_nFileTime;   // Its mtime in ns.
+        public:
+            CTriggerIndex(std::uint32_t interval = DEFAULT_INTERVAL);
+            virtual ~CTriggerIndex();
+        private:
+            CTriggerIndex(const CTriggerIndex& rhs);
+            CTriggerIndex& operator=(const CTriggerIndex& rhs);
+            int operator==(const CTriggerIndex& rhs);
+            int operator!=(const CTriggerIndex& rhs);
+        public:
+            void addItem(std::uint64_t offset, bool hasTrigger, std::uint64_t trigger);
+            void addContext(const void* pItem);
+            void build(CDataReader& reader);
+            void clear();
+            void setFile(std::uint64_t size, std::uint64_t mtime);
+            void describeFile(const char* pFilename);
+            bool describes(const char* pFilename) const;
+            
+            void write(const char* pFilename) const;
+            void read(const char* pFilename);
+            
+            const TriggerIndexEntry* find(std::uint64_t trigger) const;
+            std::size_t size() const;
+            const TriggerIndexEntry& operator[](std::size_t i) const;
+            std::uint32_t interval() const;
+            std::uint64_t items() const;
+            const std::vector<std::uint8_t>& context() const;
+            std::uint64_t fileSize() const;
+            std::uint64_t fileTime() const;
+            
+            static std::string sidecarName(const char* pFilename);
+            static bool triggerOf(const void* pItem, std::uint64_t& trigger);
+        };
+    }
+}
+
+#endif
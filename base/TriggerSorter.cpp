@@ -19,87 +19,435 @@
  *  @brief:  Implement the trigger sorter class.
  */
 #include "TriggerSorter.h"
+#include "ParameterItemPool.h"
+#include "ParameterBatch.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
 
 namespace frib {
     namespace analysis {
+        const std::size_t CTriggerSorter::DEFAULT_CAPACITY(1024);
+        const std::size_t CTriggerSorter::MAX_CAPACITY(1024*1024);
+        
         /**
          * constructor
          *    The hardest part of the constructor is initializing the
          *    last emitted trigger... we emit it to 0-1 unsigned so that
          *    it + 1 (0) is the next trigger.
+         *    The reorder window starts out with the smallest power of two
+         *    that's at least initialCapacity slots.
+         *
+         * @param initialCapacity - initial number of slots in the window.
+         * @param pPool - if not null, the pool the items come from.
          */
-        CTriggerSorter::CTriggerSorter() :
-            m_lastEmittedTrigger(0-1)
+        CTriggerSorter::CTriggerSorter(
+            std::size_t initialCapacity, CParameterItemPool* pPool
+        ) :
+            m_nMask(0), m_nPending(0), m_lastEmittedTrigger(0-1), m_pPool(pPool)
         {
-            // we can't use flush because destructors don't honor polymorphism
-            // since they run outside in.
-            
-            for (auto& p : m_items) {
-                delete p.second;
+            std::size_t capacity = 1;
+            while (capacity < initialCapacity) {
+                capacity <<= 1;
             }
+            m_window.resize(capacity, Entry{nullptr, nullptr});
+            memset(&m_run, 0, sizeof(m_run));
+            m_nMask = capacity - 1;
         }
         /**
          * destructor
          * 
-         *  Delete any remaining items.
+         *  Delete any remaining items and the blocks they live in.
+         *  We can't use flush because destructors don't honor polymorphism
+         *  since they run outside in.
          */
         CTriggerSorter::~CTriggerSorter() {
-            
+            for (auto& e : m_window) {
+                if (e.s_pItem) {
+                    if (e.s_pBlock) releaseBlock(e.s_pBlock, 1);
+                    else            releaseItem(e.s_pItem);
+                }
+            }
+            for (auto& o : m_overflow) {
+                if (o.second.s_pBlock) releaseBlock(o.second.s_pBlock, 1);
+                else                   releaseItem(o.second.s_pItem);
+            }
+            for (auto& e : m_late) {
+                if (e.s_pBlock) releaseBlock(e.s_pBlock, 1);
+                else            releaseItem(e.s_pItem);
+            }
+            for (auto p : m_freeBlocks) {
+                delete p;
+            }
+        }
+        /**
+         * setFirstTrigger
+         *    Set the trigger number the sorter expects next, e.g. the first
+         *    trigger of a run that starts part way into the data.
+         * @param trigger - the first trigger to emit.
+         * @throw std::logic_error - items are waiting to be emitted.
+         */
+        void
+        CTriggerSorter::setFirstTrigger(std::uint64_t trigger) {
+            if (m_nPending || !m_overflow.empty() || !m_late.empty()) {
+                throw std::logic_error(
+                    "CTriggerSorter::setFirstTrigger - items are waiting to be emitted"
+                );
+            }
+            m_lastEmittedTrigger = trigger - 1;
         }
         /**
          * addItem
-         *    - If the item is the next trigger just emit it.
-         *       otherwise shove it into m_items indexed by trigger#
-         *    - while the map is not empty and the 'first' item's trigger
-         *      is sequential, emit it and remove it from the map.
+         *    Add a single item to be sorted (see add for how that works).
          *  A bit on ownereship
          *     Ownership of the item is ours and passes to emitItem or whatever it
          *     does.  Note that in most of the frameworks we put his class into,
          *     delete should should be called by emitItem to get rid of the
          *     item.
          * @param item   pointer to the item to add/sort/emit.
-         * @note the 'sorting' via the map is amortized O(nLog(m)) where m
-         * is the number of in-flight items and n is the total number of items.
          */
         void
         CTriggerSorter::addItem(pParameterItem item) {
-            auto trigger = item->s_triggerCount;
-            if((m_lastEmittedTrigger +1) == trigger) {
-                emitItem(item);
-                m_lastEmittedTrigger++;
-                // See if this unblocked emitting other items:
-                
-                while (!m_items.empty()) {
-                    auto p = m_items.begin();
-                    if (p->first == (m_lastEmittedTrigger+1)) {  // can emit?
-                        auto pItem = p->second;
-                        m_items.erase(p);
-                        emitItem(pItem);
-                        m_lastEmittedTrigger++;
-                    } else {                              // no so done.
-                        break;
-                    }
-                }
-                
+            add(Entry{item, nullptr});
+            endRun();
+        }
+        /**
+         * addBlock
+         *    Add a block of items.  The block is a contiguous sequence of
+         *    PARAMETER_DATA ring items in the format produced by
+         *    CParameterBatch, or of COMPRESSED_PARAMETERS frames produced
+         *    by CParameterCompressor or PACKED_PARAMETER_DATA items
+         *    produced by CParameterPacker.  Each item is sorted as if it
+         *    had been passed to addItem, however the items are not copied
+         *    out of the block.
+         *
+         *    Ownership of the block passes to us.  It must have been
+         *    gotten from our pool's allocate if we have a pool, otherwise
+         *    with new std::uint8_t[].  It is released when the last of its
+         *    items has been emitted.
+         *
+         * @param pBlock - the block of items.
+         * @param nBytes - number of bytes in the block.
+         * @throw std::logic_error - the block is malformed.  In that case
+         *        ownership of the block stays with the caller.
+         */
+        void
+        CTriggerSorter::addBlock(void* pBlock, std::size_t nBytes) {
+            std::size_t nItems = CParameterBatch::validate(pBlock, nBytes);
+            
+            Block* pInfo;
+            if (m_freeBlocks.empty()) {
+                pInfo = new Block;
             } else {
-                m_items[trigger] = item;
-                // If we did this, we can't emit.
+                pInfo = m_freeBlocks.back();
+                m_freeBlocks.pop_back();
             }
+            pInfo->s_pData  = pBlock;
+            pInfo->s_nItems = nItems + 1;      // Hold it while adding.
             
+            std::uint8_t* p = reinterpret_cast<std::uint8_t*>(pBlock);
+            for (std::size_t i = 0; i < nItems; i++) {
+                pParameterItem pItem = reinterpret_cast<pParameterItem>(p);
+                add(Entry{pItem, pInfo});
+                p += pItem->s_header.s_size;
+            }
+            endRun();
+            releaseBlock(pInfo, 1);            // Drop the hold.
         }
         /**
          * flush
-         *   flush all elements of m_items -> emitItem
-         *   @note that at the end of this m_items will be empty.
+         *   Emit all items being held in trigger order.
+         *   @note that at the end of this no items are held.
          *   @note if the application operates properly, this should not really
          *   do anything as the application is supposed to hand us empty parameter
          *   item placeholders for events that were software filtered out.
          */
         void CTriggerSorter::flush() {
-            for (auto& p: m_items) {
-                emitItem(p.second);
+            // Pull the window items out in trigger order.  Since they all lie in
+            // [next, next+capacity) walking the slots from next's does that.
+            // The overflow items all come after them.
+            
+            std::vector<Entry> items;
+            items.reserve(m_nPending + m_overflow.size() + m_late.size());
+            std::uint64_t next = m_lastEmittedTrigger + 1;
+            for (std::size_t i = 0; m_nPending && (i < m_window.size()); i++) {
+                Entry& slot = m_window[(next + i) & m_nMask];
+                if (slot.s_pItem) {
+                    items.push_back(slot);
+                    slot.s_pItem = nullptr;
+                    m_nPending--;
+                }
+            }
+            for (auto& o : m_overflow) {
+                items.push_back(o.second);
+            }
+            m_overflow.clear();
+            // Merge in the items that were set aside:
+            
+            auto byTrigger = [](const Entry& a, const Entry& b) {
+                return a.s_pItem->s_triggerCount < b.s_pItem->s_triggerCount;
+            };
+            std::stable_sort(m_late.begin(), m_late.end(), byTrigger);
+            std::size_t nWindow = items.size();
+            items.insert(items.end(), m_late.begin(), m_late.end());
+            m_late.clear();
+            std::inplace_merge(
+                items.begin(), items.begin() + nWindow, items.end(), byTrigger
+            );
+            for (auto& e : items) {
+                emit(e);
+            }
+            endRun();
+        }
+        /**
+         * emitItems
+         *    Emit a run of items from a block.  The items are adjacent in
+         *    memory and in trigger order.  They belong to us and must not be
+         *    released.  This default implementation copies each item and
+         *    passes the copy to emitItem.  Derived classes that can deal with
+         *    the items in place should override this.
+         *
+         * @param pFirst - pointer to the first item of the run.
+         * @param nItems - number of items in the run.
+         * @param nBytes - number of bytes in the run.
+         */
+        void
+        CTriggerSorter::emitItems(
+            const ParameterItem* pFirst, std::size_t nItems, std::size_t nBytes
+        ) {
+            const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(pFirst);
+            for (std::size_t i = 0; i < nItems; i++) {
+                const ParameterItem* pItem = reinterpret_cast<const ParameterItem*>(p);
+                std::size_t size = pItem->s_header.s_size;
+                pParameterItem pCopy = m_pPool ?
+                    m_pPool->allocate(size) :
+                    reinterpret_cast<pParameterItem>(new std::uint8_t[size]);
+                memcpy(pCopy, pItem, size);
+                emitItem(pCopy);
+                p += size;
+            }
+        }
+        /**
+         * capacity
+         *   @return std::size_t - number of slots in the reorder window.
+         */
+        std::size_t
+        CTriggerSorter::capacity() const {
+            return m_window.size();
+        }
+        /**
+         * releaseItem
+         *    Get rid of an item that's no longer needed: it goes back to
+         *    the pool if we have one, otherwise it's deleted.
+         *    Derived classes' emitItem can use this.
+         * @param item - the item to release.
+         */
+        void
+        CTriggerSorter::releaseItem(pParameterItem item) {
+            if (m_pPool) {
+                m_pPool->release(item);
+            } else {
+                delete item;
+            }
+        }
+        ///////////////////////////////////////////////////////////////////////
+        // Private utilities.
+        
+        /**
+         * add
+         *    - If the item is the next trigger just emit it, then emit any
+         *      items in the window that are now sequential.
+         *    - Otherwise, if it's ahead of the next trigger put it in its window
+         *      slot, growing the window if it's too far ahead to fit.  Items
+         *      more than MAX_CAPACITY ahead go in the overflow map instead.
+         *    - Items for triggers we've already passed (or duplicates of
+         *      items already waiting) are put aside until flush.
+         * @param entry - the item and the block it lives in.
+         * @note each item is O(1) amortized; growing the window is O(capacity)
+         *       but happens only when the number of in-flight triggers doubles.
+         *       Overflow items cost O(log n) like the map this replaced.
+         */
+        void
+        CTriggerSorter::add(const Entry& entry) {
+            std::uint64_t trigger = entry.s_pItem->s_triggerCount;
+            std::uint64_t next    = m_lastEmittedTrigger + 1;
+            if(trigger == next) {
+                emit(entry);
+                m_lastEmittedTrigger += span(entry.s_pItem);
+                emitReady();            // See if this unblocked other items.
+                
+            } else if (trigger > next) {
+                std::uint64_t distance = trigger - next;
+                if (distance >= m_window.size()) {
+                    if (distance >= MAX_CAPACITY) {
+                        if (!m_overflow.insert(std::make_pair(trigger, entry)).second) {
+                            m_late.push_back(entry);  // Duplicate trigger.
+                        }
+                        return;
+                    }
+                    grow(distance + 1);
+                }
+                Entry& slot = m_window[trigger & m_nMask];
+                if (slot.s_pItem) {
+                    m_late.push_back(entry);      // Duplicate trigger.
+                } else {
+                    slot = entry;
+                    m_nPending++;
+                }
+            } else {
+                m_late.push_back(entry);          // Already passed this trigger.
+            }
+        }
+        /**
+         * emit
+         *    Emit an item.  Items that aren't in a block go straight to
+         *    emitItem.  Items in a block are added to the current run if
+         *    they follow it in the same block, otherwise the current run is
+         *    ended and a new one started.
+         * @param entry - the item to emit.
+         */
+        void
+        CTriggerSorter::emit(const Entry& entry) {
+            if (!entry.s_pBlock) {
+                endRun();
+                emitItem(entry.s_pItem);
+                return;
+            }
+            std::uint8_t* pEnd =
+                reinterpret_cast<std::uint8_t*>(m_run.s_pFirst) + m_run.s_nBytes;
+            if (
+                (m_run.s_pBlock != entry.s_pBlock) ||
+                (reinterpret_cast<std::uint8_t*>(entry.s_pItem) != pEnd)
+            ) {
+                endRun();
+                m_run.s_pBlock = entry.s_pBlock;
+                m_run.s_pFirst = entry.s_pItem;
+            }
+            m_run.s_nItems++;
+            m_run.s_nBytes += entry.s_pItem->s_header.s_size;
+        }
+        /**
+         * endRun
+         *    If there's a run of block items pending, emit it and release
+         *    its items from the block.
+         */
+        void
+        CTriggerSorter::endRun() {
+            if (m_run.s_nItems) {
+                Run run = m_run;
+                memset(&m_run, 0, sizeof(m_run));
+                emitItems(run.s_pFirst, run.s_nItems, run.s_nBytes);
+                
+                releaseBlock(run.s_pBlock, run.s_nItems);
+            }
+        }
+        /**
+         * releaseBlock
+         *    Count items out of a block.  When there are no more items,
+         *    the block storage is released and the block descriptor recycled.
+         * @param pBlock - the block.
+         * @param nItems - number of its items we're done with.
+         */
+        void
+        CTriggerSorter::releaseBlock(Block* pBlock, std::size_t nItems) {
+            pBlock->s_nItems -= nItems;
+            if (pBlock->s_nItems == 0) {
+                if (m_pPool) {
+                    m_pPool->release(reinterpret_cast<pParameterItem>(pBlock->s_pData));
+                } else {
+                    delete []reinterpret_cast<std::uint8_t*>(pBlock->s_pData);
+                }
+                m_freeBlocks.push_back(pBlock);
+            }
+        }
+        /**
+         * emitReady
+         *    Emit items from the window for as long as they are sequential
+         *    with the last one emitted.  Overflow items are moved into the
+         *    window as it reaches them.
+         */
+        void
+        CTriggerSorter::emitReady() {
+            while (true) {
+                if (!m_overflow.empty()) {
+                    admitOverflow();
+                }
+                if (!m_nPending) {
+                    break;
+                }
+                Entry& slot = m_window[(m_lastEmittedTrigger + 1) & m_nMask];
+                if (!slot.s_pItem) {
+                    break;
+                }
+                Entry entry = slot;
+                slot.s_pItem = nullptr;
+                m_nPending--;
+                emit(entry);
+                m_lastEmittedTrigger += span(entry.s_pItem);
+            }
+        }
+        /**
+         * grow
+         *    Enlarge the reorder window so that it has at least needed slots,
+         *    by doubling its size.  The items waiting in the window are
+         *    re-indexed into their slots in the new window and any overflow
+         *    items that now fit are moved in.
+         * @param needed - minimum number of slots.
+         */
+        void
+        CTriggerSorter::grow(std::uint64_t needed) {
+            std::size_t capacity = m_window.size();
+            while (capacity < needed) {
+                capacity <<= 1;
+            }
+            std::vector<Entry> window(capacity, Entry{nullptr, nullptr});
+            std::uint64_t mask = capacity - 1;
+            for (auto& e : m_window) {
+                if (e.s_pItem) {
+                    window[e.s_pItem->s_triggerCount & mask] = e;
+                }
+            }
+            m_window.swap(window);
+            m_nMask = mask;
+            admitOverflow();
+        }
+        /**
+         * admitOverflow
+         *    Move the overflow items that fit in the window into their slots.
+         *    Items whose triggers have already been emitted (e.g. covered
+         *    by a compressed frame) are set aside like any other late item.
+         */
+        void
+        CTriggerSorter::admitOverflow() {
+            std::uint64_t next = m_lastEmittedTrigger + 1;
+            while (!m_overflow.empty()) {
+                auto p = m_overflow.begin();
+                std::uint64_t trigger = p->first;
+                if (trigger >= next && trigger - next >= m_window.size()) {
+                    break;                        // Still beyond the window.
+                }
+                Entry& slot = m_window[trigger & m_nMask];
+                if (trigger < next || slot.s_pItem) {
+                    m_late.push_back(p->second);
+                } else {
+                    slot = p->second;
+                    m_nPending++;
+                }
+                m_overflow.erase(p);
+            }
+        }
+        /**
+         * span
+         *    @param pItem - an item.
+         *    @return std::uint64_t - number of triggers the item accounts
+         *           for: the event count of a compressed frame, otherwise 1.
+         */
+        std::uint64_t
+        CTriggerSorter::span(const ParameterItem* pItem) {
+            if (pItem->s_header.s_type == COMPRESSED_PARAMETERS) {
+                return reinterpret_cast<const CompressedParameters*>(pItem)->s_eventCount;
             }
-            m_items.clear();
+            return 1;
         }
     }
-}
\ No newline at end of file
+}
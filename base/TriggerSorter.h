@@ -22,10 +22,13 @@
 #define TRIGGERSORTER_H
 
 #include <cstdint>
+#include <cstddef>
 #include <AnalysisRingItems.h>
+#include <vector>
 #include <map>
 namespace frib {
     namespace analysis {
+        class CParameterItemPool;
         /**
          * @class CTriggerSorter
          *     CTriggerSorter has methods to add parameter ring items
@@ -41,18 +44,108 @@ namespace frib {
          *
          *    emitItem is pure virtual so that derived classes can decide what to
          *    actually do with items that are sorted.
+         *
+         *    Triggers are dense and the number of items in flight is bounded
+         *    by the number of workers times the size of their work items.
+         *    Items waiting to be emitted are therefore kept in a circular
+         *    reorder window indexed by trigger % capacity.  The capacity is
+         *    a power of two and doubles whenever an item lands beyond the
+         *    end of the window, up to MAX_CAPACITY slots.  Items further
+         *    ahead than that (e.g. the first item of data whose triggers
+         *    don't start at 0) are kept in an overflow map and move into the
+         *    window once it reaches them, so a stray item far ahead can't
+         *    make us allocate a slot for every trigger in between.
+         *    Items whose triggers were already emitted (or
+         *    duplicate a waiting trigger) can't go in the window; they are
+         *    held aside and only come out, in order, at flush time.
+         *
+         *    If the items come from a CParameterItemPool, pass it to the
+         *    constructor; releaseItem then gives items back to the pool
+         *    rather than deleting them.
+         *
+         *    Items can also be added a block at a time with addBlock.  A
+         *    block is a contiguous sequence of PARAMETER_DATA ring items
+         *    (e.g. a received CParameterBatch).  Its items are sorted in place,
+         *    without being copied, and the sorter keeps the block until all
+         *    of its items have been emitted.  Consecutive emitted items that
+         *    are adjacent in the same block are emitted as a single run via
+         *    emitItems.  Since the items in a run are laid out exactly as
+         *    they are in a file, a derived class can ship the run on
+         *    without touching the parameters.
+         *
+         *    A block may also contain COMPRESSED_PARAMETERS frames.  A frame
+         *    is sorted by its first trigger and stands in for all of the
+         *    s_eventCount triggers it covers; it's emitted, still compressed,
+         *    like any other item.  PACKED_PARAMETER_DATA items (see
+         *    CParameterPacker) have a ParameterItem's fixed part so they're
+         *    sorted just like PARAMETER_DATA items.
+         *
+         *    Triggers are expected to start at 0.  If they start elsewhere,
+         *    e.g. the dealer started at a trigger from a CTriggerIndex,
+         *    tell the sorter with setFirstTrigger before adding items.
          */
         class CTriggerSorter {
-        private:            
-            std::map<std::uint64_t, pParameterItem> m_items;
-            std::uint64_t                           m_lastEmittedTrigger;
         public:
-            CTriggerSorter();
+            static const std::size_t DEFAULT_CAPACITY;
+            static const std::size_t MAX_CAPACITY;
+        private:
+            struct Block {                 // A block handed to addBlock.
+                void*        s_pData;
+                std::size_t  s_nItems;     // Not yet emitted.
+            };
+            struct Entry {                 // An item waiting to be emitted.
+                pParameterItem s_pItem;
+                Block*         s_pBlock;   // nullptr if not in a block.
+            };
+            struct Run {                   // Adjacent items being emitted.
+                Block*         s_pBlock;
+                pParameterItem s_pFirst;
+                std::size_t    s_nItems;
+                std::size_t    s_nBytes;
+            };
+            
+            std::vector<Entry>           m_window;   // Indexed by trigger & m_nMask.
+            std::uint64_t                m_nMask;
+            std::size_t                  m_nPending; // Items in m_window.
+            std::map<std::uint64_t, Entry> m_overflow; // Beyond the window.
+            std::vector<Entry>           m_late;     // Can't be put in the window.
+            std::uint64_t                m_lastEmittedTrigger;
+            CParameterItemPool*          m_pPool;
+            Run                          m_run;
+            std::vector<Block*>          m_freeBlocks;
+        public:
+            CTriggerSorter(
+                std::size_t initialCapacity = DEFAULT_CAPACITY,
+                CParameterItemPool* pPool = nullptr
+            );
             virtual ~CTriggerSorter();
+        private:
+            CTriggerSorter(const CTriggerSorter& rhs);
+            CTriggerSorter& operator=(const CTriggerSorter& rhs);
+        public:
             
+            void setFirstTrigger(std::uint64_t trigger);
             void addItem(pParameterItem item);
+            void addBlock(void* pBlock, std::size_t nBytes);
             void flush();
             virtual void emitItem(pParameterItem item) = 0;
+            virtual void emitItems(
+                const ParameterItem* pFirst, std::size_t nItems,
+                std::size_t nBytes
+            );
+            
+            std::size_t capacity() const;
+        protected:
+            void releaseItem(pParameterItem item);
+        private:
+            void add(const Entry& entry);
+            void emit(const Entry& entry);
+            void endRun();
+            void releaseBlock(Block* pBlock, std::size_t nItems);
+            void grow(std::uint64_t needed);
+            void admitOverflow();
+            void emitReady();
+            static std::uint64_t span(const ParameterItem* pItem);
         };
     }
 }
@@ -0,0 +1,362 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  asyncreadertests.cpp
+ *  @brief: Tests the CAsyncDataReader class.
+ */
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/Asserter.h>
+#include "Asserts.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdexcept>
+#include <string>
+#include <string.h>
+#include <thread>
+
+#define private public
+#include "AsyncDataReader.h"
+#undef private
+
+using namespace frib::analysis;
+
+static const char* templateFilename="testXXXXXX.dat";
+
+class asyncreadertest : public CppUnit::TestFixture {
+    CPPUNIT_TEST_SUITE(asyncreadertest);
+    CPPUNIT_TEST(construct_1);
+    CPPUNIT_TEST(construct_2);
+    
+    CPPUNIT_TEST(get_1);
+    CPPUNIT_TEST(get_2);
+    CPPUNIT_TEST(get_3);
+    CPPUNIT_TEST(get_4);
+    CPPUNIT_TEST(get_5);
+    CPPUNIT_TEST(get_6);
+    CPPUNIT_TEST(get_7);
+    CPPUNIT_TEST(get_8);
+    CPPUNIT_TEST(get_9);
+    CPPUNIT_TEST(get_10);
+    
+    CPPUNIT_TEST(baddone);
+    CPPUNIT_TEST(pipe_1);
+    CPPUNIT_TEST(stats);
+    CPPUNIT_TEST_SUITE_END();
+protected:
+    void construct_1();
+    void construct_2();
+    
+    void get_1();
+    void get_2();
+    void get_3();
+    void get_4();
+    void get_5();
+    void get_6();
+    void get_7();
+    void get_8();
+    void get_9();
+    void get_10();
+    
+    void baddone();
+    void pipe_1();
+    void stats();
+private:
+    int m_fd;
+    std::string m_filename;
+public:
+    void setUp() {
+        char ftemplate[100];
+        strncpy(ftemplate, templateFilename, sizeof(ftemplate));
+        m_fd = mkstemps(ftemplate, 4);     // 4 '.dat'
+        if (m_fd < 0) {
+            std::string failmsg = "Failed to make tempfile: ";
+            failmsg += strerror(errno);
+            throw std::runtime_error(failmsg);
+        }
+        m_filename = ftemplate;
+    }
+    void tearDown() {
+        close(m_fd);      // Might have been closed in test so don't check status
+        unlink(m_filename.c_str());
+    }
+private:
+    void writeCountPattern(
+        int fd, std::uint32_t nBytes, std::uint8_t start, std::uint8_t incr
+    );
+    void checkCountPattern(
+        const void* pItem, std::uint32_t nBytes, std::uint8_t start, std::uint8_t incr
+    );
+    int readAll(CDataReader& reader, std::size_t maxBytes);
+};
+
+/**
+ * writeCountPattern
+ *   Write a ring item with a payload that consists of a byte sized counting
+ *   pattern:
+ *
+ * @param fd     - where to write it.
+ * @param nBytes - total number of bytes -inluding self.
+ * @param start  - Initial value of couting pattern.
+ * @param incr   - increment between items.
+ */
+void
+asyncreadertest::writeCountPattern(
+    int fd, std::uint32_t nBytes, std::uint8_t start, std::uint8_t incr
+) {
+    std::string item(reinterpret_cast<const char*>(&nBytes), sizeof(nBytes));
+    for (int i = sizeof(std::uint32_t); i < nBytes; i++) {
+        item.push_back(start);
+        start += incr;
+    }
+    write(fd, item.data(), item.size());
+}
+/**
+ * checkCountPattern
+ *    Check that an item has the size and counting pattern expected.
+ */
+void
+asyncreadertest::checkCountPattern(
+    const void* pItem, std::uint32_t nBytes, std::uint8_t start, std::uint8_t incr
+) {
+    const std::uint32_t* pSize = reinterpret_cast<const std::uint32_t*>(pItem);
+    EQ(nBytes, *pSize);
+    const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(pSize + 1);
+    for (int i = sizeof(std::uint32_t); i < nBytes; i++) {
+        EQ(int(start), int(*p));
+        start += incr;
+        p++;
+    }
+}
+/**
+ * readAll
+ *    Read all items from a reader, checking they have the pattern
+ *    written by get_9 and pipe_1.
+ * @return int - number of items read.
+ */
+int
+asyncreadertest::readAll(CDataReader& d, std::size_t maxBytes)
+{
+    int n = 0;
+    while (1) {
+        auto r = d.getBlock(maxBytes);
+        if (!r.s_pData) break;
+        const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(r.s_pData);
+        for (int i = 0; i < r.s_nItems; i++) {
+            checkCountPattern(p, 10 + (n % 100), n, 1);
+            p += 10 + (n % 100);
+            n++;
+        }
+        d.done();
+    }
+    return n;
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(asyncreadertest);
+
+// Construct on empty file by name - immediate eof:
+
+void asyncreadertest::construct_1()
+{
+    CAsyncDataReader d(m_filename.c_str(), 1024);
+    EQ(size_t(CAsyncDataReader::DEFAULT_BUFFER_COUNT), d.m_buffers.size());
+    auto r = d.getBlock(1024);
+    EQ(size_t(0), r.s_nbytes);
+    EQ(size_t(0), r.s_nItems);
+    ASSERT(!r.s_pData);
+}
+// Need at least two buffers:
+
+void asyncreadertest::construct_2()
+{
+    CPPUNIT_ASSERT_THROW(
+        CAsyncDataReader d(m_filename.c_str(), 1024, 1), std::invalid_argument
+    );
+}
+// Single ring item:
+
+void asyncreadertest::get_1()
+{
+    writeCountPattern(m_fd, 100, 0, 1);
+    CAsyncDataReader d(m_filename.c_str(), 1024);
+    
+    auto r = d.getBlock(1024);
+    EQ(size_t(100), r.s_nbytes);
+    EQ(size_t(1), r.s_nItems);
+    checkCountPattern(r.s_pData, 100, 0, 1);
+    d.done();
+    r = d.getBlock(1024);
+    ASSERT(!r.s_pData);
+}
+// get without done is a logic error:
+
+void asyncreadertest::get_2()
+{
+    writeCountPattern(m_fd, 100, 0, 1);
+    CAsyncDataReader d(m_filename.c_str(), 1024);
+    auto r = d.getBlock(1024);
+    CPPUNIT_ASSERT_THROW(d.getBlock(1024), std::logic_error);
+}
+// Two items in one get:
+
+void asyncreadertest::get_3()
+{
+    writeCountPattern(m_fd, 100, 0, 1);
+    writeCountPattern(m_fd, 50, 0, 2);
+    CAsyncDataReader d(m_filename.c_str(), 1024);
+    
+    auto r = d.getBlock(1024);
+    EQ(size_t(150), r.s_nbytes);
+    EQ(size_t(2), r.s_nItems);
+    checkCountPattern(r.s_pData, 100, 0, 1);
+    checkCountPattern(
+        reinterpret_cast<const std::uint8_t*>(r.s_pData) + 100, 50, 0, 2
+    );
+}
+// Two gets from the same buffer:
+
+void asyncreadertest::get_4()
+{
+    writeCountPattern(m_fd, 100, 0, 1);
+    writeCountPattern(m_fd, 50, 0, 2);
+    CAsyncDataReader d(m_filename.c_str(), 1024);
+    
+    auto r = d.getBlock(110);
+    EQ(size_t(100), r.s_nbytes);
+    EQ(size_t(1), r.s_nItems);
+    d.done();
+    
+    r = d.getBlock(110);
+    EQ(size_t(50), r.s_nbytes);
+    EQ(size_t(1), r.s_nItems);
+    checkCountPattern(r.s_pData, 50, 0, 2);
+}
+// Second item straddles the first buffer - carried over to the next one:
+
+void asyncreadertest::get_5()
+{
+    writeCountPattern(m_fd, 100, 0, 1);
+    writeCountPattern(m_fd, 50, 0, 2);
+    CAsyncDataReader d(m_filename.c_str(), 110);
+    
+    auto r = d.getBlock(1024);
+    EQ(size_t(100), r.s_nbytes);
+    EQ(size_t(1), r.s_nItems);
+    d.done();
+    
+    r = d.getBlock(1024);
+    EQ(size_t(50), r.s_nbytes);
+    EQ(size_t(1), r.s_nItems);
+    checkCountPattern(r.s_pData, 50, 0, 2);
+    d.done();
+    r = d.getBlock(1024);
+    ASSERT(!r.s_pData);
+}
+// Item won't fit in the user request:
+
+void asyncreadertest::get_6()
+{
+    writeCountPattern(m_fd, 100, 0, 1);
+    CAsyncDataReader d(m_filename.c_str(), 1024);
+    CPPUNIT_ASSERT_THROW(d.getBlock(50), std::logic_error);
+}
+// Item won't fit in a buffer - error comes out of getBlock:
+
+void asyncreadertest::get_7()
+{
+    writeCountPattern(m_fd, 100, 0, 1);
+    CAsyncDataReader d(m_filename.c_str(), 50);
+    CPPUNIT_ASSERT_THROW(d.getBlock(50), std::logic_error);
+}
+// File ends in a partial item - good data first, then the error:
+
+void asyncreadertest::get_8()
+{
+    writeCountPattern(m_fd, 100, 0, 1);
+    std::uint32_t size = 100;
+    write(m_fd, &size, sizeof(size));
+    CAsyncDataReader d(m_filename.c_str(), 1024);
+    
+    auto r = d.getBlock(1024);
+    EQ(size_t(100), r.s_nbytes);
+    d.done();
+    CPPUNIT_ASSERT_THROW(d.getBlock(1024), std::logic_error);
+}
+// Lots of items through a few small buffers:
+
+void asyncreadertest::get_9()
+{
+    for (int i = 0; i < 1000; i++) {
+        writeCountPattern(m_fd, 10 + (i % 100), i, 1);
+    }
+    CAsyncDataReader d(m_filename.c_str(), 500, 2);
+    EQ(1000, readAll(d, 300));
+}
+// Construct from fd reads from the current position:
+
+void asyncreadertest::get_10()
+{
+    writeCountPattern(m_fd, 100, 0, 1);
+    writeCountPattern(m_fd, 50, 0, 2);
+    lseek(m_fd, 100, SEEK_SET);
+    
+    CAsyncDataReader d(m_fd, 1024);
+    auto r = d.getBlock(1024);
+    EQ(size_t(50), r.s_nbytes);
+    checkCountPattern(r.s_pData, 50, 0, 2);
+    m_fd = -1;                            // d closes it.
+}
+// done when released is a logic error:
+
+void asyncreadertest::baddone()
+{
+    CAsyncDataReader d(m_filename.c_str(), 100);
+    CPPUNIT_ASSERT_THROW(d.done(), std::logic_error);
+}
+// Read from a pipe being written by another thread:
+
+void asyncreadertest::pipe_1()
+{
+    int fds[2];
+    ASSERT(pipe(fds) == 0);
+    std::thread writer([this, fds]() {
+        for (int i = 0; i < 1000; i++) {
+            writeCountPattern(fds[1], 10 + (i % 100), i, 1);
+        }
+        close(fds[1]);
+    });
+    {
+        CAsyncDataReader d(fds[0], 512);
+        EQ(1000, readAll(d, 1000));
+    }
+    writer.join();
+}
+// Statistics accumulate:
+
+void asyncreadertest::stats()
+{
+    for (int i = 0; i < 1000; i++) {
+        writeCountPattern(m_fd, 10 + (i % 100), i, 1);
+    }
+    CAsyncDataReader d(m_filename.c_str(), 1000);
+    readAll(d, 1000);
+    ASSERT(d.getWaitTime() >= 0.0);
+    ASSERT(d.getReadTime() > 0.0);
+}
@@ -0,0 +1,342 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  batchBench.cpp
+ *  @brief: Throughput benchmark for worker -> farmer event traffic.
+ *
+ *  Runs the real CMPIParameterFarmer against synthetic worker traffic and
+ *  reports events/second for:
+ *     - legacy   - a header message and a parameter values message per event
+ *                  which is how the workers used to send events.
+ *     - batched  - events packed in a CParameterBatch that is sent when full
+ *                  and at the end of each work item.
+ *
+ *  Each is run with the traffic of 1, 8, 64 and 512 workers.  Work items
+ *  (blocks of consecutive triggers) are dealt round robin to the emulated
+ *  workers which interleave their events as real workers running in
+ *  parallel would.  This also exercises the farmer's trigger sorter
+ *  with realistic amounts of disorder.
+ *
+ *  Usage:
+ *  \verbatim
+ *     mpirun -np 4 batchBench ?events? ?params-per-event? ?events-per-block?
+ *  \endverbatim
+ *  events defaults to 500000, params-per-event to 16 and events-per-block to
+ *  64.  More than one worker rank can be used; the emulated workers are
+ *  divided amongst them.  Results are printed by the farmer (rank 1).
+ */
+#include "AbstractApplication.h"
+#include "AnalysisRingItems.h"
+#include "MPIParameterFarmer.h"
+#include "ParameterBatch.h"
+#include "ParameterReader.h"
+#include <mpi.h>
+#include <stdlib.h>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <memory>
+#include <string>
+#include <stdexcept>
+
+using namespace frib::analysis;
+
+static const unsigned emulatedWorkers[] = {1, 8, 64, 512};
+static const size_t   NUM_EMULATED(
+    sizeof(emulatedWorkers)/sizeof(emulatedWorkers[0])
+);
+static const char* modeNames[] = {"legacy", "batched"};
+
+/**
+ * @class BatchBench
+ *    Application whose roles are:
+ *    - dealer    - idle; the workers make their own data.
+ *    - farmer    - CMPIParameterFarmer, timed.
+ *    - outputter - drains the sorted events from the farmer.
+ *    - workers   - generate the synthetic traffic.
+ *    Every role runs once per mode/worker count with a barrier before each run.
+ */
+class BatchBench : public AbstractApplication {
+private:
+    std::uint64_t m_nEvents;
+    unsigned      m_nParams;
+    unsigned      m_nBlock;
+    std::vector<FRIB_MPI_Parameter_Value> m_values;   // legacy send buffer.
+public:
+    BatchBench(int argc, char** argv);
+    
+    virtual void dealer(int argc, char** argv, AbstractApplication* pApp);
+    virtual void farmer(int argc, char** argv, AbstractApplication* pApp);
+    virtual void outputter(int argc, char** argv, AbstractApplication* pApp);
+    virtual void worker(int argc, char** argv, AbstractApplication* pApp);
+private:
+    void generate(unsigned nVirtual, bool batched);
+    void sendLegacy(
+        const std::vector<std::pair<unsigned, double>>& event,
+        std::uint64_t trigger
+    );
+    void sendBatch(CParameterBatch& batch);
+    void sendEnd();
+};
+
+/**
+ * constructor
+ *   Pull the optional parameters off the command line.
+ */
+BatchBench::BatchBench(int argc, char** argv) :
+    AbstractApplication(argc, argv),
+    m_nEvents(500000), m_nParams(16), m_nBlock(64)
+{
+    if (argc > 1) m_nEvents = strtoull(argv[1], nullptr, 0);
+    if (argc > 2) m_nParams = strtoul(argv[2], nullptr, 0);
+    if (argc > 3) m_nBlock  = strtoul(argv[3], nullptr, 0);
+    if (m_nBlock == 0) {
+        throw std::invalid_argument("events-per-block must be non-zero");
+    }
+}
+/**
+ * dealer
+ *    Just keeps pace with the barriers.
+ */
+void
+BatchBench::dealer(int argc, char** argv, AbstractApplication* pApp)
+{
+    for (int mode = 0; mode < 2; mode++) {
+        for (size_t i = 0; i < NUM_EMULATED; i++) {
+            MPI_Barrier(MPI_COMM_WORLD);
+        }
+    }
+}
+/**
+ * farmer
+ *    Time the farmer for each run and report the results.
+ */
+void
+BatchBench::farmer(int argc, char** argv, AbstractApplication* pApp)
+{
+    std::cout << "Events: " << m_nEvents << " parameters/event: " << m_nParams
+        << " events/block: " << m_nBlock << " worker ranks: " << numWorkers()
+        << std::endl;
+    std::cout << std::setw(8) << "mode" << std::setw(10) << "workers"
+        << std::setw(12) << "seconds" << std::setw(14) << "events/s" << std::endl;
+    for (int mode = 0; mode < 2; mode++) {
+        for (auto n : emulatedWorkers) {
+            MPI_Barrier(MPI_COMM_WORLD);
+            double start = MPI_Wtime();
+            CMPIParameterFarmer f(argc, argv, *pApp);
+            f();
+            double seconds = MPI_Wtime() - start;
+            
+            std::cout << std::setw(8) << modeNames[mode] << std::setw(10) << n
+                << std::setw(12) << std::fixed << std::setprecision(3) << seconds
+                << std::setw(14) << std::setprecision(0) << m_nEvents/seconds
+                << std::endl;
+        }
+    }
+}
+/**
+ * outputter
+ *    Drain the blocks of sorted events sent by the farmer's sorter
+ *    until it sends us an end.
+ */
+void
+BatchBench::outputter(int argc, char** argv, AbstractApplication* pApp)
+{
+    std::vector<std::uint8_t> block;
+    for (int mode = 0; mode < 2; mode++) {
+        for (size_t i = 0; i < NUM_EMULATED; i++) {
+            MPI_Barrier(MPI_COMM_WORLD);
+            while (1) {
+                MPI_Status status;
+                int stat = MPI_Probe(1, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+                throwMPIError(stat, "Outputter could not probe: ");
+                if (status.MPI_TAG != MPI_PARAMETER_BATCH_TAG) {
+                    FRIB_MPI_Parameter_MessageHeader header;
+                    stat = MPI_Recv(
+                        &header, 1, parameterHeaderDataType(), 1, MPI_END_TAG,
+                        MPI_COMM_WORLD, &status
+                    );
+                    throwMPIError(stat, "Outputter could not get the end: ");
+                    break;
+                }
+                int nBytes;
+                stat = MPI_Get_count(&status, MPI_UINT8_T, &nBytes);
+                throwMPIError(stat, "Outputter could not size events: ");
+                if (nBytes < 0) {
+                    throw std::runtime_error("Outputter got a batch of unknown size");
+                }
+                if (static_cast<size_t>(nBytes) > block.size()) {
+                    block.resize(nBytes);
+                }
+                stat = MPI_Recv(
+                    block.data(), nBytes, MPI_UINT8_T, 1,
+                    MPI_PARAMETER_BATCH_TAG, MPI_COMM_WORLD, &status
+                );
+                throwMPIError(stat, "Outputter could not get events: ");
+            }
+        }
+    }
+}
+/**
+ * worker
+ *    Generate the traffic for each run.
+ */
+void
+BatchBench::worker(int argc, char** argv, AbstractApplication* pApp)
+{
+    for (int mode = 0; mode < 2; mode++) {
+        for (auto n : emulatedWorkers) {
+            MPI_Barrier(MPI_COMM_WORLD);
+            generate(n, mode == 1);
+        }
+    }
+}
+/**
+ * generate
+ *    Generate this rank's share of the traffic of nVirtual workers.
+ *    Block b of m_nBlock triggers is processed by virtual worker b % nVirtual
+ *    and virtual worker v is emulated by worker rank v % numWorkers().
+ *    In each round every virtual worker we emulate processes one block; their
+ *    events are interleaved and, when batching, each sends its batch at the
+ *    end of its block.
+ *
+ * @param nVirtual - number of workers whose traffic is emulated.
+ * @param batched  - true to send batches, false to send legacy messages.
+ */
+void
+BatchBench::generate(unsigned nVirtual, bool batched)
+{
+    int rank;
+    int stat = MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    throwMPIError(stat, "Unable to get worker rank: ");
+    unsigned me = rank - 3;
+    
+    std::vector<unsigned> mine;
+    for (unsigned v = me; v < nVirtual; v += numWorkers()) {
+        mine.push_back(v);
+    }
+    std::vector<std::unique_ptr<CParameterBatch>> batches;
+    if (batched) {
+        for (size_t i = 0; i < mine.size(); i++) {
+            batches.emplace_back(new CParameterBatch);
+        }
+    }
+    std::vector<std::pair<unsigned, double>> event;
+    for (unsigned i = 0; i < m_nParams; i++) {
+        event.push_back({i, double(i)});
+    }
+    
+    std::uint64_t nBlocks = (m_nEvents + m_nBlock - 1)/m_nBlock;
+    for (std::uint64_t round = 0; round*nVirtual < nBlocks; round++) {
+        for (unsigned e = 0; e < m_nBlock; e++) {
+            for (size_t i = 0; i < mine.size(); i++) {
+                std::uint64_t trigger = (round*nVirtual + mine[i])*m_nBlock + e;
+                if (trigger >= m_nEvents) continue;
+                event[0].second = trigger;
+                if (batched) {
+                    batches[i]->addEvent(event, trigger);
+                    if (batches[i]->full()) sendBatch(*batches[i]);
+                } else {
+                    sendLegacy(event, trigger);
+                }
+            }
+        }
+        for (auto& b : batches) {       // End of the work items.
+            sendBatch(*b);
+        }
+    }
+    sendEnd();
+}
+/**
+ * sendLegacy
+ *    Send an event the way the workers used to: header then values.
+ */
+void
+BatchBench::sendLegacy(
+    const std::vector<std::pair<unsigned, double>>& event, std::uint64_t trigger
+)
+{
+    FRIB_MPI_Parameter_MessageHeader header;
+    header.s_triggerNumber = trigger;
+    header.s_numParameters = event.size();
+    header.s_end = false;
+    
+    m_values.clear();
+    for (auto& p : event) {
+        FRIB_MPI_Parameter_Value v;
+        v.s_number = p.first;
+        v.s_value  = p.second;
+        m_values.push_back(v);
+    }
+    int stat = MPI_Send(
+        &header, 1, parameterHeaderDataType(), 1, MPI_HEADER_TAG, MPI_COMM_WORLD
+    );
+    throwMPIError(stat, "Unable to send parameter header: ");
+    stat = MPI_Send(
+        m_values.data(), m_values.size(), parameterValueDataType(),
+        1, MPI_DATA_TAG, MPI_COMM_WORLD
+    );
+    throwMPIError(stat, "Unable to send parameters: ");
+}
+/**
+ * sendBatch
+ *    Send a batch (if not empty) and clear it.
+ */
+void
+BatchBench::sendBatch(CParameterBatch& batch)
+{
+    if (!batch.empty()) {
+        int stat = MPI_Send(
+            batch.data(), batch.size(), MPI_UINT8_T,
+            1, MPI_PARAMETER_BATCH_TAG, MPI_COMM_WORLD
+        );
+        throwMPIError(stat, "Unable to send parameter batch: ");
+        batch.clear();
+    }
+}
+/**
+ * sendEnd
+ *    Tell the farmer this worker is done with the run.
+ */
+void
+BatchBench::sendEnd()
+{
+    FRIB_MPI_Parameter_MessageHeader header;
+    header.s_triggerNumber = 0;
+    header.s_numParameters = 0;
+    header.s_end = true;
+    int stat = MPI_Send(
+        &header, 1, parameterHeaderDataType(), 1, MPI_END_TAG, MPI_COMM_WORLD
+    );
+    throwMPIError(stat, "Unable to send end: ");
+}
+
+// There's no parameter definition file.
+
+class CDummyReader : public CParameterReader {
+public:
+    CDummyReader() : CParameterReader("/dev/null") {}
+    virtual void read() {}
+};
+
+int main(int argc, char** argv)
+{
+    BatchBench app(argc, argv);
+    CDummyReader reader;
+    app(reader);
+    return EXIT_SUCCESS;
+}
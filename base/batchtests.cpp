@@ -0,0 +1,270 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  batchtests.cpp
+ *  @brief: Tests of CParameterBatch
+ */
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/Asserter.h>
+#include "Asserts.h"
+#define private public
+#include "ParameterBatch.h"
+#undef private
+#include <vector>
+#include <utility>
+#include <stdexcept>
+#include <cstdint>
+#include <string.h>
+
+using namespace frib::analysis;
+
+class batchtest : public CppUnit::TestFixture {
+    CPPUNIT_TEST_SUITE(batchtest);
+    CPPUNIT_TEST(construct_1);
+    CPPUNIT_TEST(construct_2);
+    
+    CPPUNIT_TEST(add_1);
+    CPPUNIT_TEST(add_2);
+    CPPUNIT_TEST(add_3);
+    CPPUNIT_TEST(allocate_1);
+    CPPUNIT_TEST(full_1);
+    CPPUNIT_TEST(full_2);
+    CPPUNIT_TEST(clear_1);
+    
+    CPPUNIT_TEST(unpack_1);
+    CPPUNIT_TEST(unpack_2);
+    CPPUNIT_TEST(unpack_3);
+    CPPUNIT_TEST_SUITE_END();
+    
+private:
+    CParameterBatch* m_pBatch;
+public:
+    void setUp() {
+        m_pBatch = new CParameterBatch;
+    }
+    void tearDown() {
+        delete m_pBatch;
+    }
+protected:
+    void construct_1();
+    void construct_2();
+    
+    void add_1();
+    void add_2();
+    void add_3();
+    void allocate_1();
+    void full_1();
+    void full_2();
+    void clear_1();
+    
+    void unpack_1();
+    void unpack_2();
+    void unpack_3();
+private:
+    std::vector<std::pair<unsigned, double>> makeEvent(unsigned n, unsigned first);
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(batchtest);
+
+/**
+ * makeEvent
+ *   Make an event with n parameters numbered from first.  Each value is
+ *   twice its parameter number.
+ */
+std::vector<std::pair<unsigned, double>>
+batchtest::makeEvent(unsigned n, unsigned first)
+{
+    std::vector<std::pair<unsigned, double>> result;
+    for (unsigned i = 0; i < n; i++) {
+        result.push_back({first + i, 2.0*(first + i)});
+    }
+    return result;
+}
+
+// Default construction is empty with default limits.
+void batchtest::construct_1()
+{
+    EQ(CParameterBatch::DEFAULT_MAX_EVENTS, m_pBatch->m_nMaxEvents);
+    EQ(CParameterBatch::DEFAULT_MAX_BYTES, m_pBatch->m_nMaxBytes);
+    ASSERT(m_pBatch->empty());
+    ASSERT(!m_pBatch->full());
+    EQ(size_t(0), m_pBatch->size());
+    EQ(size_t(0), m_pBatch->events());
+}
+// Zero limits are not allowed.
+void batchtest::construct_2()
+{
+    EXCEPTION(CParameterBatch b(0, 100), std::invalid_argument);
+    EXCEPTION(CParameterBatch b(100, 0), std::invalid_argument);
+}
+// One event is a properly formatted PARAMETER_DATA item.
+void batchtest::add_1()
+{
+    m_pBatch->addEvent(makeEvent(10, 5), 1234);
+    
+    size_t expectedSize = sizeof(ParameterItem) + 10*sizeof(ParameterValue);
+    EQ(size_t(1), m_pBatch->events());
+    EQ(expectedSize, m_pBatch->size());
+    ASSERT(!m_pBatch->empty());
+    
+    const ParameterItem* pItem =
+        reinterpret_cast<const ParameterItem*>(m_pBatch->data());
+    EQ(std::uint32_t(expectedSize), pItem->s_header.s_size);
+    EQ(std::uint32_t(PARAMETER_DATA), pItem->s_header.s_type);
+    EQ(std::uint32_t(sizeof(std::uint32_t)), pItem->s_header.s_unused);
+    EQ(std::uint64_t(1234), pItem->s_triggerCount);
+    EQ(std::uint32_t(10), pItem->s_parameterCount);
+    for (int i = 0; i < 10; i++) {
+        EQ(std::uint32_t(5+i), pItem->s_parameters[i].s_number);
+        EQ(2.0*(5+i), pItem->s_parameters[i].s_value);
+    }
+}
+// Events are laid end to end.
+void batchtest::add_2()
+{
+    m_pBatch->addEvent(makeEvent(3, 0), 1);
+    m_pBatch->addEvent(makeEvent(7, 100), 2);
+    
+    size_t first = sizeof(ParameterItem) + 3*sizeof(ParameterValue);
+    size_t second = sizeof(ParameterItem) + 7*sizeof(ParameterValue);
+    EQ(size_t(2), m_pBatch->events());
+    EQ(first + second, m_pBatch->size());
+    
+    const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(m_pBatch->data());
+    const ParameterItem* pItem = reinterpret_cast<const ParameterItem*>(p + first);
+    EQ(std::uint32_t(second), pItem->s_header.s_size);
+    EQ(std::uint64_t(2), pItem->s_triggerCount);
+    EQ(std::uint32_t(7), pItem->s_parameterCount);
+    EQ(std::uint32_t(106), pItem->s_parameters[6].s_number);
+}
+// An empty event is legal.
+void batchtest::add_3()
+{
+    m_pBatch->addEvent(makeEvent(0, 0), 12);
+    EQ(size_t(1), m_pBatch->events());
+    EQ(sizeof(ParameterItem), m_pBatch->size());
+}
+// Allocated events are filled in in place and look just like added ones.
+void batchtest::allocate_1()
+{
+    CParameterBatch added;
+    added.addEvent(makeEvent(3, 10), 7);
+    
+    ParameterValue* p = m_pBatch->allocateEvent(7, 3);
+    for (unsigned i = 0; i < 3; i++) {
+        p[i].s_number = 10 + i;
+        p[i].s_value  = 2.0*(10 + i);
+    }
+    EQ(size_t(1), m_pBatch->events());
+    EQ(added.size(), m_pBatch->size());
+    ASSERT(memcmp(added.data(), m_pBatch->data(), added.size()) == 0);
+}
+// Full by event count.
+void batchtest::full_1()
+{
+    CParameterBatch b(3, 1024*1024);
+    b.addEvent(makeEvent(1, 0), 0);
+    b.addEvent(makeEvent(1, 0), 1);
+    ASSERT(!b.full());
+    b.addEvent(makeEvent(1, 0), 2);
+    ASSERT(b.full());
+}
+// Full by bytes - the limit is soft so the event that crosses it is kept.
+void batchtest::full_2()
+{
+    size_t itemSize = sizeof(ParameterItem) + 10*sizeof(ParameterValue);
+    CParameterBatch b(1000, itemSize + 1);
+    b.addEvent(makeEvent(10, 0), 0);
+    ASSERT(!b.full());
+    b.addEvent(makeEvent(10, 0), 1);
+    ASSERT(b.full());
+    EQ(2*itemSize, b.size());
+}
+// clear empties the batch.
+void batchtest::clear_1()
+{
+    CParameterBatch b(2, 1024*1024);
+    b.addEvent(makeEvent(1, 0), 0);
+    b.addEvent(makeEvent(1, 0), 1);
+    ASSERT(b.full());
+    b.clear();
+    ASSERT(b.empty());
+    ASSERT(!b.full());
+    EQ(size_t(0), b.size());
+}
+// A batch round trips through unpack.
+void batchtest::unpack_1()
+{
+    for (int i = 0; i < 10; i++) {
+        m_pBatch->addEvent(makeEvent(i, i), 100 + i);
+    }
+    std::vector<pParameterItem> items;
+    CParameterBatch::unpack(m_pBatch->data(), m_pBatch->size(), items);
+    
+    EQ(size_t(10), items.size());
+    for (int i = 0; i < 10; i++) {
+        pParameterItem pItem = items[i];
+        EQ(std::uint64_t(100+i), pItem->s_triggerCount);
+        EQ(std::uint32_t(i), pItem->s_parameterCount);
+        EQ(
+            std::uint32_t(sizeof(ParameterItem) + i*sizeof(ParameterValue)),
+            pItem->s_header.s_size
+        );
+        for (int p = 0; p < i; p++) {
+            EQ(std::uint32_t(i+p), pItem->s_parameters[p].s_number);
+            EQ(2.0*(i+p), pItem->s_parameters[p].s_value);
+        }
+        delete [](reinterpret_cast<std::uint8_t*>(pItem));
+    }
+}
+// unpack appends and an empty batch unpacks to nothing.
+void batchtest::unpack_2()
+{
+    std::vector<pParameterItem> items;
+    CParameterBatch::unpack(m_pBatch->data(), m_pBatch->size(), items);
+    EQ(size_t(0), items.size());
+    
+    m_pBatch->addEvent(makeEvent(2, 0), 1);
+    CParameterBatch::unpack(m_pBatch->data(), m_pBatch->size(), items);
+    CParameterBatch::unpack(m_pBatch->data(), m_pBatch->size(), items);
+    EQ(size_t(2), items.size());
+    for (auto p : items) {
+        delete [](reinterpret_cast<std::uint8_t*>(p));
+    }
+}
+// Truncated batches and items that are not PARAMETER_DATA are errors.
+void batchtest::unpack_3()
+{
+    m_pBatch->addEvent(makeEvent(4, 0), 1);
+    std::vector<std::uint8_t> bad(
+        reinterpret_cast<const std::uint8_t*>(m_pBatch->data()),
+        reinterpret_cast<const std::uint8_t*>(m_pBatch->data()) + m_pBatch->size()
+    );
+    std::vector<pParameterItem> items;
+    EXCEPTION(
+        CParameterBatch::unpack(bad.data(), bad.size() - 1, items),
+        std::logic_error
+    );
+    EQ(size_t(0), items.size());
+    
+    reinterpret_cast<pRingItemHeader>(bad.data())->s_type = TEST_DATA;
+    EXCEPTION(
+        CParameterBatch::unpack(bad.data(), bad.size(), items),
+        std::logic_error
+    );
+    EQ(size_t(0), items.size());
+}
@@ -0,0 +1,111 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+
+/** @file:  collectBench.cpp
+ *  @brief: Per event cost of marshalling tree parameters into a batch.
+ *
+ *  Each worker moves every event from the tree parameters into the batch
+ *  for the farmer.  This times that for events with 10, 100 and 1000
+ *  parameters set, done three ways:
+ *     - copy    - collectEvent() returning a new vector that's then
+ *                 added to the batch, which is how the workers used to work.
+ *     - reuse   - collectEvent into a reused vector, then addEvent.
+ *     - direct  - collectEvent straight into CParameterBatch::allocateEvent,
+ *                 which is what the workers do now.
+ *  The parameters are set once; only the marshalling is timed.  The batch
+ *  is cleared when full as it would be when sent.
+ *
+ *  Usage:
+ *  \verbatim
+ *     collectBench ?events?
+ *  \endverbatim
+ *  events defaults to 200000.
+ */
+#include "TreeParameter.h"
+#include "TreeParameterArray.h"
+#include "ParameterBatch.h"
+#include "AnalysisRingItems.h"
+#include <stdlib.h>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <utility>
+
+using namespace frib::analysis;
+
+/**
+ * timeCollect
+ *    Time nEvents marshallings of the current event.
+ * @param nEvents - number of events.
+ * @param mode    - 0 copy, 1 reuse, 2 direct.
+ * @return double - ns per event.
+ */
+static double
+timeCollect(std::uint64_t nEvents, int mode)
+{
+    CParameterBatch batch;
+    std::vector<std::pair<unsigned, double>> event;
+    
+    auto start = std::chrono::steady_clock::now();
+    for (std::uint64_t i = 0; i < nEvents; i++) {
+        switch (mode) {
+        case 0:
+            batch.addEvent(CTreeParameter::collectEvent(), i);
+            break;
+        case 1:
+            CTreeParameter::collectEvent(event);
+            batch.addEvent(event, i);
+            break;
+        default:
+            CTreeParameter::collectEvent(
+                batch.allocateEvent(i, CTreeParameter::eventSize())
+            );
+            break;
+        }
+        if (batch.full()) batch.clear();
+    }
+    std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+    return d.count()*1.0e9/nEvents;
+}
+
+int main(int argc, char** argv)
+{
+    std::uint64_t nEvents = 200000;
+    if (argc > 1) nEvents = strtoull(argv[1], nullptr, 0);
+    if (nEvents == 0) nEvents = 1;
+    
+    CTreeParameterArray params("bench", 1000, 0);
+    
+    std::cout << "Events: " << nEvents << std::endl;
+    std::cout << std::setw(8) << "params" << std::setw(16) << "copy ns/event"
+        << std::setw(16) << "reuse ns/event" << std::setw(17) << "direct ns/event"
+        << std::endl;
+    unsigned nSet[] = {10, 100, 1000};
+    for (auto n : nSet) {
+        CTreeParameter::nextEvent();
+        for (unsigned i = 0; i < n; i++) {
+            params[i] = i;
+        }
+        std::cout << std::setw(8) << n << std::fixed << std::setprecision(1)
+            << std::setw(16) << timeCollect(nEvents, 0)
+            << std::setw(16) << timeCollect(nEvents, 1)
+            << std::setw(17) << timeCollect(nEvents, 2) << std::endl;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,207 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+
+/** @file:  columnarBench.cpp
+ *  @brief: Compare reading a few parameters from event and columnar files.
+ *
+ *  Writes the same synthetic run twice - once with CDataWriter (PARAMETER_DATA
+ *  items) and once with CColumnarDataWriter - then times reading a few
+ *  parameters back from each:
+ *     - events   - CDataReader over the whole file, every pair decoded.
+ *     - columnar - CColumnarReader reading just the wanted columns.
+ *  Event i has a value for parameter p when (p + i) % 4 == 0, i.e. a quarter
+ *  of the parameters are set in each event.
+ *
+ *  Usage:
+ *  \verbatim
+ *     columnarBench basename ?events? ?parameters? ?wanted? ?chunksize?
+ *  \endverbatim
+ *  events defaults to 100000, parameters to 1000, wanted to 2 and chunksize
+ *  to CColumnarDataWriter::DEFAULT_CHUNK_SIZE.  The files are basename.evt
+ *  and basename.col and are left behind for the caller to remove.  The
+ *  page cache for each file is dropped (posix_fadvise) before it's read.
+ */
+#include "DataWriter.h"
+#include "ColumnarDataWriter.h"
+#include "DataReader.h"
+#include "ColumnarReader.h"
+#include "AnalysisRingItems.h"
+#include "TreeParameterArray.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <stdlib.h>
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+using namespace frib::analysis;
+
+/**
+ * writeRun
+ *    Write the synthetic run with a writer.
+ */
+static void
+writeRun(CDataWriter& w, CTreeParameterArray& params, std::uint64_t nEvents)
+{
+    std::vector<std::pair<unsigned, double>> event;
+    unsigned nParams = params.size();
+    for (std::uint64_t i = 0; i < nEvents; i++) {
+        event.clear();
+        for (unsigned p = (4 - i % 4) % 4; p < nParams; p += 4) {
+            event.emplace_back(params[p].getId(), double(i + p));
+        }
+        w.writeEvent(event, i);
+    }
+    w.finish();
+}
+/**
+ * dropCache
+ *    Get a file out of the page cache so reads come from the device.
+ */
+static void
+dropCache(const std::string& name)
+{
+    int fd = open(name.c_str(), O_RDONLY);
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+}
+/**
+ * fileSize
+ */
+static std::uint64_t
+fileSize(const std::string& name)
+{
+    struct stat info;
+    stat(name.c_str(), &info);
+    return info.st_size;
+}
+/**
+ * report
+ *   Output the results of one run.
+ */
+static void
+report(
+    const char* what, double bytesRead, double fileBytes, double seconds,
+    std::uint64_t nValues, double sum
+)
+{
+    std::cout << what << ": read " << bytesRead/(1024.0*1024.0) << " MB of "
+        << fileBytes/(1024.0*1024.0) << " MB in " << seconds << " s : "
+        << nValues << " values, sum " << sum << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        std::cerr << "Usage: columnarBench basename ?events? ?parameters? ?wanted? ?chunksize?\n";
+        exit(EXIT_FAILURE);
+    }
+    std::string eventFile = argv[1];
+    eventFile += ".evt";
+    std::string columnFile = argv[1];
+    columnFile += ".col";
+    std::uint64_t nEvents = (argc > 2) ? atol(argv[2]) : 100000;
+    unsigned nParams = (argc > 3) ? atoi(argv[3]) : 1000;
+    unsigned nWanted = (argc > 4) ? atoi(argv[4]) : 2;
+    std::uint32_t chunkSize =
+        (argc > 5) ? atoi(argv[5]) : CColumnarDataWriter::DEFAULT_CHUNK_SIZE;
+    nWanted = std::min(nWanted, nParams);
+    
+    CTreeParameterArray params("bench", "arb", nParams, 0);
+    std::vector<unsigned> wanted;
+    for (unsigned i = 0; i < nWanted; i++) {
+        wanted.push_back(params[i * (nParams / nWanted)].getId());
+    }
+    {
+        auto start = std::chrono::steady_clock::now();
+        CDataWriter w(eventFile.c_str());
+        writeRun(w, params, nEvents);
+        std::chrono::duration<double> t = std::chrono::steady_clock::now() - start;
+        std::cout << "wrote events in " << t.count() << " s\n";
+    }
+    {
+        auto start = std::chrono::steady_clock::now();
+        {
+            CColumnarDataWriter w(columnFile.c_str(), chunkSize);
+            writeRun(w, params, nEvents);
+        }
+        std::chrono::duration<double> t = std::chrono::steady_clock::now() - start;
+        std::cout << "wrote columns in " << t.count() << " s\n";
+    }
+    // Events: decode everything, keep the wanted parameters.
+    
+    {
+        std::vector<bool> want;
+        for (auto n : wanted) {
+            if (n >= want.size()) want.resize(n + 1, false);
+            want[n] = true;
+        }
+        dropCache(eventFile);
+        std::uint64_t nValues(0);
+        double sum(0);
+        auto start = std::chrono::steady_clock::now();
+        CDataReader reader(eventFile.c_str(), 1024*1024);
+        while (true) {
+            auto r = reader.getBlock(1024*1024);
+            if (r.s_nItems == 0) break;
+            const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(r.s_pData);
+            for (std::size_t i = 0; i < r.s_nItems; i++) {
+                const ParameterItem* pItem = reinterpret_cast<const ParameterItem*>(p);
+                if (pItem->s_header.s_type == PARAMETER_DATA) {
+                    for (std::uint32_t v = 0; v < pItem->s_parameterCount; v++) {
+                        unsigned n = pItem->s_parameters[v].s_number;
+                        if (n < want.size() && want[n]) {
+                            sum += pItem->s_parameters[v].s_value;
+                            nValues++;
+                        }
+                    }
+                }
+                p += pItem->s_header.s_size;
+            }
+            reader.done();
+        }
+        std::chrono::duration<double> t = std::chrono::steady_clock::now() - start;
+        report("events", fileSize(eventFile), fileSize(eventFile), t.count(), nValues, sum);
+    }
+    // Columnar: just the wanted columns.
+    
+    {
+        dropCache(columnFile);
+        std::uint64_t nValues(0);
+        double sum(0);
+        auto start = std::chrono::steady_clock::now();
+        CColumnarReader reader(columnFile.c_str());
+        CColumnarReader::Chunk chunk;
+        for (std::size_t c = 0; c < reader.chunks(); c++) {
+            reader.readChunk(c, wanted, chunk);
+            for (auto& column : chunk.s_columns) {
+                for (auto v : column.s_values) {
+                    sum += v;
+                }
+                nValues += column.s_values.size();
+            }
+        }
+        std::chrono::duration<double> t = std::chrono::steady_clock::now() - start;
+        report("columnar", reader.bytesRead(), fileSize(columnFile), t.count(), nValues, sum);
+    }
+    return EXIT_SUCCESS;
+}
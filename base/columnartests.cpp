@@ -0,0 +1,486 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+
+/** @file:  columnartests.cpp
+ *  @brief: Test CColumnarDataWriter and CColumnarReader.
+ */
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/Asserter.h>
+#include "Asserts.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdexcept>
+#include <string>
+#include <string.h>
+#include <vector>
+
+#define private public
+#include "TreeParameter.h"
+#include "TreeVariable.h"
+#undef private
+
+#include "ColumnarDataWriter.h"
+#include "ColumnarReader.h"
+#include "DataWriter.h"
+#include "DataReader.h"
+#include "AnalysisRingItems.h"
+#include "ParameterBatch.h"
+#include "ParameterCompressor.h"
+#include "ParameterPacker.h"
+
+
+using namespace frib::analysis;
+static const char* templateFilename="colXXXXXX.dat";
+
+
+class columnartest : public CppUnit::TestFixture {
+    CPPUNIT_TEST_SUITE(columnartest);
+    CPPUNIT_TEST(construct_1);
+    CPPUNIT_TEST(empty_1);
+    CPPUNIT_TEST(names_1);
+    CPPUNIT_TEST(write_1);
+    CPPUNIT_TEST(write_2);
+    CPPUNIT_TEST(select_1);
+    CPPUNIT_TEST(passthrough_1);
+    CPPUNIT_TEST(flush_1);
+    CPPUNIT_TEST(block_1);
+    CPPUNIT_TEST(block_2);
+    CPPUNIT_TEST(block_3);
+    CPPUNIT_TEST(bad_1);
+    CPPUNIT_TEST(finish_1);
+    CPPUNIT_TEST_SUITE_END();
+    
+private:
+    int m_fd;
+    std::string m_filename;
+public:
+    void setUp() {
+        char ftemplate[100];
+        strncpy(ftemplate, templateFilename, sizeof(ftemplate));
+        m_fd = mkstemps(ftemplate, 4);     // 4 '.dat'
+        if (m_fd < 0) {
+            std::string failmsg = "Failed to make tempfile: ";
+            failmsg += strerror(errno);
+            throw std::runtime_error(failmsg);
+        }
+        m_filename = ftemplate;
+    }
+    void tearDown() {
+        close(m_fd);
+        unlink(m_filename.c_str());
+        CTreeParameter::m_parameterDictionary.clear();
+        CTreeVariable::m_dictionary.clear();
+    }
+protected:
+    void construct_1();
+    void empty_1();
+    void names_1();
+    void write_1();
+    void write_2();
+    void select_1();
+    void passthrough_1();
+    void flush_1();
+    void block_1();
+    void block_2();
+    void block_3();
+    void bad_1();
+    void finish_1();
+private:
+    std::vector<std::pair<unsigned, double>> makeEvent(int i);
+    void checkChunk(
+        const CColumnarReader::Chunk& chunk, std::uint64_t firstTrigger,
+        const std::vector<unsigned>& numbers
+    );
+    std::vector<std::uint32_t> itemTypes();
+};
+
+/**
+ * makeEvent
+ *    Event i has parameters 0..i%5 with value number*10 + i.
+ *    Event 9 also has parameter 7.
+ */
+std::vector<std::pair<unsigned, double>>
+columnartest::makeEvent(int i)
+{
+    std::vector<std::pair<unsigned, double>> result;
+    for (unsigned p = 0; p <= unsigned(i % 5); p++) {
+        result.push_back({p, p*10.0 + i});
+    }
+    if (i == 9) {
+        result.push_back({7, 1234.0});
+    }
+    return result;
+}
+/**
+ * checkChunk
+ *    Check a chunk read back from events made by makeEvent.
+ */
+void
+columnartest::checkChunk(
+    const CColumnarReader::Chunk& chunk, std::uint64_t firstTrigger,
+    const std::vector<unsigned>& numbers
+)
+{
+    EQ(numbers.size(), chunk.s_columns.size());
+    for (size_t c = 0; c < numbers.size(); c++) {
+        auto& column(chunk.s_columns[c]);
+        EQ(numbers[c], column.s_parameterNumber);
+        size_t nValues = 0;
+        for (size_t e = 0; e < chunk.s_triggers.size(); e++) {
+            std::uint64_t trigger = firstTrigger + e;
+            EQ(trigger, chunk.s_triggers[e]);
+            auto expected = makeEvent(trigger);
+            bool found = false;
+            double value = 0;
+            for (auto& p : expected) {
+                if (p.first == numbers[c]) {
+                    found = true;
+                    value = p.second;
+                }
+            }
+            EQ(found, column.present(e));
+            if (found) {
+                ASSERT(nValues < column.s_values.size());
+                EQ(value, column.s_values[nValues]);
+                nValues++;
+            }
+        }
+        EQ(nValues, column.s_values.size());
+    }
+}
+/**
+ * itemTypes
+ *   @return the types of the ring items in the file.
+ */
+std::vector<std::uint32_t>
+columnartest::itemTypes()
+{
+    std::vector<std::uint32_t> result;
+    lseek(m_fd, 0, SEEK_SET);
+    CDataReader reader(m_fd, 1024*1024);
+    auto r = reader.getBlock(1024*1024);
+    const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(r.s_pData);
+    for (size_t i = 0; i < r.s_nItems; i++) {
+        const RingItemHeader* pHeader = reinterpret_cast<const RingItemHeader*>(p);
+        std::uint32_t type = pHeader->s_type;     // Packed so copy.
+        result.push_back(type);
+        p += pHeader->s_size;
+    }
+    return result;
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(columnartest);
+
+// A chunk size of zero is an error.
+
+void columnartest::construct_1()
+{
+    EXCEPTION(
+        CColumnarDataWriter w(m_filename.c_str(), 0), std::invalid_argument
+    );
+}
+// A file with no events has the front matter, an empty directory and the
+// pointer to it.
+
+void columnartest::empty_1()
+{
+    {
+        CColumnarDataWriter w(m_filename.c_str());
+    }
+    std::vector<std::uint32_t> expected = {
+        PARAMETER_DEFINITIONS, VARIABLE_VALUES, CHUNK_DIRECTORY,
+        CHUNK_DIRECTORY_POINTER
+    };
+    ASSERT(expected == itemTypes());
+    
+    CColumnarReader r(m_filename.c_str());
+    EQ(size_t(0), r.chunks());
+}
+// Parameter names come from the definitions at the front of the file.
+
+void columnartest::names_1()
+{
+    CTreeParameter x("x", 100, 0.0, 100.0, "mm");
+    CTreeParameter y("y", 100, 0.0, 100.0, "mm");
+    {
+        CColumnarDataWriter w(m_filename.c_str());
+    }
+    CColumnarReader r(m_filename.c_str());
+    EQ(x.getId(), r.parameterNumber("x"));
+    EQ(y.getId(), r.parameterNumber("y"));
+    EXCEPTION(r.parameterNumber("z"), std::invalid_argument);
+}
+// Events are chunked and every column reads back.
+
+void columnartest::write_1()
+{
+    {
+        CColumnarDataWriter w(m_filename.c_str(), 4);
+        for (int i = 0; i < 10; i++) {
+            w.writeEvent(makeEvent(i), i);
+        }
+    }
+    CColumnarReader r(m_filename.c_str());
+    EQ(size_t(3), r.chunks());
+    std::vector<std::uint32_t> sizes = {4, 4, 2};
+    std::vector<std::uint32_t> columns = {4, 5, 6};    // Chunk 2 has 7 too.
+    
+    std::vector<unsigned> numbers = {0, 1, 2, 3, 4, 7, 99};
+    CColumnarReader::Chunk chunk;
+    for (size_t c = 0; c < r.chunks(); c++) {
+        EQ(sizes[c], r.chunkInfo(c).s_eventCount);
+        EQ(std::uint64_t(c*4), r.chunkInfo(c).s_firstTrigger);
+        EQ(columns[c], r.chunkInfo(c).s_columnCount);
+        r.readChunk(c, numbers, chunk);
+        EQ(size_t(sizes[c]), chunk.s_triggers.size());
+        checkChunk(chunk, c*4, numbers);
+    }
+    EXCEPTION(r.readChunk(3, numbers, chunk), std::out_of_range);
+}
+// A parameter given twice in an event keeps the last value.
+
+void columnartest::write_2()
+{
+    {
+        CColumnarDataWriter w(m_filename.c_str(), 4);
+        w.writeEvent({{1, 1.0}, {2, 2.0}, {1, 3.0}}, 0);
+        w.writeEvent({{1, 4.0}}, 1);
+    }
+    CColumnarReader r(m_filename.c_str());
+    CColumnarReader::Chunk chunk;
+    r.readChunk(0, {1, 2}, chunk);
+    EQ(size_t(2), chunk.s_columns[0].s_values.size());
+    EQ(3.0, chunk.s_columns[0].s_values[0]);
+    EQ(4.0, chunk.s_columns[0].s_values[1]);
+    EQ(size_t(1), chunk.s_columns[1].s_values.size());
+    ASSERT(chunk.s_columns[1].present(0));
+    ASSERT(!chunk.s_columns[1].present(1));
+}
+// Reading one column of many reads a small part of the file.
+
+void columnartest::select_1()
+{
+    {
+        CColumnarDataWriter w(m_filename.c_str(), 100);
+        std::vector<std::pair<unsigned, double>> event;
+        for (int i = 0; i < 1000; i++) {
+            event.clear();
+            for (unsigned p = 0; p < 200; p++) {
+                event.push_back({p, double(p + i)});
+            }
+            w.writeEvent(event, i);
+        }
+    }
+    struct stat info;
+    fstat(m_fd, &info);
+    
+    CColumnarReader r(m_filename.c_str());
+    EQ(size_t(10), r.chunks());
+    CColumnarReader::Chunk chunk;
+    for (size_t c = 0; c < r.chunks(); c++) {
+        r.readChunk(c, {150}, chunk);
+        auto& column(chunk.s_columns[0]);
+        EQ(size_t(100), column.s_values.size());
+        for (size_t e = 0; e < 100; e++) {
+            ASSERT(column.present(e));
+            EQ(double(150 + c*100 + e), column.s_values[e]);
+        }
+    }
+    ASSERT(r.bytesRead() < std::uint64_t(info.st_size/20));
+}
+// Passthrough items end the current chunk so order is kept.
+
+void columnartest::passthrough_1()
+{
+    RingItemHeader item = {
+        sizeof(RingItemHeader), TEST_DATA, sizeof(std::uint32_t)
+    };
+    {
+        CColumnarDataWriter w(m_filename.c_str(), 4);
+        w.writeEvent(makeEvent(0), 0);
+        w.writeEvent(makeEvent(1), 1);
+        w.writeItem(&item);
+        w.writeItem(&item);
+        for (int i = 2; i < 10; i++) {
+            w.writeEvent(makeEvent(i), i);
+        }
+    }
+    std::vector<std::uint32_t> expected = {
+        PARAMETER_DEFINITIONS, VARIABLE_VALUES,
+        PARAMETER_CHUNK, TEST_DATA, TEST_DATA, PARAMETER_CHUNK, PARAMETER_CHUNK,
+        CHUNK_DIRECTORY, CHUNK_DIRECTORY_POINTER
+    };
+    ASSERT(expected == itemTypes());
+    
+    CColumnarReader r(m_filename.c_str());
+    EQ(size_t(3), r.chunks());
+    CColumnarReader::Chunk chunk;
+    std::vector<unsigned> numbers = {0, 1, 4, 7};
+    std::uint64_t first = 0;
+    for (size_t c = 0; c < r.chunks(); c++) {
+        r.readChunk(c, numbers, chunk);
+        checkChunk(chunk, first, numbers);
+        first += chunk.s_triggers.size();
+    }
+    EQ(std::uint64_t(10), first);
+}
+// flush ends the chunk being built.
+
+void columnartest::flush_1()
+{
+    {
+        CColumnarDataWriter w(m_filename.c_str(), 4);
+        w.writeEvent(makeEvent(0), 0);
+        w.flush();
+        w.flush();                       // No empty chunk.
+        w.writeEvent(makeEvent(1), 1);
+    }
+    CColumnarReader r(m_filename.c_str());
+    EQ(size_t(2), r.chunks());
+    EQ(std::uint32_t(1), r.chunkInfo(0).s_eventCount);
+    EQ(std::uint64_t(1), r.chunkInfo(1).s_firstTrigger);
+}
+// A block of PARAMETER_DATA items makes the same file as writing the events.
+
+void columnartest::block_1()
+{
+    CParameterBatch batch(1000, 1024*1024);
+    {
+        CColumnarDataWriter w(m_filename.c_str(), 4);
+        for (int i = 0; i < 10; i++) {
+            w.writeEvent(makeEvent(i), i);
+            batch.addEvent(makeEvent(i), i);
+        }
+    }
+    struct stat info;
+    fstat(m_fd, &info);
+    std::vector<char> expected(info.st_size);
+    ASSERT(pread(m_fd, expected.data(), expected.size(), 0) == info.st_size);
+    
+    int fd = open(m_filename.c_str(), O_RDWR | O_TRUNC);
+    {
+        CColumnarDataWriter w(fd, 4, 100);
+        w.writeBlock(batch.data(), batch.size());
+    }
+    fstat(m_fd, &info);
+    std::vector<char> contents(info.st_size);
+    ASSERT(pread(m_fd, contents.data(), contents.size(), 0) == info.st_size);
+    ASSERT(expected == contents);
+}
+// Compressed frames are inflated into the chunks.
+
+void columnartest::block_2()
+{
+    CParameterBatch batch(1000, 1024*1024);
+    {
+        CColumnarDataWriter w(m_filename.c_str(), 4);
+        for (int i = 0; i < 10; i++) {
+            w.writeEvent(makeEvent(i), i);
+            batch.addEvent(makeEvent(i), i);
+        }
+    }
+    struct stat info;
+    fstat(m_fd, &info);
+    std::vector<char> expected(info.st_size);
+    ASSERT(pread(m_fd, expected.data(), expected.size(), 0) == info.st_size);
+    
+    CParameterCompressor c;
+    c.add(batch.data(), batch.size());
+    int fd = open(m_filename.c_str(), O_RDWR | O_TRUNC);
+    {
+        CColumnarDataWriter w(fd, 4, 100);
+        w.writeBlock(c.data(), c.size());
+    }
+    fstat(m_fd, &info);
+    std::vector<char> contents(info.st_size);
+    ASSERT(pread(m_fd, contents.data(), contents.size(), 0) == info.st_size);
+    ASSERT(expected == contents);
+}
+// Packed items are widened into the chunks whether compressed or not.
+
+void columnartest::block_3()
+{
+    CParameterBatch batch(1000, 1024*1024);
+    {
+        CColumnarDataWriter w(m_filename.c_str(), 4);
+        for (int i = 0; i < 10; i++) {
+            w.writeEvent(makeEvent(i), i);
+            batch.addEvent(makeEvent(i), i);
+        }
+    }
+    struct stat info;
+    fstat(m_fd, &info);
+    std::vector<char> expected(info.st_size);
+    ASSERT(pread(m_fd, expected.data(), expected.size(), 0) == info.st_size);
+    
+    std::vector<std::uint32_t> types(8, VALUE_UINT16);
+    types[1] = VALUE_FLOAT32;
+    CParameterPacker packer(types);
+    packer.add(batch.data(), batch.size());
+    CParameterCompressor c;
+    c.add(packer.data(), packer.size());
+    
+    for (int compressed = 0; compressed < 2; compressed++) {
+        int fd = open(m_filename.c_str(), O_RDWR | O_TRUNC);
+        {
+            CColumnarDataWriter w(fd, 4, 100);
+            if (compressed) {
+                w.writeBlock(c.data(), c.size());
+            } else {
+                w.writeBlock(packer.data(), packer.size());
+            }
+        }
+        fstat(m_fd, &info);
+        std::vector<char> contents(info.st_size);
+        ASSERT(pread(m_fd, contents.data(), contents.size(), 0) == info.st_size);
+        ASSERT(expected == contents);
+    }
+}
+// Files that aren't complete columnar files are rejected.
+
+void columnartest::bad_1()
+{
+    {
+        CDataWriter w(m_filename.c_str());
+        w.writeEvent(makeEvent(1), 1);
+    }
+    EXCEPTION(CColumnarReader r(m_filename.c_str()), std::runtime_error);
+    EXCEPTION(CColumnarReader r("/no/such/file"), std::runtime_error);
+}
+// finish writes the last chunk and the directory while the writer still
+// exists and reports failures to do so (/dev/full fails every write).
+
+void columnartest::finish_1()
+{
+    CColumnarDataWriter w(m_filename.c_str(), 4);
+    for (int i = 0; i < 6; i++) {
+        w.writeEvent(makeEvent(i), i);
+    }
+    w.finish();
+    w.finish();                             // Already finished.
+    CColumnarReader r(m_filename.c_str());
+    EQ(size_t(2), r.chunks());
+    
+    CColumnarDataWriter full("/dev/full", 4);
+    full.writeEvent(makeEvent(0), 0);
+    EXCEPTION(full.finish(), std::runtime_error);
+}
@@ -0,0 +1,269 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  compressBench.cpp
+ *  @brief: Measure compression of parameter batches on workers.
+ *
+ *  Builds a synthetic run as CParameterBatch's of the default size (what a
+ *  worker sends the farmer) and times:
+ *     - pack     - (optional) CParameterPacker::add over every batch, split
+ *                  over threads like compress.  The rate is of unpacked bytes.
+ *     - compress - CParameterCompressor::add over every (packed) batch,
+ *                  split over threads the way batches are split over
+ *                  workers.  The rate is of uncompressed bytes.
+ *     - inflate  - CParameterCompressor::decompress of every frame (and
+ *                  CParameterPacker::widen of its items if packed) in one
+ *                  thread, as the dealer's CInflatingDataReader does.  The
+ *                  rate is of inflated (widened) bytes.
+ *  along with the packing and compression ratios.
+ *
+ *  The run looks like a segmented detector: each event hits 8-64 of 512
+ *  channels.  A hit sets a raw 12 bit ADC value (a peak on an exponential
+ *  background), that value calibrated with a per channel gain and offset
+ *  and a TDC time in 0.1 ns ticks.  Each event also has its multiplicity
+ *  and summed energy.  When packing, the raw values and multiplicity are
+ *  stored as uint16 and the rest as float32.
+ *
+ *  Usage:
+ *  \verbatim
+ *     compressBench ?events? ?level? ?threads? ?pack?
+ *  \endverbatim
+ *  events defaults to 200000, level to CParameterCompressor::DEFAULT_LEVEL,
+ *  threads to 1 and pack to 0 (non zero packs before compressing).
+ */
+#include "ParameterCompressor.h"
+#include "ParameterPacker.h"
+#include "ParameterBatch.h"
+#include "AnalysisRingItems.h"
+#include <stdlib.h>
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include <random>
+#include <thread>
+#include <algorithm>
+
+using namespace frib::analysis;
+
+static const unsigned CHANNELS = 512;
+
+/**
+ * makeRun
+ *    Make the synthetic run.
+ */
+static std::vector<CParameterBatch*>
+makeRun(std::uint64_t nEvents)
+{
+    std::mt19937 gen(12345);
+    std::uniform_real_distribution<double> gains(0.9, 1.1);
+    std::uniform_real_distribution<double> offsets(-5.0, 5.0);
+    std::vector<double> gain(CHANNELS);
+    std::vector<double> offset(CHANNELS);
+    for (unsigned c = 0; c < CHANNELS; c++) {
+        gain[c]   = gains(gen);
+        offset[c] = offsets(gen);
+    }
+    std::uniform_int_distribution<unsigned> multiplicity(8, 64);
+    std::uniform_int_distribution<unsigned> channel(0, CHANNELS - 1);
+    std::bernoulli_distribution             inPeak(0.3);
+    std::normal_distribution<double>        peak(1800.0, 25.0);
+    std::exponential_distribution<double>   background(1.0/400.0);
+    std::normal_distribution<double>        time(5000.0, 40.0);
+    
+    std::vector<CParameterBatch*> result;
+    std::vector<std::pair<unsigned, double>> event;
+    std::vector<unsigned> hits;
+    CParameterBatch* pBatch = nullptr;
+    for (std::uint64_t i = 0; i < nEvents; i++) {
+        hits.clear();
+        unsigned m = multiplicity(gen);
+        while (hits.size() < m) {
+            unsigned c = channel(gen);
+            if (std::find(hits.begin(), hits.end(), c) == hits.end()) {
+                hits.push_back(c);
+            }
+        }
+        std::sort(hits.begin(), hits.end());
+        
+        event.clear();
+        double sum(0);
+        for (auto c : hits) {
+            double raw = inPeak(gen) ? peak(gen) : background(gen);
+            raw = std::min(4095.0, std::max(0.0, std::floor(raw)));
+            double energy = raw*gain[c] + offset[c];
+            event.push_back({c, raw});
+            event.push_back({CHANNELS + c, energy});
+            event.push_back({2*CHANNELS + c, std::floor(time(gen)*10.0)/10.0});
+            sum += energy;
+        }
+        event.push_back({3*CHANNELS, double(m)});
+        event.push_back({3*CHANNELS + 1, sum});
+        
+        if (!pBatch || pBatch->full()) {
+            pBatch = new CParameterBatch;
+            result.push_back(pBatch);
+        }
+        pBatch->addEvent(event, i);
+    }
+    return result;
+}
+/**
+ * storageTypes
+ *    The storage types of the synthetic run's parameters.
+ */
+static std::vector<std::uint32_t>
+storageTypes()
+{
+    std::vector<std::uint32_t> result(3*CHANNELS + 2, VALUE_FLOAT32);
+    std::fill(result.begin(), result.begin() + CHANNELS, VALUE_UINT16);
+    result[3*CHANNELS] = VALUE_UINT16;
+    return result;
+}
+
+int main(int argc, char** argv)
+{
+    std::uint64_t nEvents = (argc > 1) ? atol(argv[1]) : 200000;
+    int level = (argc > 2) ? atoi(argv[2]) : CParameterCompressor::DEFAULT_LEVEL;
+    unsigned nThreads = (argc > 3) ? atoi(argv[3]) : 1;
+    if (nThreads == 0) nThreads = 1;
+    bool pack = (argc > 4) && atoi(argv[4]);
+    
+    auto batches = makeRun(nEvents);
+    double rawBytes(0);
+    for (auto p : batches) {
+        rawBytes += p->size();
+    }
+    // Pack: thread t does batches t, t+nThreads, ...
+    
+    std::vector<std::vector<std::uint8_t>> packed(batches.size());
+    double packedBytes(rawBytes);
+    std::chrono::duration<double> packTime(0);
+    std::vector<std::thread> threads;
+    if (pack) {
+        auto types = storageTypes();
+        std::vector<CParameterPacker*> packers;
+        for (unsigned t = 0; t < nThreads; t++) {
+            packers.push_back(new CParameterPacker(types));
+        }
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned t = 0; t < nThreads; t++) {
+            threads.emplace_back([&, t]() {
+                CParameterPacker& p(*packers[t]);
+                for (std::size_t b = t; b < batches.size(); b += nThreads) {
+                    p.clear();
+                    p.add(batches[b]->data(), batches[b]->size());
+                    const std::uint8_t* pData =
+                        reinterpret_cast<const std::uint8_t*>(p.data());
+                    packed[b].assign(pData, pData + p.size());
+                }
+            });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        threads.clear();
+        packTime = std::chrono::steady_clock::now() - start;
+        packedBytes = 0;
+        for (auto& p : packed) {
+            packedBytes += p.size();
+        }
+        for (auto p : packers) delete p;
+    }
+    // Compress: likewise.
+    
+    std::vector<CParameterCompressor*> compressors;
+    for (unsigned t = 0; t < nThreads; t++) {
+        compressors.push_back(new CParameterCompressor(level));
+    }
+    std::vector<std::vector<std::uint8_t>> frames(batches.size());
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned t = 0; t < nThreads; t++) {
+        threads.emplace_back([&, t]() {
+            CParameterCompressor& c(*compressors[t]);
+            for (std::size_t b = t; b < batches.size(); b += nThreads) {
+                c.clear();
+                if (pack) {
+                    c.add(packed[b].data(), packed[b].size());
+                } else {
+                    c.add(batches[b]->data(), batches[b]->size());
+                }
+                const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(c.data());
+                frames[b].assign(p, p + c.size());
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    std::chrono::duration<double> compressTime =
+        std::chrono::steady_clock::now() - start;
+    double compressedBytes(0);
+    for (auto& f : frames) {
+        compressedBytes += f.size();
+    }
+    // Inflate in one thread:
+    
+    CParameterCompressor inflater;
+    std::vector<std::uint8_t> out;
+    std::vector<std::uint8_t> wide;
+    double inflatedBytes(0);
+    start = std::chrono::steady_clock::now();
+    for (auto& f : frames) {
+        const std::uint8_t* p = f.data();
+        const std::uint8_t* pEnd = p + f.size();
+        while (p < pEnd) {
+            auto pFrame = reinterpret_cast<const CompressedParameters*>(p);
+            out.clear();
+            inflater.decompress(pFrame, out);
+            if (pack) {
+                wide.clear();
+                for (std::size_t i = 0; i < out.size(); ) {
+                    auto pItem =
+                        reinterpret_cast<const PackedParameterItem*>(out.data() + i);
+                    CParameterPacker::widen(pItem, wide);
+                    i += pItem->s_header.s_size;
+                }
+                inflatedBytes += wide.size();
+            } else {
+                inflatedBytes += out.size();
+            }
+            p += pFrame->s_header.s_size;
+        }
+    }
+    std::chrono::duration<double> inflateTime =
+        std::chrono::steady_clock::now() - start;
+    
+    double MB = 1024.0*1024.0;
+    std::cout << nEvents << " events, " << batches.size() << " batches, "
+        << rawBytes/MB << " MB, level " << level << ", " << nThreads
+        << " threads" << (pack ? ", packed\n" : "\n");
+    if (pack) {
+        std::cout << "pack:     " << packTime.count() << " s "
+            << rawBytes/MB/packTime.count() << " MB/s ratio "
+            << rawBytes/packedBytes << std::endl;
+    }
+    std::cout << "compress: " << compressTime.count() << " s "
+        << packedBytes/MB/compressTime.count() << " MB/s ratio "
+        << packedBytes/compressedBytes << " (overall "
+        << rawBytes/compressedBytes << ")" << std::endl;
+    std::cout << "inflate:  " << inflateTime.count() << " s "
+        << inflatedBytes/MB/inflateTime.count() << " MB/s" << std::endl;
+    
+    for (auto p : batches) delete p;
+    for (auto p : compressors) delete p;
+    return (inflatedBytes == rawBytes) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,269 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  compressortests.cpp
+ *  @brief: Tests of CParameterCompressor
+ */
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/Asserter.h>
+#include "Asserts.h"
+#include "ParameterCompressor.h"
+#include "ParameterBatch.h"
+#include <vector>
+#include <utility>
+#include <stdexcept>
+#include <cstdint>
+#include <string.h>
+
+using namespace frib::analysis;
+
+class compressortest : public CppUnit::TestFixture {
+    CPPUNIT_TEST_SUITE(compressortest);
+    CPPUNIT_TEST(construct_1);
+    
+    CPPUNIT_TEST(add_1);
+    CPPUNIT_TEST(add_2);
+    CPPUNIT_TEST(add_3);
+    CPPUNIT_TEST(add_4);
+    CPPUNIT_TEST(add_5);
+    
+    CPPUNIT_TEST(decompress_1);
+    CPPUNIT_TEST(decompress_2);
+    CPPUNIT_TEST(decompress_3);
+    
+    CPPUNIT_TEST(validate_1);
+    CPPUNIT_TEST_SUITE_END();
+    
+private:
+    CParameterCompressor* m_pCompressor;
+    CParameterBatch*      m_pBatch;
+public:
+    void setUp() {
+        m_pCompressor = new CParameterCompressor;
+        m_pBatch      = new CParameterBatch(1000, 16*1024*1024);
+    }
+    void tearDown() {
+        delete m_pCompressor;
+        delete m_pBatch;
+    }
+protected:
+    void construct_1();
+    
+    void add_1();
+    void add_2();
+    void add_3();
+    void add_4();
+    void add_5();
+    
+    void decompress_1();
+    void decompress_2();
+    void decompress_3();
+    
+    void validate_1();
+private:
+    void addEvents(std::uint64_t first, unsigned n);
+    std::vector<const CompressedParameters*> frames();
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(compressortest);
+
+/**
+ * addEvents
+ *   Add n events with consecutive triggers to m_pBatch.  Each has 20
+ *   parameters whose values depend on the trigger.
+ */
+void
+compressortest::addEvents(std::uint64_t first, unsigned n)
+{
+    for (unsigned i = 0; i < n; i++) {
+        std::vector<std::pair<unsigned, double>> event;
+        for (unsigned p = 0; p < 20; p++) {
+            event.push_back({p, double((first + i) % 17 + p)});
+        }
+        m_pBatch->addEvent(event, first + i);
+    }
+}
+/**
+ * frames
+ *   @return the frames m_pCompressor holds.
+ */
+std::vector<const CompressedParameters*>
+compressortest::frames()
+{
+    std::vector<const CompressedParameters*> result;
+    const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(m_pCompressor->data());
+    const std::uint8_t* pEnd = p + m_pCompressor->size();
+    while (p < pEnd) {
+        auto pFrame = reinterpret_cast<const CompressedParameters*>(p);
+        result.push_back(pFrame);
+        p += pFrame->s_header.s_size;
+    }
+    return result;
+}
+
+// Compression levels must be ones zlib understands.
+void compressortest::construct_1()
+{
+    ASSERT(m_pCompressor->empty());
+    EQ(size_t(0), m_pCompressor->size());
+    EXCEPTION(CParameterCompressor c(0), std::invalid_argument);
+    EXCEPTION(CParameterCompressor c(10), std::invalid_argument);
+    CParameterCompressor c(9);
+}
+// Consecutive triggers make a single, properly formatted, frame that's
+// smaller than its contents.
+void compressortest::add_1()
+{
+    addEvents(100, 50);
+    m_pCompressor->add(m_pBatch->data(), m_pBatch->size());
+    
+    auto f = frames();
+    EQ(size_t(1), f.size());
+    EQ(std::uint32_t(COMPRESSED_PARAMETERS), f[0]->s_header.s_type);
+    EQ(std::uint32_t(sizeof(std::uint32_t)), f[0]->s_header.s_unused);
+    EQ(std::uint32_t(m_pCompressor->size()), f[0]->s_header.s_size);
+    EQ(std::uint64_t(100), f[0]->s_firstTrigger);
+    EQ(std::uint32_t(50), f[0]->s_eventCount);
+    EQ(std::uint32_t(m_pBatch->size()), f[0]->s_uncompressedSize);
+    ASSERT(m_pCompressor->size() < m_pBatch->size());
+}
+// A break in the triggers starts a new frame.
+void compressortest::add_2()
+{
+    addEvents(0, 10);
+    addEvents(20, 5);
+    addEvents(25, 5);
+    m_pCompressor->add(m_pBatch->data(), m_pBatch->size());
+    
+    auto f = frames();
+    EQ(size_t(2), f.size());
+    EQ(std::uint64_t(0), f[0]->s_firstTrigger);
+    EQ(std::uint32_t(10), f[0]->s_eventCount);
+    EQ(std::uint64_t(20), f[1]->s_firstTrigger);
+    EQ(std::uint32_t(10), f[1]->s_eventCount);
+}
+// Frames accumulate over adds until cleared.
+void compressortest::add_3()
+{
+    addEvents(0, 10);
+    m_pCompressor->add(m_pBatch->data(), m_pBatch->size());
+    m_pCompressor->add(m_pBatch->data(), m_pBatch->size());
+    EQ(size_t(2), frames().size());
+    
+    m_pCompressor->clear();
+    ASSERT(m_pCompressor->empty());
+}
+// Frames are limited in size.
+void compressortest::add_4()
+{
+    size_t eventSize = sizeof(ParameterItem) + 20*sizeof(ParameterValue);
+    size_t perFrame  = CParameterCompressor::MAX_FRAME_BYTES/eventSize;
+    delete m_pBatch;
+    m_pBatch = new CParameterBatch(perFrame*2, 16*1024*1024);
+    addEvents(0, perFrame + 1);
+    m_pCompressor->add(m_pBatch->data(), m_pBatch->size());
+    
+    auto f = frames();
+    EQ(size_t(2), f.size());
+    EQ(std::uint32_t(perFrame), f[0]->s_eventCount);
+    EQ(std::uint64_t(perFrame), f[1]->s_firstTrigger);
+    EQ(std::uint32_t(1), f[1]->s_eventCount);
+}
+// Only whole PARAMETER_DATA items can be compressed.
+void compressortest::add_5()
+{
+    addEvents(0, 2);
+    EXCEPTION(
+        m_pCompressor->add(m_pBatch->data(), m_pBatch->size() - 1),
+        std::logic_error
+    );
+    std::vector<std::uint8_t> item(m_pBatch->size());
+    memcpy(item.data(), m_pBatch->data(), item.size());
+    reinterpret_cast<pParameterItem>(item.data())->s_header.s_type = PARAMETER_DATA + 1;
+    EXCEPTION(m_pCompressor->add(item.data(), item.size()), std::logic_error);
+}
+// Decompressing the frames gives back the original items.
+void compressortest::decompress_1()
+{
+    addEvents(0, 10);
+    addEvents(50, 10);
+    m_pCompressor->add(m_pBatch->data(), m_pBatch->size());
+    
+    std::vector<std::uint8_t> out;
+    for (auto pFrame : frames()) {
+        m_pCompressor->decompress(pFrame, out);
+    }
+    EQ(m_pBatch->size(), out.size());
+    EQ(0, memcmp(m_pBatch->data(), out.data(), out.size()));
+}
+// Corrupt data throw and leave the output as it was.
+void compressortest::decompress_2()
+{
+    addEvents(0, 10);
+    m_pCompressor->add(m_pBatch->data(), m_pBatch->size());
+    
+    std::vector<std::uint8_t> frame(m_pCompressor->size());
+    memcpy(frame.data(), m_pCompressor->data(), frame.size());
+    pCompressedParameters pFrame = reinterpret_cast<pCompressedParameters>(frame.data());
+    for (size_t i = sizeof(CompressedParameters); i < frame.size(); i++) {
+        frame[i] ^= 0x5a;
+    }
+    std::vector<std::uint8_t> out(3);
+    EXCEPTION(m_pCompressor->decompress(pFrame, out), std::runtime_error);
+    EQ(size_t(3), out.size());
+}
+// The frame header has to match what's in it.
+void compressortest::decompress_3()
+{
+    addEvents(0, 10);
+    m_pCompressor->add(m_pBatch->data(), m_pBatch->size());
+    
+    std::vector<std::uint8_t> frame(m_pCompressor->size());
+    memcpy(frame.data(), m_pCompressor->data(), frame.size());
+    pCompressedParameters pFrame = reinterpret_cast<pCompressedParameters>(frame.data());
+    std::vector<std::uint8_t> out;
+    
+    pFrame->s_eventCount = 9;
+    EXCEPTION(m_pCompressor->decompress(pFrame, out), std::runtime_error);
+    pFrame->s_eventCount = 10;
+    pFrame->s_firstTrigger = 1;
+    EXCEPTION(m_pCompressor->decompress(pFrame, out), std::runtime_error);
+    pFrame->s_firstTrigger = 0;
+    pFrame->s_header.s_type = PARAMETER_DATA;
+    EXCEPTION(m_pCompressor->decompress(pFrame, out), std::runtime_error);
+    pFrame->s_header.s_type = COMPRESSED_PARAMETERS;
+    
+    m_pCompressor->decompress(pFrame, out);
+    EQ(m_pBatch->size(), out.size());
+}
+// Batches validate with frames in them.
+void compressortest::validate_1()
+{
+    addEvents(0, 10);
+    m_pCompressor->add(m_pBatch->data(), m_pBatch->size());
+    std::vector<std::uint8_t> block(m_pCompressor->size());
+    memcpy(block.data(), m_pCompressor->data(), block.size());
+    block.insert(
+        block.end(),
+        reinterpret_cast<const std::uint8_t*>(m_pBatch->data()),
+        reinterpret_cast<const std::uint8_t*>(m_pBatch->data()) + m_pBatch->size()
+    );
+    EQ(size_t(11), CParameterBatch::validate(block.data(), block.size()));
+    
+    reinterpret_cast<pCompressedParameters>(block.data())->s_eventCount = 0;
+    EXCEPTION(CParameterBatch::validate(block.data(), block.size()), std::logic_error);
+}
@@ -0,0 +1,212 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+
+/** @file:  definitionserializertests.cpp
+ *  @brief: Tests of CDefinitionSerializer.
+ */
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/Asserter.h>
+#include "Asserts.h"
+
+#include "DefinitionSerializer.h"
+#include "TreeParameter.h"
+#include "TreeVariable.h"
+#include "AnalysisRingItems.h"
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <stdexcept>
+#include <string.h>
+
+using namespace frib::analysis;
+
+class DefSerializerTest : public CppUnit::TestFixture {
+    CPPUNIT_TEST_SUITE(DefSerializerTest);
+    CPPUNIT_TEST(serialize_1);
+    CPPUNIT_TEST(roundtrip_1);
+    CPPUNIT_TEST(roundtrip_2);
+    CPPUNIT_TEST(storage_1);
+    CPPUNIT_TEST(id_1);
+    CPPUNIT_TEST(bad_1);
+    CPPUNIT_TEST(bad_2);
+    CPPUNIT_TEST(bad_3);
+    CPPUNIT_TEST_SUITE_END();
+protected:
+    void serialize_1();
+    void roundtrip_1();
+    void roundtrip_2();
+    void storage_1();
+    void id_1();
+    void bad_1();
+    void bad_2();
+    void bad_3();
+public:
+    void setUp() {
+        CTreeParameter p("ser.param", 512, -1.0, 1.0, "mm");
+        CTreeVariable  v("ser.var", 3.5, "cm");
+    }
+    void tearDown() {}
+private:
+    static std::vector<std::uint8_t> oneParameter(
+        std::uint32_t id, const char* name,
+        std::uint32_t storage = VALUE_DOUBLE
+    );
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(DefSerializerTest);
+
+// A blob with a single parameter and no variables.
+
+std::vector<std::uint8_t>
+DefSerializerTest::oneParameter(
+    std::uint32_t id, const char* name, std::uint32_t storage
+)
+{
+    std::vector<std::uint8_t> result;
+    std::uint32_t u[2] = {1, id};
+    result.insert(result.end(), (std::uint8_t*)u, (std::uint8_t*)(u + 2));
+    std::uint32_t chans = 100;
+    double limits[2] = {0.0, 100.0};
+    result.insert(result.end(), (std::uint8_t*)&chans, (std::uint8_t*)(&chans + 1));
+    result.insert(
+        result.end(), (std::uint8_t*)&storage, (std::uint8_t*)(&storage + 1)
+    );
+    result.insert(result.end(), (std::uint8_t*)limits, (std::uint8_t*)(limits + 2));
+    result.insert(result.end(), name, name + strlen(name) + 1);
+    result.push_back(0);                    // No units.
+    std::uint32_t nVars = 0;
+    result.insert(result.end(), (std::uint8_t*)&nVars, (std::uint8_t*)(&nVars + 1));
+    return result;
+}
+
+// The blob starts with the parameter count and has the names.
+
+void DefSerializerTest::serialize_1()
+{
+    auto blob = CDefinitionSerializer::serialize();
+    std::uint32_t nParams;
+    memcpy(&nParams, blob.data(), sizeof(nParams));
+    EQ(CTreeParameter::getDefinitionCount(), std::size_t(nParams));
+    
+    std::string s(blob.begin(), blob.end());
+    ASSERT(s.find("ser.param") != std::string::npos);
+    ASSERT(s.find("ser.var") != std::string::npos);
+}
+// Unpacking restores the definitions as they were packed.
+
+void DefSerializerTest::roundtrip_1()
+{
+    auto blob = CDefinitionSerializer::serialize();
+    std::size_t nDefs = CTreeParameter::getDefinitionCount();
+    
+    CTreeParameter p("ser.param", 100, 0.0, 10.0, "ns");
+    CTreeVariable  v("ser.var", 1.0, "km");
+    CDefinitionSerializer::deserialize(blob.data(), blob.size());
+    
+    EQ(nDefs, CTreeParameter::getDefinitionCount());
+    EQ(512U, p.getBins());
+    EQ(-1.0, p.getStart());
+    EQ(1.0, p.getStop());
+    EQ(std::string("mm"), p.getUnit());
+    EQ(3.5, v.getValue());
+    EQ(std::string("cm"), v.getUnit());
+}
+// A parameter that's in the blob but not defined here is made with
+// the id it had, even if that leaves a gap.
+
+void DefSerializerTest::roundtrip_2()
+{
+    std::uint32_t id = 100000;
+    auto blob = oneParameter(id, "ser.new");
+    CDefinitionSerializer::deserialize(blob.data(), blob.size());
+    
+    CTreeParameter p("ser.new");
+    EQ(unsigned(id), p.getId());
+    EQ(100U, p.getBins());
+}
+// Storage types go along with the definitions.
+
+void DefSerializerTest::storage_1()
+{
+    CTreeParameter p("ser.param");
+    p.setStorage(VALUE_FLOAT32);
+    auto blob = CDefinitionSerializer::serialize();
+    p.setStorage(VALUE_DOUBLE);
+    
+    CDefinitionSerializer::deserialize(blob.data(), blob.size());
+    EQ(VALUE_FLOAT32, p.getStorage());
+    
+    blob = oneParameter(200000, "ser.uint16", VALUE_UINT16);
+    CDefinitionSerializer::deserialize(blob.data(), blob.size());
+    CTreeParameter q("ser.uint16");
+    EQ(VALUE_UINT16, q.getStorage());
+    
+    p.setStorage(VALUE_DOUBLE);
+}
+// A new parameter can't take an id that's in use and an existing one
+// can't change its id.
+
+void DefSerializerTest::id_1()
+{
+    CTreeParameter p("ser.param");
+    auto blob = oneParameter(p.getId(), "ser.wrongid");
+    CPPUNIT_ASSERT_THROW(
+        CDefinitionSerializer::deserialize(blob.data(), blob.size()),
+        std::logic_error
+    );
+    blob = oneParameter(p.getId() + 1, "ser.param");
+    CPPUNIT_ASSERT_THROW(
+        CDefinitionSerializer::deserialize(blob.data(), blob.size()),
+        std::logic_error
+    );
+}
+// Truncated blobs are detected.
+
+void DefSerializerTest::bad_1()
+{
+    auto blob = CDefinitionSerializer::serialize();
+    CPPUNIT_ASSERT_THROW(
+        CDefinitionSerializer::deserialize(blob.data(), blob.size() - 1),
+        std::invalid_argument
+    );
+    CPPUNIT_ASSERT_THROW(
+        CDefinitionSerializer::deserialize(blob.data(), 2),
+        std::invalid_argument
+    );
+}
+// So are blobs with extra data.
+
+void DefSerializerTest::bad_2()
+{
+    auto blob = CDefinitionSerializer::serialize();
+    blob.push_back(0);
+    CPPUNIT_ASSERT_THROW(
+        CDefinitionSerializer::deserialize(blob.data(), blob.size()),
+        std::invalid_argument
+    );
+}
+// As are unknown storage types.
+
+void DefSerializerTest::bad_3()
+{
+    auto blob = oneParameter(300000, "ser.badtype", 42);
+    CPPUNIT_ASSERT_THROW(
+        CDefinitionSerializer::deserialize(blob.data(), blob.size()),
+        std::invalid_argument
+    );
+}
@@ -0,0 +1,111 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+
+/** @file:  dictionaryBench.cpp
+ *  @brief: Startup cost of defining many tree parameters and variables.
+ *
+ *  Large detector arrays define their tree parameters with
+ *  CTreeParameterArray and each element is looked up in, then entered into,
+ *  the parameter dictionary.  This times, for 10k, 100k and 1M parameters:
+ *     - define  - CTreeParameterArray creating new parameters.
+ *     - bind    - a second CTreeParameterArray of the same name, which only
+ *                 looks up the existing definitions.
+ *     - defs    - CTreeParameter::getDefinitions (what the outputter writes).
+ *     - vars    - creating as many tree variables.
+ *  Each size uses new names so the dictionaries also hold the parameters
+ *  of the smaller sizes.
+ *
+ *  Usage:
+ *  \verbatim
+ *     dictionaryBench ?largest?
+ *  \endverbatim
+ *  largest (default 1000000) limits the sizes that are run.
+ */
+#include "TreeParameter.h"
+#include "TreeParameterArray.h"
+#include "TreeVariable.h"
+#include <stdlib.h>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace frib::analysis;
+
+typedef std::chrono::steady_clock Clock;
+
+static double
+secondsSince(Clock::time_point start)
+{
+    std::chrono::duration<double> d = Clock::now() - start;
+    return d.count();
+}
+
+int main(int argc, char** argv)
+{
+    unsigned largest = 1000000;
+    if (argc > 1) largest = strtoul(argv[1], nullptr, 0);
+    
+    std::cout << std::setw(9) << "params" << std::setw(12) << "define s"
+        << std::setw(12) << "bind s" << std::setw(12) << "defs s"
+        << std::setw(12) << "vars s" << std::endl;
+    unsigned sizes[] = {10000, 100000, 1000000};
+    for (auto n : sizes) {
+        if (n > largest) break;
+        std::stringstream base;
+        base << "bench" << n;
+        
+        auto start = Clock::now();
+        CTreeParameterArray* pDefine = new CTreeParameterArray(base.str(), n, 0);
+        double define = secondsSince(start);
+        
+        start = Clock::now();
+        CTreeParameterArray* pBind = new CTreeParameterArray(base.str(), n, 0);
+        double bind = secondsSince(start);
+        
+        start = Clock::now();
+        auto defs = CTreeParameter::getDefinitions();
+        double getDefs = secondsSince(start);
+        
+        std::vector<std::string> names;
+        names.reserve(n);
+        for (unsigned i = 0; i < n; i++) {
+            std::stringstream name;
+            name << base.str() << ".var." << i;
+            names.push_back(name.str());
+        }
+        std::vector<CTreeVariable*> vars;
+        vars.reserve(n);
+        start = Clock::now();
+        for (auto& name : names) {
+            vars.push_back(new CTreeVariable(name, 0.0, "mm"));
+        }
+        double varTime = secondsSince(start);
+        
+        std::cout << std::setw(9) << n << std::fixed << std::setprecision(3)
+            << std::setw(12) << define << std::setw(12) << bind
+            << std::setw(12) << getDefs << std::setw(12) << varTime << std::endl;
+        
+        for (auto p : vars) delete p;
+        delete pBind;
+        delete pDefine;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,105 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+
+/** @file:  indexTriggers.cpp
+ *  @brief: Write the trigger index of an existing raw or parameter file.
+ *
+ *  Outputters can index the parameter files they write (see
+ *  CMPIParameterOutput::getIndexInterval) but raw event files and
+ *  existing parameter files have to be indexed after the fact.  This
+ *  reads the file once and writes its index (see CTriggerIndex) so that
+ *  dealers can start at a trigger without reading up to it.
+ *
+ *  Usage:
+ *  \verbatim
+ *     indexTriggers file ?interval? ?indexfile?
+ *  \endverbatim
+ *  interval is the number of items between index entries and defaults
+ *  to CTriggerIndex::DEFAULT_INTERVAL.  indexfile defaults to the file's
+ *  sidecar (file.idx) which is where the dealers look for it.
+ */
+#include "TriggerIndex.h"
+#include "DataReader.h"
+#include "MappedDataReader.h"
+#include <stdlib.h>
+#include <iostream>
+#include <string>
+#include <memory>
+#include <stdexcept>
+
+using namespace frib::analysis;
+
+static const std::size_t BUFFER_SIZE(16*1024*1024);
+
+/**
+ * usage
+ *    Complain about the command line.
+ */
+static void
+usage()
+{
+    std::cerr << "Usage:\n";
+    std::cerr << "   indexTriggers file ?interval? ?indexfile?\n";
+    std::cerr << "Where:\n";
+    std::cerr << "   file      - a raw event file or parameter file.\n";
+    std::cerr << "   interval  - items between index entries (default "
+        << CTriggerIndex::DEFAULT_INTERVAL << ").\n";
+    std::cerr << "   indexfile - where to write the index (default file.idx).\n";
+}
+
+int main(int argc, char** argv)
+{
+    if ((argc < 2) || (argc > 4)) {
+        usage();
+        return EXIT_FAILURE;
+    }
+    const char* pFilename = argv[1];
+    unsigned long interval = CTriggerIndex::DEFAULT_INTERVAL;
+    if (argc > 2) {
+        char* pEnd;
+        interval = strtoul(argv[2], &pEnd, 0);
+        if ((*pEnd != '\0') || (interval == 0) || (interval > UINT32_MAX)) {
+            std::cerr << "The interval must be a positive integer\n";
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+    std::string indexFile =
+        argc > 3 ? std::string(argv[3]) : CTriggerIndex::sidecarName(pFilename);
+    
+    try {
+        std::unique_ptr<CDataReader> pReader(
+            CMappedDataReader::isMappable(pFilename) ?
+                static_cast<CDataReader*>(new CMappedDataReader(pFilename)) :
+                new CDataReader(pFilename, BUFFER_SIZE)
+        );
+        CTriggerIndex index(interval);
+        index.build(*pReader);
+        index.describeFile(pFilename);
+        index.write(indexFile.c_str());
+        
+        std::cout << pFilename << ": " << index.items() << " items, "
+            << index.size() << " index entries written to " << indexFile
+            << std::endl;
+    }
+    catch (std::exception& e) {
+        std::cerr << "indexTriggers failed: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,311 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  inflatingreadertests.cpp
+ *  @brief: Tests the CInflatingDataReader class.
+ */
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/Asserter.h>
+#include "Asserts.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdexcept>
+#include <string>
+#include <string.h>
+#include <vector>
+#include <cstdint>
+
+#include "InflatingDataReader.h"
+#include "MappedDataReader.h"
+#include "ParameterCompressor.h"
+#include "ParameterPacker.h"
+#include "ParameterBatch.h"
+#include "AnalysisRingItems.h"
+
+using namespace frib::analysis;
+
+static const char* templateFilename="testXXXXXX.dat";
+
+class inflatingreadertest : public CppUnit::TestFixture {
+    CPPUNIT_TEST_SUITE(inflatingreadertest);
+    CPPUNIT_TEST(get_1);
+    CPPUNIT_TEST(get_2);
+    CPPUNIT_TEST(get_3);
+    CPPUNIT_TEST(get_4);
+    CPPUNIT_TEST(packed_1);
+    CPPUNIT_TEST(packed_2);
+    
+    CPPUNIT_TEST(baddone);
+    CPPUNIT_TEST(badget);
+    CPPUNIT_TEST(corrupt);
+    CPPUNIT_TEST_SUITE_END();
+protected:
+    void get_1();
+    void get_2();
+    void get_3();
+    void get_4();
+    void packed_1();
+    void packed_2();
+    
+    void baddone();
+    void badget();
+    void corrupt();
+private:
+    int m_fd;
+    std::string m_filename;
+    std::vector<std::uint8_t> m_expected;     // What the reader should give.
+public:
+    void setUp() {
+        char ftemplate[100];
+        strncpy(ftemplate, templateFilename, sizeof(ftemplate));
+        m_fd = mkstemps(ftemplate, 4);     // 4 '.dat'
+        if (m_fd < 0) {
+            std::string failmsg = "Failed to make tempfile: ";
+            failmsg += strerror(errno);
+            throw std::runtime_error(failmsg);
+        }
+        m_filename = ftemplate;
+        m_expected.clear();
+    }
+    void tearDown() {
+        close(m_fd);
+        unlink(m_filename.c_str());
+    }
+private:
+    void writeItems(const void* pData, size_t nBytes);
+    void writeEvents(
+        std::uint64_t first, unsigned n, bool compress, bool pack = false
+    );
+    void writePassthrough();
+    std::vector<std::uint8_t> readAll(CDataReader& reader, size_t maxbytes);
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(inflatingreadertest);
+
+/**
+ * writeItems
+ *    Write data to the file.
+ */
+void
+inflatingreadertest::writeItems(const void* pData, size_t nBytes)
+{
+    if (write(m_fd, pData, nBytes) != ssize_t(nBytes)) {
+        throw std::runtime_error("Failed to write test file");
+    }
+}
+/**
+ * writeEvents
+ *    Write n events with consecutive triggers, as PARAMETER_DATA items or
+ *    compressed and/or packed (as uint16s, which holds them exactly).
+ *    The items are added to what we expect to read back.
+ */
+void
+inflatingreadertest::writeEvents(
+    std::uint64_t first, unsigned n, bool compress, bool pack
+)
+{
+    CParameterBatch batch(n, 1024*1024);
+    for (unsigned i = 0; i < n; i++) {
+        std::vector<std::pair<unsigned, double>> event;
+        for (unsigned p = 0; p < 10; p++) {
+            event.push_back({p, double(first + i + p)});
+        }
+        batch.addEvent(event, first + i);
+    }
+    const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(batch.data());
+    m_expected.insert(m_expected.end(), p, p + batch.size());
+    
+    const void* pData = batch.data();
+    size_t nBytes = batch.size();
+    CParameterPacker packer(std::vector<std::uint32_t>(10, VALUE_UINT16));
+    if (pack) {
+        packer.add(pData, nBytes);
+        pData  = packer.data();
+        nBytes = packer.size();
+    }
+    CParameterCompressor c;
+    if (compress) {
+        c.add(pData, nBytes);
+        pData  = c.data();
+        nBytes = c.size();
+    }
+    writeItems(pData, nBytes);
+}
+/**
+ * writePassthrough
+ *    Write a small non parameter item.
+ */
+void
+inflatingreadertest::writePassthrough()
+{
+    std::uint8_t item[100];
+    RingItemHeader* pHeader = reinterpret_cast<RingItemHeader*>(item);
+    pHeader->s_size   = sizeof(item);
+    pHeader->s_type   = 1;
+    pHeader->s_unused = sizeof(std::uint32_t);
+    for (size_t i = sizeof(RingItemHeader); i < sizeof(item); i++) {
+        item[i] = i;
+    }
+    writeItems(item, sizeof(item));
+    m_expected.insert(m_expected.end(), item, item + sizeof(item));
+}
+/**
+ * readAll
+ *    Read everything from a reader checking that the blocks are whole
+ *    items that fit in maxbytes (unless they're a single item).
+ */
+std::vector<std::uint8_t>
+inflatingreadertest::readAll(CDataReader& reader, size_t maxbytes)
+{
+    std::vector<std::uint8_t> result;
+    while (1) {
+        auto block = reader.getBlock(maxbytes);
+        if (!block.s_nbytes) {
+            reader.done();
+            break;
+        }
+        ASSERT(block.s_nItems > 0);
+        ASSERT((block.s_nbytes <= maxbytes) || (block.s_nItems == 1));
+        const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(block.s_pData);
+        size_t nBytes = 0;
+        for (size_t i = 0; i < block.s_nItems; i++) {
+            const RingItemHeader* pHeader =
+                reinterpret_cast<const RingItemHeader*>(p + nBytes);
+            ASSERT(pHeader->s_type != COMPRESSED_PARAMETERS);
+            ASSERT(pHeader->s_type != PACKED_PARAMETER_DATA);
+            nBytes += pHeader->s_size;
+        }
+        EQ(block.s_nbytes, nBytes);
+        result.insert(result.end(), p, p + nBytes);
+        reader.done();
+    }
+    return result;
+}
+
+// A file without frames reads as it would without us.
+void inflatingreadertest::get_1()
+{
+    writePassthrough();
+    writeEvents(0, 100, false);
+    writePassthrough();
+    
+    CInflatingDataReader reader(new CMappedDataReader(m_filename.c_str()));
+    ASSERT(!reader.blocksPersist());
+    ASSERT(m_expected == readAll(reader, 1024*1024));
+}
+// Frames are replaced by their events.
+void inflatingreadertest::get_2()
+{
+    writePassthrough();
+    writeEvents(0, 100, true);
+    writeEvents(100, 10, false);
+    writeEvents(110, 50, true);
+    writePassthrough();
+    
+    CInflatingDataReader reader(new CMappedDataReader(m_filename.c_str()));
+    ASSERT(m_expected == readAll(reader, 1024*1024));
+}
+// The expanded data are handed out in pieces no bigger than maxbytes.
+void inflatingreadertest::get_3()
+{
+    writeEvents(0, 100, true);
+    writePassthrough();
+    writeEvents(100, 100, true);
+    
+    size_t eventSize = sizeof(ParameterItem) + 10*sizeof(ParameterValue);
+    CInflatingDataReader reader(new CMappedDataReader(m_filename.c_str()));
+    ASSERT(m_expected == readAll(reader, 25*eventSize + 1));   // > a frame.
+}
+// An inflated item bigger than maxbytes is still handed out.
+void inflatingreadertest::get_4()
+{
+    CParameterBatch batch;
+    std::vector<std::pair<unsigned, double>> event;
+    for (unsigned p = 0; p < 1000; p++) {
+        event.push_back({p, 1.0});
+    }
+    batch.addEvent(event, 0);
+    batch.addEvent(event, 1);
+    CParameterCompressor c;
+    c.add(batch.data(), batch.size());
+    writeItems(c.data(), c.size());
+    const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(batch.data());
+    m_expected.insert(m_expected.end(), p, p + batch.size());
+    
+    CInflatingDataReader reader(new CMappedDataReader(m_filename.c_str()));
+    ASSERT(m_expected == readAll(reader, c.size()));
+}
+// Packed items are widened whether or not they're in frames.
+void inflatingreadertest::packed_1()
+{
+    writePassthrough();
+    writeEvents(0, 100, false, true);
+    writeEvents(100, 10, false);
+    writeEvents(110, 50, true, true);
+    writeEvents(160, 50, true);
+    writePassthrough();
+    
+    CInflatingDataReader reader(new CMappedDataReader(m_filename.c_str()));
+    ASSERT(m_expected == readAll(reader, 1024*1024));
+}
+// Widened items are bigger than the packed ones they came from but are
+// still handed out in pieces no bigger than maxbytes.
+void inflatingreadertest::packed_2()
+{
+    writeEvents(0, 100, false, true);
+    
+    size_t eventSize = sizeof(ParameterItem) + 10*sizeof(ParameterValue);
+    CInflatingDataReader reader(new CMappedDataReader(m_filename.c_str()));
+    ASSERT(m_expected == readAll(reader, 25*eventSize));
+}
+// done must follow a getBlock.
+void inflatingreadertest::baddone()
+{
+    writeEvents(0, 10, true);
+    CInflatingDataReader reader(new CMappedDataReader(m_filename.c_str()));
+    EXCEPTION(reader.done(), std::logic_error);
+    reader.getBlock(1024);
+    reader.done();
+    EXCEPTION(reader.done(), std::logic_error);
+}
+// getBlock can't be called until the last block is done.
+void inflatingreadertest::badget()
+{
+    writeEvents(0, 10, true);
+    CInflatingDataReader reader(new CMappedDataReader(m_filename.c_str()));
+    reader.getBlock(1024);
+    EXCEPTION(reader.getBlock(1024), std::logic_error);
+}
+// A corrupt frame throws.
+void inflatingreadertest::corrupt()
+{
+    CParameterBatch batch;
+    std::vector<std::pair<unsigned, double>> event = {{1, 1.0}};
+    batch.addEvent(event, 0);
+    CParameterCompressor c;
+    c.add(batch.data(), batch.size());
+    std::vector<std::uint8_t> frame(
+        reinterpret_cast<const std::uint8_t*>(c.data()),
+        reinterpret_cast<const std::uint8_t*>(c.data()) + c.size()
+    );
+    reinterpret_cast<pCompressedParameters>(frame.data())->s_uncompressedSize++;
+    writeItems(frame.data(), frame.size());
+    
+    CInflatingDataReader reader(new CMappedDataReader(m_filename.c_str()));
+    EXCEPTION(reader.getBlock(1024), std::runtime_error);
+}
@@ -0,0 +1,384 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  mappedreadertests.cpp
+ *  @brief: Tests the CMappedDataReader class.
+ */
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/Asserter.h>
+#include "Asserts.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdexcept>
+#include <string>
+#include <string.h>
+
+#define private public
+#include "MappedDataReader.h"
+#undef private
+
+using namespace frib::analysis;
+
+static const char* templateFilename="testXXXXXX.dat";
+
+class mappedreadertest : public CppUnit::TestFixture {
+    CPPUNIT_TEST_SUITE(mappedreadertest);
+    CPPUNIT_TEST(construct_1);
+    CPPUNIT_TEST(construct_2);
+    CPPUNIT_TEST(construct_3);
+    CPPUNIT_TEST(mappable);
+    
+    CPPUNIT_TEST(get_1);
+    CPPUNIT_TEST(get_2);
+    CPPUNIT_TEST(get_3);
+    CPPUNIT_TEST(get_4);
+    CPPUNIT_TEST(get_5);
+    CPPUNIT_TEST(get_6);
+    CPPUNIT_TEST(get_7);
+    CPPUNIT_TEST(get_8);
+    CPPUNIT_TEST(get_9);
+    
+    CPPUNIT_TEST(baddone);
+    CPPUNIT_TEST(release);
+    CPPUNIT_TEST(persist);
+    CPPUNIT_TEST_SUITE_END();
+protected:
+    void construct_1();
+    void construct_2();
+    void construct_3();
+    void mappable();
+    
+    void get_1();
+    void get_2();
+    void get_3();
+    void get_4();
+    void get_5();
+    void get_6();
+    void get_7();
+    void get_8();
+    void get_9();
+    
+    void baddone();
+    void release();
+    void persist();
+private:
+    int m_fd;
+    std::string m_filename;
+public:
+    void setUp() {
+        char ftemplate[100];
+        strncpy(ftemplate, templateFilename, sizeof(ftemplate));
+        m_fd = mkstemps(ftemplate, 4);     // 4 '.dat'
+        if (m_fd < 0) {
+            std::string failmsg = "Failed to make tempfile: ";
+            failmsg += strerror(errno);
+            throw std::runtime_error(failmsg);
+        }
+        m_filename = ftemplate;
+    }
+    void tearDown() {
+        close(m_fd);      // Might have been closed in test so don't check status
+        unlink(m_filename.c_str());
+    }
+private:
+    void writeCountPattern(std::uint32_t nBytes, std::uint8_t start, std::uint8_t incr);
+    void checkCountPattern(
+        const void* pItem, std::uint32_t nBytes, std::uint8_t start, std::uint8_t incr
+    );
+};
+
+/**
+ * writeCountPattern
+ *   Write a ring item with a payload that consists of a byte sized counting
+ *   pattern:
+ *
+ * @param nBytes - total number of bytes -inluding self.
+ * @param start  - Initial value of couting pattern.
+ * @param incr   - increment between items.
+ */
+void
+mappedreadertest::writeCountPattern(
+    std::uint32_t nBytes, std::uint8_t start, std::uint8_t incr
+) {
+    std::string item(reinterpret_cast<const char*>(&nBytes), sizeof(nBytes));
+    for (int i = sizeof(std::uint32_t); i < nBytes; i++) {
+        item.push_back(start);
+        start += incr;
+    }
+    write(m_fd, item.data(), item.size());
+}
+/**
+ * checkCountPattern
+ *    Check that an item has the size and counting pattern expected.
+ */
+void
+mappedreadertest::checkCountPattern(
+    const void* pItem, std::uint32_t nBytes, std::uint8_t start, std::uint8_t incr
+) {
+    const std::uint32_t* pSize = reinterpret_cast<const std::uint32_t*>(pItem);
+    EQ(nBytes, *pSize);
+    const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(pSize + 1);
+    for (int i = sizeof(std::uint32_t); i < nBytes; i++) {
+        EQ(int(start), int(*p));
+        start += incr;
+        p++;
+    }
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(mappedreadertest);
+
+// Construct on empty file by name - immediate eof:
+
+void mappedreadertest::construct_1()
+{
+    CMappedDataReader d(m_filename.c_str());
+    ASSERT(!d.m_pMapping);
+    EQ(size_t(0), d.m_nFileSize);
+    auto r = d.getBlock(1024);
+    EQ(size_t(0), r.s_nbytes);
+    EQ(size_t(0), r.s_nItems);
+    ASSERT(!r.s_pData);
+}
+// Construct by fd starts at the file position:
+
+void mappedreadertest::construct_2()
+{
+    writeCountPattern(100, 0, 1);
+    writeCountPattern(50, 0, 2);
+    lseek(m_fd, 100, SEEK_SET);
+    
+    CMappedDataReader d(m_fd);
+    EQ(m_fd, d.m_nFd);
+    EQ(size_t(150), d.m_nFileSize);
+    EQ(size_t(100), d.m_nCursor);
+    
+    auto r = d.getBlock(1024);
+    EQ(size_t(50), r.s_nbytes);
+    EQ(size_t(1), r.s_nItems);
+    checkCountPattern(r.s_pData, 50, 0, 2);
+    m_fd = -1;                   // d closes it.
+}
+// Nonexistent file throws:
+
+void mappedreadertest::construct_3()
+{
+    std::string name = m_filename;
+    name += ".nosuch";
+    CPPUNIT_ASSERT_THROW(
+        CMappedDataReader d(name.c_str()), std::runtime_error
+    );
+}
+// Only regular files are mappable:
+
+void mappedreadertest::mappable()
+{
+    ASSERT(CMappedDataReader::isMappable(m_filename.c_str()));
+    ASSERT(!CMappedDataReader::isMappable("/dev/null"));
+    std::string name = m_filename;
+    name += ".nosuch";
+    ASSERT(!CMappedDataReader::isMappable(name.c_str()));
+}
+// Single ring item comes directly from the mapping:
+
+void mappedreadertest::get_1()
+{
+    writeCountPattern(100, 0, 1);
+    CMappedDataReader d(m_filename.c_str());
+    
+    auto r = d.getBlock(1024);
+    EQ(size_t(100), r.s_nbytes);
+    EQ(size_t(1), r.s_nItems);
+    EQ(reinterpret_cast<const void*>(d.m_pMapping), r.s_pData);
+    checkCountPattern(r.s_pData, 100, 0, 1);
+}
+// get without done is a logic error:
+
+void mappedreadertest::get_2()
+{
+    writeCountPattern(100, 0, 1);
+    CMappedDataReader d(m_filename.c_str());
+    auto r = d.getBlock(1024);
+    CPPUNIT_ASSERT_THROW(d.getBlock(1024), std::logic_error);
+}
+// get after done gives eof:
+
+void mappedreadertest::get_3()
+{
+    writeCountPattern(100, 0, 1);
+    CMappedDataReader d(m_filename.c_str());
+    auto r = d.getBlock(1024);
+    d.done();
+    CPPUNIT_ASSERT_NO_THROW(r = d.getBlock(1024));
+    EQ(size_t(0), r.s_nbytes);
+    EQ(size_t(0), r.s_nItems);
+    ASSERT(!r.s_pData);
+}
+// Two items in one get:
+
+void mappedreadertest::get_4()
+{
+    writeCountPattern(100, 0, 1);
+    writeCountPattern(50, 0, 2);
+    CMappedDataReader d(m_filename.c_str());
+    
+    auto r = d.getBlock(1024);
+    EQ(size_t(150), r.s_nbytes);
+    EQ(size_t(2), r.s_nItems);
+    checkCountPattern(r.s_pData, 100, 0, 1);
+    checkCountPattern(
+        reinterpret_cast<const std::uint8_t*>(r.s_pData) + 100, 50, 0, 2
+    );
+}
+// Two gets - second block follows the first in the mapping:
+
+void mappedreadertest::get_5()
+{
+    writeCountPattern(100, 0, 1);
+    writeCountPattern(50, 0, 2);
+    CMappedDataReader d(m_filename.c_str());
+    
+    auto r = d.getBlock(110);
+    EQ(size_t(100), r.s_nbytes);
+    EQ(size_t(1), r.s_nItems);
+    const std::uint8_t* pFirst = reinterpret_cast<const std::uint8_t*>(r.s_pData);
+    d.done();
+    
+    r = d.getBlock(110);
+    EQ(size_t(50), r.s_nbytes);
+    EQ(size_t(1), r.s_nItems);
+    EQ(reinterpret_cast<const void*>(pFirst + 100), r.s_pData);
+    checkCountPattern(r.s_pData, 50, 0, 2);
+    d.done();
+    
+    r = d.getBlock(110);
+    ASSERT(!r.s_pData);
+}
+// Item won't fit in user request:
+
+void mappedreadertest::get_6()
+{
+    writeCountPattern(100, 0, 1);
+    CMappedDataReader d(m_filename.c_str());
+    CPPUNIT_ASSERT_THROW(d.getBlock(50), std::logic_error);
+}
+// File ends in a partial item:
+
+void mappedreadertest::get_7()
+{
+    writeCountPattern(100, 0, 1);
+    std::uint32_t size = 100;
+    write(m_fd, &size, sizeof(size));           // Truncated item.
+    CMappedDataReader d(m_filename.c_str());
+    
+    auto r = d.getBlock(1024);                  // Just the good one:
+    EQ(size_t(100), r.s_nbytes);
+    EQ(size_t(1), r.s_nItems);
+    d.done();
+    CPPUNIT_ASSERT_THROW(d.getBlock(1024), std::logic_error);
+}
+// File ends with a fragment that isn't even a size:
+
+void mappedreadertest::get_8()
+{
+    writeCountPattern(100, 0, 1);
+    std::uint8_t junk = 0;
+    write(m_fd, &junk, sizeof(junk));
+    CMappedDataReader d(m_filename.c_str());
+    
+    auto r = d.getBlock(1024);
+    EQ(size_t(100), r.s_nbytes);
+    d.done();
+    CPPUNIT_ASSERT_THROW(d.getBlock(1024), std::logic_error);
+}
+// Lots of items, make sure we get them all in order:
+
+void mappedreadertest::get_9()
+{
+    for (int i = 0; i < 1000; i++) {
+        writeCountPattern(10 + (i % 100), i, 1);
+    }
+    CMappedDataReader d(m_filename.c_str());
+    int n = 0;
+    while (1) {
+        auto r = d.getBlock(1000);
+        if (!r.s_pData) break;
+        const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(r.s_pData);
+        for (int i = 0; i < r.s_nItems; i++) {
+            checkCountPattern(p, 10 + (n % 100), n, 1);
+            p += 10 + (n % 100);
+            n++;
+        }
+        d.done();
+    }
+    EQ(1000, n);
+}
+// done when released is a logic error:
+
+void mappedreadertest::baddone()
+{
+    CMappedDataReader d(m_filename.c_str());
+    CPPUNIT_ASSERT_THROW(d.done(), std::logic_error);
+}
+// Pages behind the cursor get released as we go:
+
+void mappedreadertest::release()
+{
+    for (int i = 0; i < 4000; i++) {
+        writeCountPattern(8192, i, 1);        // ~32MB.
+    }
+    CMappedDataReader d(m_filename.c_str());
+    int n = 0;
+    while (1) {
+        auto r = d.getBlock(1024*1024);
+        if (!r.s_pData) break;
+        n += r.s_nItems;
+        d.done();
+        ASSERT(d.m_nReleased <= d.m_nCursor);
+    }
+    EQ(4000, n);
+    ASSERT(d.m_nReleased > 0);
+    ASSERT((d.m_nFileSize - d.m_nReleased) < 16*1024*1024);
+}
+// Blocks stay valid after done() -- even once their pages are released.
+
+void mappedreadertest::persist()
+{
+    for (int i = 0; i < 4000; i++) {
+        writeCountPattern(8192, i, 1);        // ~32MB.
+    }
+    CMappedDataReader d(m_filename.c_str());
+    ASSERT(d.blocksPersist());
+    
+    auto first = d.getBlock(1024*1024);
+    d.done();
+    while (1) {
+        auto r = d.getBlock(1024*1024);
+        if (!r.s_pData) break;
+        d.done();
+    }
+    ASSERT(d.m_nReleased > 0);
+    
+    const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(first.s_pData);
+    for (int i = 0; i < first.s_nItems; i++) {
+        checkCountPattern(p, 8192, i, 1);
+        p += 8192;
+    }
+}
@@ -0,0 +1,197 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+
+/** @file:  namedictionarytests.cpp
+ *  @brief: Tests of CNameDictionary.
+ */
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/Asserter.h>
+#include "Asserts.h"
+
+#include "NameDictionary.h"
+#include <string>
+#include <vector>
+#include <sstream>
+
+using namespace frib::analysis;
+
+// Counts constructions so we can tell when items are made.
+
+struct Counted {
+    static unsigned s_constructed;
+    int s_value;
+    Counted() : s_value(0) { s_constructed++; }
+    Counted(int value) : s_value(value) { s_constructed++; }
+};
+unsigned Counted::s_constructed(0);
+
+class namedicttest : public CppUnit::TestFixture {
+    CPPUNIT_TEST_SUITE(namedicttest);
+    CPPUNIT_TEST(empty_1);
+    CPPUNIT_TEST(emplace_1);
+    CPPUNIT_TEST(emplace_2);
+    CPPUNIT_TEST(find_1);
+    CPPUNIT_TEST(index_1);
+    CPPUNIT_TEST(iterate_1);
+    CPPUNIT_TEST(stable_1);
+    CPPUNIT_TEST(reserve_1);
+    CPPUNIT_TEST(clear_1);
+    CPPUNIT_TEST_SUITE_END();
+protected:
+    void empty_1();
+    void emplace_1();
+    void emplace_2();
+    void find_1();
+    void index_1();
+    void iterate_1();
+    void stable_1();
+    void reserve_1();
+    void clear_1();
+public:
+    void setUp() {
+        Counted::s_constructed = 0;
+    }
+    void tearDown() {}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(namedicttest);
+
+static std::string
+itemName(unsigned i)
+{
+    std::stringstream s;
+    s << "array." << i;
+    return s.str();
+}
+
+// A new dictionary is empty.
+
+void namedicttest::empty_1()
+{
+    CNameDictionary<int> d;
+    ASSERT(d.empty());
+    EQ(size_t(0), d.size());
+    ASSERT(d.begin() == d.end());
+    ASSERT(d.find("nothing") == d.end());
+    EQ(size_t(0), d.count("nothing"));
+}
+// Emplacing a new name adds it.
+
+void namedicttest::emplace_1()
+{
+    CNameDictionary<Counted> d;
+    auto result = d.emplace("a", 12);
+    ASSERT(result.second);
+    EQ(std::string("a"), result.first->first);
+    EQ(12, result.first->second.s_value);
+    EQ(size_t(1), d.size());
+    EQ(size_t(1), d.count("a"));
+}
+// Emplacing an existing name does not replace or construct.
+
+void namedicttest::emplace_2()
+{
+    CNameDictionary<Counted> d;
+    d.emplace("a", 12);
+    auto result = d.emplace("a", 13);
+    ASSERT(!result.second);
+    EQ(12, result.first->second.s_value);
+    EQ(size_t(1), d.size());
+    EQ(unsigned(1), Counted::s_constructed);
+}
+// Find gets the right one amongst many.
+
+void namedicttest::find_1()
+{
+    CNameDictionary<unsigned> d;
+    for (unsigned i = 0; i < 1000; i++) {
+        d.emplace(itemName(i), i);
+    }
+    for (unsigned i = 0; i < 1000; i++) {
+        auto p = d.find(itemName(i));
+        ASSERT(p != d.end());
+        EQ(itemName(i), p->first);
+        EQ(i, p->second);
+    }
+    ASSERT(d.find(itemName(1000)) == d.end());
+}
+// operator[] default constructs missing items.
+
+void namedicttest::index_1()
+{
+    CNameDictionary<int> d;
+    d["a"] = 5;
+    EQ(5, d["a"]);
+    EQ(0, d["b"]);
+    EQ(size_t(2), d.size());
+}
+// Iteration is in the order items were added.
+
+void namedicttest::iterate_1()
+{
+    CNameDictionary<int> d;
+    std::vector<std::string> names = {"z", "a", "m", "b"};
+    for (auto& name : names) {
+        d.emplace(name, 1);
+    }
+    unsigned i = 0;
+    for (auto& item : d) {
+        EQ(names[i], item.first);
+        i++;
+    }
+    EQ(unsigned(names.size()), i);
+}
+// Items don't move as the dictionary grows.
+
+void namedicttest::stable_1()
+{
+    CNameDictionary<unsigned> d;
+    std::vector<unsigned*> addresses;
+    for (unsigned i = 0; i < 10000; i++) {
+        addresses.push_back(&(d.emplace(itemName(i), i).first->second));
+    }
+    for (unsigned i = 0; i < 10000; i++) {
+        EQ(addresses[i], &(d.find(itemName(i))->second));
+    }
+}
+// Reserving doesn't change the contents.
+
+void namedicttest::reserve_1()
+{
+    CNameDictionary<unsigned> d;
+    d.emplace("a", 1);
+    d.reserve(100000);
+    EQ(size_t(1), d.size());
+    EQ(unsigned(1), d.find("a")->second);
+    d.emplace("b", 2);
+    EQ(unsigned(2), d.find("b")->second);
+}
+// Clear empties it and it can be reused.
+
+void namedicttest::clear_1()
+{
+    CNameDictionary<unsigned> d;
+    for (unsigned i = 0; i < 100; i++) {
+        d.emplace(itemName(i), i);
+    }
+    d.clear();
+    ASSERT(d.empty());
+    ASSERT(d.find(itemName(1)) == d.end());
+    d.emplace(itemName(1), 7);
+    EQ(unsigned(7), d.find(itemName(1))->second);
+}
@@ -0,0 +1,331 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+/** @file:  packertests.cpp
+ *  @brief: Tests of CParameterPacker
+ */
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/Asserter.h>
+#include "Asserts.h"
+#include "ParameterPacker.h"
+#include "ParameterCompressor.h"
+#include "ParameterBatch.h"
+#include <vector>
+#include <utility>
+#include <stdexcept>
+#include <cstdint>
+#include <cmath>
+#include <string.h>
+
+using namespace frib::analysis;
+
+class packertest : public CppUnit::TestFixture {
+    CPPUNIT_TEST_SUITE(packertest);
+    CPPUNIT_TEST(packs_1);
+    
+    CPPUNIT_TEST(add_1);
+    CPPUNIT_TEST(add_2);
+    CPPUNIT_TEST(add_3);
+    CPPUNIT_TEST(add_4);
+    CPPUNIT_TEST(add_5);
+    
+    CPPUNIT_TEST(widen_1);
+    CPPUNIT_TEST(widen_2);
+    CPPUNIT_TEST(widen_3);
+    
+    CPPUNIT_TEST(validate_1);
+    CPPUNIT_TEST(compress_1);
+    CPPUNIT_TEST_SUITE_END();
+    
+private:
+    CParameterPacker* m_pPacker;
+    CParameterBatch*  m_pBatch;
+public:
+    void setUp() {
+        // Parameters 0-3 are double, float32, uint16, uint32; the rest
+        // are double by default.
+        
+        m_pPacker = new CParameterPacker(
+            {VALUE_DOUBLE, VALUE_FLOAT32, VALUE_UINT16, VALUE_UINT32}
+        );
+        m_pBatch  = new CParameterBatch(1000, 16*1024*1024);
+    }
+    void tearDown() {
+        delete m_pPacker;
+        delete m_pBatch;
+    }
+protected:
+    void packs_1();
+    
+    void add_1();
+    void add_2();
+    void add_3();
+    void add_4();
+    void add_5();
+    
+    void widen_1();
+    void widen_2();
+    void widen_3();
+    
+    void validate_1();
+    void compress_1();
+private:
+    void addEvent(std::uint64_t trigger, double value);
+    std::vector<std::uint8_t> widened();
+    std::vector<const PackedParameterItem*> items();
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(packertest);
+
+/**
+ * addEvent
+ *   Add an event to m_pBatch that sets parameters 0-4 to value.
+ */
+void
+packertest::addEvent(std::uint64_t trigger, double value)
+{
+    std::vector<std::pair<unsigned, double>> event;
+    for (unsigned p = 0; p < 5; p++) {
+        event.push_back({p, value});
+    }
+    m_pBatch->addEvent(event, trigger);
+}
+/**
+ * widened
+ *   @return the items m_pPacker holds, widened.
+ */
+std::vector<std::uint8_t>
+packertest::widened()
+{
+    std::vector<std::uint8_t> result;
+    for (auto pItem : items()) {
+        CParameterPacker::widen(pItem, result);
+    }
+    return result;
+}
+/**
+ * items
+ *   @return the packed items m_pPacker holds.
+ */
+std::vector<const PackedParameterItem*>
+packertest::items()
+{
+    std::vector<const PackedParameterItem*> result;
+    const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(m_pPacker->data());
+    const std::uint8_t* pEnd = p + m_pPacker->size();
+    while (p < pEnd) {
+        auto pItem = reinterpret_cast<const PackedParameterItem*>(p);
+        result.push_back(pItem);
+        p += pItem->s_header.s_size;
+    }
+    return result;
+}
+
+// Only non double storage types are worth packing.
+void packertest::packs_1()
+{
+    ASSERT(!CParameterPacker::packs({}));
+    ASSERT(!CParameterPacker::packs({VALUE_DOUBLE, VALUE_DOUBLE}));
+    ASSERT(CParameterPacker::packs({VALUE_DOUBLE, VALUE_UINT16}));
+    ASSERT(m_pPacker->empty());
+    EQ(size_t(0), m_pPacker->size());
+}
+// Integral values are stored in the parameter's type and the header
+// is that of a parameter item.
+void packertest::add_1()
+{
+    addEvent(100, 1234.0);
+    m_pPacker->add(m_pBatch->data(), m_pBatch->size());
+    
+    auto i = items();
+    EQ(size_t(1), i.size());
+    EQ(std::uint32_t(PACKED_PARAMETER_DATA), i[0]->s_header.s_type);
+    EQ(std::uint32_t(sizeof(std::uint32_t)), i[0]->s_header.s_unused);
+    EQ(std::uint32_t(m_pPacker->size()), i[0]->s_header.s_size);
+    EQ(std::uint64_t(100), i[0]->s_triggerCount);
+    EQ(std::uint32_t(5), i[0]->s_parameterCount);
+    
+    // 5 tags + double + float + uint16 + uint32 + double.
+    
+    size_t body = 5*sizeof(std::uint32_t) + 2*sizeof(double) + sizeof(float) +
+        sizeof(std::uint16_t) + sizeof(std::uint32_t);
+    EQ(sizeof(PackedParameterItem) + body, m_pPacker->size());
+    
+    std::uint32_t tag;
+    memcpy(&tag, i[0]->s_data + sizeof(std::uint32_t) + sizeof(double), sizeof(tag));
+    EQ(VALUE_FLOAT32, tag >> PACKED_TYPE_SHIFT);
+    EQ(std::uint32_t(1), tag & PACKED_NUMBER_MASK);
+}
+// Values an integer type can't hold stay doubles so they survive as is.
+void packertest::add_2()
+{
+    const double values[] = {-1.0, 1.5, 65536.0, 4294967296.0, -0.0, NAN};
+    std::uint64_t trigger = 0;
+    for (auto v : values) {
+        addEvent(trigger++, v);
+    }
+    m_pPacker->add(m_pBatch->data(), m_pBatch->size());
+    
+    auto wide = widened();
+    EQ(m_pBatch->size(), wide.size());
+    EQ(0, memcmp(m_pBatch->data(), wide.data(), wide.size()));
+    
+    // 65536 doesn't fit in 16 bits but does in 32:
+    
+    const PackedParameterItem* pItem = items()[2];
+    std::uint32_t tag;
+    const std::uint8_t* p = pItem->s_data + 2*sizeof(std::uint32_t) +
+        sizeof(double) + sizeof(float);
+    memcpy(&tag, p, sizeof(tag));
+    EQ(VALUE_DOUBLE, tag >> PACKED_TYPE_SHIFT);
+    p += sizeof(tag) + sizeof(double);
+    memcpy(&tag, p, sizeof(tag));
+    EQ(VALUE_UINT32, tag >> PACKED_TYPE_SHIFT);
+}
+// float32 rounds, but values too big for a float stay doubles.
+void packertest::add_3()
+{
+    addEvent(0, 0.1);
+    addEvent(1, 1.0e300);
+    m_pPacker->add(m_pBatch->data(), m_pBatch->size());
+    
+    auto wide = widened();
+    EQ(m_pBatch->size(), wide.size());
+    const ParameterItem* pFirst = reinterpret_cast<const ParameterItem*>(wide.data());
+    const ParameterItem* pSecond = reinterpret_cast<const ParameterItem*>(
+        wide.data() + pFirst->s_header.s_size
+    );
+    EQ(0.1, pFirst->s_parameters[0].s_value);
+    EQ(double(float(0.1)), pFirst->s_parameters[1].s_value);
+    EQ(1.0e300, pSecond->s_parameters[1].s_value);
+}
+// Items accumulate over adds until cleared and order is kept.
+void packertest::add_4()
+{
+    addEvent(5, 1.0);
+    addEvent(3, 2.0);
+    m_pPacker->add(m_pBatch->data(), m_pBatch->size());
+    m_pPacker->add(m_pBatch->data(), m_pBatch->size());
+    auto i = items();
+    EQ(size_t(4), i.size());
+    EQ(std::uint64_t(5), i[0]->s_triggerCount);
+    EQ(std::uint64_t(3), i[1]->s_triggerCount);
+    EQ(std::uint64_t(5), i[2]->s_triggerCount);
+    
+    m_pPacker->clear();
+    ASSERT(m_pPacker->empty());
+}
+// Only whole PARAMETER_DATA items with packable numbers can be packed.
+void packertest::add_5()
+{
+    addEvent(0, 1.0);
+    EXCEPTION(
+        m_pPacker->add(m_pBatch->data(), m_pBatch->size() - 1),
+        std::logic_error
+    );
+    std::vector<std::uint8_t> item(m_pBatch->size());
+    memcpy(item.data(), m_pBatch->data(), item.size());
+    pParameterItem pItem = reinterpret_cast<pParameterItem>(item.data());
+    pItem->s_header.s_type = PACKED_PARAMETER_DATA;
+    EXCEPTION(m_pPacker->add(item.data(), item.size()), std::logic_error);
+    pItem->s_header.s_type = PARAMETER_DATA;
+    pItem->s_parameters[4].s_number = PACKED_NUMBER_MASK + 1;
+    EXCEPTION(m_pPacker->add(item.data(), item.size()), std::logic_error);
+    ASSERT(m_pPacker->empty());
+}
+// Widening gives back the original items when nothing was rounded.
+void packertest::widen_1()
+{
+    for (unsigned i = 0; i < 20; i++) {
+        addEvent(i, i*3);
+    }
+    m_pPacker->add(m_pBatch->data(), m_pBatch->size());
+    ASSERT(m_pPacker->size() < m_pBatch->size());
+    
+    auto wide = widened();
+    EQ(m_pBatch->size(), wide.size());
+    EQ(0, memcmp(m_pBatch->data(), wide.data(), wide.size()));
+}
+// Corrupt items throw and leave the output as it was.
+void packertest::widen_2()
+{
+    addEvent(0, 1.0);
+    m_pPacker->add(m_pBatch->data(), m_pBatch->size());
+    std::vector<std::uint8_t> item(m_pPacker->size());
+    memcpy(item.data(), m_pPacker->data(), item.size());
+    pPackedParameterItem pItem = reinterpret_cast<pPackedParameterItem>(item.data());
+    std::vector<std::uint8_t> out(3);
+    
+    pItem->s_parameterCount = 6;                // Runs off the end.
+    EXCEPTION(CParameterPacker::widen(pItem, out), std::runtime_error);
+    pItem->s_parameterCount = 1000000;          // Can't possibly fit.
+    EXCEPTION(CParameterPacker::widen(pItem, out), std::runtime_error);
+    pItem->s_parameterCount = 4;                // Leaves trailing data.
+    EXCEPTION(CParameterPacker::widen(pItem, out), std::runtime_error);
+    pItem->s_parameterCount = 5;
+    pItem->s_data[3] = 0xf0;                    // Bad type tag.
+    EXCEPTION(CParameterPacker::widen(pItem, out), std::runtime_error);
+    pItem->s_data[3] = 0;
+    pItem->s_header.s_type = PARAMETER_DATA;
+    EXCEPTION(CParameterPacker::widen(pItem, out), std::runtime_error);
+    EQ(size_t(3), out.size());
+    
+    pItem->s_header.s_type = PACKED_PARAMETER_DATA;
+    CParameterPacker::widen(pItem, out);
+    EQ(size_t(3) + m_pBatch->size(), out.size());
+}
+// Parameters the packer knows nothing about are left doubles.
+void packertest::widen_3()
+{
+    std::vector<std::pair<unsigned, double>> event = {{1000, 7.0}, {2, 7.0}};
+    m_pBatch->addEvent(event, 0);
+    m_pPacker->add(m_pBatch->data(), m_pBatch->size());
+    EQ(
+        sizeof(PackedParameterItem) + 2*sizeof(std::uint32_t) +
+            sizeof(double) + sizeof(std::uint16_t),
+        m_pPacker->size()
+    );
+    auto wide = widened();
+    EQ(0, memcmp(m_pBatch->data(), wide.data(), wide.size()));
+}
+// Batches validate with packed items in them.
+void packertest::validate_1()
+{
+    addEvent(0, 1.0);
+    addEvent(1, 2.0);
+    m_pPacker->add(m_pBatch->data(), m_pBatch->size());
+    EQ(size_t(2), CParameterBatch::validate(m_pPacker->data(), m_pPacker->size()));
+}
+// Packed items can be compressed and come back packed.
+void packertest::compress_1()
+{
+    for (unsigned i = 0; i < 20; i++) {
+        addEvent(10 + i, i);
+    }
+    m_pPacker->add(m_pBatch->data(), m_pBatch->size());
+    CParameterCompressor compressor;
+    compressor.add(m_pPacker->data(), m_pPacker->size());
+    
+    auto pFrame = reinterpret_cast<const CompressedParameters*>(compressor.data());
+    EQ(compressor.size(), size_t(pFrame->s_header.s_size));
+    EQ(std::uint64_t(10), pFrame->s_firstTrigger);
+    EQ(std::uint32_t(20), pFrame->s_eventCount);
+    
+    std::vector<std::uint8_t> out;
+    compressor.decompress(pFrame, out);
+    EQ(m_pPacker->size(), out.size());
+    EQ(0, memcmp(m_pPacker->data(), out.data(), out.size()));
+}
@@ -0,0 +1,510 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+
+/** @file:  paramprojectiontests.cpp
+ *  @brief: Tests of dealer side projection of parameter data.
+ */
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/Asserter.h>
+#include "Asserts.h"
+
+#include "AbstractApplication.h"
+#include "MPIParameterDealer.h"
+#define private public
+#include "MPIParametersToParametersWorker.h"
+#undef private
+#include "MPIParameterFarmer.h"
+#include "MPIParameterOutput.h"
+#include "TreeParameter.h"
+#include "TreeParameterArray.h"
+#include "ParameterReader.h"
+#include "AnalysisRingItems.h"
+#include "TriggerIndex.h"
+#include "MappedDataReader.h"
+#include "Transport.h"
+#include <string>
+#include <vector>
+#include <set>
+#include <atomic>
+#include <stdexcept>
+#include <cstdint>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace frib::analysis;
+
+static const std::uint32_t BEGIN_RUN = 1;
+static const std::uint32_t END_RUN = 2;
+static const unsigned      NUM_EVENTS = 1000;
+static const unsigned      NUM_PARAMS = 16;     // projin.00 - projin.15 ids 1-16
+
+// The value of parameter id in an event:
+
+static double
+value(unsigned trigger, unsigned id)
+{
+    return trigger*100.0 + id;
+}
+
+// Tree parameters are made by the reader, before the role threads start.
+
+static CTreeParameterArray* pIn(nullptr);
+static CTreeParameter*      pSum(nullptr);
+
+class ProjectionReader : public CParameterReader {
+public:
+    ProjectionReader() : CParameterReader("/dev/null") {}
+    virtual void read() {
+        if (!pIn) {
+            pIn  = new CTreeParameterArray("projin", NUM_PARAMS, 0);
+            pSum = new CTreeParameter("projsum");
+        }
+    }
+};
+
+// A worker that only consumes projin.03 and projin.07 and sums them.
+
+class SumWorker : public CMPIParametersToParametersWorker {
+public:
+    SumWorker(int argc, char** argv, AbstractApplication* pApp) :
+        CMPIParametersToParametersWorker(argc, argv, pApp) {}
+    virtual void process() {
+        CTreeParameterArray& in(*pIn);
+        *pSum = in[3] + in[7];
+    }
+protected:
+    virtual bool consumesParameter(const std::string& name) {
+        return (name == "projin.03") || (name == "projin.07");
+    }
+};
+
+// Runs the parameter pipeline.  If m_pipeline is false, the workers are
+// stand-ins that report the ids in m_consumed (worker i gets
+// m_consumed[i % size]) and record what the dealer sends them.
+// m_first/m_count are the range of triggers to process.
+
+class ProjectionApplication : public AbstractApplication {
+public:
+    bool                               m_pipeline;
+    std::vector<std::set<std::uint32_t>> m_consumed;
+    std::atomic<unsigned>              m_nWorkersStarted;
+    std::atomic<unsigned>              m_nEvents;
+    std::atomic<unsigned>              m_nParameters;
+    std::uint64_t                      m_first;
+    std::uint64_t                      m_count;
+public:
+    ProjectionApplication(int argc, char** argv, bool pipeline) :
+        AbstractApplication(argc, argv), m_pipeline(pipeline),
+        m_nWorkersStarted(0), m_nEvents(0), m_nParameters(0),
+        m_first(0), m_count(ALL_TRIGGERS) {}
+    virtual std::uint64_t getFirstTrigger(int argc, char** argv) {
+        return m_first;
+    }
+    virtual std::uint64_t getTriggerCount(int argc, char** argv) {
+        return m_count;
+    }
+    virtual void dealer(int argc, char** argv, AbstractApplication* pApp) {
+        CMPIParameterDealer dealer(argc, argv, pApp);
+        dealer();
+    }
+    virtual void farmer(int argc, char** argv, AbstractApplication* pApp) {
+        if (m_pipeline) {
+            CMPIParameterFarmer farmer(argc, argv, *pApp);
+            farmer();
+        }
+    }
+    virtual void outputter(int argc, char** argv, AbstractApplication* pApp) {
+        if (m_pipeline) {
+            CMPIParameterOutput outputter;
+            outputter(argc, argv, pApp);
+        }
+    }
+    virtual void worker(int argc, char** argv, AbstractApplication* pApp) {
+        if (m_pipeline) {
+            SumWorker worker(argc, argv, pApp);
+            worker();
+        } else {
+            standIn(pApp);
+        }
+    }
+private:
+    void standIn(AbstractApplication* pApp);
+};
+
+// Receive the definitions, report the consumed ids and check that
+// each event only has consumed parameters with the right values.
+
+void
+ProjectionApplication::standIn(AbstractApplication* pApp)
+{
+    CTransport& transport(pApp->transport());
+    const std::set<std::uint32_t>& consumed(
+        m_consumed[m_nWorkersStarted++ % m_consumed.size()]
+    );
+    std::set<std::uint32_t> all;
+    for (const auto& ids : m_consumed) {
+        all.insert(ids.begin(), ids.end());
+    }
+    
+    std::uint32_t n;
+    transport.receiveBroadcast(
+        &n, 1, CTransport::UINT32, DEALER_RANK, FIRST_WORKER_RANK,
+        MPI_PARAMDEF_TAG
+    );
+    std::vector<FRIB_MPI_ParameterDef> defs(n);
+    transport.receiveBroadcast(
+        defs.data(), n, CTransport::PARAMETER_DEF, DEALER_RANK,
+        FIRST_WORKER_RANK, MPI_PARAMDEF_TAG
+    );
+    transport.receiveBroadcast(
+        &n, 1, CTransport::UINT32, DEALER_RANK, FIRST_WORKER_RANK,
+        MPI_VARIABLES_TAG
+    );
+    EQ(std::uint32_t(0), n);
+    
+    std::vector<std::uint32_t> ids(consumed.begin(), consumed.end());
+    n = ids.size();
+    transport.send(&n, 1, CTransport::UINT32, DEALER_RANK, MPI_PROJECTION_TAG);
+    if (n) {
+        transport.send(
+            ids.data(), n, CTransport::UINT32, DEALER_RANK, MPI_PROJECTION_TAG
+        );
+    }
+    
+    std::vector<std::uint8_t> block;
+    while (1) {
+        pApp->requestData(1024*1024);
+        FRIB_MPI_Message_Header hdr;
+        transport.recv(
+            &hdr, 1, CTransport::MESSAGE_HEADER, DEALER_RANK, MPI_HEADER_TAG
+        );
+        if (hdr.s_end) break;
+        block.resize(hdr.s_nBytes);
+        transport.recv(
+            block.data(), hdr.s_nBytes, CTransport::BYTES,
+            DEALER_RANK, MPI_DATA_TAG
+        );
+        std::size_t offset(0);
+        while (offset < block.size()) {
+            const ParameterItem* pItem =
+                reinterpret_cast<const ParameterItem*>(block.data() + offset);
+            EQ(PARAMETER_DATA, pItem->s_header.s_type);
+            EQ(
+                std::uint32_t(
+                    sizeof(ParameterItem) +
+                    pItem->s_parameterCount*sizeof(ParameterValue)
+                ),
+                pItem->s_header.s_size
+            );
+            for (std::uint32_t i = 0; i < pItem->s_parameterCount; i++) {
+                const ParameterValue& v(pItem->s_parameters[i]);
+                ASSERT(all.count(v.s_number));
+                EQ(value(pItem->s_triggerCount, v.s_number), v.s_value);
+            }
+            m_nEvents++;
+            m_nParameters += pItem->s_parameterCount;
+            offset += pItem->s_header.s_size;
+        }
+    }
+}
+
+class paramprojectiontest : public CppUnit::TestFixture {
+    CPPUNIT_TEST_SUITE(paramprojectiontest);
+    CPPUNIT_TEST(project_1);
+    CPPUNIT_TEST(project_2);
+    CPPUNIT_TEST(project_3);
+    CPPUNIT_TEST(pipeline_1);
+    CPPUNIT_TEST(range_1);
+    CPPUNIT_TEST(range_2);
+    CPPUNIT_TEST(malformed_1);
+    CPPUNIT_TEST_SUITE_END();
+protected:
+    void project_1();
+    void project_2();
+    void project_3();
+    void pipeline_1();
+    void range_1();
+    void range_2();
+    void malformed_1();
+private:
+    std::string        m_inFile;
+    std::string        m_outFile;
+    std::vector<char*> m_argv;
+public:
+    void setUp() {
+        char inName[]  = "/tmp/projinXXXXXX";
+        char outName[] = "/tmp/projoutXXXXXX";
+        int fd = mkstemp(inName);
+        close(fd);
+        fd = mkstemp(outName);
+        close(fd);
+        m_inFile = inName;
+        m_outFile = outName;
+        makeParameterFile();
+        
+        m_argv.clear();
+        m_argv.push_back(const_cast<char*>("threadtests"));
+        m_argv.push_back(const_cast<char*>(m_inFile.c_str()));
+        m_argv.push_back(const_cast<char*>(m_outFile.c_str()));
+        m_argv.push_back(nullptr);
+    }
+    void tearDown() {
+        unlink(m_inFile.c_str());
+        unlink(m_outFile.c_str());
+        unlink(CTriggerIndex::sidecarName(m_inFile.c_str()).c_str());
+    }
+private:
+    void makeParameterFile();
+    std::vector<std::uint8_t> readOutput();
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(paramprojectiontest);
+
+// Parameter definitions, (no) variables, a begin run, NUM_EVENTS events
+// each with all NUM_PARAMS parameters and an end run.
+
+void paramprojectiontest::makeParameterFile()
+{
+    int fd = open(m_inFile.c_str(), O_WRONLY | O_TRUNC);
+    ASSERT(fd >= 0);
+    
+    std::vector<std::uint8_t> item(sizeof(ParameterDefinitions));
+    for (unsigned id = 1; id <= NUM_PARAMS; id++) {
+        char name[MAX_IDENT];
+        sprintf(name, "projin.%02u", id - 1);
+        std::size_t offset = item.size();
+        item.resize(offset + sizeof(ParameterDefinition) + strlen(name) + 1);
+        ParameterDefinition* pDef =
+            reinterpret_cast<ParameterDefinition*>(item.data() + offset);
+        pDef->s_parameterNumber = id;
+        strcpy(pDef->s_parameterName, name);
+    }
+    ParameterDefinitions* pDefs =
+        reinterpret_cast<ParameterDefinitions*>(item.data());
+    pDefs->s_header.s_type = PARAMETER_DEFINITIONS;
+    pDefs->s_header.s_size = item.size();
+    pDefs->s_header.s_unused = sizeof(std::uint32_t);
+    pDefs->s_numParameters = NUM_PARAMS;
+    ASSERT(write(fd, item.data(), item.size()) == ssize_t(item.size()));
+    
+    VariableItem vars;
+    vars.s_header.s_type = VARIABLE_VALUES;
+    vars.s_header.s_size = sizeof(vars);
+    vars.s_header.s_unused = sizeof(std::uint32_t);
+    vars.s_numVars = 0;
+    ASSERT(write(fd, &vars, sizeof(vars)) == sizeof(vars));
+    
+    RingItemHeader hdr;
+    hdr.s_type = BEGIN_RUN;
+    hdr.s_size = sizeof(hdr);
+    hdr.s_unused = sizeof(std::uint32_t);
+    ASSERT(write(fd, &hdr, sizeof(hdr)) == sizeof(hdr));
+    
+    item.resize(sizeof(ParameterItem) + NUM_PARAMS*sizeof(ParameterValue));
+    ParameterItem* pEvent = reinterpret_cast<ParameterItem*>(item.data());
+    pEvent->s_header.s_type = PARAMETER_DATA;
+    pEvent->s_header.s_size = item.size();
+    pEvent->s_header.s_unused = sizeof(std::uint32_t);
+    pEvent->s_parameterCount = NUM_PARAMS;
+    for (unsigned i = 0; i < NUM_EVENTS; i++) {
+        pEvent->s_triggerCount = i;
+        for (unsigned p = 0; p < NUM_PARAMS; p++) {
+            pEvent->s_parameters[p].s_number = p + 1;
+            pEvent->s_parameters[p].s_value  = value(i, p + 1);
+        }
+        ASSERT(write(fd, item.data(), item.size()) == ssize_t(item.size()));
+    }
+    
+    hdr.s_type = END_RUN;
+    ASSERT(write(fd, &hdr, sizeof(hdr)) == sizeof(hdr));
+    close(fd);
+}
+std::vector<std::uint8_t>
+paramprojectiontest::readOutput()
+{
+    int fd = open(m_outFile.c_str(), O_RDONLY);
+    ASSERT(fd >= 0);
+    struct stat statbuf;
+    ASSERT(fstat(fd, &statbuf) >= 0);
+    std::vector<std::uint8_t> result(statbuf.st_size);
+    EQ(ssize_t(statbuf.st_size), read(fd, result.data(), statbuf.st_size));
+    close(fd);
+    return result;
+}
+
+// A worker that consumes everything gets the events unmodified.
+
+void paramprojectiontest::project_1()
+{
+    ProjectionReader reader;
+    ProjectionApplication app(m_argv.size() - 1, m_argv.data(), false);
+    std::set<std::uint32_t> all;
+    for (std::uint32_t id = 1; id <= NUM_PARAMS; id++) {
+        all.insert(id);
+    }
+    app.m_consumed.push_back(all);
+    app.runThreaded(reader, 1);
+    
+    EQ(NUM_EVENTS, unsigned(app.m_nEvents));
+    EQ(NUM_EVENTS*NUM_PARAMS, unsigned(app.m_nParameters));
+}
+// Workers get the union of what they consume and nothing else.
+
+void paramprojectiontest::project_2()
+{
+    ProjectionReader reader;
+    ProjectionApplication app(m_argv.size() - 1, m_argv.data(), false);
+    app.m_consumed.push_back({3, 7});
+    app.m_consumed.push_back({7, 12});
+    app.runThreaded(reader, 2);
+    
+    EQ(NUM_EVENTS, unsigned(app.m_nEvents));
+    EQ(NUM_EVENTS*3, unsigned(app.m_nParameters));
+}
+// If nothing is consumed the events still get to the workers.
+
+void paramprojectiontest::project_3()
+{
+    ProjectionReader reader;
+    ProjectionApplication app(m_argv.size() - 1, m_argv.data(), false);
+    app.m_consumed.push_back({});
+    app.runThreaded(reader, 1);
+    
+    EQ(NUM_EVENTS, unsigned(app.m_nEvents));
+    EQ(0U, unsigned(app.m_nParameters));
+}
+// The full pipeline with a worker that only consumes two parameters:
+// the output has those and their sum.
+
+void paramprojectiontest::pipeline_1()
+{
+    ProjectionReader reader;
+    ProjectionApplication app(m_argv.size() - 1, m_argv.data(), true);
+    app.runThreaded(reader, 1);
+    
+    CTreeParameterArray& in(*pIn);
+    unsigned id3   = in[3].getId();
+    unsigned id7   = in[7].getId();
+    unsigned idSum = pSum->getId();
+    
+    std::vector<std::uint8_t> data = readOutput();
+    std::uint64_t trigger(0);
+    std::size_t offset(0);
+    while (offset < data.size()) {
+        const RingItemHeader* pH =
+            reinterpret_cast<const RingItemHeader*>(data.data() + offset);
+        if (pH->s_type == PARAMETER_DATA) {
+            const ParameterItem* pP =
+                reinterpret_cast<const ParameterItem*>(pH);
+            EQ(trigger, pP->s_triggerCount);
+            EQ(std::uint32_t(3), pP->s_parameterCount);
+            for (unsigned i = 0; i < 3; i++) {
+                const ParameterValue& v(pP->s_parameters[i]);
+                if (v.s_number == id3) {
+                    EQ(value(trigger, 4), v.s_value);
+                } else if (v.s_number == id7) {
+                    EQ(value(trigger, 8), v.s_value);
+                } else {
+                    EQ(idSum, v.s_number);
+                    EQ(value(trigger, 4) + value(trigger, 8), v.s_value);
+                }
+            }
+            trigger++;
+        }
+        ASSERT(pH->s_size > 0);
+        offset += pH->s_size;
+    }
+    EQ(offset, data.size());
+    EQ(std::uint64_t(NUM_EVENTS), trigger);
+}
+// The pipeline over a range of triggers of an indexed file: the dealer
+// seeks close to the first and sends just the range.
+
+void paramprojectiontest::range_1()
+{
+    CTriggerIndex index(50);
+    {
+        CMappedDataReader input(m_inFile.c_str());
+        index.build(input);
+    }
+    index.describeFile(m_inFile.c_str());
+    index.write(CTriggerIndex::sidecarName(m_inFile.c_str()).c_str());
+    
+    ProjectionReader reader;
+    ProjectionApplication app(m_argv.size() - 1, m_argv.data(), true);
+    app.m_first = 525;
+    app.m_count = 200;
+    app.runThreaded(reader, 2);
+    
+    std::vector<std::uint8_t> data = readOutput();
+    std::uint64_t trigger(525);
+    std::size_t offset(0);
+    while (offset < data.size()) {
+        const RingItemHeader* pH =
+            reinterpret_cast<const RingItemHeader*>(data.data() + offset);
+        ASSERT(pH->s_type != BEGIN_RUN);
+        ASSERT(pH->s_type != END_RUN);
+        if (pH->s_type == PARAMETER_DATA) {
+            EQ(trigger, reinterpret_cast<const ParameterItem*>(pH)->s_triggerCount);
+            trigger++;
+        }
+        offset += pH->s_size;
+    }
+    EQ(std::uint64_t(725), trigger);
+}
+// Without an index, the dealer reads up to the first trigger.
+
+void paramprojectiontest::range_2()
+{
+    ProjectionReader reader;
+    ProjectionApplication app(m_argv.size() - 1, m_argv.data(), false);
+    app.m_consumed.push_back({3});
+    app.m_first = 990;
+    app.runThreaded(reader, 1);
+    
+    EQ(10U, unsigned(app.m_nEvents));
+    EQ(10U, unsigned(app.m_nParameters));
+}
+// Items that run past the end of the work item, or events that claim more
+// parameters than they hold, are rejected rather than read past their end.
+
+void paramprojectiontest::malformed_1()
+{
+    SumWorker worker(0, nullptr, nullptr);
+    std::vector<std::uint8_t> item(
+        sizeof(ParameterItem) + 2*sizeof(ParameterValue)
+    );
+    ParameterItem* pItem = reinterpret_cast<ParameterItem*>(item.data());
+    pItem->s_header.s_type = PARAMETER_DATA;
+    pItem->s_header.s_size = item.size();
+    pItem->s_header.s_unused = sizeof(std::uint32_t);
+    pItem->s_triggerCount = 0;
+    pItem->s_parameterCount = 3;
+    EXCEPTION(worker.processBlock(item.data(), item.size()), std::logic_error);
+    
+    pItem->s_header.s_size = sizeof(RingItemHeader) + sizeof(std::uint32_t);
+    EXCEPTION(
+        worker.processBlock(item.data(), pItem->s_header.s_size),
+        std::logic_error
+    );
+    EXCEPTION(worker.processBlock(item.data(), 4), std::logic_error);
+}
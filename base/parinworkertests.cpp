@@ -96,14 +96,13 @@ const void* parinworkertest::skipDefs()
         reinterpret_cast<const FRIB_MPI_VariableDef*>(pN);
     return pDef + numItems;
 }
-// skip an event:
+// skip an event (a PARAMETER_DATA ring item):
 const void* parinworkertest::nextEvent(const void* pEvent) {
-    const FRIB_MPI_Parameter_MessageHeader* pHeader =
-            reinterpret_cast<const FRIB_MPI_Parameter_MessageHeader*>(pEvent);
+    const RingItemHeader* pHeader =
+            reinterpret_cast<const RingItemHeader*>(pEvent);
     const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(pEvent);
     
-    return p + sizeof(FRIB_MPI_Parameter_MessageHeader) +
-        pHeader->s_numParameters * sizeof(FRIB_MPI_Parameter_Value);
+    return p + pHeader->s_size;
 }
 
 // First item should define all of the parameters:
@@ -175,10 +174,12 @@ void parinworkertest::events_1()
     while (bytesLeft) {
         numEvents++;
         
-        const FRIB_MPI_Parameter_MessageHeader* pHeader =
-            reinterpret_cast<const FRIB_MPI_Parameter_MessageHeader*>(pEvent);
-        unsigned size = sizeof(FRIB_MPI_Parameter_MessageHeader) +
-            pHeader->s_numParameters * sizeof(FRIB_MPI_Parameter_Value);
+        const ParameterItem* pItem =
+            reinterpret_cast<const ParameterItem*>(pEvent);
+        EQ(std::uint32_t(PARAMETER_DATA), pItem->s_header.s_type);
+        unsigned size = sizeof(ParameterItem) +
+            pItem->s_parameterCount * sizeof(ParameterValue);
+        EQ(size, pItem->s_header.s_size);
         pEvent += size;
         bytesLeft -= size;
     }
@@ -188,34 +189,33 @@ void parinworkertest::events_1()
 // triggers count and the size of the event is a rollovery thing
 //
 void parinworkertest::events_2() {
-    const FRIB_MPI_Parameter_MessageHeader* pHeader =
-            reinterpret_cast<const FRIB_MPI_Parameter_MessageHeader*>(skipDefs());
+    const ParameterItem* pItem =
+            reinterpret_cast<const ParameterItem*>(skipDefs());
     
     for (int i =0; i < numberEvents; i++) {
-        EQ(std::uint64_t(i), pHeader->s_triggerNumber);
-        EQ(std::uint32_t( i % 16 + 1), pHeader->s_numParameters);
+        EQ(std::uint64_t(i), pItem->s_triggerCount);
+        EQ(std::uint32_t( i % 16 + 1), pItem->s_parameterCount);
         
-        pHeader =
-            reinterpret_cast<const FRIB_MPI_Parameter_MessageHeader*>(nextEvent(pHeader));
+        pItem =
+            reinterpret_cast<const ParameterItem*>(nextEvent(pItem));
             
     }
 }
 void parinworkertest::events_3() {
-     const FRIB_MPI_Parameter_MessageHeader* pHeader =
-            reinterpret_cast<const FRIB_MPI_Parameter_MessageHeader*>(skipDefs());
+     const ParameterItem* pItem =
+            reinterpret_cast<const ParameterItem*>(skipDefs());
     
     for (int i =0; i < numberEvents; i++) {
-        const FRIB_MPI_Parameter_Value* pValue =
-            reinterpret_cast<const FRIB_MPI_Parameter_Value*>(pHeader+1);
-        for (int p =0; p < pHeader->s_numParameters; p++) {
+        const ParameterValue* pValue = pItem->s_parameters;
+        for (int p =0; p < pItem->s_parameterCount; p++) {
             EQ(std::uint32_t(p), pValue->s_number);
             EQ(double(p*10), pValue->s_value);
             
             pValue++;
         }
         
-        pHeader =
-            reinterpret_cast<const FRIB_MPI_Parameter_MessageHeader*>(nextEvent(pHeader));
+        pItem =
+            reinterpret_cast<const ParameterItem*>(nextEvent(pItem));
             
     }
 }
\ No newline at end of file
@@ -0,0 +1,273 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+
+/** @file:  patternBench.cpp
+ *  @brief: Measure pattern encoding of parameter files.
+ *
+ *  Builds a synthetic run and writes it with a CDataWriter (plain
+ *  PARAMETER_DATA items) and a CPatternDataWriter, then times:
+ *     - write  - writeBlock of the run's CParameterBatch's to each file.
+ *     - read   - reading each file back through a CInflatingDataReader
+ *                (as the dealer does).  The rate is of PARAMETER_DATA bytes.
+ *     - select - summing one parameter over the run straight from each
+ *                file: scanning each event's number/value pairs for the
+ *                plain file, using the parameter's slot in each pattern for
+ *                the pattern file.
+ *  along with the file sizes and the number of patterns.
+ *
+ *  The run looks like a detector of GROUPS subsystems of GROUP_SIZE
+ *  parameters.  The first subsystem (the trigger) is in every event, the
+ *  others fire independently with probabilities from 10% to 70%.  A
+ *  subsystem that fires sets all of its parameters so events have one of
+ *  at most 2^(GROUPS-1) patterns.
+ *
+ *  Usage:
+ *  \verbatim
+ *     patternBench ?events? ?directory?
+ *  \endverbatim
+ *  events defaults to 500000 and directory, where the files are
+ *  written (and removed), to /tmp.
+ */
+#include "DataWriter.h"
+#include "PatternDataWriter.h"
+#include "ParameterPatterns.h"
+#include "InflatingDataReader.h"
+#include "MappedDataReader.h"
+#include "ParameterBatch.h"
+#include "AnalysisRingItems.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+using namespace frib::analysis;
+
+static const unsigned GROUPS     = 8;
+static const unsigned GROUP_SIZE = 16;
+static const unsigned SELECTED   = 3*GROUP_SIZE + 5;   // What select sums.
+
+/**
+ * makeRun
+ *    Make the synthetic run.
+ */
+static std::vector<CParameterBatch*>
+makeRun(std::uint64_t nEvents)
+{
+    std::mt19937 gen(12345);
+    std::normal_distribution<double> value(1000.0, 100.0);
+    std::vector<std::bernoulli_distribution> fires;
+    for (unsigned g = 0; g < GROUPS; g++) {
+        fires.push_back(std::bernoulli_distribution(g ? 0.1*g : 1.0));
+    }
+    std::vector<CParameterBatch*> result;
+    std::vector<std::pair<unsigned, double>> event;
+    CParameterBatch* pBatch = nullptr;
+    for (std::uint64_t i = 0; i < nEvents; i++) {
+        event.clear();
+        for (unsigned g = 0; g < GROUPS; g++) {
+            if (fires[g](gen)) {
+                for (unsigned p = 0; p < GROUP_SIZE; p++) {
+                    event.push_back({g*GROUP_SIZE + p, value(gen)});
+                }
+            }
+        }
+        if (!pBatch || pBatch->full()) {
+            pBatch = new CParameterBatch;
+            result.push_back(pBatch);
+        }
+        pBatch->addEvent(event, i);
+    }
+    return result;
+}
+/**
+ * writeFile
+ *    Write the run with a writer.
+ * @return double - seconds taken, including finishing the file.
+ */
+static double
+writeFile(CDataWriter* pWriter, const std::vector<CParameterBatch*>& batches)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (auto p : batches) {
+        pWriter->writeBlock(p->data(), p->size());
+    }
+    pWriter->finish();
+    std::chrono::duration<double> t = std::chrono::steady_clock::now() - start;
+    delete pWriter;
+    return t.count();
+}
+/**
+ * readFile
+ *    Read a file through a CInflatingDataReader.
+ * @param[out] nBytes - bytes of PARAMETER_DATA read.
+ * @return double - seconds taken.
+ */
+static double
+readFile(const std::string& name, double& nBytes)
+{
+    nBytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    CInflatingDataReader reader(new CMappedDataReader(name.c_str()));
+    while (1) {
+        auto block = reader.getBlock(1024*1024);
+        if (!block.s_nbytes) {
+            reader.done();
+            break;
+        }
+        const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(block.s_pData);
+        for (std::size_t i = 0; i < block.s_nItems; i++) {
+            auto pHeader = reinterpret_cast<const RingItemHeader*>(p);
+            if (pHeader->s_type == PARAMETER_DATA) {
+                nBytes += pHeader->s_size;
+            }
+            p += pHeader->s_size;
+        }
+        reader.done();
+    }
+    std::chrono::duration<double> t = std::chrono::steady_clock::now() - start;
+    return t.count();
+}
+/**
+ * selectFile
+ *    Sum SELECTED over a file without expanding it.
+ * @param[out] sum - the sum.
+ * @return double - seconds taken.
+ */
+static double
+selectFile(const std::string& name, double& sum)
+{
+    sum = 0;
+    CParameterPatterns patterns;
+    std::vector<int> slots;                 // SELECTED's slot in each pattern.
+    auto start = std::chrono::steady_clock::now();
+    CMappedDataReader reader(name.c_str());
+    while (1) {
+        auto block = reader.getBlock(1024*1024);
+        if (!block.s_nbytes) {
+            reader.done();
+            break;
+        }
+        const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(block.s_pData);
+        for (std::size_t i = 0; i < block.s_nItems; i++) {
+            auto pHeader = reinterpret_cast<const RingItemHeader*>(p);
+            if (pHeader->s_type == PARAMETER_DATA) {
+                auto pItem = reinterpret_cast<const ParameterItem*>(p);
+                for (std::uint32_t n = 0; n < pItem->s_parameterCount; n++) {
+                    if (pItem->s_parameters[n].s_number == SELECTED) {
+                        sum += pItem->s_parameters[n].s_value;
+                    }
+                }
+            } else if (pHeader->s_type == PARAMETER_PATTERNS) {
+                patterns.define(reinterpret_cast<const ParameterPatterns*>(p));
+                while (slots.size() < patterns.size()) {
+                    auto& numbers(patterns.pattern(slots.size()));
+                    auto s = std::lower_bound(numbers.begin(), numbers.end(), SELECTED);
+                    slots.push_back(
+                        ((s != numbers.end()) && (*s == SELECTED)) ?
+                            int(s - numbers.begin()) : -1
+                    );
+                }
+            } else if (pHeader->s_type == PATTERN_PARAMETER_DATA) {
+                auto pItem = reinterpret_cast<const PatternParameterItem*>(p);
+                int slot = slots[pItem->s_pattern];
+                if (slot >= 0) {
+                    sum += pItem->s_values[slot];
+                }
+            }
+            p += pHeader->s_size;
+        }
+        reader.done();
+    }
+    std::chrono::duration<double> t = std::chrono::steady_clock::now() - start;
+    return t.count();
+}
+
+int main(int argc, char** argv)
+{
+    std::uint64_t nEvents = (argc > 1) ? atol(argv[1]) : 500000;
+    std::string directory = (argc > 2) ? argv[2] : "/tmp";
+    std::string plainFile   = directory + "/patternBench.plain";
+    std::string patternFile = directory + "/patternBench.pattern";
+    
+    auto batches = makeRun(nEvents);
+    double rawBytes(0);
+    for (auto p : batches) {
+        rawBytes += p->size();
+    }
+    double plainWrite = writeFile(new CDataWriter(plainFile.c_str()), batches);
+    double patternWrite =
+        writeFile(new CPatternDataWriter(patternFile.c_str()), batches);
+    std::size_t nPatterns = 0;
+    {
+        // Count the patterns from the file, the writer is gone:
+        
+        CMappedDataReader reader(patternFile.c_str());
+        while (1) {
+            auto block = reader.getBlock(1024*1024);
+            if (!block.s_nbytes) {
+                reader.done();
+                break;
+            }
+            const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(block.s_pData);
+            for (std::size_t i = 0; i < block.s_nItems; i++) {
+                auto pHeader = reinterpret_cast<const RingItemHeader*>(p);
+                if (pHeader->s_type == PARAMETER_PATTERNS) {
+                    nPatterns += reinterpret_cast<const ParameterPatterns*>(p)->s_patternCount;
+                }
+                p += pHeader->s_size;
+            }
+            reader.done();
+        }
+    }
+    struct stat plainStat;
+    struct stat patternStat;
+    stat(plainFile.c_str(), &plainStat);
+    stat(patternFile.c_str(), &patternStat);
+    
+    double plainBytes, patternBytes;
+    double plainRead   = readFile(plainFile, plainBytes);
+    double patternRead = readFile(patternFile, patternBytes);
+    double plainSum, patternSum;
+    double plainSelect   = selectFile(plainFile, plainSum);
+    double patternSelect = selectFile(patternFile, patternSum);
+    
+    unlink(plainFile.c_str());
+    unlink(patternFile.c_str());
+    
+    double MB = 1024.0*1024.0;
+    std::cout << nEvents << " events, " << rawBytes/MB << " MB, "
+        << nPatterns << " patterns\n";
+    std::cout << "size:    plain " << plainStat.st_size/MB << " MB pattern "
+        << patternStat.st_size/MB << " MB ratio "
+        << double(plainStat.st_size)/patternStat.st_size << std::endl;
+    std::cout << "write:   plain " << rawBytes/MB/plainWrite << " MB/s pattern "
+        << rawBytes/MB/patternWrite << " MB/s" << std::endl;
+    std::cout << "read:    plain " << plainBytes/MB/plainRead << " MB/s pattern "
+        << patternBytes/MB/patternRead << " MB/s" << std::endl;
+    std::cout << "select:  plain " << plainSelect << " s pattern "
+        << patternSelect << " s" << std::endl;
+    
+    for (auto p : batches) delete p;
+    return ((plainBytes == patternBytes) && (plainSum == patternSum)) ?
+        EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,499 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+
+/** @file:  patterntests.cpp
+ *  @brief: Tests CParameterPatterns and CPatternDataWriter.
+ */
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/Asserter.h>
+#include "Asserts.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdexcept>
+#include <string>
+#include <string.h>
+#include <vector>
+#include <cstdint>
+#include <sys/stat.h>
+
+#define private public
+#include "TreeParameter.h"
+#include "TreeVariable.h"
+#undef private
+#include "ParameterPatterns.h"
+#include "PatternDataWriter.h"
+#include "DataWriter.h"
+#include "DataReader.h"
+#include "InflatingDataReader.h"
+#include "MappedDataReader.h"
+#include "AnalysisRingItems.h"
+#include "ParameterBatch.h"
+#include "ParameterCompressor.h"
+#include "ParameterPacker.h"
+
+using namespace frib::analysis;
+static const char* templateFilename="patXXXXXX.dat";
+
+class patterntest : public CppUnit::TestFixture {
+    CPPUNIT_TEST_SUITE(patterntest);
+    CPPUNIT_TEST(add_1);
+    CPPUNIT_TEST(add_2);
+    CPPUNIT_TEST(define_1);
+    CPPUNIT_TEST(define_2);
+    CPPUNIT_TEST(define_3);
+    CPPUNIT_TEST(define_4);
+    CPPUNIT_TEST(expand_1);
+    CPPUNIT_TEST(expand_2);
+    CPPUNIT_TEST(write_1);
+    CPPUNIT_TEST(write_2);
+    CPPUNIT_TEST(write_3);
+    CPPUNIT_TEST(block_1);
+    CPPUNIT_TEST_SUITE_END();
+    
+private:
+    int m_fd;
+    std::string m_filename;
+public:
+    void setUp() {
+        char ftemplate[100];
+        strncpy(ftemplate, templateFilename, sizeof(ftemplate));
+        m_fd = mkstemps(ftemplate, 4);     // 4 '.dat'
+        if (m_fd < 0) {
+            std::string failmsg = "Failed to make tempfile: ";
+            failmsg += strerror(errno);
+            throw std::runtime_error(failmsg);
+        }
+        m_filename = ftemplate;
+    }
+    void tearDown() {
+        close(m_fd);
+        unlink(m_filename.c_str());
+        CTreeParameter::m_parameterDictionary.clear();
+        CTreeVariable::m_dictionary.clear();
+    }
+protected:
+    void add_1();
+    void add_2();
+    void define_1();
+    void define_2();
+    void define_3();
+    void define_4();
+    void expand_1();
+    void expand_2();
+    void write_1();
+    void write_2();
+    void write_3();
+    void block_1();
+private:
+    std::vector<std::pair<unsigned, double>> makeEvent(int i);
+    std::vector<std::uint8_t> makeDefinitions(
+        std::uint32_t first,
+        const std::vector<std::vector<std::uint32_t>>& patterns
+    );
+    std::vector<std::uint8_t> readParameters(std::size_t maxbytes);
+    std::vector<std::uint32_t> itemTypes();
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(patterntest);
+
+/**
+ * makeEvent
+ *    Event i has parameters 0..i%3 with value number*10 + i and
+ *    every 4th event also has parameter 50: six patterns.
+ */
+std::vector<std::pair<unsigned, double>>
+patterntest::makeEvent(int i)
+{
+    std::vector<std::pair<unsigned, double>> result;
+    for (unsigned p = 0; p <= unsigned(i % 3); p++) {
+        result.push_back({p, p*10.0 + i});
+    }
+    if (i % 4 == 0) {
+        result.push_back({50, 1234.5 + i});
+    }
+    return result;
+}
+/**
+ * makeDefinitions
+ *    Build a PARAMETER_PATTERNS item.
+ */
+std::vector<std::uint8_t>
+patterntest::makeDefinitions(
+    std::uint32_t first,
+    const std::vector<std::vector<std::uint32_t>>& patterns
+)
+{
+    std::vector<std::uint32_t> words = {
+        0, PARAMETER_PATTERNS, sizeof(std::uint32_t),
+        first, std::uint32_t(patterns.size())
+    };
+    for (auto& p : patterns) {
+        words.push_back(p.size());
+        words.insert(words.end(), p.begin(), p.end());
+    }
+    words[0] = words.size() * sizeof(std::uint32_t);
+    const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(words.data());
+    return std::vector<std::uint8_t>(p, p + words[0]);
+}
+/**
+ * readParameters
+ *    Read the file back through an inflating reader and return the
+ *    PARAMETER_DATA and passthrough items (not the front matter).  Checks no
+ *    pattern items get through.
+ */
+std::vector<std::uint8_t>
+patterntest::readParameters(std::size_t maxbytes)
+{
+    std::vector<std::uint8_t> result;
+    CInflatingDataReader reader(new CMappedDataReader(m_filename.c_str()));
+    while (1) {
+        auto block = reader.getBlock(maxbytes);
+        if (!block.s_nbytes) {
+            reader.done();
+            break;
+        }
+        const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(block.s_pData);
+        for (size_t i = 0; i < block.s_nItems; i++) {
+            const RingItemHeader* pHeader =
+                reinterpret_cast<const RingItemHeader*>(p);
+            ASSERT(pHeader->s_type != PARAMETER_PATTERNS);
+            ASSERT(pHeader->s_type != PATTERN_PARAMETER_DATA);
+            if (
+                (pHeader->s_type != PARAMETER_DEFINITIONS) &&
+                (pHeader->s_type != VARIABLE_VALUES)
+            ) {
+                result.insert(result.end(), p, p + pHeader->s_size);
+            }
+            p += pHeader->s_size;
+        }
+        reader.done();
+    }
+    return result;
+}
+/**
+ * itemTypes
+ *    @return the types of the items in the file (not the front matter).
+ */
+std::vector<std::uint32_t>
+patterntest::itemTypes()
+{
+    std::vector<std::uint32_t> result;
+    lseek(m_fd, 0, SEEK_SET);
+    CDataReader reader(m_fd, 1024*1024);
+    auto r = reader.getBlock(1024*1024);
+    const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(r.s_pData);
+    for (size_t i = 0; i < r.s_nItems; i++) {
+        const RingItemHeader* pHeader = reinterpret_cast<const RingItemHeader*>(p);
+        if (
+            (pHeader->s_type != PARAMETER_DEFINITIONS) &&
+            (pHeader->s_type != VARIABLE_VALUES)
+        ) {
+            result.push_back(pHeader->s_type);
+        }
+        p += pHeader->s_size;
+    }
+    reader.done();
+    return result;
+}
+// Patterns are numbered in the order they're added.
+
+void patterntest::add_1()
+{
+    CParameterPatterns patterns;
+    EQ(size_t(0), patterns.size());
+    EQ(CParameterPatterns::NO_PATTERN, patterns.lookup({1, 2, 3}));
+    
+    EQ(std::uint32_t(0), patterns.add({1, 2, 3}));
+    EQ(std::uint32_t(1), patterns.add({1, 2}));
+    EQ(std::uint32_t(2), patterns.add({}));
+    EQ(size_t(3), patterns.size());
+    
+    EQ(std::uint32_t(0), patterns.lookup({1, 2, 3}));
+    EQ(std::uint32_t(1), patterns.lookup({1, 2}));
+    EQ(std::uint32_t(2), patterns.lookup({}));
+    EQ(CParameterPatterns::NO_PATTERN, patterns.lookup({2, 3}));
+    ASSERT(CParameterPatterns::Pattern({1, 2}) == patterns.pattern(1));
+    
+    patterns.clear();
+    EQ(size_t(0), patterns.size());
+    EQ(CParameterPatterns::NO_PATTERN, patterns.lookup({1, 2, 3}));
+}
+// Adding a pattern twice or asking for one that doesn't exist throws.
+
+void patterntest::add_2()
+{
+    CParameterPatterns patterns;
+    patterns.add({1, 2, 3});
+    EXCEPTION(patterns.add({1, 2, 3}), std::logic_error);
+    EXCEPTION(patterns.pattern(1), std::out_of_range);
+    EQ(size_t(1), patterns.size());
+}
+// Definitions items add patterns in order.
+
+void patterntest::define_1()
+{
+    CParameterPatterns patterns;
+    auto item = makeDefinitions(0, {{1, 2, 3}, {}, {7}});
+    patterns.define(reinterpret_cast<const ParameterPatterns*>(item.data()));
+    item = makeDefinitions(3, {{4, 5}});
+    patterns.define(reinterpret_cast<const ParameterPatterns*>(item.data()));
+    
+    EQ(size_t(4), patterns.size());
+    ASSERT(CParameterPatterns::Pattern({1, 2, 3}) == patterns.pattern(0));
+    ASSERT(patterns.pattern(1).empty());
+    ASSERT(CParameterPatterns::Pattern({7}) == patterns.pattern(2));
+    ASSERT(CParameterPatterns::Pattern({4, 5}) == patterns.pattern(3));
+    EQ(std::uint32_t(3), patterns.lookup({4, 5}));
+}
+// Definitions out of order or that run off the end of the item throw.
+
+void patterntest::define_2()
+{
+    CParameterPatterns patterns;
+    auto item = makeDefinitions(1, {{1, 2, 3}});
+    EXCEPTION(
+        patterns.define(reinterpret_cast<const ParameterPatterns*>(item.data())),
+        std::runtime_error
+    );
+    item = makeDefinitions(0, {{1, 2, 3}, {4, 5}});
+    pParameterPatterns pItem = reinterpret_cast<pParameterPatterns>(item.data());
+    pItem->s_header.s_size -= sizeof(std::uint32_t);
+    EXCEPTION(patterns.define(pItem), std::runtime_error);
+    pItem->s_header.s_size += sizeof(std::uint32_t);
+    pItem->s_header.s_type = PARAMETER_DATA;
+    EXCEPTION(patterns.define(pItem), std::runtime_error);
+    EQ(size_t(0), patterns.size());
+}
+// Redefining a pattern throws and leaves none of the item's patterns.
+
+void patterntest::define_3()
+{
+    CParameterPatterns patterns;
+    patterns.add({1});
+    auto item = makeDefinitions(1, {{2}, {3}, {1}});
+    EXCEPTION(
+        patterns.define(reinterpret_cast<const ParameterPatterns*>(item.data())),
+        std::runtime_error
+    );
+    EQ(size_t(1), patterns.size());
+    EQ(CParameterPatterns::NO_PATTERN, patterns.lookup({2}));
+    EQ(CParameterPatterns::NO_PATTERN, patterns.lookup({3}));
+    EQ(std::uint32_t(0), patterns.lookup({1}));
+}
+// Patterns already defined identically (e.g. from an index context) are
+// skipped; conflicting ones throw and leave the patterns as they were.
+
+void patterntest::define_4()
+{
+    CParameterPatterns patterns;
+    patterns.add({1});
+    patterns.add({2});
+    auto item = makeDefinitions(1, {{2}, {3}});
+    patterns.define(reinterpret_cast<const ParameterPatterns*>(item.data()));
+    EQ(size_t(3), patterns.size());
+    EQ(std::uint32_t(2), patterns.lookup({3}));
+    
+    item = makeDefinitions(0, {{1}});            // Entirely known.
+    patterns.define(reinterpret_cast<const ParameterPatterns*>(item.data()));
+    EQ(size_t(3), patterns.size());
+    
+    item = makeDefinitions(2, {{4}, {5}});
+    EXCEPTION(
+        patterns.define(reinterpret_cast<const ParameterPatterns*>(item.data())),
+        std::runtime_error
+    );
+    EQ(size_t(3), patterns.size());
+    EQ(CParameterPatterns::NO_PATTERN, patterns.lookup({5}));
+}
+// A pattern item expands to the PARAMETER_DATA item of its numbers.
+
+void patterntest::expand_1()
+{
+    CParameterPatterns patterns;
+    patterns.add({3, 7, 9});
+    
+    std::vector<std::uint8_t> item(sizeof(PatternParameterItem) + 3*sizeof(double));
+    pPatternParameterItem pItem = reinterpret_cast<pPatternParameterItem>(item.data());
+    pItem->s_header.s_size   = item.size();
+    pItem->s_header.s_type   = PATTERN_PARAMETER_DATA;
+    pItem->s_header.s_unused = sizeof(std::uint32_t);
+    pItem->s_triggerCount    = 1234;
+    pItem->s_pattern         = 0;
+    pItem->s_values[0] = 1.5;
+    pItem->s_values[1] = 2.5;
+    pItem->s_values[2] = 3.5;
+    
+    std::vector<std::uint8_t> out(4, 0xff);              // Appends.
+    patterns.expand(pItem, out);
+    
+    CParameterBatch batch(1, 1024);
+    batch.addEvent({{3, 1.5}, {7, 2.5}, {9, 3.5}}, 1234);
+    const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(batch.data());
+    std::vector<std::uint8_t> expected(4, 0xff);
+    expected.insert(expected.end(), p, p + batch.size());
+    ASSERT(expected == out);
+}
+// Undefined patterns and the wrong number of values throw, leaving out be.
+
+void patterntest::expand_2()
+{
+    CParameterPatterns patterns;
+    patterns.add({3, 7, 9});
+    
+    std::vector<std::uint8_t> item(sizeof(PatternParameterItem) + 2*sizeof(double));
+    pPatternParameterItem pItem = reinterpret_cast<pPatternParameterItem>(item.data());
+    pItem->s_header.s_size   = item.size();
+    pItem->s_header.s_type   = PATTERN_PARAMETER_DATA;
+    pItem->s_header.s_unused = sizeof(std::uint32_t);
+    pItem->s_triggerCount    = 1234;
+    pItem->s_pattern         = 0;
+    
+    std::vector<std::uint8_t> out(4, 0xff);
+    EXCEPTION(patterns.expand(pItem, out), std::runtime_error);
+    pItem->s_pattern = 1;
+    EXCEPTION(patterns.expand(pItem, out), std::runtime_error);
+    EQ(size_t(4), out.size());
+}
+// Events read back as PARAMETER_DATA with each pattern defined just
+// before its first use and the file smaller than plain output.
+
+void patterntest::write_1()
+{
+    CParameterBatch batch(100, 1024*1024);
+    {
+        CPatternDataWriter w(m_filename.c_str());
+        for (int i = 0; i < 100; i++) {
+            w.writeEvent(makeEvent(i), i);
+            batch.addEvent(makeEvent(i), i);
+        }
+        EQ(size_t(6), w.patterns().size());
+    }
+    const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(batch.data());
+    std::vector<std::uint8_t> expected(p, p + batch.size());
+    ASSERT(expected == readParameters(1024*1024));
+    
+    auto types = itemTypes();
+    EQ(size_t(106), types.size());
+    size_t defined = 0;
+    for (size_t i = 0; i < types.size(); i++) {
+        if (types[i] == PARAMETER_PATTERNS) {
+            defined++;
+            EQ(PATTERN_PARAMETER_DATA, types[i+1]);
+        } else {
+            EQ(PATTERN_PARAMETER_DATA, types[i]);
+        }
+    }
+    EQ(size_t(6), defined);
+    
+    std::string plainFile = m_filename + ".plain";
+    {
+        CDataWriter w(plainFile.c_str());
+        w.writeBlock(batch.data(), batch.size());
+    }
+    struct stat pattern;
+    struct stat plain;
+    stat(m_filename.c_str(), &pattern);
+    stat(plainFile.c_str(), &plain);
+    unlink(plainFile.c_str());
+    ASSERT(pattern.st_size < plain.st_size);
+}
+// Unsorted events are sorted; passthrough items keep their place.
+
+void patterntest::write_2()
+{
+    std::uint8_t passthrough[32];
+    RingItemHeader* pHeader = reinterpret_cast<RingItemHeader*>(passthrough);
+    pHeader->s_size   = sizeof(passthrough);
+    pHeader->s_type   = 1;
+    pHeader->s_unused = sizeof(std::uint32_t);
+    memset(passthrough + sizeof(RingItemHeader), 0x5a,
+           sizeof(passthrough) - sizeof(RingItemHeader));
+    
+    std::vector<std::uint8_t> expected;
+    {
+        CPatternDataWriter w(m_filename.c_str());
+        w.writeItem(passthrough);
+        expected.insert(expected.end(), passthrough, passthrough + sizeof(passthrough));
+        for (int i = 0; i < 10; i++) {
+            auto event = makeEvent(i);
+            CParameterBatch batch(1, 1024);
+            batch.addEvent(event, i);
+            const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(batch.data());
+            expected.insert(expected.end(), p, p + batch.size());
+            
+            std::vector<std::pair<unsigned, double>> reversed(
+                event.rbegin(), event.rend()
+            );
+            w.writeEvent(reversed, i);
+        }
+        w.writeItem(passthrough);
+        expected.insert(expected.end(), passthrough, passthrough + sizeof(passthrough));
+    }
+    ASSERT(expected == readParameters(1024*1024));
+}
+// Small reads work even when a block holds only pattern definitions.
+
+void patterntest::write_3()
+{
+    CParameterBatch batch(20, 1024*1024);
+    {
+        CPatternDataWriter w(m_filename.c_str());
+        for (int i = 0; i < 20; i++) {
+            w.writeEvent(makeEvent(i), i);
+            batch.addEvent(makeEvent(i), i);
+        }
+    }
+    const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(batch.data());
+    std::vector<std::uint8_t> expected(p, p + batch.size());
+    
+    // The biggest item is a pattern item of 4 values:
+    
+    ASSERT(expected == readParameters(sizeof(PatternParameterItem) + 4*sizeof(double)));
+}
+// Blocks of PARAMETER_DATA, packed items and compressed frames all
+// come out as pattern items.
+
+void patterntest::block_1()
+{
+    CParameterBatch batch(30, 1024*1024);
+    for (int i = 0; i < 30; i++) {
+        batch.addEvent(makeEvent(i), i);
+    }
+    CParameterPacker packer(std::vector<std::uint32_t>(51, VALUE_FLOAT32));
+    packer.add(batch.data(), batch.size());
+    CParameterCompressor compressor;
+    compressor.add(batch.data(), batch.size());
+    {
+        CPatternDataWriter w(m_filename.c_str());
+        w.writeBlock(batch.data(), batch.size());
+        w.writeBlock(packer.data(), packer.size());
+        w.writeBlock(compressor.data(), compressor.size());
+        EQ(size_t(6), w.patterns().size());
+    }
+    const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(batch.data());
+    std::vector<std::uint8_t> once(p, p + batch.size());
+    std::vector<std::uint8_t> expected;
+    for (int i = 0; i < 3; i++) {
+        expected.insert(expected.end(), once.begin(), once.end());
+    }
+    ASSERT(expected == readParameters(1024*1024));
+    for (auto type : itemTypes()) {
+        ASSERT((type == PATTERN_PARAMETER_DATA) || (type == PARAMETER_PATTERNS));
+    }
+}
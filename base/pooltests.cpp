@@ -0,0 +1,273 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  pooltests.cpp
+ *  @brief: Tests of CParameterItemPool
+ */
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/Asserter.h>
+#include "Asserts.h"
+#define private public
+#include "ParameterItemPool.h"
+#include "TriggerSorter.h"
+#undef private
+#include <vector>
+#include <stdexcept>
+#include <string.h>
+
+using namespace frib::analysis;
+
+// Sorter that releases the items it emits:
+
+struct CPoolSorter : public CTriggerSorter {
+    std::vector<std::uint64_t> m_triggers;
+    CPoolSorter(CParameterItemPool* pPool) : CTriggerSorter(DEFAULT_CAPACITY, pPool) {}
+    virtual void emitItem(pParameterItem item) {
+        m_triggers.push_back(item->s_triggerCount);
+        releaseItem(item);
+    }
+};
+
+class pooltest : public CppUnit::TestFixture {
+    CPPUNIT_TEST_SUITE(pooltest);
+    CPPUNIT_TEST(construct_1);
+    CPPUNIT_TEST(construct_2);
+    
+    CPPUNIT_TEST(alloc_1);
+    CPPUNIT_TEST(alloc_2);
+    CPPUNIT_TEST(alloc_3);
+    CPPUNIT_TEST(alloc_4);
+    CPPUNIT_TEST(alloc_5);
+    
+    CPPUNIT_TEST(release_1);
+    CPPUNIT_TEST(release_2);
+    CPPUNIT_TEST(oversize_1);
+    CPPUNIT_TEST(slab_1);
+    
+    CPPUNIT_TEST(sorter_1);
+    CPPUNIT_TEST(sorter_2);
+    CPPUNIT_TEST_SUITE_END();
+    
+private:
+    CParameterItemPool* m_pPool;
+public:
+    void setUp() {
+        m_pPool = new CParameterItemPool;
+    }
+    void tearDown() {
+        delete m_pPool;
+    }
+protected:
+    void construct_1();
+    void construct_2();
+    
+    void alloc_1();
+    void alloc_2();
+    void alloc_3();
+    void alloc_4();
+    void alloc_5();
+    
+    void release_1();
+    void release_2();
+    void oversize_1();
+    void slab_1();
+    
+    void sorter_1();
+    void sorter_2();
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(pooltest);
+
+// Nothing is allocated by construction.
+void pooltest::construct_1()
+{
+    auto& stats = m_pPool->getStatistics();
+    EQ(size_t(0), stats.s_bytesHeld);
+    EQ(size_t(0), stats.s_bytesInUse);
+    EQ(size_t(0), stats.s_highWaterMark);
+    EQ(size_t(0), stats.s_itemsInUse);
+    EQ(size_t(0), stats.s_allocations);
+    EQ(size_t(0), stats.s_slabAllocations);
+    EQ(size_t(0), stats.s_oversizeAllocations);
+    ASSERT(m_pPool->maxChunkSize() >= CParameterItemPool::DEFAULT_MAX_CHUNK_SIZE);
+    ASSERT(m_pPool->m_slabs.empty());
+}
+// Zero slab size is illegal.
+void pooltest::construct_2()
+{
+    EXCEPTION(CParameterItemPool p(0), std::invalid_argument);
+}
+// A small allocation gets a slab.
+void pooltest::alloc_1()
+{
+    pParameterItem p = m_pPool->allocate(sizeof(ParameterItem));
+    ASSERT(p);
+    auto& stats = m_pPool->getStatistics();
+    EQ(size_t(1), stats.s_allocations);
+    EQ(size_t(1), stats.s_slabAllocations);
+    EQ(size_t(1), stats.s_itemsInUse);
+    EQ(CParameterItemPool::DEFAULT_SLAB_SIZE, stats.s_bytesHeld);
+    ASSERT(stats.s_bytesInUse >= sizeof(ParameterItem));
+    EQ(stats.s_bytesInUse, stats.s_highWaterMark);
+    m_pPool->release(p);
+}
+// allocateItem fills in the item header.
+void pooltest::alloc_2()
+{
+    pParameterItem p = m_pPool->allocateItem(10);
+    EQ(std::uint32_t(sizeof(ParameterItem) + 10*sizeof(ParameterValue)), p->s_header.s_size);
+    EQ(std::uint32_t(PARAMETER_DATA), p->s_header.s_type);
+    EQ(std::uint32_t(sizeof(std::uint32_t)), p->s_header.s_unused);
+    EQ(std::uint32_t(10), p->s_parameterCount);
+    m_pPool->release(p);
+}
+// Several allocations in the same slab don't overlap.
+void pooltest::alloc_3()
+{
+    std::vector<pParameterItem> items;
+    for (int i = 0; i < 100; i++) {
+        pParameterItem p = m_pPool->allocateItem(3);
+        memset(p->s_parameters, i, 3*sizeof(ParameterValue));
+        items.push_back(p);
+    }
+    for (int i = 0; i < 100; i++) {
+        std::uint8_t* p = reinterpret_cast<std::uint8_t*>(items[i]->s_parameters);
+        for (int b = 0; b < 3*sizeof(ParameterValue); b++) {
+            EQ(std::uint8_t(i), p[b]);
+        }
+        EQ(std::uint32_t(3), items[i]->s_parameterCount);
+    }
+    EQ(size_t(1), m_pPool->getStatistics().s_slabAllocations);
+    EQ(size_t(100), m_pPool->getStatistics().s_itemsInUse);
+    for (auto p : items) m_pPool->release(p);
+    EQ(size_t(0), m_pPool->getStatistics().s_itemsInUse);
+    EQ(size_t(0), m_pPool->getStatistics().s_bytesInUse);
+}
+// Different sizes come from different size classes.
+void pooltest::alloc_4()
+{
+    pParameterItem small = m_pPool->allocateItem(1);
+    pParameterItem big   = m_pPool->allocateItem(1000);
+    EQ(size_t(2), m_pPool->getStatistics().s_slabAllocations);
+    ASSERT(m_pPool->sizeClass(small->s_header.s_size) < m_pPool->sizeClass(big->s_header.s_size));
+    m_pPool->release(small);
+    m_pPool->release(big);
+}
+// High water mark tracks the peak.
+void pooltest::alloc_5()
+{
+    pParameterItem p1 = m_pPool->allocateItem(1);
+    pParameterItem p2 = m_pPool->allocateItem(1);
+    size_t peak = m_pPool->getStatistics().s_bytesInUse;
+    m_pPool->release(p1);
+    m_pPool->release(p2);
+    pParameterItem p3 = m_pPool->allocateItem(1);
+    EQ(peak, m_pPool->getStatistics().s_highWaterMark);
+    EQ(size_t(2), m_pPool->getStatistics().s_maxItemsInUse);
+    m_pPool->release(p3);
+}
+// Released storage is re-used.
+void pooltest::release_1()
+{
+    pParameterItem p1 = m_pPool->allocateItem(5);
+    m_pPool->release(p1);
+    pParameterItem p2 = m_pPool->allocateItem(5);
+    EQ(p1, p2);
+    m_pPool->release(p2);
+}
+// Steady state does not go back to the heap.
+void pooltest::release_2()
+{
+    std::vector<pParameterItem> items;
+    for (int i = 0; i < 1000; i++) {
+        items.push_back(m_pPool->allocateItem(i % 50));
+    }
+    size_t slabs = m_pPool->getStatistics().s_slabAllocations;
+    size_t held  = m_pPool->getStatistics().s_bytesHeld;
+    for (int pass = 0; pass < 10; pass++) {
+        for (auto p : items) m_pPool->release(p);
+        items.clear();
+        for (int i = 0; i < 1000; i++) {
+            items.push_back(m_pPool->allocateItem(i % 50));
+        }
+    }
+    EQ(slabs, m_pPool->getStatistics().s_slabAllocations);
+    EQ(held, m_pPool->getStatistics().s_bytesHeld);
+    for (auto p : items) m_pPool->release(p);
+}
+// Oversized items come from the heap and are given back to it.
+void pooltest::oversize_1()
+{
+    CParameterItemPool pool(4096, 1024);
+    pParameterItem p = pool.allocate(2048);
+    EQ(size_t(1), pool.getStatistics().s_oversizeAllocations);
+    EQ(size_t(0), pool.getStatistics().s_slabAllocations);
+    ASSERT(pool.getStatistics().s_bytesHeld >= 2048);
+    memset(p, 0xff, 2048);                 // Header content doesn't matter.
+    pool.release(p);
+    EQ(size_t(0), pool.getStatistics().s_bytesHeld);
+    EQ(size_t(0), pool.getStatistics().s_bytesInUse);
+    EQ(size_t(0), pool.getStatistics().s_itemsInUse);
+}
+// A chunk bigger than the slab size still works (one chunk per slab).
+void pooltest::slab_1()
+{
+    CParameterItemPool pool(128, 4096);
+    pParameterItem p1 = pool.allocate(1000);
+    pParameterItem p2 = pool.allocate(1000);
+    ASSERT(p1 != p2);
+    EQ(size_t(2), pool.getStatistics().s_slabAllocations);
+    EQ(size_t(0), pool.getStatistics().s_oversizeAllocations);
+    pool.release(p1);
+    pool.release(p2);
+}
+// A sorter given the pool releases emitted items to it.
+void pooltest::sorter_1()
+{
+    {
+        CPoolSorter sorter(m_pPool);
+        for (int i = 9; i >= 0; i--) {
+            pParameterItem p = m_pPool->allocateItem(2);
+            p->s_triggerCount = i;
+            sorter.addItem(p);
+        }
+        EQ(size_t(10), sorter.m_triggers.size());
+    }
+    EQ(size_t(0), m_pPool->getStatistics().s_itemsInUse);
+}
+// Items left in the sorter are released when it's destroyed.
+void pooltest::sorter_2()
+{
+    {
+        CPoolSorter sorter(m_pPool);
+        for (int i = 9; i > 0; i--) {
+            pParameterItem p = m_pPool->allocateItem(2);
+            p->s_triggerCount = i;
+            sorter.addItem(p);
+        }
+        pParameterItem p = m_pPool->allocateItem(2);
+        p->s_triggerCount = 20;
+        sorter.addItem(p);
+        p = m_pPool->allocateItem(2);
+        p->s_triggerCount = 3;             // Duplicate.
+        sorter.addItem(p);
+        
+        EQ(size_t(11), m_pPool->getStatistics().s_itemsInUse);
+        EQ(size_t(0), sorter.m_triggers.size());
+    }
+    EQ(size_t(0), m_pPool->getStatistics().s_itemsInUse);
+}
@@ -0,0 +1,268 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+/** @file:  prefetchBench.cpp
+ *  @brief: Worker idle time as a function of the number of prefetch credits.
+ *
+ *  A synthetic dealer hands out work items (blocks of ring items) and the
+ *  workers "process" each one by spinning for a fixed time.  Workers run
+ *  with 0 credits (request a work item and wait for it, which is how the
+ *  workers used to work) and with 1, 2, 4 and 8 credits using a
+ *  CMPIWorkItemPrefetcher.  For each, the dealer (rank 0) reports the
+ *  elapsed time, work items per second and the mean fraction of the time
+ *  workers spent waiting for work.
+ *
+ *  Usage:
+ *  \verbatim
+ *     mpirun -np 6 prefetchBench ?work-items? ?bytes-per-item? ?work-us?
+ *  \endverbatim
+ *  work-items defaults to 4000, bytes-per-item to 262144 and work-us (the
+ *  microseconds each work item takes to process) to 200.
+ */
+#include "AbstractApplication.h"
+#include "AnalysisRingItems.h"
+#include "MPIWorkItemPrefetcher.h"
+#include "ParameterReader.h"
+#include <mpi.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <stdexcept>
+
+using namespace frib::analysis;
+
+static const unsigned creditCounts[] = {0, 1, 2, 4, 8};
+static const size_t   NUM_CREDIT_COUNTS(
+    sizeof(creditCounts)/sizeof(creditCounts[0])
+);
+static const size_t   ITEM_SIZE(1024);         // Ring items in a work item.
+
+/**
+ * @class PrefetchBench
+ *    Application whose roles are:
+ *    - dealer    - deals the work items and reports the results.
+ *    - farmer    - idle.
+ *    - outputter - idle.
+ *    - workers   - process the work items.
+ *    Every role runs once per credit count with a barrier before each run
+ *    and contributes to the reduction of the idle times after it.
+ */
+class PrefetchBench : public AbstractApplication {
+private:
+    unsigned m_nItems;
+    size_t   m_nBytes;
+    double   m_workSeconds;
+public:
+    PrefetchBench(int argc, char** argv);
+    
+    virtual void dealer(int argc, char** argv, AbstractApplication* pApp);
+    virtual void farmer(int argc, char** argv, AbstractApplication* pApp);
+    virtual void outputter(int argc, char** argv, AbstractApplication* pApp);
+    virtual void worker(int argc, char** argv, AbstractApplication* pApp);
+private:
+    void idle();
+    double runWorker(unsigned credits);
+    void deal(const std::vector<std::uint8_t>& block);
+};
+
+/**
+ * constructor
+ *   Pull the optional parameters off the command line.
+ */
+PrefetchBench::PrefetchBench(int argc, char** argv) :
+    AbstractApplication(argc, argv),
+    m_nItems(4000), m_nBytes(256*1024), m_workSeconds(200.0e-6)
+{
+    if (argc > 1) m_nItems = strtoul(argv[1], nullptr, 0);
+    if (argc > 2) m_nBytes = strtoul(argv[2], nullptr, 0);
+    if (argc > 3) m_workSeconds = strtod(argv[3], nullptr)*1.0e-6;
+    if (m_nBytes < ITEM_SIZE) {
+        throw std::invalid_argument("bytes-per-item must be at least 1024");
+    }
+    m_nBytes -= m_nBytes % ITEM_SIZE;
+}
+/**
+ * dealer
+ *    Deal the work items for each credit count, then collect and report
+ *    the worker idle times.
+ */
+void
+PrefetchBench::dealer(int argc, char** argv, AbstractApplication* pApp)
+{
+    // A work item is a block of ring items:
+    
+    std::vector<std::uint8_t> block(m_nBytes);
+    for (size_t i = 0; i < m_nBytes; i += ITEM_SIZE) {
+        RingItemHeader* pHeader = reinterpret_cast<RingItemHeader*>(&block[i]);
+        pHeader->s_size   = ITEM_SIZE;
+        pHeader->s_type   = 30;
+        pHeader->s_unused = sizeof(std::uint32_t);
+    }
+    std::cout << "Work items: " << m_nItems << " bytes/item: " << m_nBytes
+        << " work us/item: " << m_workSeconds*1.0e6
+        << " workers: " << numWorkers() << std::endl;
+    std::cout << std::setw(8) << "credits" << std::setw(12) << "seconds"
+        << std::setw(14) << "items/s" << std::setw(12) << "idle %" << std::endl;
+    
+    for (auto credits : creditCounts) {
+        MPI_Barrier(MPI_COMM_WORLD);
+        double start = MPI_Wtime();
+        deal(block);
+        double seconds = MPI_Wtime() - start;
+        
+        double idleSeconds(0.0), totalIdle;
+        MPI_Reduce(&idleSeconds, &totalIdle, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+        double busySeconds = m_nItems*m_workSeconds;
+        double idlePercent = 100.0*totalIdle/(totalIdle + busySeconds);
+        
+        std::cout << std::setw(8) << credits
+            << std::setw(12) << std::fixed << std::setprecision(3) << seconds
+            << std::setw(14) << std::setprecision(0) << m_nItems/seconds
+            << std::setw(12) << std::setprecision(1) << idlePercent
+            << std::endl;
+    }
+}
+/**
+ * farmer
+ */
+void
+PrefetchBench::farmer(int argc, char** argv, AbstractApplication* pApp)
+{
+    idle();
+}
+/**
+ * outputter
+ */
+void
+PrefetchBench::outputter(int argc, char** argv, AbstractApplication* pApp)
+{
+    idle();
+}
+/**
+ * worker
+ *    Process the work items for each credit count and contribute our
+ *    idle time to the dealer's total.
+ */
+void
+PrefetchBench::worker(int argc, char** argv, AbstractApplication* pApp)
+{
+    for (auto credits : creditCounts) {
+        MPI_Barrier(MPI_COMM_WORLD);
+        double idleSeconds = runWorker(credits);
+        double totalIdle;
+        MPI_Reduce(&idleSeconds, &totalIdle, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    }
+}
+/**
+ * idle
+ *    Keep pace with the barriers and reductions.
+ */
+void
+PrefetchBench::idle()
+{
+    for (size_t i = 0; i < NUM_CREDIT_COUNTS; i++) {
+        MPI_Barrier(MPI_COMM_WORLD);
+        double idleSeconds(0.0), totalIdle;
+        MPI_Reduce(&idleSeconds, &totalIdle, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    }
+}
+/**
+ * deal
+ *    Send m_nItems work items then the ends.  This is what the real dealers
+ *    do, minus the I/O.
+ * @param block - the work item to send.
+ */
+void
+PrefetchBench::deal(const std::vector<std::uint8_t>& block)
+{
+    for (unsigned i = 0; i < m_nItems; i++) {
+        FRIB_MPI_Request_Data request;
+        int dest = getRequest(&request);
+        size_t n = workItemSize(request, block.data(), block.size());
+        sendWorkItem(dest, i, block.data(), n);
+    }
+    sendEofs();
+}
+/**
+ * runWorker
+ *    Process work items until the dealer sends an end.
+ * @param credits - number of prefetch credits, 0 to request each work
+ *                  item and wait for it.
+ * @return double - seconds spent waiting for work items.
+ */
+double
+PrefetchBench::runWorker(unsigned credits)
+{
+    double idleSeconds(0.0);
+    CMPIWorkItemPrefetcher* pPrefetcher(nullptr);
+    if (credits) {
+        pPrefetcher = new CMPIWorkItemPrefetcher(*this, credits, m_nBytes);
+    }
+    std::vector<std::uint8_t> block(m_nBytes);
+    while (1) {
+        FRIB_MPI_Message_Header header;
+        if (pPrefetcher) {
+            if (!pPrefetcher->next(header)) break;
+        } else {
+            double start = MPI_Wtime();
+            requestData(m_nBytes);
+            MPI_Status status;
+            int stat = MPI_Recv(
+                &header, 1, messageHeaderType(), 0, MPI_HEADER_TAG,
+                MPI_COMM_WORLD, &status
+            );
+            throwMPIError(stat, "Unable to receive work item header: ");
+            if (header.s_end) {
+                idleSeconds += MPI_Wtime() - start;
+                break;
+            }
+            stat = MPI_Recv(
+                block.data(), header.s_nBytes, MPI_UINT8_T, 0, MPI_DATA_TAG,
+                MPI_COMM_WORLD, &status
+            );
+            throwMPIError(stat, "Unable to receive work item: ");
+            idleSeconds += MPI_Wtime() - start;
+        }
+        // "Process" the work item:
+        
+        double start = MPI_Wtime();
+        while ((MPI_Wtime() - start) < m_workSeconds)
+            ;
+    }
+    if (pPrefetcher) {
+        idleSeconds = pPrefetcher->idleTime();
+        delete pPrefetcher;
+    }
+    return idleSeconds;
+}
+
+// There's no parameter definition file.
+
+class CDummyReader : public CParameterReader {
+public:
+    CDummyReader() : CParameterReader("/dev/null") {}
+    virtual void read() {}
+};
+
+int main(int argc, char** argv)
+{
+    PrefetchBench app(argc, argv);
+    CDummyReader reader;
+    app(reader);
+    return EXIT_SUCCESS;
+}
@@ -56,8 +56,10 @@ class readertest : public CppUnit::TestFixture {
     CPPUNIT_TEST(get_8);
     CPPUNIT_TEST(get_9);
     CPPUNIT_TEST(get_10);
+    CPPUNIT_TEST(get_11);
     
     CPPUNIT_TEST(baddone);
+    CPPUNIT_TEST(persist);
     CPPUNIT_TEST_SUITE_END();
 protected:
     void construct_1();
@@ -74,8 +76,10 @@ protected:
     void get_8();
     void get_9();
     void get_10();
+    void get_11();
     
     void baddone();
+    void persist();
 private:
     int m_fd;
     std::string m_filename;
@@ -378,9 +382,43 @@ void readertest::get_10()
     CDataReader d(m_fd, 50);
     CPPUNIT_ASSERT_THROW(auto r = d.getBlock(50), std::logic_error);
 }
+// Release slides the whole unconsumed tail to the front of the buffer:
+
+void readertest::get_11()
+{
+    writeCountPattern(20, 0, 1);
+    writeCountPattern(100, 0, 3);
+    lseek(m_fd, 0, SEEK_SET);
+    
+    CDataReader d(m_fd, 200);             // Both in one gulp.
+    auto r = d.getBlock(50);              // Just the first.
+    EQ(size_t(20), r.s_nbytes);
+    d.done();
+    
+    r = d.getBlock(200);
+    EQ(size_t(100), r.s_nbytes);
+    EQ(size_t(1), r.s_nItems);
+    union {
+        const std::uint32_t* u_32;
+        const std::uint8_t*  u_8;
+    } p;
+    p.u_32 = reinterpret_cast<const std::uint32_t*>(r.s_pData);
+    EQ(std::uint32_t(100), *p.u_32);
+    p.u_32++;
+    for (int i =0; i < 100 - sizeof(uint32_t); i++ ) {
+        EQ(int(std::uint8_t(i*3)), int(*p.u_8));
+        p.u_8++;
+    }
+}
 // done when released is a logic error:
 
 void readertest::baddone() {
     CDataReader d(m_fd, 100);
     CPPUNIT_ASSERT_THROW(d.done(), std::logic_error);
-}
\ No newline at end of file
+}
+// Our buffer is recycled by done() so blocks don't persist.
+
+void readertest::persist() {
+    CDataReader d(m_fd, 100);
+    ASSERT(!d.blocksPersist());
+}
@@ -0,0 +1,231 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+/** @file:  roleBench.cpp
+ *  @brief: Throughput of the dealer/farmer/outputter roles without MPI.
+ *
+ *  The application runs in-process (AbstractApplication::runThreaded) so
+ *  no MPI launcher is needed.  The dealer hands out synthetic work items
+ *  using the same request/grant protocol as the real dealers, the
+ *  workers turn each ring item into an event with a fixed number of
+ *  parameters without doing any analysis (and without using tree
+ *  parameters, so any number of them can run) and the real farmer
+ *  (CMPIParameterFarmer) and outputter (CMPIParameterOutput, writing to
+ *  /dev/null) do the rest.  What's measured is therefore the role code
+ *  and the transport, not the analysis.
+ *
+ *  The benchmark runs with 1, 2, 4... workers up to the maximum and
+ *  reports the elapsed time and events per second for each.
+ *
+ *  Usage:
+ *  \verbatim
+ *     roleBench ?max-workers? ?events? ?params-per-event? ?events-per-item?
+ *  \endverbatim
+ *  max-workers defaults to 4, events to 1000000, params-per-event to 16
+ *  and events-per-item to 256.
+ */
+#include "AbstractApplication.h"
+#include "AnalysisRingItems.h"
+#include "MPIParameterFarmer.h"
+#include "MPIParameterOutput.h"
+#include "MPIWorkItemPrefetcher.h"
+#include "ParameterBatch.h"
+#include "ParameterReader.h"
+#include <stdlib.h>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <utility>
+#include <chrono>
+#include <cstdint>
+
+using namespace frib::analysis;
+
+static const std::uint32_t PHYSICS_EVENT(30);
+
+/**
+ * @class RoleBench
+ *    Application whose roles are:
+ *    - dealer    - deals the synthetic work items.
+ *    - farmer    - CMPIParameterFarmer.
+ *    - outputter - CMPIParameterOutput to /dev/null.
+ *    - workers   - make events from the work items.
+ */
+class RoleBench : public AbstractApplication {
+private:
+    unsigned m_nEvents;
+    unsigned m_nParams;
+    unsigned m_nItemEvents;
+public:
+    RoleBench(int argc, char** argv);
+    unsigned numEvents() const { return m_nEvents; }
+    
+    virtual void dealer(int argc, char** argv, AbstractApplication* pApp);
+    virtual void farmer(int argc, char** argv, AbstractApplication* pApp);
+    virtual void outputter(int argc, char** argv, AbstractApplication* pApp);
+    virtual void worker(int argc, char** argv, AbstractApplication* pApp);
+};
+
+/**
+ * @class NullOutput
+ *    Outputter that discards its output.
+ */
+class NullOutput : public CMPIParameterOutput {
+public:
+    virtual std::string getOutputFile(int argc, char** argv) {
+        return "/dev/null";
+    }
+};
+
+/**
+ * constructor
+ *    Pull the optional parameters off the command line.
+ */
+RoleBench::RoleBench(int argc, char** argv) :
+    AbstractApplication(argc, argv),
+    m_nEvents(1000000), m_nParams(16), m_nItemEvents(256)
+{
+    if (argc > 2) m_nEvents = strtoul(argv[2], nullptr, 0);
+    if (argc > 3) m_nParams = strtoul(argv[3], nullptr, 0);
+    if (argc > 4) m_nItemEvents = strtoul(argv[4], nullptr, 0);
+    if (m_nItemEvents == 0) m_nItemEvents = 1;
+}
+/**
+ * dealer
+ *    Grant requests with work items of minimal physics events, numbering
+ *    them so that the block number is the trigger of the first event.
+ */
+void
+RoleBench::dealer(int argc, char** argv, AbstractApplication* pApp)
+{
+    std::vector<RingItemHeader> block(m_nItemEvents);
+    for (auto& item : block) {
+        item.s_size   = sizeof(RingItemHeader);
+        item.s_type   = PHYSICS_EVENT;
+        item.s_unused = sizeof(std::uint32_t);
+    }
+    unsigned trigger = 0;
+    while (trigger < m_nEvents) {
+        FRIB_MPI_Request_Data request;
+        int dest = getRequest(&request);
+        unsigned nEvents = m_nItemEvents;
+        if (nEvents > (m_nEvents - trigger)) {
+            nEvents = m_nEvents - trigger;
+        }
+        size_t nBytes = workItemSize(
+            request, block.data(), nEvents*sizeof(RingItemHeader)
+        );
+        sendWorkItem(dest, trigger, block.data(), nBytes);
+        trigger += nBytes/sizeof(RingItemHeader);
+    }
+    sendEofs();
+}
+/**
+ * farmer
+ */
+void
+RoleBench::farmer(int argc, char** argv, AbstractApplication* pApp)
+{
+    CMPIParameterFarmer farmer(argc, argv, *pApp);
+    farmer();
+}
+/**
+ * outputter
+ */
+void
+RoleBench::outputter(int argc, char** argv, AbstractApplication* pApp)
+{
+    NullOutput outputter;
+    outputter(argc, argv, pApp);
+}
+/**
+ * worker
+ *    Each event gets m_nParams parameters.  Batches go to the farmer the
+ *    way CMPIRawToParametersWorker sends them.
+ */
+void
+RoleBench::worker(int argc, char** argv, AbstractApplication* pApp)
+{
+    CTransport& transport(this->transport());
+    CParameterBatch batch;
+    CMPIWorkItemPrefetcher prefetcher(
+        *this, 2, m_nItemEvents*sizeof(RingItemHeader)
+    );
+    std::vector<std::pair<unsigned, double>> event;
+    for (unsigned i = 0; i < m_nParams; i++) {
+        event.push_back(std::make_pair(i + 1, double(i)));
+    }
+    FRIB_MPI_Message_Header header;
+    while (prefetcher.next(header)) {
+        std::uint64_t trigger = header.s_nBlockNum;
+        size_t nEvents = header.s_nBytes/sizeof(RingItemHeader);
+        for (size_t i = 0; i < nEvents; i++) {
+            batch.addEvent(event, trigger++);
+            if (batch.full()) {
+                transport.send(
+                    batch.data(), batch.size(), CTransport::BYTES,
+                    FARMER_RANK, MPI_PARAMETER_BATCH_TAG
+                );
+                batch.clear();
+            }
+        }
+        if (!batch.empty()) {
+            transport.send(
+                batch.data(), batch.size(), CTransport::BYTES,
+                FARMER_RANK, MPI_PARAMETER_BATCH_TAG
+            );
+            batch.clear();
+        }
+    }
+    FRIB_MPI_Parameter_MessageHeader end;
+    end.s_triggerNumber = 0;
+    end.s_numParameters = 0;
+    end.s_end           = true;
+    transport.send(&end, 1, CTransport::PARAMETER_HEADER, FARMER_RANK, MPI_END_TAG);
+}
+
+// There's no parameter definition file.
+
+class CDummyReader : public CParameterReader {
+public:
+    CDummyReader() : CParameterReader("/dev/null") {}
+    virtual void read() {}
+};
+
+int main(int argc, char** argv)
+{
+    unsigned maxWorkers = 4;
+    if (argc > 1) maxWorkers = strtoul(argv[1], nullptr, 0);
+    
+    RoleBench app(argc, argv);
+    CDummyReader reader;
+    std::cout << std::setw(8) << "workers" << std::setw(12) << "seconds"
+        << std::setw(14) << "events/s" << std::endl;
+    for (unsigned nWorkers = 1; nWorkers <= maxWorkers; nWorkers *= 2) {
+        auto start = std::chrono::steady_clock::now();
+        app.runThreaded(reader, nWorkers);
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        double seconds = elapsed.count();
+        
+        std::cout << std::setw(8) << nWorkers
+            << std::setw(12) << std::fixed << std::setprecision(3) << seconds
+            << std::setw(14) << std::setprecision(0)
+            << app.numEvents()/seconds
+            << std::endl;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,159 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  sorterBench.cpp
+ *  @brief: Per item cost of CTriggerSorter at realistic disorder.
+ *
+ *  The farmer sees triggers in the order workers finish them.  This
+ *  emulates that: work items (blocks of consecutive triggers) are dealt
+ *  round robin to a number of workers whose events interleave.  The
+ *  resulting stream is fed to:
+ *     - map     - a std::map based sorter, which is how CTriggerSorter
+ *                 used to work.
+ *     - window  - CTriggerSorter.
+ *  and the cost per item is reported for several worker counts.
+ *  The item allocation is done up front so only the sorting is timed.
+ *
+ *  Usage:
+ *  \verbatim
+ *     sorterBench ?items? ?events-per-block?
+ *  \endverbatim
+ *  items defaults to 2000000 and events-per-block to 64.
+ */
+#include "TriggerSorter.h"
+#include "AnalysisRingItems.h"
+#include <stdlib.h>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <map>
+
+using namespace frib::analysis;
+
+/**
+ * @class MapSorter
+ *    The original std::map based reordering.
+ */
+class MapSorter {
+private:
+    std::map<std::uint64_t, pParameterItem> m_items;
+    std::uint64_t                           m_lastEmittedTrigger;
+public:
+    std::uint64_t                           m_nEmitted;
+    MapSorter() : m_lastEmittedTrigger(0-1), m_nEmitted(0) {}
+    void addItem(pParameterItem item) {
+        auto trigger = item->s_triggerCount;
+        if ((m_lastEmittedTrigger + 1) == trigger) {
+            m_nEmitted++;
+            m_lastEmittedTrigger++;
+            while (!m_items.empty()) {
+                auto p = m_items.begin();
+                if (p->first == (m_lastEmittedTrigger + 1)) {
+                    m_items.erase(p);
+                    m_nEmitted++;
+                    m_lastEmittedTrigger++;
+                } else {
+                    break;
+                }
+            }
+        } else {
+            m_items[trigger] = item;
+        }
+    }
+};
+/**
+ * @class WindowSorter
+ *    CTriggerSorter that just counts.
+ */
+class WindowSorter : public CTriggerSorter {
+public:
+    std::uint64_t m_nEmitted;
+    WindowSorter() : m_nEmitted(0) {}
+    virtual void emitItem(pParameterItem item) { m_nEmitted++; }
+};
+
+/**
+ * makeOrder
+ *    Produce the order in which nWorkers workers, each handed blocks
+ *    of nBlock triggers round robin, would deliver the triggers.
+ */
+static std::vector<std::uint64_t>
+makeOrder(std::uint64_t nItems, unsigned nWorkers, unsigned nBlock)
+{
+    std::vector<std::uint64_t> result;
+    result.reserve(nItems);
+    std::uint64_t nBlocks = (nItems + nBlock - 1)/nBlock;
+    for (std::uint64_t round = 0; round*nWorkers < nBlocks; round++) {
+        for (unsigned e = 0; e < nBlock; e++) {
+            for (unsigned w = 0; w < nWorkers; w++) {
+                std::uint64_t trigger = (round*nWorkers + w)*nBlock + e;
+                if (trigger < nItems) result.push_back(trigger);
+            }
+        }
+    }
+    return result;
+}
+
+int main(int argc, char** argv)
+{
+    std::uint64_t nItems = 2000000;
+    unsigned      nBlock = 64;
+    if (argc > 1) nItems = strtoull(argv[1], nullptr, 0);
+    if (argc > 2) nBlock = strtoul(argv[2], nullptr, 0);
+    if (nBlock == 0) nBlock = 1;
+    
+    std::vector<ParameterItem> items(nItems);
+    for (std::uint64_t i = 0; i < nItems; i++) {
+        items[i].s_header.s_size = sizeof(ParameterItem);
+        items[i].s_header.s_type = PARAMETER_DATA;
+        items[i].s_header.s_unused = sizeof(std::uint32_t);
+        items[i].s_triggerCount = i;
+        items[i].s_parameterCount = 0;
+    }
+    std::cout << "Items: " << nItems << " events/block: " << nBlock << std::endl;
+    std::cout << std::setw(8) << "workers" << std::setw(14) << "map ns/item"
+        << std::setw(16) << "window ns/item" << std::endl;
+    
+    unsigned workers[] = {1, 8, 64, 512};
+    for (auto w : workers) {
+        auto order = makeOrder(nItems, w, nBlock);
+        
+        MapSorter ms;
+        auto start = std::chrono::steady_clock::now();
+        for (auto t : order) ms.addItem(&items[t]);
+        std::chrono::duration<double> mapTime = std::chrono::steady_clock::now() - start;
+        
+        double windowSeconds;
+        {
+            WindowSorter ws;
+            start = std::chrono::steady_clock::now();
+            for (auto t : order) ws.addItem(&items[t]);
+            std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+            windowSeconds = d.count();
+            if ((ws.m_nEmitted != nItems) || (ms.m_nEmitted != nItems)) {
+                std::cerr << "Sorters did not emit all items!\n";
+                return EXIT_FAILURE;
+            }
+        }
+        std::cout << std::setw(8) << w
+            << std::setw(14) << std::fixed << std::setprecision(1)
+            << mapTime.count()*1.0e9/nItems
+            << std::setw(16) << windowSeconds*1.0e9/nItems << std::endl;
+    }
+    return EXIT_SUCCESS;
+}
@@ -24,8 +24,13 @@
 #define private public
 #include "TriggerSorter.h"
 #undef private
+#include "ParameterItemPool.h"
+#include "ParameterBatch.h"
+#include "ParameterCompressor.h"
 #include <vector>
 #include <cstdint>
+#include <cstring>
+#include <stdexcept>
 
 using namespace frib::analysis;
 
@@ -38,6 +43,32 @@ struct CMyTriggerSorter : public CTriggerSorter {
         delete item;
     }
 };
+// Records the runs emitted from blocks as well:
+
+struct CRunSorter : public CTriggerSorter {
+    std::vector<std::uint64_t> m_triggers;
+    std::vector<size_t>        m_runs;     // 0 for a single item.
+    
+    CRunSorter(CParameterItemPool* pPool) :
+        CTriggerSorter(DEFAULT_CAPACITY, pPool) {}
+    virtual void emitItem(pParameterItem item) {
+        m_triggers.push_back(item->s_triggerCount);
+        m_runs.push_back(0);
+        releaseItem(item);
+    }
+    virtual void emitItems(
+        const ParameterItem* pFirst, size_t nItems, size_t nBytes
+    ) {
+        const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(pFirst);
+        const std::uint8_t* pEnd = p + nBytes;
+        while (p < pEnd) {
+            const ParameterItem* pItem = reinterpret_cast<const ParameterItem*>(p);
+            m_triggers.push_back(pItem->s_triggerCount);
+            p += pItem->s_header.s_size;
+        }
+        m_runs.push_back(nItems);
+    }
+};
 
 class sorttest : public CppUnit::TestFixture {
     CPPUNIT_TEST_SUITE(sorttest);
@@ -51,6 +82,25 @@ class sorttest : public CppUnit::TestFixture {
     
     CPPUNIT_TEST(flush_1);
     CPPUNIT_TEST(flush_2);
+    
+    CPPUNIT_TEST(window_1);
+    CPPUNIT_TEST(window_2);
+    CPPUNIT_TEST(window_3);
+    CPPUNIT_TEST(window_4);
+    CPPUNIT_TEST(late_1);
+    CPPUNIT_TEST(late_2);
+    
+    CPPUNIT_TEST(block_1);
+    CPPUNIT_TEST(block_2);
+    CPPUNIT_TEST(block_3);
+    CPPUNIT_TEST(block_4);
+    CPPUNIT_TEST(block_5);
+    CPPUNIT_TEST(block_6);
+    CPPUNIT_TEST(block_7);
+    CPPUNIT_TEST(first_1);
+    CPPUNIT_TEST(first_2);
+    CPPUNIT_TEST(first_3);
+    CPPUNIT_TEST(first_4);
     CPPUNIT_TEST_SUITE_END();
     
 private:
@@ -73,6 +123,32 @@ protected:
     
     void flush_1();
     void flush_2();
+    
+    void window_1();
+    void window_2();
+    void window_3();
+    void window_4();
+    void late_1();
+    void late_2();
+    
+    void block_1();
+    void block_2();
+    void block_3();
+    void block_4();
+    void block_5();
+    void block_6();
+    void block_7();
+    
+    void first_1();
+    void first_2();
+    void first_3();
+    void first_4();
+private:
+    pParameterItem makeItem(std::uint64_t trigger);
+    void* makeBlock(
+        CParameterItemPool& pool, std::uint64_t first, size_t n,
+        size_t& nBytes
+    );
 };
 
 CPPUNIT_TEST_SUITE_REGISTRATION(sorttest);
@@ -80,7 +156,9 @@ CPPUNIT_TEST_SUITE_REGISTRATION(sorttest);
 void sorttest::construct_1()
 {
     EQ(std::uint64_t(0-1), m_pSorter->m_lastEmittedTrigger);
-    ASSERT(m_pSorter->m_items.empty());
+    EQ(size_t(0), m_pSorter->m_nPending);
+    ASSERT(m_pSorter->m_late.empty());
+    EQ(CTriggerSorter::DEFAULT_CAPACITY, m_pSorter->capacity());
     ASSERT(m_pSorter->m_triggers.empty());
 }
 // flush  after construction does nothing.
@@ -214,4 +292,396 @@ void sorttest::flush_2()
     delete m_pSorter;
     
     m_pSorter = nullptr;
-}
\ No newline at end of file
+}
+
+// Make an empty item with the specified trigger:
+
+pParameterItem
+sorttest::makeItem(std::uint64_t trigger)
+{
+    pParameterItem pItem = new ParameterItem;
+    pItem->s_header.s_size = sizeof(ParameterItem);
+    pItem->s_header.s_type = PARAMETER_DATA;
+    pItem->s_header.s_unused = sizeof(std::uint32_t);
+    pItem->s_triggerCount = trigger;
+    pItem->s_parameterCount = 0;
+    return pItem;
+}
+// Window capacity is rounded up to a power of 2.
+
+void sorttest::window_1()
+{
+    struct Sorter : public CTriggerSorter {
+        Sorter(size_t n) : CTriggerSorter(n) {}
+        virtual void emitItem(pParameterItem item) { delete item; }
+    };
+    Sorter s(100);
+    EQ(size_t(128), s.capacity());
+    EQ(std::uint64_t(127), s.m_nMask);
+    Sorter s2(64);
+    EQ(size_t(64), s2.capacity());
+}
+// Items beyond the window grow it and are still emitted in order.
+
+void sorttest::window_2()
+{
+    size_t n = 3*CTriggerSorter::DEFAULT_CAPACITY;
+    for (size_t i = n; i > 0; i--) {
+        m_pSorter->addItem(makeItem(i));
+    }
+    ASSERT(m_pSorter->capacity() >= n);
+    EQ(n, m_pSorter->m_nPending);
+    ASSERT(m_pSorter->m_triggers.empty());
+    
+    m_pSorter->addItem(makeItem(0));
+    EQ(n+1, m_pSorter->m_triggers.size());
+    for (size_t i = 0; i <= n; i++) {
+        EQ(std::uint64_t(i), m_pSorter->m_triggers.at(i));
+    }
+    EQ(size_t(0), m_pSorter->m_nPending);
+}
+// The window wraps around many times as triggers advance.
+
+void sorttest::window_3()
+{
+    size_t n = 10*CTriggerSorter::DEFAULT_CAPACITY;
+    for (size_t i = 0; i < n; i += 2) {    // pairs swapped.
+        m_pSorter->addItem(makeItem(i+1));
+        m_pSorter->addItem(makeItem(i));
+    }
+    EQ(CTriggerSorter::DEFAULT_CAPACITY, m_pSorter->capacity());
+    EQ(n, m_pSorter->m_triggers.size());
+    for (size_t i = 0; i < n; i++) {
+        EQ(std::uint64_t(i), m_pSorter->m_triggers.at(i));
+    }
+}
+// Growing when the window doesn't start at slot 0 re-indexes properly.
+
+void sorttest::window_4()
+{
+    size_t cap = CTriggerSorter::DEFAULT_CAPACITY;
+    for (size_t i = 0; i < cap - 10; i++) {
+        m_pSorter->addItem(makeItem(i));
+    }
+    for (size_t i = 3*cap; i > cap - 10; i--) {
+        m_pSorter->addItem(makeItem(i));
+    }
+    m_pSorter->addItem(makeItem(cap - 10));
+    EQ(3*cap + 1, m_pSorter->m_triggers.size());
+    for (size_t i = 0; i <= 3*cap; i++) {
+        EQ(std::uint64_t(i), m_pSorter->m_triggers.at(i));
+    }
+}
+// An item for a trigger we've already emitted doesn't block later ones
+// and comes out at flush.
+
+void sorttest::late_1()
+{
+    m_pSorter->addItem(makeItem(0));
+    m_pSorter->addItem(makeItem(1));
+    m_pSorter->addItem(makeItem(0));        // late.
+    m_pSorter->addItem(makeItem(2));
+    
+    EQ(size_t(3), m_pSorter->m_triggers.size());
+    EQ(size_t(1), m_pSorter->m_late.size());
+    
+    m_pSorter->flush();
+    EQ(size_t(4), m_pSorter->m_triggers.size());
+    EQ(std::uint64_t(0), m_pSorter->m_triggers.at(3));
+    ASSERT(m_pSorter->m_late.empty());
+}
+// Duplicates of waiting items are kept and flush merges them
+// in trigger order with the window.
+
+void sorttest::late_2()
+{
+    m_pSorter->addItem(makeItem(5));
+    m_pSorter->addItem(makeItem(3));
+    m_pSorter->addItem(makeItem(5));        // duplicate.
+    m_pSorter->addItem(makeItem(8));
+    
+    ASSERT(m_pSorter->m_triggers.empty());
+    m_pSorter->flush();
+    
+    std::uint64_t expected[] = {3, 5, 5, 8};
+    EQ(size_t(4), m_pSorter->m_triggers.size());
+    for (int i = 0; i < 4; i++) {
+        EQ(expected[i], m_pSorter->m_triggers.at(i));
+    }
+    EQ(size_t(0), m_pSorter->m_nPending);
+}
+/**
+ * makeBlock
+ *    Make a block of events with sequential triggers in pool storage.
+ * @param pool  - pool to allocate the block from.
+ * @param first - first trigger.
+ * @param n     - number of events.
+ * @param[out] nBytes - size of the block.
+ * @return void* - the block.
+ */
+void*
+sorttest::makeBlock(
+    CParameterItemPool& pool, std::uint64_t first, size_t n, size_t& nBytes
+)
+{
+    CParameterBatch batch(n, 1024*1024);
+    std::vector<std::pair<unsigned, double>> event = {{1, 1.0}};
+    for (size_t i = 0; i < n; i++) {
+        batch.addEvent(event, first + i);
+    }
+    nBytes = batch.size();
+    void* pBlock = pool.allocate(nBytes);
+    memcpy(pBlock, batch.data(), nBytes);
+    return pBlock;
+}
+// An in order block comes out as a single run and is given back to the
+// pool.
+
+void sorttest::block_1()
+{
+    CParameterItemPool pool;
+    {
+        CRunSorter s(&pool);
+        size_t nBytes;
+        void* pBlock = makeBlock(pool, 0, 10, nBytes);
+        s.addBlock(pBlock, nBytes);
+        
+        EQ(size_t(1), s.m_runs.size());
+        EQ(size_t(10), s.m_runs[0]);
+        EQ(size_t(10), s.m_triggers.size());
+        for (int i = 0; i < 10; i++) {
+            EQ(std::uint64_t(i), s.m_triggers[i]);
+        }
+        EQ(size_t(0), pool.getStatistics().s_itemsInUse);
+    }
+}
+// A block that's ahead is held until the block in front of it arrives.
+// Each comes out as a run.
+
+void sorttest::block_2()
+{
+    CParameterItemPool pool;
+    CRunSorter s(&pool);
+    size_t n1, n2;
+    void* p2 = makeBlock(pool, 10, 10, n2);
+    s.addBlock(p2, n2);
+    ASSERT(s.m_runs.empty());
+    EQ(size_t(1), pool.getStatistics().s_itemsInUse);
+    
+    void* p1 = makeBlock(pool, 0, 10, n1);
+    s.addBlock(p1, n1);
+    EQ(size_t(2), s.m_runs.size());
+    EQ(size_t(10), s.m_runs[0]);
+    EQ(size_t(10), s.m_runs[1]);
+    for (int i = 0; i < 20; i++) {
+        EQ(std::uint64_t(i), s.m_triggers.at(i));
+    }
+    EQ(size_t(0), pool.getStatistics().s_itemsInUse);
+}
+// Single items split runs and come out in order.
+
+void sorttest::block_3()
+{
+    CParameterItemPool pool;
+    CRunSorter s(&pool);
+    size_t n1, n2;
+    void* p1 = makeBlock(pool, 0, 5, n1);
+    void* p2 = makeBlock(pool, 6, 5, n2);
+    s.addBlock(p2, n2);
+    s.addBlock(p1, n1);                 // 0-4 out.
+    
+    pParameterItem pItem = pool.allocateItem(0);
+    pItem->s_triggerCount = 5;
+    s.addItem(pItem);                   // 5 and 6-10 out.
+    
+    EQ(size_t(3), s.m_runs.size());
+    EQ(size_t(5), s.m_runs[0]);
+    EQ(size_t(0), s.m_runs[1]);
+    EQ(size_t(5), s.m_runs[2]);
+    EQ(size_t(11), s.m_triggers.size());
+    for (int i = 0; i < 11; i++) {
+        EQ(std::uint64_t(i), s.m_triggers[i]);
+    }
+    EQ(size_t(0), pool.getStatistics().s_itemsInUse);
+}
+// Interleaved triggers in two blocks give single item runs and the
+// blocks are held until their last item goes out - including at flush.
+
+void sorttest::block_4()
+{
+    CParameterItemPool pool;
+    CRunSorter s(&pool);
+    CParameterBatch even(100, 1024*1024);
+    CParameterBatch odd(100, 1024*1024);
+    std::vector<std::pair<unsigned, double>> event;
+    for (int i = 1; i < 10; i++) {
+        if (i % 2) {
+            odd.addEvent(event, i);
+        } else {
+            even.addEvent(event, i);
+        }
+    }
+    void* pOdd = pool.allocate(odd.size());
+    memcpy(pOdd, odd.data(), odd.size());
+    void* pEven = pool.allocate(even.size());
+    memcpy(pEven, even.data(), even.size());
+    
+    s.addBlock(pOdd, odd.size());
+    s.addBlock(pEven, even.size());
+    ASSERT(s.m_runs.empty());            // 0 is missing.
+    EQ(size_t(2), pool.getStatistics().s_itemsInUse);
+    
+    s.flush();
+    EQ(size_t(9), s.m_runs.size());
+    for (int i = 0; i < 9; i++) {
+        EQ(size_t(1), s.m_runs[i]);
+        EQ(std::uint64_t(i+1), s.m_triggers[i]);
+    }
+    EQ(size_t(0), pool.getStatistics().s_itemsInUse);
+}
+// Sorters that don't override emitItems get copies of block items
+// via emitItem.
+
+void sorttest::block_5()
+{
+    CParameterBatch batch(100, 1024*1024);
+    std::vector<std::pair<unsigned, double>> event;
+    for (int i = 0; i < 5; i++) {
+        batch.addEvent(event, i);
+    }
+    std::uint8_t* pBlock = new std::uint8_t[batch.size()];
+    memcpy(pBlock, batch.data(), batch.size());
+    m_pSorter->addBlock(pBlock, batch.size());
+    
+    EQ(size_t(5), m_pSorter->m_triggers.size());
+    for (int i = 0; i < 5; i++) {
+        EQ(std::uint64_t(i), m_pSorter->m_triggers[i]);
+    }
+}
+// Malformed blocks throw and aren't kept.  Blocks still held at destruction
+// are released.
+
+void sorttest::block_6()
+{
+    CParameterItemPool pool;
+    {
+        CRunSorter s(&pool);
+        size_t nBytes;
+        void* pBlock = makeBlock(pool, 1, 3, nBytes);
+        CPPUNIT_ASSERT_THROW(
+            s.addBlock(pBlock, nBytes - 1), std::logic_error
+        );
+        ASSERT(s.m_triggers.empty());
+        EQ(size_t(0), s.m_nPending);
+        
+        s.addBlock(pBlock, nBytes);
+        EQ(size_t(3), s.m_nPending);
+    }
+    EQ(size_t(0), pool.getStatistics().s_itemsInUse);
+}
+// A compressed frame is sorted by its first trigger and accounts for all
+// of its triggers.
+
+void sorttest::block_7()
+{
+    CParameterItemPool pool;
+    {
+        CRunSorter s(&pool);
+        std::vector<void*> frames;
+        std::vector<size_t> sizes;
+        for (std::uint64_t first : {5, 0}) {
+            size_t nBytes;
+            void* pItems = makeBlock(pool, first, 5, nBytes);
+            CParameterCompressor c;
+            c.add(pItems, nBytes);
+            pool.release(reinterpret_cast<pParameterItem>(pItems));
+            
+            void* pFrame = pool.allocate(c.size());
+            memcpy(pFrame, c.data(), c.size());
+            frames.push_back(pFrame);
+            sizes.push_back(c.size());
+        }
+        size_t nBytes;
+        void* pItems = makeBlock(pool, 10, 2, nBytes);
+        
+        s.addBlock(frames[0], sizes[0]);
+        s.addBlock(pItems, nBytes);
+        ASSERT(s.m_runs.empty());
+        s.addBlock(frames[1], sizes[1]);
+        
+        std::vector<std::uint64_t> triggers = {0, 5, 10, 11};
+        std::vector<size_t>        runs     = {1, 1, 2};
+        ASSERT(triggers == s.m_triggers);
+        ASSERT(runs == s.m_runs);
+        EQ(size_t(0), s.m_nPending);
+        EQ(std::uint64_t(11), s.m_lastEmittedTrigger);
+    }
+    EQ(size_t(0), pool.getStatistics().s_itemsInUse);
+}
+// Triggers that start after 0 are emitted as they arrive once the
+// sorter is told where they start, without growing the window.
+
+void sorttest::first_1()
+{
+    std::uint64_t first = 1000000;
+    m_pSorter->setFirstTrigger(first);
+    m_pSorter->addItem(makeItem(first + 1));
+    EQ(size_t(0), m_pSorter->m_triggers.size());
+    m_pSorter->addItem(makeItem(first));
+    EQ(size_t(2), m_pSorter->m_triggers.size());
+    EQ(first, m_pSorter->m_triggers.at(0));
+    EQ(first + 1, m_pSorter->m_triggers.at(1));
+    EQ(CTriggerSorter::DEFAULT_CAPACITY, m_pSorter->capacity());
+}
+// The first trigger can't be set while items are waiting.
+
+void sorttest::first_2()
+{
+    m_pSorter->addItem(makeItem(2));
+    EXCEPTION(m_pSorter->setFirstTrigger(2), std::logic_error);
+    m_pSorter->flush();
+    m_pSorter->setFirstTrigger(10);         // Fine once they're out.
+    m_pSorter->addItem(makeItem(10));
+    EQ(size_t(2), m_pSorter->m_triggers.size());
+    EQ(std::uint64_t(10), m_pSorter->m_triggers.at(1));
+}
+// Triggers that start far from 0 without setFirstTrigger are held in the
+// overflow map rather than sizing the window to the gap.
+
+void sorttest::first_3()
+{
+    std::uint64_t first = 1000000000000;
+    for (std::uint64_t i = 0; i < 10; i++) {
+        m_pSorter->addItem(makeItem(first + 9 - i));
+    }
+    EQ(CTriggerSorter::DEFAULT_CAPACITY, m_pSorter->capacity());
+    EQ(size_t(10), m_pSorter->m_overflow.size());
+    ASSERT(m_pSorter->m_triggers.empty());
+    
+    m_pSorter->flush();
+    EQ(size_t(10), m_pSorter->m_triggers.size());
+    for (std::uint64_t i = 0; i < 10; i++) {
+        EQ(first + i, m_pSorter->m_triggers.at(i));
+    }
+    ASSERT(m_pSorter->m_overflow.empty());
+}
+// Overflow items move into the window and are emitted in order once
+// the triggers reach them.
+
+void sorttest::first_4()
+{
+    std::uint64_t far = CTriggerSorter::MAX_CAPACITY + 10;
+    m_pSorter->addItem(makeItem(far + 1));
+    m_pSorter->addItem(makeItem(far));
+    EQ(size_t(2), m_pSorter->m_overflow.size());
+    
+    for (std::uint64_t i = 0; i < far; i++) {
+        m_pSorter->addItem(makeItem(i));
+    }
+    EQ(size_t(far + 2), m_pSorter->m_triggers.size());
+    EQ(far, m_pSorter->m_triggers.at(far));
+    EQ(far + 1, m_pSorter->m_triggers.at(far + 1));
+    ASSERT(m_pSorter->m_overflow.empty());
+    EQ(size_t(0), m_pSorter->m_nPending);
+    EQ(CTriggerSorter::DEFAULT_CAPACITY, m_pSorter->capacity());
+}
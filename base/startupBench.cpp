@@ -0,0 +1,130 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+/** @file:  startupBench.cpp
+ *  @brief: Time from starting an MPI application to its roles running.
+ *
+ *  Startup includes MPI_Init, reading the parameter definition file
+ *  and making the transport.  A Tcl definition file with a number of
+ *  16 element tree parameter arrays and tree variable arrays is read
+ *  with CTCLParameterReader.  Each rank measures the time from calling
+ *  the application to entering its role; the largest of those is
+ *  reported along with the number of ranks.
+ *
+ *  Usage:
+ *  \verbatim
+ *     mpirun -np n startupBench ?arrays?
+ *  \endverbatim
+ *  arrays defaults to 1000 (16000 parameters and 16000 variables).
+ */
+#include "AbstractApplication.h"
+#include "TCLParameterReader.h"
+#include <mpi.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <chrono>
+
+using namespace frib::analysis;
+
+static std::chrono::steady_clock::time_point start;
+
+/**
+ * @class StartupBench
+ *    Every role just reports how long it took to get there.
+ */
+class StartupBench : public AbstractApplication {
+public:
+    StartupBench(int argc, char** argv) : AbstractApplication(argc, argv) {}
+    virtual void dealer(int argc, char** argv, AbstractApplication* pApp) {
+        report();
+    }
+    virtual void farmer(int argc, char** argv, AbstractApplication* pApp) {
+        report();
+    }
+    virtual void outputter(int argc, char** argv, AbstractApplication* pApp) {
+        report();
+    }
+    virtual void worker(int argc, char** argv, AbstractApplication* pApp) {
+        report();
+    }
+private:
+    void report();
+};
+
+/**
+ * report
+ *    Rank 0 prints the largest startup time of any rank.
+ */
+void
+StartupBench::report()
+{
+    std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+    double seconds = d.count();
+    double maxSeconds;
+    MPI_Reduce(&seconds, &maxSeconds, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    int rank;
+    int size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    if (rank == 0) {
+        std::cout << std::setw(8) << "ranks" << std::setw(12) << "seconds"
+            << std::endl;
+        std::cout << std::setw(8) << size << std::setw(12) << maxSeconds
+            << std::endl;
+    }
+}
+/**
+ * writeConfig
+ *    Write the definition file.
+ * @param filename - where to write it.
+ * @param nArrays  - number of tree parameter (and variable) arrays.
+ */
+static void
+writeConfig(const std::string& filename, unsigned nArrays)
+{
+    std::ofstream f(filename);
+    for (unsigned i = 0; i < nArrays; i++) {
+        f << "treeparameterarray p" << i << " 0 4096 4096 channels 16 0\n";
+        f << "treevariablearray v" << i << " 1.0 keV 16 0\n";
+    }
+}
+
+int main(int argc, char** argv)
+{
+    unsigned nArrays = 1000;
+    if (argc > 1) nArrays = strtoul(argv[1], nullptr, 0);
+    
+    // Every process writes a file since only MPI knows which is rank 0.
+    
+    std::stringstream name;
+    name << "/tmp/startupBench." << getpid() << ".tcl";
+    std::string filename = name.str();
+    writeConfig(filename, nArrays);
+    
+    CTCLParameterReader reader(filename.c_str());
+    StartupBench app(argc, argv);
+    start = std::chrono::steady_clock::now();
+    app(reader);
+    
+    unlink(filename.c_str());
+    return EXIT_SUCCESS;
+}
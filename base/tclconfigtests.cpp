@@ -34,6 +34,7 @@
 #define private public
 #include "TreeParameter.h"
 #include "TreeVariable.h"
+#include "AnalysisRingItems.h"
 #undef private
 using namespace frib::analysis;
 
@@ -47,9 +48,12 @@ class TclConfigtest : public CppUnit::TestFixture {
     CPPUNIT_TEST(treeparam_1);
     CPPUNIT_TEST(treeparam_2);
     CPPUNIT_TEST(treeparam_3);
+    CPPUNIT_TEST(treeparam_4);
+    CPPUNIT_TEST(treeparam_5);
     
     CPPUNIT_TEST(treeparamarray_1);
     CPPUNIT_TEST(treeparamarray_2);
+    CPPUNIT_TEST(treeparamarray_3);
     
     CPPUNIT_TEST(treevariable_1);
     CPPUNIT_TEST(treevariable_2);
@@ -62,9 +66,12 @@ protected:
     void treeparam_1();
     void treeparam_2();
     void treeparam_3();
+    void treeparam_4();
+    void treeparam_5();
     
     void treeparamarray_1();
     void treeparamarray_2();
+    void treeparamarray_3();
     
     void treevariable_1();
     void treevariable_2();
@@ -181,6 +188,42 @@ void TclConfigtest::treeparam_3() {
 }
 // single treeeparameterarray definiition
 
+// storage types:
+
+void TclConfigtest::treeparam_4() {
+    const char* script =
+        "treeparameter a 0 1024 512 none\n\
+        treeparameter b 0 1024 512 none double\n\
+        treeparameter c -1.5 1.5 1024 MeV float32\n\
+        treeparameter d 0 16384 16384 chans uint16\n\
+        treeparameter e 0 1e6 1000 chans uint32\n";
+    write(m_fd, script, strlen(script));
+    close(m_fd);
+    
+    CTCLParameterReader reader(m_filename.c_str());
+    CPPUNIT_ASSERT_NO_THROW(reader.read());
+    
+    auto defs = CTreeParameter::getDefinitions();
+    EQ(size_t(5), defs.size());
+    EQ(VALUE_DOUBLE, defs[0].second.s_storage);
+    EQ(VALUE_DOUBLE, defs[1].second.s_storage);
+    EQ(VALUE_FLOAT32, defs[2].second.s_storage);
+    EQ(VALUE_UINT16, defs[3].second.s_storage);
+    EQ(VALUE_UINT32, defs[4].second.s_storage);
+    EQ(std::string("MeV"), defs[2].second.s_units);
+}
+// Too many words after a valid type:
+
+void TclConfigtest::treeparam_5() {
+    const char* script =
+        "treeparameter test 0 1024 512 none uint16 extra\n";
+    write(m_fd, script, strlen(script));
+    close(m_fd);
+    
+    CTCLParameterReader reader(m_filename.c_str());
+    CPPUNIT_ASSERT_THROW(reader.read(), std::runtime_error);
+}
+
 void TclConfigtest::treeparamarray_1()
 {
     const char* script =
@@ -217,6 +260,24 @@ void TclConfigtest::treeparamarray_2() {
     CTCLParameterReader reader(m_filename.c_str());
     CPPUNIT_ASSERT_THROW(reader.read(), std::runtime_error);
 }
+// storage type for all elements:
+
+void TclConfigtest::treeparamarray_3() {
+    const char* script =
+        "treeparameterarray test 0 4096 4096 chans 16 0 uint16\n";
+        
+    write(m_fd, script, strlen(script));
+    close(m_fd);
+    
+    CTCLParameterReader reader(m_filename.c_str());
+    CPPUNIT_ASSERT_NO_THROW(reader.read());
+    
+    auto defs = CTreeParameter::getDefinitions();
+    EQ(size_t(16), defs.size());
+    for (int i =0; i < defs.size(); i++) {
+        EQ(VALUE_UINT16, defs[i].second.s_storage);
+    }
+}
 // single tree variable:
 
 void TclConfigtest::treevariable_1() {
@@ -275,6 +275,7 @@ MyApp::nextItem(int fd) {
     FRIB_MPI_Request_Data request;
     request.s_requestor =  3;    // My rank.
     request.s_maxdata   = 1024;  //Ignored anyway.
+    request.s_credits   = 0;
     
     // for MPI_Error_string:
     
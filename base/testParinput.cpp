@@ -23,8 +23,10 @@
 #include "MPIParameterDealer.h"
 #include "ParameterReader.h"
 #include "AnalysisRingItems.h"
+#include "Transport.h"
 #include <stdexcept>
 #include <memory>
+#include <vector>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -149,47 +151,51 @@ MyApp::worker(int argc, char** argv, AbstractApplication* pApp) {
     std::uint32_t numItems;
     MPI_Status status;
     int stat;
+    std::vector<std::uint32_t> ids;      // We consume all parameters.
     // These block determine when the dynamic data are released.
     
     // Parameter definitions:
     {
-        stat = MPI_Recv(&numItems, 1, MPI_UINT32_T, 0, MPI_PARAMDEF_TAG, MPI_COMM_WORLD, &status);
-        pApp->throwMPIError(stat, "Unable to get number of parameter definitions");
+        pApp->transport().receiveBroadcast(
+            &numItems, 1, CTransport::UINT32, 0, FIRST_WORKER_RANK, MPI_PARAMDEF_TAG
+        );
         if (write(fd, &numItems, sizeof(numItems)) < 0) {
             throw std::runtime_error("Failed to write # param defs to file");
         }
         
         
         std::unique_ptr<FRIB_MPI_ParameterDef> pData(new FRIB_MPI_ParameterDef[numItems]);
-        stat = MPI_Recv(
-            pData.get(), numItems, pApp->parameterDefType(),
-            0, MPI_PARAMDEF_TAG, MPI_COMM_WORLD, &status
+        pApp->transport().receiveBroadcast(
+            pData.get(), numItems, CTransport::PARAMETER_DEF,
+            0, FIRST_WORKER_RANK, MPI_PARAMDEF_TAG
         );
-        pApp->throwMPIError(stat, "Could not read parameter defs");
         
         if (write(fd, pData.get(), numItems*sizeof(FRIB_MPI_ParameterDef)) < 0) {
             throw std::runtime_error("Unable to write parameter defs to file");
         }
-        
+                for (int i = 0; i < numItems; i++) {
+            ids.push_back(pData.get()[i].s_parameterId);
+        }
+
         
     }
     // Variable defs/values:
 
     {
         
-        stat = MPI_Recv(&numItems, 1, MPI_UINT32_T, 0, MPI_VARIABLES_TAG, MPI_COMM_WORLD, &status);
-        pApp->throwMPIError(stat, "Unable to get number of Variable definitions");
+        pApp->transport().receiveBroadcast(
+            &numItems, 1, CTransport::UINT32, 0, FIRST_WORKER_RANK, MPI_VARIABLES_TAG
+        );
         if (write(fd, &numItems, sizeof(numItems)) < 0) {
             throw std::runtime_error("Failed to write # variable defs to file");
         }
         
         
         std::unique_ptr<FRIB_MPI_VariableDef> pData(new FRIB_MPI_VariableDef[numItems]);
-        stat = MPI_Recv(
-            pData.get(), numItems, pApp->variableDefType(),
-            0, MPI_VARIABLES_TAG, MPI_COMM_WORLD, &status
+        pApp->transport().receiveBroadcast(
+            pData.get(), numItems, CTransport::VARIABLE_DEF,
+            0, FIRST_WORKER_RANK, MPI_VARIABLES_TAG
         );
-        pApp->throwMPIError(stat, "Could not read variable def/value block");
         
         if (write(fd, pData.get(), numItems*sizeof(FRIB_MPI_VariableDef)) < 0) {
             throw std::runtime_error("Could not write variable defs");
@@ -198,34 +204,39 @@ MyApp::worker(int argc, char** argv, AbstractApplication* pApp) {
     }
     
     
-    // Get the parameter data
+    // Tell the dealer which parameters we consume:
+    
+    numItems = ids.size();
+    stat = MPI_Send(&numItems, 1, MPI_UINT32_T, 0, MPI_PROJECTION_TAG, MPI_COMM_WORLD);
+    pApp->throwMPIError(stat, "Unable to send number of consumed parameters");
+    if (numItems) {
+        stat = MPI_Send(
+            ids.data(), numItems, MPI_UINT32_T, 0, MPI_PROJECTION_TAG, MPI_COMM_WORLD
+        );
+        pApp->throwMPIError(stat, "Unable to send consumed parameter ids");
+    }
+    
+    // Get the parameter data - blocks of PARAMETER_DATA ring items.
     
     while (1) {
         pApp->requestData(1024*1024);
-        FRIB_MPI_Parameter_MessageHeader hdr;
+        FRIB_MPI_Message_Header hdr;
         stat = MPI_Recv(
-            &hdr, 1, pApp->parameterHeaderDataType(),
+            &hdr, 1, pApp->messageHeaderType(),
             0, MPI_HEADER_TAG, MPI_COMM_WORLD, &status
         );
         pApp->throwMPIError(stat, "Unable to get data header");
         
         if (hdr.s_end) break;
         
-        if (write(fd, &hdr, sizeof(hdr)) < 0) {
-            throw std::runtime_error("Failed to write header");
-        }
-        
-        
-        std::unique_ptr<FRIB_MPI_Parameter_Value> pData(new FRIB_MPI_Parameter_Value[hdr.s_numParameters]);
+        std::unique_ptr<std::uint8_t[]> pData(new std::uint8_t[hdr.s_nBytes]);
         stat = MPI_Recv(
-            pData.get(), hdr.s_numParameters, pApp->parameterValueDataType(),
+            pData.get(), hdr.s_nBytes, MPI_UINT8_T,
             0, MPI_DATA_TAG, MPI_COMM_WORLD, &status
         );
         pApp->throwMPIError(stat, "Could not get data body");
         
-        if (write(
-            fd, pData.get(), hdr.s_numParameters*sizeof(FRIB_MPI_Parameter_Value
-        )) < 0) {
+        if (write(fd, pData.get(), hdr.s_nBytes) < 0) {
             throw std::runtime_error("Unable to write payload data");
         }
         
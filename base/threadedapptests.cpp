@@ -0,0 +1,635 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+
+/** @file:  threadedapptests.cpp
+ *  @brief: Run an application with AbstractApplication::runThreaded.
+ */
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/Asserter.h>
+#include "Asserts.h"
+
+#include "AbstractApplication.h"
+#include "MPIRawToParametersWorker.h"
+#include "MPIParameterFarmer.h"
+#include "MPIParameterOutput.h"
+#include "MPIRawReader.h"
+#include "ColumnarReader.h"
+#include "InflatingDataReader.h"
+#include "MappedDataReader.h"
+#include "TriggerIndex.h"
+#include "TreeParameterArray.h"
+#include "ParameterReader.h"
+#include "AnalysisRingItems.h"
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <cstdint>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace frib::analysis;
+
+static const std::uint32_t PHYSICS_EVENT = 30;
+static const std::uint32_t BEGIN_RUN = 1;
+static const std::uint32_t END_RUN = 2;
+static const std::uint32_t SCALERS = 20;
+static const unsigned      NUM_EVENTS = 10000;
+
+// The parameter array is made by the parameter reader, before the role
+// threads start, so the workers never modify the dictionary.  The reader
+// also sets how the array's values are stored, as a configuration file can.
+
+static CTreeParameterArray* pArray(nullptr);
+
+class ThreadParameterReader : public CParameterReader {
+    std::uint32_t m_storage;
+public:
+    ThreadParameterReader(std::uint32_t storage = VALUE_DOUBLE) :
+        CParameterReader("/dev/null"), m_storage(storage) {}
+    virtual void read() {
+        if (!pArray) {
+            pArray = new CTreeParameterArray("threadarray", 16, 0);
+        }
+        for (int i = 0; i < 16; i++) {
+            (*pArray)[i].setStorage(m_storage);
+        }
+    }
+};
+// Each physics event holds its index.  The worker sets index%10 + 1
+// parameters so that the output can be checked no matter which worker
+// got which event.
+
+class ThreadWorker : public CMPIRawToParametersWorker {
+    unsigned m_nThreads;
+    int      m_compression;
+public:
+    ThreadWorker(AbstractApplication& app, unsigned nThreads, int compression) :
+        CMPIRawToParametersWorker(app), m_nThreads(nThreads),
+        m_compression(compression) {}
+protected:
+    virtual unsigned getThreadCount(int argc, char** argv) {
+        return m_nThreads;
+    }
+    virtual int getCompressionLevel(int argc, char** argv) {
+        return m_compression;
+    }
+public:
+    virtual void unpackData(const void* pData) {
+        const RingItemHeader* pHeader =
+            reinterpret_cast<const RingItemHeader*>(pData);
+        const std::uint32_t* pIndex =
+            reinterpret_cast<const std::uint32_t*>(pHeader + 1);
+        CTreeParameterArray& array(*pArray);
+        unsigned n = *pIndex % 10;
+        for (unsigned i = 0; i < n + 1; i++) {
+            array[i] = n;
+        }
+    }
+};
+
+// Output that can be columnar or pattern encoded and can be indexed.
+
+class ThreadOutput : public CMPIParameterOutput {
+    std::uint32_t m_chunkSize;
+    bool          m_patterns;
+    std::uint32_t m_indexInterval;
+public:
+    ThreadOutput(std::uint32_t chunkSize, bool patterns, std::uint32_t indexInterval = 0) :
+        m_chunkSize(chunkSize), m_patterns(patterns),
+        m_indexInterval(indexInterval) {}
+protected:
+    virtual std::uint32_t getOutputChunkSize(int argc, char** argv) {
+        return m_chunkSize;
+    }
+    virtual bool getPatternEncoding(int argc, char** argv) {
+        return m_patterns;
+    }
+    virtual std::uint32_t getIndexInterval(int argc, char** argv) {
+        return m_indexInterval;
+    }
+};
+
+class ThreadApplication : public AbstractApplication {
+    bool     m_dealerFails;
+    unsigned m_workerThreads;
+    std::uint32_t m_chunkSize;
+    int      m_compression;
+    bool     m_patterns;
+public:
+    ThreadApplication(
+        int argc, char** argv, bool dealerFails = false,
+        unsigned workerThreads = 1, std::uint32_t chunkSize = 0,
+        int compression = 0, bool patterns = false
+    ) :
+        AbstractApplication(argc, argv), m_dealerFails(dealerFails),
+        m_workerThreads(workerThreads), m_chunkSize(chunkSize),
+        m_compression(compression), m_patterns(patterns) {}
+    
+    virtual void dealer(int argc, char** argv, AbstractApplication* pApp) {
+        if (m_dealerFails) {
+            throw std::runtime_error("Dealer failed");
+        }
+        CMPIRawReader dealer(argc, argv, pApp);
+        dealer();
+    }
+    virtual void farmer(int argc, char** argv, AbstractApplication* pApp) {
+        CMPIParameterFarmer farmer(argc, argv, *pApp);
+        farmer();
+    }
+    virtual void outputter(int argc, char** argv, AbstractApplication* pApp) {
+        ThreadOutput outputter(m_chunkSize, m_patterns);
+        outputter(argc, argv, pApp);
+    }
+    virtual void worker(int argc, char** argv, AbstractApplication* pApp) {
+        ThreadWorker worker(*pApp, m_workerThreads, m_compression);
+        worker(argc, argv);
+    }
+};
+
+// A dealer with small blocks so that items straddle block boundaries.
+
+class SmallBlockReader : public CMPIRawReader {
+public:
+    SmallBlockReader(int argc, char** argv, AbstractApplication* pApp) :
+        CMPIRawReader(argc, argv, pApp) {}
+protected:
+    virtual unsigned getBlockSize(int argc, char** argv) const {
+        return 1200;
+    }
+};
+
+// Processes a range of triggers and indexes its output.  The dealer can
+// use small blocks.
+
+class RangeApplication : public ThreadApplication {
+    std::uint64_t m_first;
+    std::uint64_t m_count;
+    bool          m_smallBlocks;
+public:
+    RangeApplication(
+        int argc, char** argv, std::uint64_t first, std::uint64_t count,
+        bool smallBlocks = false
+    ) :
+        ThreadApplication(argc, argv), m_first(first), m_count(count),
+        m_smallBlocks(smallBlocks) {}
+    virtual void dealer(int argc, char** argv, AbstractApplication* pApp) {
+        if (m_smallBlocks) {
+            SmallBlockReader dealer(argc, argv, pApp);
+            dealer();
+        } else {
+            ThreadApplication::dealer(argc, argv, pApp);
+        }
+    }
+    virtual std::uint64_t getFirstTrigger(int argc, char** argv) {
+        return m_first;
+    }
+    virtual std::uint64_t getTriggerCount(int argc, char** argv) {
+        return m_count;
+    }
+    virtual void outputter(int argc, char** argv, AbstractApplication* pApp) {
+        ThreadOutput outputter(0, false, 100);
+        outputter(argc, argv, pApp);
+    }
+};
+
+class threadedapptest : public CppUnit::TestFixture {
+    CPPUNIT_TEST_SUITE(threadedapptest);
+    CPPUNIT_TEST(workers_1);
+    CPPUNIT_TEST(run_1);
+    CPPUNIT_TEST(run_2);
+    CPPUNIT_TEST(run_3);
+    CPPUNIT_TEST(columnar_1);
+    CPPUNIT_TEST(compress_1);
+    CPPUNIT_TEST(compress_2);
+    CPPUNIT_TEST(pack_1);
+    CPPUNIT_TEST(pack_2);
+    CPPUNIT_TEST(pattern_1);
+    CPPUNIT_TEST(range_1);
+    CPPUNIT_TEST(range_2);
+    CPPUNIT_TEST(range_3);
+    CPPUNIT_TEST(range_4);
+    CPPUNIT_TEST(error_1);
+    CPPUNIT_TEST_SUITE_END();
+protected:
+    void workers_1();
+    void run_1();
+    void run_2();
+    void run_3();
+    void columnar_1();
+    void compress_1();
+    void compress_2();
+    void pack_1();
+    void pack_2();
+    void pattern_1();
+    void range_1();
+    void range_2();
+    void range_3();
+    void range_4();
+    void error_1();
+private:
+    std::string        m_inFile;
+    std::string        m_outFile;
+    std::vector<char*> m_argv;
+public:
+    void setUp() {
+        char inName[]  = "/tmp/threadinXXXXXX";
+        char outName[] = "/tmp/threadoutXXXXXX";
+        int fd = mkstemp(inName);
+        close(fd);
+        fd = mkstemp(outName);
+        close(fd);
+        m_inFile = inName;
+        m_outFile = outName;
+        makeEventFile();
+        
+        m_argv.clear();
+        m_argv.push_back(const_cast<char*>("threadtests"));
+        m_argv.push_back(const_cast<char*>(m_inFile.c_str()));
+        m_argv.push_back(const_cast<char*>(m_outFile.c_str()));
+        m_argv.push_back(nullptr);
+    }
+    void tearDown() {
+        unlink(m_inFile.c_str());
+        unlink(m_outFile.c_str());
+        unlink(CTriggerIndex::sidecarName(m_inFile.c_str()).c_str());
+        unlink(CTriggerIndex::sidecarName(m_outFile.c_str()).c_str());
+    }
+private:
+    void makeEventFile(unsigned scalerInterval = 0);
+    void checkOutput();
+    void checkOutput(const std::vector<std::uint8_t>& data);
+    void checkRange(
+        std::uint64_t first, std::uint64_t end, unsigned scalers = 0
+    );
+    std::vector<std::uint8_t> readOutput();
+    std::vector<std::uint8_t> inflateOutput(
+        std::uint32_t type = COMPRESSED_PARAMETERS
+    );
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(threadedapptest);
+
+// Begin run, NUM_EVENTS physics events and an end run.  If scalerInterval
+// is nonzero a scaler item follows every scalerInterval events.
+
+void threadedapptest::makeEventFile(unsigned scalerInterval)
+{
+    int fd = open(m_inFile.c_str(), O_WRONLY | O_TRUNC);
+    ASSERT(fd >= 0);
+    
+    RingItemHeader hdr;
+    hdr.s_type = BEGIN_RUN;
+    hdr.s_size = sizeof(hdr);
+    hdr.s_unused = sizeof(std::uint32_t);
+    ASSERT(write(fd, &hdr, sizeof(hdr)) == sizeof(hdr));
+    struct {
+        RingItemHeader s_header;
+        std::uint32_t  s_index;
+    } event;
+    event.s_header.s_type = PHYSICS_EVENT;
+    event.s_header.s_size = sizeof(event);
+    event.s_header.s_unused = sizeof(std::uint32_t);
+    RingItemHeader scaler;
+    scaler.s_type = SCALERS;
+    scaler.s_size = sizeof(scaler);
+    scaler.s_unused = sizeof(std::uint32_t);
+    for (unsigned i = 0; i < NUM_EVENTS; i++) {
+        event.s_index = i;
+        ASSERT(write(fd, &event, sizeof(event)) == sizeof(event));
+        if (scalerInterval && ((i + 1) % scalerInterval == 0)) {
+            ASSERT(write(fd, &scaler, sizeof(scaler)) == sizeof(scaler));
+        }
+    }
+    hdr.s_type = END_RUN;
+    ASSERT(write(fd, &hdr, sizeof(hdr)) == sizeof(hdr));
+    close(fd);
+}
+std::vector<std::uint8_t>
+threadedapptest::readOutput()
+{
+    int fd = open(m_outFile.c_str(), O_RDONLY);
+    ASSERT(fd >= 0);
+    struct stat statbuf;
+    ASSERT(fstat(fd, &statbuf) >= 0);
+    std::vector<std::uint8_t> result(statbuf.st_size);
+    EQ(ssize_t(statbuf.st_size), read(fd, result.data(), statbuf.st_size));
+    close(fd);
+    return result;
+}
+// Read the output through a CInflatingDataReader, checking that there
+// were items of the given type (compressed frames by default) to expand.
+
+std::vector<std::uint8_t>
+threadedapptest::inflateOutput(std::uint32_t type)
+{
+    std::vector<std::uint8_t> raw = readOutput();
+    bool found(false);
+    for (std::size_t offset = 0; offset < raw.size(); ) {
+        const RingItemHeader* pH =
+            reinterpret_cast<const RingItemHeader*>(raw.data() + offset);
+        if (pH->s_type == type) found = true;
+        offset += pH->s_size;
+    }
+    ASSERT(found);
+    
+    std::vector<std::uint8_t> result;
+    CInflatingDataReader reader(new CMappedDataReader(m_outFile.c_str()));
+    while (1) {
+        auto block = reader.getBlock(1024*1024);
+        if (!block.s_nbytes) break;
+        const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(block.s_pData);
+        result.insert(result.end(), p, p + block.s_nbytes);
+        reader.done();
+    }
+    return result;
+}
+
+// Need at least one worker.
+
+void threadedapptest::workers_1()
+{
+    ThreadParameterReader reader;
+    ThreadApplication app(m_argv.size() - 1, m_argv.data());
+    CPPUNIT_ASSERT_THROW(app.runThreaded(reader, 0), std::invalid_argument);
+}
+// Run the whole pipeline and check the output.
+
+void threadedapptest::run_1()
+{
+    ThreadParameterReader reader;
+    ThreadApplication app(m_argv.size() - 1, m_argv.data());
+    app.runThreaded(reader, 1);
+    checkOutput();
+}
+// Workers each have their own tree parameter context so several of
+// them can unpack at once.
+
+void threadedapptest::run_2()
+{
+    ThreadParameterReader reader;
+    ThreadApplication app(m_argv.size() - 1, m_argv.data());
+    app.runThreaded(reader, 4);
+    checkOutput();
+}
+// Workers that unpack each block with a pool of threads.
+
+void threadedapptest::run_3()
+{
+    ThreadParameterReader reader;
+    ThreadApplication app(m_argv.size() - 1, m_argv.data(), false, 4);
+    app.runThreaded(reader, 2);
+    checkOutput();
+}
+// The output has everything in trigger order with the right
+// number of parameters.
+
+void threadedapptest::checkOutput()
+{
+    checkOutput(readOutput());
+}
+void threadedapptest::checkOutput(const std::vector<std::uint8_t>& data)
+{
+    bool begin(false);
+    bool end(false);
+    std::uint64_t trigger(0);
+    std::size_t offset(0);
+    while (offset < data.size()) {
+        const RingItemHeader* pH =
+            reinterpret_cast<const RingItemHeader*>(data.data() + offset);
+        if (pH->s_type == BEGIN_RUN) begin = true;
+        if (pH->s_type == END_RUN)   end   = true;
+        if (pH->s_type == PARAMETER_DATA) {
+            const ParameterItem* pP =
+                reinterpret_cast<const ParameterItem*>(pH);
+            EQ(trigger, pP->s_triggerCount);
+            EQ(std::uint32_t(trigger % 10 + 1), pP->s_parameterCount);
+            trigger++;
+        }
+        ASSERT(pH->s_size > 0);
+        offset += pH->s_size;
+    }
+    EQ(offset, data.size());
+    ASSERT(begin);
+    ASSERT(end);
+    EQ(std::uint64_t(NUM_EVENTS), trigger);
+}
+// The outputter can write columnar output.
+
+void threadedapptest::columnar_1()
+{
+    ThreadParameterReader reader;
+    ThreadApplication app(m_argv.size() - 1, m_argv.data(), false, 1, 1000);
+    app.runThreaded(reader, 2);
+    
+    std::vector<unsigned> numbers;
+    for (unsigned i = 0; i < 10; i++) {
+        numbers.push_back((*pArray)[i].getId());
+    }
+    CColumnarReader r(m_outFile.c_str());
+    CColumnarReader::Chunk chunk;
+    std::uint64_t trigger(0);
+    for (std::size_t c = 0; c < r.chunks(); c++) {
+        r.readChunk(c, numbers, chunk);
+        std::vector<std::size_t> next(numbers.size(), 0);
+        for (std::size_t e = 0; e < chunk.s_triggers.size(); e++) {
+            EQ(trigger, chunk.s_triggers[e]);
+            for (unsigned i = 0; i < numbers.size(); i++) {
+                auto& column(chunk.s_columns[i]);
+                EQ(i <= trigger % 10, column.present(e));
+                if (column.present(e)) {
+                    EQ(double(trigger % 10), column.s_values[next[i]++]);
+                }
+            }
+            trigger++;
+        }
+    }
+    EQ(std::uint64_t(NUM_EVENTS), trigger);
+}
+// Workers can compress their batches; the output reads back the same
+// through a CInflatingDataReader.
+
+void threadedapptest::compress_1()
+{
+    ThreadParameterReader reader;
+    ThreadApplication app(m_argv.size() - 1, m_argv.data(), false, 1, 0, 1);
+    app.runThreaded(reader, 2);
+    checkOutput(inflateOutput());
+}
+// Likewise with workers that compress each chunk in their thread pools.
+
+void threadedapptest::compress_2()
+{
+    ThreadParameterReader reader;
+    ThreadApplication app(m_argv.size() - 1, m_argv.data(), false, 4, 0, 1);
+    app.runThreaded(reader, 2);
+    checkOutput(inflateOutput());
+}
+// Parameters stored as uint16 are packed by the workers; the output
+// reads back the same through a CInflatingDataReader.
+
+void threadedapptest::pack_1()
+{
+    ThreadParameterReader reader(VALUE_UINT16);
+    ThreadApplication app(m_argv.size() - 1, m_argv.data());
+    app.runThreaded(reader, 2);
+    checkOutput(inflateOutput(PACKED_PARAMETER_DATA));
+}
+// Pool threads pack, then compress, their chunks.
+
+void threadedapptest::pack_2()
+{
+    ThreadParameterReader reader(VALUE_UINT16);
+    ThreadApplication app(m_argv.size() - 1, m_argv.data(), false, 4, 0, 1);
+    app.runThreaded(reader, 2);
+    checkOutput(inflateOutput());
+}
+// The outputter can pattern encode what packing, compressing workers send.
+
+void threadedapptest::pattern_1()
+{
+    ThreadParameterReader reader(VALUE_UINT16);
+    ThreadApplication app(
+        m_argv.size() - 1, m_argv.data(), false, 4, 0, 1, true
+    );
+    app.runThreaded(reader, 2);
+    checkOutput(inflateOutput(PATTERN_PARAMETER_DATA));
+}
+// The output of a range of triggers has just those triggers and the
+// passthrough items between them.  Those before the range (unless it
+// starts at 0) and after it are dropped.
+
+void threadedapptest::checkRange(
+    std::uint64_t first, std::uint64_t end, unsigned scalers
+)
+{
+    std::vector<std::uint8_t> data = readOutput();
+    bool beginRun(false);
+    bool endRun(false);
+    unsigned nScalers(0);
+    std::uint64_t trigger(first);
+    std::size_t offset(0);
+    while (offset < data.size()) {
+        const RingItemHeader* pH =
+            reinterpret_cast<const RingItemHeader*>(data.data() + offset);
+        if (pH->s_type == BEGIN_RUN) beginRun = true;
+        if (pH->s_type == END_RUN) endRun = true;
+        if (pH->s_type == SCALERS) nScalers++;
+        if (pH->s_type == PARAMETER_DATA) {
+            const ParameterItem* pP =
+                reinterpret_cast<const ParameterItem*>(pH);
+            EQ(trigger, pP->s_triggerCount);
+            EQ(std::uint32_t(trigger % 10 + 1), pP->s_parameterCount);
+            trigger++;
+        }
+        offset += pH->s_size;
+    }
+    EQ(end, trigger);
+    EQ(first == 0, beginRun);
+    EQ(end == NUM_EVENTS, endRun);
+    EQ(scalers, nScalers);
+}
+// A range of triggers from an indexed raw file.  The output is indexed
+// from the first trigger of the range.
+
+void threadedapptest::range_1()
+{
+    CTriggerIndex index(64);
+    {
+        CMappedDataReader input(m_inFile.c_str());
+        index.build(input);
+    }
+    index.describeFile(m_inFile.c_str());
+    index.write(CTriggerIndex::sidecarName(m_inFile.c_str()).c_str());
+    
+    ThreadParameterReader reader;
+    RangeApplication app(m_argv.size() - 1, m_argv.data(), 4321, 2000);
+    app.runThreaded(reader, 2);
+    checkRange(4321, 6321);
+    
+    CTriggerIndex output;
+    output.read(CTriggerIndex::sidecarName(m_outFile.c_str()).c_str());
+    ASSERT(output.size() > 0);
+    EQ(std::uint64_t(4321), output[0].s_trigger);
+}
+// Without an index the dealer counts its way to the first trigger.  A
+// range can run to the end of the data.
+
+void threadedapptest::range_2()
+{
+    ThreadParameterReader reader;
+    RangeApplication app(
+        m_argv.size() - 1, m_argv.data(), 9000, AbstractApplication::ALL_TRIGGERS
+    );
+    app.runThreaded(reader, 2);
+    checkRange(9000, NUM_EVENTS);
+}
+// Passthrough items between the events of a range are kept wherever the
+// dealer's blocks split the data, including when the range starts at 0.
+
+void threadedapptest::range_3()
+{
+    makeEventFile(10);
+    ThreadParameterReader reader;
+    {
+        RangeApplication app(m_argv.size() - 1, m_argv.data(), 0, 999999, true);
+        app.runThreaded(reader, 2);
+    }
+    checkRange(0, NUM_EVENTS, NUM_EVENTS/10);
+    {
+        RangeApplication app(m_argv.size() - 1, m_argv.data(), 1005, 3000, true);
+        app.runThreaded(reader, 2);
+    }
+    checkRange(1005, 4005, 300);     // After events 1009, 1019 ... 3999.
+}
+// An index left over from some other version of the input file is
+// ignored rather than used to seek into the wrong place.
+
+void threadedapptest::range_4()
+{
+    CTriggerIndex index(64);
+    for (std::uint64_t i = 0; i < NUM_EVENTS; i += 64) {
+        index.addItem(i*3 + 1, true, i);          // Not where the events are.
+    }
+    struct stat info;
+    ASSERT(stat(m_inFile.c_str(), &info) == 0);
+    index.setFile(info.st_size + 1000, 0);
+    index.write(CTriggerIndex::sidecarName(m_inFile.c_str()).c_str());
+    
+    ThreadParameterReader reader;
+    RangeApplication app(m_argv.size() - 1, m_argv.data(), 4321, 2000);
+    app.runThreaded(reader, 2);
+    checkRange(4321, 6321);
+}
+// A role that fails must not leave the others hanging; the failure
+// is reported to the caller.
+
+void threadedapptest::error_1()
+{
+    ThreadParameterReader reader;
+    ThreadApplication app(m_argv.size() - 1, m_argv.data(), true);
+    try {
+        app.runThreaded(reader, 1);
+        FAIL("runThreaded should have thrown");
+    }
+    catch (std::runtime_error& e) {
+        EQ(std::string("Dealer failed"), std::string(e.what()));
+    }
+}
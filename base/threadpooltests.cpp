@@ -0,0 +1,142 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+
+/** @file:  threadpooltests.cpp
+ *  @brief: Tests of CThreadPool.
+ */
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/Asserter.h>
+#include "Asserts.h"
+
+#include "ThreadPool.h"
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <stdexcept>
+
+using namespace frib::analysis;
+
+class threadpooltest : public CppUnit::TestFixture {
+    CPPUNIT_TEST_SUITE(threadpooltest);
+    CPPUNIT_TEST(construct_1);
+    CPPUNIT_TEST(construct_2);
+    CPPUNIT_TEST(run_1);
+    CPPUNIT_TEST(run_2);
+    CPPUNIT_TEST(run_3);
+    CPPUNIT_TEST(share_1);
+    CPPUNIT_TEST(error_1);
+    CPPUNIT_TEST_SUITE_END();
+protected:
+    void construct_1();
+    void construct_2();
+    void run_1();
+    void run_2();
+    void run_3();
+    void share_1();
+    void error_1();
+public:
+    void setUp() {}
+    void tearDown() {}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(threadpooltest);
+
+// Size includes the caller of run.
+
+void threadpooltest::construct_1()
+{
+    CThreadPool pool(4);
+    EQ(unsigned(4), pool.size());
+}
+// Need at least one thread.
+
+void threadpooltest::construct_2()
+{
+    CPPUNIT_ASSERT_THROW(CThreadPool pool(0), std::invalid_argument);
+}
+// Each thread index is run exactly once and job 0 is the caller.
+
+void threadpooltest::run_1()
+{
+    CThreadPool pool(4);
+    std::vector<std::atomic<int>> calls(4);
+    for (auto& c : calls) c = 0;
+    std::thread::id zero;
+    std::thread::id me = std::this_thread::get_id();
+    pool.run([&](unsigned i) {
+        calls[i]++;
+        if (i == 0) zero = std::this_thread::get_id();
+    });
+    for (auto& c : calls) {
+        EQ(1, c.load());
+    }
+    ASSERT(zero == me);
+}
+// The pool can run many jobs one after another.
+
+void threadpooltest::run_2()
+{
+    CThreadPool pool(3);
+    std::atomic<unsigned> total(0);
+    for (int i = 0; i < 1000; i++) {
+        pool.run([&](unsigned) { total++; });
+    }
+    EQ(unsigned(3000), total.load());
+}
+// A pool of one just runs the job in the caller.
+
+void threadpooltest::run_3()
+{
+    CThreadPool pool(1);
+    unsigned calls(0);
+    pool.run([&](unsigned i) { EQ(unsigned(0), i); calls++; });
+    EQ(unsigned(1), calls);
+}
+// Threads dividing work with a counter do all of it exactly once.
+
+void threadpooltest::share_1()
+{
+    CThreadPool pool(4);
+    std::vector<int> done(1000, 0);
+    std::atomic<size_t> next(0);
+    pool.run([&](unsigned) {
+        size_t i;
+        while ((i = next.fetch_add(1)) < done.size()) {
+            done[i]++;
+        }
+    });
+    for (auto d : done) {
+        EQ(1, d);
+    }
+}
+// Exceptions from a pool thread are rethrown by run and the pool
+// is still usable afterwards.
+
+void threadpooltest::error_1()
+{
+    CThreadPool pool(4);
+    CPPUNIT_ASSERT_THROW(
+        pool.run([](unsigned i) {
+            if (i == 2) throw std::runtime_error("failed");
+        }),
+        std::runtime_error
+    );
+    std::atomic<unsigned> calls(0);
+    pool.run([&](unsigned) { calls++; });
+    EQ(unsigned(4), calls.load());
+}
@@ -0,0 +1,594 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+
+/** @file:  transporttests.cpp
+ *  @brief: Tests of CMessageQueue and CQueueTransport.
+ */
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/Asserter.h>
+#include "Asserts.h"
+
+#include "MessageQueue.h"
+#include "QueueTransport.h"
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <cstdint>
+#include <string.h>
+
+using namespace frib::analysis;
+
+// Make a message with an int payload.
+
+static CMessageQueue::pMessage
+makeMessage(int source, int value)
+{
+    CMessageQueue::pMessage p = CMessageQueue::allocate(sizeof(int));
+    p->s_source = source;
+    p->s_tag    = 1;
+    memcpy(CMessageQueue::payload(p), &value, sizeof(int));
+    return p;
+}
+static int
+messageValue(CMessageQueue::pMessage p)
+{
+    int result;
+    memcpy(&result, CMessageQueue::payload(p), sizeof(int));
+    return result;
+}
+
+class queuetest : public CppUnit::TestFixture {
+    CPPUNIT_TEST_SUITE(queuetest);
+    CPPUNIT_TEST(empty_1);
+    CPPUNIT_TEST(fifo_1);
+    CPPUNIT_TEST(producers_1);
+    CPPUNIT_TEST(wait_1);
+    CPPUNIT_TEST(limit_1);
+    CPPUNIT_TEST(limit_2);
+    CPPUNIT_TEST(abort_1);
+    CPPUNIT_TEST_SUITE_END();
+protected:
+    void empty_1();
+    void fifo_1();
+    void producers_1();
+    void wait_1();
+    void limit_1();
+    void limit_2();
+    void abort_1();
+public:
+    void setUp() {}
+    void tearDown() {}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(queuetest);
+
+void queuetest::empty_1()
+{
+    CMessageQueue q;
+    ASSERT(!q.tryGet());
+    EQ(std::size_t(0), q.bytesQueued());
+}
+// Messages come out in the order they went in; the stub node is
+// handled as the queue empties and refills.
+
+void queuetest::fifo_1()
+{
+    CMessageQueue q;
+    for (int pass = 0; pass < 3; pass++) {
+        for (int i = 0; i < 3; i++) {
+            q.put(makeMessage(0, i));
+        }
+        EQ(3*sizeof(int), q.bytesQueued());
+        for (int i = 0; i < 3; i++) {
+            CMessageQueue::pMessage p = q.get();
+            EQ(i, messageValue(p));
+            CMessageQueue::free(p);
+        }
+        ASSERT(!q.tryGet());
+        EQ(std::size_t(0), q.bytesQueued());
+    }
+}
+// Several producers: everything arrives and each producer's messages
+// are in order.
+
+void queuetest::producers_1()
+{
+    const int nProducers = 4;
+    const int nMessages  = 10000;
+    CMessageQueue q;
+    std::vector<std::thread> producers;
+    for (int i = 0; i < nProducers; i++) {
+        producers.emplace_back([&q, i, nMessages]() {
+            for (int n = 0; n < nMessages; n++) {
+                q.put(makeMessage(i, n));
+            }
+        });
+    }
+    std::vector<int> next(nProducers, 0);
+    for (int i = 0; i < nProducers*nMessages; i++) {
+        CMessageQueue::pMessage p = q.get();
+        EQ(next[p->s_source], messageValue(p));
+        next[p->s_source]++;
+        CMessageQueue::free(p);
+    }
+    for (auto& t : producers) {
+        t.join();
+    }
+    ASSERT(!q.tryGet());
+}
+// A consumer that has gone to sleep is woken by a put.
+
+void queuetest::wait_1()
+{
+    CMessageQueue q;
+    std::thread producer([&q]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        q.put(makeMessage(0, 1234));
+    });
+    CMessageQueue::pMessage p = q.get();
+    EQ(1234, messageValue(p));
+    CMessageQueue::free(p);
+    producer.join();
+}
+// A put that would go over the byte limit waits for room.
+
+void queuetest::limit_1()
+{
+    CMessageQueue q(sizeof(int));
+    q.put(makeMessage(0, 1));
+    std::atomic<bool> done(false);
+    std::thread producer([&q, &done]() {
+        q.put(makeMessage(0, 2));
+        done = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    ASSERT(!done);
+    
+    CMessageQueue::pMessage p = q.get();
+    EQ(1, messageValue(p));
+    CMessageQueue::free(p);
+    producer.join();
+    ASSERT(done);
+    p = q.get();
+    EQ(2, messageValue(p));
+    CMessageQueue::free(p);
+}
+// An empty queue accepts a message bigger than the limit.
+
+void queuetest::limit_2()
+{
+    CMessageQueue q(1);
+    q.put(makeMessage(0, 1));
+    CMessageQueue::pMessage p = q.get();
+    EQ(1, messageValue(p));
+    CMessageQueue::free(p);
+}
+// abort wakes up a waiting consumer and producer.
+
+void queuetest::abort_1()
+{
+    CMessageQueue q(sizeof(int));
+    CMessageQueue full(sizeof(int));
+    full.put(makeMessage(0, 1));
+    
+    std::atomic<int> nThrown(0);
+    std::thread consumer([&q, &nThrown]() {
+        try {
+            q.get();
+        }
+        catch (std::runtime_error& e) {
+            nThrown++;
+        }
+    });
+    std::thread producer([&full, &nThrown]() {
+        CMessageQueue::pMessage p = makeMessage(0, 2);
+        try {
+            full.put(p);
+        }
+        catch (std::runtime_error& e) {
+            CMessageQueue::free(p);
+            nThrown++;
+        }
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    q.abort();
+    full.abort();
+    consumer.join();
+    producer.join();
+    EQ(2, int(nThrown));
+    ASSERT(q.aborted());
+    
+    CPPUNIT_ASSERT_THROW(q.get(), std::runtime_error);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// CQueueTransport - sends never wait on the receiver so most of this can
+// be done in a single thread.
+
+class queuetransporttest : public CppUnit::TestFixture {
+    CPPUNIT_TEST_SUITE(queuetransporttest);
+    CPPUNIT_TEST(construct_1);
+    CPPUNIT_TEST(construct_2);
+    CPPUNIT_TEST(sendrecv_1);
+    CPPUNIT_TEST(sendrecv_2);
+    CPPUNIT_TEST(tag_1);
+    CPPUNIT_TEST(source_1);
+    CPPUNIT_TEST(source_2);
+    CPPUNIT_TEST(probe_1);
+    CPPUNIT_TEST(truncate_1);
+    CPPUNIT_TEST(isend_1);
+    CPPUNIT_TEST(irecv_1);
+    CPPUNIT_TEST(irecv_2);
+    CPPUNIT_TEST(irecv_3);
+    CPPUNIT_TEST(irecv_4);
+    CPPUNIT_TEST(cancel_1);
+    CPPUNIT_TEST(threads_1);
+    CPPUNIT_TEST(broadcast_1);
+    CPPUNIT_TEST(broadcast_2);
+    CPPUNIT_TEST(abort_1);
+    CPPUNIT_TEST_SUITE_END();
+protected:
+    void construct_1();
+    void construct_2();
+    void sendrecv_1();
+    void sendrecv_2();
+    void tag_1();
+    void source_1();
+    void source_2();
+    void probe_1();
+    void truncate_1();
+    void isend_1();
+    void irecv_1();
+    void irecv_2();
+    void irecv_3();
+    void irecv_4();
+    void cancel_1();
+    void threads_1();
+    void broadcast_1();
+    void broadcast_2();
+    void abort_1();
+private:
+    std::vector<CMessageQueue*>   m_mailboxes;
+    std::vector<CQueueTransport*> m_ranks;
+public:
+    void setUp() {
+        for (int i = 0; i < 3; i++) {
+            m_mailboxes.push_back(new CMessageQueue);
+        }
+        for (int i = 0; i < 3; i++) {
+            m_ranks.push_back(new CQueueTransport(m_mailboxes, i));
+        }
+    }
+    void tearDown() {
+        for (auto p : m_ranks) delete p;
+        for (auto p : m_mailboxes) delete p;
+        m_ranks.clear();
+        m_mailboxes.clear();
+    }
+private:
+    void sendInt(int from, int to, int tag, int value);
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(queuetransporttest);
+
+void queuetransporttest::sendInt(int from, int to, int tag, int value)
+{
+    m_ranks[from]->send(&value, sizeof(int), CTransport::BYTES, to, tag);
+}
+
+void queuetransporttest::construct_1()
+{
+    EQ(0, m_ranks[0]->rank());
+    EQ(2, m_ranks[2]->rank());
+    EQ(unsigned(3), m_ranks[1]->size());
+}
+void queuetransporttest::construct_2()
+{
+    CPPUNIT_ASSERT_THROW(
+        CQueueTransport(m_mailboxes, 3), std::invalid_argument
+    );
+}
+// Simple send and receive.
+
+void queuetransporttest::sendrecv_1()
+{
+    sendInt(0, 1, 5, 1234);
+    int value(0);
+    CTransport::Status s = m_ranks[1]->recv(
+        &value, sizeof(int), CTransport::BYTES, 0, 5
+    );
+    EQ(1234, value);
+    EQ(0, s.s_source);
+    EQ(5, s.s_tag);
+    EQ(sizeof(int), s.s_nBytes);
+}
+// Counts are in units of the data type.
+
+void queuetransporttest::sendrecv_2()
+{
+    std::uint32_t values[4] = {1, 2, 3, 4};
+    m_ranks[0]->send(values, 4, CTransport::UINT32, 2, 1);
+    std::uint32_t got[10];
+    CTransport::Status s = m_ranks[2]->recv(
+        got, 10, CTransport::UINT32, CTransport::ANY_SOURCE, CTransport::ANY_TAG
+    );
+    EQ(4*sizeof(std::uint32_t), s.s_nBytes);
+    for (int i = 0; i < 4; i++) {
+        EQ(values[i], got[i]);
+    }
+}
+// Messages that don't match are kept for later.
+
+void queuetransporttest::tag_1()
+{
+    sendInt(0, 1, 1, 1);
+    sendInt(0, 1, 2, 2);
+    sendInt(0, 1, 1, 3);
+    int value;
+    m_ranks[1]->recv(&value, sizeof(int), CTransport::BYTES, 0, 2);
+    EQ(2, value);
+    m_ranks[1]->recv(&value, sizeof(int), CTransport::BYTES, 0, 1);
+    EQ(1, value);
+    m_ranks[1]->recv(&value, sizeof(int), CTransport::BYTES, 0, 1);
+    EQ(3, value);
+}
+// ANY_SOURCE gets messages in the order they arrived.
+
+void queuetransporttest::source_1()
+{
+    sendInt(2, 1, 1, 2);
+    sendInt(0, 1, 1, 0);
+    int value;
+    CTransport::Status s = m_ranks[1]->recv(
+        &value, sizeof(int), CTransport::BYTES, CTransport::ANY_SOURCE, 1
+    );
+    EQ(2, s.s_source);
+    EQ(2, value);
+    s = m_ranks[1]->recv(
+        &value, sizeof(int), CTransport::BYTES, CTransport::ANY_SOURCE, 1
+    );
+    EQ(0, s.s_source);
+    EQ(0, value);
+}
+// A specific source skips other senders' messages.
+
+void queuetransporttest::source_2()
+{
+    sendInt(2, 1, 1, 2);
+    sendInt(0, 1, 1, 0);
+    int value;
+    m_ranks[1]->recv(&value, sizeof(int), CTransport::BYTES, 0, 1);
+    EQ(0, value);
+    m_ranks[1]->recv(&value, sizeof(int), CTransport::BYTES, 2, 1);
+    EQ(2, value);
+}
+// Probe describes but does not consume a message.
+
+void queuetransporttest::probe_1()
+{
+    sendInt(0, 1, 1, 1);
+    sendInt(2, 1, 7, 2);
+    CTransport::Status s = m_ranks[1]->probe(CTransport::ANY_SOURCE, 7);
+    EQ(2, s.s_source);
+    EQ(7, s.s_tag);
+    EQ(sizeof(int), s.s_nBytes);
+    
+    s = m_ranks[1]->probe(CTransport::ANY_SOURCE, CTransport::ANY_TAG);
+    EQ(0, s.s_source);
+    
+    int value;
+    m_ranks[1]->recv(&value, sizeof(int), CTransport::BYTES, 2, 7);
+    EQ(2, value);
+    m_ranks[1]->recv(
+        &value, sizeof(int), CTransport::BYTES,
+        CTransport::ANY_SOURCE, CTransport::ANY_TAG
+    );
+    EQ(1, value);
+}
+// A receive buffer that's too small is an error.
+
+void queuetransporttest::truncate_1()
+{
+    sendInt(0, 1, 1, 1);
+    char c;
+    CPPUNIT_ASSERT_THROW(
+        m_ranks[1]->recv(&c, 1, CTransport::BYTES, 0, 1),
+        std::runtime_error
+    );
+}
+// isend is complete right away.
+
+void queuetransporttest::isend_1()
+{
+    int value = 1234;
+    CTransport::Request r = m_ranks[0]->isend(
+        &value, sizeof(int), CTransport::BYTES, 1, 1
+    );
+    ASSERT(r != CTransport::NULL_REQUEST);
+    value = 0;                           // Data were already sent.
+    ASSERT(m_ranks[0]->test(r));
+    EQ(CTransport::NULL_REQUEST, r);
+    
+    m_ranks[1]->recv(&value, sizeof(int), CTransport::BYTES, 0, 1);
+    EQ(1234, value);
+}
+// irecv is satisfied by a later message.
+
+void queuetransporttest::irecv_1()
+{
+    int value(0);
+    CTransport::Request r = m_ranks[1]->irecv(
+        &value, sizeof(int), CTransport::BYTES, 0, 1
+    );
+    ASSERT(!m_ranks[1]->test(r));
+    sendInt(0, 1, 1, 1234);
+    CTransport::Status s = m_ranks[1]->wait(r);
+    EQ(CTransport::NULL_REQUEST, r);
+    EQ(1234, value);
+    EQ(0, s.s_source);
+    EQ(1, s.s_tag);
+}
+// irecv is satisfied by a message that's already arrived.
+
+void queuetransporttest::irecv_2()
+{
+    sendInt(0, 1, 1, 1234);
+    int value;
+    m_ranks[1]->probe(0, 1);              // Now it's arrived.
+    CTransport::Request r = m_ranks[1]->irecv(
+        &value, sizeof(int), CTransport::BYTES, 0, 1
+    );
+    ASSERT(m_ranks[1]->test(r));
+    EQ(1234, value);
+}
+// Messages go to the posted receives in the order they were posted,
+// even if they're waited for in some other order.
+
+void queuetransporttest::irecv_3()
+{
+    int values[3];
+    CTransport::Request r[3];
+    for (int i = 0; i < 3; i++) {
+        r[i] = m_ranks[1]->irecv(
+            &values[i], sizeof(int), CTransport::BYTES, 0, 1
+        );
+    }
+    for (int i = 0; i < 3; i++) {
+        sendInt(0, 1, 1, i);
+    }
+    for (int i = 2; i >= 0; i--) {
+        m_ranks[1]->wait(r[i]);
+        EQ(i, values[i]);
+    }
+}
+// A blocking receive doesn't take a message from an earlier posted irecv.
+
+void queuetransporttest::irecv_4()
+{
+    int first(-1), second(-1);
+    CTransport::Request r = m_ranks[1]->irecv(
+        &first, sizeof(int), CTransport::BYTES, 0, 1
+    );
+    sendInt(0, 1, 1, 1);
+    sendInt(0, 1, 1, 2);
+    m_ranks[1]->recv(&second, sizeof(int), CTransport::BYTES, 0, 1);
+    EQ(2, second);
+    ASSERT(m_ranks[1]->test(r));
+    EQ(1, first);
+}
+// Cancelled receives don't take messages.
+
+void queuetransporttest::cancel_1()
+{
+    int value(0);
+    CTransport::Request r = m_ranks[1]->irecv(
+        &value, sizeof(int), CTransport::BYTES, 0, 1
+    );
+    m_ranks[1]->cancel(r);
+    EQ(CTransport::NULL_REQUEST, r);
+    
+    sendInt(0, 1, 1, 1234);
+    int got;
+    m_ranks[1]->recv(&got, sizeof(int), CTransport::BYTES, 0, 1);
+    EQ(1234, got);
+    EQ(0, value);
+}
+// Request/response between threads.
+
+void queuetransporttest::threads_1()
+{
+    const int nRequests = 1000;
+    CQueueTransport* pServer = m_ranks[0];
+    std::thread server([pServer, nRequests]() {
+        for (int i = 0; i < 2*nRequests; i++) {
+            int value;
+            CTransport::Status s = pServer->recv(
+                &value, sizeof(int), CTransport::BYTES,
+                CTransport::ANY_SOURCE, 1
+            );
+            value *= 2;
+            pServer->send(&value, sizeof(int), CTransport::BYTES, s.s_source, 2);
+        }
+    });
+    CQueueTransport* pOther = m_ranks[2];
+    std::thread other([pOther, nRequests]() {
+        for (int i = 0; i < nRequests; i++) {
+            pOther->send(&i, sizeof(int), CTransport::BYTES, 0, 1);
+            int reply;
+            pOther->recv(&reply, sizeof(int), CTransport::BYTES, 0, 2);
+            if (reply != 2*i) throw std::logic_error("bad reply");
+        }
+    });
+    for (int i = 0; i < nRequests; i++) {
+        sendInt(1, 0, 1, i);
+        int reply;
+        m_ranks[1]->recv(&reply, sizeof(int), CTransport::BYTES, 0, 2);
+        EQ(2*i, reply);
+    }
+    server.join();
+    other.join();
+}
+// Broadcast reaches every rank from the first one on.
+
+void queuetransporttest::broadcast_1()
+{
+    int value = 1234;
+    m_ranks[0]->broadcast(&value, sizeof(int), CTransport::BYTES, 1, 3);
+    for (int i = 1; i < 3; i++) {
+        int got(0);
+        CTransport::Status s = m_ranks[i]->recv(
+            &got, sizeof(int), CTransport::BYTES, 0, 3
+        );
+        EQ(1234, got);
+        EQ(0, s.s_source);
+    }
+    ASSERT(!m_mailboxes[0]->tryGet());
+}
+// receiveBroadcast gets broadcasts in order.
+
+void queuetransporttest::broadcast_2()
+{
+    int values[2] = {1234, 5678};
+    m_ranks[0]->broadcast(&values[0], 1, CTransport::UINT32, 1, 3);
+    m_ranks[0]->broadcast(&values[1], 1, CTransport::UINT32, 1, 3);
+    for (int i = 1; i < 3; i++) {
+        for (int j = 0; j < 2; j++) {
+            int got(0);
+            CTransport::Status s = m_ranks[i]->receiveBroadcast(
+                &got, 1, CTransport::UINT32, 0, 1, 3
+            );
+            EQ(values[j], got);
+            EQ(0, s.s_source);
+            EQ(sizeof(std::uint32_t), s.s_nBytes);
+        }
+    }
+}
+// Abort makes receives throw.
+
+void queuetransporttest::abort_1()
+{
+    m_ranks[0]->abort();
+    int value;
+    CPPUNIT_ASSERT_THROW(
+        m_ranks[1]->recv(&value, sizeof(int), CTransport::BYTES, 0, 1),
+        std::runtime_error
+    );
+    CPPUNIT_ASSERT_THROW(sendInt(0, 2, 1, 1), std::runtime_error);
+}
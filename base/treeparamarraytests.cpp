@@ -57,6 +57,13 @@ class TPATest : public CppUnit::TestFixture {
     CPPUNIT_TEST(isbound_1);
     CPPUNIT_TEST(isbound_2);
     CPPUNIT_TEST(isbound_3);
+    
+    CPPUNIT_TEST(contiguous_1);
+    CPPUNIT_TEST(contiguous_2);
+    CPPUNIT_TEST(unchecked_1);
+    CPPUNIT_TEST(setall_1);
+    CPPUNIT_TEST(setall_2);
+    CPPUNIT_TEST(setall_3);
     CPPUNIT_TEST_SUITE_END();
     
 private:
@@ -64,10 +71,8 @@ private:
 public:
     void setUp() {
         CTreeParameter::m_parameterDictionary.clear();
-        CTreeParameter::m_scoreboard.clear();
-        CTreeParameter::m_generation = 1;
+        CTreeParameter::m_processContext.clear();
         CTreeParameter::m_nextId = 0;
-        CTreeParameter::m_event.clear();
         CTreeParameter::m_defaultSpecification = {
             .s_low = 0,                 // Will need updating if it
             .s_high = 100,              // changes in TreeParameter.cpp
@@ -77,10 +82,8 @@ public:
     }
     void tearDown() {
         CTreeParameter::m_parameterDictionary.clear();
-        CTreeParameter::m_scoreboard.clear();
-        CTreeParameter::m_generation = 1;
+        CTreeParameter::m_processContext.clear();
         CTreeParameter::m_nextId = 0;
-        CTreeParameter::m_event.clear();
         CTreeParameter::m_defaultSpecification = {
             .s_low = 0,                 // Will need updating if it
             .s_high = 100,              // changes in TreeParameter.cpp
@@ -112,6 +115,13 @@ protected:
     void isbound_2();
     void isbound_3();
     
+    void contiguous_1();
+    void contiguous_2();
+    void unchecked_1();
+    void setall_1();
+    void setall_2();
+    void setall_3();
+    
     // Bind is a no-op under the hood so we don't test.
 };
 
@@ -347,4 +357,68 @@ void TPATest::isbound_3() {
         CTreeParameterArray a("test5", 1024, -1.0, 1.0, "mm", 16);
         ASSERT(a.isBound());
     }
-}
\ No newline at end of file
+}
+// Elements are stored contiguously with consecutive ids.
+void TPATest::contiguous_1() {
+    CTreeParameter before("before");
+    CTreeParameterArray a("test", 16, -2);
+    ASSERT(a.hasContiguousIds());
+    for (int i = -2; i < 14; i++) {
+        EQ(&a[-2] + (i + 2), &a[i]);
+        EQ(a[-2].getId() + (i + 2), a[i].getId());
+    }
+    EQ(&a[0], *(a.begin() + 2));
+}
+// Binding to some parameters that already exist may break consecutive ids.
+void TPATest::contiguous_2() {
+    CTreeParameter existing("test.05");
+    CTreeParameterArray a("test", 10, 0);
+    ASSERT(!a.hasContiguousIds());
+    EQ(existing.getId(), a[5].getId());
+    
+    CTreeParameterArray empty;
+    ASSERT(!empty.hasContiguousIds());
+}
+// unchecked is the same element as operator[].
+void TPATest::unchecked_1() {
+    CTreeParameterArray a("test", 16, 1);
+    for (int i = 1; i < 17; i++) {
+        EQ(&a[i], &a.unchecked(i));
+    }
+    a.unchecked(3) = 1.5;
+    EQ(1.5, double(a[3]));
+}
+// setAll makes everything valid and the pointer reaches the values.
+void TPATest::setall_1() {
+    CTreeParameterArray a("test", 16, -1);
+    a[0] = 100.0;                     // Already set - not rescoreboarded.
+    double* p = a.setAll();
+    for (int i = 0; i < 16; i++) {
+        p[i] = i*2.0;
+    }
+    for (int i = -1; i < 15; i++) {
+        ASSERT(a[i].isValid());
+        EQ((i + 1)*2.0, double(a[i]));
+    }
+    EQ(size_t(16), CTreeParameter::getScoreboard().size());
+    
+    CTreeParameter::nextEvent();
+    ASSERT(!a[0].isValid());
+}
+// setAll is not possible without consecutive ids.
+void TPATest::setall_2() {
+    CTreeParameter existing("test.05");
+    CTreeParameterArray a("test", 10, 0);
+    CPPUNIT_ASSERT_THROW(a.setAll(), std::logic_error);
+}
+// setAll works in a thread's own context.
+void TPATest::setall_3() {
+    CTreeParameterArray a("test", 4, 0);
+    CTreeParameterContext c;
+    CTreeParameter::setContext(&c);
+    double* p = a.setAll();
+    p[2] = 5.0;
+    EQ(5.0, c.get(a[2].getId()));
+    CTreeParameter::setContext(nullptr);
+    ASSERT(!a[2].isValid());
+}
@@ -0,0 +1,349 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+
+/** @file:  treeparamcontexttests.cpp
+ *  @brief: Tests for CTreeParameterContext and per thread contexts.
+ */
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/Asserter.h>
+#include "Asserts.h"
+#define private public
+#include "TreeParameter.h"
+#include "TreeParameterContext.h"
+#include "AnalysisRingItems.h"
+#undef private
+#include <thread>
+#include <vector>
+
+using namespace frib::analysis;
+
+class TPContextTest : public CppUnit::TestFixture {
+    CPPUNIT_TEST_SUITE(TPContextTest);
+    CPPUNIT_TEST(initial);
+    CPPUNIT_TEST(resize_1);
+    CPPUNIT_TEST(set_1);
+    CPPUNIT_TEST(set_2);
+    CPPUNIT_TEST(set_3);
+    CPPUNIT_TEST(reference_1);
+    CPPUNIT_TEST(reference_2);
+    CPPUNIT_TEST(next_1);
+    CPPUNIT_TEST(unset_1);
+    CPPUNIT_TEST(collect_1);
+    CPPUNIT_TEST(collect_2);
+    CPPUNIT_TEST(collect_3);
+    CPPUNIT_TEST(clear_1);
+    CPPUNIT_TEST(default_1);
+    CPPUNIT_TEST(select_1);
+    CPPUNIT_TEST(select_2);
+    CPPUNIT_TEST(threads_1);
+    CPPUNIT_TEST_SUITE_END();
+protected:
+    void initial();
+    void resize_1();
+    void set_1();
+    void set_2();
+    void set_3();
+    void reference_1();
+    void reference_2();
+    void next_1();
+    void unset_1();
+    void collect_1();
+    void collect_2();
+    void collect_3();
+    void clear_1();
+    void default_1();
+    void select_1();
+    void select_2();
+    void threads_1();
+public:
+    void setUp() {}
+    void tearDown() {
+        CTreeParameter::setContext(nullptr);
+        CTreeParameter::m_parameterDictionary.clear();
+        CTreeParameter::m_processContext.clear();
+        CTreeParameter::m_nextId = 0;
+    }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TPContextTest);
+
+void TPContextTest::initial()
+{
+    CTreeParameterContext c;
+    EQ(std::uint64_t(1), c.generation());
+    ASSERT(c.getEvent().empty());
+    ASSERT(c.getScoreboard().empty());
+    ASSERT(!c.isSet(0));
+}
+// Resizing makes room but nothing is valid.
+
+void TPContextTest::resize_1()
+{
+    CTreeParameterContext c;
+    c.resize(10);
+    EQ(size_t(10), c.getEvent().size());
+    for (unsigned i = 0; i < 10; i++) {
+        ASSERT(!c.isSet(i));
+    }
+    c.resize(5);                          // Never shrinks.
+    EQ(size_t(10), c.getEvent().size());
+}
+// Setting makes valid and scoreboards.
+
+void TPContextTest::set_1()
+{
+    CTreeParameterContext c;
+    c.resize(10);
+    c.set(3, 1.5);
+    ASSERT(c.isSet(3));
+    EQ(1.5, c.get(3));
+    EQ(size_t(1), c.getScoreboard().size());
+    EQ(unsigned(3), c.getScoreboard()[0]);
+}
+// Setting twice only scoreboards once.
+
+void TPContextTest::set_2()
+{
+    CTreeParameterContext c;
+    c.resize(10);
+    c.set(3, 1.5);
+    c.set(3, 2.5);
+    EQ(2.5, c.get(3));
+    EQ(size_t(1), c.getScoreboard().size());
+}
+// Setting past the end grows.
+
+void TPContextTest::set_3()
+{
+    CTreeParameterContext c;
+    c.set(20, 1.0);
+    EQ(size_t(21), c.getEvent().size());
+    ASSERT(c.isSet(20));
+    ASSERT(!c.isSet(19));
+}
+// reference marks the parameter set once and refers to its value.
+
+void TPContextTest::reference_1()
+{
+    CTreeParameterContext c;
+    c.reference(3) = 1.5;
+    ASSERT(c.isSet(3));
+    EQ(1.5, c.get(3));
+    c.reference(3) += 1.0;
+    EQ(2.5, c.get(3));
+    EQ(size_t(1), c.getScoreboard().size());
+    
+    c.nextEvent();
+    ASSERT(!c.isSet(3));
+    c.reference(3);
+    ASSERT(c.isSet(3));
+}
+// referenceRange marks a range set (once) and points at it.
+
+void TPContextTest::reference_2()
+{
+    CTreeParameterContext c;
+    c.set(3, 3.0);
+    double* p = c.referenceRange(2, 4);
+    EQ(3.0, p[1]);
+    p[0] = 2.0;
+    p[3] = 5.0;
+    EQ(2.0, c.get(2));
+    EQ(5.0, c.get(5));
+    for (unsigned i = 2; i < 6; i++) {
+        ASSERT(c.isSet(i));
+    }
+    ASSERT(!c.isSet(1));
+    EQ(size_t(4), c.getScoreboard().size());
+    EQ(unsigned(3), c.getScoreboard()[0]);
+}
+// Next event invalidates everything.
+
+void TPContextTest::next_1()
+{
+    CTreeParameterContext c;
+    c.set(1, 1.0);
+    c.set(2, 2.0);
+    c.nextEvent();
+    EQ(std::uint64_t(2), c.generation());
+    ASSERT(!c.isSet(1));
+    ASSERT(!c.isSet(2));
+    ASSERT(c.getScoreboard().empty());
+    
+    c.resize(10);                         // New ones are not valid either.
+    ASSERT(!c.isSet(9));
+}
+// Unset removes from the scoreboard.
+
+void TPContextTest::unset_1()
+{
+    CTreeParameterContext c;
+    c.set(1, 1.0);
+    c.set(2, 2.0);
+    c.unset(1);
+    ASSERT(!c.isSet(1));
+    ASSERT(c.isSet(2));
+    EQ(size_t(1), c.getScoreboard().size());
+    EQ(unsigned(2), c.getScoreboard()[0]);
+    
+    c.unset(1);                            // No-op.
+    c.unset(100);                          // Even for ones that don't exist.
+    EQ(size_t(1), c.getScoreboard().size());
+}
+// collect gets the set ones in the order they were set.
+
+void TPContextTest::collect_1()
+{
+    CTreeParameterContext c;
+    c.set(5, 5.0);
+    c.set(2, 2.0);
+    auto event = c.collectEvent();
+    EQ(size_t(2), event.size());
+    EQ(unsigned(5), event[0].first);
+    EQ(5.0, event[0].second);
+    EQ(unsigned(2), event[1].first);
+    EQ(2.0, event[1].second);
+}
+// Collecting into a reused vector replaces its contents.
+
+void TPContextTest::collect_2()
+{
+    CTreeParameterContext c;
+    std::vector<std::pair<unsigned, double>> event = {{1, 1.0}, {2, 2.0}, {3, 3.0}};
+    c.set(5, 5.0);
+    c.collectEvent(event);
+    EQ(size_t(1), event.size());
+    EQ(unsigned(5), event[0].first);
+    EQ(5.0, event[0].second);
+    
+    c.nextEvent();
+    c.collectEvent(event);
+    ASSERT(event.empty());
+}
+// Collecting in wire format.
+
+void TPContextTest::collect_3()
+{
+    CTreeParameterContext c;
+    EQ(size_t(0), c.eventSize());
+    c.set(5, 5.0);
+    c.set(2, 2.0);
+    c.set(5, 6.0);
+    EQ(size_t(2), c.eventSize());
+    
+    ParameterValue values[3];
+    values[2].s_number = 1234;
+    c.collectEvent(values);
+    EQ(std::uint32_t(5), values[0].s_number);
+    EQ(6.0, values[0].s_value);
+    EQ(std::uint32_t(2), values[1].s_number);
+    EQ(2.0, values[1].s_value);
+    EQ(std::uint32_t(1234), values[2].s_number);   // Untouched.
+}
+void TPContextTest::clear_1()
+{
+    CTreeParameterContext c;
+    c.set(5, 5.0);
+    c.nextEvent();
+    c.clear();
+    EQ(std::uint64_t(1), c.generation());
+    ASSERT(c.getEvent().empty());
+    ASSERT(c.getScoreboard().empty());
+}
+// By default tree parameters use the process context.
+
+void TPContextTest::default_1()
+{
+    EQ(&CTreeParameter::m_processContext, &CTreeParameter::context());
+    CTreeParameter p("p");
+    p = 1.0;
+    ASSERT(CTreeParameter::m_processContext.isSet(p.getId()));
+}
+// Selecting a context sizes it and values go there.
+
+void TPContextTest::select_1()
+{
+    CTreeParameter p1("p1");
+    CTreeParameter p2("p2");
+    CTreeParameterContext c;
+    CTreeParameter::setContext(&c);
+    EQ(&c, &CTreeParameter::context());
+    EQ(size_t(2), c.getEvent().size());
+    
+    p2 = 2.0;
+    ASSERT(p2.isValid());
+    ASSERT(c.isSet(p2.getId()));
+    ASSERT(!CTreeParameter::m_processContext.isSet(p2.getId()));
+    EQ(size_t(1), CTreeParameter::collectEvent().size());
+    
+    CTreeParameter::setContext(nullptr);
+    ASSERT(!p2.isValid());
+    EQ(size_t(0), CTreeParameter::collectEvent().size());
+}
+// Contexts are independent.
+
+void TPContextTest::select_2()
+{
+    CTreeParameter p("p");
+    CTreeParameterContext c1;
+    CTreeParameterContext c2;
+    CTreeParameter::setContext(&c1);
+    p = 1.0;
+    CTreeParameter::setContext(&c2);
+    ASSERT(!p.isValid());
+    p = 2.0;
+    CTreeParameter::nextEvent();
+    ASSERT(!p.isValid());
+    CTreeParameter::setContext(&c1);
+    ASSERT(p.isValid());
+    EQ(1.0, double(p));
+}
+// Threads with their own contexts don't interfere.
+
+void TPContextTest::threads_1()
+{
+    const unsigned nThreads = 4;
+    const unsigned nEvents = 10000;
+    CTreeParameter a("a");
+    CTreeParameter b("b");
+    std::vector<std::thread> threads;
+    std::vector<unsigned>    errors(nThreads, 0);
+    for (unsigned t = 0; t < nThreads; t++) {
+        threads.emplace_back([&a, &b, &errors, t, nEvents]() {
+            CTreeParameterContext c;
+            CTreeParameter::setContext(&c);
+            for (unsigned i = 0; i < nEvents; i++) {
+                a = t;
+                if ((i % 2) == 0) b = i;
+                auto event = CTreeParameter::collectEvent();
+                if (event.size() != ((i % 2) ? 1 : 2)) errors[t]++;
+                if (event[0].second != t) errors[t]++;
+                if (((i % 2) == 0) && (event[1].second != i)) errors[t]++;
+                CTreeParameter::nextEvent();
+            }
+            CTreeParameter::setContext(nullptr);
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (unsigned t = 0; t < nThreads; t++) {
+        EQ(unsigned(0), errors[t]);
+    }
+    ASSERT(CTreeParameter::m_processContext.getScoreboard().empty());
+}
@@ -24,6 +24,7 @@
 #define private public
 #include "TreeParameter.h"
 #undef private
+#include "AnalysisRingItems.h"
 
 
 using namespace frib::analysis;
@@ -150,6 +151,11 @@ class TPTest : public CppUnit::TestFixture {
     CPPUNIT_TEST(setunit_1);
     CPPUNIT_TEST(setunit_2);
     
+    CPPUNIT_TEST(storage_1);
+    CPPUNIT_TEST(storage_2);
+    CPPUNIT_TEST(storage_3);
+    CPPUNIT_TEST(storagetypes);
+    
     CPPUNIT_TEST(isvalid_1);
     CPPUNIT_TEST(isvalid_2);
     CPPUNIT_TEST(isvalid_3);
@@ -174,6 +180,7 @@ class TPTest : public CppUnit::TestFixture {
     
     CPPUNIT_TEST(getdef_1);
     CPPUNIT_TEST(getdef_2);
+    CPPUNIT_TEST(getdef_3);
     CPPUNIT_TEST_SUITE_END();
 
     
@@ -185,10 +192,8 @@ public:
     }
     void tearDown() {
         CTreeParameter::m_parameterDictionary.clear();
-        CTreeParameter::m_scoreboard.clear();
-        CTreeParameter::m_generation = 1;
+        CTreeParameter::m_processContext.clear();
         CTreeParameter::m_nextId = 0;
-        CTreeParameter::m_event.clear();
         CTreeParameter::m_defaultSpecification = {
             .s_low = 0,                 // Will need updating if it
             .s_high = 100,              // changes in TreeParameter.cpp
@@ -319,6 +324,11 @@ protected:
     void setunit_1();
     void setunit_2();
     
+    void storage_1();
+    void storage_2();
+    void storage_3();
+    void storagetypes();
+    
     void isvalid_1();
     void isvalid_2();
     void isvalid_3();
@@ -344,6 +354,7 @@ protected:
     
     void getdef_1();
     void getdef_2();
+    void getdef_3();
 };
 
 CPPUNIT_TEST_SUITE_REGISTRATION(TPTest);
@@ -351,11 +362,11 @@ CPPUNIT_TEST_SUITE_REGISTRATION(TPTest);
 // initial state of static stuff.
 void TPTest::initial()
 {
-    EQ(std::uint64_t(1), CTreeParameter::m_generation);
+    EQ(std::uint64_t(1), CTreeParameter::m_processContext.m_generation);
     ASSERT(CTreeParameter::m_parameterDictionary.empty());
     EQ(unsigned(1), CTreeParameter::m_nextId);
-    ASSERT(CTreeParameter::m_event.empty());
-    ASSERT(CTreeParameter::m_scoreboard.empty());
+    ASSERT(CTreeParameter::m_processContext.m_event.empty());
+    ASSERT(CTreeParameter::m_processContext.m_scoreboard.empty());
     
     // these need to be updated if the initial default values
     // change.
@@ -369,7 +380,7 @@ void TPTest::initial()
 
 void TPTest::next_1() {
     CTreeParameter::nextEvent();
-    EQ(std::uint64_t(2), CTreeParameter::m_generation);
+    EQ(std::uint64_t(2), CTreeParameter::m_processContext.m_generation);
     
 }
 // next event does not affect empties the parameter dictionary.
@@ -391,14 +402,14 @@ void TPTest::next_3() {
 // next event clears the scoreboard and does not touch the event:
 
 void TPTest::next_4() {
-    CTreeParameter::m_scoreboard.push_back(1);
-    CTreeParameter::m_scoreboard.push_back(2);
-    CTreeParameter::m_event.push_back(1234.5);
-    CTreeParameter::m_event.push_back(3.1416);
+    CTreeParameter::m_processContext.m_scoreboard.push_back(1);
+    CTreeParameter::m_processContext.m_scoreboard.push_back(2);
+    CTreeParameter::m_processContext.m_event.push_back(1234.5);
+    CTreeParameter::m_processContext.m_event.push_back(3.1416);
     
     CTreeParameter::nextEvent();
-    EQ(size_t(0), CTreeParameter::m_scoreboard.size());
-    EQ(size_t(2), CTreeParameter::m_event.size());
+    EQ(size_t(0), CTreeParameter::m_processContext.m_scoreboard.size());
+    EQ(size_t(2), CTreeParameter::m_processContext.m_event.size());
 }
 // nothing to collect gives empty vector:
 void TPTest::collect_1() {
@@ -409,8 +420,8 @@ void TPTest::collect_1() {
 void TPTest::collect_2() {
     std::vector<double> eventData = {1.0, 2.1, 3.2, 5.3, 7.5, 13.7}; // See the pattern?
     std::vector<unsigned> sbdata = {2, 3, 5};                        // A prime example.
-    CTreeParameter::m_event.insert(CTreeParameter::m_event.begin(), eventData.begin(), eventData.end());
-    CTreeParameter::m_scoreboard.insert(CTreeParameter::m_scoreboard.begin(), sbdata.begin(), sbdata.end());
+    CTreeParameter::m_processContext.m_event.insert(CTreeParameter::m_processContext.m_event.begin(), eventData.begin(), eventData.end());
+    CTreeParameter::m_processContext.m_scoreboard.insert(CTreeParameter::m_processContext.m_scoreboard.begin(), sbdata.begin(), sbdata.end());
     
     auto result = CTreeParameter::collectEvent();
     
@@ -442,7 +453,7 @@ void TPTest::dunits() {
 
 void TPTest::getEvent() {
     for (int i =0; i < 100; i++) {
-        CTreeParameter::m_event.push_back(i);
+        CTreeParameter::m_processContext.m_event.push_back(i);
     }
     auto& e = CTreeParameter::getEvent();
     EQ(size_t(100), e.size());
@@ -455,7 +466,7 @@ void TPTest::getEvent() {
 
 void TPTest::getsb() {
     std::vector<unsigned> sbdata = {2, 3, 5};                        // A prime example.
-    CTreeParameter::m_scoreboard.insert(CTreeParameter::m_scoreboard.begin(), sbdata.begin(), sbdata.end());
+    CTreeParameter::m_processContext.m_scoreboard.insert(CTreeParameter::m_processContext.m_scoreboard.begin(), sbdata.begin(), sbdata.end());
     
     auto& s = CTreeParameter::getScoreboard();
     EQ(sbdata.size(), s.size());
@@ -483,7 +494,7 @@ void TPTest::construct_2() {
     EQ(CTreeParameter::m_defaultSpecification.s_chans, param.m_pDefinition->s_chans);
     EQ(CTreeParameter::m_defaultSpecification.s_units, param.m_pDefinition->s_units);
     EQ(false, param.m_pDefinition->s_changed);
-    EQ(CTreeParameter::m_generation-1, param.m_pDefinition->s_generation);
+    EQ(CTreeParameter::m_processContext.m_generation-1, CTreeParameter::m_processContext.m_generations.at(param.m_pDefinition->s_parameterNumber));
     
 }
 // construct with name and units:
@@ -498,7 +509,7 @@ void TPTest::construct_3() {
     EQ(CTreeParameter::m_defaultSpecification.s_chans, param.m_pDefinition->s_chans);
     EQ(std::string("mm"), param.m_pDefinition->s_units);
     EQ(false, param.m_pDefinition->s_changed);
-    EQ(CTreeParameter::m_generation-1, param.m_pDefinition->s_generation);
+    EQ(CTreeParameter::m_processContext.m_generation-1, CTreeParameter::m_processContext.m_generations.at(param.m_pDefinition->s_parameterNumber));
 }
 // Construct with low, high units.
 void TPTest::construct_4() {
@@ -512,7 +523,7 @@ void TPTest::construct_4() {
     EQ(CTreeParameter::m_defaultSpecification.s_chans, param.m_pDefinition->s_chans);
     EQ(std::string("mm"), param.m_pDefinition->s_units);
     EQ(false, param.m_pDefinition->s_changed);
-    EQ(CTreeParameter::m_generation-1, param.m_pDefinition->s_generation);
+    EQ(CTreeParameter::m_processContext.m_generation-1, CTreeParameter::m_processContext.m_generations.at(param.m_pDefinition->s_parameterNumber));
 }
 // construct with low, high channels, units.
 void TPTest::construct_5() {
@@ -527,7 +538,7 @@ void TPTest::construct_5() {
     EQ(unsigned(1024), param.m_pDefinition->s_chans);
     EQ(std::string("mm"), param.m_pDefinition->s_units);
     EQ(false, param.m_pDefinition->s_changed);
-    EQ(CTreeParameter::m_generation-1, param.m_pDefinition->s_generation);
+    EQ(CTreeParameter::m_processContext.m_generation-1, CTreeParameter::m_processContext.m_generations.at(param.m_pDefinition->s_parameterNumber));
 }
 // construct with reslution
 void TPTest::construct_6() {
@@ -542,7 +553,7 @@ void TPTest::construct_6() {
     EQ(unsigned(1024), param.m_pDefinition->s_chans);
     EQ(CTreeParameter::m_defaultSpecification.s_units, param.m_pDefinition->s_units);
     EQ(false, param.m_pDefinition->s_changed);
-    EQ(CTreeParameter::m_generation-1, param.m_pDefinition->s_generation);   
+    EQ(CTreeParameter::m_processContext.m_generation-1, CTreeParameter::m_processContext.m_generations.at(param.m_pDefinition->s_parameterNumber));   
 }
 // old style resolution or width not supported:
 
@@ -566,7 +577,7 @@ void TPTest::construct_8() {
     EQ(original.m_pDefinition->s_chans, copy.m_pDefinition->s_chans);
     EQ(original.m_pDefinition->s_units, copy.m_pDefinition->s_units);
     EQ(false, copy.m_pDefinition->s_changed);
-    EQ(CTreeParameter::m_generation-1, copy.m_pDefinition->s_generation);
+    EQ(CTreeParameter::m_processContext.m_generation-1, CTreeParameter::m_processContext.m_generations.at(copy.m_pDefinition->s_parameterNumber));
 }
 // copy construction
 void TPTest::construct_9() {
@@ -670,8 +681,8 @@ void TPTest::cvtdouble_1() {
     
     // Make this valid with a known value artificially:
     
-    p.m_pDefinition->s_generation = CTreeParameter::m_generation;
-    CTreeParameter::m_event.at(p.m_pDefinition->s_parameterNumber) = 1.2345;
+    CTreeParameter::m_processContext.m_generations.at(p.m_pDefinition->s_parameterNumber) = CTreeParameter::m_processContext.m_generation;
+    CTreeParameter::m_processContext.m_event.at(p.m_pDefinition->s_parameterNumber) = 1.2345;
     
     EQ(double(1.2345), double(p));
 }
@@ -707,17 +718,17 @@ void TPTest::assign_1() {
     
     // Validity book keeping and dope vector done:
     
-    EQ(CTreeParameter::m_generation, p.m_pDefinition->s_generation);
-    EQ(size_t(1), CTreeParameter::m_scoreboard.size());
-    EQ(p.m_pDefinition->s_parameterNumber, CTreeParameter::m_scoreboard[0]);
+    EQ(CTreeParameter::m_processContext.m_generation, CTreeParameter::m_processContext.m_generations.at(p.m_pDefinition->s_parameterNumber));
+    EQ(size_t(1), CTreeParameter::m_processContext.m_scoreboard.size());
+    EQ(p.m_pDefinition->s_parameterNumber, CTreeParameter::m_processContext.m_scoreboard[0]);
     
     // Assigning again does not change the generation or scoreboard;
     
     p = 3.1416;
     EQ(double(3.1416), double(p));
-    EQ(CTreeParameter::m_generation, p.m_pDefinition->s_generation);
-    EQ(size_t(1), CTreeParameter::m_scoreboard.size());
-    EQ(p.m_pDefinition->s_parameterNumber, CTreeParameter::m_scoreboard[0]);
+    EQ(CTreeParameter::m_processContext.m_generation, CTreeParameter::m_processContext.m_generations.at(p.m_pDefinition->s_parameterNumber));
+    EQ(size_t(1), CTreeParameter::m_processContext.m_scoreboard.size());
+    EQ(p.m_pDefinition->s_parameterNumber, CTreeParameter::m_processContext.m_scoreboard[0]);
   
 }
 // Assignments can be chained
@@ -745,13 +756,13 @@ void TPTest::assign_4() {
     CTreeParameter p2("other");          // bound
     p2 = p1;                    // valid.
     
-    EQ(CTreeParameter::m_generation, p2.m_pDefinition->s_generation);  //check validity.
+    EQ(CTreeParameter::m_processContext.m_generation, CTreeParameter::m_processContext.m_generations.at(p2.m_pDefinition->s_parameterNumber));  //check validity.
     EQ(double(3.1416), double(p2));   //get double representation.
     
     // Ensure the validity book keeping was done in the scoreboard:
     
-    EQ(size_t(2), CTreeParameter::m_scoreboard.size());
-    EQ(p2.m_pDefinition->s_parameterNumber, CTreeParameter::m_scoreboard.at(1));
+    EQ(size_t(2), CTreeParameter::m_processContext.m_scoreboard.size());
+    EQ(p2.m_pDefinition->s_parameterNumber, CTreeParameter::m_processContext.m_scoreboard.at(1));
     
     
 }
@@ -1076,6 +1087,44 @@ void TPTest::setunit_2() {
     CTreeParameter p;
     CPPUNIT_ASSERT_THROW(p.setUnit("mm"), std::logic_error);
 }
+// storage type:
+
+void TPTest::storage_1() {
+    CTreeParameter p("test");
+    EQ(VALUE_DOUBLE, p.getStorage());
+    p.resetChanged();
+    CPPUNIT_ASSERT_NO_THROW(p.setStorage(VALUE_UINT16));
+    EQ(VALUE_UINT16, p.getStorage());
+    ASSERT(p.hasChanged());
+    
+    CTreeParameter same("test");
+    EQ(VALUE_UINT16, same.getStorage());
+}
+void TPTest::storage_2() {
+    CTreeParameter p;
+    CPPUNIT_ASSERT_THROW(p.getStorage(), std::logic_error);
+    CPPUNIT_ASSERT_THROW(p.setStorage(VALUE_FLOAT32), std::logic_error);
+}
+void TPTest::storage_3() {
+    CTreeParameter p("test");
+    CPPUNIT_ASSERT_THROW(p.setStorage(VALUE_UINT32 + 1), std::invalid_argument);
+    EQ(VALUE_DOUBLE, p.getStorage());
+}
+// The storage types are indexed by parameter id:
+
+void TPTest::storagetypes() {
+    CTreeParameter a("a");
+    CTreeParameter b("b");
+    CTreeParameter c("c");
+    b.setStorage(VALUE_FLOAT32);
+    c.setStorage(VALUE_UINT16);
+    
+    auto types = CTreeParameter::getStorageTypes();
+    EQ(size_t(3), types.size());
+    EQ(VALUE_DOUBLE, types[a.getId()]);
+    EQ(VALUE_FLOAT32, types[b.getId()]);
+    EQ(VALUE_UINT16, types[c.getId()]);
+}
 // validity:
 
 void TPTest::isvalid_1() {
@@ -1204,4 +1253,22 @@ void TPTest::getdef_2()
         EQ(values[i].second.s_units, r.second.s_units);
     }
     
-}
\ No newline at end of file
+}
+// Definitions come back sorted by name whatever order they were
+// made in, and can be counted without getting them.
+
+void TPTest::getdef_3()
+{
+    EQ(size_t(0), CTreeParameter::getDefinitionCount());
+    CTreeParameter z("z");
+    CTreeParameter a("a");
+    CTreeParameter m("m");
+    EQ(size_t(3), CTreeParameter::getDefinitionCount());
+    
+    auto result = CTreeParameter::getDefinitions();
+    EQ(size_t(3), result.size());
+    EQ(std::string("a"), result[0].first);
+    EQ(std::string("m"), result[1].first);
+    EQ(std::string("z"), result[2].first);
+    EQ(a.getId(), result[0].second.s_parameterNumber);
+}
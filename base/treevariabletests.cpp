@@ -301,16 +301,17 @@ void TVTest::iter_2() {
     CTreeVariable::createDefinition("test3", 3.0, "");
     CTreeVariable::createDefinition("test2", 2.0, "");
     
-    // Iteration order is lexical:
+    // Iteration order is creation order:
     
-    std::vector<std::string> names ={"test1", "test2", "test3", "test4"};
-    std::vector<double> values = {1.0, 2.0, 3.0, 4.0};
+    std::vector<std::string> names ={"test4", "test1", "test3", "test2"};
+    std::vector<double> values = {4.0, 1.0, 3.0, 2.0};
     unsigned i =0;
     for (auto p = CTreeVariable::begin(); p != CTreeVariable::end(); p++ ) {
         EQ(names[i], p->first);
         EQ(values[i], p->second.s_value);
         i++;
     }
+    EQ(unsigned(4), i);
 }
 // empty:
 void TVTest::size_1() {
@@ -0,0 +1,582 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+
+/** @file:  triggerindextests.cpp
+ *  @brief: Tests CTriggerIndex and seeking with it.
+ */
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/Asserter.h>
+#include "Asserts.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <stdexcept>
+#include <string>
+#include <string.h>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "TriggerIndex.h"
+#include "DataWriter.h"
+#include "PatternDataWriter.h"
+#include "DataReader.h"
+#include "MappedDataReader.h"
+#include "InflatingDataReader.h"
+#include "AnalysisRingItems.h"
+
+using namespace frib::analysis;
+static const char* templateFilename="idxXXXXXX.dat";
+static const std::uint32_t PHYSICS_EVENT(30);
+static const std::uint32_t BEGIN_RUN(1);
+
+class triggerindextest : public CppUnit::TestFixture {
+    CPPUNIT_TEST_SUITE(triggerindextest);
+    CPPUNIT_TEST(construct_1);
+    CPPUNIT_TEST(add_1);
+    CPPUNIT_TEST(find_1);
+    CPPUNIT_TEST(io_1);
+    CPPUNIT_TEST(io_2);
+    CPPUNIT_TEST(io_3);
+    CPPUNIT_TEST(describe_1);
+    CPPUNIT_TEST(build_1);
+    CPPUNIT_TEST(build_2);
+    CPPUNIT_TEST(writer_1);
+    CPPUNIT_TEST(writer_2);
+    CPPUNIT_TEST(seek_1);
+    CPPUNIT_TEST(seek_2);
+    CPPUNIT_TEST(seek_3);
+    CPPUNIT_TEST_SUITE_END();
+    
+private:
+    int m_fd;
+    std::string m_filename;
+    std::string m_indexFile;
+public:
+    void setUp() {
+        char ftemplate[100];
+        strncpy(ftemplate, templateFilename, sizeof(ftemplate));
+        m_fd = mkstemps(ftemplate, 4);     // 4 '.dat'
+        if (m_fd < 0) {
+            std::string failmsg = "Failed to make tempfile: ";
+            failmsg += strerror(errno);
+            throw std::runtime_error(failmsg);
+        }
+        m_filename  = ftemplate;
+        m_indexFile = CTriggerIndex::sidecarName(ftemplate);
+    }
+    void tearDown() {
+        close(m_fd);
+        unlink(m_filename.c_str());
+        unlink(m_indexFile.c_str());
+    }
+protected:
+    void construct_1();
+    void add_1();
+    void find_1();
+    void io_1();
+    void io_2();
+    void io_3();
+    void describe_1();
+    void build_1();
+    void build_2();
+    void writer_1();
+    void writer_2();
+    void seek_1();
+    void seek_2();
+    void seek_3();
+private:
+    std::vector<std::pair<unsigned, double>> makeEvent(int i);
+    void writeRaw(int nPhysics);
+    std::vector<std::uint64_t> readTriggers(CDataReader& reader);
+    RingItemHeader itemAt(std::uint64_t offset, std::uint64_t& trigger);
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(triggerindextest);
+
+/**
+ * makeEvent
+ *    Event i has parameters 0..i%3: three patterns.
+ */
+std::vector<std::pair<unsigned, double>>
+triggerindextest::makeEvent(int i)
+{
+    std::vector<std::pair<unsigned, double>> result;
+    for (unsigned p = 0; p <= unsigned(i % 3); p++) {
+        result.push_back({p, p*10.0 + i});
+    }
+    return result;
+}
+/**
+ * writeRaw
+ *    Write a raw event file: a begin run item then nPhysics physics
+ *    events of increasing size with a scaler-ish item after every 10th.
+ *    The first word of each physics event's body is its trigger number.
+ */
+void
+triggerindextest::writeRaw(int nPhysics)
+{
+    std::vector<std::uint32_t> data = {16, BEGIN_RUN, 4, 0};
+    for (int i = 0; i < nPhysics; i++) {
+        std::uint32_t nWords = 4 + i % 5;
+        data.push_back(nWords * sizeof(std::uint32_t));
+        data.push_back(PHYSICS_EVENT);
+        data.push_back(sizeof(std::uint32_t));
+        data.push_back(i);
+        for (std::uint32_t w = 4; w < nWords; w++) data.push_back(w);
+        if (i % 10 == 9) {
+            data.insert(data.end(), {16, 20, 4, 0});
+        }
+    }
+    size_t nBytes = data.size() * sizeof(std::uint32_t);
+    ASSERT(write(m_fd, data.data(), nBytes) == ssize_t(nBytes));
+}
+/**
+ * readTriggers
+ *    @return the triggers of the PARAMETER_DATA items a reader
+ *            returns from where it is to the end of the file.
+ */
+std::vector<std::uint64_t>
+triggerindextest::readTriggers(CDataReader& reader)
+{
+    std::vector<std::uint64_t> result;
+    while (1) {
+        auto block = reader.getBlock(1024*1024);
+        if (!block.s_nbytes) {
+            reader.done();
+            break;
+        }
+        const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(block.s_pData);
+        for (size_t i = 0; i < block.s_nItems; i++) {
+            const ParameterItem* pItem = reinterpret_cast<const ParameterItem*>(p);
+            if (pItem->s_header.s_type == PARAMETER_DATA) {
+                result.push_back(pItem->s_triggerCount);
+            }
+            p += pItem->s_header.s_size;
+        }
+        reader.done();
+    }
+    return result;
+}
+/**
+ * itemAt
+ *    Read the header of the item at an offset of the file and the 64 bit
+ *    word after it (the trigger number of items that have one).
+ */
+RingItemHeader
+triggerindextest::itemAt(std::uint64_t offset, std::uint64_t& trigger)
+{
+    std::uint8_t data[sizeof(RingItemHeader) + sizeof(std::uint64_t)];
+    ASSERT(pread(m_fd, data, sizeof(data), offset) == ssize_t(sizeof(data)));
+    RingItemHeader result;
+    memcpy(&result, data, sizeof(result));
+    memcpy(&trigger, data + sizeof(result), sizeof(trigger));
+    return result;
+}
+// An index needs a nonzero interval.
+
+void triggerindextest::construct_1()
+{
+    EXCEPTION(CTriggerIndex(0), std::invalid_argument);
+    CTriggerIndex index;
+    EQ(CTriggerIndex::DEFAULT_INTERVAL, index.interval());
+    EQ(size_t(0), index.size());
+    EQ(std::uint64_t(0), index.items());
+}
+// Entries are made for the first item with a trigger and then the
+// first one with a trigger at least interval items later.
+
+void triggerindextest::add_1()
+{
+    CTriggerIndex index(3);
+    index.addItem(0, false, 0);       // item 0: no trigger.
+    index.addItem(10, true, 0);       // item 1: entry.
+    index.addItem(20, true, 1);
+    index.addItem(30, true, 2);
+    index.addItem(40, false, 0);      // item 4: due but no trigger.
+    index.addItem(50, true, 3);       // item 5: entry.
+    index.addItem(60, true, 4);
+    index.addItem(70, true, 5);
+    index.addItem(80, true, 6);       // item 8: entry.
+    
+    EQ(std::uint64_t(9), index.items());
+    EQ(size_t(3), index.size());
+    EQ(std::uint64_t(0),  index[0].s_trigger);
+    EQ(std::uint64_t(1),  index[0].s_itemCount);
+    EQ(std::uint64_t(10), index[0].s_offset);
+    EQ(std::uint64_t(3),  index[1].s_trigger);
+    EQ(std::uint64_t(5),  index[1].s_itemCount);
+    EQ(std::uint64_t(50), index[1].s_offset);
+    EQ(std::uint64_t(6),  index[2].s_trigger);
+    EQ(std::uint64_t(80), index[2].s_offset);
+    EXCEPTION(index[3], std::out_of_range);
+    
+    index.clear();
+    EQ(size_t(0), index.size());
+    EQ(std::uint64_t(0), index.items());
+}
+// find gives the last entry at or before a trigger.
+
+void triggerindextest::find_1()
+{
+    CTriggerIndex index(1);
+    index.addItem(100, true, 10);
+    index.addItem(200, true, 20);
+    index.addItem(300, true, 30);
+    
+    ASSERT(index.find(9) == nullptr);
+    EQ(std::uint64_t(100), index.find(10)->s_offset);
+    EQ(std::uint64_t(100), index.find(19)->s_offset);
+    EQ(std::uint64_t(200), index.find(20)->s_offset);
+    EQ(std::uint64_t(300), index.find(1000)->s_offset);
+    
+    CTriggerIndex empty;
+    ASSERT(empty.find(0) == nullptr);
+}
+// An index and its context survive a write/read - even one needing
+// several TRIGGER_INDEX items.
+
+void triggerindextest::io_1()
+{
+    CTriggerIndex index(2);
+    for (std::uint64_t i = 0; i < 200000; i++) {
+        index.addItem(i*100, true, i);
+    }
+    std::uint32_t context[4] = {16, 1234, 4, 56};
+    index.addContext(context);
+    index.setFile(20000000, 1234);
+    index.write(m_indexFile.c_str());
+    
+    CTriggerIndex copy;
+    copy.read(m_indexFile.c_str());
+    EQ(std::uint32_t(2), copy.interval());
+    EQ(std::uint64_t(20000000), copy.fileSize());
+    EQ(std::uint64_t(1234), copy.fileTime());
+    EQ(index.size(), copy.size());
+    for (size_t i = 0; i < copy.size(); i++) {
+        EQ(index[i].s_trigger,   copy[i].s_trigger);
+        EQ(index[i].s_itemCount, copy[i].s_itemCount);
+        EQ(index[i].s_offset,    copy[i].s_offset);
+    }
+    ASSERT(index.context() == copy.context());
+    EQ(size_t(sizeof(context)), copy.context().size());
+    
+    CTriggerIndex empty;                      // Still writes an item.
+    empty.write(m_indexFile.c_str());
+    copy.read(m_indexFile.c_str());
+    EQ(size_t(0), copy.size());
+    EQ(CTriggerIndex::DEFAULT_INTERVAL, copy.interval());
+}
+// Files that are missing or aren't indices throw and leave the index
+// alone.
+
+void triggerindextest::io_2()
+{
+    CTriggerIndex index(1);
+    index.addItem(100, true, 10);
+    EXCEPTION(index.read("/no/such/file.idx"), std::runtime_error);
+    
+    std::uint32_t notIndex[4] = {16, 1234, 4, 56};     // No TRIGGER_INDEX.
+    ASSERT(write(m_fd, notIndex, sizeof(notIndex)) == sizeof(notIndex));
+    EXCEPTION(index.read(m_filename.c_str()), std::runtime_error);
+    
+    index.setFile(1000, 0);
+    index.write(m_indexFile.c_str());
+    int fd = open(m_indexFile.c_str(), O_WRONLY);
+    ASSERT(fd >= 0);
+    std::uint32_t count = 2;                            // Bad entry count.
+    ASSERT(pwrite(fd, &count, sizeof(count), offsetof(TriggerIndex, s_entryCount)) == sizeof(count));
+    close(fd);
+    EXCEPTION(index.read(m_indexFile.c_str()), std::runtime_error);
+    
+    EQ(size_t(1), index.size());
+    EQ(std::uint64_t(10), index[0].s_trigger);
+}
+// An entry past the end of the indexed file is rejected.
+
+void triggerindextest::io_3()
+{
+    CTriggerIndex index(1);
+    index.addItem(100, true, 10);
+    index.addItem(200, true, 11);
+    index.setFile(200, 0);
+    index.write(m_indexFile.c_str());
+    
+    CTriggerIndex copy;
+    EXCEPTION(copy.read(m_indexFile.c_str()), std::runtime_error);
+    EQ(size_t(0), copy.size());
+    
+    index.setFile(201, 0);
+    index.write(m_indexFile.c_str());
+    copy.read(m_indexFile.c_str());
+    EQ(size_t(2), copy.size());
+}
+// An index describes its file until the file changes.
+
+void triggerindextest::describe_1()
+{
+    writeRaw(100);
+    CTriggerIndex index(8);
+    {
+        CMappedDataReader reader(m_filename.c_str());
+        index.build(reader);
+    }
+    ASSERT(!index.describes(m_filename.c_str()));
+    index.describeFile(m_filename.c_str());
+    
+    struct stat info;
+    ASSERT(stat(m_filename.c_str(), &info) == 0);
+    EQ(std::uint64_t(info.st_size), index.fileSize());
+    ASSERT(index.describes(m_filename.c_str()));
+    
+    index.write(m_indexFile.c_str());
+    CTriggerIndex copy;
+    copy.read(m_indexFile.c_str());
+    ASSERT(copy.describes(m_filename.c_str()));
+    
+    std::uint32_t more[2] = {8, 1234};
+    ASSERT(write(m_fd, more, sizeof(more)) == sizeof(more));
+    ASSERT(!copy.describes(m_filename.c_str()));
+    ASSERT(!copy.describes("/no/such/file.dat"));
+    EXCEPTION(index.describeFile("/no/such/file.dat"), std::runtime_error);
+}
+// Raw files are indexed by counting physics events.
+
+void triggerindextest::build_1()
+{
+    writeRaw(100);
+    CTriggerIndex index(8);
+    CMappedDataReader reader(m_filename.c_str());
+    index.build(reader);
+    
+    EQ(std::uint64_t(1 + 100 + 10), index.items());
+    ASSERT(index.size() > 10);
+    std::uint64_t lastItems = 0;
+    for (size_t i = 0; i < index.size(); i++) {
+        std::uint64_t word;
+        RingItemHeader header = itemAt(index[i].s_offset, word);
+        EQ(PHYSICS_EVENT, header.s_type);
+        EQ(index[i].s_trigger, word & 0xffffffff);   // Body starts with it.
+        if (i) {
+            ASSERT(index[i].s_itemCount >= lastItems + 8);
+        }
+        lastItems = index[i].s_itemCount;
+    }
+    EQ(std::uint64_t(0), index[0].s_trigger);
+    EQ(std::uint64_t(1), index[0].s_itemCount);
+    EQ(std::uint64_t(16), index[0].s_offset);
+    ASSERT(index.context().empty());
+}
+// Parameter files are indexed by the items' trigger numbers, including
+// compressed frames and pattern items; pattern definitions are context.
+
+void triggerindextest::build_2()
+{
+    {
+        CPatternDataWriter w(m_filename.c_str());
+        for (int i = 0; i < 100; i++) {
+            w.writeEvent(makeEvent(i), 1000 + i);
+        }
+    }
+    CTriggerIndex index(10);
+    CMappedDataReader reader(m_filename.c_str());
+    index.build(reader);
+    
+    EQ(std::uint64_t(2 + 3 + 100), index.items());   // front matter, patterns.
+    EQ(std::uint64_t(1000), index[0].s_trigger);
+    for (size_t i = 0; i < index.size(); i++) {
+        std::uint64_t trigger;
+        RingItemHeader header = itemAt(index[i].s_offset, trigger);
+        EQ(PATTERN_PARAMETER_DATA, header.s_type);
+        EQ(index[i].s_trigger, trigger);
+    }
+    // Context is the three PARAMETER_PATTERNS items:
+    
+    const std::uint8_t* p = index.context().data();
+    const std::uint8_t* pEnd = p + index.context().size();
+    size_t n = 0;
+    while (p < pEnd) {
+        const RingItemHeader* pHeader = reinterpret_cast<const RingItemHeader*>(p);
+        EQ(PARAMETER_PATTERNS, pHeader->s_type);
+        p += pHeader->s_size;
+        n++;
+    }
+    EQ(size_t(3), n);
+}
+// A writer with an index interval writes the same index build would.
+
+void triggerindextest::writer_1()
+{
+    {
+        CDataWriter w(m_filename.c_str(), CDataWriter::DEFAULT_BUFFER_SIZE, 16);
+        for (int i = 0; i < 200; i++) {
+            w.writeEvent(makeEvent(i), i);
+        }
+        std::uint32_t passthrough[4] = {16, 20, 4, 0};
+        w.writeItem(passthrough);
+        std::vector<std::uint8_t> block;
+        for (int i = 200; i < 300; i++) {
+            auto event = makeEvent(i);
+            std::vector<std::uint8_t> item(
+                sizeof(ParameterItem) + event.size() * sizeof(ParameterValue)
+            );
+            pParameterItem pItem = reinterpret_cast<pParameterItem>(item.data());
+            pItem->s_header.s_size   = item.size();
+            pItem->s_header.s_type   = PARAMETER_DATA;
+            pItem->s_header.s_unused = sizeof(std::uint32_t);
+            pItem->s_triggerCount    = i;
+            pItem->s_parameterCount  = event.size();
+            for (size_t p = 0; p < event.size(); p++) {
+                pItem->s_parameters[p].s_number = event[p].first;
+                pItem->s_parameters[p].s_value  = event[p].second;
+            }
+            block.insert(block.end(), item.begin(), item.end());
+        }
+        w.writeBlock(block.data(), block.size());
+    }
+    CTriggerIndex written;
+    written.read(m_indexFile.c_str());
+    
+    CTriggerIndex built(16);
+    CMappedDataReader reader(m_filename.c_str());
+    built.build(reader);
+    
+    EQ(std::uint32_t(16), written.interval());
+    EQ(built.size(), written.size());
+    for (size_t i = 0; i < built.size(); i++) {
+        EQ(built[i].s_trigger,   written[i].s_trigger);
+        EQ(built[i].s_itemCount, written[i].s_itemCount);
+        EQ(built[i].s_offset,    written[i].s_offset);
+    }
+    
+    // Without an interval there's no index:
+    
+    unlink(m_indexFile.c_str());
+    {
+        CDataWriter w(m_filename.c_str());
+        w.writeEvent(makeEvent(0), 0);
+    }
+    EQ(-1, access(m_indexFile.c_str(), F_OK));
+}
+// The pattern writer indexes its items and keeps its pattern definitions
+// as context.  The index is written when the file is finished.
+
+void triggerindextest::writer_2()
+{
+    {
+        CPatternDataWriter w(m_filename.c_str(), CDataWriter::DEFAULT_BUFFER_SIZE, 10);
+        for (int i = 0; i < 100; i++) {
+            w.writeEvent(makeEvent(i), i);
+        }
+        w.finish();                     // Writes the sidecar.
+        EQ(0, access(m_indexFile.c_str(), R_OK));
+    }
+    CTriggerIndex written;
+    written.read(m_indexFile.c_str());
+    CTriggerIndex built(10);
+    CMappedDataReader reader(m_filename.c_str());
+    built.build(reader);
+    
+    EQ(built.size(), written.size());
+    for (size_t i = 0; i < built.size(); i++) {
+        EQ(built[i].s_trigger, written[i].s_trigger);
+        EQ(built[i].s_offset,  written[i].s_offset);
+    }
+    ASSERT(built.context() == written.context());
+    ASSERT(!written.context().empty());
+}
+// Readers seek to an index entry and read on from there.
+
+void triggerindextest::seek_1()
+{
+    {
+        CDataWriter w(m_filename.c_str(), CDataWriter::DEFAULT_BUFFER_SIZE, 10);
+        for (int i = 0; i < 100; i++) {
+            w.writeEvent(makeEvent(i), i);
+        }
+    }
+    CTriggerIndex index;
+    index.read(m_indexFile.c_str());
+    const TriggerIndexEntry* pEntry = index.find(55);
+    ASSERT(pEntry);
+    EQ(std::uint64_t(50), pEntry->s_trigger);
+    
+    std::vector<std::uint64_t> expected;
+    for (std::uint64_t i = 50; i < 100; i++) expected.push_back(i);
+    
+    CMappedDataReader mapped(m_filename.c_str());
+    mapped.seek(pEntry->s_offset);
+    ASSERT(expected == readTriggers(mapped));
+    mapped.seek(index[0].s_offset);               // Backwards too.
+    EQ(size_t(100), readTriggers(mapped).size());
+    
+    CDataReader buffered(m_filename.c_str(), 1024);
+    ASSERT(buffered.getBlock(1024).s_pData);
+    EXCEPTION(buffered.seek(pEntry->s_offset), std::logic_error);
+    buffered.done();
+    buffered.seek(pEntry->s_offset);
+    ASSERT(expected == readTriggers(buffered));
+}
+// Seeks must be between blocks and, for mapped files, in the file.
+
+void triggerindextest::seek_2()
+{
+    writeRaw(10);
+    CMappedDataReader reader(m_filename.c_str());
+    auto block = reader.getBlock(1024);
+    EXCEPTION(reader.seek(0), std::logic_error);
+    reader.done();
+    EXCEPTION(reader.seek(1000000), std::out_of_range);
+    reader.seek(16);
+    block = reader.getBlock(1024);
+    EQ(size_t(10 + 1), block.s_nItems);
+    reader.done();
+}
+// A pattern encoded file can be read from an index entry once the
+// reader has the index context.
+
+void triggerindextest::seek_3()
+{
+    {
+        CPatternDataWriter w(m_filename.c_str(), CDataWriter::DEFAULT_BUFFER_SIZE, 10);
+        for (int i = 0; i < 100; i++) {
+            w.writeEvent(makeEvent(i), i);
+        }
+    }
+    CTriggerIndex index;
+    index.read(m_indexFile.c_str());
+    const TriggerIndexEntry* pEntry = index.find(70);
+    ASSERT(pEntry);
+    ASSERT(pEntry->s_trigger > 0);
+    
+    std::vector<std::uint64_t> expected;
+    for (std::uint64_t i = pEntry->s_trigger; i < 100; i++) expected.push_back(i);
+    
+    CInflatingDataReader reader(new CMappedDataReader(m_filename.c_str()));
+    reader.seek(pEntry->s_offset);
+    reader.addContext(index.context().data(), index.context().size());
+    ASSERT(expected == readTriggers(reader));
+    
+    // Seeking back to the start re-reads the definitions, which agree
+    // with the context:
+    
+    reader.seek(0);
+    EQ(size_t(100), readTriggers(reader).size());
+}
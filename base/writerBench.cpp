@@ -0,0 +1,149 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     FRIB
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  writerBench.cpp
+ *  @brief: Throughput benchmark for CDataWriter.
+ *
+ *  Writes a synthetic parameter stream several ways and reports the
+ *  throughput of each:
+ *     - legacy      - one write(2) per item field/parameter value which is
+ *                     how CDataWriter::writeEvent used to work.
+ *     - unbuffered  - CDataWriter with no buffering (one write per item).
+ *     - buffered    - CDataWriter with the requested buffer size.
+ *
+ *  Usage:
+ *  \verbatim
+ *     writerBench outfile ?gbytes? ?params-per-event? ?buffersize?
+ *  \endverbatim
+ *  gbytes defaults to 2, params-per-event to 200 and buffersize to
+ *  CDataWriter::DEFAULT_BUFFER_SIZE.  Use a file on the filesystem you want
+ *  to characterize - /dev/null measures just the CPU/syscall overhead.
+ *  The output file is left behind for the caller to remove.
+ */
+#include "DataWriter.h"
+#include "AnalysisRingItems.h"
+#include "TreeParameterArray.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <stdlib.h>
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <stdexcept>
+
+using namespace frib::analysis;
+
+/**
+ * legacyWriteEvent
+ *    Reproduces the original CDataWriter::writeEvent I/O pattern.
+ */
+static void
+legacyWriteEvent(
+    int fd, const std::vector<std::pair<unsigned, double>>& event,
+    std::uint64_t trigger
+) {
+    RingItemHeader header = {
+        std::uint32_t(
+            sizeof(RingItemHeader) + sizeof(std::uint64_t) + sizeof(std::uint32_t)
+            + event.size() * sizeof(ParameterValue)
+        ),
+        PARAMETER_DATA, sizeof(std::uint32_t)
+    };
+    write(fd, &header, sizeof(header));
+    write(fd, &trigger, sizeof(trigger));
+    std::uint32_t n = event.size();
+    write(fd, &n, sizeof(n));
+    for (auto& p : event) {
+        ParameterValue v;
+        v.s_number = p.first;
+        v.s_value  = p.second;
+        write(fd, &v, sizeof(v));
+    }
+}
+/**
+ * report
+ *   Output the results of one run.
+ */
+static void
+report(const char* what, std::uint64_t nEvents, double bytes, double seconds)
+{
+    std::cout << what << ": " << nEvents << " events "
+        << bytes/(1024.0*1024.0) << " MB in " << seconds << " s : "
+        << (bytes/(1024.0*1024.0))/seconds << " MB/s "
+        << nEvents/seconds << " events/s\n";
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        std::cerr << "Usage: writerBench outfile ?gbytes? ?params-per-event? ?buffersize?\n";
+        exit(EXIT_FAILURE);
+    }
+    const char* pFilename = argv[1];
+    double gbytes = (argc > 2) ? atof(argv[2]) : 2.0;
+    unsigned nParams = (argc > 3) ? atoi(argv[3]) : 200;
+    std::size_t bufferSize =
+        (argc > 4) ? atol(argv[4]) : CDataWriter::DEFAULT_BUFFER_SIZE;
+    
+    CTreeParameterArray params("bench", "arb", nParams, 0);
+    
+    std::vector<std::pair<unsigned, double>> event;
+    for (unsigned i = 0; i < nParams; i++) {
+        event.emplace_back(params[i].getId(), i*1.5);
+    }
+    double eventSize = sizeof(RingItemHeader) + sizeof(std::uint64_t)
+        + sizeof(std::uint32_t) + nParams*sizeof(ParameterValue);
+    std::uint64_t nEvents = (gbytes * 1024.0*1024.0*1024.0)/eventSize;
+    double totalBytes = nEvents * eventSize;
+    
+    // Legacy:
+    
+    {
+        int fd = creat(pFilename, S_IRUSR | S_IWUSR | S_IRGRP);
+        if (fd < 0) {
+            std::cerr << "Unable to create " << pFilename << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        auto start = std::chrono::steady_clock::now();
+        for (std::uint64_t i = 0; i < nEvents; i++) {
+            legacyWriteEvent(fd, event, i);
+        }
+        fsync(fd);
+        close(fd);
+        std::chrono::duration<double> t = std::chrono::steady_clock::now() - start;
+        report("legacy", nEvents, totalBytes, t.count());
+    }
+    // Unbuffered and buffered CDataWriter:
+    
+    std::size_t sizes[2] = {0, bufferSize};
+    const char* names[2] = {"unbuffered", "buffered"};
+    for (int i = 0; i < 2; i++) {
+        auto start = std::chrono::steady_clock::now();
+        {
+            CDataWriter w(pFilename, sizes[i]);
+            for (std::uint64_t e = 0; e < nEvents; e++) {
+                w.writeEvent(event, e);
+            }
+            w.flush();
+        }
+        std::chrono::duration<double> t = std::chrono::steady_clock::now() - start;
+        report(names[i], nEvents, totalBytes, t.count());
+    }
+    return EXIT_SUCCESS;
+}
@@ -31,20 +31,21 @@
 #include <stdexcept>
 #include <string>
 #include <string.h>
-
+
 #define private public
-#include "DataWriter.h"
-#include "TreeParameter.h"
-#include "TreeParameterArray.h"
+#include "DataWriter.h"
+#include "TreeParameter.h"
+#include "TreeParameterArray.h"
 #include "TreeVariable.h"
 #include "TreeVariableArray.h"
-#undef private
+#undef private
 
 #include "DataReader.h"
 #include "AnalysisRingItems.h"
+#include "ParameterBatch.h"
 
 
-using namespace frib::analysis;
+using namespace frib::analysis;
 static const char* templateFilename="testXXXXXX.dat";
 
 
@@ -53,17 +54,27 @@ class writertest : public CppUnit::TestFixture {
     CPPUNIT_TEST(construct_1);
     CPPUNIT_TEST(construct_2);
     CPPUNIT_TEST(construct_3);
-    CPPUNIT_TEST(construct_4);
-    CPPUNIT_TEST(construct_5);
-    CPPUNIT_TEST(construct_6);
-    CPPUNIT_TEST(construct_7);
-    
-    CPPUNIT_TEST(write_1);
-    CPPUNIT_TEST(write_2);
-    CPPUNIT_TEST(write_3);
-    
-    CPPUNIT_TEST(writepars_1);
+    CPPUNIT_TEST(construct_4);
+    CPPUNIT_TEST(construct_5);
+    CPPUNIT_TEST(construct_6);
+    CPPUNIT_TEST(construct_7);
+    
+    CPPUNIT_TEST(write_1);
+    CPPUNIT_TEST(write_2);
+    CPPUNIT_TEST(write_3);
+    
+    CPPUNIT_TEST(writepars_1);
     CPPUNIT_TEST(writepars_2);
+    
+    CPPUNIT_TEST(buffered_1);
+    CPPUNIT_TEST(buffered_2);
+    CPPUNIT_TEST(buffered_3);
+    CPPUNIT_TEST(buffered_4);
+    
+    CPPUNIT_TEST(block_1);
+    CPPUNIT_TEST(block_2);
+    
+    CPPUNIT_TEST(finish_1);
     CPPUNIT_TEST_SUITE_END();
     
 private:
@@ -89,88 +100,138 @@ public:
 
         close(m_fd);      // Might have been closed in test so don't check status
         unlink(m_filename.c_str());
-        CTreeParameter::m_parameterDictionary.clear();
+        CTreeParameter::m_parameterDictionary.clear();
         CTreeVariable::m_dictionary.clear();
     }
 protected:
     void construct_1();
     void construct_2();
     void construct_3();
-    void construct_4();
-    void construct_5();
-    void construct_6();
-    void construct_7();
-    
-    void write_1();
-    void write_2();
-    void write_3();
-    
-    void writepars_1();
-    void writepars_2();
-private:
-        void* makeCountingRingItem(
-            void* pBuffer,
-            std::uint32_t totalSize, std::uint8_t first, std::uint8_t step
-        );
+    void construct_4();
+    void construct_5();
+    void construct_6();
+    void construct_7();
+    
+    void write_1();
+    void write_2();
+    void write_3();
+    
+    void writepars_1();
+    void writepars_2();
+    
+    void buffered_1();
+    void buffered_2();
+    void buffered_3();
+    void buffered_4();
+    
+    void block_1();
+    void block_2();
+    
+    void finish_1();
+private:
+        void* makeCountingRingItem(
+            void* pBuffer,
+            std::uint32_t totalSize, std::uint8_t first, std::uint8_t step
+        );
         const void* skipItems(const void* pBuffer, size_t nItems=1);
+        void writeMixed(CDataWriter& w);
+        std::string readFile(int fd);
 };
-
-/**
- * skipItems
- * 
- *   Skip buffered ring item(s).
- * @param pBuffer - Buffer containing a sequence of ring items.
- * @param nItems - number of items to skip.
- * @note the caller is responsible for determining there are at least nItems
- * @return void* pointer to the ring item after skippgin nItesm in the buffer.
- *
- */
-const void*
-writertest::skipItems(const void* pBuffer, size_t nItems) {
-    for (int i =0; i < nItems; i++) {
-        union {
-            const std::uint8_t* p8;
-            const RingItemHeader* ph;
-        } p;
-        p.p8 = reinterpret_cast<const std::uint8_t*>(pBuffer);
-        p.p8 += p.ph->s_size;
-        pBuffer = p.p8;
-    }
-    return pBuffer;
-}
-/**
- * makeCountingRingItem
- *    Create a counting ring item.
- *  @param pBuffer - user buffer must bet at least totalSize bytes of storage.
- *  @param totalSize - Total number of bytes in the ring item to create.
- *  @param first    - Value of first byte of body.
- *  @param step     - Next item step added to prior.
- *  @return void*    - pBuffer
- *
- *  @note the item type will be TEST_DATA, of course.
- */
-void*
-writertest::makeCountingRingItem(
-        void* pBuffer,
-        std::uint32_t totalSize, std::uint8_t first, std::uint8_t step
-) {
-    ASSERT(totalSize >= sizeof(RingItemHeader));   // At least an empty item.
-    pRingItemHeader pHeader = reinterpret_cast<pRingItemHeader>(pBuffer);
-    pHeader->s_size = totalSize;
-    pHeader->s_type = TEST_DATA;
-    pHeader->s_unused = sizeof(std::uint32_t);
-    
-    pHeader++;
-    std::uint8_t* p = reinterpret_cast<std::uint8_t*>(pHeader);
-    totalSize -= sizeof(RingItemHeader);                // Remaining bytes:
-    
-    for (int i =0; i < totalSize; i++) {
-        *p++ = first;
-        first += step;
-    }
-    return pBuffer;
-}
-
+
+/**
+ * skipItems
+ * 
+ *   Skip buffered ring item(s).
+ * @param pBuffer - Buffer containing a sequence of ring items.
+ * @param nItems - number of items to skip.
+ * @note the caller is responsible for determining there are at least nItems
+ * @return void* pointer to the ring item after skippgin nItesm in the buffer.
+ *
+ */
+const void*
+writertest::skipItems(const void* pBuffer, size_t nItems) {
+    for (int i =0; i < nItems; i++) {
+        union {
+            const std::uint8_t* p8;
+            const RingItemHeader* ph;
+        } p;
+        p.p8 = reinterpret_cast<const std::uint8_t*>(pBuffer);
+        p.p8 += p.ph->s_size;
+        pBuffer = p.p8;
+    }
+    return pBuffer;
+}
+/**
+ * makeCountingRingItem
+ *    Create a counting ring item.
+ *  @param pBuffer - user buffer must bet at least totalSize bytes of storage.
+ *  @param totalSize - Total number of bytes in the ring item to create.
+ *  @param first    - Value of first byte of body.
+ *  @param step     - Next item step added to prior.
+ *  @return void*    - pBuffer
+ *
+ *  @note the item type will be TEST_DATA, of course.
+ */
+void*
+writertest::makeCountingRingItem(
+        void* pBuffer,
+        std::uint32_t totalSize, std::uint8_t first, std::uint8_t step
+) {
+    ASSERT(totalSize >= sizeof(RingItemHeader));   // At least an empty item.
+    pRingItemHeader pHeader = reinterpret_cast<pRingItemHeader>(pBuffer);
+    pHeader->s_size = totalSize;
+    pHeader->s_type = TEST_DATA;
+    pHeader->s_unused = sizeof(std::uint32_t);
+    
+    pHeader++;
+    std::uint8_t* p = reinterpret_cast<std::uint8_t*>(pHeader);
+    totalSize -= sizeof(RingItemHeader);                // Remaining bytes:
+    
+    for (int i =0; i < totalSize; i++) {
+        *p++ = first;
+        first += step;
+    }
+    return pBuffer;
+}
+/**
+ * writeMixed
+ *    Write a mix of events and passthrough items of various sizes.
+ * @param w - the writer to use.
+ */
+void
+writertest::writeMixed(CDataWriter& w)
+{
+    std::uint32_t item[1024];
+    std::vector<std::pair<unsigned, double>> event;
+    for (int i = 0; i < 100; i++) {
+        event.clear();
+        for (int p = 0; p < i; p++) {
+            event.push_back({p, p*1.5 + i});
+        }
+        w.writeEvent(event, i);
+        if ((i % 10) == 0) {
+            w.writeItem(makeCountingRingItem(item, 12 + i*40, i, 1));
+        }
+    }
+}
+/**
+ * readFile
+ *    Return the entire contents of a file.
+ *  @param fd - file descriptor open on the file.
+ *  @return std::string - the file contents.
+ */
+std::string
+writertest::readFile(int fd)
+{
+    std::string result;
+    char buffer[8192];
+    lseek(fd, 0, SEEK_SET);
+    ssize_t n;
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+        result.append(buffer, n);
+    }
+    return result;
+}
 
 CPPUNIT_TEST_SUITE_REGISTRATION(writertest);
 
@@ -248,265 +309,429 @@ void writertest::construct_4() {
     // I'm not sure why but if optimization is -O2 the following fails to
     // put name to be "a" but instead leaves it as an empty string:
     //std::string name = std::string(pParams->s_parameters[0].s_parameterName);
-    //EQ(defs[0].first, name);
-    
-    
-    
-}
-// A few tree parameter defs - using an array:
-
-void writertest::construct_5() {
-        CTreeParameterArray a("a", "mm", 16, 0);
-        {
-            CDataWriter w(m_filename.c_str());
-        }                                    // CLosed.
-        CDataReader reader(m_fd, 8192*10);
-        auto r = reader.getBlock(8192*10);   // Slurp it all in.
-        
-        EQ(size_t(2), r.s_nItems);  // got boht.
-        
-        const ParameterDefinitions* pParams =
-            reinterpret_cast<const ParameterDefinitions*>(r.s_pData);
-        EQ(PARAMETER_DEFINITIONS, pParams->s_header.s_type);
-        EQ(std::uint32_t(16), pParams->s_numParameters);
-        
-        const ParameterDefinition* p = pParams->s_parameters;
-        union {
-            const std::uint8_t* p8;
-            const ParameterDefinition* pv;
-        } pp;
-        pp.pv = p;
-        for (int i = 0; i <16; i++) {
-            
-            EQ(a[i].getId(), pp.pv->s_parameterNumber);
-            EQ(0, strcmp(a[i].getName().c_str(), pp.pv->s_parameterName));
-            pp.p8 += sizeof(ParameterDefinition) + strlen(pp.pv->s_parameterName) + 1;
-        }
-        
-}
-// Single tree variable:
-void writertest::construct_6() {
-    CTreeVariable a("a", "mm");
-    a = 3.1416;                          // Give it a value.
-    
-    {
-        CDataWriter w(m_filename.c_str());
-    }                                    // CLosed.
-    CDataReader reader(m_fd, 8192*10);
-    auto r = reader.getBlock(8192*10);   // Slurp it all in.
-    
-    EQ(size_t(2), r.s_nItems);  // got both
-    
-    // Skip the first one:
-    
-    union {
-        const std::uint8_t* p8;
-        const RingItemHeader* ph;
-    } pItem;
-    pItem.ph = reinterpret_cast<const RingItemHeader*>(r.s_pData);
-    pItem.p8 += pItem.ph->s_size;
-    
-    //  Item should be a variable def item with 1 variable:
-    
-    EQ(VARIABLE_VALUES, pItem.ph->s_type);
-    union {
-        const std::uint8_t* p8;
-        const VariableItem* pv;
-    } pv;
-    pv.p8 = pItem.p8;
-    EQ(std::uint32_t(1), pv.pv->s_numVars);
-    
-    
-    union {
-        const std::uint8_t* p8;
-        const Variable*     pv;
-    } p;
-    p.pv = pv.pv->s_variables;
-    
-    EQ(double(a), p.pv->s_value);
-    EQ(0, strcmp(a.getUnit().c_str(), p.pv->s_variableUnits));
-    EQ(0, strcmp(a.getName().c_str(), p.pv->s_variableName));
-    
-}
-// multiple tree variables:
-
-void writertest::construct_7()
-{
-    CTreeVariableArray a("a", 1.2345, "mm", 16, 0);
-    {
-        CDataWriter w(m_filename.c_str());
-    }                                    // CLosed.
-    CDataReader reader(m_fd, 8192*10);
-    auto r = reader.getBlock(8192*10);   // Slurp it all in.
-    
-    EQ(size_t(2), r.s_nItems);  // got both
-    
-    // Skip the first one:
-    
-    union {
-        const std::uint8_t* p8;
-        const RingItemHeader* ph;
-    } pItem;
-    pItem.ph = reinterpret_cast<const RingItemHeader*>(r.s_pData);
-    pItem.p8 += pItem.ph->s_size;
-    
-    //  Item should be a variable def item with 1 variable:
-    
-    EQ(VARIABLE_VALUES, pItem.ph->s_type);
-    union {
-        const std::uint8_t* p8;
-        const VariableItem* pv;
-    } pv;
-    pv.p8 = pItem.p8;
-    EQ(std::uint32_t(16), pv.pv->s_numVars);
-    
-    union {
-        const std::uint8_t* p8;
-        const Variable*     pv;
-    } p;
-    p.pv = pv.pv->s_variables;
-    
-    for (int i =0; i < 16; i++) {
-        EQ(double(a[i]), p.pv->s_value);
-        EQ(0, strcmp(a[i].getUnit().c_str(), p.pv->s_variableUnits));
-        EQ(0, strcmp(a[i].getName().c_str(), p.pv->s_variableName));
-        p.p8 += sizeof(Variable) + strlen(p.pv->s_variableName) +1;
-    }
-}
-// Write an empty ring item:
-
-void writertest::write_1()
-{
-    RingItemHeader item;
-    void* pItem = makeCountingRingItem(&item, sizeof(item), 0, 0);
-    {
-        CDataWriter w(m_filename.c_str());
-        w.writeItem(pItem);
-    }
-    // The file should have three items - empty parameter defs, empty var values
-    // and the empty ring item in item.
-    
-    CDataReader reader(m_fd, 8192*10);
-    auto r = reader.getBlock(8192*10);
-    EQ(size_t(3), r.s_nItems);
-    
-    const void* pReadItem = skipItems(r.s_pData, 2); // s.b. item.
-    EQ(0, memcmp(pItem, pReadItem, sizeof(RingItemHeader)));
-    
-}
-// Write a ring item with some contents:
-
-void writertest::write_2()
-{
-    std::uint32_t item[8192];
-    void* pItem = makeCountingRingItem(item, 100, 1, 1);
-    {
-        CDataWriter w(m_filename.c_str());
-        w.writeItem(pItem);
-    }
-    // The file should have three items - empty parameter defs, empty var values
-    // and the empty ring item in item.
-    
-    CDataReader reader(m_fd, 8192*10);
-    auto r = reader.getBlock(8192*10);
-    EQ(size_t(3), r.s_nItems);
-    
-    const void* pReadItem = skipItems(r.s_pData, 2); // s.b. item.
-    
-    // Ensure the size is right:
-    
-    const RingItemHeader* pHeader = reinterpret_cast<const RingItemHeader*>(pReadItem);
-    EQ(size_t(100), size_t(pHeader->s_size));
-    EQ(TEST_DATA, pHeader->s_type);
-    EQ(sizeof(std::uint32_t), size_t(pHeader->s_unused));
-    
-    EQ(0, memcmp(item, pReadItem, 100));
-    
-}
-// write a couple non-empty ring items
-void writertest::write_3() {
-    std::uint32_t item1[200];
-    std::uint32_t item2[100];
-    void* pItem1 = makeCountingRingItem(item1, 200, 1, 1);
-    void* pItem2 = makeCountingRingItem(item2, 100, 1, 2);
-    
-    {
-        CDataWriter w(m_filename.c_str());
-        w.writeItem(item1);
-        w.writeItem(item2);
-    }
-    // The file should have three items - empty parameter defs, empty var values
-    // and the empty ring item in item.
-    
-    CDataReader reader(m_fd, 8192*10);
-    auto r = reader.getBlock(8192*10);
-    EQ(size_t(4), r.s_nItems);
-    
-    const void* pReadItem = skipItems(r.s_pData, 2); // s.b. item.
-    const RingItemHeader* pHeader = reinterpret_cast<const RingItemHeader*>(pReadItem);
-    EQ(size_t(200), size_t(pHeader->s_size));
-    EQ(TEST_DATA, pHeader->s_type);
-    EQ(sizeof(std::uint32_t), size_t(pHeader->s_unused));
-    EQ(0, memcmp(item1, pReadItem, 200));
-    
-    pReadItem = skipItems(pReadItem);
-    pHeader = reinterpret_cast<const RingItemHeader*>(pReadItem);
-    EQ(size_t(100), size_t(pHeader->s_size));
-    EQ(TEST_DATA, pHeader->s_type);
-    EQ(sizeof(std::uint32_t), size_t(pHeader->s_unused));
-    EQ(0, memcmp(item2, pReadItem, 100));
-}
-// write empty parameters record:
-
-void writertest::writepars_1()
-{
-    std::vector<std::pair<unsigned, double>> event;
-    {
-        CDataWriter w(m_filename.c_str());
-        w.writeEvent(event, 123);
-    }
-    CDataReader reader(m_fd, 8192*10);
-    auto r = reader.getBlock(8192*10);
-    EQ(size_t(3), r.s_nItems);
-    
-    const void* pReadItem = skipItems(r.s_pData, 2);
-    const ParameterItem* pItem = reinterpret_cast<const ParameterItem*>(pReadItem);
-    EQ(PARAMETER_DATA, pItem->s_header.s_type);
-    EQ(std::uint32_t(sizeof(ParameterItem)), pItem->s_header.s_size);
-    EQ(std::uint32_t(sizeof(std::uint32_t)), pItem->s_header.s_unused);
-    EQ(std::uint64_t(123), pItem->s_triggerCount);
-    EQ(std::uint32_t(0), pItem->s_parameterCount);  
-}
-// write a non-empty parameters record:
-
-void writertest::writepars_2()
-{
-    std::vector<std::pair<unsigned, double>> event;
-    for (int i = 0; i < 10; i++) {
-        event.push_back({i*2, 3.1416*2});
-    }
-    {
-        CDataWriter w(m_filename.c_str());
-        w.writeEvent(event, 123);
-    }
-    CDataReader reader(m_fd, 8192*10);
-    auto r = reader.getBlock(8192*10);
-    EQ(size_t(3), r.s_nItems);
-    
-    const void* pReadItem = skipItems(r.s_pData, 2);
-    const ParameterItem* pItem = reinterpret_cast<const ParameterItem*>(pReadItem);
-    EQ(PARAMETER_DATA, pItem->s_header.s_type);
-    EQ(
-       std::uint32_t(sizeof(ParameterItem)+ 10*(sizeof(std::uint32_t) + sizeof(double))),
-        pItem->s_header.s_size
-    );
-    EQ(std::uint32_t(sizeof(std::uint32_t)), pItem->s_header.s_unused);
-    EQ(std::uint64_t(123), pItem->s_triggerCount);
-    EQ(std::uint32_t(10), pItem->s_parameterCount);
-    const ParameterValue* p = pItem->s_parameters;
-    for (int i =0; i < 10; i++) {
-        EQ(std::uint32_t(i*2), p->s_number);
-        EQ(double(3.1416*2), p->s_value);
-        p++;
-    }
-}
\ No newline at end of file
+    //EQ(defs[0].first, name);
+    
+    
+    
+}
+// A few tree parameter defs - using an array:
+
+void writertest::construct_5() {
+        CTreeParameterArray a("a", "mm", 16, 0);
+        {
+            CDataWriter w(m_filename.c_str());
+        }                                    // CLosed.
+        CDataReader reader(m_fd, 8192*10);
+        auto r = reader.getBlock(8192*10);   // Slurp it all in.
+        
+        EQ(size_t(2), r.s_nItems);  // got boht.
+        
+        const ParameterDefinitions* pParams =
+            reinterpret_cast<const ParameterDefinitions*>(r.s_pData);
+        EQ(PARAMETER_DEFINITIONS, pParams->s_header.s_type);
+        EQ(std::uint32_t(16), pParams->s_numParameters);
+        
+        const ParameterDefinition* p = pParams->s_parameters;
+        union {
+            const std::uint8_t* p8;
+            const ParameterDefinition* pv;
+        } pp;
+        pp.pv = p;
+        for (int i = 0; i <16; i++) {
+            
+            EQ(a[i].getId(), pp.pv->s_parameterNumber);
+            EQ(0, strcmp(a[i].getName().c_str(), pp.pv->s_parameterName));
+            pp.p8 += sizeof(ParameterDefinition) + strlen(pp.pv->s_parameterName) + 1;
+        }
+        
+}
+// Single tree variable:
+void writertest::construct_6() {
+    CTreeVariable a("a", "mm");
+    a = 3.1416;                          // Give it a value.
+    
+    {
+        CDataWriter w(m_filename.c_str());
+    }                                    // CLosed.
+    CDataReader reader(m_fd, 8192*10);
+    auto r = reader.getBlock(8192*10);   // Slurp it all in.
+    
+    EQ(size_t(2), r.s_nItems);  // got both
+    
+    // Skip the first one:
+    
+    union {
+        const std::uint8_t* p8;
+        const RingItemHeader* ph;
+    } pItem;
+    pItem.ph = reinterpret_cast<const RingItemHeader*>(r.s_pData);
+    pItem.p8 += pItem.ph->s_size;
+    
+    //  Item should be a variable def item with 1 variable:
+    
+    EQ(VARIABLE_VALUES, pItem.ph->s_type);
+    union {
+        const std::uint8_t* p8;
+        const VariableItem* pv;
+    } pv;
+    pv.p8 = pItem.p8;
+    EQ(std::uint32_t(1), pv.pv->s_numVars);
+    
+    
+    union {
+        const std::uint8_t* p8;
+        const Variable*     pv;
+    } p;
+    p.pv = pv.pv->s_variables;
+    
+    EQ(double(a), p.pv->s_value);
+    EQ(0, strcmp(a.getUnit().c_str(), p.pv->s_variableUnits));
+    EQ(0, strcmp(a.getName().c_str(), p.pv->s_variableName));
+    
+}
+// multiple tree variables:
+
+void writertest::construct_7()
+{
+    CTreeVariableArray a("a", 1.2345, "mm", 16, 0);
+    {
+        CDataWriter w(m_filename.c_str());
+    }                                    // CLosed.
+    CDataReader reader(m_fd, 8192*10);
+    auto r = reader.getBlock(8192*10);   // Slurp it all in.
+    
+    EQ(size_t(2), r.s_nItems);  // got both
+    
+    // Skip the first one:
+    
+    union {
+        const std::uint8_t* p8;
+        const RingItemHeader* ph;
+    } pItem;
+    pItem.ph = reinterpret_cast<const RingItemHeader*>(r.s_pData);
+    pItem.p8 += pItem.ph->s_size;
+    
+    //  Item should be a variable def item with 1 variable:
+    
+    EQ(VARIABLE_VALUES, pItem.ph->s_type);
+    union {
+        const std::uint8_t* p8;
+        const VariableItem* pv;
+    } pv;
+    pv.p8 = pItem.p8;
+    EQ(std::uint32_t(16), pv.pv->s_numVars);
+    
+    union {
+        const std::uint8_t* p8;
+        const Variable*     pv;
+    } p;
+    p.pv = pv.pv->s_variables;
+    
+    for (int i =0; i < 16; i++) {
+        EQ(double(a[i]), p.pv->s_value);
+        EQ(0, strcmp(a[i].getUnit().c_str(), p.pv->s_variableUnits));
+        EQ(0, strcmp(a[i].getName().c_str(), p.pv->s_variableName));
+        p.p8 += sizeof(Variable) + strlen(p.pv->s_variableName) +1;
+    }
+}
+// Write an empty ring item:
+
+void writertest::write_1()
+{
+    RingItemHeader item;
+    void* pItem = makeCountingRingItem(&item, sizeof(item), 0, 0);
+    {
+        CDataWriter w(m_filename.c_str());
+        w.writeItem(pItem);
+    }
+    // The file should have three items - empty parameter defs, empty var values
+    // and the empty ring item in item.
+    
+    CDataReader reader(m_fd, 8192*10);
+    auto r = reader.getBlock(8192*10);
+    EQ(size_t(3), r.s_nItems);
+    
+    const void* pReadItem = skipItems(r.s_pData, 2); // s.b. item.
+    EQ(0, memcmp(pItem, pReadItem, sizeof(RingItemHeader)));
+    
+}
+// Write a ring item with some contents:
+
+void writertest::write_2()
+{
+    std::uint32_t item[8192];
+    void* pItem = makeCountingRingItem(item, 100, 1, 1);
+    {
+        CDataWriter w(m_filename.c_str());
+        w.writeItem(pItem);
+    }
+    // The file should have three items - empty parameter defs, empty var values
+    // and the empty ring item in item.
+    
+    CDataReader reader(m_fd, 8192*10);
+    auto r = reader.getBlock(8192*10);
+    EQ(size_t(3), r.s_nItems);
+    
+    const void* pReadItem = skipItems(r.s_pData, 2); // s.b. item.
+    
+    // Ensure the size is right:
+    
+    const RingItemHeader* pHeader = reinterpret_cast<const RingItemHeader*>(pReadItem);
+    EQ(size_t(100), size_t(pHeader->s_size));
+    EQ(TEST_DATA, pHeader->s_type);
+    EQ(sizeof(std::uint32_t), size_t(pHeader->s_unused));
+    
+    EQ(0, memcmp(item, pReadItem, 100));
+    
+}
+// write a couple non-empty ring items
+void writertest::write_3() {
+    std::uint32_t item1[200];
+    std::uint32_t item2[100];
+    void* pItem1 = makeCountingRingItem(item1, 200, 1, 1);
+    void* pItem2 = makeCountingRingItem(item2, 100, 1, 2);
+    
+    {
+        CDataWriter w(m_filename.c_str());
+        w.writeItem(item1);
+        w.writeItem(item2);
+    }
+    // The file should have three items - empty parameter defs, empty var values
+    // and the empty ring item in item.
+    
+    CDataReader reader(m_fd, 8192*10);
+    auto r = reader.getBlock(8192*10);
+    EQ(size_t(4), r.s_nItems);
+    
+    const void* pReadItem = skipItems(r.s_pData, 2); // s.b. item.
+    const RingItemHeader* pHeader = reinterpret_cast<const RingItemHeader*>(pReadItem);
+    EQ(size_t(200), size_t(pHeader->s_size));
+    EQ(TEST_DATA, pHeader->s_type);
+    EQ(sizeof(std::uint32_t), size_t(pHeader->s_unused));
+    EQ(0, memcmp(item1, pReadItem, 200));
+    
+    pReadItem = skipItems(pReadItem);
+    pHeader = reinterpret_cast<const RingItemHeader*>(pReadItem);
+    EQ(size_t(100), size_t(pHeader->s_size));
+    EQ(TEST_DATA, pHeader->s_type);
+    EQ(sizeof(std::uint32_t), size_t(pHeader->s_unused));
+    EQ(0, memcmp(item2, pReadItem, 100));
+}
+// write empty parameters record:
+
+void writertest::writepars_1()
+{
+    std::vector<std::pair<unsigned, double>> event;
+    {
+        CDataWriter w(m_filename.c_str());
+        w.writeEvent(event, 123);
+    }
+    CDataReader reader(m_fd, 8192*10);
+    auto r = reader.getBlock(8192*10);
+    EQ(size_t(3), r.s_nItems);
+    
+    const void* pReadItem = skipItems(r.s_pData, 2);
+    const ParameterItem* pItem = reinterpret_cast<const ParameterItem*>(pReadItem);
+    EQ(PARAMETER_DATA, pItem->s_header.s_type);
+    EQ(std::uint32_t(sizeof(ParameterItem)), pItem->s_header.s_size);
+    EQ(std::uint32_t(sizeof(std::uint32_t)), pItem->s_header.s_unused);
+    EQ(std::uint64_t(123), pItem->s_triggerCount);
+    EQ(std::uint32_t(0), pItem->s_parameterCount);  
+}
+// write a non-empty parameters record:
+
+void writertest::writepars_2()
+{
+    std::vector<std::pair<unsigned, double>> event;
+    for (int i = 0; i < 10; i++) {
+        event.push_back({i*2, 3.1416*2});
+    }
+    {
+        CDataWriter w(m_filename.c_str());
+        w.writeEvent(event, 123);
+    }
+    CDataReader reader(m_fd, 8192*10);
+    auto r = reader.getBlock(8192*10);
+    EQ(size_t(3), r.s_nItems);
+    
+    const void* pReadItem = skipItems(r.s_pData, 2);
+    const ParameterItem* pItem = reinterpret_cast<const ParameterItem*>(pReadItem);
+    EQ(PARAMETER_DATA, pItem->s_header.s_type);
+    EQ(
+       std::uint32_t(sizeof(ParameterItem)+ 10*(sizeof(std::uint32_t) + sizeof(double))),
+        pItem->s_header.s_size
+    );
+    EQ(std::uint32_t(sizeof(std::uint32_t)), pItem->s_header.s_unused);
+    EQ(std::uint64_t(123), pItem->s_triggerCount);
+    EQ(std::uint32_t(10), pItem->s_parameterCount);
+    const ParameterValue* p = pItem->s_parameters;
+    for (int i =0; i < 10; i++) {
+        EQ(std::uint32_t(i*2), p->s_number);
+        EQ(double(3.1416*2), p->s_value);
+        p++;
+    }
+}// Buffered and unbuffered writers make identical files - small buffer
+// so that some events and items don't fit in the buffer.
+
+void writertest::buffered_1()
+{
+    CTreeParameterArray a("a", "mm", 16, 0);
+    {
+        CDataWriter w(m_filename.c_str(), 0);
+        writeMixed(w);
+    }
+    std::string unbuffered = readFile(m_fd);
+    
+    int fd = open(m_filename.c_str(), O_RDWR | O_TRUNC);
+    {
+        CDataWriter w(fd, 256);
+        writeMixed(w);
+    }
+    std::string buffered = readFile(m_fd);
+    EQ(unbuffered.size(), buffered.size());
+    ASSERT(unbuffered == buffered);
+}
+// Default buffering makes the same file too:
+
+void writertest::buffered_2()
+{
+    CTreeParameterArray a("a", "mm", 16, 0);
+    {
+        CDataWriter w(m_filename.c_str(), 0);
+        writeMixed(w);
+    }
+    std::string unbuffered = readFile(m_fd);
+    
+    int fd = open(m_filename.c_str(), O_RDWR | O_TRUNC);
+    {
+        CDataWriter w(fd);
+        writeMixed(w);
+    }
+    std::string buffered = readFile(m_fd);
+    ASSERT(unbuffered == buffered);
+}
+// Data are buffered until flushed:
+
+void writertest::buffered_3()
+{
+    std::vector<std::pair<unsigned, double>> event = {{1, 2.0}};
+    CDataWriter w(m_filename.c_str(), 8192);
+    w.writeEvent(event, 1);
+    EQ(size_t(0), readFile(m_fd).size());
+    
+    w.flush();
+    std::string contents = readFile(m_fd);
+    lseek(m_fd, 0, SEEK_SET);
+    CDataReader reader(m_fd, 8192*10);
+    auto r = reader.getBlock(8192*10);
+    EQ(size_t(3), r.s_nItems);
+    EQ(contents.size(), r.s_nbytes);
+    const ParameterItem* pItem =
+        reinterpret_cast<const ParameterItem*>(skipItems(r.s_pData, 2));
+    EQ(PARAMETER_DATA, pItem->s_header.s_type);
+    EQ(std::uint64_t(1), pItem->s_triggerCount);
+    EQ(std::uint32_t(1), pItem->s_parameterCount);
+    EQ(std::uint32_t(1), pItem->s_parameters[0].s_number);
+    EQ(2.0, pItem->s_parameters[0].s_value);
+}
+// Passthrough bigger than the buffer goes out in order after buffered data.
+
+void writertest::buffered_4()
+{
+    std::uint32_t item[1024];
+    makeCountingRingItem(item, sizeof(item), 0, 1);
+    std::vector<std::pair<unsigned, double>> event = {{1, 2.0}};
+    {
+        CDataWriter w(m_filename.c_str(), 100);
+        w.writeEvent(event, 1);
+        w.writeItem(item);
+        w.writeEvent(event, 2);
+    }
+    CDataReader reader(m_fd, 8192*10);
+    auto r = reader.getBlock(8192*10);
+    EQ(size_t(5), r.s_nItems);
+    const ParameterItem* pEvent =
+        reinterpret_cast<const ParameterItem*>(skipItems(r.s_pData, 2));
+    EQ(std::uint64_t(1), pEvent->s_triggerCount);
+    const void* pItem = skipItems(pEvent);
+    EQ(0, memcmp(item, pItem, sizeof(item)));
+    pEvent = reinterpret_cast<const ParameterItem*>(skipItems(pItem));
+    EQ(std::uint64_t(2), pEvent->s_triggerCount);
+}
+// Writing a batch of events as a block makes the same file as writing the
+// events one at a time.
+
+void writertest::block_1()
+{
+    std::vector<std::pair<unsigned, double>> event;
+    CParameterBatch batch(1000, 1024*1024);
+    {
+        CDataWriter w(m_filename.c_str(), 0);
+        for (int i = 0; i < 50; i++) {
+            event.clear();
+            for (int p = 0; p < i; p++) {
+                event.push_back({p, p*1.5 + i});
+            }
+            w.writeEvent(event, i);
+            batch.addEvent(event, i);
+        }
+    }
+    std::string expected = readFile(m_fd);
+    
+    int fd = open(m_filename.c_str(), O_RDWR | O_TRUNC);
+    {
+        CDataWriter w(fd, 8192*10);
+        w.writeBlock(batch.data(), batch.size());
+    }
+    std::string contents = readFile(m_fd);
+    EQ(expected.size(), contents.size());
+    ASSERT(expected == contents);
+}
+// A block that doesn't fit in the buffer goes out in order after the
+// buffered data:
+
+void writertest::block_2()
+{
+    std::vector<std::pair<unsigned, double>> event = {{1, 2.0}, {3, 4.0}};
+    CParameterBatch batch(1000, 1024*1024);
+    for (int i = 1; i < 21; i++) {
+        batch.addEvent(event, i);
+    }
+    {
+        CDataWriter w(m_filename.c_str(), 100);
+        w.writeEvent(event, 0);
+        w.writeBlock(batch.data(), batch.size());
+        w.writeEvent(event, 21);
+    }
+    CDataReader reader(m_fd, 8192*10);
+    auto r = reader.getBlock(8192*10);
+    EQ(size_t(2 + 22), r.s_nItems);
+    const void* p = skipItems(r.s_pData, 2);
+    for (int i = 0; i < 22; i++) {
+        const ParameterItem* pItem = reinterpret_cast<const ParameterItem*>(p);
+        EQ(std::uint32_t(PARAMETER_DATA), pItem->s_header.s_type);
+        EQ(std::uint64_t(i), pItem->s_triggerCount);
+        p = skipItems(p);
+    }
+}
+// finish writes out the file and reports failures to do so (every write
+// to /dev/full fails with ENOSPC).  Once finished, finishing does nothing.
+
+void writertest::finish_1()
+{
+    std::vector<std::pair<unsigned, double>> event = {{1, 2.0}, {3, 4.0}};
+    {
+        CDataWriter w(m_filename.c_str());
+        w.writeEvent(event, 0);
+        w.finish();
+        w.finish();
+        
+        CDataReader reader(m_fd, 8192);
+        auto r = reader.getBlock(8192);
+        EQ(size_t(3), r.s_nItems);
+    }
+    CDataWriter full("/dev/full");
+    full.writeEvent(event, 0);
+    EXCEPTION(full.finish(), std::runtime_error);
+    CPPUNIT_ASSERT_NO_THROW(full.finish());
+}
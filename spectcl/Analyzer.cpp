@@ -63,7 +63,7 @@ namespace frib {
          */
         UInt_t
         CAnalyzer::getParametersInEvent() const {
-            return CTreeParameter::getDefinitions().size();    // Not terribly efficient.
+            return CTreeParameter::getDefinitionCount();
         }
         /**
          * getDecoder
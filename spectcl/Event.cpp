@@ -20,7 +20,6 @@
  */
 #include "Event.h"
 #include "TreeParameter.h"
-#include <algorithm>
 #include <sstream>
 namespace frib {
     namespace analysis {
@@ -47,32 +46,27 @@ namespace frib {
          *    Indexing the revent is mostly as simple as providing the
          *    index to the array.  _However_
          *    -  If the index does not exist a new tree parameter is created.
-         *    -  If the index is not in the scoreboard it's added.
+         *    -  If the index is not yet set this event, it's marked as
+         *       set and added to the scoreboard.  Like CTreeParameter
+         *       this uses the context's generation stamps so it's O(1);
+         *       the scoreboard is not searched.
          * @parameter nParam - index into the parameter vector.
          * @return CParameterValue&  where CParameterValue is just a double.
-         * @note Since we don't touch the underlying tree parameter and its shared data,
-         *    isValid isn't going to work on this   That's ok because there's
-         *    no isValid in CParameterValue anymore.  We strongly suggest the
-         *    use of CTreeParameters and not CEvent as targets of the
-         *    unpacking.
+         * @note Since we return a reference, we can't tell reads from writes
+         *    so any access makes the parameter valid for the event.
+         *    We strongly suggest the use of CTreeParameters and not CEvent
+         *    as targets of the unpacking.
          *    
          */
         CParameterValue&
         CEvent::operator[](UInt_t nParam) {
             // If necessary make the tree parameter.
             
-            
-            if (CTreeParameter::m_event.size() <= nParam) {
+            CTreeParameterContext& context(CTreeParameter::context());
+            if (context.m_event.size() <= nParam) {
                 makeParameter(nParam);
             }
-            if (std::find(
-                CTreeParameter::m_scoreboard.begin(),
-                CTreeParameter::m_scoreboard.end(),
-                nParam) == CTreeParameter::m_scoreboard.end()) {
-                CTreeParameter::m_scoreboard.push_back(nParam);
-            }
-            return CTreeParameter::m_event[nParam];
-            
+            return context.reference(nParam);
         }
         
         /**
@@ -81,7 +75,7 @@ namespace frib {
          */
         CEventIterator
         CEvent::begin() {
-            return CTreeParameter::m_event.begin();
+            return CTreeParameter::context().m_event.begin();
         }
         /**
          * end
@@ -90,7 +84,7 @@ namespace frib {
          */
         CEventIterator
         CEvent::end() {
-            return CTreeParameter::m_event.end();
+            return CTreeParameter::context().m_event.end();
         }
         /**
          * size()
@@ -98,7 +92,7 @@ namespace frib {
          */
         UInt_t
         CEvent::size() {
-            return CTreeParameter::m_event.size();
+            return CTreeParameter::context().m_event.size();
         }
         /**
          * clear
@@ -123,14 +117,16 @@ namespace frib {
         /**
          * makeParameter
          *     Well this really might make many parameters.  Given an index
-         *     we add Tree parameter instances until CTreeParameter::m_event.size()
+         *     we add Tree parameter instances until the event in this thread's
+         *     tree parameter context
          *     can accomodate a specific index.
          *     These tree parameters have names but should be thought of as anonymous.
          *     
          */
         void
         CEvent::makeParameter(unsigned index) {
-            unsigned n = CTreeParameter::m_event.size();
+            CTreeParameterContext& context(CTreeParameter::context());
+            unsigned n = context.m_event.size();
             do {
                std::stringstream namestr;
                namestr << "_unnamed." << n;
@@ -138,6 +134,7 @@ namespace frib {
                CTreeParameter p(name);
                n++;
             } while (n <= (index));
+            context.resize(index + 1);    // In case the names already existed.
         }
         
         
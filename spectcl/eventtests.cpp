@@ -46,11 +46,9 @@ public:
         
         // Empty everything.
         
-        CTreeParameter::m_generation = 1;
+        CTreeParameter::m_processContext.clear();
         CTreeParameter::m_parameterDictionary.clear();
         CTreeParameter::m_nextId = 0;
-        CTreeParameter::m_event.clear();
-        CTreeParameter::m_scoreboard.clear();
         
     }
     void tearDown() {
@@ -88,15 +86,21 @@ void eventtest::exist_2() {
     CEvent e;
     e[t1.getId()] = 2.0;
     
-    EQ(size_t(1), CTreeParameter::m_scoreboard.size());
+    EQ(size_t(1), CTreeParameter::m_processContext.m_scoreboard.size());
     EQ(size_t(1), CTreeParameter::m_parameterDictionary.size());
 }
-// setting via array does not set valid (flaw).
+// setting via array sets the tree parameter valid and
+// setting it again doesn't duplicate it in the scoreboard.
 void eventtest::exist_3() {
     CTreeParameter t1("t1");
     CEvent e;
     e[t1.getId()] = 2.0;
-    ASSERT(!t1.isValid());  // nasty incompatibility.
+    ASSERT(t1.isValid());
+    EQ(double(2.0), double(t1));
+    t1 = 3.0;
+    e[t1.getId()] = 4.0;
+    EQ(size_t(1), CTreeParameter::m_processContext.m_scoreboard.size());
+    EQ(double(4.0), double(t1));
 }
 // Have to create a new tree parameter:
 
@@ -105,7 +109,7 @@ void eventtest::new_1() {
     e[0] = 1.2345;       // Made a new one.
     EQ(double(1.2345), e[0]);
     EQ(size_t(1), CTreeParameter::m_parameterDictionary.size());
-    EQ(size_t(1), CTreeParameter::m_scoreboard.size());
+    EQ(size_t(1), CTreeParameter::m_processContext.m_scoreboard.size());
     
 }
 // Created a tree parameter.
@@ -124,7 +128,7 @@ void eventtest::new_3() {
     CEvent e;
     e[2] = 1.2345;
     EQ(size_t(3), CTreeParameter::m_parameterDictionary.size());
-    EQ(size_t(1), CTreeParameter::m_scoreboard.size());
+    EQ(size_t(1), CTreeParameter::m_processContext.m_scoreboard.size());
     double d = e[1];                                     // nasty incompatiblilty...
-    EQ(size_t(2),  CTreeParameter::m_scoreboard.size()); // peculiarity of CEvent
+    EQ(size_t(2),  CTreeParameter::m_processContext.m_scoreboard.size()); // peculiarity of CEvent
 }
\ No newline at end of file
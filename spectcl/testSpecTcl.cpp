@@ -77,8 +77,7 @@ public:
         delete m_pArray;
         
         CTreeParameter::m_parameterDictionary.clear();
-        CTreeParameter::m_scoreboard.clear();
-        CTreeParameter::m_event.clear();
+        CTreeParameter::m_processContext.clear();
         
         for (auto p: m_fileToInternalMapping) {
             delete p;
@@ -140,8 +140,7 @@ public:
         // Clear the tree parameter defs etc.:
         
         CTreeParameter::m_parameterDictionary.clear();
-        CTreeParameter::m_event.clear();
-        CTreeParameter::m_scoreboard.clear();
+        CTreeParameter::m_processContext.clear();
     }
     void tearDown() {
         delete m_pWorker;